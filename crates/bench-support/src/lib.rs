@@ -0,0 +1,237 @@
+//! Driver shared by the workspace's `harness = false` benchmarks
+//!
+//! Each benchmark supplies its cases and how to measure one; this runs them
+//! under the common command line:
+//!
+//! ```text
+//! [FILTER] [--save FILE] [--baseline FILE] [--threshold PCT] [own options]
+//! ```
+//!
+//! Only cases whose name contains `FILTER` run. `--save` writes the results,
+//! and `--baseline` compares against a saved run and fails when a number grew
+//! by more than the threshold. Results are tab-separated `key\tvalue` lines.
+
+use std::collections::BTreeMap;
+use std::env;
+use std::error::Error;
+use std::fmt::{Display, Write as _};
+use std::fs;
+use std::path::{Path, PathBuf};
+use std::process::ExitCode;
+use std::str::FromStr;
+
+/// Measurements saved and compared between runs, by key
+pub type Results = BTreeMap<String, f64>;
+
+/// The options every benchmark takes
+pub struct Options {
+    pub filter: Option<String>,
+    pub save: Option<PathBuf>,
+    pub baseline: Option<PathBuf>,
+    /// Percent growth from the baseline that counts as a regression
+    pub threshold: f64,
+}
+
+impl Options {
+    /// Parse the command line, with `threshold` as the default threshold
+    ///
+    /// Options the benchmark defines go to `own` with a way to take their
+    /// value; it returns whether it knew the option.
+    pub fn parse(
+        threshold: f64,
+        mut own: impl FnMut(&str, &mut dyn FnMut() -> Result<String, String>) -> Result<bool, String>,
+    ) -> Result<Self, String> {
+        let mut options = Options {
+            filter: None,
+            save: None,
+            baseline: None,
+            threshold,
+        };
+        let mut args = env::args().skip(1);
+        while let Some(arg) = args.next() {
+            let mut value = || args.next().ok_or(format!("{arg} needs a value"));
+            match arg.as_str() {
+                // Passed by `cargo bench`
+                "--bench" => {}
+                "--save" => options.save = Some(value()?.into()),
+                "--baseline" => options.baseline = Some(value()?.into()),
+                "--threshold" => options.threshold = number(&value()?)?,
+                _ if own(&arg, &mut value)? => {}
+                _ if arg.starts_with('-') => return Err(format!("unknown option {arg}")),
+                _ => options.filter = Some(arg),
+            }
+        }
+        Ok(options)
+    }
+}
+
+/// Parse an option's numeric value
+pub fn number<T: FromStr>(text: &str) -> Result<T, String>
+where
+    T::Err: Display,
+{
+    text.parse().map_err(|e| format!("{e}"))
+}
+
+/// How results print: decimal places and a unit after each number
+#[derive(Debug, Clone, Copy)]
+pub struct Format {
+    pub decimals: usize,
+    pub unit: &'static str,
+}
+
+/// The workspace checkout
+pub fn root() -> PathBuf {
+    Path::new(env!("CARGO_MANIFEST_DIR")).join("../..")
+}
+
+/// Every example program, C then Rust, sorted within each
+pub fn examples() -> Vec<PathBuf> {
+    let mut paths = Vec::new();
+    for (dir, ext) in [("sdk/c/examples", "c"), ("crates/smd/examples", "rs")] {
+        let Ok(entries) = fs::read_dir(root().join(dir)) else {
+            continue;
+        };
+        let mut found: Vec<_> = entries
+            .filter_map(|entry| entry.ok().map(|e| e.path()))
+            .filter(|path| path.extension().is_some_and(|e| e == ext))
+            .collect();
+        found.sort();
+        paths.extend(found);
+    }
+    paths
+}
+
+/// File name of `path`, which names its case
+pub fn file_name(path: &Path) -> String {
+    path.file_name()
+        .unwrap_or_default()
+        .to_string_lossy()
+        .to_string()
+}
+
+/// Measure the `cases` `options` selects with `bench`, then save and
+/// compare the results as asked
+///
+/// A case whose error `skipped` accepts, such as one the compiler can't
+/// build yet, is reported and left out rather than failing the run.
+pub fn run<T>(
+    options: &Options,
+    format: Format,
+    cases: &[(String, T)],
+    mut bench: impl FnMut(&str, &T) -> Result<Results, Box<dyn Error>>,
+    skipped: impl Fn(&(dyn Error + 'static)) -> bool,
+) -> ExitCode {
+    let mut results = Results::new();
+    let mut failures = 0;
+    for (name, case) in cases {
+        if options
+            .filter
+            .as_ref()
+            .is_some_and(|f| !name.contains(f.as_str()))
+        {
+            continue;
+        }
+        match bench(name, case) {
+            Ok(r) => results.extend(r),
+            Err(e) if skipped(e.as_ref()) => println!("{name}: skipped, does not compile\n"),
+            Err(e) => {
+                println!("{name}: FAILED: {e}\n");
+                failures += 1;
+            }
+        }
+    }
+    if let Some(path) = &options.save
+        && let Err(e) = save(path, &results, format)
+    {
+        eprintln!("error: {}: {e}", path.display());
+        return ExitCode::FAILURE;
+    }
+    if let Some(path) = &options.baseline {
+        match load(path) {
+            Ok(baseline) => failures += compare(&results, &baseline, options.threshold, format),
+            Err(e) => {
+                eprintln!("error: {}: {e}", path.display());
+                return ExitCode::FAILURE;
+            }
+        }
+    }
+    if failures > 0 {
+        ExitCode::FAILURE
+    } else {
+        ExitCode::SUCCESS
+    }
+}
+
+fn load(path: &Path) -> Result<Results, Box<dyn Error>> {
+    let mut results = Results::new();
+    for line in fs::read_to_string(path)?.lines() {
+        let Some((key, value)) = line.rsplit_once('\t') else {
+            continue;
+        };
+        results.insert(key.to_string(), value.parse()?);
+    }
+    Ok(results)
+}
+
+fn save(path: &Path, results: &Results, format: Format) -> std::io::Result<()> {
+    let mut text = String::new();
+    for (key, value) in results {
+        let _ = writeln!(text, "{key}\t{value:.0$}", format.decimals);
+    }
+    fs::write(path, text)
+}
+
+/// Print how `results` moved from `baseline`; returns the regressions
+fn compare(results: &Results, baseline: &Results, threshold: f64, format: Format) -> usize {
+    println!("change from baseline:");
+    let Format { decimals, unit } = format;
+    let mut regressions = 0;
+    for (key, &new) in results {
+        let Some(&old) = baseline.get(key) else {
+            continue;
+        };
+        let change = if old == 0.0 {
+            0.0
+        } else {
+            (new - old) * 100.0 / old
+        };
+        let flag = if change > threshold {
+            regressions += 1;
+            "  REGRESSION"
+        } else {
+            ""
+        };
+        println!(
+            "  {:<40} {old:>10.decimals$}{unit} -> {new:>10.decimals$}{unit}  {change:>+6.2}%{flag}",
+            key.replace('\t', " ")
+        );
+    }
+    regressions
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_saved_results_load_back() {
+        let path = env::temp_dir().join(format!("bench-support-{}.tsv", std::process::id()));
+        let results = Results::from([
+            ("hello.c\tframe".to_string(), 1234.0),
+            ("pong.rs".to_string(), 2.5),
+        ]);
+        let format = Format {
+            decimals: 3,
+            unit: "ms",
+        };
+        save(&path, &results, format).unwrap();
+        let loaded = load(&path).unwrap();
+        fs::remove_file(&path).unwrap();
+        assert_eq!(loaded, results);
+
+        let slower = Results::from([("pong.rs".to_string(), 2.6)]);
+        assert_eq!(compare(&slower, &loaded, 10.0, format), 0);
+        assert_eq!(compare(&slower, &loaded, 2.0, format), 1);
+    }
+}
@@ -54,6 +54,7 @@
 //! - [`types`] - Common types and constants
 
 #![no_std]
+#![cfg_attr(target_arch = "m68k", feature(asm_experimental_arch))]
 #![allow(dead_code)]
 
 pub mod input;
@@ -15,7 +15,15 @@
 //!
 //! // Hide unused sprites
 //! sprite::hide(1);
+//!
+//! // Send the changes to VRAM during the next vblank
+//! sprite::flush();
 //! ```
+//!
+//! The functions here edit a copy of the sprite attribute table in work RAM
+//! and track which entries changed. [`flush()`] queues the changed span as a
+//! single DMA on the [`vdp`] DMA queue, instead of setting up a VRAM write
+//! for every field.
 
 use crate::vdp;
 
@@ -182,6 +190,31 @@ impl Sprite {
     }
 }
 
+/// Work RAM copy of the sprite attribute table
+static mut SHADOW: [[u16; 4]; MAX_SPRITES as usize] = [[0; 4]; MAX_SPRITES as usize];
+
+/// Dirty entries `[DIRTY_LO, DIRTY_HI)`; empty when `DIRTY_HI <= DIRTY_LO`
+static mut DIRTY_LO: u8 = 0;
+static mut DIRTY_HI: u8 = 0;
+
+/// Write a shadow entry and widen the dirty range to cover it
+fn write(index: u8, entry: [u16; 4]) {
+    unsafe {
+        SHADOW[index as usize] = entry;
+        DIRTY_LO = DIRTY_LO.min(index);
+        DIRTY_HI = DIRTY_HI.max(index + 1);
+    }
+}
+
+/// Link to the next sprite in the default chain
+fn next_link(index: u8) -> u16 {
+    if index < MAX_SPRITES - 1 {
+        u16::from(index + 1)
+    } else {
+        0
+    }
+}
+
 /// Initialize sprite system
 ///
 /// Clears all 80 sprite entries and sets up default linking.
@@ -200,75 +233,50 @@ pub fn init() {
 /// * `size` - Sprite size
 /// * `tile` - Base tile index (and attributes)
 pub fn set(index: u8, x: i16, y: i16, size: SpriteSize, tile: u16) {
-    let addr = SPRITE_TABLE + (index as u16) * 8;
-    vdp::set_write_addr(addr);
-
-    // Word 0: Y position + 128
-    vdp::write_data((y + 128) as u16);
-
-    // Word 1: Size (upper byte) | Link (lower byte)
-    let next = if index < MAX_SPRITES - 1 {
-        index + 1
-    } else {
-        0
-    };
-    vdp::write_data(((size as u16) << 8) | (next as u16));
-
-    // Word 2: Tile attributes
-    vdp::write_data(tile);
-
-    // Word 3: X position + 128
-    vdp::write_data((x + 128) as u16);
+    write(
+        index,
+        [
+            (y + 128) as u16,
+            ((size as u16) << 8) | next_link(index),
+            tile,
+            (x + 128) as u16,
+        ],
+    );
 }
 
 /// Update sprite from Sprite structure
 pub fn update(index: u8, spr: &Sprite) {
-    let addr = SPRITE_TABLE + (index as u16) * 8;
-    vdp::set_write_addr(addr);
-
-    vdp::write_data((spr.y + 128) as u16);
-
-    let next = if index < MAX_SPRITES - 1 {
-        index + 1
-    } else {
-        0
-    };
-    vdp::write_data(((spr.size as u16) << 8) | (next as u16));
-
-    vdp::write_data(spr.tile | spr.attr);
-    vdp::write_data((spr.x + 128) as u16);
+    write(
+        index,
+        [
+            (spr.y + 128) as u16,
+            (u16::from(spr.size) << 8) | next_link(index),
+            spr.tile | spr.attr,
+            (spr.x + 128) as u16,
+        ],
+    );
 }
 
 /// Set sprite position only
 ///
 /// Faster than `set()` when only position changes.
 pub fn set_pos(index: u8, x: i16, y: i16) {
-    let addr = SPRITE_TABLE + (index as u16) * 8;
-
-    // Write Y position
-    vdp::set_write_addr(addr);
-    vdp::write_data((y + 128) as u16);
-
-    // Write X position (skip to word 3)
-    vdp::set_write_addr(addr + 6);
-    vdp::write_data((x + 128) as u16);
+    let mut entry = entry(index);
+    entry[0] = (y + 128) as u16;
+    entry[3] = (x + 128) as u16;
+    write(index, entry);
 }
 
 /// Hide a sprite (move off-screen)
 pub fn hide(index: u8) {
-    let addr = SPRITE_TABLE + (index as u16) * 8;
-    vdp::set_write_addr(addr);
-    vdp::write_data(0); // Y = 0 (off-screen with +128 offset = 128, but 0 ends list)
+    let mut entry = entry(index);
+    entry[0] = 0; // Y = 0 (off-screen with +128 offset = 128, but 0 ends list)
+    write(index, entry);
 }
 
 /// Clear a sprite entry
 pub fn clear(index: u8) {
-    let addr = SPRITE_TABLE + (index as u16) * 8;
-    vdp::set_write_addr(addr);
-    vdp::write_data(0);
-    vdp::write_data(0);
-    vdp::write_data(0);
-    vdp::write_data(0);
+    write(index, [0; 4]);
 }
 
 /// Set sprite link (for custom sprite ordering)
@@ -277,12 +285,9 @@ pub fn clear(index: u8) {
 /// * `index` - Sprite index (0-79)
 /// * `next` - Next sprite index (0 = end of list)
 pub fn set_link(index: u8, next: u8) {
-    let addr = SPRITE_TABLE + (index as u16) * 8 + 2;
-    vdp::set_write_addr(addr);
-    // Read current size, update link
-    // For simplicity, we just write size 0 with new link
-    // In real usage, you'd want to preserve the size
-    vdp::write_data(next as u16);
+    let mut entry = entry(index);
+    entry[1] = (entry[1] & 0xFF00) | u16::from(next);
+    write(index, entry);
 }
 
 /// Clear all sprites
@@ -293,3 +298,27 @@ pub fn clear_all() {
         clear(i);
     }
 }
+
+/// Current shadow table entry: Y, size/link, attributes, X
+pub fn entry(index: u8) -> [u16; 4] {
+    unsafe { SHADOW[index as usize] }
+}
+
+/// Queue the entries changed since the last flush as one DMA
+///
+/// Call once per frame, after the last sprite update. If the DMA queue is
+/// full the entries stay dirty and go with the next flush.
+pub fn flush() {
+    unsafe {
+        if DIRTY_HI <= DIRTY_LO {
+            return;
+        }
+        let lo = u16::from(DIRTY_LO);
+        let src = (&raw const SHADOW).cast::<u16>().add(usize::from(lo) * 4);
+        let len = (u16::from(DIRTY_HI) - lo) * 4;
+        if vdp::dma_queue_transfer(src, SPRITE_TABLE + lo * 8, len) {
+            DIRTY_LO = MAX_SPRITES;
+            DIRTY_HI = 0;
+        }
+    }
+}
@@ -111,12 +111,12 @@ pub mod tile {
 ///
 /// Configures:
 /// - 320x224 (H40) display mode
-/// - Display enabled, Mode 5
+/// - Display and DMA enabled, Mode 5, as the C SDK's `vdp_init`
 /// - Default plane addresses
 /// - Auto-increment of 2
 pub fn init() {
     set_reg(0, 0x04); // Mode register 1
-    set_reg(1, 0x44); // Mode register 2: display on, Mode 5
+    set_reg(1, 0x54); // Mode register 2: display on, DMA on, Mode 5
     set_reg(2, 0x30); // Plane A address: 0xC000
     set_reg(3, 0x00); // Window address
     set_reg(4, 0x07); // Plane B address: 0xE000
@@ -312,3 +312,346 @@ pub fn clear_plane_b() {
         write_data(0);
     }
 }
+
+// ---------------------------------------------------------------------------
+// DMA
+// ---------------------------------------------------------------------------
+
+/// Program the DMA length registers (19-20)
+fn set_dma_length(len: u16) {
+    set_reg(19, len as u8);
+    set_reg(20, (len >> 8) as u8);
+}
+
+/// Wait for a fill or VRAM copy to finish, then restore auto-increment 2
+fn finish_byte_dma() {
+    while status() & 0x02 != 0 {}
+    set_reg(15, 2);
+}
+
+/// DMA `len` words from 68000 memory to VRAM, starting now
+///
+/// Needs DMA enabled in mode register 2 (bit 4), as [`init`] leaves it.
+pub fn dma_transfer(src: *const u16, dst: u16, len: u16) {
+    let src = (src as u32) >> 1;
+    set_dma_length(len);
+    set_reg(21, src as u8);
+    set_reg(22, (src >> 8) as u8);
+    set_reg(23, ((src >> 16) & 0x7F) as u8);
+    unsafe {
+        VDP_CTRL.write_volatile(0x4000 | (dst & 0x3FFF));
+        VDP_CTRL.write_volatile(0x0080 | ((dst >> 14) & 0x03));
+    }
+}
+
+/// Fill `len` bytes of VRAM at `dst` with `value`, starting now
+pub fn dma_fill(dst: u16, value: u16, len: u16) {
+    set_reg(15, 1);
+    set_dma_length(len);
+    set_reg(23, 0x80);
+    unsafe {
+        VDP_CTRL.write_volatile(0x4000 | (dst & 0x3FFF));
+        VDP_CTRL.write_volatile(0x0080 | ((dst >> 14) & 0x03));
+        VDP_DATA.write_volatile(value);
+    }
+    finish_byte_dma();
+}
+
+/// Copy `len` bytes of VRAM from `src` to `dst`, starting now
+pub fn dma_copy(src: u16, dst: u16, len: u16) {
+    set_reg(15, 1);
+    set_dma_length(len);
+    set_reg(21, src as u8);
+    set_reg(22, (src >> 8) as u8);
+    set_reg(23, 0xC0);
+    unsafe {
+        VDP_CTRL.write_volatile(0x4000 | (dst & 0x3FFF));
+        VDP_CTRL.write_volatile(0x00C0 | ((dst >> 14) & 0x03));
+    }
+    finish_byte_dma();
+}
+
+// ---------------------------------------------------------------------------
+// DMA queue
+// ---------------------------------------------------------------------------
+//
+// The VDP moves data several times faster in vblank than during active
+// display, so VRAM updates are queued during the frame and started by
+// `dma_queue_flush()` once vblank begins. Like the other DMAs they need DMA
+// enabled in mode register 2, which `init()` does.
+
+/// Entries the DMA queue holds
+pub const DMA_QUEUE_LEN: usize = 32;
+
+/// DMA bytes one flush starts, about what one NTSC vblank moves in H40
+pub const DMA_BUDGET: u32 = 7200;
+
+#[derive(Clone, Copy, PartialEq, Eq)]
+enum DmaKind {
+    Transfer,
+    Fill,
+    Copy,
+}
+
+/// A queued DMA; `len` is in words for transfers and bytes otherwise
+#[derive(Clone, Copy)]
+struct DmaEntry {
+    kind: DmaKind,
+    src: u32,
+    dst: u16,
+    len: u16,
+    value: u16,
+}
+
+impl DmaEntry {
+    const EMPTY: DmaEntry = DmaEntry {
+        kind: DmaKind::Transfer,
+        src: 0,
+        dst: 0,
+        len: 0,
+        value: 0,
+    };
+
+    fn bytes(&self) -> u32 {
+        match self.kind {
+            DmaKind::Transfer => u32::from(self.len) * 2,
+            DmaKind::Fill | DmaKind::Copy => u32::from(self.len),
+        }
+    }
+}
+
+static mut DMA_QUEUE: [DmaEntry; DMA_QUEUE_LEN] = [DmaEntry::EMPTY; DMA_QUEUE_LEN];
+static mut DMA_HEAD: usize = 0;
+static mut DMA_COUNT: usize = 0;
+
+/// Run `f` with interrupts masked, then restore the previous mask
+///
+/// Keeps an interrupt handler from seeing the queue half updated, or from
+/// writing a VDP command between the two words of one of ours.
+#[inline]
+fn without_interrupts<R>(f: impl FnOnce() -> R) -> R {
+    #[cfg(target_arch = "m68k")]
+    unsafe {
+        let sr: u16;
+        core::arch::asm!(
+            "move.w %sr, {sr}",
+            "move.w {masked}, %sr",
+            sr = out(reg_data) sr,
+            masked = in(reg_data) 0x2700u16,
+            options(nostack),
+        );
+        let result = f();
+        core::arch::asm!("move.w {sr}, %sr", sr = in(reg_data) sr, options(nostack));
+        result
+    }
+    #[cfg(not(target_arch = "m68k"))]
+    f()
+}
+
+/// Append `entry`, or extend the newest entry when it is a transfer that
+/// `entry` continues in both 68000 memory and VRAM
+fn dma_queue_push(entry: DmaEntry) -> bool {
+    without_interrupts(|| unsafe {
+        if entry.kind == DmaKind::Transfer && DMA_COUNT > 0 {
+            let last = &mut DMA_QUEUE[(DMA_HEAD + DMA_COUNT - 1) % DMA_QUEUE_LEN];
+            let bytes = last.bytes();
+            let len = u32::from(last.len) + u32::from(entry.len);
+            // The source may not cross a 128 KB bank
+            let end = last.src + len * 2 - 1;
+            if last.kind == DmaKind::Transfer
+                && last.src + bytes == entry.src
+                && u32::from(last.dst) + bytes == u32::from(entry.dst)
+                && len <= 0xFFFF
+                && (last.src ^ end) & 0xFFFE_0000 == 0
+            {
+                last.len = len as u16;
+                return true;
+            }
+        }
+        if DMA_COUNT == DMA_QUEUE_LEN {
+            return false;
+        }
+        DMA_QUEUE[(DMA_HEAD + DMA_COUNT) % DMA_QUEUE_LEN] = entry;
+        DMA_COUNT += 1;
+        true
+    })
+}
+
+/// Queue a DMA of `len` words from 68000 memory to VRAM
+///
+/// Returns `false` if the queue is full.
+pub fn dma_queue_transfer(src: *const u16, dst: u16, len: u16) -> bool {
+    dma_queue_push(DmaEntry {
+        kind: DmaKind::Transfer,
+        src: src as u32,
+        dst,
+        len,
+        value: 0,
+    })
+}
+
+/// Queue a fill of `len` bytes of VRAM with `value`
+///
+/// Returns `false` if the queue is full.
+pub fn dma_queue_fill(dst: u16, value: u16, len: u16) -> bool {
+    dma_queue_push(DmaEntry {
+        kind: DmaKind::Fill,
+        src: 0,
+        dst,
+        len,
+        value,
+    })
+}
+
+/// Queue a copy of `len` bytes within VRAM
+///
+/// Returns `false` if the queue is full.
+pub fn dma_queue_copy(src: u16, dst: u16, len: u16) -> bool {
+    dma_queue_push(DmaEntry {
+        kind: DmaKind::Copy,
+        src: u32::from(src),
+        dst,
+        len,
+        value: 0,
+    })
+}
+
+/// Number of DMAs waiting in the queue
+pub fn dma_queue_len() -> usize {
+    unsafe { DMA_COUNT }
+}
+
+/// Start queued DMAs, oldest first, until [`DMA_BUDGET`] bytes have gone
+///
+/// Call this once vblank begins, e.g. right after [`vsync()`]. It runs with
+/// interrupts masked, and the oldest entry always goes, so one larger than
+/// the budget cannot stall the queue. Needs DMA enabled, as [`init`] leaves
+/// it; otherwise the entries are dropped without reaching VRAM.
+pub fn dma_queue_flush() {
+    let mut budget = DMA_BUDGET;
+    without_interrupts(|| unsafe {
+        while DMA_COUNT > 0 && budget > 0 {
+            let entry = DMA_QUEUE[DMA_HEAD];
+            match entry.kind {
+                DmaKind::Transfer => dma_transfer(entry.src as *const u16, entry.dst, entry.len),
+                DmaKind::Fill => dma_fill(entry.dst, entry.value, entry.len),
+                DmaKind::Copy => dma_copy(entry.src as u16, entry.dst, entry.len),
+            }
+            budget = budget.saturating_sub(entry.bytes());
+            DMA_HEAD = (DMA_HEAD + 1) % DMA_QUEUE_LEN;
+            DMA_COUNT -= 1;
+        }
+    });
+}
+
+/// Drop every queued DMA
+pub fn dma_queue_clear() {
+    without_interrupts(|| unsafe {
+        DMA_HEAD = 0;
+        DMA_COUNT = 0;
+    });
+}
+
+// ---------------------------------------------------------------------------
+// Packed tiles
+// ---------------------------------------------------------------------------
+//
+// `smdc --pack` compresses tile data into chunks of at most 4096 bytes, each
+// a big-endian word of its decoded length followed by tokens: `0nnnnnnn`
+// is `n + 1` literal bytes, `1nnnnnnn` plus a big-endian word `d` copies
+// `n + 3` bytes from `d` back in the chunk. A zero length ends the data.
+
+/// Bytes of RAM [`load_tiles_packed`] unpacks into: two chunks, so one can
+/// unpack while the last waits for its DMA
+pub const UNPACK_WINDOW: usize = 8192;
+
+/// Word aligned, as DMA reads words
+#[repr(align(2))]
+struct Window([u8; UNPACK_WINDOW]);
+
+static mut UNPACK: Window = Window([0; UNPACK_WINDOW]);
+static mut UNPACK_USED: usize = 0;
+
+/// Decode the tokens of one chunk from `src` into all of `out`, returning
+/// how many bytes of `src` they took
+fn unpack_chunk(src: &[u8], out: &mut [u8]) -> usize {
+    let (mut i, mut o) = (0, 0);
+    while o < out.len() {
+        let token = src[i];
+        i += 1;
+        if token & 0x80 == 0 {
+            let n = usize::from(token) + 1;
+            out[o..o + n].copy_from_slice(&src[i..i + n]);
+            i += n;
+            o += n;
+        } else {
+            let n = usize::from(token & 0x7F) + 3;
+            let distance = usize::from(u16::from_be_bytes([src[i], src[i + 1]]));
+            i += 2;
+            // Byte by byte: the copy may overlap what it writes
+            for _ in 0..n {
+                out[o] = out[o - distance];
+                o += 1;
+            }
+        }
+    }
+    i
+}
+
+/// Unpack data packed by `smdc --pack` into `out`, returning its length
+pub fn unpack(packed: &[u8], out: &mut [u8]) -> usize {
+    let (mut i, mut o) = (0, 0);
+    loop {
+        let len = usize::from(u16::from_be_bytes([packed[i], packed[i + 1]]));
+        i += 2;
+        if len == 0 {
+            return o;
+        }
+        i += unpack_chunk(&packed[i..], &mut out[o..o + len]);
+        o += len;
+    }
+}
+
+/// Load tiles packed by `smdc --pack`
+///
+/// Each chunk is unpacked into a RAM window and queued for DMA, so the tiles
+/// reach VRAM over the next vblanks. When the window or the queue is full
+/// this flushes the queue at the next vblank itself, so don't call it from
+/// an interrupt handler. Needs DMA enabled, as [`init`] leaves it.
+///
+/// # Arguments
+/// * `index` - Starting tile index (0-2047)
+/// * `packed` - Packed tile data
+pub fn load_tiles_packed(index: u16, packed: &[u8]) {
+    let mut dst = index * 32;
+    let mut i = 0;
+    loop {
+        let len = usize::from(u16::from_be_bytes([packed[i], packed[i + 1]]));
+        i += 2;
+        if len == 0 {
+            return;
+        }
+        unsafe {
+            // Nothing queued reads the window any more
+            if dma_queue_len() == 0 {
+                UNPACK_USED = 0;
+            }
+            if UNPACK_USED + len > UNPACK_WINDOW {
+                while dma_queue_len() > 0 {
+                    vsync();
+                    dma_queue_flush();
+                }
+                UNPACK_USED = 0;
+            }
+            let base = (&raw mut UNPACK).cast::<u8>();
+            let window = core::slice::from_raw_parts_mut(base.add(UNPACK_USED), len);
+            i += unpack_chunk(&packed[i..], window);
+            UNPACK_USED += len;
+            while !dma_queue_transfer(window.as_ptr().cast(), dst, (len / 2) as u16) {
+                vsync();
+                dma_queue_flush();
+            }
+        }
+        dst = dst.wrapping_add(len as u16);
+    }
+}
@@ -31,3 +31,24 @@ fn test_attr_flags() {
     assert_eq!(attr::VFLIP, 0x1000);
     assert_eq!(attr::HFLIP, 0x0800);
 }
+
+#[test]
+fn test_shadow_table_flush() {
+    use smd::sprite;
+    use smd::vdp::{dma_queue_clear, dma_queue_len};
+
+    dma_queue_clear();
+    sprite::set(3, 10, 20, SpriteSize::Size2x2, 0x0123);
+    sprite::set_link(3, 7);
+    assert_eq!(sprite::entry(3), [148, 0x0507, 0x0123, 138]);
+
+    // Entries 0-3 changed (the range starts at 0), sent in one DMA
+    sprite::set_pos(1, 0, 0);
+    sprite::flush();
+    assert_eq!(dma_queue_len(), 1);
+
+    // Nothing changed since, so nothing to send
+    sprite::flush();
+    assert_eq!(dma_queue_len(), 1);
+    dma_queue_clear();
+}
@@ -0,0 +1,37 @@
+use smd::vdp::{DMA_QUEUE_LEN, dma_queue_clear, dma_queue_fill, dma_queue_len, dma_queue_transfer};
+
+// The queue is global state, so one test walks through it in order
+#[test]
+fn test_dma_queue() {
+    static DATA: [u16; 64] = [0; 64];
+    dma_queue_clear();
+
+    // Transfers continuing each other in RAM and VRAM share an entry
+    assert!(dma_queue_transfer(DATA.as_ptr(), 0x1000, 16));
+    assert!(dma_queue_transfer(DATA[16..].as_ptr(), 0x1020, 16));
+    assert_eq!(dma_queue_len(), 1);
+
+    // A gap in VRAM, or a fill, needs a new one
+    assert!(dma_queue_transfer(DATA[32..].as_ptr(), 0x2000, 16));
+    assert!(dma_queue_fill(0x2020, 0, 32));
+    assert_eq!(dma_queue_len(), 3);
+
+    while dma_queue_len() < DMA_QUEUE_LEN {
+        assert!(dma_queue_fill(0, 0, 2));
+    }
+    assert!(!dma_queue_fill(0, 0, 2));
+
+    dma_queue_clear();
+    assert_eq!(dma_queue_len(), 0);
+}
+
+#[test]
+fn test_unpack() {
+    // Chunk of 8: literals "ab", then 6 bytes from 2 back; then 3 literals
+    let packed = [
+        0, 8, 1, b'a', b'b', 0x83, 0, 2, 0, 3, 2, b'x', b'y', b'z', 0, 0,
+    ];
+    let mut out = [0u8; 16];
+    assert_eq!(smd::vdp::unpack(&packed, &mut out), 11);
+    assert_eq!(&out[..11], b"ababababxyz");
+}
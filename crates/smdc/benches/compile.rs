@@ -0,0 +1,269 @@
+//! Host compile time for the example programs and a large synthetic unit
+//!
+//! ```text
+//! cargo bench -p smdc -- [FILTER] [--samples N] [--budget SECS] [-O N]
+//!                        [--lines N] [--save FILE] [--baseline FILE]
+//!                        [--threshold PCT]
+//! ```
+//!
+//! Every example under `sdk/c/examples` and `crates/smd/examples` is built
+//! to a ROM in process, plus `synthetic.c`, generated with about `--lines`
+//! lines (50,000 by default) of loops, switches and calls so frontend and
+//! backend costs that grow faster than the source show up. Each case gets
+//! one warm-up build, then samples until `--samples` or the time budget
+//! runs out, and reports the median with the spread and the split between
+//! the top-level phases. The medians are what `--save` and `--baseline`
+//! record and compare; see `bench_support` for those.
+
+use bench_support::{Format, Options, Results};
+use smd_compiler::backend::m68k::sdk::VBLANK_CALLBACK;
+use smd_compiler::backend::{BackendConfig, OutputFormat, RomBackend};
+use smd_compiler::common::stats::{self, Stats};
+use smd_compiler::driver::Pipeline;
+use smd_compiler::frontend::{CFrontend, CompileContext, FrontendConfig, RustFrontend};
+use smd_compiler::opt::{PassManager, remove_dead_symbols};
+use smd_compiler::{CompileError, DiagnosticReporter};
+use std::error::Error;
+use std::fmt::Write as _;
+use std::fs;
+use std::process::ExitCode;
+use std::time::{Duration, Instant};
+
+/// Phases broken out in the report
+const PHASES: [&str; 3] = ["frontend", "opt", "backend"];
+/// Fewest samples taken, whatever the budget
+const MIN_SAMPLES: usize = 3;
+
+/// Options of this benchmark, besides the shared ones
+struct Run {
+    samples: usize,
+    budget: Duration,
+    opt: u8,
+    lines: usize,
+}
+
+/// A source to build: its name and text
+struct Case {
+    name: String,
+    source: String,
+}
+
+/// Every example, C then Rust, then the synthetic unit
+fn cases(run: &Run) -> Result<Vec<(String, Case)>, Box<dyn Error>> {
+    let mut cases = Vec::new();
+    for path in bench_support::examples() {
+        let name = bench_support::file_name(&path);
+        let source = fs::read_to_string(&path)?;
+        cases.push((name.clone(), Case { name, source }));
+    }
+    let name = "synthetic.c".to_string();
+    let source = synthetic_source(run.lines);
+    cases.push((name.clone(), Case { name, source }));
+    Ok(cases)
+}
+
+/// A C unit of about `lines` lines: a chain of functions each calling the
+/// last, so none is dead, over shared globals
+fn synthetic_source(lines: usize) -> String {
+    // Lines per function below, blank line included
+    const FUNCTION_LINES: usize = 23;
+    let functions = (lines / FUNCTION_LINES).max(1);
+    let mut out = String::from(
+        "struct point { short x; short y; };\n\
+         int table[64];\n\
+         struct point points[16];\n\
+         unsigned char flags[32];\n\
+         int total;\n",
+    );
+    for k in 0..functions {
+        let tail = if k == 0 {
+            "return sum;".to_string()
+        } else {
+            format!("return sum + f{}(b, sum & 255);", k - 1)
+        };
+        let _ = write!(
+            out,
+            "
+static int f{k}(int a, int b) {{
+    int sum = 0;
+    int i;
+    for (i = 0; i < (a & 15); i++) {{
+        sum += table[(i + {k}) & 63] * {scale};
+        if (sum > {limit}) {{
+            sum -= b;
+        }} else {{
+            sum ^= i << {shift};
+        }}
+    }}
+    switch (b & 3) {{
+    case 0: sum += points[{point}].x; break;
+    case 1: sum -= points[{point}].y; break;
+    case 2: flags[{flag}] = (unsigned char)sum; break;
+    default: sum = -sum; break;
+    }}
+    while (sum > {floor}) {{
+        sum = sum / 2 - 1;
+    }}
+    {tail}
+}}
+",
+            scale = k % 7 + 1,
+            limit = 1000 + k,
+            shift = k % 5,
+            point = k % 16,
+            flag = k % 32,
+            floor = k % 100 + 50,
+        );
+    }
+    let _ = write!(
+        out,
+        "
+int main(void) {{
+    total = f{}(3, 7);
+    while (1) {{}}
+    return 0;
+}}
+",
+        functions - 1
+    );
+    out
+}
+
+/// Build `case` to a ROM the way `smdc -t rom` does
+fn build(pipeline: &Pipeline, case: &Case, opt: u8) -> Result<usize, Box<dyn Error>> {
+    let mut reporter = DiagnosticReporter::new();
+    let file_id = reporter.add_file(&case.name, &case.source);
+    let frontend_config = FrontendConfig {
+        include_paths: vec![bench_support::root().join("sdk/c/include")],
+        ..Default::default()
+    };
+    let mut module = pipeline.compile_source(
+        &case.source,
+        &case.name,
+        None,
+        &frontend_config,
+        &reporter,
+        file_id,
+    )?;
+    PassManager::for_level(opt).run(&mut module);
+    if opt > 0 {
+        remove_dead_symbols(&mut module, &["main", VBLANK_CALLBACK]);
+    }
+    let config = BackendConfig {
+        output_format: OutputFormat::Binary,
+        optimize_level: opt,
+        ..Default::default()
+    };
+    let ctx = CompileContext::new(case.name.clone(), file_id, &reporter);
+    let output = pipeline.generate_output(&module, &ctx, "rom", &config)?;
+    Ok(output.as_binary().map_or(0, <[u8]>::len))
+}
+
+/// Milliseconds in `d`
+fn ms(d: Duration) -> f64 {
+    d.as_secs_f64() * 1000.0
+}
+
+/// Time one case and print its report; returns its median in milliseconds,
+/// keyed by the case name
+fn bench(pipeline: &Pipeline, case: &Case, run: &Run) -> Result<Results, Box<dyn Error>> {
+    // The warm-up run also fills the caches and catches unbuildable cases
+    let (result, _) = stats::collect(|| build(pipeline, case, run.opt));
+    let rom_bytes = result?;
+
+    let mut samples = Vec::with_capacity(run.samples);
+    let mut phases = Stats::default();
+    let started = Instant::now();
+    while samples.len() < run.samples.max(1)
+        && (samples.len() < MIN_SAMPLES || started.elapsed() < run.budget)
+    {
+        let start = Instant::now();
+        let (result, stats) = stats::collect(|| build(pipeline, case, run.opt));
+        samples.push(start.elapsed());
+        result?;
+        phases.merge(stats);
+    }
+
+    samples.sort();
+    let n = samples.len() as f64;
+    let median = ms(samples[samples.len() / 2]);
+    let mean = samples.iter().map(|&d| ms(d)).sum::<f64>() / n;
+    let deviation = (samples.iter().map(|&d| (ms(d) - mean).powi(2)).sum::<f64>() / n).sqrt();
+    let lines = case.source.lines().count();
+
+    let mut out = String::new();
+    let _ = writeln!(
+        out,
+        "{} (-O{}, {lines} lines, {rom_bytes} byte ROM)",
+        case.name, run.opt
+    );
+    let _ = writeln!(
+        out,
+        "  time      {median:>10.3}ms median  {:.3}ms min  {mean:.3}ms mean ± {deviation:.3}  ({} samples)",
+        ms(samples[0]),
+        samples.len()
+    );
+    let _ = writeln!(
+        out,
+        "  rate      {:>10.0} lines/s",
+        lines as f64 * 1000.0 / median
+    );
+    let split: Vec<_> = PHASES
+        .iter()
+        .map(|phase| format!("{phase} {:.3}ms", ms(phases.phase_time(phase)) / n))
+        .collect();
+    let _ = writeln!(out, "  phases    {}", split.join("  "));
+    println!("{out}");
+    Ok(Results::from([(case.name.clone(), median)]))
+}
+
+fn main() -> ExitCode {
+    let mut run = Run {
+        samples: 20,
+        budget: Duration::from_secs(10),
+        opt: 2,
+        lines: 50_000,
+    };
+    let parsed = Options::parse(10.0, |arg, value| {
+        match arg {
+            "--samples" => run.samples = bench_support::number(&value()?)?,
+            "--budget" => run.budget = Duration::from_secs_f64(bench_support::number(&value()?)?),
+            "-O" => run.opt = bench_support::number(&value()?)?,
+            "--lines" => run.lines = bench_support::number(&value()?)?,
+            _ => return Ok(false),
+        }
+        Ok(true)
+    });
+    let options = match parsed {
+        Ok(options) => options,
+        Err(message) => {
+            eprintln!("error: {message}");
+            return ExitCode::FAILURE;
+        }
+    };
+    let cases = match cases(&run) {
+        Ok(cases) => cases,
+        Err(e) => {
+            eprintln!("error: {e}");
+            return ExitCode::FAILURE;
+        }
+    };
+
+    let mut pipeline = Pipeline::new();
+    pipeline.register_frontend(Box::new(CFrontend::new()));
+    pipeline.register_frontend(Box::new(RustFrontend::new()));
+    pipeline.register_backend(Box::new(RomBackend::new()));
+
+    let format = Format {
+        decimals: 3,
+        unit: "ms",
+    };
+    bench_support::run(
+        &options,
+        format,
+        &cases,
+        |_, case| bench(&pipeline, case, &run),
+        // Examples the frontends can't build yet aren't failures here
+        |e| e.downcast_ref::<CompileError>().is_some(),
+    )
+}
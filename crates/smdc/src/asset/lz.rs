@@ -0,0 +1,199 @@
+//! LZ compression of tile and map data
+//!
+//! The format is built for a small, fast 68000 decoder
+//! (`vdp_load_tiles_packed` in the SDK). Everything is byte aligned and
+//! big-endian. Data is cut into chunks of at most `CHUNK` bytes that decode
+//! independently, so the decoder only ever needs one chunk of RAM. Each chunk
+//! is its decoded length as a word followed by tokens, and a zero length ends
+//! the stream:
+//!
+//! - `0nnnnnnn`: `n + 1` literal bytes follow
+//! - `1nnnnnnn dddddddd dddddddd`: copy `n + 3` bytes from `d` bytes back in
+//!   the chunk's output (the copy may overlap what it writes, for runs)
+//!
+//! Odd input gets a zero byte of padding, since the decoded chunks are
+//! handed to word-sized DMA.
+
+use std::collections::HashMap;
+
+/// Largest decoded chunk, in bytes (128 tiles)
+pub const CHUNK: usize = 4096;
+
+/// Longest literal run one token holds
+const MAX_LITERALS: usize = 128;
+/// Shortest and longest match one token holds
+const MIN_MATCH: usize = 3;
+const MAX_MATCH: usize = 130;
+/// Earlier positions with the same first bytes tried per match search
+const MAX_CANDIDATES: usize = 64;
+
+/// Compress `data` into the packed format
+pub fn pack(data: &[u8]) -> Vec<u8> {
+    let mut padded = data.to_vec();
+    if padded.len() % 2 == 1 {
+        padded.push(0);
+    }
+    let mut out = Vec::new();
+    for chunk in padded.chunks(CHUNK) {
+        out.extend_from_slice(&(chunk.len() as u16).to_be_bytes());
+        pack_chunk(chunk, &mut out);
+    }
+    out.extend_from_slice(&[0, 0]);
+    out
+}
+
+/// Decompress a packed stream, or `None` if it is malformed
+pub fn unpack(packed: &[u8]) -> Option<Vec<u8>> {
+    let mut out = Vec::new();
+    let mut bytes = packed.iter().copied();
+    let mut next = || bytes.next();
+    loop {
+        let len = usize::from(u16::from_be_bytes([next()?, next()?]));
+        if len == 0 {
+            return Some(out);
+        }
+        let start = out.len();
+        while out.len() - start < len {
+            let token = next()?;
+            if token & 0x80 == 0 {
+                for _ in 0..=token {
+                    out.push(next()?);
+                }
+            } else {
+                let count = usize::from(token & 0x7F) + MIN_MATCH;
+                let distance = usize::from(u16::from_be_bytes([next()?, next()?]));
+                if distance == 0 || distance > out.len() - start {
+                    return None;
+                }
+                for _ in 0..count {
+                    out.push(out[out.len() - distance]);
+                }
+            }
+        }
+        if out.len() - start != len {
+            return None;
+        }
+    }
+}
+
+/// Append the tokens of one chunk to `out`
+fn pack_chunk(chunk: &[u8], out: &mut Vec<u8>) {
+    // Positions seen so far, by their first MIN_MATCH bytes, newest last
+    let mut seen: HashMap<&[u8], Vec<usize>> = HashMap::new();
+    let mut literals = 0;
+    let mut pos = 0;
+    while pos < chunk.len() {
+        let (mut len, mut distance) = longest_match(chunk, pos, &seen);
+        // Lazy matching: a longer match one byte on is worth a literal
+        if len >= MIN_MATCH && pos + 1 < chunk.len() {
+            remember(chunk, pos, &mut seen);
+            let (next_len, _) = longest_match(chunk, pos + 1, &seen);
+            if next_len > len {
+                len = 0;
+                distance = 0;
+            }
+            forget(chunk, pos, &mut seen);
+        }
+        if len >= MIN_MATCH {
+            flush_literals(&chunk[pos - literals..pos], out);
+            literals = 0;
+            out.push(0x80 | (len - MIN_MATCH) as u8);
+            out.extend_from_slice(&(distance as u16).to_be_bytes());
+            for p in pos..pos + len {
+                remember(chunk, p, &mut seen);
+            }
+            pos += len;
+        } else {
+            remember(chunk, pos, &mut seen);
+            literals += 1;
+            pos += 1;
+        }
+    }
+    flush_literals(&chunk[pos - literals..pos], out);
+}
+
+/// The longest earlier copy of the bytes at `pos`, as (length, distance)
+fn longest_match(chunk: &[u8], pos: usize, seen: &HashMap<&[u8], Vec<usize>>) -> (usize, usize) {
+    let Some(key) = chunk.get(pos..pos + MIN_MATCH) else {
+        return (0, 0);
+    };
+    let Some(candidates) = seen.get(key) else {
+        return (0, 0);
+    };
+    let limit = (chunk.len() - pos).min(MAX_MATCH);
+    let mut best = (0, 0);
+    for &from in candidates.iter().rev().take(MAX_CANDIDATES) {
+        let len = (0..limit)
+            .take_while(|&i| chunk[from + i] == chunk[pos + i])
+            .count();
+        if len > best.0 {
+            best = (len, pos - from);
+            if len == limit {
+                break;
+            }
+        }
+    }
+    best
+}
+
+fn remember<'a>(chunk: &'a [u8], pos: usize, seen: &mut HashMap<&'a [u8], Vec<usize>>) {
+    if let Some(key) = chunk.get(pos..pos + MIN_MATCH) {
+        seen.entry(key).or_default().push(pos);
+    }
+}
+
+/// Undo the `remember` of `pos`, the newest position
+fn forget(chunk: &[u8], pos: usize, seen: &mut HashMap<&[u8], Vec<usize>>) {
+    if let Some(key) = chunk.get(pos..pos + MIN_MATCH)
+        && let Some(positions) = seen.get_mut(key)
+    {
+        positions.pop();
+    }
+}
+
+fn flush_literals(literals: &[u8], out: &mut Vec<u8>) {
+    for run in literals.chunks(MAX_LITERALS) {
+        out.push((run.len() - 1) as u8);
+        out.extend_from_slice(run);
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use pretty_assertions::assert_eq;
+
+    #[test]
+    fn test_round_trip() {
+        // A tile-like pattern with repeats, noise and a long run
+        let mut data: Vec<u8> = (0..3000u32).map(|i| (i * 7 % 13) as u8).collect();
+        data.extend((0..5000u32).map(|i| (i.wrapping_mul(2_654_435_761) >> 24) as u8));
+        data.extend(std::iter::repeat_n(0x11, 900));
+        let packed = pack(&data);
+        assert_eq!(unpack(&packed).unwrap(), data);
+        assert!(packed.len() < data.len());
+    }
+
+    #[test]
+    fn test_runs_overlap_their_copy() {
+        let packed = pack(&[0xAB; 64]);
+        // One literal, then a single match copying it onward
+        assert_eq!(packed, vec![0, 64, 0x00, 0xAB, 0x80 | 60, 0, 1, 0, 0]);
+    }
+
+    #[test]
+    fn test_odd_input_is_padded_and_chunked() {
+        let data: Vec<u8> = (0..=CHUNK as u32).map(|i| (i % 251) as u8).collect();
+        let unpacked = unpack(&pack(&data)).unwrap();
+        assert_eq!(unpacked.len(), CHUNK + 2);
+        assert_eq!(&unpacked[..=CHUNK], &data[..]);
+        assert_eq!(unpacked[CHUNK + 1], 0);
+    }
+
+    #[test]
+    fn test_empty_input() {
+        assert_eq!(pack(&[]), vec![0, 0]);
+        assert_eq!(unpack(&[0, 0]), Some(Vec::new()));
+        assert_eq!(unpack(&[0, 4, 0x80, 0, 1]), None);
+    }
+}
@@ -0,0 +1,69 @@
+//! Build-time asset compression
+//!
+//! `smdc --asset NAME=FILE` packs a raw binary file (tiles, maps) with
+//! `lz::pack` and links it into the program as the read-only byte array
+//! `NAME`, which C code declares as `extern const unsigned char NAME[];` and
+//! hands to `vdp_load_tiles_packed`. `smdc --pack FILE` writes the packed
+//! stream to a file instead, for data embedded by other means.
+
+pub mod lz;
+
+use crate::common::{CompileError, CompileResult};
+use crate::ir::IrGlobal;
+use crate::types::IrType;
+use std::path::Path;
+
+/// The packed contents of `path`
+pub fn pack_file(path: &Path) -> CompileResult<Vec<u8>> {
+    let data = std::fs::read(path)?;
+    Ok(lz::pack(&data))
+}
+
+/// The global for an asset given as `NAME=FILE` on the command line
+pub fn load(spec: &str) -> CompileResult<IrGlobal> {
+    let Some((name, file)) = spec.split_once('=') else {
+        return Err(CompileError::codegen(format!(
+            "asset '{spec}' should be NAME=FILE"
+        )));
+    };
+    if name.is_empty()
+        || name.starts_with(|c: char| c.is_ascii_digit())
+        || !name.chars().all(|c| c.is_ascii_alphanumeric() || c == '_')
+    {
+        return Err(CompileError::codegen(format!(
+            "asset name '{name}' is not an identifier"
+        )));
+    }
+    let packed = pack_file(Path::new(file))?;
+    Ok(IrGlobal {
+        name: name.to_string(),
+        ty: IrType::array(IrType::u8(), packed.len()),
+        init: Some(packed),
+        readonly: true,
+        internal: false,
+    })
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_asset_spec() {
+        let path = std::env::temp_dir().join(format!("smdc_asset_{}.bin", std::process::id()));
+        std::fs::write(&path, [7u8; 100]).unwrap();
+        let global = load(&format!("tiles={}", path.display())).unwrap();
+        std::fs::remove_file(&path).unwrap();
+        assert_eq!(global.name, "tiles");
+        assert!(global.readonly);
+        assert_eq!(
+            lz::unpack(global.init.as_ref().unwrap()).unwrap(),
+            vec![7; 100]
+        );
+        assert_eq!(global.ty.size, global.init.unwrap().len());
+
+        assert!(load("tiles").is_err());
+        assert!(load("9lives=x.bin").is_err());
+        assert!(load("ok=/nonexistent/file.bin").is_err());
+    }
+}
@@ -1,17 +1,29 @@
 //! Two-pass assembler for M68k instructions
 //!
-//! Converts M68k instructions to binary with symbol resolution.
+//! Converts M68k instructions to binary with symbol resolution. The layout
+//! pass relaxes branches: every `Bcc`/`BRA`/`BSR` starts out in the 2-byte
+//! short form, and any whose target turns out to be out of reach is widened
+//! to the word form. This repeats until the layout stops changing.
+//!
+//! `.text` and `.rodata` are laid out in ROM. `.data` labels get RAM
+//! addresses, but the bytes still go into ROM for the startup stub to copy.
+//! `.bss` only reserves RAM, so nothing in it reaches the ROM image.
+//!
+//! `assemble_object` instead produces a relocatable object for the linker,
+//! with the three kinds of section kept apart.
 
-use super::encoder::{EncodeError, InstructionEncoder};
-use super::m68k::M68kInst;
-use std::collections::HashMap;
+use super::encoder::{EncodeError, InstructionEncoder, SHORT_BRANCH_SIZE};
+use super::m68k::{Directive, M68kInst, SectionName};
+use super::object::{ObjectFile, ObjectSection, ObjectSymbol, Relocation, RelocationKind};
+use crate::common::{Symbol, stats};
+use std::collections::{HashMap, HashSet};
 
 /// Assembly error
 #[derive(Debug, Clone)]
 pub enum AssemblyError {
     /// Encoding error from instruction encoder
     Encode(EncodeError),
-    /// Unresolved symbol after assembly
+    /// Reference to a label nothing defines
     UnresolvedSymbol(String),
     /// Symbol defined multiple times
     DuplicateSymbol(String),
@@ -29,23 +41,61 @@ impl std::fmt::Display for AssemblyError {
 
 impl From<EncodeError> for AssemblyError {
     fn from(e: EncodeError) -> Self {
-        AssemblyError::Encode(e)
+        match e {
+            EncodeError::UnresolvedSymbol(name) => AssemblyError::UnresolvedSymbol(name),
+            e => AssemblyError::Encode(e),
+        }
     }
 }
 
 /// RAM base address for data section
-const DATA_RAM_BASE: u32 = 0x00FF8000;
+pub(super) const DATA_RAM_BASE: u32 = 0x00FF8000;
+
+/// Where a section's contents end up
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+enum Section {
+    /// Code and read-only data, addressed in ROM
+    Rom,
+    /// Initialized data: addressed in RAM, image in ROM
+    Data,
+    /// Zeroed data: addressed in RAM only
+    Bss,
+}
+
+impl Section {
+    /// The section a directive switches to, if it is a section directive
+    fn from_directive(directive: &Directive) -> Option<Self> {
+        match directive {
+            Directive::Section(SectionName::Text | SectionName::Rodata) => Some(Section::Rom),
+            Directive::Section(SectionName::Data) => Some(Section::Data),
+            Directive::Section(SectionName::Bss) => Some(Section::Bss),
+            _ => None,
+        }
+    }
+
+    fn object_section(self) -> ObjectSection {
+        match self {
+            Section::Rom => ObjectSection::Text,
+            Section::Data => ObjectSection::Data,
+            Section::Bss => ObjectSection::Bss,
+        }
+    }
+}
 
 /// Two-pass assembler for M68k instructions
 pub struct Assembler {
     /// Symbol table (label -> address)
-    symbols: HashMap<String, u32>,
+    symbols: HashMap<Symbol, u32>,
     /// Base address for code
     base_address: u32,
     /// ROM offset where data section starts (for copying to RAM)
     data_rom_offset: u32,
     /// Size of data section
     data_size: u32,
+    /// Size of the ROM image, from the base address
+    image_size: u32,
+    /// Addresses of branches encoded in short form
+    short_branches: HashSet<u32>,
 }
 
 impl Assembler {
@@ -56,6 +106,8 @@ impl Assembler {
             base_address,
             data_rom_offset: 0,
             data_size: 0,
+            image_size: 0,
+            short_branches: HashSet::new(),
         }
     }
 
@@ -77,7 +129,7 @@ impl Assembler {
     /// Assemble a list of instructions to binary
     pub fn assemble(&mut self, instructions: &[M68kInst]) -> Result<Vec<u8>, AssemblyError> {
         // Pass 1: Calculate all label addresses
-        self.layout_pass(instructions)?;
+        stats::time("layout", || self.layout_pass(instructions))?;
 
         // Debug: print symbol table for global variables
         if std::env::var("DEBUG_ASM").is_ok() {
@@ -92,179 +144,322 @@ impl Assembler {
         }
 
         // Pass 2: Encode all instructions with resolved addresses
-        self.encode_pass(instructions)
+        let image = stats::time("encode", || self.encode_pass(instructions))?;
+        self.count_sizes();
+        Ok(image)
+    }
+
+    /// Report the laid-out sizes to `--stats`
+    fn count_sizes(&self) {
+        stats::count("image bytes", u64::from(self.image_size));
+        stats::count("ram bytes", u64::from(self.data_size));
     }
 
-    /// Pass 1: Calculate the address of each label
+    /// Pass 1: Calculate the address of each label, relaxing branches
     fn layout_pass(&mut self, instructions: &[M68kInst]) -> Result<(), AssemblyError> {
+        let branches: Vec<(usize, Symbol)> = instructions
+            .iter()
+            .enumerate()
+            .filter_map(|(i, inst)| match inst {
+                M68kInst::Bra(label) | M68kInst::Bsr(label) | M68kInst::Bcc(_, label) => {
+                    Some((i, *label))
+                }
+                _ => None,
+            })
+            .collect();
+
+        // Widening a branch only ever moves code apart, so this terminates
+        let mut long_branches = HashSet::new();
+        loop {
+            let addresses = self.layout(instructions, &long_branches)?;
+            let mut widened = false;
+            for &(i, label) in &branches {
+                if long_branches.contains(&i) {
+                    continue;
+                }
+                let reaches = self
+                    .symbols
+                    .get(&label)
+                    .is_some_and(|&t| InstructionEncoder::short_branch_reaches(addresses[i], t));
+                if !reaches {
+                    long_branches.insert(i);
+                    widened = true;
+                }
+            }
+            if !widened {
+                stats::count("branches", branches.len() as u64);
+                stats::count("long branches", long_branches.len() as u64);
+                self.short_branches = branches
+                    .iter()
+                    .filter(|(i, _)| !long_branches.contains(i))
+                    .map(|&(i, _)| addresses[i])
+                    .collect();
+                return Ok(());
+            }
+        }
+    }
+
+    /// Assign addresses with the given branches in word form and the rest
+    /// short. Fills the symbol table and returns each instruction's address.
+    fn layout(
+        &mut self,
+        instructions: &[M68kInst],
+        long_branches: &HashSet<usize>,
+    ) -> Result<Vec<u32>, AssemblyError> {
         self.symbols.clear();
-        let mut encoder = InstructionEncoder::new();
-        encoder.set_base_address(self.base_address);
+        let mut addresses = Vec::with_capacity(instructions.len());
+        let encoder = InstructionEncoder::new();
 
         let mut position = self.base_address;
-        let mut in_data_section = false;
+        let mut section = Section::Rom;
         let mut data_position = DATA_RAM_BASE;
+        let mut data_started = false;
+
+        for (i, inst) in instructions.iter().enumerate() {
+            addresses.push(position);
 
-        for inst in instructions {
             // Handle section directives
-            if let M68kInst::Directive(d) = inst {
-                if d.contains(".section .data") || d == ".data" {
-                    // Switch to data section - labels now get RAM addresses
-                    in_data_section = true;
-                    // Record where data starts in ROM (for copying)
+            if let M68kInst::Directive(d) = inst
+                && let Some(next) = Section::from_directive(d)
+            {
+                // Record where data starts in ROM (for copying)
+                if next == Section::Data && !data_started {
                     self.data_rom_offset = position;
-                    continue;
-                }
-                if d.contains(".section .text") || d == ".text" {
-                    in_data_section = false;
-                    continue;
+                    data_started = true;
                 }
+                section = next;
+                continue;
             }
 
-            // Handle labels - use RAM address if in data section
+            // Handle labels - use RAM address outside ROM sections
             if let M68kInst::Label(name) = inst {
-                if self.symbols.contains_key(name) {
-                    return Err(AssemblyError::DuplicateSymbol(name.clone()));
-                }
-                if in_data_section {
-                    self.symbols.insert(name.clone(), data_position);
+                let address = if section == Section::Rom {
+                    position
                 } else {
-                    self.symbols.insert(name.clone(), position);
+                    data_position
+                };
+                if self.symbols.insert(*name, address).is_some() {
+                    return Err(AssemblyError::DuplicateSymbol(name.to_string()));
                 }
             }
 
             // Handle alignment directives
-            if let M68kInst::Directive(d) = inst
-                && d.starts_with(".align ")
-            {
-                let align = d[7..].trim().parse::<u32>().unwrap_or(2);
+            if let M68kInst::Directive(Directive::Align(align)) = inst {
                 let mask = align - 1;
-                if in_data_section {
+                if section != Section::Rom {
                     data_position = (data_position + mask) & !mask;
                 }
-                position = (position + mask) & !mask;
+                if section != Section::Bss {
+                    position = (position + mask) & !mask;
+                }
                 continue;
             }
 
             // Calculate instruction size
-            let size = encoder.instruction_size(inst) as u32;
-            position += size;
-            if in_data_section {
+            let size = match inst {
+                M68kInst::Bra(_) | M68kInst::Bsr(_) | M68kInst::Bcc(_, _)
+                    if !long_branches.contains(&i) =>
+                {
+                    SHORT_BRANCH_SIZE
+                }
+                _ => encoder.instruction_size(inst),
+            } as u32;
+            if section != Section::Rom {
                 data_position += size;
             }
+            if section != Section::Bss {
+                position += size;
+            }
         }
 
         // Calculate data section size
         self.data_size = data_position - DATA_RAM_BASE;
+        self.image_size = position - self.base_address;
 
-        Ok(())
+        Ok(addresses)
     }
 
     /// Pass 2: Encode all instructions with resolved addresses
-    fn encode_pass(&self, instructions: &[M68kInst]) -> Result<Vec<u8>, AssemblyError> {
-        let mut output = Vec::new();
-        let mut encoder = InstructionEncoder::new();
-        encoder.set_base_address(self.base_address);
-
-        // Copy symbol table to encoder
-        for name in self.symbols.keys() {
-            encoder.define_symbol(name);
-            // We need to set the position manually for pre-defined symbols
-        }
+    fn encode_pass(&mut self, instructions: &[M68kInst]) -> Result<Vec<u8>, AssemblyError> {
+        let size = self.image_size as usize;
+        self.with_encoder(false, |encoder| {
+            Self::encode_sections(instructions, encoder, size, None)
+        })
+    }
 
-        // Create a new encoder with symbols pre-populated
-        let mut encoder = self.create_encoder_with_symbols();
+    /// Run `encode` with an encoder holding the symbol table and branch
+    /// forms layout settled on. The table moves into the encoder and back
+    /// rather than being copied.
+    fn with_encoder<T>(
+        &mut self,
+        relocatable: bool,
+        encode: impl FnOnce(&mut InstructionEncoder) -> Result<T, AssemblyError>,
+    ) -> Result<T, AssemblyError> {
+        let mut encoder = InstructionEncoder::with_symbols(std::mem::take(&mut self.symbols));
+        encoder.set_base_address(self.base_address);
+        encoder.set_short_branches(std::mem::take(&mut self.short_branches));
+        encoder.set_relocatable(relocatable);
+        let result = encode(&mut encoder);
+        self.symbols = encoder.into_symbols();
+        result
+    }
 
+    /// Encode everything outside `.bss`, in order, into an image of `size`
+    /// bytes. With `fixups`, every absolute label reference is recorded
+    /// there for the linker.
+    fn encode_sections(
+        instructions: &[M68kInst],
+        encoder: &mut InstructionEncoder,
+        size: usize,
+        mut fixups: Option<&mut Vec<Relocation>>,
+    ) -> Result<Vec<u8>, AssemblyError> {
+        let mut output = Vec::with_capacity(size);
+        let mut section = Section::Rom;
         for inst in instructions {
-            // Handle alignment
             if let M68kInst::Directive(d) = inst
-                && d.starts_with(".align ")
+                && let Some(next) = Section::from_directive(d)
             {
-                let align = d[7..].trim().parse::<usize>().unwrap_or(2);
-                while output.len() % align != 0 {
-                    output.push(0);
-                    encoder.position += 1;
-                }
+                section = next;
+                continue;
+            }
+            if section == Section::Bss {
                 continue;
             }
 
-            let bytes = encoder.encode(inst)?;
-            output.extend(bytes);
-        }
-
-        // Apply relocations
-        self.apply_relocations(&mut output, &encoder)?;
+            // Handle alignment
+            if let M68kInst::Directive(Directive::Align(align)) = inst {
+                let padded = output.len().next_multiple_of(*align as usize);
+                encoder.position += (padded - output.len()) as u32;
+                output.resize(padded, 0);
+                continue;
+            }
 
+            if let Some(fixups) = fixups.as_deref_mut() {
+                encoder.label_fixups(inst, |offset, label| {
+                    fixups.push(Relocation {
+                        offset: encoder.position + offset,
+                        symbol: label.to_string(),
+                        kind: RelocationKind::Absolute32,
+                    });
+                });
+            }
+            encoder.encode(inst, &mut output)?;
+        }
         Ok(output)
     }
 
-    fn create_encoder_with_symbols(&self) -> InstructionEncoder {
-        let mut encoder = InstructionEncoder::new();
-        encoder.set_base_address(self.base_address);
-
-        // Pre-populate symbol table
-        for (name, &addr) in &self.symbols {
-            // Temporarily move position to symbol address, define, then restore
-            let saved_pos = encoder.position;
-            encoder.position = addr;
-            encoder.define_symbol(name);
-            encoder.position = saved_pos;
+    /// Assemble one translation unit into a relocatable object at address 0.
+    ///
+    /// Code and `.rodata` go to the object's text, `.data` and `.bss` to
+    /// their own sections, so the linker can place every object's data
+    /// together. Branches are relaxed as in `assemble`, those to labels the
+    /// object does not define staying in word form. Labels starting with `.`
+    /// or named by a `.local` directive stay out of the other objects.
+    pub fn assemble_object(
+        &mut self,
+        instructions: &[M68kInst],
+    ) -> Result<ObjectFile, AssemblyError> {
+        let mut text = Vec::new();
+        let mut data = Vec::new();
+        let mut bss = Vec::new();
+        let mut label_sections = HashMap::new();
+        let mut locals = HashSet::new();
+        let mut section = Section::Rom;
+        for inst in instructions {
+            if let M68kInst::Directive(Directive::Local(name)) = inst {
+                locals.insert(*name);
+            }
+            if let M68kInst::Directive(d) = inst
+                && let Some(next) = Section::from_directive(d)
+            {
+                section = next;
+                continue;
+            }
+            if let M68kInst::Label(name) = inst {
+                label_sections.insert(*name, section);
+            }
+            match section {
+                Section::Rom => text.push(inst.clone()),
+                Section::Data => data.push(inst.clone()),
+                Section::Bss => bss.push(inst.clone()),
+            }
         }
 
-        encoder
-    }
-
-    fn apply_relocations(
-        &self,
-        output: &mut [u8],
-        encoder: &InstructionEncoder,
-    ) -> Result<(), AssemblyError> {
-        for (pos, symbol, is_relative) in encoder.relocations() {
-            let target = self
-                .symbols
-                .get(symbol)
-                .ok_or_else(|| AssemblyError::UnresolvedSymbol(symbol.clone()))?;
-
-            let offset = (*pos - self.base_address) as usize;
-
-            if *is_relative {
-                // PC-relative displacement
-                let pc = *pos; // PC is at the extension word
-                let disp = (*target as i32) - (pc as i32);
-
-                if !(-32768..=32767).contains(&disp) {
-                    return Err(AssemblyError::Encode(EncodeError::OutOfRange(format!(
-                        "branch displacement {disp} out of range"
-                    ))));
-                }
-
-                let disp_bytes = (disp as i16).to_be_bytes();
-                if offset + 1 < output.len() {
-                    output[offset] = disp_bytes[0];
-                    output[offset + 1] = disp_bytes[1];
+        // Long-aligned section ends keep the .data image and its RAM copy
+        // laid out alike, and every section a whole number of longs
+        let align = M68kInst::Directive(Directive::Align(4));
+        let mut ordered = text;
+        ordered.push(align.clone());
+        ordered.push(M68kInst::Directive(Directive::Section(SectionName::Data)));
+        ordered.extend(data);
+        ordered.push(align.clone());
+        ordered.push(M68kInst::Directive(Directive::Section(SectionName::Bss)));
+        ordered.extend(bss);
+        ordered.push(align);
+
+        let base_address = std::mem::replace(&mut self.base_address, 0);
+        let result = stats::time("layout", || self.layout_pass(&ordered)).and_then(|()| {
+            let size = self.image_size as usize;
+            stats::time("encode", || {
+                self.with_encoder(true, |encoder| {
+                    let mut relocations = Vec::new();
+                    let image =
+                        Self::encode_sections(&ordered, encoder, size, Some(&mut relocations))?;
+                    relocations.extend(encoder.relocations().iter().map(|(pos, symbol, _)| {
+                        Relocation {
+                            offset: *pos,
+                            symbol: symbol.to_string(),
+                            kind: RelocationKind::Relative16,
+                        }
+                    }));
+                    Ok((image, relocations))
+                })
+            })
+        });
+        self.base_address = base_address;
+        let (mut image, relocations) = result?;
+        self.count_sizes();
+
+        let data = image.split_off(self.data_rom_offset as usize);
+        let data_len = data.len() as u32;
+        let mut symbols: Vec<ObjectSymbol> = self
+            .symbols
+            .iter()
+            .map(|(name, &addr)| {
+                let section = label_sections[name];
+                let offset = match section {
+                    Section::Rom => addr,
+                    Section::Data => addr - DATA_RAM_BASE,
+                    Section::Bss => addr - DATA_RAM_BASE - data_len,
+                };
+                ObjectSymbol {
+                    name: name.to_string(),
+                    section: section.object_section(),
+                    offset,
+                    global: !name.starts_with('.') && !locals.contains(name),
                 }
-            } else {
-                // Absolute address
-                let addr_bytes = target.to_be_bytes();
-                if offset + 3 < output.len() {
-                    output[offset] = addr_bytes[0];
-                    output[offset + 1] = addr_bytes[1];
-                    output[offset + 2] = addr_bytes[2];
-                    output[offset + 3] = addr_bytes[3];
-                }
-            }
-        }
-        Ok(())
+            })
+            .collect();
+        symbols.sort_by(|a, b| a.name.cmp(&b.name));
+
+        Ok(ObjectFile {
+            text: image,
+            data,
+            bss_size: self.data_size - data_len,
+            symbols,
+            relocations,
+            sdk_functions: Vec::new(),
+        })
     }
 
     /// Get the symbol table
-    pub fn symbols(&self) -> &HashMap<String, u32> {
+    pub fn symbols(&self) -> &HashMap<Symbol, u32> {
         &self.symbols
     }
 
     /// Add an external symbol (e.g., for ROM entry point)
     pub fn add_symbol(&mut self, name: &str, addr: u32) {
-        self.symbols.insert(name.to_string(), addr);
+        self.symbols.insert(name.into(), addr);
     }
 }
 
@@ -292,26 +487,62 @@ mod tests {
     fn test_assemble_with_label() {
         let mut asm = Assembler::new(0x200);
         let instructions = vec![
-            M68kInst::Label("start".to_string()),
+            M68kInst::Label("start".into()),
             M68kInst::Nop,
-            M68kInst::Bra("start".to_string()),
+            M68kInst::Bra("start".into()),
         ];
 
         let bytes = asm.assemble(&instructions).unwrap();
 
         // NOP at 0x200 = 0x4E71
-        // BRA.W start at 0x202 = 0x6000 + displacement
-        // displacement = 0x200 - 0x204 = -4 = 0xFFFC
-        assert_eq!(bytes[0..2], [0x4E, 0x71]); // NOP
-        assert_eq!(bytes[2..4], [0x60, 0x00]); // BRA.W
-        assert_eq!(bytes[4..6], [0xFF, 0xFC]); // displacement -4
+        // BRA.S start at 0x202 = 0x6000 + 8-bit displacement
+        // displacement = 0x200 - 0x204 = -4 = 0xFC
+        assert_eq!(bytes, vec![0x4E, 0x71, 0x60, 0xFC]);
+    }
+
+    #[test]
+    fn test_branch_relaxation() {
+        // A forward branch over 130 bytes of NOPs needs a word displacement;
+        // the backward branch right after the target stays short.
+        let mut instructions = vec![
+            M68kInst::Label("top".into()),
+            M68kInst::Bcc(Cond::Eq, "far".into()),
+        ];
+        instructions.extend(std::iter::repeat_n(M68kInst::Nop, 65));
+        instructions.push(M68kInst::Label("far".into()));
+        instructions.push(M68kInst::Bra("far".into()));
+        instructions.push(M68kInst::Bra("top".into()));
+
+        let mut asm = Assembler::new(0x200);
+        let bytes = asm.assemble(&instructions).unwrap();
+
+        // BEQ.W far: 0x6700, displacement 0x286 - 0x202 = 0x84
+        assert_eq!(bytes[0..4], [0x67, 0x00, 0x00, 0x84]);
+        assert_eq!(asm.symbols()[&"far".into()], 0x286);
+        // BRA to itself: displacement -2 is short
+        assert_eq!(bytes[0x86..0x88], [0x60, 0xFE]);
+        // BRA top from 0x288: displacement 0x200 - 0x28A = -138 needs a word
+        assert_eq!(bytes[0x88..0x8C], [0x60, 0x00, 0xFF, 0x76]);
+        assert_eq!(bytes.len(), 0x8C);
+    }
+
+    #[test]
+    fn test_branch_to_next_instruction_uses_word_form() {
+        // An 8-bit displacement of 0 would mean "word displacement follows"
+        let instructions = vec![
+            M68kInst::Bra("next".into()),
+            M68kInst::Label("next".into()),
+            M68kInst::Rts,
+        ];
+        let bytes = Assembler::new(0x200).assemble(&instructions).unwrap();
+        assert_eq!(bytes, vec![0x60, 0x00, 0x00, 0x02, 0x4E, 0x75]);
     }
 
     #[test]
     fn test_assemble_function() {
         let mut asm = Assembler::new(0x200);
         let instructions = vec![
-            M68kInst::Label("add".to_string()),
+            M68kInst::Label("add".into()),
             M68kInst::Link(AddrReg::A6, -4),
             M68kInst::Move(
                 Size::Long,
@@ -337,4 +568,60 @@ mod tests {
         let len = bytes.len();
         assert_eq!(bytes[len - 2..], [0x4E, 0x75]);
     }
+
+    #[test]
+    fn test_sections() {
+        let directive = M68kInst::Directive;
+        let label = |l: &str| M68kInst::Label(l.into());
+        let instructions = vec![
+            M68kInst::Nop,
+            directive(Directive::Section(SectionName::Data)),
+            label("data"),
+            directive(Directive::Word(1)),
+            directive(Directive::Section(SectionName::Bss)),
+            label("bss"),
+            directive(Directive::Space(64)),
+            directive(Directive::Section(SectionName::Rodata)),
+            label("rodata"),
+            directive(Directive::Word(2)),
+        ];
+        let mut asm = Assembler::new(0x200);
+        let bytes = asm.assemble(&instructions).unwrap();
+
+        // .data lives in RAM with its image in ROM, .bss only in RAM, and
+        // .rodata in ROM right after the .data image
+        assert_eq!(asm.symbols()[&"data".into()], DATA_RAM_BASE);
+        assert_eq!(asm.symbols()[&"bss".into()], DATA_RAM_BASE + 2);
+        assert_eq!(asm.symbols()[&"rodata".into()], 0x204);
+        assert_eq!(asm.data_rom_offset(), 0x202);
+        assert_eq!(asm.data_size(), 66);
+        assert_eq!(bytes, vec![0x4E, 0x71, 0x00, 0x01, 0x00, 0x02]);
+    }
+
+    #[test]
+    fn test_label_difference_words() {
+        let label = |l: &str| M68kInst::Label(l.into());
+        let diff = |a: &str, b: &str| M68kInst::Directive(Directive::WordDiff(a.into(), b.into()));
+        let instructions = vec![
+            label("back"),
+            M68kInst::Nop,
+            label("table"),
+            diff("fwd", "table"),
+            diff("back", "table"),
+            M68kInst::Directive(Directive::Word(0xFFFE)),
+            label("fwd"),
+            M68kInst::Rts,
+        ];
+        let mut asm = Assembler::new(0x200);
+        let bytes = asm.assemble(&instructions).unwrap();
+        assert_eq!(bytes[2..8], [0x00, 0x06, 0xFF, 0xFE, 0xFF, 0xFE]);
+
+        let undefined = vec![diff("nowhere", "back")];
+        assert!(Assembler::new(0x200).assemble(&undefined).is_err());
+        let undefined = vec![M68kInst::Bra("nowhere".into())];
+        assert!(matches!(
+            Assembler::new(0x200).assemble(&undefined),
+            Err(AssemblyError::UnresolvedSymbol(name)) if name == "nowhere"
+        ));
+    }
 }
@@ -0,0 +1,242 @@
+//! Register calling convention
+//!
+//! Calls normally push every argument as a long, right to left, and the
+//! callee finds them at 8(A6) and up. At `-O2` and up, calls between the
+//! module's own functions, and calls to SDK library routines marked
+//! `reg_args` in the registry, pass the first arguments in `ARG_REGS`
+//! instead. Any further arguments are pushed as before, so the first stack
+//! argument is still at 8(A6).
+//!
+//! `lower_params` rewrites a callee's parameter accesses to match.
+
+use super::m68k::{AddrReg, DataReg, Reg};
+use crate::ir::{BasicBlock, Inst, IrFunction, Label, SpannedInst, Temp, Value};
+use std::collections::HashMap;
+
+/// Registers holding the first arguments of a register-convention call, in
+/// order. The rest go on the stack.
+pub const ARG_REGS: [Reg; 4] = [
+    Reg::Data(DataReg::D0),
+    Reg::Data(DataReg::D1),
+    Reg::Addr(AddrReg::A0),
+    Reg::Addr(AddrReg::A1),
+];
+
+/// Copy of `func` for a callee using the register convention.
+///
+/// A register parameter whose slot is only read whole becomes a `Param` in a
+/// new entry block, and its loads become copies, so it never touches memory.
+/// Parameters whose slot address escapes keep their `LoadParam`; the emitter
+/// gives those a frame slot and stores the register there on entry.
+pub fn lower_params(func: &IrFunction) -> IrFunction {
+    let mut func = func.clone();
+    let insts = || func.blocks.iter().flat_map(|b| &b.insts).map(|s| &s.inst);
+
+    // Parameter slot temp -> (index, size)
+    let mut slots: HashMap<Temp, (usize, usize)> = HashMap::new();
+    let mut defs: HashMap<Temp, usize> = HashMap::new();
+    for inst in insts() {
+        if let Some(dst) = inst.def() {
+            *defs.entry(dst).or_default() += 1;
+        }
+        if let Inst::LoadParam { dst, index, size } = inst
+            && *index < ARG_REGS.len()
+        {
+            slots.insert(*dst, (*index, *size));
+        }
+    }
+    slots.retain(|slot, _| defs[slot] == 1);
+
+    // Every use of the slot must be a load of the whole parameter, all with
+    // the same extension
+    let mut uses: HashMap<Temp, usize> = HashMap::new();
+    let mut loads: HashMap<Temp, (usize, Option<bool>)> = HashMap::new();
+    for inst in insts() {
+        for temp in inst.uses() {
+            *uses.entry(temp).or_default() += 1;
+        }
+        if let Inst::Load {
+            addr: Value::Temp(slot),
+            size,
+            volatile: false,
+            signed,
+            ..
+        } = inst
+            && let Some(&(_, param_size)) = slots.get(slot)
+            && *size == param_size
+        {
+            let entry = loads.entry(*slot).or_insert((0, Some(*signed)));
+            entry.0 += 1;
+            if entry.1 != Some(*signed) {
+                entry.1 = None;
+            }
+        }
+    }
+    slots.retain(|slot, _| {
+        let uses = uses.get(slot).copied().unwrap_or(0);
+        match loads.get(slot) {
+            Some(&(count, Some(_))) => count == uses,
+            Some((_, None)) => false,
+            None => uses == 0,
+        }
+    });
+    if slots.is_empty() {
+        return func;
+    }
+
+    let mut next = insts()
+        .flat_map(|inst| inst.def().into_iter().chain(inst.uses()))
+        .map(|t| t.0 + 1)
+        .max()
+        .unwrap_or(0);
+    let mut params: Vec<(usize, Inst)> = Vec::new();
+    let mut values: HashMap<Temp, Temp> = HashMap::new();
+    for (&slot, &(index, size)) in &slots {
+        if let Some(&(_, Some(signed))) = loads.get(&slot) {
+            let dst = Temp(next);
+            next += 1;
+            values.insert(slot, dst);
+            params.push((
+                index,
+                Inst::Param {
+                    dst,
+                    index,
+                    size,
+                    signed,
+                },
+            ));
+        }
+    }
+    params.sort_by_key(|(index, _)| *index);
+
+    for block in &mut func.blocks {
+        block.insts.retain_mut(|sinst| match &sinst.inst {
+            Inst::LoadParam { dst, .. } => !slots.contains_key(dst),
+            Inst::Load {
+                dst,
+                addr: Value::Temp(slot),
+                ..
+            } => {
+                if let Some(&value) = values.get(slot) {
+                    sinst.inst = Inst::Copy {
+                        dst: *dst,
+                        src: Value::Temp(value),
+                        width: 4,
+                    };
+                }
+                true
+            }
+            _ => true,
+        });
+    }
+
+    // A block of its own, since the old entry block may be a branch target
+    let mut entry = BasicBlock::new(Label(format!(".L{}_args", func.name).into()));
+    entry.insts = params
+        .into_iter()
+        .map(|(_, inst)| SpannedInst::new(inst, None))
+        .collect();
+    func.blocks.insert(0, entry);
+    func
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::types::IrType;
+
+    fn function(insts: Vec<Inst>) -> IrFunction {
+        let mut func = IrFunction::new("f".to_string(), Vec::new(), IrType::void());
+        let mut block = BasicBlock::new(Label("f".into()));
+        block.insts = insts
+            .into_iter()
+            .map(|i| SpannedInst::new(i, None))
+            .collect();
+        func.blocks.push(block);
+        func
+    }
+
+    fn load(dst: u32, slot: u32, size: usize, signed: bool) -> Inst {
+        Inst::Load {
+            dst: Temp(dst),
+            addr: Value::Temp(Temp(slot)),
+            size,
+            volatile: false,
+            signed,
+            width: 4,
+        }
+    }
+
+    #[test]
+    fn test_read_only_params_become_register_values() {
+        let func = function(vec![
+            Inst::LoadParam {
+                dst: Temp(0),
+                index: 0,
+                size: 4,
+            },
+            Inst::LoadParam {
+                dst: Temp(1),
+                index: 1,
+                size: 2,
+            },
+            load(2, 0, 4, true),
+            load(3, 1, 2, false),
+            Inst::Return(Some(Value::Temp(Temp(3)))),
+        ]);
+        let lowered = lower_params(&func);
+
+        assert_eq!(lowered.blocks.len(), 2);
+        let entry: Vec<_> = lowered.blocks[0].insts.iter().map(|s| &s.inst).collect();
+        assert!(matches!(
+            entry.as_slice(),
+            [
+                Inst::Param {
+                    index: 0,
+                    size: 4,
+                    ..
+                },
+                Inst::Param {
+                    index: 1,
+                    size: 2,
+                    signed: false,
+                    ..
+                }
+            ]
+        ));
+        let body = &lowered.blocks[1].insts;
+        assert!(
+            !body
+                .iter()
+                .any(|s| matches!(s.inst, Inst::LoadParam { .. }))
+        );
+        assert!(matches!(body[1].inst, Inst::Copy { dst: Temp(3), .. }));
+    }
+
+    #[test]
+    fn test_escaping_and_stack_params_keep_their_slots() {
+        let func = function(vec![
+            Inst::LoadParam {
+                dst: Temp(0),
+                index: 0,
+                size: 4,
+            },
+            Inst::LoadParam {
+                dst: Temp(1),
+                index: 4,
+                size: 4,
+            },
+            Inst::Call {
+                dst: None,
+                func: "g".into(),
+                args: vec![Value::Temp(Temp(0))],
+            },
+            load(2, 1, 4, true),
+            Inst::Return(Some(Value::Temp(Temp(2)))),
+        ]);
+        let lowered = lower_params(&func);
+
+        assert_eq!(lowered.blocks.len(), 1);
+        assert_eq!(lowered.blocks[0].insts.len(), func.blocks[0].insts.len());
+    }
+}
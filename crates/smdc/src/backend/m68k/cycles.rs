@@ -0,0 +1,466 @@
+//! Static cycle estimates
+//!
+//! `instruction_cycles` is the timing counterpart of
+//! `InstructionEncoder::instruction_size`: clock periods per instruction from
+//! the MC68000 user's manual, including effective address calculation and
+//! bus cycles for zero wait-state memory. Where the manual gives a range the
+//! estimate takes the slow end, so a budget built from these numbers errs
+//! on the safe side:
+//! - conditional branches and `DBF` count as taken;
+//! - `MULS`/`MULU` count as their worst case unless the multiplier is an
+//!   immediate, and `DIVS`/`DIVU` always do;
+//! - a shift count held in a register is taken as 8.
+//!
+//! `cycle_report` sums these per basic block of the generated code, for
+//! `--cycle-report`.
+
+use super::m68k::*;
+use crate::common::Symbol;
+use std::fmt::Write;
+
+/// Effective address calculation time for `op` accessed at `size`
+fn ea_cycles(op: &Operand, size: Size) -> u32 {
+    let long = size == Size::Long;
+    let (short, wide) = match op {
+        Operand::DataReg(_) | Operand::AddrReg(_) | Operand::Sr => (0, 0),
+        Operand::AddrInd(_) | Operand::PostInc(_) | Operand::Imm(_) => (4, 8),
+        Operand::PreDec(_) => (6, 10),
+        Operand::Disp(..) | Operand::AbsShort(_) | Operand::PcRel(_) => (8, 12),
+        Operand::Indexed(..) => (10, 14),
+        // Labels are assembled as absolute long addresses
+        Operand::AbsLong(_) | Operand::Label(_) => (12, 16),
+    };
+    if long { wide } else { short }
+}
+
+/// Time to write a `MOVE` destination (predecrement costs no extra here)
+fn move_destination_cycles(op: &Operand, size: Size) -> u32 {
+    match op {
+        Operand::PreDec(a) => ea_cycles(&Operand::AddrInd(*a), size),
+        _ => ea_cycles(op, size),
+    }
+}
+
+/// Extra time `LEA`, `PEA`, `JMP`, `JSR` and `MOVEM` take to form an address
+/// beyond the `(An)` form: `(displacement, indexed, absolute long)`
+fn control_cycles(op: &Operand, (disp, indexed, long): (u32, u32, u32)) -> u32 {
+    match op {
+        Operand::Disp(..) | Operand::AbsShort(_) | Operand::PcRel(_) => disp,
+        Operand::Indexed(..) => indexed,
+        Operand::AbsLong(_) | Operand::Label(_) => long,
+        _ => 0,
+    }
+}
+
+fn is_register(op: &Operand) -> bool {
+    matches!(op, Operand::DataReg(_) | Operand::AddrReg(_))
+}
+
+/// Register-to-register time, or read-modify-write time for a memory operand
+fn read_modify_write(size: Size, op: &Operand, register: (u32, u32)) -> u32 {
+    let long = size == Size::Long;
+    if is_register(op) {
+        if long { register.1 } else { register.0 }
+    } else {
+        (if long { 12 } else { 8 }) + ea_cycles(op, size)
+    }
+}
+
+/// Shift or rotate of a data register by `count`
+fn shift_cycles(size: Size, count: &Operand) -> u32 {
+    let base = if size == Size::Long { 8 } else { 6 };
+    match count {
+        // The encoder splits counts above 8 into several instructions
+        Operand::Imm(n) => {
+            let n = (*n).max(1) as u32;
+            n.div_ceil(8) * base + 2 * n
+        }
+        _ => base + 16,
+    }
+}
+
+/// Estimated clock periods for one instruction; zero for pseudo-instructions
+pub fn instruction_cycles(inst: &M68kInst) -> u32 {
+    match inst {
+        M68kInst::Label(_) | M68kInst::Comment(_) | M68kInst::Directive(_) | M68kInst::Barrier => 0,
+
+        M68kInst::Move(size, src, Operand::Sr) => 12 + ea_cycles(src, *size),
+        M68kInst::Move(_, Operand::Sr, dst) => {
+            if is_register(dst) {
+                6
+            } else {
+                8 + ea_cycles(dst, Size::Word)
+            }
+        }
+        M68kInst::Move(size, src, dst) => {
+            4 + ea_cycles(src, *size) + move_destination_cycles(dst, *size)
+        }
+        M68kInst::Moveq(..) | M68kInst::Ext(..) | M68kInst::Swap(_) | M68kInst::Nop => 4,
+        M68kInst::Exg(..) | M68kInst::Scc(_, Operand::DataReg(_)) => 6,
+        M68kInst::Lea(op, _) => 4 + control_cycles(op, (4, 8, 8)),
+        M68kInst::Pea(op) => 12 + control_cycles(op, (4, 8, 8)),
+
+        M68kInst::Add(size, src, dst)
+        | M68kInst::Sub(size, src, dst)
+        | M68kInst::And(size, src, dst)
+        | M68kInst::Or(size, src, dst) => {
+            if is_register(dst) {
+                let long_extra = if is_register(src) || matches!(src, Operand::Imm(_)) {
+                    8
+                } else {
+                    6
+                };
+                ea_cycles(src, *size) + if *size == Size::Long { long_extra } else { 4 }
+            } else {
+                read_modify_write(*size, dst, (4, 8))
+            }
+        }
+        M68kInst::Cmp(size, src, _) => {
+            ea_cycles(src, *size) + if *size == Size::Long { 6 } else { 4 }
+        }
+        M68kInst::Adda(size, src, _) | M68kInst::Suba(size, src, _) => {
+            let long_from_memory =
+                *size == Size::Long && !is_register(src) && !matches!(src, Operand::Imm(_));
+            ea_cycles(src, *size) + if long_from_memory { 6 } else { 8 }
+        }
+        M68kInst::Cmpa(size, src, _) => 6 + ea_cycles(src, *size),
+        M68kInst::Addq(size, _, op) | M68kInst::Subq(size, _, op) => match op {
+            Operand::AddrReg(_) => 8,
+            _ => read_modify_write(*size, op, (4, 8)),
+        },
+
+        M68kInst::Addi(size, _, op)
+        | M68kInst::Subi(size, _, op)
+        | M68kInst::Ori(size, _, op)
+        | M68kInst::Eori(size, _, op) => immediate_cycles(*size, op, 16),
+        M68kInst::Andi(size, _, op) => immediate_cycles(*size, op, 14),
+        M68kInst::Cmpi(size, _, op) => {
+            if is_register(op) {
+                if *size == Size::Long { 14 } else { 8 }
+            } else {
+                ea_cycles(op, *size) + if *size == Size::Long { 12 } else { 8 }
+            }
+        }
+
+        M68kInst::Clr(size, op) | M68kInst::Neg(size, op) | M68kInst::Not(size, op) => {
+            read_modify_write(*size, op, (4, 6))
+        }
+        M68kInst::Tst(size, op) => 4 + ea_cycles(op, *size),
+        M68kInst::Eor(size, _, op) => read_modify_write(*size, op, (4, 8)),
+
+        M68kInst::Muls(src, _) | M68kInst::Mulu(src, _) => {
+            let signed = matches!(inst, M68kInst::Muls(..));
+            38 + 2 * multiplier_bits(src, signed) + ea_cycles(src, Size::Word)
+        }
+        M68kInst::Divu(src, _) => 140 + ea_cycles(src, Size::Word),
+        M68kInst::Divs(src, _) => 158 + ea_cycles(src, Size::Word),
+
+        M68kInst::Lsl(size, count, _)
+        | M68kInst::Lsr(size, count, _)
+        | M68kInst::Asl(size, count, _)
+        | M68kInst::Asr(size, count, _)
+        | M68kInst::Rol(size, count, _)
+        | M68kInst::Ror(size, count, _) => shift_cycles(*size, count),
+
+        M68kInst::Btst(bit, op) => {
+            let static_bit = u32::from(matches!(bit, Operand::Imm(_)));
+            if is_register(op) {
+                6 + 4 * static_bit
+            } else {
+                4 + 4 * static_bit + ea_cycles(op, Size::Byte)
+            }
+        }
+        M68kInst::Bset(bit, op) | M68kInst::Bchg(bit, op) | M68kInst::Bclr(bit, op) => {
+            let static_bit = 4 * u32::from(matches!(bit, Operand::Imm(_)));
+            if is_register(op) {
+                let clear = 2 * u32::from(matches!(inst, M68kInst::Bclr(..)));
+                8 + static_bit + clear
+            } else {
+                8 + static_bit + ea_cycles(op, Size::Byte)
+            }
+        }
+
+        M68kInst::Bra(_) | M68kInst::Bcc(..) | M68kInst::Dbf(..) => 10,
+        M68kInst::Bsr(_) => 18,
+        M68kInst::Jmp(op) => 8 + control_cycles(op, (2, 6, 4)),
+        M68kInst::Jsr(op) => 16 + control_cycles(op, (2, 6, 4)),
+        M68kInst::Rts | M68kInst::Link(..) => 16,
+        M68kInst::Rte => 20,
+        M68kInst::Unlk(_) => 12,
+
+        M68kInst::Movem(size, regs, op, to_memory) => {
+            let per_reg = if *size == Size::Long { 8 } else { 4 };
+            let base = if *to_memory { 8 } else { 12 };
+            base + control_cycles(op, (4, 6, 8)) + per_reg * regs.len() as u32
+        }
+        M68kInst::Scc(_, op) => 8 + ea_cycles(op, Size::Byte),
+    }
+}
+
+/// `ADDI`-style immediate operation, or the `#imm,SR` form
+fn immediate_cycles(size: Size, op: &Operand, long_register: u32) -> u32 {
+    match op {
+        Operand::Sr => 20,
+        _ if is_register(op) => {
+            if size == Size::Long {
+                long_register
+            } else {
+                8
+            }
+        }
+        _ => ea_cycles(op, size) + if size == Size::Long { 20 } else { 12 },
+    }
+}
+
+/// Number of two-cycle steps a multiply takes beyond its base time: one per
+/// set bit of an unsigned multiplier, one per 01/10 pair of a signed one
+/// (with a zero appended). Unknown multipliers take the worst case.
+fn multiplier_bits(src: &Operand, signed: bool) -> u32 {
+    let Operand::Imm(n) = src else {
+        return 16;
+    };
+    let bits = u32::from(*n as u16);
+    if signed {
+        let bits = bits << 1;
+        ((bits ^ (bits >> 1)) & 0xFFFF).count_ones()
+    } else {
+        bits.count_ones()
+    }
+}
+
+/// One basic block of a report
+struct Block {
+    label: Symbol,
+    cycles: u32,
+    /// Number of loops (backward branches) enclosing the block
+    loop_depth: usize,
+    /// Source location from the nearest `-g` line comment
+    source: Option<String>,
+}
+
+/// Per-block cycle estimates for every function in `code`.
+///
+/// A label without a leading `.` starts a function; other labels start
+/// blocks within it. A block lies in a loop when a branch at or after it
+/// jumps back to a label at or before it. With `-g`, each block shows the
+/// source line its code came from.
+pub fn cycle_report(code: &[M68kInst]) -> String {
+    let mut out = String::new();
+    let text_end = code
+        .iter()
+        .position(|inst| {
+            matches!(inst, M68kInst::Directive(Directive::Section(s)) if *s != SectionName::Text)
+        })
+        .unwrap_or(code.len());
+    let code = &code[..text_end];
+
+    let mut start = 0;
+    while start < code.len() {
+        let end = code[start + 1..]
+            .iter()
+            .position(|inst| matches!(inst, M68kInst::Label(l) if !l.starts_with('.')))
+            .map_or(code.len(), |i| start + 1 + i);
+        if let M68kInst::Label(name) = &code[start] {
+            let blocks = function_blocks(&code[start..end]);
+            let total: u32 = blocks.iter().map(|b| b.cycles).sum();
+            start = end;
+            // Data labels and the like
+            if total == 0 {
+                continue;
+            }
+            let _ = writeln!(out, "{name}: {total} cycles");
+            for block in &blocks {
+                let loop_note = match block.loop_depth {
+                    0 => String::new(),
+                    1 => "loop".to_string(),
+                    depth => format!("loop x{depth}"),
+                };
+                let _ = writeln!(
+                    out,
+                    "  {:<28} {:>6}  {:<8} {}",
+                    block.label,
+                    block.cycles,
+                    loop_note,
+                    block.source.as_deref().unwrap_or("")
+                );
+            }
+        } else {
+            start = end;
+        }
+    }
+    out
+}
+
+/// Split one function's code into blocks and mark the loops among them
+fn function_blocks(code: &[M68kInst]) -> Vec<Block> {
+    let mut blocks: Vec<Block> = Vec::new();
+    // (block index, label) for each label, and (block index, target) for
+    // each branch
+    let mut labels: Vec<(usize, Symbol)> = Vec::new();
+    let mut branches: Vec<(usize, Symbol)> = Vec::new();
+    let mut source: Option<String> = None;
+    for inst in code {
+        match inst {
+            M68kInst::Label(label) => {
+                // Consecutive labels name the same block
+                if blocks.last().is_none_or(|b| b.cycles > 0) {
+                    blocks.push(Block {
+                        label: *label,
+                        cycles: 0,
+                        loop_depth: 0,
+                        source: source.clone(),
+                    });
+                }
+                labels.push((blocks.len() - 1, *label));
+            }
+            M68kInst::Comment(comment) if is_source_line(comment) => {
+                source = Some(comment.clone());
+                if let Some(block) = blocks.last_mut()
+                    && block.cycles == 0
+                {
+                    block.source.clone_from(&source);
+                }
+            }
+            _ => {
+                if let Some(block) = blocks.last_mut() {
+                    block.cycles += instruction_cycles(inst);
+                }
+                if let M68kInst::Bra(target) | M68kInst::Bcc(_, target) | M68kInst::Dbf(_, target) =
+                    inst
+                {
+                    branches.push((blocks.len().saturating_sub(1), *target));
+                }
+            }
+        }
+    }
+
+    for (from, target) in branches {
+        if let Some(&(to, _)) = labels.iter().find(|(_, l)| *l == target)
+            && to <= from
+        {
+            for block in &mut blocks[to..=from] {
+                block.loop_depth += 1;
+            }
+        }
+    }
+    blocks
+}
+
+/// Whether a comment is a `-g` source location (`file:line`)
+fn is_source_line(comment: &str) -> bool {
+    comment
+        .rsplit_once(':')
+        .is_some_and(|(file, line)| !file.is_empty() && line.parse::<usize>().is_ok())
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn d(n: u8) -> DataReg {
+        [DataReg::D0, DataReg::D1, DataReg::D2][n as usize]
+    }
+
+    #[test]
+    fn test_manual_timings() {
+        let cases = [
+            (M68kInst::Moveq(1, d(0)), 4),
+            (
+                M68kInst::Move(
+                    Size::Word,
+                    Operand::DataReg(d(0)),
+                    Operand::AbsLong(0xC00000),
+                ),
+                16,
+            ),
+            (
+                M68kInst::Move(Size::Long, Operand::Imm(5), Operand::PreDec(AddrReg::A7)),
+                20,
+            ),
+            (
+                M68kInst::Move(
+                    Size::Long,
+                    Operand::Disp(8, AddrReg::A6),
+                    Operand::DataReg(d(2)),
+                ),
+                16,
+            ),
+            (
+                M68kInst::Add(Size::Long, Operand::DataReg(d(1)), Operand::DataReg(d(0))),
+                8,
+            ),
+            (
+                M68kInst::Add(
+                    Size::Word,
+                    Operand::AddrInd(AddrReg::A0),
+                    Operand::DataReg(d(0)),
+                ),
+                8,
+            ),
+            (M68kInst::Addi(Size::Long, 1000, Operand::DataReg(d(0))), 16),
+            (M68kInst::Andi(Size::Long, 0xFF, Operand::DataReg(d(0))), 14),
+            (
+                M68kInst::Addq(Size::Long, 4, Operand::AddrReg(AddrReg::A7)),
+                8,
+            ),
+            (M68kInst::Lsl(Size::Long, Operand::Imm(3), d(0)), 14),
+            (M68kInst::Muls(Operand::Imm(1), d(0)), 46),
+            (M68kInst::Mulu(Operand::DataReg(d(1)), d(0)), 70),
+            (M68kInst::Jsr(Operand::Label("f".into())), 20),
+            (
+                M68kInst::Lea(Operand::Disp(-4, AddrReg::A6), AddrReg::A0),
+                8,
+            ),
+            (M68kInst::Link(AddrReg::A6, -8), 16),
+            (M68kInst::Rts, 16),
+            (
+                M68kInst::Movem(
+                    Size::Long,
+                    vec![Reg::Data(d(2)), Reg::Data(DataReg::D3)],
+                    Operand::PreDec(AddrReg::A7),
+                    true,
+                ),
+                24,
+            ),
+            (
+                M68kInst::Movem(
+                    Size::Long,
+                    vec![Reg::Data(d(2)), Reg::Data(DataReg::D3)],
+                    Operand::PostInc(AddrReg::A7),
+                    false,
+                ),
+                28,
+            ),
+            (M68kInst::Label("x".into()), 0),
+        ];
+        for (inst, expected) in cases {
+            assert_eq!(instruction_cycles(&inst), expected, "{}", inst.format());
+        }
+    }
+
+    #[test]
+    fn test_report_flags_loops_and_source_lines() {
+        let code = vec![
+            M68kInst::Directive(Directive::Global("f".into())),
+            M68kInst::Label("f".into()),
+            M68kInst::Comment("a.c:3".to_string()),
+            M68kInst::Moveq(9, d(0)),
+            M68kInst::Label(".Lloop".into()),
+            M68kInst::Comment("a.c:4".to_string()),
+            M68kInst::Nop,
+            M68kInst::Dbf(d(0), ".Lloop".into()),
+            M68kInst::Label(".Ldone".into()),
+            M68kInst::Rts,
+            M68kInst::Label("g".into()),
+            M68kInst::Rts,
+        ];
+        let report = cycle_report(&code);
+        let lines: Vec<_> = report.lines().collect();
+        assert_eq!(lines[0], "f: 34 cycles");
+        assert!(lines[1].contains(" 4 ") && lines[1].ends_with("a.c:3"));
+        assert!(lines[2].starts_with("  .Lloop") && lines[2].contains("loop"));
+        assert!(lines[2].ends_with("a.c:4"));
+        assert!(!lines[3].contains("loop"));
+        assert_eq!(lines[4], "g: 16 cycles");
+    }
+}
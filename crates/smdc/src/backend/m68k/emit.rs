@@ -1,22 +1,74 @@
 //! M68k code emitter
 
+use super::callconv::{self, ARG_REGS};
+use super::encoder::InstructionEncoder;
 use super::m68k::*;
+use super::peephole::{self, Peephole};
+use super::regalloc::{self, Allocation};
 use super::sdk::{
-    SdkFunctionKind, SdkInlineGenerator, SdkLibraryGenerator, SdkRegistry, generate_static_data,
-    resolve_dependencies,
+    SdkFunctionKind, SdkInlineGenerator, SdkLibraryGenerator, SdkRegistry, SdkSpecializer,
+    VBLANK_CALLBACK, VDP_DATA, generate_static_data, inline_uses_static_data, needs_dma_queue,
+    needs_frame_counter, resolve_dependencies,
 };
-use crate::common::CompileResult;
+use super::strength;
+use crate::backend::StartupMode;
+use crate::common::stats::{self, FunctionStats};
+use crate::common::{CompileResult, Symbol};
 use crate::ir::*;
 use std::collections::{HashMap, HashSet};
 
+/// End of everything the program keeps in RAM (.data, .bss and SDK state)
+const BSS_END: &str = "__bss_end";
+
+/// Switches with at most this many cases compare against each in turn
+const SWITCH_CHAIN_MAX: usize = 3;
+
+/// A switch gets a jump table when its cases fill at least one in this many
+/// of the slots between the lowest and highest case
+const SWITCH_TABLE_DENSITY: i64 = 3;
+
+/// Data registers SDK inline calls receive their arguments in
+const SDK_ARG_REGS: [DataReg; 4] = [DataReg::D0, DataReg::D1, DataReg::D2, DataReg::D3];
+
+/// Registers a function must preserve for its caller
+const CALLEE_SAVED: [Reg; 10] = [
+    Reg::Data(DataReg::D2),
+    Reg::Data(DataReg::D3),
+    Reg::Data(DataReg::D4),
+    Reg::Data(DataReg::D5),
+    Reg::Data(DataReg::D6),
+    Reg::Data(DataReg::D7),
+    Reg::Addr(AddrReg::A2),
+    Reg::Addr(AddrReg::A3),
+    Reg::Addr(AddrReg::A4),
+    Reg::Addr(AddrReg::A5),
+];
+
+/// Where the value of an IR temp lives
+#[derive(Debug, Clone, Copy)]
+enum TempHome {
+    /// Held in a register for its whole lifetime
+    Reg(Reg),
+    /// Constant frame address (offset from FP) of an Alloca or parameter slot
+    Frame(i16),
+    /// Spilled to a stack slot (offset from FP)
+    Slot(i16),
+}
+
 /// Code generator that converts IR to M68k assembly
 pub struct CodeGenerator {
     output: Vec<M68kInst>,
-    /// Maps IR temps to stack offsets (negative from FP)
+    /// Maps spilled IR temps to stack offsets (negative from FP)
     temp_offsets: HashMap<u32, i16>,
+    /// Frame addresses of Alloca/LoadParam temps (offset from FP)
+    frame_temps: HashMap<u32, i16>,
+    /// Register assignment for the function being generated
+    alloc: Allocation,
+    /// Registers destroyed by each SDK library function (and its dependencies)
+    sdk_clobbers: HashMap<String, RegMask>,
     /// Current stack frame size
     frame_size: i16,
-    /// Next stack offset
+    /// Lowest frame offset allocated so far (grows downward from 0)
     next_offset: i16,
     /// Total size of global data (for RAM allocation)
     data_size: usize,
@@ -32,6 +84,22 @@ pub struct CodeGenerator {
     debug_filename: String,
     /// Source text for byte-offset → line mapping
     debug_source: String,
+    /// Rewrites applied to each generated function
+    peephole: Peephole,
+    /// Optimization level (`-O`)
+    optimize_level: u8,
+    /// How much hardware state the startup stub clears
+    startup: StartupMode,
+    /// Temps of the current function known to hold 16-bit unsigned values
+    narrow: HashSet<Temp>,
+    /// Counter for labels the emitter introduces itself
+    next_label: usize,
+    /// Parameters of the current function that arrive in `ARG_REGS`
+    reg_params: usize,
+    /// Generating an object for separate compilation
+    separate: bool,
+    /// Frame slots the prologue stores register parameters into, by index
+    reg_param_slots: HashMap<usize, i16>,
 }
 
 impl CodeGenerator {
@@ -39,8 +107,11 @@ impl CodeGenerator {
         Self {
             output: Vec::new(),
             temp_offsets: HashMap::new(),
+            frame_temps: HashMap::new(),
+            alloc: Allocation::default(),
+            sdk_clobbers: HashMap::new(),
             frame_size: 0,
-            next_offset: -4,
+            next_offset: 0,
             data_size: 0,
             sdk_registry: SdkRegistry::new(),
             pending_sdk_functions: HashSet::new(),
@@ -48,21 +119,31 @@ impl CodeGenerator {
             debug_enabled: false,
             debug_filename: String::new(),
             debug_source: String::new(),
+            peephole: Peephole::new(),
+            optimize_level: 0,
+            startup: StartupMode::default(),
+            narrow: HashSet::new(),
+            next_label: 0,
+            reg_params: 0,
+            separate: false,
+            reg_param_slots: HashMap::new(),
         }
     }
 
     /// Generate M68k assembly from IR module as text
     pub fn generate(&mut self, module: &IrModule) -> CompileResult<String> {
         let instructions = self.generate_instructions(module)?;
+        Ok(Self::format(&instructions))
+    }
 
-        // Format output
+    /// Assembly text for generated instructions, one per line
+    pub fn format(instructions: &[M68kInst]) -> String {
         let mut result = String::new();
-        for inst in &instructions {
+        for inst in instructions {
             result.push_str(&inst.format());
             result.push('\n');
         }
-
-        Ok(result)
+        result
     }
 
     /// Enable debug output (source comments in assembly)
@@ -72,11 +153,119 @@ impl CodeGenerator {
         self.debug_source = source;
     }
 
+    /// Enable the peephole rules and strength reduction for `-O<level>`
+    pub fn set_optimize_level(&mut self, level: u8) {
+        self.optimize_level = level;
+        self.peephole = Peephole::for_level(level);
+    }
+
+    /// Choose what the startup stub clears before `main`
+    pub fn set_startup(&mut self, mode: StartupMode) {
+        self.startup = mode;
+    }
+
     /// Generate M68k instructions from IR module (for binary output)
     pub fn generate_instructions(&mut self, module: &IrModule) -> CompileResult<Vec<M68kInst>> {
+        self.begin_module(module, false);
+
+        // Emit header
+        self.emit(M68kInst::Directive(Directive::Section(SectionName::Text)));
+        self.emit(M68kInst::Directive(Directive::Align(2)));
+
+        // Emit startup stub at entry point (0x200)
+        // This ensures the ROM starts properly regardless of function order
+        let mode_register = self.emit_startup_stub();
+
+        // Emit user functions
+        for func in &module.functions {
+            self.generate_function(func)?;
+        }
+
+        // Emit SDK library functions that were used
+        self.emit_sdk_library_functions();
+
+        // With a VBlank handler in the ROM, the startup stub can turn the
+        // VBlank interrupt on, and DMA for the queue
+        if self.emit_vblank_handler() {
+            self.enable_vblank_interrupt(mode_register);
+        }
+
+        // Emit data section with ROM initial values and RAM references. The
+        // startup stub copies it, so the labels are there even when empty.
+        self.emit_module_data(module, true);
+
+        // Emit SDK static data (frame counter, operator offsets, etc.)
+        self.emit_sdk_static_data();
+
+        // The startup stub zeroes RAM up to here
+        self.emit(M68kInst::Directive(Directive::Section(SectionName::Bss)));
+        self.emit(M68kInst::Directive(Directive::Align(4)));
+        self.emit(M68kInst::Label(BSS_END.into()));
+
+        Ok(std::mem::take(&mut self.output))
+    }
+
+    /// Generate one separately compiled translation unit: its functions and
+    /// globals, without the startup stub or SDK library routines, which
+    /// `generate_runtime` provides once for all objects. Calls between user
+    /// functions pass every argument on the stack, as the callee may be in
+    /// another object.
+    pub fn generate_object_instructions(
+        &mut self,
+        module: &IrModule,
+    ) -> CompileResult<Vec<M68kInst>> {
+        self.begin_module(module, true);
+
+        self.emit(M68kInst::Directive(Directive::Section(SectionName::Text)));
+        self.emit(M68kInst::Directive(Directive::Align(2)));
+        for func in &module.functions {
+            self.generate_function(func)?;
+        }
+        self.emit_module_data(module, false);
+
+        Ok(std::mem::take(&mut self.output))
+    }
+
+    /// SDK library routines the last generated module calls, sorted
+    pub fn sdk_functions(&self) -> Vec<String> {
+        let mut functions: Vec<String> = self.pending_sdk_functions.iter().cloned().collect();
+        functions.sort();
+        functions
+    }
+
+    /// Generate the code separately compiled objects share: the startup
+    /// stub, the SDK library routines in `sdk_functions` and their
+    /// dependencies, the VBlank handler and SDK state. `defined` holds every
+    /// function the objects define. The linker supplies the section
+    /// boundary labels the startup stub refers to.
+    pub fn generate_runtime(
+        &mut self,
+        sdk_functions: &HashSet<String>,
+        defined: &HashSet<String>,
+    ) -> Vec<M68kInst> {
+        self.output.clear();
+        self.separate = true;
+        self.pending_sdk_functions = sdk_functions.clone();
+        self.defined_functions = defined.clone();
+
+        self.emit(M68kInst::Directive(Directive::Section(SectionName::Text)));
+        self.emit(M68kInst::Directive(Directive::Align(2)));
+        let mode_register = self.emit_startup_stub();
+        self.emit_sdk_library_functions();
+        if self.emit_vblank_handler() {
+            self.enable_vblank_interrupt(mode_register);
+        }
+        self.emit_sdk_static_data();
+
+        std::mem::take(&mut self.output)
+    }
+
+    /// Reset per-module state before generating `module`
+    fn begin_module(&mut self, module: &IrModule, separate: bool) {
         self.output.clear();
         self.pending_sdk_functions.clear();
         self.defined_functions.clear();
+        self.separate = separate;
 
         // Debug info is configured externally via set_debug_info() before calling this
 
@@ -87,97 +276,114 @@ impl CodeGenerator {
 
         // Calculate total data size first (for RAM allocation)
         self.data_size = 0;
-        for global in &module.globals {
+        for global in module.globals.iter().filter(|g| !g.readonly) {
             let size = global.ty.size;
             // Align to 4 bytes for efficiency
             self.data_size = (self.data_size + 3) & !3;
             self.data_size += size;
         }
-        for (_, string) in &module.strings {
-            self.data_size += string.len() + 1; // +1 for null terminator
-        }
         // Align final size
         self.data_size = (self.data_size + 3) & !3;
+    }
 
-        // Emit header
-        self.emit(M68kInst::Directive(".section .text".to_string()));
-        self.emit(M68kInst::Directive(".align 2".to_string()));
-
-        // Emit startup stub at entry point (0x200)
-        // This ensures the ROM starts properly regardless of function order
-        self.emit_startup_stub();
+    /// Turn on the VBlank interrupt in the startup stub's mode register 2
+    /// write, at `mode_register`
+    fn enable_vblank_interrupt(&mut self, mode_register: usize) {
+        self.output[mode_register] = M68kInst::Move(
+            Size::Word,
+            Operand::Imm(0x8134),
+            Operand::AddrInd(AddrReg::A1),
+        );
+    }
 
-        // Emit user functions
-        for func in &module.functions {
-            self.generate_function(func)?;
+    /// Emit the module's globals and string literals into `.data`, `.bss`
+    /// and `.rodata`. With `markers`, `.data` is bracketed by the labels
+    /// the startup stub copies it with; a linked program gets them from the
+    /// linker instead.
+    fn emit_module_data(&mut self, module: &IrModule, markers: bool) {
+        // Emit label for ROM location BEFORE switching to data section
+        // This label gets a ROM address (where initial values are stored)
+        // Long-aligned in ROM and RAM alike, so the copy can go by longs
+        if markers {
+            self.emit(M68kInst::Directive(Directive::Align(4)));
+            self.emit(M68kInst::Label("__data_rom_start".into()));
         }
 
-        // Emit SDK library functions that were used
-        self.emit_sdk_library_functions();
-
-        // Emit data section with ROM initial values and RAM references
-        if !module.globals.is_empty() || !module.strings.is_empty() {
-            // Emit label for ROM location BEFORE switching to data section
-            // This label gets a ROM address (where initial values are stored)
-            self.emit(M68kInst::Directive(".align 2".to_string()));
-            self.emit(M68kInst::Label("__data_rom_start".to_string()));
+        // Now switch to data section - labels get RAM addresses
+        self.emit(M68kInst::Directive(Directive::Section(SectionName::Data)));
+        self.emit(M68kInst::Directive(Directive::Align(2)));
 
-            // Now switch to data section - labels get RAM addresses
-            self.emit(M68kInst::Directive(".section .data".to_string()));
-            self.emit(M68kInst::Directive(".align 2".to_string()));
+        // Mark start of data in RAM
+        if markers {
+            self.emit(M68kInst::Label("__data_ram_start".into()));
+        }
+        for global in &module.globals {
+            if !global.readonly && global.init.is_some() {
+                self.emit_global(global);
+            }
+        }
 
-            // Mark start of data in RAM
-            self.emit(M68kInst::Label("__data_ram_start".to_string()));
+        // Mark end of data in RAM
+        if markers {
+            self.emit(M68kInst::Directive(Directive::Align(4)));
+            self.emit(M68kInst::Label("__data_ram_end".into()));
+        }
 
+        // Zero-initialized globals only need RAM, which startup clears
+        if module
+            .globals
+            .iter()
+            .any(|g| !g.readonly && g.init.is_none())
+        {
+            self.emit(M68kInst::Directive(Directive::Section(SectionName::Bss)));
             for global in &module.globals {
-                self.emit(M68kInst::Label(global.name.clone()));
-                if let Some(init_bytes) = &global.init {
-                    // Emit initialized data
-                    self.emit_data_bytes(init_bytes);
-                } else {
-                    // Zero-initialized
-                    let size = global.ty.size;
-                    match size {
-                        1 => self.emit(M68kInst::Directive(".byte 0".to_string())),
-                        2 => self.emit(M68kInst::Directive(".word 0".to_string())),
-                        _ => self.emit(M68kInst::Directive(format!(".space {size}"))),
-                    }
+                if !global.readonly && global.init.is_none() {
+                    self.emit_global(global);
                 }
             }
+        }
 
-            for (label, string) in &module.strings {
-                self.emit(M68kInst::Label(label.0.clone()));
-                // Escape the string for assembly
-                let escaped = string
-                    .replace('\\', "\\\\")
-                    .replace('"', "\\\"")
-                    .replace('\n', "\\n")
-                    .replace('\r', "\\r")
-                    .replace('\t', "\\t")
-                    .replace('\0', "\\0");
-                self.emit(M68kInst::Directive(format!(".asciz \"{escaped}\"")));
+        // Read-only globals and string literals stay in ROM
+        if module.globals.iter().any(|g| g.readonly) || !module.strings.is_empty() {
+            self.emit(M68kInst::Directive(Directive::Section(SectionName::Rodata)));
+            self.emit(M68kInst::Directive(Directive::Align(2)));
+            for global in module.globals.iter().filter(|g| g.readonly) {
+                self.emit_global(global);
             }
 
-            // Mark end of data in RAM
-            self.emit(M68kInst::Directive(".align 2".to_string()));
-            self.emit(M68kInst::Label("__data_ram_end".to_string()));
+            for (label, string) in &module.strings {
+                self.emit(M68kInst::Label(label.0));
+                self.emit(M68kInst::Directive(Directive::Asciz(string.clone())));
+            }
+            self.emit(M68kInst::Directive(Directive::Align(2)));
         }
-
-        // Emit SDK static data (frame counter, operator offsets, etc.)
-        self.emit_sdk_static_data();
-
-        Ok(std::mem::take(&mut self.output))
     }
 
     fn emit(&mut self, inst: M68kInst) {
         self.output.push(inst);
     }
 
+    /// Emit a memory access, fenced off from the peephole optimizer when
+    /// it is volatile. The IR passes (`opt`) already leave such accesses
+    /// alone; without the fences a store and reload of the same global or
+    /// frame slot would still be forwarded here.
+    fn emit_access(&mut self, inst: M68kInst, volatile: bool) {
+        if volatile {
+            self.emit(M68kInst::Barrier);
+            self.emit(inst);
+            self.emit(M68kInst::Barrier);
+        } else {
+            self.emit(inst);
+        }
+    }
+
     /// Emit the startup stub that runs at entry point (0x200)
     /// This initializes the Genesis hardware and calls main
-    fn emit_startup_stub(&mut self) {
-        self.emit(M68kInst::Label("_start".to_string()));
-        self.emit(M68kInst::Directive(".global _start".to_string()));
+    ///
+    /// Returns the index of the mode register 2 write.
+    fn emit_startup_stub(&mut self) -> usize {
+        self.emit(M68kInst::Label("_start".into()));
+        self.emit(M68kInst::Directive(Directive::Global("_start".into())));
 
         // Disable interrupts during initialization
         // move.w #$2700, sr (set supervisor mode, disable interrupts)
@@ -199,13 +405,13 @@ impl CodeGenerator {
             Operand::Imm(0),
             Operand::AddrInd(AddrReg::A0),
         ));
-        self.emit(M68kInst::Bcc(Cond::Eq, ".no_tmss".to_string()));
+        self.emit(M68kInst::Bcc(Cond::Eq, ".no_tmss".into()));
         self.emit(M68kInst::Move(
             Size::Long,
             Operand::Imm(0x53454741), // 'SEGA'
             Operand::AbsLong(0xA14000),
         ));
-        self.emit(M68kInst::Label(".no_tmss".to_string()));
+        self.emit(M68kInst::Label(".no_tmss".into()));
 
         // Request Z80 bus and reset Z80 for PSG access
         // Write $0100 to $A11100 to request Z80 bus
@@ -221,56 +427,53 @@ impl CodeGenerator {
             Operand::AbsLong(0xA11200),
         ));
         // Wait for Z80 bus grant
-        self.emit(M68kInst::Label(".wait_z80".to_string()));
+        self.emit(M68kInst::Label(".wait_z80".into()));
         self.emit(M68kInst::Btst(Operand::Imm(0), Operand::AbsLong(0xA11100)));
-        self.emit(M68kInst::Bcc(Cond::Ne, ".wait_z80".to_string()));
-
-        // Initialize RAM - clear first 64KB of work RAM
-        // lea $FF0000, a0  ; Start of RAM
-        // move.w #$3FFF, d0 ; 64KB / 4 - 1 = $3FFF longs
-        // .clear_ram:
-        // clr.l (a0)+
-        // dbf d0, .clear_ram
-        self.emit(M68kInst::Lea(Operand::AbsLong(0xFF0000), AddrReg::A0));
-        self.emit(M68kInst::Move(
-            Size::Word,
-            Operand::Imm(0x3FFF),
-            Operand::DataReg(DataReg::D0),
-        ));
-        self.emit(M68kInst::Label(".clear_ram".to_string()));
-        self.emit(M68kInst::Clr(Size::Long, Operand::PostInc(AddrReg::A0)));
-        self.emit(M68kInst::Dbf(DataReg::D0, ".clear_ram".to_string()));
+        self.emit(M68kInst::Bcc(Cond::Ne, ".wait_z80".into()));
+
+        // Zero RAM: all 64KB for a full startup, otherwise just the .bss
+        // the program uses. Either way, .data is then copied over from ROM.
+        match self.startup {
+            StartupMode::Full => {
+                self.emit(M68kInst::Lea(Operand::AbsLong(0xFF0000), AddrReg::A1));
+                self.emit(M68kInst::Lea(Operand::AbsLong(0x0100_0000), AddrReg::A2));
+            }
+            StartupMode::Minimal => {
+                self.emit(M68kInst::Lea(
+                    Operand::Label("__data_ram_end".into()),
+                    AddrReg::A1,
+                ));
+                self.emit(M68kInst::Lea(Operand::Label(BSS_END.into()), AddrReg::A2));
+            }
+        }
+        self.emit_ram_clear();
 
-        // Copy initialized data from ROM to RAM
+        // Copy initialized data from ROM to RAM, a long at a time
         // Source: __data_rom_start (ROM address)
         // Dest: __data_ram_start (RAM address = 0xFF8000)
-        // Count: __data_ram_end - __data_ram_start
+        // Count: (__data_ram_end - __data_ram_start) / 4
         self.emit(M68kInst::Lea(
-            Operand::Label("__data_rom_start".to_string()),
+            Operand::Label("__data_rom_start".into()),
             AddrReg::A0,
         )); // Source in ROM
         self.emit(M68kInst::Lea(
-            Operand::Label("__data_ram_start".to_string()),
+            Operand::Label("__data_ram_start".into()),
             AddrReg::A1,
         )); // Dest in RAM
         self.emit(M68kInst::Lea(
-            Operand::Label("__data_ram_end".to_string()),
+            Operand::Label("__data_ram_end".into()),
             AddrReg::A2,
         )); // End marker
-        self.emit(M68kInst::Label(".copy_data".to_string()));
-        self.emit(M68kInst::Cmpa(
-            Size::Long,
-            Operand::AddrReg(AddrReg::A1),
-            AddrReg::A2,
-        )); // Compare A1 with A2
-        self.emit(M68kInst::Bcc(Cond::Le, ".copy_done".to_string())); // If A2 <= A1, we're done (end reached)
+        self.emit_long_count(2);
+        self.emit(M68kInst::Bra(".copy_test".into()));
+        self.emit(M68kInst::Label(".copy_data".into()));
         self.emit(M68kInst::Move(
             Size::Long,
             Operand::PostInc(AddrReg::A0),
             Operand::PostInc(AddrReg::A1),
         ));
-        self.emit(M68kInst::Bra(".copy_data".to_string()));
-        self.emit(M68kInst::Label(".copy_done".to_string()));
+        self.emit(M68kInst::Label(".copy_test".into()));
+        self.emit(M68kInst::Dbf(DataReg::D0, ".copy_data".into()));
 
         // Set up stack pointer (already set by vector table, but ensure it's correct)
         self.emit(M68kInst::Move(
@@ -288,11 +491,12 @@ impl CodeGenerator {
             Operand::Imm(0x8004),
             Operand::AddrInd(AddrReg::A1),
         )); // Reg 0
+        let mode_register = self.output.len();
         self.emit(M68kInst::Move(
             Size::Word,
-            Operand::Imm(0x8104),
+            Operand::Imm(0x8114),
             Operand::AddrInd(AddrReg::A1),
-        )); // Reg 1 - display OFF (vdp_init enables after VRAM clear)
+        )); // Reg 1 - display OFF (vdp_init turns it on), DMA ON
         self.emit(M68kInst::Move(
             Size::Word,
             Operand::Imm(0x8230),
@@ -344,32 +548,15 @@ impl CodeGenerator {
             Operand::AddrInd(AddrReg::A1),
         )); // Reg 16: H64xV32
 
-        // Clear all VRAM (64KB) from address 0 upward
-        // Set VRAM write address to 0x0000
-        // Command format: first word = 0x4000 | (addr & 0x3FFF), second word = (addr >> 14)
-        self.emit(M68kInst::Move(
-            Size::Word,
-            Operand::Imm(0x4000),
-            Operand::AddrInd(AddrReg::A1),
-        )); // VRAM write @ 0x0000
-        self.emit(M68kInst::Move(
-            Size::Word,
-            Operand::Imm(0x0000),
-            Operand::AddrInd(AddrReg::A1),
-        )); // Upper addr = 0
-        // Clear 64KB (32K words)
-        self.emit(M68kInst::Lea(Operand::AbsLong(0xC00000), AddrReg::A1));
-        self.emit(M68kInst::Move(
-            Size::Word,
-            Operand::Imm(0x7FFF),
-            Operand::DataReg(DataReg::D0),
-        ));
-        self.emit(M68kInst::Label(".clear_vram".to_string()));
-        self.emit(M68kInst::Clr(Size::Word, Operand::AddrInd(AddrReg::A1)));
-        self.emit(M68kInst::Dbf(DataReg::D0, ".clear_vram".to_string()));
-
-        // Re-setup A1 for palette write
-        self.emit(M68kInst::Lea(Operand::AbsLong(0xC00004), AddrReg::A1));
+        // Clear video memory with DMA fills while the display is off. A
+        // minimal startup leaves VRAM to the program.
+        if self.startup == StartupMode::Full {
+            // VRAM: the first data write covers bytes 0-1, the fill the rest
+            self.emit_vdp_fill(0x4000_0080, 0xFFFF, 1);
+        }
+        // CRAM (64 colours) and VSRAM (40 scroll words)
+        self.emit_vdp_fill(0xC000_0080, 64, 2);
+        self.emit_vdp_fill(0x4000_0090, 40, 2);
 
         // Set up palette - CRAM write
         self.emit(M68kInst::Move(
@@ -439,17 +626,153 @@ impl CodeGenerator {
         ));
 
         // Jump to main
-        self.emit(M68kInst::Jsr(Operand::Label("main".to_string())));
+        self.emit(M68kInst::Jsr(Operand::Label("main".into())));
 
         // Infinite loop after main returns (shouldn't happen in a game)
-        self.emit(M68kInst::Label(".halt".to_string()));
-        self.emit(M68kInst::Bra(".halt".to_string()));
+        self.emit(M68kInst::Label(".halt".into()));
+        self.emit(M68kInst::Bra(".halt".into()));
 
         // Add some padding/alignment
-        self.emit(M68kInst::Directive(".align 2".to_string()));
+        self.emit(M68kInst::Directive(Directive::Align(2)));
+        mode_register
+    }
+
+    /// Set D0 to the long count between A1 and A2 shifted right by
+    /// `shift` (2 for longs)
+    fn emit_long_count(&mut self, shift: i32) {
+        self.emit(M68kInst::Move(
+            Size::Long,
+            Operand::AddrReg(AddrReg::A2),
+            Operand::DataReg(DataReg::D0),
+        ));
+        self.emit(M68kInst::Sub(
+            Size::Long,
+            Operand::AddrReg(AddrReg::A1),
+            Operand::DataReg(DataReg::D0),
+        ));
+        self.emit(M68kInst::Lsr(Size::Long, Operand::Imm(shift), DataReg::D0));
+    }
+
+    /// Zero RAM from A1 up to A2, both long-aligned: 64-byte `movem.l`
+    /// blocks down from the top, then single longs up from the bottom
+    fn emit_ram_clear(&mut self) {
+        let data = [
+            DataReg::D1,
+            DataReg::D2,
+            DataReg::D3,
+            DataReg::D4,
+            DataReg::D5,
+            DataReg::D6,
+            DataReg::D7,
+        ];
+        for d in data {
+            self.emit(M68kInst::Moveq(0, d));
+        }
+        let zero: Vec<Reg> = data
+            .into_iter()
+            .map(Reg::Data)
+            .chain([Reg::Addr(AddrReg::A3)])
+            .collect();
+        self.emit(M68kInst::Move(
+            Size::Long,
+            Operand::DataReg(DataReg::D1),
+            Operand::AddrReg(AddrReg::A3),
+        ));
+        self.emit_long_count(6);
+        self.emit(M68kInst::Bra(".clear_test".into()));
+        self.emit(M68kInst::Label(".clear_ram".into()));
+        for _ in 0..2 {
+            self.emit(M68kInst::Movem(
+                Size::Long,
+                zero.clone(),
+                Operand::PreDec(AddrReg::A2),
+                true,
+            ));
+        }
+        self.emit(M68kInst::Label(".clear_test".into()));
+        self.emit(M68kInst::Dbf(DataReg::D0, ".clear_ram".into()));
+        self.emit(M68kInst::Bra(".clear_tail_test".into()));
+        self.emit(M68kInst::Label(".clear_tail".into()));
+        self.emit(M68kInst::Clr(Size::Long, Operand::PostInc(AddrReg::A1)));
+        self.emit(M68kInst::Label(".clear_tail_test".into()));
+        self.emit(M68kInst::Cmpa(
+            Size::Long,
+            Operand::AddrReg(AddrReg::A1),
+            AddrReg::A2,
+        ));
+        self.emit(M68kInst::Bcc(Cond::Hi, ".clear_tail".into()));
+    }
+
+    /// DMA-fill video memory with zero, the way `vdp_dma_fill` does: set
+    /// the length and fill mode, write the DMA command for `target`, then
+    /// the fill value, and wait for the DMA to finish. Expects A1 = VDP
+    /// control port; leaves auto-increment at 2.
+    fn emit_vdp_fill(&mut self, target: u32, len: u16, increment: u8) {
+        let wait = format!(".fill_wait_{target:08x}");
+        for reg in [
+            0x8F00 | u16::from(increment),
+            0x9300 | (len & 0xFF),
+            0x9400 | (len >> 8),
+            0x9780,
+        ] {
+            self.emit(M68kInst::Move(
+                Size::Word,
+                Operand::Imm(i32::from(reg)),
+                Operand::AddrInd(AddrReg::A1),
+            ));
+        }
+        self.emit(M68kInst::Move(
+            Size::Long,
+            Operand::Imm(target as i32),
+            Operand::AddrInd(AddrReg::A1),
+        ));
+        self.emit(M68kInst::Move(
+            Size::Word,
+            Operand::Imm(0),
+            Operand::AbsLong(VDP_DATA),
+        ));
+        self.emit(M68kInst::Label(wait.clone().into()));
+        self.emit(M68kInst::Move(
+            Size::Word,
+            Operand::AddrInd(AddrReg::A1),
+            Operand::DataReg(DataReg::D0),
+        ));
+        self.emit(M68kInst::Btst(
+            Operand::Imm(1),
+            Operand::DataReg(DataReg::D0),
+        ));
+        self.emit(M68kInst::Bcc(Cond::Ne, wait.into()));
+        if increment != 2 {
+            self.emit(M68kInst::Move(
+                Size::Word,
+                Operand::Imm(0x8F02),
+                Operand::AddrInd(AddrReg::A1),
+            ));
+        }
+    }
+
+    /// Emit a global's label and contents into the current section
+    fn emit_global(&mut self, global: &IrGlobal) {
+        if global.ty.align > 1 {
+            self.emit(M68kInst::Directive(Directive::Align(2)));
+        }
+        if global.internal {
+            self.emit(M68kInst::Directive(Directive::Local(Symbol::from(
+                &global.name,
+            ))));
+        }
+        self.emit(M68kInst::Label(Symbol::from(&global.name)));
+        if let Some(init_bytes) = &global.init {
+            self.emit_data_bytes(init_bytes);
+        } else {
+            match global.ty.size {
+                1 => self.emit(M68kInst::Directive(Directive::Byte(0))),
+                2 => self.emit(M68kInst::Directive(Directive::Word(0))),
+                size => self.emit(M68kInst::Directive(Directive::Space(size as u32))),
+            }
+        }
     }
 
-    /// Emit initialized data bytes
     fn emit_data_bytes(&mut self, bytes: &[u8]) {
         let mut i = 0;
         let len = bytes.len();
@@ -457,20 +780,20 @@ impl CodeGenerator {
         // Emit 4-byte (long) values where possible
         while i + 4 <= len {
             let val = u32::from_be_bytes([bytes[i], bytes[i + 1], bytes[i + 2], bytes[i + 3]]);
-            self.emit(M68kInst::Directive(format!(".long 0x{val:08X}")));
+            self.emit(M68kInst::Directive(Directive::Long(val)));
             i += 4;
         }
 
         // Emit 2-byte (word) values
         while i + 2 <= len {
             let val = u16::from_be_bytes([bytes[i], bytes[i + 1]]);
-            self.emit(M68kInst::Directive(format!(".word 0x{val:04X}")));
+            self.emit(M68kInst::Directive(Directive::Word(val)));
             i += 2;
         }
 
         // Emit remaining bytes
         while i < len {
-            self.emit(M68kInst::Directive(format!(".byte 0x{:02X}", bytes[i])));
+            self.emit(M68kInst::Directive(Directive::Byte(bytes[i])));
             i += 1;
         }
     }
@@ -478,63 +801,85 @@ impl CodeGenerator {
     fn generate_function(&mut self, func: &IrFunction) -> CompileResult<()> {
         // Reset state
         self.temp_offsets.clear();
-        self.next_offset = -4;
-
-        // Count how many temps we need
-        let mut max_temp = 0u32;
-        for block in &func.blocks {
-            for sinst in &block.insts {
-                match &sinst.inst {
-                    Inst::Copy { dst, .. }
-                    | Inst::Unary { dst, .. }
-                    | Inst::Binary { dst, .. }
-                    | Inst::Load { dst, .. }
-                    | Inst::Alloca { dst, .. }
-                    | Inst::AddrOf { dst, .. } => {
-                        max_temp = max_temp.max(dst.0 + 1);
+        self.frame_temps.clear();
+        self.reg_param_slots.clear();
+        self.next_offset = 0;
+
+        self.reg_params = self.register_arg_count(&func.name);
+        let lowered;
+        let func = if self.reg_params > 0 {
+            lowered = callconv::lower_params(func);
+            &lowered
+        } else {
+            func
+        };
+
+        self.alloc = stats::time("regalloc", || {
+            regalloc::allocate(func, |inst| self.call_clobbers(inst))
+        });
+        self.narrow = if self.optimize_level > 0 {
+            strength::narrow_temps(func)
+        } else {
+            HashSet::new()
+        };
+
+        // Lay out the frame: Alloca temps get storage below FP, LoadParam
+        // temps point at the caller's argument slots above it, or at a slot
+        // below it for parameters passed in registers
+        for sinst in func.blocks.iter().flat_map(|b| &b.insts) {
+            match &sinst.inst {
+                Inst::Alloca { dst, size, .. } if self.alloc.is_frame_temp(*dst) => {
+                    let offset = self.alloc_frame(*size);
+                    self.frame_temps.insert(dst.0, offset);
+                }
+                Inst::LoadParam { dst, index, size } => {
+                    if *index < self.reg_params && !self.reg_param_slots.contains_key(index) {
+                        let slot = self.alloc_frame(4);
+                        self.reg_param_slots.insert(*index, slot);
                     }
-                    Inst::Call { dst: Some(dst), .. } => {
-                        max_temp = max_temp.max(dst.0 + 1);
+                    if self.alloc.is_frame_temp(*dst) {
+                        let offset = self.param_address(*index, *size);
+                        self.frame_temps.insert(dst.0, offset);
                     }
-                    _ => {}
                 }
+                _ => {}
             }
         }
 
-        // Calculate frame size (temps + locals + saved regs)
-        self.frame_size = (max_temp as i16) * 4 + 16; // Extra space for saved regs
-        // Align to 4 bytes
-        self.frame_size = (self.frame_size + 3) & !3;
-
         // Emit function label
-        self.emit(M68kInst::Directive(format!(".global {}", func.name)));
-        self.emit(M68kInst::Label(func.name.clone()));
-
-        // Prologue
-        self.emit(M68kInst::Link(AddrReg::A6, -self.frame_size));
-        // Save callee-saved registers
+        let start = self.output.len();
+        let name = func.name.as_str().into();
+        self.emit(M68kInst::Directive(if func.internal {
+            Directive::Local(name)
+        } else {
+            Directive::Global(name)
+        }));
+        self.emit(M68kInst::Label(Symbol::from(&func.name)));
+
+        // Prologue (the LINK size is patched once all spill slots are known)
+        let link_index = self.output.len();
+        self.emit(M68kInst::Link(AddrReg::A6, 0));
+        // Save callee-saved registers (trimmed to the ones used below)
         self.emit(M68kInst::Movem(
             Size::Long,
-            vec![
-                Reg::Data(DataReg::D2),
-                Reg::Data(DataReg::D3),
-                Reg::Data(DataReg::D4),
-                Reg::Data(DataReg::D5),
-                Reg::Data(DataReg::D6),
-                Reg::Data(DataReg::D7),
-                Reg::Addr(AddrReg::A2),
-                Reg::Addr(AddrReg::A3),
-                Reg::Addr(AddrReg::A4),
-                Reg::Addr(AddrReg::A5),
-            ],
+            CALLEE_SAVED.to_vec(),
             Operand::PreDec(AddrReg::A7),
             true,
         ));
+        let mut spills: Vec<_> = self.reg_param_slots.iter().map(|(&i, &o)| (i, o)).collect();
+        spills.sort_unstable();
+        for (index, offset) in spills {
+            self.emit(M68kInst::Move(
+                Size::Long,
+                reg_operand(ARG_REGS[index]),
+                Operand::Disp(offset, AddrReg::A6),
+            ));
+        }
 
         // Generate body
         let mut last_debug_line: usize = 0;
         for block in &func.blocks {
-            self.emit(M68kInst::Label(block.label.0.clone()));
+            self.emit(M68kInst::Label(block.label.0));
             for sinst in &block.insts {
                 // Emit source line comment when the line changes
                 if self.debug_enabled {
@@ -554,20 +899,228 @@ impl CodeGenerator {
             }
         }
 
+        self.frame_size = -self.next_offset;
+        self.output[link_index] = M68kInst::Link(AddrReg::A6, -self.frame_size);
+
+        // Library routines may destroy registers the body never names
+        let clobbered = func
+            .blocks
+            .iter()
+            .flat_map(|b| &b.insts)
+            .fold(0, |mask, sinst| mask | self.call_clobbers(&sinst.inst));
+
+        let mut code = self.output.split_off(start);
+        stats::time("peephole", || {
+            self.peephole.run(&mut code);
+            trim_frame(&mut code, clobbered, self.optimize_level > 0);
+        });
+        if stats::enabled() {
+            self.record_function(func, &code);
+        }
+        self.output.append(&mut code);
+
         Ok(())
     }
 
+    /// Report the sizes of a just-generated function to `--stats`
+    fn record_function(&self, func: &IrFunction, code: &[M68kInst]) {
+        let insts = func.blocks.iter().flat_map(|b| &b.insts);
+        let encoder = InstructionEncoder::new();
+        let code_bytes = code.iter().map(|inst| encoder.instruction_size(inst)).sum();
+        let machine_insts = code
+            .iter()
+            .filter(|inst| {
+                !matches!(
+                    inst,
+                    M68kInst::Label(_)
+                        | M68kInst::Comment(_)
+                        | M68kInst::Directive(_)
+                        | M68kInst::Barrier
+                )
+            })
+            .count();
+        stats::count("ir instructions", insts.clone().count() as u64);
+        stats::count("machine instructions", machine_insts as u64);
+        stats::function(FunctionStats {
+            name: func.name.clone(),
+            ir_insts: insts.clone().count(),
+            temps: insts
+                .filter_map(|sinst| sinst.inst.def())
+                .collect::<HashSet<_>>()
+                .len(),
+            spills: self.temp_offsets.len(),
+            frame_bytes: self.frame_size as usize,
+            machine_insts,
+            code_bytes,
+        });
+    }
+
+    /// A fresh label for control flow inside one lowered IR instruction
+    fn local_label(&mut self) -> Symbol {
+        self.next_label += 1;
+        format!(".Lcg{}", self.next_label).into()
+    }
+
+    /// How many leading arguments calls to `func` pass in `ARG_REGS`
+    fn register_arg_count(&self, func: &str) -> usize {
+        let enabled = if self.defined_functions.contains(func) {
+            self.optimize_level >= 2 && !self.separate
+        } else {
+            self.sdk_registry.lookup(func).is_some_and(|f| f.reg_args)
+        };
+        if enabled { ARG_REGS.len() } else { 0 }
+    }
+
+    /// Frame address of parameter `index` (of `size` bytes) of the current
+    /// function
+    fn param_address(&self, index: usize, size: usize) -> i16 {
+        match self.reg_param_slots.get(&index) {
+            Some(slot) => slot + (4 - size.min(4)) as i16,
+            None => param_offset(index - self.reg_params.min(index), size),
+        }
+    }
+
+    /// Reserve `size` bytes (rounded up to 4) in the current frame
+    fn alloc_frame(&mut self, size: usize) -> i16 {
+        self.next_offset -= ((size as i16) + 3) & !3;
+        self.next_offset
+    }
+
+    /// Registers an SDK call's generated code destroys.
+    ///
+    /// User functions save every register the allocator hands out, so only SDK
+    /// calls (inline code and unsaved library routines) clobber anything.
+    fn call_clobbers(&mut self, inst: &Inst) -> RegMask {
+        let Inst::Call { func, args, .. } = inst else {
+            return 0;
+        };
+        if self.defined_functions.contains(func.as_str()) {
+            return 0;
+        }
+        let Some(kind) = self.sdk_registry.lookup(func).map(|f| f.kind) else {
+            return 0;
+        };
+        if let Some(code) = self.sdk_specialization(func, args) {
+            let arg_mask = args
+                .iter()
+                .zip(&SDK_ARG_REGS)
+                .filter(|(arg, _)| constant_arg(arg).is_none())
+                .fold(0, |m, (_, &r)| m | Reg::Data(r).mask());
+            return arg_mask | written_regs(&code);
+        }
+        match kind {
+            SdkFunctionKind::Inline => {
+                let arg_mask = SDK_ARG_REGS
+                    .iter()
+                    .take(args.len())
+                    .fold(0, |m, &r| m | Reg::Data(r).mask());
+                let body_mask = SdkInlineGenerator::generate(func)
+                    .map_or(RegMask::MAX, |code| written_regs(&code));
+                arg_mask | body_mask
+            }
+            SdkFunctionKind::Library => {
+                if let Some(&mask) = self.sdk_clobbers.get(func.as_str()) {
+                    return mask;
+                }
+                let roots = HashSet::from([func.to_string()]);
+                let mut generator = SdkLibraryGenerator::new();
+                let mask = resolve_dependencies(&roots)
+                    .iter()
+                    .filter(|f| {
+                        self.sdk_registry
+                            .lookup(f)
+                            .is_some_and(|sdk| sdk.kind == SdkFunctionKind::Library)
+                    })
+                    .fold(0, |m, f| m | written_regs(&generator.generate(f)));
+                self.sdk_clobbers.insert(func.to_string(), mask);
+                mask
+            }
+        }
+    }
+
     fn get_temp_offset(&mut self, temp: Temp) -> i16 {
         if let Some(&offset) = self.temp_offsets.get(&temp.0) {
             offset
         } else {
-            let offset = self.next_offset;
-            self.next_offset -= 4;
+            let offset = self.alloc_frame(4);
             self.temp_offsets.insert(temp.0, offset);
             offset
         }
     }
 
+    fn temp_home(&mut self, temp: Temp) -> TempHome {
+        if let Some(&offset) = self.frame_temps.get(&temp.0) {
+            TempHome::Frame(offset)
+        } else if let Some(reg) = self.alloc.reg(temp) {
+            TempHome::Reg(reg)
+        } else {
+            TempHome::Slot(self.get_temp_offset(temp))
+        }
+    }
+
+    /// Data register allocated to `temp`, if any
+    fn temp_data_reg(&self, temp: Temp) -> Option<DataReg> {
+        match self.alloc.reg(temp) {
+            Some(Reg::Data(d)) if !self.frame_temps.contains_key(&temp.0) => Some(d),
+            _ => None,
+        }
+    }
+
+    /// Register to compute `dst` in: its own data register, unless that would
+    /// overwrite `operand` before it is read
+    fn work_reg(&self, dst: Temp, operand: &Value) -> DataReg {
+        match self.temp_data_reg(dst) {
+            Some(d) if operand.as_temp().and_then(|t| self.temp_data_reg(t)) != Some(d) => d,
+            _ => DataReg::D0,
+        }
+    }
+
+    /// Get `value` into a data register: the temp's own register if it has
+    /// one, otherwise loaded into `scratch`
+    fn data_operand(&mut self, value: &Value, scratch: DataReg) -> CompileResult<DataReg> {
+        if let Some(d) = value.as_temp().and_then(|t| self.temp_data_reg(t)) {
+            return Ok(d);
+        }
+        self.load_value(value, scratch)?;
+        Ok(scratch)
+    }
+
+    /// Memory operand addressing the location `addr` points to (may use A0/D0)
+    fn address_operand(&mut self, addr: &Value) -> CompileResult<Operand> {
+        if let Value::IntConst(n) = addr {
+            return Ok(Operand::AbsLong(*n as u32));
+        }
+        if let Value::Temp(t) = addr {
+            match self.temp_home(*t) {
+                TempHome::Frame(offset) => return Ok(Operand::Disp(offset, AddrReg::A6)),
+                TempHome::Reg(Reg::Addr(a)) => return Ok(Operand::AddrInd(a)),
+                TempHome::Reg(Reg::Data(d)) => {
+                    self.emit(M68kInst::Move(
+                        Size::Long,
+                        Operand::DataReg(d),
+                        Operand::AddrReg(AddrReg::A0),
+                    ));
+                    return Ok(Operand::AddrInd(AddrReg::A0));
+                }
+                TempHome::Slot(offset) => {
+                    self.emit(M68kInst::Move(
+                        Size::Long,
+                        Operand::Disp(offset, AddrReg::A6),
+                        Operand::AddrReg(AddrReg::A0),
+                    ));
+                    return Ok(Operand::AddrInd(AddrReg::A0));
+                }
+            }
+        }
+        self.load_value(addr, DataReg::D0)?;
+        self.emit(M68kInst::Move(
+            Size::Long,
+            Operand::DataReg(DataReg::D0),
+            Operand::AddrReg(AddrReg::A0),
+        ));
+        Ok(Operand::AddrInd(AddrReg::A0))
+    }
+
     fn load_value(&mut self, value: &Value, reg: DataReg) -> CompileResult<()> {
         match value {
             Value::IntConst(n) => {
@@ -581,23 +1134,51 @@ impl CodeGenerator {
                     ));
                 }
             }
-            Value::Temp(t) => {
-                let offset = self.get_temp_offset(*t);
-                self.emit(M68kInst::Move(
-                    Size::Long,
-                    Operand::Disp(offset, AddrReg::A6),
-                    Operand::DataReg(reg),
-                ));
-            }
-            Value::Name(name) => {
-                self.emit(M68kInst::Move(
-                    Size::Long,
-                    Operand::Label(name.clone()),
-                    Operand::DataReg(reg),
-                ));
+            Value::Temp(t) => match self.temp_home(*t) {
+                TempHome::Reg(Reg::Data(d)) => {
+                    if d != reg {
+                        self.emit(M68kInst::Move(
+                            Size::Long,
+                            Operand::DataReg(d),
+                            Operand::DataReg(reg),
+                        ));
+                    }
+                }
+                TempHome::Reg(Reg::Addr(a)) => {
+                    self.emit(M68kInst::Move(
+                        Size::Long,
+                        Operand::AddrReg(a),
+                        Operand::DataReg(reg),
+                    ));
+                }
+                TempHome::Frame(offset) => {
+                    self.emit(M68kInst::Lea(
+                        Operand::Disp(offset, AddrReg::A6),
+                        AddrReg::A0,
+                    ));
+                    self.emit(M68kInst::Move(
+                        Size::Long,
+                        Operand::AddrReg(AddrReg::A0),
+                        Operand::DataReg(reg),
+                    ));
+                }
+                TempHome::Slot(offset) => {
+                    self.emit(M68kInst::Move(
+                        Size::Long,
+                        Operand::Disp(offset, AddrReg::A6),
+                        Operand::DataReg(reg),
+                    ));
+                }
+            },
+            Value::Name(name) => {
+                self.emit(M68kInst::Move(
+                    Size::Long,
+                    Operand::Label(*name),
+                    Operand::DataReg(reg),
+                ));
             }
             Value::StringConst(label) => {
-                self.emit(M68kInst::Lea(Operand::Label(label.0.clone()), AddrReg::A0));
+                self.emit(M68kInst::Lea(Operand::Label(label.0), AddrReg::A0));
                 self.emit(M68kInst::Move(
                     Size::Long,
                     Operand::AddrReg(AddrReg::A0),
@@ -608,12 +1189,7 @@ impl CodeGenerator {
                 self.load_value(addr, reg)?;
                 self.emit(M68kInst::Move(
                     Size::Long,
-                    Operand::AddrReg(AddrReg::A0),
-                    Operand::DataReg(DataReg::D0),
-                ));
-                self.emit(M68kInst::Move(
-                    Size::Long,
-                    Operand::DataReg(DataReg::D0),
+                    Operand::DataReg(reg),
                     Operand::AddrReg(AddrReg::A0),
                 ));
                 self.emit(M68kInst::Move(
@@ -626,47 +1202,209 @@ impl CodeGenerator {
         Ok(())
     }
 
+    /// Load `value` into address register `areg`, touching no other register
+    fn load_address_reg(&mut self, value: &Value, areg: AddrReg) -> CompileResult<()> {
+        let target = Operand::AddrReg(areg);
+        match value {
+            Value::IntConst(n) => {
+                self.emit(M68kInst::Move(Size::Long, Operand::Imm(*n as i32), target));
+            }
+            Value::Temp(t) => match self.temp_home(*t) {
+                TempHome::Reg(r) => self.emit(M68kInst::Move(Size::Long, reg_operand(r), target)),
+                TempHome::Frame(offset) => {
+                    self.emit(M68kInst::Lea(Operand::Disp(offset, AddrReg::A6), areg));
+                }
+                TempHome::Slot(offset) => {
+                    self.emit(M68kInst::Move(
+                        Size::Long,
+                        Operand::Disp(offset, AddrReg::A6),
+                        target,
+                    ));
+                }
+            },
+            Value::Name(name) => {
+                self.emit(M68kInst::Move(Size::Long, Operand::Label(*name), target));
+            }
+            Value::StringConst(label) => {
+                self.emit(M68kInst::Lea(Operand::Label(label.0), areg));
+            }
+            Value::Mem(addr) => {
+                self.load_address_reg(addr, areg)?;
+                self.emit(M68kInst::Move(Size::Long, Operand::AddrInd(areg), target));
+            }
+        }
+        Ok(())
+    }
+
+    /// Extend the low `size` bytes of `reg` to 32 bits
+    fn extend(&mut self, reg: DataReg, size: usize, signed: bool) {
+        self.extend_to(reg, size, 4, signed);
+    }
+
+    /// Extend the low `size` bytes of `reg` to its low `width` bytes
+    fn extend_to(&mut self, reg: DataReg, size: usize, width: usize, signed: bool) {
+        // On 68000: ext.w extends byte->word, ext.l extends word->long (sign
+        // extension). For unsigned, use AND to zero-extend
+        if signed {
+            if size == 1 && width >= 2 {
+                self.emit(M68kInst::Ext(Size::Word, reg)); // byte -> word
+            }
+            if size <= 2 && width == 4 {
+                self.emit(M68kInst::Ext(Size::Long, reg)); // word -> long
+            }
+        } else if size <= 2 && size < width {
+            let mask = if size == 1 { 0xFF } else { 0xFFFF };
+            self.emit(M68kInst::Andi(
+                Size::from_bytes(width),
+                mask,
+                Operand::DataReg(reg),
+            ));
+        }
+    }
+
     fn store_temp(&mut self, temp: Temp, reg: DataReg) {
-        let offset = self.get_temp_offset(temp);
-        self.emit(M68kInst::Move(
-            Size::Long,
-            Operand::DataReg(reg),
-            Operand::Disp(offset, AddrReg::A6),
-        ));
+        match self.temp_home(temp) {
+            TempHome::Reg(Reg::Data(d)) => {
+                if d != reg {
+                    self.emit(M68kInst::Move(
+                        Size::Long,
+                        Operand::DataReg(reg),
+                        Operand::DataReg(d),
+                    ));
+                }
+            }
+            TempHome::Reg(Reg::Addr(a)) => {
+                self.emit(M68kInst::Move(
+                    Size::Long,
+                    Operand::DataReg(reg),
+                    Operand::AddrReg(a),
+                ));
+            }
+            // Frame temps have a single definition (their Alloca/LoadParam)
+            TempHome::Frame(_) => {}
+            TempHome::Slot(offset) => {
+                self.emit(M68kInst::Move(
+                    Size::Long,
+                    Operand::DataReg(reg),
+                    Operand::Disp(offset, AddrReg::A6),
+                ));
+            }
+        }
+    }
+
+    /// Compute an effective address with LEA and store it as `dst`'s value
+    fn store_address(&mut self, dst: Temp, ea: Operand) {
+        match self.temp_home(dst) {
+            TempHome::Reg(Reg::Addr(a)) => self.emit(M68kInst::Lea(ea, a)),
+            TempHome::Reg(Reg::Data(d)) => {
+                self.emit(M68kInst::Lea(ea, AddrReg::A0));
+                self.emit(M68kInst::Move(
+                    Size::Long,
+                    Operand::AddrReg(AddrReg::A0),
+                    Operand::DataReg(d),
+                ));
+            }
+            TempHome::Frame(_) => {}
+            TempHome::Slot(offset) => {
+                self.emit(M68kInst::Lea(ea, AddrReg::A0));
+                self.emit(M68kInst::Move(
+                    Size::Long,
+                    Operand::AddrReg(AddrReg::A0),
+                    Operand::Disp(offset, AddrReg::A6),
+                ));
+            }
+        }
+    }
+
+    /// Lower a multiplication or division with a constant operand through
+    /// `strength`, returning false if the generic lowering should be used
+    fn binary_with_constant(
+        &mut self,
+        dst: Temp,
+        op: BinOp,
+        left: &Value,
+        right: &Value,
+    ) -> CompileResult<bool> {
+        if self.optimize_level == 0 {
+            return Ok(false);
+        }
+        let (value, c) = match (op, left, right) {
+            (_, _, Value::IntConst(c)) => (left, *c),
+            (BinOp::Mul, Value::IntConst(c), _) => (right, *c),
+            _ => return Ok(false),
+        };
+        let work = self.temp_data_reg(dst).unwrap_or(DataReg::D0);
+        let code = match op {
+            BinOp::Mul => strength::multiply(work, DataReg::D1, c),
+            BinOp::Div | BinOp::Mod | BinOp::UDiv | BinOp::UMod => {
+                let narrow = value.as_temp().is_some_and(|t| self.narrow.contains(&t));
+                match strength::divide(op, work, DataReg::D1, c, narrow, &mut || self.local_label())
+                {
+                    Some(code) => code,
+                    None => return Ok(false),
+                }
+            }
+            _ => return Ok(false),
+        };
+        self.load_value(value, work)?;
+        for inst in code {
+            self.emit(inst);
+        }
+        self.store_temp(dst, work);
+        Ok(true)
     }
 
     fn generate_inst(&mut self, inst: &Inst) -> CompileResult<()> {
         match inst {
             Inst::Label(label) => {
-                self.emit(M68kInst::Label(label.0.clone()));
+                self.emit(M68kInst::Label(label.0));
             }
 
-            Inst::Copy { dst, src } => {
-                self.load_value(src, DataReg::D0)?;
-                self.store_temp(*dst, DataReg::D0);
+            Inst::Copy { dst, src, width } => {
+                let work = self.temp_data_reg(*dst).unwrap_or(DataReg::D0);
+                match src {
+                    // Only the low bytes matter: a .w/.b immediate is shorter
+                    Value::IntConst(n) if *width < 4 && i8::try_from(*n).is_err() => {
+                        let size = Size::from_bytes(*width);
+                        self.emit(M68kInst::Move(
+                            size,
+                            Operand::Imm(size.truncate(*n)),
+                            Operand::DataReg(work),
+                        ));
+                    }
+                    _ => self.load_value(src, work)?,
+                }
+                self.store_temp(*dst, work);
             }
 
-            Inst::Unary { dst, op, src } => {
-                self.load_value(src, DataReg::D0)?;
+            Inst::Unary {
+                dst,
+                op,
+                src,
+                width,
+            } => {
+                let work = self.temp_data_reg(*dst).unwrap_or(DataReg::D0);
+                self.load_value(src, work)?;
+                let size = Size::from_bytes(*width);
                 match op {
                     UnOp::Neg => {
-                        self.emit(M68kInst::Neg(Size::Long, Operand::DataReg(DataReg::D0)));
+                        self.emit(M68kInst::Neg(size, Operand::DataReg(work)));
                     }
                     UnOp::Not => {
                         // Logical not: result is 0 if non-zero, 1 if zero
-                        self.emit(M68kInst::Tst(Size::Long, Operand::DataReg(DataReg::D0)));
-                        self.emit(M68kInst::Scc(Cond::Eq, Operand::DataReg(DataReg::D0)));
+                        self.emit(M68kInst::Tst(Size::Long, Operand::DataReg(work)));
+                        self.emit(M68kInst::Scc(Cond::Eq, Operand::DataReg(work)));
                         self.emit(M68kInst::And(
                             Size::Long,
                             Operand::Imm(1),
-                            Operand::DataReg(DataReg::D0),
+                            Operand::DataReg(work),
                         ));
                     }
                     UnOp::BitNot => {
-                        self.emit(M68kInst::Not(Size::Long, Operand::DataReg(DataReg::D0)));
+                        self.emit(M68kInst::Not(size, Operand::DataReg(work)));
                     }
                 }
-                self.store_temp(*dst, DataReg::D0);
+                self.store_temp(*dst, work);
             }
 
             Inst::Binary {
@@ -674,103 +1412,91 @@ impl CodeGenerator {
                 op,
                 left,
                 right,
+                width,
             } => {
-                self.load_value(left, DataReg::D0)?;
-                self.load_value(right, DataReg::D1)?;
+                if self.binary_with_constant(*dst, *op, left, right)? {
+                    return Ok(());
+                }
+                let work = self.work_reg(*dst, right);
+                self.load_value(left, work)?;
+                let src = self.data_operand(right, DataReg::D1)?;
+                // Operations whose low result bytes only depend on the low
+                // bytes of their operands run at the demanded width
+                let size = Size::from_bytes(*width);
 
                 match op {
                     BinOp::Add => {
                         self.emit(M68kInst::Add(
-                            Size::Long,
-                            Operand::DataReg(DataReg::D1),
-                            Operand::DataReg(DataReg::D0),
+                            size,
+                            Operand::DataReg(src),
+                            Operand::DataReg(work),
                         ));
                     }
                     BinOp::Sub => {
                         self.emit(M68kInst::Sub(
-                            Size::Long,
-                            Operand::DataReg(DataReg::D1),
-                            Operand::DataReg(DataReg::D0),
+                            size,
+                            Operand::DataReg(src),
+                            Operand::DataReg(work),
                         ));
                     }
                     BinOp::Mul => {
                         // M68000 only has 16x16->32 multiply
-                        self.emit(M68kInst::Muls(Operand::DataReg(DataReg::D1), DataReg::D0));
+                        self.emit(M68kInst::Muls(Operand::DataReg(src), work));
                     }
                     BinOp::Div => {
                         // 32/16->16r16 signed divide
-                        self.emit(M68kInst::Divs(Operand::DataReg(DataReg::D1), DataReg::D0));
+                        self.emit(M68kInst::Divs(Operand::DataReg(src), work));
                         // Quotient is in low word, sign-extend
-                        self.emit(M68kInst::Ext(Size::Long, DataReg::D0));
+                        self.emit(M68kInst::Ext(Size::Long, work));
                     }
                     BinOp::Mod => {
                         // 32/16->16r16 signed divide for remainder
-                        self.emit(M68kInst::Divs(Operand::DataReg(DataReg::D1), DataReg::D0));
+                        self.emit(M68kInst::Divs(Operand::DataReg(src), work));
                         // Remainder is in high word
-                        self.emit(M68kInst::Swap(DataReg::D0));
-                        self.emit(M68kInst::Ext(Size::Long, DataReg::D0));
+                        self.emit(M68kInst::Swap(work));
+                        self.emit(M68kInst::Ext(Size::Long, work));
                     }
                     BinOp::UDiv => {
                         // 32/16->16r16 unsigned divide
-                        self.emit(M68kInst::Divu(Operand::DataReg(DataReg::D1), DataReg::D0));
+                        self.emit(M68kInst::Divu(Operand::DataReg(src), work));
                         // Quotient is in low word, zero-extend
-                        self.emit(M68kInst::Andi(
-                            Size::Long,
-                            0xFFFF,
-                            Operand::DataReg(DataReg::D0),
-                        ));
+                        self.emit(M68kInst::Andi(Size::Long, 0xFFFF, Operand::DataReg(work)));
                     }
                     BinOp::UMod => {
                         // 32/16->16r16 unsigned divide for remainder
-                        self.emit(M68kInst::Divu(Operand::DataReg(DataReg::D1), DataReg::D0));
+                        self.emit(M68kInst::Divu(Operand::DataReg(src), work));
                         // Remainder is in high word
-                        self.emit(M68kInst::Swap(DataReg::D0));
-                        self.emit(M68kInst::Andi(
-                            Size::Long,
-                            0xFFFF,
-                            Operand::DataReg(DataReg::D0),
-                        ));
+                        self.emit(M68kInst::Swap(work));
+                        self.emit(M68kInst::Andi(Size::Long, 0xFFFF, Operand::DataReg(work)));
                     }
                     BinOp::And => {
                         self.emit(M68kInst::And(
-                            Size::Long,
-                            Operand::DataReg(DataReg::D1),
-                            Operand::DataReg(DataReg::D0),
+                            size,
+                            Operand::DataReg(src),
+                            Operand::DataReg(work),
                         ));
                     }
                     BinOp::Or => {
                         self.emit(M68kInst::Or(
-                            Size::Long,
-                            Operand::DataReg(DataReg::D1),
-                            Operand::DataReg(DataReg::D0),
+                            size,
+                            Operand::DataReg(src),
+                            Operand::DataReg(work),
                         ));
                     }
                     BinOp::Xor => {
-                        self.emit(M68kInst::Eor(
-                            Size::Long,
-                            DataReg::D1,
-                            Operand::DataReg(DataReg::D0),
-                        ));
+                        self.emit(M68kInst::Eor(size, src, Operand::DataReg(work)));
                     }
                     BinOp::Shl => {
-                        self.emit(M68kInst::Lsl(
-                            Size::Long,
-                            Operand::DataReg(DataReg::D1),
-                            DataReg::D0,
-                        ));
+                        self.emit(M68kInst::Lsl(size, Operand::DataReg(src), work));
                     }
                     BinOp::Shr => {
-                        self.emit(M68kInst::Lsr(
-                            Size::Long,
-                            Operand::DataReg(DataReg::D1),
-                            DataReg::D0,
-                        ));
+                        self.emit(M68kInst::Lsr(Size::Long, Operand::DataReg(src), work));
                     }
                     BinOp::Eq | BinOp::Ne | BinOp::Lt | BinOp::Le | BinOp::Gt | BinOp::Ge => {
                         self.emit(M68kInst::Cmp(
                             Size::Long,
-                            Operand::DataReg(DataReg::D1),
-                            Operand::DataReg(DataReg::D0),
+                            Operand::DataReg(src),
+                            Operand::DataReg(work),
                         ));
                         let cond = match op {
                             BinOp::Eq => Cond::Eq,
@@ -781,113 +1507,91 @@ impl CodeGenerator {
                             BinOp::Ge => Cond::Ge,
                             _ => unreachable!(),
                         };
-                        self.emit(M68kInst::Scc(cond, Operand::DataReg(DataReg::D0)));
+                        self.emit(M68kInst::Scc(cond, Operand::DataReg(work)));
                         self.emit(M68kInst::And(
                             Size::Long,
                             Operand::Imm(1),
-                            Operand::DataReg(DataReg::D0),
+                            Operand::DataReg(work),
                         ));
                     }
                 }
-                self.store_temp(*dst, DataReg::D0);
+                self.store_temp(*dst, work);
             }
 
             Inst::Load {
                 dst,
                 addr,
                 size,
-                volatile: _,
+                volatile,
                 signed,
+                width,
             } => {
-                // Note: volatile flag indicates this memory access should not be optimized.
-                // For now, we emit the same code (no optimization pass yet).
-                self.load_value(addr, DataReg::D0)?;
-                self.emit(M68kInst::Move(
-                    Size::Long,
-                    Operand::DataReg(DataReg::D0),
-                    Operand::AddrReg(AddrReg::A0),
-                ));
+                let ea = self.address_operand(addr)?;
+                let work = self.temp_data_reg(*dst).unwrap_or(DataReg::D0);
                 let sz = Size::from_bytes(*size);
-                self.emit(M68kInst::Move(
-                    sz,
-                    Operand::AddrInd(AddrReg::A0),
-                    Operand::DataReg(DataReg::D0),
-                ));
-                // Extend to 32-bit: sign-extend for signed types, zero-extend for unsigned
-                // On 68000: ext.w extends byte->word, ext.l extends word->long (sign extension)
-                // For unsigned, use AND to zero-extend
-                if *signed {
-                    // Sign extend
-                    if *size == 1 {
-                        self.emit(M68kInst::Ext(Size::Word, DataReg::D0)); // byte -> word
-                        self.emit(M68kInst::Ext(Size::Long, DataReg::D0)); // word -> long
-                    } else if *size == 2 {
-                        self.emit(M68kInst::Ext(Size::Long, DataReg::D0)); // word -> long
-                    }
-                } else {
-                    // Zero extend using AND
-                    if *size == 1 {
-                        self.emit(M68kInst::Andi(
-                            Size::Long,
-                            0xFF,
-                            Operand::DataReg(DataReg::D0),
-                        ));
-                    } else if *size == 2 {
-                        self.emit(M68kInst::Andi(
-                            Size::Long,
-                            0xFFFF,
-                            Operand::DataReg(DataReg::D0),
-                        ));
-                    }
-                }
-                self.store_temp(*dst, DataReg::D0);
+                self.emit_access(M68kInst::Move(sz, ea, Operand::DataReg(work)), *volatile);
+                // Extend only as far as the readers look
+                self.extend_to(work, *size, *width, *signed);
+                self.store_temp(*dst, work);
             }
 
             Inst::Store {
                 addr,
                 src,
                 size,
-                volatile: _,
+                volatile,
             } => {
-                // Note: volatile flag indicates this memory access should not be optimized.
-                // For now, we emit the same code (no optimization pass yet).
-                self.load_value(addr, DataReg::D0)?;
-                self.emit(M68kInst::Move(
-                    Size::Long,
-                    Operand::DataReg(DataReg::D0),
-                    Operand::AddrReg(AddrReg::A0),
-                ));
-                self.load_value(src, DataReg::D1)?;
+                // The value goes first: loading it may itself need A0.
+                let value = self.data_operand(src, DataReg::D1)?;
+                let ea = self.address_operand(addr)?;
                 let sz = Size::from_bytes(*size);
-                self.emit(M68kInst::Move(
-                    sz,
-                    Operand::DataReg(DataReg::D1),
-                    Operand::AddrInd(AddrReg::A0),
-                ));
+                self.emit_access(M68kInst::Move(sz, Operand::DataReg(value), ea), *volatile);
             }
 
             Inst::Jump(label) => {
-                self.emit(M68kInst::Bra(label.0.clone()));
+                self.emit(M68kInst::Bra(label.0));
             }
 
             Inst::CondJump { cond, target } => {
-                self.load_value(cond, DataReg::D0)?;
-                self.emit(M68kInst::Tst(Size::Long, Operand::DataReg(DataReg::D0)));
-                self.emit(M68kInst::Bcc(Cond::Ne, target.0.clone()));
+                let reg = self.data_operand(cond, DataReg::D0)?;
+                self.emit(M68kInst::Tst(Size::Long, Operand::DataReg(reg)));
+                self.emit(M68kInst::Bcc(Cond::Ne, target.0));
             }
 
             Inst::CondJumpFalse { cond, target } => {
-                self.load_value(cond, DataReg::D0)?;
-                self.emit(M68kInst::Tst(Size::Long, Operand::DataReg(DataReg::D0)));
-                self.emit(M68kInst::Bcc(Cond::Eq, target.0.clone()));
+                let reg = self.data_operand(cond, DataReg::D0)?;
+                self.emit(M68kInst::Tst(Size::Long, Operand::DataReg(reg)));
+                self.emit(M68kInst::Bcc(Cond::Eq, target.0));
             }
 
+            Inst::DecJump { counter, target } => {
+                if let Some(reg) = self.temp_data_reg(*counter) {
+                    self.emit(M68kInst::Dbf(reg, target.0));
+                } else {
+                    // Same effect as dbf, on a counter kept in memory
+                    self.load_value(&Value::Temp(*counter), DataReg::D0)?;
+                    let d0 = Operand::DataReg(DataReg::D0);
+                    self.emit(M68kInst::Subq(Size::Word, 1, d0.clone()));
+                    self.store_temp(*counter, DataReg::D0);
+                    self.emit(M68kInst::Cmpi(Size::Word, -1, d0));
+                    self.emit(M68kInst::Bcc(Cond::Ne, target.0));
+                }
+            }
+
+            Inst::Switch {
+                value,
+                cases,
+                default,
+            } => self.emit_switch(value, cases, default.0)?,
+
             Inst::Call { dst, func, args } => {
                 // Check if this is an SDK function (but not if user defined their own)
-                let is_sdk = !self.defined_functions.contains(func)
+                let is_sdk = !self.defined_functions.contains(func.as_str())
                     && self.sdk_registry.lookup(func).is_some();
 
-                if is_sdk {
+                if is_sdk && let Some(code) = self.sdk_specialization(func, args) {
+                    self.emit_sdk_specialized_call(code, args, dst)?;
+                } else if is_sdk {
                     let sdk_func = self.sdk_registry.lookup(func).unwrap();
                     match sdk_func.kind {
                         SdkFunctionKind::Inline => {
@@ -896,7 +1600,7 @@ impl CodeGenerator {
                         }
                         SdkFunctionKind::Library => {
                             // Mark function as needed, emit normal call
-                            self.pending_sdk_functions.insert(func.clone());
+                            self.pending_sdk_functions.insert(func.to_string());
                             self.emit_standard_call(func, args, dst)?;
                         }
                     }
@@ -915,18 +1619,7 @@ impl CodeGenerator {
                 // Restore callee-saved registers
                 self.emit(M68kInst::Movem(
                     Size::Long,
-                    vec![
-                        Reg::Data(DataReg::D2),
-                        Reg::Data(DataReg::D3),
-                        Reg::Data(DataReg::D4),
-                        Reg::Data(DataReg::D5),
-                        Reg::Data(DataReg::D6),
-                        Reg::Data(DataReg::D7),
-                        Reg::Addr(AddrReg::A2),
-                        Reg::Addr(AddrReg::A3),
-                        Reg::Addr(AddrReg::A4),
-                        Reg::Addr(AddrReg::A5),
-                    ],
+                    CALLEE_SAVED.to_vec(),
                     Operand::PostInc(AddrReg::A7),
                     false,
                 ));
@@ -935,67 +1628,41 @@ impl CodeGenerator {
             }
 
             Inst::Alloca { dst, size, .. } => {
-                // Allocate on stack by subtracting from SP
-                // But we use frame-relative addressing, so just assign an offset
-                let offset = self.get_temp_offset(*dst);
-                // Reserve additional space for the allocated storage
-                // This prevents other temps from overlapping with alloca storage
-                let storage_offset = self.next_offset;
-                self.next_offset -= ((*size as i16) + 3) & !3; // Align to 4 bytes
-                // Store address of allocated space
-                self.emit(M68kInst::Lea(
-                    Operand::Disp(storage_offset, AddrReg::A6),
-                    AddrReg::A0,
-                ));
-                self.emit(M68kInst::Move(
-                    Size::Long,
-                    Operand::AddrReg(AddrReg::A0),
-                    Operand::Disp(offset, AddrReg::A6),
-                ));
+                // Frame temps were laid out up front and are addressed directly
+                if !self.alloc.is_frame_temp(*dst) {
+                    let storage_offset = self.alloc_frame(*size);
+                    self.store_address(*dst, Operand::Disp(storage_offset, AddrReg::A6));
+                }
             }
 
             Inst::AddrOf { dst, name } => {
-                self.emit(M68kInst::Lea(Operand::Label(name.clone()), AddrReg::A0));
-                self.emit(M68kInst::Move(
-                    Size::Long,
-                    Operand::AddrReg(AddrReg::A0),
-                    Operand::DataReg(DataReg::D0),
-                ));
-                self.store_temp(*dst, DataReg::D0);
+                self.store_address(*dst, Operand::Label(*name));
             }
 
             Inst::LoadParam { dst, index, size } => {
-                // In M68k cdecl with LINK A6:
-                // - 0(a6) = saved old A6
-                // - 4(a6) = return address
-                // - 8(a6) = first parameter
-                // - 12(a6) = second parameter, etc.
-                // Store the ADDRESS of the parameter slot, not its value.
-                // This matches the Alloca model where temps hold addresses.
-                //
-                // On big-endian M68K, callers push all values as 32-bit longs.
-                // For smaller types, the value is in the LOW bytes of the slot.
-                // We need to adjust the offset to point to the actual value:
-                // - 4-byte: offset + 0
-                // - 2-byte: offset + 2
-                // - 1-byte: offset + 3
-                let base_offset = 8 + (*index as i16) * 4;
-                let size_adjust = match *size {
-                    1 => 3, // byte at end of 4-byte slot
-                    2 => 2, // word at end of 4-byte slot
-                    _ => 0, // long uses full slot
-                };
-                let offset = base_offset + size_adjust;
-                self.emit(M68kInst::Lea(
-                    Operand::Disp(offset, AddrReg::A6),
-                    AddrReg::A0,
-                ));
-                self.emit(M68kInst::Move(
-                    Size::Long,
-                    Operand::AddrReg(AddrReg::A0),
-                    Operand::DataReg(DataReg::D0),
-                ));
-                self.store_temp(*dst, DataReg::D0);
+                // Temps hold the ADDRESS of the parameter slot, not its value,
+                // matching the Alloca model where temps hold addresses.
+                if !self.alloc.is_frame_temp(*dst) {
+                    let offset = self.param_address(*index, *size);
+                    self.store_address(*dst, Operand::Disp(offset, AddrReg::A6));
+                }
+            }
+
+            Inst::Param {
+                dst,
+                index,
+                size,
+                signed,
+            } => {
+                // Params come first and in index order, so D0 no longer holds
+                // an argument unless this is the first one
+                let work = self.temp_data_reg(*dst).unwrap_or(DataReg::D0);
+                let arg = reg_operand(ARG_REGS[*index]);
+                if arg != Operand::DataReg(work) {
+                    self.emit(M68kInst::Move(Size::Long, arg, Operand::DataReg(work)));
+                }
+                self.extend(work, *size, *signed);
+                self.store_temp(*dst, work);
             }
 
             Inst::Comment(c) => {
@@ -1017,12 +1684,15 @@ impl CodeGenerator {
         args: &[Value],
         dst: &Option<Temp>,
     ) -> CompileResult<()> {
-        // Load arguments into D0, D1, D2, D3 in order
-        let arg_regs = [DataReg::D0, DataReg::D1, DataReg::D2, DataReg::D3];
-        for (i, arg) in args.iter().enumerate() {
-            if i < arg_regs.len() {
-                self.load_value(arg, arg_regs[i])?;
-            }
+        // Load arguments into D0, D1, D2, D3 in order. The allocator keeps
+        // temps out of these registers across the call, so no argument is
+        // overwritten before it is loaded.
+        for (arg, &reg) in args.iter().zip(&SDK_ARG_REGS) {
+            self.load_value(arg, reg)?;
+        }
+
+        if inline_uses_static_data(func) {
+            self.pending_sdk_functions.insert(func.to_string());
         }
 
         // Generate inline instructions
@@ -1039,6 +1709,117 @@ impl CodeGenerator {
         Ok(())
     }
 
+    /// Code specialized for the constant arguments of an SDK call, if the
+    /// optimizer is on and the function has a cheaper form for them
+    fn sdk_specialization(&self, func: &str, args: &[Value]) -> Option<Vec<M68kInst>> {
+        if self.optimize_level == 0 {
+            return None;
+        }
+        let consts: Vec<Option<i64>> = args.iter().map(constant_arg).collect();
+        SdkSpecializer::generate(func, &consts)
+    }
+
+    /// Emit an SDK call specialized on its constant arguments. Only the
+    /// runtime arguments are loaded, each into its usual register.
+    fn emit_sdk_specialized_call(
+        &mut self,
+        code: Vec<M68kInst>,
+        args: &[Value],
+        dst: &Option<Temp>,
+    ) -> CompileResult<()> {
+        for (arg, &reg) in args.iter().zip(&SDK_ARG_REGS) {
+            if constant_arg(arg).is_none() {
+                self.load_value(arg, reg)?;
+            }
+        }
+        for inst in code {
+            self.emit(inst);
+        }
+        if let Some(d) = dst {
+            self.store_temp(*d, DataReg::D0);
+        }
+        Ok(())
+    }
+
+    /// Lower a multiway branch. Cases are compared as 32-bit signed values,
+    /// the first of any duplicates winning.
+    ///
+    /// A few cases become a compare chain. Dense cases index a table of word
+    /// offsets from the table to each case label, after an unsigned bounds
+    /// check that also catches values below the lowest case. Anything else
+    /// becomes a balanced binary search.
+    fn emit_switch(
+        &mut self,
+        value: &Value,
+        cases: &[(i64, Label)],
+        default: Symbol,
+    ) -> CompileResult<()> {
+        let mut cases: Vec<(i32, Symbol)> = cases
+            .iter()
+            .map(|(case, label)| (*case as i32, label.0))
+            .collect();
+        cases.sort_by_key(|&(case, _)| case);
+        cases.dedup_by_key(|&mut (case, _)| case);
+
+        let (Some(&(low, _)), Some(&(high, _))) = (cases.first(), cases.last()) else {
+            self.emit(M68kInst::Bra(default));
+            return Ok(());
+        };
+        let span = i64::from(high) - i64::from(low) + 1;
+        if cases.len() <= SWITCH_CHAIN_MAX || span > cases.len() as i64 * SWITCH_TABLE_DENSITY {
+            let reg = self.data_operand(value, DataReg::D0)?;
+            self.emit_switch_search(reg, &cases, default);
+            return Ok(());
+        }
+
+        self.load_value(value, DataReg::D0)?;
+        let d0 = Operand::DataReg(DataReg::D0);
+        if low != 0 {
+            self.emit(M68kInst::Subi(Size::Long, low, d0.clone()));
+        }
+        self.emit(M68kInst::Cmpi(Size::Long, (span - 1) as i32, d0.clone()));
+        self.emit(M68kInst::Bcc(Cond::Hi, default));
+        self.emit(M68kInst::Add(Size::Word, d0.clone(), d0.clone()));
+        let table = self.local_label();
+        self.emit(M68kInst::Lea(Operand::Label(table), AddrReg::A0));
+        let entry = Operand::Indexed(0, AddrReg::A0, DataReg::D0);
+        self.emit(M68kInst::Move(Size::Word, entry.clone(), d0));
+        self.emit(M68kInst::Jmp(entry));
+        self.emit(M68kInst::Label(table));
+        let mut next = cases.iter().peekable();
+        for slot in i64::from(low)..=i64::from(high) {
+            let target = match next.next_if(|&&(case, _)| i64::from(case) == slot) {
+                Some(&(_, label)) => label,
+                None => default,
+            };
+            self.emit(M68kInst::Directive(Directive::WordDiff(target, table)));
+        }
+        Ok(())
+    }
+
+    /// Binary search of sorted `cases` for the value in `reg`, ending in a
+    /// compare chain once few enough cases are left
+    fn emit_switch_search(&mut self, reg: DataReg, cases: &[(i32, Symbol)], default: Symbol) {
+        let value = Operand::DataReg(reg);
+        if cases.len() <= SWITCH_CHAIN_MAX {
+            for &(case, label) in cases {
+                self.emit(M68kInst::Cmpi(Size::Long, case, value.clone()));
+                self.emit(M68kInst::Bcc(Cond::Eq, label));
+            }
+            self.emit(M68kInst::Bra(default));
+            return;
+        }
+        let mid = cases.len() / 2;
+        let (case, label) = cases[mid];
+        let lower = self.local_label();
+        self.emit(M68kInst::Cmpi(Size::Long, case, value));
+        self.emit(M68kInst::Bcc(Cond::Eq, label));
+        self.emit(M68kInst::Bcc(Cond::Lt, lower));
+        self.emit_switch_search(reg, &cases[mid + 1..], default);
+        self.emit(M68kInst::Label(lower));
+        self.emit_switch_search(reg, &cases[..mid], default);
+    }
+
     /// Emit a standard function call (push args, JSR, clean stack)
     fn emit_standard_call(
         &mut self,
@@ -1046,21 +1827,36 @@ impl CodeGenerator {
         args: &[Value],
         dst: &Option<Temp>,
     ) -> CompileResult<()> {
-        // Push arguments right-to-left
-        for arg in args.iter().rev() {
-            self.load_value(arg, DataReg::D0)?;
+        let in_regs = self.register_arg_count(func).min(args.len());
+
+        // Push stack arguments right-to-left
+        for arg in args[in_regs..].iter().rev() {
+            let reg = self.data_operand(arg, DataReg::D0)?;
             self.emit(M68kInst::Move(
                 Size::Long,
-                Operand::DataReg(DataReg::D0),
+                Operand::DataReg(reg),
                 Operand::PreDec(AddrReg::A7),
             ));
         }
 
+        // Then the register arguments: data registers first, as loading a
+        // value into one may go through A0
+        for (arg, &reg) in args.iter().zip(&ARG_REGS[..in_regs]) {
+            if let Reg::Data(d) = reg {
+                self.load_value(arg, d)?;
+            }
+        }
+        for (arg, &reg) in args.iter().zip(&ARG_REGS[..in_regs]) {
+            if let Reg::Addr(a) = reg {
+                self.load_address_reg(arg, a)?;
+            }
+        }
+
         // Call function
-        self.emit(M68kInst::Jsr(Operand::Label(func.to_string())));
+        self.emit(M68kInst::Jsr(Operand::Label(func.into())));
 
         // Clean up stack
-        let stack_size = (args.len() * 4) as i32;
+        let stack_size = ((args.len() - in_regs) * 4) as i32;
         if stack_size > 0 {
             if stack_size <= 8 {
                 self.emit(M68kInst::Addq(
@@ -1119,6 +1915,29 @@ impl CodeGenerator {
         }
     }
 
+    /// Emit the VBlank interrupt handler if the program needs one
+    ///
+    /// That is when it uses the frame counter or DMA queue, or defines
+    /// `vblank_handler`. The per-frame VDP work `vdp_wait_vblank_start` ends
+    /// with goes along with it. Returns whether the handler was emitted.
+    fn emit_vblank_handler(&mut self) -> bool {
+        let functions = resolve_dependencies(&self.pending_sdk_functions);
+        let callback = self.defined_functions.contains(VBLANK_CALLBACK);
+        if !needs_frame_counter(&functions) && !needs_dma_queue(&functions) && !callback {
+            return false;
+        }
+        let mut generator = SdkLibraryGenerator::new();
+        self.emit(M68kInst::Comment("VBlank interrupt handler".to_string()));
+        let mut code = generator.generate_vblank_handler(&functions, callback);
+        if functions.contains("vdp_wait_vblank_start") {
+            code.extend(generator.generate_vblank_work(&functions));
+        }
+        for inst in code {
+            self.emit(inst);
+        }
+        true
+    }
+
     /// Emit SDK static data (frame counter, operator offsets, etc.)
     fn emit_sdk_static_data(&mut self) {
         if self.pending_sdk_functions.is_empty() {
@@ -1136,8 +1955,548 @@ impl CodeGenerator {
     }
 }
 
+/// Frame offset of a parameter in the caller's argument area.
+///
+/// In M68k cdecl with LINK A6:
+/// - 0(a6) = saved old A6
+/// - 4(a6) = return address
+/// - 8(a6) = first parameter
+/// - 12(a6) = second parameter, etc.
+///
+/// On big-endian M68K, callers push all values as 32-bit longs.
+/// For smaller types, the value is in the LOW bytes of the slot:
+/// - 4-byte: offset + 0
+/// - 2-byte: offset + 2
+/// - 1-byte: offset + 3
+fn param_offset(index: usize, size: usize) -> i16 {
+    let base_offset = 8 + (index as i16) * 4;
+    let size_adjust = match size {
+        1 => 3, // byte at end of 4-byte slot
+        2 => 2, // word at end of 4-byte slot
+        _ => 0, // long uses full slot
+    };
+    base_offset + size_adjust
+}
+
+/// Shrink a generated function's prologue and epilogues.
+///
+/// Only the callee-saved registers the body writes, or that the library
+/// routines it calls destroy (`clobbered`), are saved. With `omit_frame`, a
+/// function without locals or spill slots that never moves SP itself (so
+/// makes no calls) also loses its LINK/UNLK and reads its arguments relative
+/// to SP.
+fn trim_frame(code: &mut Vec<M68kInst>, clobbered: RegMask, omit_frame: bool) {
+    let is_save = |inst: &M68kInst| matches!(inst, M68kInst::Movem(Size::Long, regs, _, _) if regs[..] == CALLEE_SAVED[..]);
+    let is_frame = |inst: &M68kInst| {
+        is_save(inst)
+            || matches!(
+                inst,
+                M68kInst::Link(AddrReg::A6, _) | M68kInst::Unlk(AddrReg::A6) | M68kInst::Rts
+            )
+    };
+    let written = code
+        .iter()
+        .filter(|inst| !is_save(inst))
+        .fold(clobbered, |mask, inst| mask | inst.written_regs());
+    let saved: Vec<Reg> = CALLEE_SAVED
+        .into_iter()
+        .filter(|r| written & r.mask() != 0)
+        .collect();
+
+    let frame_regs = Reg::Addr(AddrReg::A6).mask() | Reg::Addr(AddrReg::A7).mask();
+    let frameless = omit_frame
+        && !code.iter().any(|inst| {
+            matches!(inst, M68kInst::Link(_, size) if *size != 0)
+                || (!is_frame(inst) && inst.written_regs() & frame_regs != 0)
+        });
+
+    let sp = AddrReg::A7;
+    let mut trimmed = Vec::with_capacity(code.len());
+    for mut inst in code.drain(..) {
+        if is_save(&inst) {
+            let M68kInst::Movem(_, _, _, to_memory) = inst else {
+                unreachable!()
+            };
+            match (saved.as_slice(), to_memory) {
+                ([], _) => {}
+                ([reg], true) => trimmed.push(M68kInst::Move(
+                    Size::Long,
+                    reg_operand(*reg),
+                    Operand::PreDec(sp),
+                )),
+                ([reg], false) => trimmed.push(M68kInst::Move(
+                    Size::Long,
+                    Operand::PostInc(sp),
+                    reg_operand(*reg),
+                )),
+                (regs, true) => trimmed.push(M68kInst::Movem(
+                    Size::Long,
+                    regs.to_vec(),
+                    Operand::PreDec(sp),
+                    true,
+                )),
+                (regs, false) => trimmed.push(M68kInst::Movem(
+                    Size::Long,
+                    regs.to_vec(),
+                    Operand::PostInc(sp),
+                    false,
+                )),
+            }
+            continue;
+        }
+        if frameless {
+            if matches!(inst, M68kInst::Link(..) | M68kInst::Unlk(_)) {
+                continue;
+            }
+            // Arguments sit above the saved registers and return address
+            // instead of the saved A6 and return address
+            let shift = 4 * saved.len() as i16 - 4;
+            for operand in peephole::operands_mut(&mut inst) {
+                if let Operand::Disp(offset, AddrReg::A6) = *operand {
+                    *operand = Operand::Disp(offset + shift, sp);
+                }
+            }
+        }
+        trimmed.push(inst);
+    }
+    *code = trimmed;
+}
+
+fn reg_operand(reg: Reg) -> Operand {
+    match reg {
+        Reg::Data(d) => Operand::DataReg(d),
+        Reg::Addr(a) => Operand::AddrReg(a),
+    }
+}
+
+/// Union of the registers written by a sequence of instructions
+fn written_regs(code: &[M68kInst]) -> RegMask {
+    code.iter().fold(0, |mask, inst| mask | inst.written_regs())
+}
+
+/// The value of an SDK call argument known at compile time
+fn constant_arg(arg: &Value) -> Option<i64> {
+    match arg {
+        Value::IntConst(n) => Some(*n),
+        _ => None,
+    }
+}
+
 impl Default for CodeGenerator {
     fn default() -> Self {
         Self::new()
     }
 }
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::backend::m68k::sdk::{VBLANK_HANDLER, VDP_CTRL};
+    use crate::frontend::c::{Parser, SemanticAnalyzer};
+    use crate::ir::IrBuilder;
+    use crate::opt::PassManager;
+    use crate::types::IrType;
+
+    fn function(body: Vec<M68kInst>) -> Vec<M68kInst> {
+        let mut code = vec![
+            M68kInst::Label("f".into()),
+            M68kInst::Link(AddrReg::A6, 0),
+            M68kInst::Movem(
+                Size::Long,
+                CALLEE_SAVED.to_vec(),
+                Operand::PreDec(AddrReg::A7),
+                true,
+            ),
+        ];
+        code.extend(body);
+        code.extend([
+            M68kInst::Movem(
+                Size::Long,
+                CALLEE_SAVED.to_vec(),
+                Operand::PostInc(AddrReg::A7),
+                false,
+            ),
+            M68kInst::Unlk(AddrReg::A6),
+            M68kInst::Rts,
+        ]);
+        code
+    }
+
+    #[test]
+    fn test_leaf_function_loses_frame() {
+        let mut code = function(vec![M68kInst::Move(
+            Size::Long,
+            Operand::Disp(8, AddrReg::A6),
+            Operand::DataReg(DataReg::D2),
+        )]);
+        trim_frame(&mut code, 0, true);
+        assert_eq!(
+            code,
+            vec![
+                M68kInst::Label("f".into()),
+                M68kInst::Move(
+                    Size::Long,
+                    Operand::DataReg(DataReg::D2),
+                    Operand::PreDec(AddrReg::A7)
+                ),
+                M68kInst::Move(
+                    Size::Long,
+                    Operand::Disp(8, AddrReg::A7),
+                    Operand::DataReg(DataReg::D2)
+                ),
+                M68kInst::Move(
+                    Size::Long,
+                    Operand::PostInc(AddrReg::A7),
+                    Operand::DataReg(DataReg::D2)
+                ),
+                M68kInst::Rts,
+            ]
+        );
+    }
+
+    #[test]
+    fn test_caller_keeps_frame_and_saves_library_clobbers() {
+        let body = vec![
+            M68kInst::Move(
+                Size::Long,
+                Operand::Disp(8, AddrReg::A6),
+                Operand::PreDec(AddrReg::A7),
+            ),
+            M68kInst::Jsr(Operand::Label("g".into())),
+            M68kInst::Addq(Size::Long, 4, Operand::AddrReg(AddrReg::A7)),
+        ];
+        let clobbered = Reg::Data(DataReg::D3).mask() | Reg::Addr(AddrReg::A2).mask();
+        let mut code = function(body.clone());
+        trim_frame(&mut code, clobbered, true);
+        let saved = vec![Reg::Data(DataReg::D3), Reg::Addr(AddrReg::A2)];
+        assert_eq!(code[1], M68kInst::Link(AddrReg::A6, 0));
+        assert_eq!(
+            code[2],
+            M68kInst::Movem(
+                Size::Long,
+                saved.clone(),
+                Operand::PreDec(AddrReg::A7),
+                true
+            )
+        );
+        assert_eq!(code[3..6], body[..]);
+        assert_eq!(
+            code[6],
+            M68kInst::Movem(Size::Long, saved, Operand::PostInc(AddrReg::A7), false)
+        );
+
+        // Nothing to save at all
+        let mut code = function(vec![M68kInst::Moveq(0, DataReg::D0)]);
+        trim_frame(&mut code, 0, false);
+        assert_eq!(code.len(), 5);
+        assert!(!code.iter().any(|inst| matches!(inst, M68kInst::Movem(..))));
+    }
+
+    /// Code between the last push before `jsr callee` and the stack cleanup
+    fn call_site(level: u8) -> Vec<M68kInst> {
+        let mut callee = IrFunction::new("callee".to_string(), Vec::new(), IrType::void());
+        let mut block = BasicBlock::new(Label("callee".into()));
+        block.insts.push(SpannedInst::new(Inst::Return(None), None));
+        callee.blocks.push(block);
+
+        let mut caller = IrFunction::new("main".to_string(), Vec::new(), IrType::void());
+        let mut block = BasicBlock::new(Label("main".into()));
+        block.insts.push(SpannedInst::new(
+            Inst::Call {
+                dst: None,
+                func: "callee".into(),
+                args: (1..=5).map(Value::IntConst).collect(),
+            },
+            None,
+        ));
+        block.insts.push(SpannedInst::new(Inst::Return(None), None));
+        caller.blocks.push(block);
+
+        let mut module = IrModule::new();
+        module.functions = vec![callee, caller];
+        let mut codegen = CodeGenerator::new();
+        codegen.set_optimize_level(level);
+        let code = codegen.generate_instructions(&module).unwrap();
+        let call = code
+            .iter()
+            .position(|i| *i == M68kInst::Jsr(Operand::Label("callee".into())))
+            .unwrap();
+        let start = code[..call]
+            .iter()
+            .rposition(|i| matches!(i, M68kInst::Label(l) if l == "main"))
+            .unwrap();
+        code[start..=call + 1].to_vec()
+    }
+
+    #[test]
+    fn test_register_convention_at_o2() {
+        let code = call_site(2);
+        let pushes = code
+            .iter()
+            .filter(|i| matches!(i, M68kInst::Move(_, _, Operand::PreDec(AddrReg::A7))))
+            .count();
+        assert_eq!(pushes, 1);
+        assert!(code.contains(&M68kInst::Moveq(1, DataReg::D0)));
+        assert!(code.contains(&M68kInst::Moveq(2, DataReg::D1)));
+        assert!(code.contains(&M68kInst::Move(
+            Size::Long,
+            Operand::Imm(4),
+            Operand::AddrReg(AddrReg::A1)
+        )));
+        assert_eq!(
+            code.last(),
+            Some(&M68kInst::Addq(
+                Size::Long,
+                4,
+                Operand::AddrReg(AddrReg::A7)
+            ))
+        );
+    }
+
+    #[test]
+    fn test_stack_convention_below_o2() {
+        let code = call_site(1);
+        let pushes = code
+            .iter()
+            .filter(|i| matches!(i, M68kInst::Move(_, _, Operand::PreDec(AddrReg::A7))))
+            .count();
+        assert_eq!(pushes, 5);
+    }
+
+    #[test]
+    fn test_sdk_call_specialized_on_constants() {
+        let mut main = IrFunction::new("main".to_string(), Vec::new(), IrType::void());
+        let mut block = BasicBlock::new(Label("main".into()));
+        block.insts.push(SpannedInst::new(
+            Inst::Call {
+                dst: None,
+                func: "vdp_set_tile_a".into(),
+                args: vec![Value::IntConst(1), Value::IntConst(0), Value::IntConst(7)],
+            },
+            None,
+        ));
+        block.insts.push(SpannedInst::new(Inst::Return(None), None));
+        main.blocks.push(block);
+        let mut module = IrModule::new();
+        module.functions = vec![main];
+
+        let mut codegen = CodeGenerator::new();
+        codegen.set_optimize_level(1);
+        let code = codegen.generate_instructions(&module).unwrap();
+        assert!(code.contains(&M68kInst::Move(
+            Size::Long,
+            Operand::Imm(0x4002_0003),
+            Operand::AbsLong(VDP_CTRL)
+        )));
+        let library_call = M68kInst::Jsr(Operand::Label("vdp_set_tile_a".into()));
+        assert!(!code.contains(&library_call));
+
+        // -O0 keeps the library call
+        let mut codegen = CodeGenerator::new();
+        let code = codegen.generate_instructions(&module).unwrap();
+        assert!(code.contains(&library_call));
+    }
+
+    fn lower_switch(cases: &[i64]) -> Vec<M68kInst> {
+        let cases: Vec<(i64, Label)> = cases
+            .iter()
+            .map(|&c| (c, Label(format!("case{c}").into())))
+            .collect();
+        let mut cg = CodeGenerator::new();
+        cg.emit_switch(&Value::IntConst(0), &cases, "deflt".into())
+            .unwrap();
+        cg.output
+    }
+
+    #[test]
+    fn test_dense_switch_uses_jump_table() {
+        let code = lower_switch(&[7, 3, 4, 6, 3]);
+        let entries: Vec<String> = code
+            .iter()
+            .filter_map(|i| match i {
+                M68kInst::Directive(Directive::WordDiff(a, b)) => Some(format!("{a}-{b}")),
+                _ => None,
+            })
+            .collect();
+        assert_eq!(
+            entries,
+            [
+                "case3-.Lcg1",
+                "case4-.Lcg1",
+                "deflt-.Lcg1",
+                "case6-.Lcg1",
+                "case7-.Lcg1"
+            ]
+        );
+        let d0 = Operand::DataReg(DataReg::D0);
+        assert!(code.contains(&M68kInst::Subi(Size::Long, 3, d0.clone())));
+        assert!(code.contains(&M68kInst::Cmpi(Size::Long, 4, d0)));
+        assert!(code.contains(&M68kInst::Bcc(Cond::Hi, "deflt".into())));
+        assert!(code.contains(&M68kInst::Jmp(Operand::Indexed(
+            0,
+            AddrReg::A0,
+            DataReg::D0
+        ))));
+    }
+
+    #[test]
+    fn test_sparse_switch_uses_binary_search() {
+        let code = lower_switch(&[-500, 1, 90, 700, 5000, 40000, 1 << 20]);
+        assert!(!code.iter().any(|i| matches!(i, M68kInst::Jmp(_))));
+        let compares = code
+            .iter()
+            .filter(|i| matches!(i, M68kInst::Cmpi(..)))
+            .count();
+        assert_eq!(compares, 7);
+        // The middle case splits the rest
+        assert_eq!(
+            code[1],
+            M68kInst::Cmpi(Size::Long, 700, Operand::DataReg(DataReg::D0))
+        );
+        assert_eq!(code[3], M68kInst::Bcc(Cond::Lt, ".Lcg1".into()));
+
+        let chain = lower_switch(&[1, 1000]);
+        assert_eq!(chain.last(), Some(&M68kInst::Bra("deflt".into())));
+    }
+
+    #[test]
+    fn test_vblank_callback_enables_interrupt() {
+        let mut func = IrFunction::new("vblank_handler".to_string(), Vec::new(), IrType::void());
+        let mut block = BasicBlock::new(Label("vblank_handler".into()));
+        block.insts.push(SpannedInst::new(Inst::Return(None), None));
+        func.blocks.push(block);
+        let mut module = IrModule::new();
+        module.functions = vec![func];
+        let code = CodeGenerator::new().generate_instructions(&module).unwrap();
+
+        assert!(code.contains(&M68kInst::Label(VBLANK_HANDLER.into())));
+        assert!(code.contains(&M68kInst::Move(
+            Size::Word,
+            Operand::Imm(0x8134),
+            Operand::AddrInd(AddrReg::A1)
+        )));
+
+        let code = CodeGenerator::new()
+            .generate_instructions(&IrModule::new())
+            .unwrap();
+        assert!(!code.contains(&M68kInst::Label(VBLANK_HANDLER.into())));
+    }
+
+    #[test]
+    fn test_globals_are_placed_by_constness() {
+        let global = |name: &str, init: Option<Vec<u8>>, readonly| IrGlobal {
+            name: name.to_string(),
+            ty: IrType::i32(),
+            init,
+            readonly,
+            internal: false,
+        };
+        let mut module = IrModule::new();
+        module.globals = vec![
+            global("table", Some(vec![0, 0, 0, 1]), true),
+            global("counter", None, false),
+            global("state", Some(vec![0, 0, 0, 2]), false),
+        ];
+        module
+            .strings
+            .push((Label("str_0".into()), "hi".to_string()));
+        let code = CodeGenerator::new().generate_instructions(&module).unwrap();
+
+        let section_of = |label: &str| {
+            let at = code
+                .iter()
+                .position(|i| matches!(i, M68kInst::Label(l) if l == label))
+                .unwrap();
+            code[..at]
+                .iter()
+                .rev()
+                .find_map(|i| match i {
+                    M68kInst::Directive(Directive::Section(s)) => Some(*s),
+                    _ => None,
+                })
+                .unwrap()
+        };
+        assert_eq!(section_of("state"), SectionName::Data);
+        assert_eq!(section_of("counter"), SectionName::Bss);
+        assert_eq!(section_of("table"), SectionName::Rodata);
+        assert_eq!(section_of("str_0"), SectionName::Rodata);
+    }
+
+    #[test]
+    fn test_startup_modes() {
+        let vram_fill = M68kInst::Move(
+            Size::Long,
+            Operand::Imm(0x4000_0080),
+            Operand::AddrInd(AddrReg::A1),
+        );
+        let bss_start = M68kInst::Lea(Operand::Label("__data_ram_end".into()), AddrReg::A1);
+
+        let code = CodeGenerator::new()
+            .generate_instructions(&IrModule::new())
+            .unwrap();
+        assert!(code.contains(&vram_fill));
+        assert!(!code.contains(&bss_start));
+        assert!(
+            code.iter()
+                .any(|i| matches!(i, M68kInst::Movem(_, _, Operand::PreDec(AddrReg::A2), true)))
+        );
+        assert!(
+            !code
+                .iter()
+                .any(|i| matches!(i, M68kInst::Clr(Size::Word, _)))
+        );
+        assert!(code.contains(&M68kInst::Label(BSS_END.into())));
+
+        let mut codegen = CodeGenerator::new();
+        codegen.set_startup(StartupMode::Minimal);
+        let code = codegen.generate_instructions(&IrModule::new()).unwrap();
+        assert!(!code.contains(&vram_fill));
+        assert!(code.contains(&bss_start));
+    }
+
+    /// Code for the function `name` in C `source`, built at -O2
+    fn c_function(source: &str, name: &str) -> Vec<M68kInst> {
+        let mut tu = Parser::new(source).unwrap().parse().unwrap();
+        SemanticAnalyzer::new().analyze(&mut tu).unwrap();
+        let mut module = IrBuilder::new().build(&tu).unwrap();
+        PassManager::for_level(2).run(&mut module);
+        let mut codegen = CodeGenerator::new();
+        codegen.set_optimize_level(2);
+        let code = codegen.generate_object_instructions(&module).unwrap();
+        let start = code
+            .iter()
+            .position(|i| *i == M68kInst::Label(name.into()))
+            .unwrap();
+        let len = code[start..]
+            .iter()
+            .position(|i| *i == M68kInst::Rts)
+            .unwrap();
+        code[start..=start + len].to_vec()
+    }
+
+    #[test]
+    fn test_volatile_store_and_reload_kept() {
+        let source = "volatile int ticks;
+            int global(void) { ticks = 5; return ticks; }
+            int local(void) { volatile int n = 7; n = n; return n; }";
+        // Stores to and loads from the variable, which the peephole
+        // optimizer would otherwise forward through a register
+        let accesses = |code: &[M68kInst]| {
+            let memory = |op: &Operand| {
+                matches!(
+                    op,
+                    Operand::AddrInd(_) | Operand::Disp(_, AddrReg::A6) | Operand::Label(_)
+                )
+            };
+            let moves = code.iter().filter_map(|i| match i {
+                M68kInst::Move(_, src, dst) => Some((memory(src), memory(dst))),
+                _ => None,
+            });
+            let stores = moves.clone().filter(|&(_, to)| to).count();
+            let loads = moves.filter(|&(from, _)| from).count();
+            (stores, loads)
+        };
+        assert_eq!(accesses(&c_function(source, "global")), (1, 1));
+        assert_eq!(accesses(&c_function(source, "local")), (2, 2));
+    }
+}
@@ -1,9 +1,14 @@
 //! M68k instruction binary encoder
 //!
-//! Converts M68k instructions to binary machine code.
+//! Converts M68k instructions to binary machine code, appending to a
+//! caller-supplied buffer so a whole section encodes without allocating.
 
 use super::m68k::*;
-use std::collections::HashMap;
+use crate::common::Symbol;
+use std::collections::{HashMap, HashSet};
+
+/// Size of a `Bcc`/`BRA`/`BSR` with its displacement in the opword
+pub const SHORT_BRANCH_SIZE: usize = 2;
 
 /// Error during instruction encoding
 #[derive(Debug, Clone)]
@@ -29,14 +34,53 @@ impl std::fmt::Display for EncodeError {
     }
 }
 
+/// Extension words of one effective address: at most a long
+#[derive(Debug, Clone, Copy, Default)]
+struct Ext {
+    bytes: [u8; 4],
+    len: usize,
+}
+
+impl Ext {
+    fn word(value: u16) -> Self {
+        let [a, b] = value.to_be_bytes();
+        Self {
+            bytes: [a, b, 0, 0],
+            len: 2,
+        }
+    }
+
+    fn long(value: u32) -> Self {
+        Self {
+            bytes: value.to_be_bytes(),
+            len: 4,
+        }
+    }
+}
+
+impl std::ops::Deref for Ext {
+    type Target = [u8];
+
+    fn deref(&self) -> &[u8] {
+        &self.bytes[..self.len]
+    }
+}
+
 /// Instruction encoder that converts M68k instructions to bytes
 pub struct InstructionEncoder {
     /// Current position in output
     pub position: u32,
     /// Symbol table for label resolution
-    symbols: HashMap<String, u32>,
+    symbols: HashMap<Symbol, u32>,
     /// Pending relocations (position, symbol_name, is_relative)
-    relocations: Vec<(u32, String, bool)>,
+    relocations: Vec<(u32, Symbol, bool)>,
+    /// Addresses of branches to encode with an 8-bit displacement
+    short_branches: HashSet<u32>,
+    /// Encode label operands the symbol table lacks as zero, for the
+    /// linker to patch, instead of failing
+    relocatable: bool,
+    /// Trace label resolution (`DEBUG_ASM`)
+    debug: bool,
 }
 
 impl InstructionEncoder {
@@ -45,34 +89,71 @@ impl InstructionEncoder {
             position: 0,
             symbols: HashMap::new(),
             relocations: Vec::new(),
+            short_branches: HashSet::new(),
+            relocatable: false,
+            debug: std::env::var_os("DEBUG_ASM").is_some(),
         }
     }
 
+    /// An encoder using a symbol table already filled in by layout
+    pub fn with_symbols(symbols: HashMap<Symbol, u32>) -> Self {
+        Self {
+            symbols,
+            ..Self::new()
+        }
+    }
+
+    /// Give back the symbol table
+    pub fn into_symbols(self) -> HashMap<Symbol, u32> {
+        self.symbols
+    }
+
     /// Set base address for encoding
     pub fn set_base_address(&mut self, addr: u32) {
         self.position = addr;
     }
 
     /// Define a symbol at the current position (only if not already defined)
-    pub fn define_symbol(&mut self, name: &str) {
+    pub fn define_symbol(&mut self, name: Symbol) {
         // Don't overwrite existing symbols - they may have been pre-populated
         // with correct addresses from the layout pass
-        if !self.symbols.contains_key(name) {
-            self.symbols.insert(name.to_string(), self.position);
-        }
+        self.symbols.entry(name).or_insert(self.position);
+    }
+
+    /// Encode the branches at these addresses in short (`.s`) form.
+    ///
+    /// The addresses come from the assembler's relaxation pass, which has
+    /// already checked that each target is within reach.
+    pub fn set_short_branches(&mut self, addrs: HashSet<u32>) {
+        self.short_branches = addrs;
+    }
+
+    /// Leave label operands that are not in the symbol table for the
+    /// linker (see `label_fixups`) instead of rejecting them
+    pub fn set_relocatable(&mut self, relocatable: bool) {
+        self.relocatable = relocatable;
+    }
+
+    /// Whether a branch at `from` can reach `target` with an 8-bit displacement.
+    ///
+    /// Displacement 0 selects the word form and $FF is reserved (68020+
+    /// long form), so neither is usable.
+    pub fn short_branch_reaches(from: u32, target: u32) -> bool {
+        let disp = i64::from(target) - i64::from(from) - 2;
+        (-128..=127).contains(&disp) && disp != 0 && disp != -1
     }
 
     /// Get symbol address, if defined
-    pub fn get_symbol(&self, name: &str) -> Option<u32> {
-        self.symbols.get(name).copied()
+    pub fn get_symbol(&self, name: Symbol) -> Option<u32> {
+        self.symbols.get(&name).copied()
     }
 
     /// Calculate the size of an instruction in bytes (for layout pass)
     pub fn instruction_size(&self, inst: &M68kInst) -> usize {
         match inst {
             // Pseudo-instructions produce no code
-            M68kInst::Label(_) | M68kInst::Comment(_) => 0,
-            M68kInst::Directive(d) => self.directive_size(d),
+            M68kInst::Label(_) | M68kInst::Comment(_) | M68kInst::Barrier => 0,
+            M68kInst::Directive(d) => d.size(),
 
             // Fixed 2-byte instructions
             M68kInst::Nop | M68kInst::Rts | M68kInst::Rte => 2,
@@ -84,8 +165,9 @@ impl InstructionEncoder {
             M68kInst::Link(_, _) => 4,
 
             // Branch instructions
-            M68kInst::Bra(_) | M68kInst::Bsr(_) | M68kInst::Bcc(_, _) => 4, // Use word displacement
-            M68kInst::Dbf(_, _) => 4,                                       // DBF is 4 bytes
+            // Word displacement; the assembler shrinks branches that reach
+            M68kInst::Bra(_) | M68kInst::Bsr(_) | M68kInst::Bcc(_, _) => 4,
+            M68kInst::Dbf(_, _) => 4, // DBF is 4 bytes
 
             // Variable length based on operands
             M68kInst::Move(size, src, dst) => {
@@ -171,31 +253,67 @@ impl InstructionEncoder {
         }
     }
 
-    fn directive_size(&self, directive: &str) -> usize {
-        if directive.starts_with(".byte ") {
-            1
-        } else if directive.starts_with(".word ") {
-            2
-        } else if directive.starts_with(".long ") {
-            4
-        } else if directive.starts_with(".space ") {
-            directive[7..].trim().parse::<usize>().unwrap_or(0)
-        } else if directive.starts_with(".ascii ") || directive.starts_with(".asciz ") {
-            // Extract string and count characters
-            let content = &directive[7..];
-            if content.starts_with('"') && content.ends_with('"') {
-                let s = &content[1..content.len() - 1];
-                let len = s.len();
-                if directive.starts_with(".asciz") {
-                    len + 1
-                } else {
-                    len
-                }
-            } else {
-                0
+    /// Call `each` with every absolute label reference in an instruction:
+    /// the byte offset of its 32-bit address from the start of the
+    /// instruction, and the label. Mirrors the operand order `encode` writes
+    /// extension words in.
+    pub fn label_fixups(&self, inst: &M68kInst, mut each: impl FnMut(u32, Symbol)) {
+        let (first, operands): (usize, [Option<&Operand>; 2]) = match inst {
+            M68kInst::Move(_, src, dst) => (2, [Some(src), Some(dst)]),
+            M68kInst::Add(_, src, dst)
+            | M68kInst::Sub(_, src, dst)
+            | M68kInst::And(_, src, dst)
+            | M68kInst::Or(_, src, dst)
+            | M68kInst::Cmp(_, src, dst) => match dst {
+                Operand::DataReg(_) => (2, [Some(src), None]),
+                _ => (2, [Some(dst), None]),
+            },
+            M68kInst::Lea(op, _)
+            | M68kInst::Pea(op)
+            | M68kInst::Clr(_, op)
+            | M68kInst::Adda(_, op, _)
+            | M68kInst::Suba(_, op, _)
+            | M68kInst::Cmpa(_, op, _)
+            | M68kInst::Addq(_, _, op)
+            | M68kInst::Subq(_, _, op)
+            | M68kInst::Muls(op, _)
+            | M68kInst::Mulu(op, _)
+            | M68kInst::Divs(op, _)
+            | M68kInst::Divu(op, _)
+            | M68kInst::Neg(_, op)
+            | M68kInst::Not(_, op)
+            | M68kInst::Tst(_, op)
+            | M68kInst::Eor(_, _, op)
+            | M68kInst::Jmp(op)
+            | M68kInst::Jsr(op)
+            | M68kInst::Scc(_, op) => (2, [Some(op), None]),
+            M68kInst::Addi(size, _, op)
+            | M68kInst::Subi(size, _, op)
+            | M68kInst::Andi(size, _, op)
+            | M68kInst::Ori(size, _, op)
+            | M68kInst::Eori(size, _, op)
+            | M68kInst::Cmpi(size, _, op) => (2 + self.immediate_size(*size), [Some(op), None]),
+            M68kInst::Btst(bit, op)
+            | M68kInst::Bset(bit, op)
+            | M68kInst::Bclr(bit, op)
+            | M68kInst::Bchg(bit, op) => {
+                let bit_size = if matches!(bit, Operand::Imm(_)) { 2 } else { 0 };
+                (2 + bit_size, [Some(op), None])
             }
-        } else {
-            0 // Other directives like .section, .align, .global
+            M68kInst::Movem(_, _, op, _) => (4, [Some(op), None]),
+            _ => return,
+        };
+
+        let size = match inst {
+            M68kInst::Move(size, ..) => *size,
+            _ => Size::Long,
+        };
+        let mut offset = first;
+        for op in operands.into_iter().flatten() {
+            if let Operand::Label(label) = op {
+                each(offset as u32, *label);
+            }
+            offset += self.operand_extension_size(op, size);
         }
     }
 
@@ -239,18 +357,31 @@ impl InstructionEncoder {
         }
     }
 
-    /// Encode a single instruction to bytes
-    pub fn encode(&mut self, inst: &M68kInst) -> Result<Vec<u8>, EncodeError> {
-        let mut bytes = Vec::new();
+    /// Encode a single instruction, appending its bytes to `bytes`. On
+    /// error, `bytes` is left as it was.
+    pub fn encode(&mut self, inst: &M68kInst, bytes: &mut Vec<u8>) -> Result<(), EncodeError> {
+        let start = bytes.len();
+        if let Err(e) = self.encode_instruction(inst, bytes) {
+            bytes.truncate(start);
+            return Err(e);
+        }
+        self.position += (bytes.len() - start) as u32;
+        Ok(())
+    }
 
+    fn encode_instruction(
+        &mut self,
+        inst: &M68kInst,
+        bytes: &mut Vec<u8>,
+    ) -> Result<(), EncodeError> {
         match inst {
             // Pseudo-instructions
             M68kInst::Label(name) => {
-                self.define_symbol(name);
+                self.define_symbol(*name);
             }
-            M68kInst::Comment(_) => {}
+            M68kInst::Comment(_) | M68kInst::Barrier => {}
             M68kInst::Directive(d) => {
-                self.encode_directive(d, &mut bytes)?;
+                self.encode_directive(d, bytes)?;
             }
 
             // Fixed instructions
@@ -304,14 +435,14 @@ impl InstructionEncoder {
 
             // Branch instructions
             M68kInst::Bra(label) => {
-                self.encode_branch(0x6000, label, &mut bytes)?;
+                self.encode_branch(0x6000, *label, bytes)?;
             }
             M68kInst::Bsr(label) => {
-                self.encode_branch(0x6100, label, &mut bytes)?;
+                self.encode_branch(0x6100, *label, bytes)?;
             }
             M68kInst::Bcc(cond, label) => {
                 let base = 0x6000 | ((cond_code(cond) as u16) << 8);
-                self.encode_branch(base, label, &mut bytes)?;
+                self.encode_branch(base, *label, bytes)?;
             }
             M68kInst::Dbf(reg, label) => {
                 // DBF Dn, label (decrement and branch if not -1)
@@ -319,26 +450,12 @@ impl InstructionEncoder {
                 let opword = 0x51C8 | reg_num_data(reg) as u16;
                 bytes.extend_from_slice(&opword.to_be_bytes());
 
-                // Calculate displacement or mark for relocation
-                if let Some(target) = self.symbols.get(label) {
-                    let current = self.position + 2; // After the opword
-                    let disp = (*target as i32) - (current as i32);
-                    if !(-32768..=32767).contains(&disp) {
-                        return Err(EncodeError::OutOfRange(format!(
-                            "DBF to {label} out of range"
-                        )));
-                    }
-                    bytes.extend_from_slice(&(disp as i16 as u16).to_be_bytes());
-                } else {
-                    self.relocations
-                        .push((self.position + 2, label.clone(), true));
-                    bytes.extend_from_slice(&0u16.to_be_bytes()); // Placeholder
-                }
+                self.encode_displacement(*label, bytes)?;
             }
 
             // MOVE
             M68kInst::Move(size, src, dst) => {
-                self.encode_move(*size, src, dst, &mut bytes)?;
+                self.encode_move(*size, src, dst, bytes)?;
             }
 
             // LEA
@@ -372,67 +489,67 @@ impl InstructionEncoder {
 
             // ADD
             M68kInst::Add(size, src, dst) => {
-                self.encode_add_sub(0xD000, *size, src, dst, &mut bytes)?;
+                self.encode_add_sub(0xD000, *size, src, dst, bytes)?;
             }
 
             // SUB
             M68kInst::Sub(size, src, dst) => {
-                self.encode_add_sub(0x9000, *size, src, dst, &mut bytes)?;
+                self.encode_add_sub(0x9000, *size, src, dst, bytes)?;
             }
 
             // ADDA
             M68kInst::Adda(size, src, dst) => {
-                self.encode_adda_suba(0xD0C0, *size, src, dst, &mut bytes)?;
+                self.encode_adda_suba(0xD0C0, *size, src, dst, bytes)?;
             }
 
             // SUBA
             M68kInst::Suba(size, src, dst) => {
-                self.encode_adda_suba(0x90C0, *size, src, dst, &mut bytes)?;
+                self.encode_adda_suba(0x90C0, *size, src, dst, bytes)?;
             }
 
             // ADDQ
             M68kInst::Addq(size, data, op) => {
-                self.encode_addq_subq(0x5000, *size, *data, op, &mut bytes)?;
+                self.encode_addq_subq(0x5000, *size, *data, op, bytes)?;
             }
 
             // SUBQ
             M68kInst::Subq(size, data, op) => {
-                self.encode_addq_subq(0x5100, *size, *data, op, &mut bytes)?;
+                self.encode_addq_subq(0x5100, *size, *data, op, bytes)?;
             }
 
             // ADDI
             M68kInst::Addi(size, imm, op) => {
-                self.encode_imm_op(0x0600, *size, *imm, op, &mut bytes)?;
+                self.encode_imm_op(0x0600, *size, *imm, op, bytes)?;
             }
 
             // SUBI
             M68kInst::Subi(size, imm, op) => {
-                self.encode_imm_op(0x0400, *size, *imm, op, &mut bytes)?;
+                self.encode_imm_op(0x0400, *size, *imm, op, bytes)?;
             }
 
             // AND
             M68kInst::And(size, src, dst) => {
-                self.encode_and_or(0xC000, *size, src, dst, &mut bytes)?;
+                self.encode_and_or(0xC000, *size, src, dst, bytes)?;
             }
 
             // OR
             M68kInst::Or(size, src, dst) => {
-                self.encode_and_or(0x8000, *size, src, dst, &mut bytes)?;
+                self.encode_and_or(0x8000, *size, src, dst, bytes)?;
             }
 
             // ANDI
             M68kInst::Andi(size, imm, op) => {
-                self.encode_imm_op(0x0200, *size, *imm, op, &mut bytes)?;
+                self.encode_imm_op(0x0200, *size, *imm, op, bytes)?;
             }
 
             // ORI
             M68kInst::Ori(size, imm, op) => {
-                self.encode_imm_op(0x0000, *size, *imm, op, &mut bytes)?;
+                self.encode_imm_op(0x0000, *size, *imm, op, bytes)?;
             }
 
             // EORI
             M68kInst::Eori(size, imm, op) => {
-                self.encode_imm_op(0x0A00, *size, *imm, op, &mut bytes)?;
+                self.encode_imm_op(0x0A00, *size, *imm, op, bytes)?;
             }
 
             // EOR
@@ -489,7 +606,7 @@ impl InstructionEncoder {
 
             // CMPI
             M68kInst::Cmpi(size, imm, op) => {
-                self.encode_imm_op(0x0C00, *size, *imm, op, &mut bytes)?;
+                self.encode_imm_op(0x0C00, *size, *imm, op, bytes)?;
             }
 
             // NEG
@@ -568,36 +685,36 @@ impl InstructionEncoder {
 
             // Shift instructions
             M68kInst::Lsl(size, count, reg) => {
-                self.encode_shift(0xE108, *size, count, reg, &mut bytes)?;
+                self.encode_shift(0xE108, *size, count, reg, bytes)?;
             }
             M68kInst::Lsr(size, count, reg) => {
-                self.encode_shift(0xE008, *size, count, reg, &mut bytes)?;
+                self.encode_shift(0xE008, *size, count, reg, bytes)?;
             }
             M68kInst::Asl(size, count, reg) => {
-                self.encode_shift(0xE100, *size, count, reg, &mut bytes)?;
+                self.encode_shift(0xE100, *size, count, reg, bytes)?;
             }
             M68kInst::Asr(size, count, reg) => {
-                self.encode_shift(0xE000, *size, count, reg, &mut bytes)?;
+                self.encode_shift(0xE000, *size, count, reg, bytes)?;
             }
             M68kInst::Rol(size, count, reg) => {
-                self.encode_shift(0xE118, *size, count, reg, &mut bytes)?;
+                self.encode_shift(0xE118, *size, count, reg, bytes)?;
             }
             M68kInst::Ror(size, count, reg) => {
-                self.encode_shift(0xE018, *size, count, reg, &mut bytes)?;
+                self.encode_shift(0xE018, *size, count, reg, bytes)?;
             }
 
             // Bit operations
             M68kInst::Btst(bit, op) => {
-                self.encode_bit_op(0x0100, 0x0800, bit, op, &mut bytes)?;
+                self.encode_bit_op(0x0100, 0x0800, bit, op, bytes)?;
             }
             M68kInst::Bset(bit, op) => {
-                self.encode_bit_op(0x01C0, 0x08C0, bit, op, &mut bytes)?;
+                self.encode_bit_op(0x01C0, 0x08C0, bit, op, bytes)?;
             }
             M68kInst::Bclr(bit, op) => {
-                self.encode_bit_op(0x0180, 0x0880, bit, op, &mut bytes)?;
+                self.encode_bit_op(0x0180, 0x0880, bit, op, bytes)?;
             }
             M68kInst::Bchg(bit, op) => {
-                self.encode_bit_op(0x0140, 0x0840, bit, op, &mut bytes)?;
+                self.encode_bit_op(0x0140, 0x0840, bit, op, bytes)?;
             }
 
             // JMP
@@ -634,7 +751,7 @@ impl InstructionEncoder {
 
             // MOVEM
             M68kInst::Movem(size, regs, op, to_mem) => {
-                self.encode_movem(*size, regs, op, *to_mem, &mut bytes)?;
+                self.encode_movem(*size, regs, op, *to_mem, bytes)?;
             }
 
             // Scc
@@ -647,66 +764,90 @@ impl InstructionEncoder {
             }
         }
 
-        self.position += bytes.len() as u32;
-        Ok(bytes)
+        Ok(())
     }
 
-    fn encode_directive(&self, directive: &str, bytes: &mut Vec<u8>) -> Result<(), EncodeError> {
-        if directive.starts_with(".byte ") {
-            let val = parse_number(&directive[6..])?;
-            bytes.push(val as u8);
-        } else if directive.starts_with(".word ") {
-            let val = parse_number(&directive[6..])?;
-            bytes.extend_from_slice(&(val as u16).to_be_bytes());
-        } else if directive.starts_with(".long ") {
-            let val = parse_number(&directive[6..])?;
-            bytes.extend_from_slice(&(val as u32).to_be_bytes());
-        } else if directive.starts_with(".space ") {
-            let size = directive[7..]
-                .trim()
-                .parse::<usize>()
-                .map_err(|_| EncodeError::InvalidOperands("invalid .space size".to_string()))?;
-            bytes.extend(std::iter::repeat_n(0u8, size));
-        } else if directive.starts_with(".ascii ") || directive.starts_with(".asciz ") {
-            let content = &directive[7..];
-            if content.starts_with('"') && content.ends_with('"') {
-                let s = &content[1..content.len() - 1];
-                bytes.extend(s.bytes());
-                if directive.starts_with(".asciz") {
-                    bytes.push(0);
-                }
-            }
+    fn encode_directive(
+        &self,
+        directive: &Directive,
+        bytes: &mut Vec<u8>,
+    ) -> Result<(), EncodeError> {
+        match directive {
+            Directive::Byte(v) => bytes.push(*v),
+            Directive::Word(v) => bytes.extend_from_slice(&v.to_be_bytes()),
+            Directive::Long(v) => bytes.extend_from_slice(&v.to_be_bytes()),
+            Directive::WordDiff(a, b) => {
+                let symbol = |name: &Symbol| {
+                    self.symbols
+                        .get(name)
+                        .copied()
+                        .ok_or_else(|| EncodeError::UnresolvedSymbol(name.to_string()))
+                };
+                let diff = symbol(a)?.wrapping_sub(symbol(b)?);
+                bytes.extend_from_slice(&(diff as u16).to_be_bytes());
+            }
+            Directive::Space(n) => bytes.resize(bytes.len() + *n as usize, 0),
+            Directive::Asciz(text) => {
+                bytes.extend_from_slice(text.as_bytes());
+                bytes.push(0);
+            }
+            // Layout only; the assembler handles sections and alignment
+            Directive::Section(_)
+            | Directive::Align(_)
+            | Directive::Global(_)
+            | Directive::Local(_) => {}
         }
-        // Other directives like .section, .align, .global are ignored in binary output
         Ok(())
     }
 
     fn encode_branch(
         &mut self,
         base: u16,
-        label: &str,
+        label: Symbol,
         bytes: &mut Vec<u8>,
     ) -> Result<(), EncodeError> {
-        // Always use word displacement for simplicity
+        if self.short_branches.contains(&self.position) {
+            let target = self
+                .symbols
+                .get(&label)
+                .copied()
+                .filter(|&t| Self::short_branch_reaches(self.position, t));
+            let Some(target) = target else {
+                return Err(EncodeError::OutOfRange(format!(
+                    "short branch to {label} out of range"
+                )));
+            };
+            let disp = (target as i32) - (self.position as i32 + 2);
+            let opword = base | u16::from(disp as i8 as u8);
+            bytes.extend_from_slice(&opword.to_be_bytes());
+            return Ok(());
+        }
+
         let opword = base; // Displacement 0 means word displacement follows
         bytes.extend_from_slice(&opword.to_be_bytes());
+        self.encode_displacement(label, bytes)
+    }
 
-        // Calculate displacement or mark for relocation
-        if let Some(target) = self.symbols.get(label) {
-            let current = self.position + 2; // After the opword
-            let disp = (*target as i32) - (current as i32);
-            if !(-32768..=32767).contains(&disp) {
-                return Err(EncodeError::OutOfRange(format!(
-                    "branch to {label} out of range"
-                )));
+    /// The word displacement of a branch or `DBF` whose opword is at the
+    /// current position. A label outside the symbol table is left for the
+    /// linker when relocatable.
+    fn encode_displacement(
+        &mut self,
+        label: Symbol,
+        bytes: &mut Vec<u8>,
+    ) -> Result<(), EncodeError> {
+        let current = self.position + 2; // After the opword
+        let Some(&target) = self.symbols.get(&label) else {
+            if !self.relocatable {
+                return Err(EncodeError::UnresolvedSymbol(label.to_string()));
             }
-            bytes.extend_from_slice(&(disp as i16 as u16).to_be_bytes());
-        } else {
-            // Mark for relocation
-            self.relocations
-                .push((self.position + 2, label.to_string(), true));
+            self.relocations.push((current, label, true));
             bytes.extend_from_slice(&0u16.to_be_bytes()); // Placeholder
-        }
+            return Ok(());
+        };
+        let disp = i16::try_from(i64::from(target) - i64::from(current))
+            .map_err(|_| EncodeError::OutOfRange(format!("branch to {label} out of range")))?;
+        bytes.extend_from_slice(&disp.to_be_bytes());
         Ok(())
     }
 
@@ -1041,59 +1182,49 @@ impl InstructionEncoder {
 
     /// Encode an effective address operand
     /// Returns (mode, register, extension_words)
-    fn encode_ea(&self, op: &Operand, size: Size) -> Result<(u8, u8, Vec<u8>), EncodeError> {
-        let mut ext = Vec::new();
-
-        let (mode, reg) = match op {
-            Operand::DataReg(d) => (0b000, reg_num_data(d)),
-            Operand::AddrReg(a) => (0b001, reg_num_addr(a)),
-            Operand::AddrInd(a) => (0b010, reg_num_addr(a)),
-            Operand::PostInc(a) => (0b011, reg_num_addr(a)),
-            Operand::PreDec(a) => (0b100, reg_num_addr(a)),
-            Operand::Disp(d, a) => {
-                ext.extend_from_slice(&(*d as u16).to_be_bytes());
-                (0b101, reg_num_addr(a))
-            }
+    fn encode_ea(&self, op: &Operand, size: Size) -> Result<(u8, u8, Ext), EncodeError> {
+        let none = Ext::default();
+        Ok(match op {
+            Operand::DataReg(d) => (0b000, reg_num_data(d), none),
+            Operand::AddrReg(a) => (0b001, reg_num_addr(a), none),
+            Operand::AddrInd(a) => (0b010, reg_num_addr(a), none),
+            Operand::PostInc(a) => (0b011, reg_num_addr(a), none),
+            Operand::PreDec(a) => (0b100, reg_num_addr(a), none),
+            Operand::Disp(d, a) => (0b101, reg_num_addr(a), Ext::word(*d as u16)),
             Operand::Indexed(d, a, idx) => {
                 // Brief extension word: D/A | reg | W/L | scale | 0 | disp
                 let brief = ((reg_num_data(idx) as u16) << 12) | ((*d as u8 as u16) & 0xFF);
-                ext.extend_from_slice(&brief.to_be_bytes());
-                (0b110, reg_num_addr(a))
-            }
-            Operand::AbsShort(addr) => {
-                ext.extend_from_slice(&(*addr as u16).to_be_bytes());
-                (0b111, 0b000)
-            }
-            Operand::AbsLong(addr) => {
-                ext.extend_from_slice(&addr.to_be_bytes());
-                (0b111, 0b001)
+                (0b110, reg_num_addr(a), Ext::word(brief))
             }
+            Operand::AbsShort(addr) => (0b111, 0b000, Ext::word(*addr as u16)),
+            Operand::AbsLong(addr) => (0b111, 0b001, Ext::long(*addr)),
             Operand::Imm(val) => {
-                match size {
-                    Size::Byte | Size::Word => ext.extend_from_slice(&(*val as u16).to_be_bytes()),
-                    Size::Long => ext.extend_from_slice(&(*val as u32).to_be_bytes()),
-                }
-                (0b111, 0b100)
+                let ext = match size {
+                    Size::Byte | Size::Word => Ext::word(*val as u16),
+                    Size::Long => Ext::long(*val as u32),
+                };
+                (0b111, 0b100, ext)
             }
             Operand::PcRel(_label) => {
                 // PC-relative with word displacement
                 // TODO: Handle symbol resolution
-                ext.extend_from_slice(&0u16.to_be_bytes()); // Placeholder
-                (0b111, 0b010)
+                (0b111, 0b010, Ext::word(0)) // Placeholder
             }
             Operand::Label(label) => {
                 // Treat as absolute long
-                if let Some(addr) = self.symbols.get(label) {
-                    if std::env::var("DEBUG_ASM").is_ok() {
+                let addr = if let Some(&addr) = self.symbols.get(label) {
+                    if self.debug {
                         eprintln!("  Label '{label}' resolved to 0x{addr:08X}");
                     }
-                    ext.extend_from_slice(&addr.to_be_bytes());
+                    addr
+                } else if self.relocatable {
+                    0
                 } else {
                     return Err(EncodeError::InvalidOperands(format!(
                         "Label '{label}' not found in symbol table"
                     )));
-                }
-                (0b111, 0b001)
+                };
+                (0b111, 0b001, Ext::long(addr))
             }
             Operand::Sr => {
                 // SR is not a standard EA mode, it's handled specially in MOVE to/from SR
@@ -1101,13 +1232,11 @@ impl InstructionEncoder {
                     "SR cannot be encoded as EA".to_string(),
                 ));
             }
-        };
-
-        Ok((mode, reg, ext))
+        })
     }
 
     /// Get pending relocations
-    pub fn relocations(&self) -> &[(u32, String, bool)] {
+    pub fn relocations(&self) -> &[(u32, Symbol, bool)] {
         &self.relocations
     }
 }
@@ -1175,79 +1304,75 @@ fn cond_code(cond: &Cond) -> u8 {
     }
 }
 
-fn parse_number(s: &str) -> Result<i32, EncodeError> {
-    let s = s.trim();
-    if s.starts_with("0x") || s.starts_with("0X") {
-        // Parse as u32 first to handle full 32-bit range, then cast to i32
-        u32::from_str_radix(&s[2..], 16)
-            .map(|v| v as i32)
-            .map_err(|_| EncodeError::InvalidOperands(format!("invalid hex number: {s}")))
-    } else if s.starts_with('$') {
-        u32::from_str_radix(&s[1..], 16)
-            .map(|v| v as i32)
-            .map_err(|_| EncodeError::InvalidOperands(format!("invalid hex number: {s}")))
-    } else {
-        s.parse::<i32>()
-            .map_err(|_| EncodeError::InvalidOperands(format!("invalid number: {s}")))
-    }
-}
-
 #[cfg(test)]
 mod tests {
     use super::*;
 
+    fn encode(inst: &M68kInst) -> Vec<u8> {
+        let mut bytes = Vec::new();
+        InstructionEncoder::new().encode(inst, &mut bytes).unwrap();
+        bytes
+    }
+
     #[test]
     fn test_encode_nop() {
-        let mut encoder = InstructionEncoder::new();
-        let bytes = encoder.encode(&M68kInst::Nop).unwrap();
+        let bytes = encode(&M68kInst::Nop);
         assert_eq!(bytes, vec![0x4E, 0x71]);
     }
 
     #[test]
     fn test_encode_rts() {
-        let mut encoder = InstructionEncoder::new();
-        let bytes = encoder.encode(&M68kInst::Rts).unwrap();
+        let bytes = encode(&M68kInst::Rts);
         assert_eq!(bytes, vec![0x4E, 0x75]);
     }
 
     #[test]
     fn test_encode_moveq() {
-        let mut encoder = InstructionEncoder::new();
-        let bytes = encoder.encode(&M68kInst::Moveq(5, DataReg::D0)).unwrap();
+        let bytes = encode(&M68kInst::Moveq(5, DataReg::D0));
         assert_eq!(bytes, vec![0x70, 0x05]); // MOVEQ #5, D0
     }
 
     #[test]
     fn test_encode_link() {
-        let mut encoder = InstructionEncoder::new();
-        let bytes = encoder.encode(&M68kInst::Link(AddrReg::A6, -64)).unwrap();
+        let bytes = encode(&M68kInst::Link(AddrReg::A6, -64));
         assert_eq!(bytes, vec![0x4E, 0x56, 0xFF, 0xC0]); // LINK A6, #-64
     }
 
     #[test]
     fn test_encode_move_reg_to_reg() {
-        let mut encoder = InstructionEncoder::new();
-        let bytes = encoder
-            .encode(&M68kInst::Move(
-                Size::Long,
-                Operand::DataReg(DataReg::D0),
-                Operand::DataReg(DataReg::D1),
-            ))
-            .unwrap();
+        let bytes = encode(&M68kInst::Move(
+            Size::Long,
+            Operand::DataReg(DataReg::D0),
+            Operand::DataReg(DataReg::D1),
+        ));
         assert_eq!(bytes, vec![0x22, 0x00]); // MOVE.L D0, D1
     }
 
     #[test]
     fn test_encode_add_imm() {
-        let mut encoder = InstructionEncoder::new();
-        let bytes = encoder
-            .encode(&M68kInst::Addi(
-                Size::Long,
-                100,
-                Operand::DataReg(DataReg::D0),
-            ))
-            .unwrap();
+        let bytes = encode(&M68kInst::Addi(
+            Size::Long,
+            100,
+            Operand::DataReg(DataReg::D0),
+        ));
         // ADDI.L #100, D0
         assert_eq!(bytes, vec![0x06, 0x80, 0x00, 0x00, 0x00, 0x64]);
     }
+
+    #[test]
+    fn test_encode_appends_and_advances() {
+        let mut encoder = InstructionEncoder::new();
+        encoder.set_base_address(0x200);
+        let mut bytes = vec![0xAA];
+        encoder.encode(&M68kInst::Nop, &mut bytes).unwrap();
+        encoder
+            .encode(&M68kInst::Bra("top".into()), &mut bytes)
+            .unwrap_err();
+        encoder.define_symbol("top".into());
+        encoder
+            .encode(&M68kInst::Bra("top".into()), &mut bytes)
+            .unwrap();
+        assert_eq!(bytes, vec![0xAA, 0x4E, 0x71, 0x60, 0x00, 0xFF, 0xFE]);
+        assert_eq!(encoder.position, 0x206);
+    }
 }
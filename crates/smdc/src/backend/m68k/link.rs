@@ -0,0 +1,298 @@
+//! Linker for relocatable objects
+//!
+//! Objects are placed in the order given. Their text comes first, from the
+//! base address, so the object holding the startup stub goes first. The
+//! `.data` images follow, back to back, for the startup stub to copy to RAM
+//! in one go. In RAM, `.data` starts where a single-file build puts it, and
+//! every object's `.bss` follows. The linker defines the labels the startup
+//! stub finds these regions by.
+
+use super::assembler::DATA_RAM_BASE;
+use super::object::{ObjectFile, ObjectSection, RelocationKind};
+use std::collections::HashMap;
+
+/// ROM address of the first `.data` image
+const DATA_ROM_START: &str = "__data_rom_start";
+/// RAM address of the first object's `.data`
+const DATA_RAM_START: &str = "__data_ram_start";
+/// End of `.data` in RAM, where `.bss` starts
+const DATA_RAM_END: &str = "__data_ram_end";
+/// End of `.bss` in RAM
+const BSS_END: &str = "__bss_end";
+
+/// Link error
+#[derive(Debug, Clone)]
+pub enum LinkError {
+    /// Referenced symbol no object defines
+    UndefinedSymbol(String),
+    /// Global symbol defined by more than one object
+    DuplicateSymbol(String),
+    /// Branch displacement that does not fit in 16 bits
+    OutOfRange(String),
+}
+
+impl std::fmt::Display for LinkError {
+    fn fmt(&self, f: &mut std::fmt::Formatter<'_>) -> std::fmt::Result {
+        match self {
+            LinkError::UndefinedSymbol(s) => write!(f, "undefined symbol: {s}"),
+            LinkError::DuplicateSymbol(s) => write!(f, "duplicate symbol: {s}"),
+            LinkError::OutOfRange(s) => write!(f, "branch to {s} out of range"),
+        }
+    }
+}
+
+/// Linked program
+pub struct LinkedImage {
+    /// ROM contents from the base address: all text, then the `.data` images
+    pub code: Vec<u8>,
+    /// Addresses of global symbols
+    pub symbols: HashMap<String, u32>,
+}
+
+/// Round up to a whole number of longs
+fn align4(n: u32) -> u32 {
+    (n + 3) & !3
+}
+
+/// Lay out `objects` from `base_address` and resolve their relocations
+pub fn link(objects: &[ObjectFile], base_address: u32) -> Result<LinkedImage, LinkError> {
+    let mut text_bases = Vec::with_capacity(objects.len());
+    let mut position = base_address;
+    for object in objects {
+        position = align4(position);
+        text_bases.push(position);
+        position += object.text.len() as u32;
+    }
+    let data_rom_start = align4(position);
+
+    let mut data_bases = Vec::with_capacity(objects.len());
+    let mut ram = DATA_RAM_BASE;
+    for object in objects {
+        data_bases.push(ram);
+        ram += align4(object.data.len() as u32);
+    }
+    let data_ram_end = ram;
+    let mut bss_bases = Vec::with_capacity(objects.len());
+    for object in objects {
+        bss_bases.push(ram);
+        ram += align4(object.bss_size);
+    }
+
+    let address = |i: usize, section: ObjectSection, offset: u32| {
+        offset
+            + match section {
+                ObjectSection::Text => text_bases[i],
+                ObjectSection::Data => data_bases[i],
+                ObjectSection::Bss => bss_bases[i],
+            }
+    };
+
+    let mut globals: HashMap<String, u32> = [
+        (DATA_ROM_START, data_rom_start),
+        (DATA_RAM_START, DATA_RAM_BASE),
+        (DATA_RAM_END, data_ram_end),
+        (BSS_END, ram),
+    ]
+    .into_iter()
+    .map(|(name, addr)| (name.to_string(), addr))
+    .collect();
+    let mut locals: Vec<HashMap<&str, u32>> = Vec::with_capacity(objects.len());
+    for (i, object) in objects.iter().enumerate() {
+        let mut own = HashMap::new();
+        for sym in &object.symbols {
+            let addr = address(i, sym.section, sym.offset);
+            own.insert(sym.name.as_str(), addr);
+            if sym.global && globals.insert(sym.name.clone(), addr).is_some() {
+                return Err(LinkError::DuplicateSymbol(sym.name.clone()));
+            }
+        }
+        locals.push(own);
+    }
+
+    let data_size = data_ram_end - DATA_RAM_BASE;
+    let mut code = vec![0u8; (data_rom_start - base_address + data_size) as usize];
+    for (i, object) in objects.iter().enumerate() {
+        let text = (text_bases[i] - base_address) as usize;
+        code[text..text + object.text.len()].copy_from_slice(&object.text);
+        let data = (data_rom_start - base_address + data_bases[i] - DATA_RAM_BASE) as usize;
+        code[data..data + object.data.len()].copy_from_slice(&object.data);
+
+        for reloc in &object.relocations {
+            let target = locals[i]
+                .get(reloc.symbol.as_str())
+                .or_else(|| globals.get(&reloc.symbol))
+                .copied()
+                .ok_or_else(|| LinkError::UndefinedSymbol(reloc.symbol.clone()))?;
+            let at = text_bases[i] + reloc.offset;
+            let field = (at - base_address) as usize;
+            match reloc.kind {
+                RelocationKind::Absolute32 => {
+                    code[field..field + 4].copy_from_slice(&target.to_be_bytes());
+                }
+                RelocationKind::Relative16 => {
+                    // PC is at the extension word
+                    let disp = i64::from(target) - i64::from(at);
+                    let disp = i16::try_from(disp)
+                        .map_err(|_| LinkError::OutOfRange(reloc.symbol.clone()))?;
+                    code[field..field + 2].copy_from_slice(&disp.to_be_bytes());
+                }
+            }
+        }
+    }
+
+    Ok(LinkedImage {
+        code,
+        symbols: globals,
+    })
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::backend::BackendConfig;
+    use crate::backend::m68k::{
+        AddrReg, Assembler, Directive, M68kBackend, M68kInst, Operand, SectionName, Size,
+    };
+    use crate::frontend::c::{Parser, SemanticAnalyzer};
+    use crate::ir::IrBuilder;
+
+    fn object(instructions: &[M68kInst]) -> ObjectFile {
+        Assembler::new(0x200).assemble_object(instructions).unwrap()
+    }
+
+    fn c_object(source: &str) -> ObjectFile {
+        let mut tu = Parser::new(source).unwrap().parse().unwrap();
+        SemanticAnalyzer::new().analyze(&mut tu).unwrap();
+        let module = IrBuilder::new().build(&tu).unwrap();
+        M68kBackend::compile_object(&module, &BackendConfig::default()).unwrap()
+    }
+
+    #[test]
+    fn test_object_sections_and_relocations() {
+        let directive = M68kInst::Directive;
+        let label = |l: &str| M68kInst::Label(l.into());
+        let obj = object(&[
+            label("main"),
+            M68kInst::Jsr(Operand::Label("update".into())),
+            M68kInst::Bra("main".into()),
+            directive(Directive::Section(SectionName::Data)),
+            label("score"),
+            directive(Directive::Long(7)),
+            directive(Directive::Section(SectionName::Bss)),
+            label("lives"),
+            directive(Directive::Word(0)),
+            directive(Directive::Section(SectionName::Rodata)),
+            label(".Lstr0"),
+            directive(Directive::Byte(65)),
+        ]);
+
+        // JSR update; BRA.S main; then .rodata in the text
+        assert_eq!(
+            obj.text,
+            vec![0x4E, 0xB9, 0, 0, 0, 0, 0x60, 0xF8, 0x41, 0, 0, 0]
+        );
+        assert_eq!(obj.data, vec![0, 0, 0, 7]);
+        assert_eq!(obj.bss_size, 4);
+        assert_eq!(obj.relocations.len(), 1);
+        assert_eq!(obj.relocations[0].offset, 2);
+        assert_eq!(obj.relocations[0].symbol, "update");
+
+        let section = |name: &str| {
+            let sym = obj.symbols.iter().find(|s| s.name == name).unwrap();
+            (sym.section, sym.offset, sym.global)
+        };
+        assert_eq!(section("main"), (ObjectSection::Text, 0, true));
+        assert_eq!(section("score"), (ObjectSection::Data, 0, true));
+        assert_eq!(section("lives"), (ObjectSection::Bss, 0, true));
+        assert_eq!(section(".Lstr0"), (ObjectSection::Text, 8, false));
+    }
+
+    #[test]
+    fn test_link_resolves_across_objects() {
+        let label = |l: &str| M68kInst::Label(l.into());
+        let first = object(&[
+            label("_start"),
+            M68kInst::Lea(Operand::Label(DATA_RAM_END.into()), AddrReg::A1),
+            M68kInst::Jsr(Operand::Label("main".into())),
+            label(".halt"),
+            M68kInst::Bra(".halt".into()),
+        ]);
+        let second = object(&[
+            label("main"),
+            M68kInst::Move(
+                Size::Long,
+                Operand::Label("count".into()),
+                Operand::Label("count".into()),
+            ),
+            M68kInst::Rts,
+            M68kInst::Directive(Directive::Section(SectionName::Data)),
+            label("count"),
+            M68kInst::Directive(Directive::Long(1)),
+            label(".halt"),
+            M68kInst::Directive(Directive::Long(2)),
+        ]);
+
+        let image = link(&[first, second], 0x200).unwrap();
+        // _start is 14 bytes; main starts at the next long
+        assert_eq!(image.symbols["main"], 0x210);
+        assert_eq!(image.symbols["count"], DATA_RAM_BASE);
+        assert_eq!(image.symbols[DATA_RAM_END], DATA_RAM_BASE + 8);
+        assert_eq!(image.symbols[BSS_END], DATA_RAM_BASE + 8);
+        assert_eq!(image.code[2..6], (DATA_RAM_BASE + 8).to_be_bytes());
+        assert_eq!(image.code[8..12], 0x210u32.to_be_bytes());
+        // Each object's .halt is its own
+        assert_eq!(image.code[12..14], [0x60, 0xFE]);
+        assert_eq!(image.code[0x12..0x16], DATA_RAM_BASE.to_be_bytes());
+        assert_eq!(image.code[0x16..0x1A], DATA_RAM_BASE.to_be_bytes());
+        // The .data image follows all text
+        assert_eq!(image.symbols[DATA_ROM_START], 0x21C);
+        assert_eq!(image.code[0x1C..0x24], [0, 0, 0, 1, 0, 0, 0, 2]);
+
+        let missing = object(&[M68kInst::Jsr(Operand::Label("nowhere".into()))]);
+        assert!(matches!(
+            link(&[missing], 0x200),
+            Err(LinkError::UndefinedSymbol(_))
+        ));
+        let twice = || object(&[label("main"), M68kInst::Rts]);
+        assert!(matches!(
+            link(&[twice(), twice()], 0x200),
+            Err(LinkError::DuplicateSymbol(_))
+        ));
+    }
+
+    #[test]
+    fn test_static_symbols_stay_in_their_object() {
+        // The first declares helper static only in its prototype
+        let first = c_object(
+            "static int helper(void);
+            static int count;
+            int first(void) { count = helper(); return count; }
+            int helper(void) { return 1; }",
+        );
+        let second = c_object(
+            "static int helper(void) { return 2; }
+            static int count = 5;
+            int second(void) { return helper() + count; }",
+        );
+        for obj in [&first, &second] {
+            for name in ["helper", "count"] {
+                let sym = obj.symbols.iter().find(|s| s.name == name).unwrap();
+                assert!(!sym.global, "{name}");
+            }
+        }
+
+        let image = link(&[first, second], 0x200).unwrap();
+        assert!(image.symbols.contains_key("first"));
+        assert!(image.symbols.contains_key("second"));
+        assert!(!image.symbols.contains_key("helper"));
+        assert!(!image.symbols.contains_key("count"));
+
+        // Another object still can't reach them
+        let caller = c_object("int helper(void); int main(void) { return helper(); }");
+        let again = c_object("static int helper(void) { return 3; }");
+        assert!(matches!(
+            link(&[caller, again], 0x200),
+            Err(LinkError::UndefinedSymbol(s)) if s == "helper"
+        ));
+    }
+}
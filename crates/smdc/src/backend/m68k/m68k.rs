@@ -1,7 +1,9 @@
 //! M68k instruction definitions
 
+use crate::common::Symbol;
+
 /// M68k data registers
-#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+#[derive(Debug, Clone, Copy, PartialEq, Eq, Hash)]
 pub enum DataReg {
     D0,
     D1,
@@ -29,7 +31,7 @@ impl std::fmt::Display for DataReg {
 }
 
 /// M68k address registers
-#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+#[derive(Debug, Clone, Copy, PartialEq, Eq, Hash)]
 pub enum AddrReg {
     A0,
     A1,
@@ -57,12 +59,25 @@ impl std::fmt::Display for AddrReg {
 }
 
 /// Any M68k register
-#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+#[derive(Debug, Clone, Copy, PartialEq, Eq, Hash)]
 pub enum Reg {
     Data(DataReg),
     Addr(AddrReg),
 }
 
+/// Set of registers: bit n = Dn, bit 8+n = An (same layout as a MOVEM mask)
+pub type RegMask = u16;
+
+impl Reg {
+    /// This register's bit in a `RegMask`
+    pub fn mask(self) -> RegMask {
+        match self {
+            Reg::Data(d) => 1 << (d as u16),
+            Reg::Addr(a) => 1 << (8 + a as u16),
+        }
+    }
+}
+
 impl std::fmt::Display for Reg {
     fn fmt(&self, f: &mut std::fmt::Formatter<'_>) -> std::fmt::Result {
         match self {
@@ -98,10 +113,19 @@ impl Size {
             _ => Size::Long,
         }
     }
+
+    /// `n` reduced to the bits an operation of this size uses, sign-extended
+    pub fn truncate(self, n: i64) -> i32 {
+        match self {
+            Size::Byte => i32::from(n as i8),
+            Size::Word => i32::from(n as i16),
+            Size::Long => n as i32,
+        }
+    }
 }
 
 /// M68k addressing mode operand
-#[derive(Debug, Clone)]
+#[derive(Debug, Clone, PartialEq, Eq)]
 pub enum Operand {
     /// Data register direct: Dn
     DataReg(DataReg),
@@ -124,9 +148,9 @@ pub enum Operand {
     /// Immediate: #imm
     Imm(i32),
     /// PC relative: d(PC)
-    PcRel(String),
+    PcRel(Symbol),
     /// Label reference
-    Label(String),
+    Label(Symbol),
     /// Status register
     Sr,
 }
@@ -178,6 +202,30 @@ pub enum Cond {
     Le,    // Less or Equal (signed)
 }
 
+impl Cond {
+    /// The condition that holds exactly when `self` does not
+    pub fn negate(self) -> Self {
+        match self {
+            Cond::True => Cond::False,
+            Cond::False => Cond::True,
+            Cond::Hi => Cond::Ls,
+            Cond::Ls => Cond::Hi,
+            Cond::Cc => Cond::Cs,
+            Cond::Cs => Cond::Cc,
+            Cond::Ne => Cond::Eq,
+            Cond::Eq => Cond::Ne,
+            Cond::Vc => Cond::Vs,
+            Cond::Vs => Cond::Vc,
+            Cond::Pl => Cond::Mi,
+            Cond::Mi => Cond::Pl,
+            Cond::Ge => Cond::Lt,
+            Cond::Lt => Cond::Ge,
+            Cond::Gt => Cond::Le,
+            Cond::Le => Cond::Gt,
+        }
+    }
+}
+
 impl std::fmt::Display for Cond {
     fn fmt(&self, f: &mut std::fmt::Formatter<'_>) -> std::fmt::Result {
         match self {
@@ -201,8 +249,91 @@ impl std::fmt::Display for Cond {
     }
 }
 
+/// Section selected by a `.section` directive
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum SectionName {
+    Text,
+    Rodata,
+    Data,
+    Bss,
+}
+
+impl std::fmt::Display for SectionName {
+    fn fmt(&self, f: &mut std::fmt::Formatter<'_>) -> std::fmt::Result {
+        match self {
+            SectionName::Text => write!(f, ".text"),
+            SectionName::Rodata => write!(f, ".rodata"),
+            SectionName::Data => write!(f, ".data"),
+            SectionName::Bss => write!(f, ".bss"),
+        }
+    }
+}
+
+/// Assembler directive
+#[derive(Debug, Clone, PartialEq, Eq)]
+pub enum Directive {
+    Section(SectionName),
+    /// Pad to a multiple of this many bytes
+    Align(u32),
+    Global(Symbol),
+    /// Keep a label out of the other objects of a separate build
+    Local(Symbol),
+    Byte(u8),
+    Word(u16),
+    Long(u32),
+    /// Distance from the second label to the first, as a word (jump tables)
+    WordDiff(Symbol, Symbol),
+    /// This many zero bytes
+    Space(u32),
+    /// String bytes and a terminating zero
+    Asciz(String),
+}
+
+impl Directive {
+    /// Size in bytes of the data this directive emits
+    pub fn size(&self) -> usize {
+        match self {
+            Directive::Byte(_) => 1,
+            Directive::Word(_) | Directive::WordDiff(..) => 2,
+            Directive::Long(_) => 4,
+            Directive::Space(n) => *n as usize,
+            Directive::Asciz(s) => s.len() + 1,
+            Directive::Section(_)
+            | Directive::Align(_)
+            | Directive::Global(_)
+            | Directive::Local(_) => 0,
+        }
+    }
+}
+
+impl std::fmt::Display for Directive {
+    fn fmt(&self, f: &mut std::fmt::Formatter<'_>) -> std::fmt::Result {
+        match self {
+            Directive::Section(s) => write!(f, ".section {s}"),
+            Directive::Align(n) => write!(f, ".align {n}"),
+            Directive::Global(s) => write!(f, ".global {s}"),
+            Directive::Local(s) => write!(f, ".local {s}"),
+            Directive::Byte(v) => write!(f, ".byte 0x{v:02X}"),
+            Directive::Word(v) => write!(f, ".word 0x{v:04X}"),
+            Directive::Long(v) => write!(f, ".long 0x{v:08X}"),
+            Directive::WordDiff(a, b) => write!(f, ".word {a}-{b}"),
+            Directive::Space(n) => write!(f, ".space {n}"),
+            Directive::Asciz(s) => {
+                let escaped = s
+                    .replace('\\', "\\\\")
+                    .replace('"', "\\\"")
+                    .replace('\n', "\\n")
+                    .replace('\r', "\\r")
+                    .replace('\t', "\\t")
+                    .replace('\0', "\\0");
+                write!(f, ".asciz \"{escaped}\"")
+            }
+        }
+    }
+}
+
 /// M68k instruction
-#[derive(Debug, Clone)]
+#[derive(Debug, Clone, PartialEq, Eq)]
 pub enum M68kInst {
     // Data movement
     Move(Size, Operand, Operand),
@@ -258,10 +389,10 @@ pub enum M68kInst {
     Tst(Size, Operand),
 
     // Branch
-    Bra(String),
-    Bsr(String),
-    Bcc(Cond, String),
-    Dbf(DataReg, String), // Decrement and branch if not -1 (loop)
+    Bra(Symbol),
+    Bsr(Symbol),
+    Bcc(Cond, Symbol),
+    Dbf(DataReg, Symbol), // Decrement and branch if not -1 (loop)
 
     // Jump
     Jmp(Operand),
@@ -284,12 +415,121 @@ pub enum M68kInst {
     Swap(DataReg),
 
     // Pseudo-instructions
-    Label(String),
+    Label(Symbol),
     Comment(String),
-    Directive(String),
+    Directive(Directive),
+    /// Fence around a volatile access: the peephole optimizer moves,
+    /// merges and removes no memory access across it
+    Barrier,
+}
+
+impl Operand {
+    /// Registers this operand names, directly or as part of an address
+    pub fn regs(&self) -> RegMask {
+        match self {
+            Operand::DataReg(d) => Reg::Data(*d).mask(),
+            Operand::AddrReg(a)
+            | Operand::AddrInd(a)
+            | Operand::PostInc(a)
+            | Operand::PreDec(a)
+            | Operand::Disp(_, a) => Reg::Addr(*a).mask(),
+            Operand::Indexed(_, a, d) => Reg::Addr(*a).mask() | Reg::Data(*d).mask(),
+            _ => 0,
+        }
+    }
+
+    /// Registers modified as a side effect of addressing (post-increment/pre-decrement)
+    pub fn side_effect_regs(&self) -> RegMask {
+        match self {
+            Operand::PostInc(a) | Operand::PreDec(a) => Reg::Addr(*a).mask(),
+            _ => 0,
+        }
+    }
+
+    /// Registers written when this operand is an instruction's destination
+    fn written_regs(&self) -> RegMask {
+        match self {
+            Operand::DataReg(d) => Reg::Data(*d).mask(),
+            Operand::AddrReg(a) => Reg::Addr(*a).mask(),
+            _ => self.side_effect_regs(),
+        }
+    }
 }
 
 impl M68kInst {
+    /// Registers this instruction may modify (excluding SR)
+    pub fn written_regs(&self) -> RegMask {
+        let sp = Reg::Addr(AddrReg::A7).mask();
+        match self {
+            M68kInst::Move(_, src, dst)
+            | M68kInst::Add(_, src, dst)
+            | M68kInst::Sub(_, src, dst)
+            | M68kInst::And(_, src, dst)
+            | M68kInst::Or(_, src, dst) => src.side_effect_regs() | dst.written_regs(),
+            M68kInst::Cmp(_, src, dst) | M68kInst::Btst(src, dst) => {
+                src.side_effect_regs() | dst.side_effect_regs()
+            }
+            M68kInst::Bset(bit, op) | M68kInst::Bclr(bit, op) | M68kInst::Bchg(bit, op) => {
+                bit.side_effect_regs() | op.written_regs()
+            }
+            M68kInst::Moveq(_, d)
+            | M68kInst::Ext(_, d)
+            | M68kInst::Swap(d)
+            | M68kInst::Dbf(d, _) => Reg::Data(*d).mask(),
+            M68kInst::Muls(src, d)
+            | M68kInst::Mulu(src, d)
+            | M68kInst::Divs(src, d)
+            | M68kInst::Divu(src, d)
+            | M68kInst::Lsl(_, src, d)
+            | M68kInst::Lsr(_, src, d)
+            | M68kInst::Asl(_, src, d)
+            | M68kInst::Asr(_, src, d)
+            | M68kInst::Rol(_, src, d)
+            | M68kInst::Ror(_, src, d) => src.side_effect_regs() | Reg::Data(*d).mask(),
+            M68kInst::Lea(_, a) => Reg::Addr(*a).mask(),
+            M68kInst::Adda(_, src, a) | M68kInst::Suba(_, src, a) => {
+                src.side_effect_regs() | Reg::Addr(*a).mask()
+            }
+            M68kInst::Cmpa(_, src, _) => src.side_effect_regs(),
+            M68kInst::Exg(r1, r2) => r1.mask() | r2.mask(),
+            M68kInst::Clr(_, op)
+            | M68kInst::Addq(_, _, op)
+            | M68kInst::Subq(_, _, op)
+            | M68kInst::Addi(_, _, op)
+            | M68kInst::Subi(_, _, op)
+            | M68kInst::Andi(_, _, op)
+            | M68kInst::Ori(_, _, op)
+            | M68kInst::Eori(_, _, op)
+            | M68kInst::Neg(_, op)
+            | M68kInst::Not(_, op)
+            | M68kInst::Scc(_, op)
+            | M68kInst::Eor(_, _, op) => op.written_regs(),
+            M68kInst::Cmpi(_, _, op) | M68kInst::Tst(_, op) => op.side_effect_regs(),
+            M68kInst::Movem(_, regs, op, to_mem) => {
+                let loaded = if *to_mem {
+                    0
+                } else {
+                    regs.iter().fold(0, |m, r| m | r.mask())
+                };
+                loaded | op.side_effect_regs()
+            }
+            M68kInst::Link(a, _) | M68kInst::Unlk(a) => Reg::Addr(*a).mask() | sp,
+            M68kInst::Pea(_)
+            | M68kInst::Jsr(_)
+            | M68kInst::Bsr(_)
+            | M68kInst::Rts
+            | M68kInst::Rte => sp,
+            M68kInst::Bra(_)
+            | M68kInst::Bcc(_, _)
+            | M68kInst::Jmp(_)
+            | M68kInst::Nop
+            | M68kInst::Label(_)
+            | M68kInst::Comment(_)
+            | M68kInst::Directive(_)
+            | M68kInst::Barrier => 0,
+        }
+    }
+
     pub fn format(&self) -> String {
         match self {
             M68kInst::Move(s, src, dst) => format!("    move.{s}  {src}, {dst}"),
@@ -369,6 +609,7 @@ impl M68kInst {
             M68kInst::Label(l) => format!("{l}:"),
             M68kInst::Comment(c) => format!("    ; {c}"),
             M68kInst::Directive(d) => format!("    {d}"),
+            M68kInst::Barrier => "    ; volatile".to_string(),
         }
     }
 }
@@ -4,21 +4,34 @@
 //! targeting the Sega Megadrive/Genesis console.
 
 mod assembler;
+mod callconv;
+mod cycles;
 mod emit;
 mod encoder;
+mod link;
 mod m68k;
+mod object;
+pub mod peephole;
+mod regalloc;
 pub mod sdk;
+mod strength;
 mod symfile;
 
 pub use assembler::Assembler;
+pub use cycles::{cycle_report, instruction_cycles};
 pub use emit::CodeGenerator;
 pub use encoder::{EncodeError, InstructionEncoder};
+pub use link::{LinkError, LinkedImage, link};
 pub use m68k::*;
+pub use object::{
+    ObjectError, ObjectFile, ObjectSection, ObjectSymbol, Relocation, RelocationKind,
+};
+pub use peephole::Peephole;
 pub use sdk::{SdkFunction, SdkFunctionKind, SdkRegistry};
 pub use symfile::generate_sym_file;
 
 use crate::backend::{Backend, BackendConfig, BackendOutput, OutputFormat};
-use crate::common::CompileResult;
+use crate::common::{CompileError, CompileResult, stats};
 use crate::ir::IrModule;
 
 /// M68k assembly backend
@@ -28,6 +41,25 @@ impl M68kBackend {
     pub fn new() -> Self {
         Self
     }
+
+    /// Compile a module to a relocatable object, for linking with others
+    /// by `RomBackend::link`
+    pub fn compile_object(module: &IrModule, config: &BackendConfig) -> CompileResult<ObjectFile> {
+        let mut codegen = CodeGenerator::new();
+        codegen.set_optimize_level(config.optimize_level);
+        if config.debug_info {
+            if let Some(di) = &module.debug_info {
+                codegen.set_debug_info(di.filename.clone(), di.source.clone());
+            }
+        }
+        let instructions = stats::time("codegen", || codegen.generate_object_instructions(module))?;
+        let mut object = stats::time("assemble", || {
+            Assembler::new(0).assemble_object(&instructions)
+        })
+        .map_err(|e| CompileError::backend(format!("assembly error: {e}")))?;
+        object.sdk_functions = codegen.sdk_functions();
+        Ok(object)
+    }
 }
 
 impl Default for M68kBackend {
@@ -46,7 +78,7 @@ impl Backend for M68kBackend {
     }
 
     fn supported_formats(&self) -> &'static [OutputFormat] {
-        &[OutputFormat::Assembly]
+        &[OutputFormat::Assembly, OutputFormat::Object]
     }
 
     fn generate(
@@ -55,18 +87,33 @@ impl Backend for M68kBackend {
         _ctx: &crate::frontend::CompileContext,
         config: &BackendConfig,
     ) -> CompileResult<BackendOutput> {
+        if config.output_format == OutputFormat::Object {
+            if config.verbose {
+                eprintln!("Generating M68k object...");
+            }
+            return Ok(BackendOutput::binary(
+                Self::compile_object(module, config)?.to_bytes(),
+            ));
+        }
+
         if config.verbose {
             eprintln!("Generating M68k assembly...");
         }
 
         let mut codegen = CodeGenerator::new();
+        codegen.set_optimize_level(config.optimize_level);
+        codegen.set_startup(config.startup);
         if config.debug_info {
             if let Some(di) = &module.debug_info {
                 codegen.set_debug_info(di.filename.clone(), di.source.clone());
             }
         }
-        let asm = codegen.generate(module)?;
+        let instructions = stats::time("codegen", || codegen.generate_instructions(module))?;
+        let report = config.cycle_report.then(|| cycle_report(&instructions));
 
-        Ok(BackendOutput::text(asm))
+        let text = stats::time("format", || CodeGenerator::format(&instructions));
+        let mut output = BackendOutput::text(text);
+        output.cycle_report = report;
+        Ok(output)
     }
 }
@@ -0,0 +1,284 @@
+//! Relocatable object files for separate compilation
+//!
+//! An object holds one translation unit assembled at address 0: its code
+//! and read-only data (`text`), the ROM image of its initialized RAM data
+//! (`data`) and the size of its zeroed RAM (`bss`). Every absolute label
+//! reference, and every branch to a label outside the object, is left as a
+//! relocation for the linker. Labels starting with `.`, and those of C
+//! `static` functions and variables, are local to the object; all others
+//! are visible to the other objects.
+//!
+//! The file format is big-endian: the magic `SMDO` and a version word, the
+//! three sections, then the symbol, relocation and SDK routine tables.
+
+/// Object file magic
+const MAGIC: &[u8; 4] = b"SMDO";
+
+/// Object file format version
+const VERSION: u16 = 1;
+
+/// Section of an object
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum ObjectSection {
+    /// Code and read-only data, placed in ROM
+    Text,
+    /// Initialized data: addressed in RAM, image in ROM
+    Data,
+    /// Zeroed data, addressed in RAM only
+    Bss,
+}
+
+impl ObjectSection {
+    fn tag(self) -> u8 {
+        match self {
+            ObjectSection::Text => 0,
+            ObjectSection::Data => 1,
+            ObjectSection::Bss => 2,
+        }
+    }
+
+    fn from_tag(tag: u8) -> Option<Self> {
+        match tag {
+            0 => Some(ObjectSection::Text),
+            1 => Some(ObjectSection::Data),
+            2 => Some(ObjectSection::Bss),
+            _ => None,
+        }
+    }
+}
+
+/// A label an object defines
+#[derive(Debug, Clone, PartialEq, Eq)]
+pub struct ObjectSymbol {
+    pub name: String,
+    pub section: ObjectSection,
+    /// Offset from the start of the section
+    pub offset: u32,
+    /// Visible to other objects
+    pub global: bool,
+}
+
+/// How a relocation is patched
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum RelocationKind {
+    /// 32-bit absolute address
+    Absolute32,
+    /// 16-bit displacement from the relocated word
+    Relative16,
+}
+
+/// A reference in `text` to be patched with a symbol's final address
+#[derive(Debug, Clone, PartialEq, Eq)]
+pub struct Relocation {
+    /// Offset of the patched field from the start of `text`
+    pub offset: u32,
+    pub symbol: String,
+    pub kind: RelocationKind,
+}
+
+/// Malformed object file
+#[derive(Debug, Clone)]
+pub struct ObjectError(pub String);
+
+impl std::fmt::Display for ObjectError {
+    fn fmt(&self, f: &mut std::fmt::Formatter<'_>) -> std::fmt::Result {
+        write!(f, "malformed object: {}", self.0)
+    }
+}
+
+impl std::error::Error for ObjectError {}
+
+/// A relocatable object
+#[derive(Debug, Clone, Default, PartialEq, Eq)]
+pub struct ObjectFile {
+    pub text: Vec<u8>,
+    pub data: Vec<u8>,
+    pub bss_size: u32,
+    pub symbols: Vec<ObjectSymbol>,
+    pub relocations: Vec<Relocation>,
+    /// SDK library routines the object calls, which the linker adds once
+    pub sdk_functions: Vec<String>,
+}
+
+impl ObjectFile {
+    /// Serialize to the on-disk format
+    pub fn to_bytes(&self) -> Vec<u8> {
+        let mut out = Vec::with_capacity(self.text.len() + self.data.len() + 64);
+        out.extend_from_slice(MAGIC);
+        out.extend_from_slice(&VERSION.to_be_bytes());
+        put_bytes(&mut out, &self.text);
+        put_bytes(&mut out, &self.data);
+        out.extend_from_slice(&self.bss_size.to_be_bytes());
+
+        out.extend_from_slice(&(self.symbols.len() as u32).to_be_bytes());
+        for sym in &self.symbols {
+            out.push(sym.section.tag());
+            out.push(u8::from(sym.global));
+            out.extend_from_slice(&sym.offset.to_be_bytes());
+            put_bytes(&mut out, sym.name.as_bytes());
+        }
+
+        out.extend_from_slice(&(self.relocations.len() as u32).to_be_bytes());
+        for reloc in &self.relocations {
+            out.push(match reloc.kind {
+                RelocationKind::Absolute32 => 0,
+                RelocationKind::Relative16 => 1,
+            });
+            out.extend_from_slice(&reloc.offset.to_be_bytes());
+            put_bytes(&mut out, reloc.symbol.as_bytes());
+        }
+
+        out.extend_from_slice(&(self.sdk_functions.len() as u32).to_be_bytes());
+        for name in &self.sdk_functions {
+            put_bytes(&mut out, name.as_bytes());
+        }
+        out
+    }
+
+    /// Parse the on-disk format
+    pub fn from_bytes(bytes: &[u8]) -> Result<Self, ObjectError> {
+        let mut r = Reader { bytes, pos: 0 };
+        if r.take(4)? != MAGIC {
+            return Err(ObjectError("not an smdc object".to_string()));
+        }
+        let version = r.u16()?;
+        if version != VERSION {
+            return Err(ObjectError(format!("unsupported version {version}")));
+        }
+        let text = r.bytes()?.to_vec();
+        let data = r.bytes()?.to_vec();
+        let bss_size = r.u32()?;
+
+        let mut symbols = Vec::new();
+        for _ in 0..r.u32()? {
+            let section = ObjectSection::from_tag(r.u8()?)
+                .ok_or_else(|| ObjectError("bad section".to_string()))?;
+            let global = r.u8()? != 0;
+            let offset = r.u32()?;
+            let name = r.string()?;
+            symbols.push(ObjectSymbol {
+                name,
+                section,
+                offset,
+                global,
+            });
+        }
+
+        let mut relocations = Vec::new();
+        for _ in 0..r.u32()? {
+            let kind = match r.u8()? {
+                0 => RelocationKind::Absolute32,
+                1 => RelocationKind::Relative16,
+                _ => return Err(ObjectError("bad relocation kind".to_string())),
+            };
+            let offset = r.u32()?;
+            let symbol = r.string()?;
+            relocations.push(Relocation {
+                offset,
+                symbol,
+                kind,
+            });
+        }
+
+        let mut sdk_functions = Vec::new();
+        for _ in 0..r.u32()? {
+            sdk_functions.push(r.string()?);
+        }
+
+        Ok(Self {
+            text,
+            data,
+            bss_size,
+            symbols,
+            relocations,
+            sdk_functions,
+        })
+    }
+}
+
+/// Append a length-prefixed byte string
+fn put_bytes(out: &mut Vec<u8>, bytes: &[u8]) {
+    out.extend_from_slice(&(bytes.len() as u32).to_be_bytes());
+    out.extend_from_slice(bytes);
+}
+
+/// Cursor over a serialized object
+struct Reader<'a> {
+    bytes: &'a [u8],
+    pos: usize,
+}
+
+impl<'a> Reader<'a> {
+    fn take(&mut self, n: usize) -> Result<&'a [u8], ObjectError> {
+        let end = self
+            .pos
+            .checked_add(n)
+            .filter(|&end| end <= self.bytes.len())
+            .ok_or_else(|| ObjectError("truncated".to_string()))?;
+        let slice = &self.bytes[self.pos..end];
+        self.pos = end;
+        Ok(slice)
+    }
+
+    fn u8(&mut self) -> Result<u8, ObjectError> {
+        Ok(self.take(1)?[0])
+    }
+
+    fn u16(&mut self) -> Result<u16, ObjectError> {
+        let b = self.take(2)?;
+        Ok(u16::from_be_bytes([b[0], b[1]]))
+    }
+
+    fn u32(&mut self) -> Result<u32, ObjectError> {
+        let b = self.take(4)?;
+        Ok(u32::from_be_bytes([b[0], b[1], b[2], b[3]]))
+    }
+
+    fn bytes(&mut self) -> Result<&'a [u8], ObjectError> {
+        let len = self.u32()? as usize;
+        self.take(len)
+    }
+
+    fn string(&mut self) -> Result<String, ObjectError> {
+        String::from_utf8(self.bytes()?.to_vec())
+            .map_err(|_| ObjectError("symbol name is not UTF-8".to_string()))
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_object_round_trip() {
+        let object = ObjectFile {
+            text: vec![0x4E, 0xB9, 0, 0, 0, 0, 0x4E, 0x75],
+            data: vec![0, 0, 0, 7],
+            bss_size: 16,
+            symbols: vec![
+                ObjectSymbol {
+                    name: "main".to_string(),
+                    section: ObjectSection::Text,
+                    offset: 0,
+                    global: true,
+                },
+                ObjectSymbol {
+                    name: ".Lstr0".to_string(),
+                    section: ObjectSection::Data,
+                    offset: 0,
+                    global: false,
+                },
+            ],
+            relocations: vec![Relocation {
+                offset: 2,
+                symbol: "update".to_string(),
+                kind: RelocationKind::Absolute32,
+            }],
+            sdk_functions: vec!["vdp_init".to_string()],
+        };
+        let bytes = object.to_bytes();
+        assert_eq!(ObjectFile::from_bytes(&bytes).unwrap(), object);
+        assert!(ObjectFile::from_bytes(&bytes[..bytes.len() - 1]).is_err());
+        assert!(ObjectFile::from_bytes(b"\x7FELF").is_err());
+    }
+}
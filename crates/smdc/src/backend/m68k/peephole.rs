@@ -0,0 +1,1229 @@
+//! Peephole optimizer over generated 68000 code
+//!
+//! The code generator lowers one IR instruction at a time, which leaves
+//! redundant sequences at the seams: a spilled temp stored and reloaded,
+//! constants routed through a scratch register, a `tst` of a value whose
+//! flags the previous instruction already set, or an address built with
+//! `lea` only to be dereferenced once. `Peephole` rewrites these short
+//! windows of a function's code in place.
+//!
+//! Each rewrite is checked against register liveness and the condition
+//! codes, so a window is only changed when no later instruction can observe
+//! the difference. Windows never span a label, nor the `Barrier` fences
+//! around a volatile access, so such accesses are never forwarded, folded
+//! or removed.
+
+use super::callconv::ARG_REGS;
+use super::m68k::*;
+use crate::common::Symbol;
+use std::collections::HashMap;
+
+/// Every register
+const ALL_REGS: RegMask = 0xFFFF;
+
+/// Registers a caller may still read after `rts`: all but the scratch
+/// registers D1, A0 and A1
+const RETURN_LIVE: RegMask = ALL_REGS & !(1 << 1) & !(1 << 8) & !(1 << 9);
+
+/// How far a lookahead for the next flag-setting instruction may go
+const FLAG_SCAN_LIMIT: usize = 32;
+
+/// Instructions to step back after a rewrite, so windows it enabled are seen
+const LOOKBEHIND: usize = 3;
+
+/// A family of rewrites the peephole optimizer can apply
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum Rule {
+    /// `move.l #n,dN` to `moveq`, small `add`/`sub` immediates to
+    /// `addq`/`subq`, and constants loaded into a scratch register folded
+    /// into the instruction that reads it
+    QuickImmediates,
+    /// Reload of a value just stored to a stack slot or global
+    ForwardStores,
+    /// Register copy read once and then dead
+    ForwardCopies,
+    /// `lea` whose result is only used once, as an address
+    FoldAddresses,
+    /// `tst` of a register whose flags are already set
+    RedundantTests,
+    /// `scc`/`and.l #1` boolean feeding a conditional branch
+    FuseCompares,
+}
+
+impl Rule {
+    pub fn name(self) -> &'static str {
+        match self {
+            Rule::QuickImmediates => "quick-immediates",
+            Rule::ForwardStores => "forward-stores",
+            Rule::ForwardCopies => "forward-copies",
+            Rule::FoldAddresses => "fold-addresses",
+            Rule::RedundantTests => "redundant-tests",
+            Rule::FuseCompares => "fuse-compares",
+        }
+    }
+}
+
+/// Ordered set of peephole rules applied to generated functions
+pub struct Peephole {
+    rules: Vec<Rule>,
+}
+
+impl Peephole {
+    pub fn new() -> Self {
+        Self { rules: Vec::new() }
+    }
+
+    /// The standard rule set for `-O<level>`: none at `-O0`, all of them above
+    pub fn for_level(level: u8) -> Self {
+        let mut peephole = Self::new();
+        if level > 0 {
+            for rule in [
+                Rule::QuickImmediates,
+                Rule::ForwardStores,
+                Rule::ForwardCopies,
+                Rule::FoldAddresses,
+                Rule::RedundantTests,
+                Rule::FuseCompares,
+            ] {
+                peephole.add(rule);
+            }
+        }
+        peephole
+    }
+
+    pub fn add(&mut self, rule: Rule) {
+        self.rules.push(rule);
+    }
+
+    pub fn is_empty(&self) -> bool {
+        self.rules.is_empty()
+    }
+
+    /// Names of the enabled rules, in order
+    pub fn rule_names(&self) -> Vec<&'static str> {
+        self.rules.iter().map(|r| r.name()).collect()
+    }
+
+    /// Rewrite the code of one function, returning true if anything changed.
+    ///
+    /// Control leaving `code` through a jump or `rte` is assumed to read
+    /// every register, and `rts` every register but the scratch ones.
+    pub fn run(&self, code: &mut Vec<M68kInst>) -> bool {
+        if self.rules.is_empty() {
+            return false;
+        }
+        let mut changed = false;
+        let mut flow = Flow::new(code);
+        let mut i = 0;
+        while i < code.len() {
+            let Some(rewrite) = self
+                .rules
+                .iter()
+                .find_map(|&rule| flow.rewrite(rule, code, i))
+            else {
+                i += 1;
+                continue;
+            };
+            rewrite.apply(code);
+            changed = true;
+            flow = Flow::new(code);
+            i = back(code, rewrite.start, LOOKBEHIND);
+        }
+        changed
+    }
+}
+
+impl Default for Peephole {
+    fn default() -> Self {
+        Self::new()
+    }
+}
+
+/// Replace `code[start..=end]` with `with`, keeping any comments in between
+struct Rewrite {
+    start: usize,
+    end: usize,
+    with: Vec<M68kInst>,
+}
+
+impl Rewrite {
+    fn new(start: usize, end: usize, with: Vec<M68kInst>) -> Self {
+        Self { start, end, with }
+    }
+
+    fn apply(&self, code: &mut Vec<M68kInst>) {
+        let mut with: Vec<M68kInst> = code[self.start..=self.end]
+            .iter()
+            .filter(|inst| matches!(inst, M68kInst::Comment(_)))
+            .cloned()
+            .collect();
+        with.extend(self.with.iter().cloned());
+        code.splice(self.start..=self.end, with);
+    }
+}
+
+/// The instruction after `i`, skipping comments
+fn next(code: &[M68kInst], i: usize) -> Option<usize> {
+    (i + 1..code.len()).find(|&j| !matches!(code[j], M68kInst::Comment(_)))
+}
+
+/// Index `n` non-comment instructions before `i`
+fn back(code: &[M68kInst], i: usize, n: usize) -> usize {
+    let mut i = i.min(code.len());
+    for _ in 0..n {
+        match (0..i)
+            .rev()
+            .find(|&j| !matches!(code[j], M68kInst::Comment(_)))
+        {
+            Some(j) => i = j,
+            None => return 0,
+        }
+    }
+    i
+}
+
+/// Where control goes after an instruction
+enum Succ {
+    Next,
+    Jump(Symbol),
+    Branch(Symbol),
+    /// Leaves the function: `rts`, `rte` or an indirect jump
+    Exit,
+}
+
+fn successors(inst: &M68kInst) -> Succ {
+    match inst {
+        M68kInst::Bra(label) | M68kInst::Bcc(Cond::True, label) => Succ::Jump(*label),
+        M68kInst::Bcc(Cond::False, _) => Succ::Next,
+        M68kInst::Bcc(_, label) | M68kInst::Dbf(_, label) => Succ::Branch(*label),
+        M68kInst::Jmp(_) | M68kInst::Rts | M68kInst::Rte => Succ::Exit,
+        _ => Succ::Next,
+    }
+}
+
+/// Effect of an instruction on the N, Z, V and C flags
+#[derive(PartialEq, Eq)]
+enum Flags {
+    /// Depends on their current value
+    Read,
+    /// Overwrites all four without reading them
+    Set,
+    /// Leaves them (or some of them) alone
+    Keep,
+}
+
+fn flag_effect(inst: &M68kInst) -> Flags {
+    let to_areg = |op: &Operand| matches!(op, Operand::AddrReg(_));
+    match inst {
+        _ if operands(inst).contains(&&Operand::Sr) => Flags::Read,
+        M68kInst::Bcc(Cond::True | Cond::False, _) => Flags::Keep,
+        M68kInst::Bcc(_, _) | M68kInst::Scc(_, _) => Flags::Read,
+        M68kInst::Move(_, _, dst)
+        | M68kInst::Add(_, _, dst)
+        | M68kInst::Sub(_, _, dst)
+        | M68kInst::And(_, _, dst)
+        | M68kInst::Or(_, _, dst)
+        | M68kInst::Addq(_, _, dst)
+        | M68kInst::Subq(_, _, dst) => {
+            if to_areg(dst) {
+                Flags::Keep
+            } else {
+                Flags::Set
+            }
+        }
+        M68kInst::Moveq(_, _)
+        | M68kInst::Eor(_, _, _)
+        | M68kInst::Addi(_, _, _)
+        | M68kInst::Subi(_, _, _)
+        | M68kInst::Andi(_, _, _)
+        | M68kInst::Ori(_, _, _)
+        | M68kInst::Eori(_, _, _)
+        | M68kInst::Cmp(_, _, _)
+        | M68kInst::Cmpa(_, _, _)
+        | M68kInst::Cmpi(_, _, _)
+        | M68kInst::Tst(_, _)
+        | M68kInst::Neg(_, _)
+        | M68kInst::Not(_, _)
+        | M68kInst::Clr(_, _)
+        | M68kInst::Ext(_, _)
+        | M68kInst::Swap(_)
+        | M68kInst::Muls(_, _)
+        | M68kInst::Mulu(_, _)
+        | M68kInst::Divs(_, _)
+        | M68kInst::Divu(_, _)
+        | M68kInst::Lsl(_, _, _)
+        | M68kInst::Lsr(_, _, _)
+        | M68kInst::Asl(_, _, _)
+        | M68kInst::Asr(_, _, _)
+        | M68kInst::Rol(_, _, _)
+        | M68kInst::Ror(_, _, _) => Flags::Set,
+        // Nothing relies on the flags a subroutine returns with
+        M68kInst::Jsr(_) | M68kInst::Bsr(_) => Flags::Set,
+        _ => Flags::Keep,
+    }
+}
+
+/// The memory operands of an instruction, in order
+fn operands(inst: &M68kInst) -> Vec<&Operand> {
+    match inst {
+        M68kInst::Move(_, a, b)
+        | M68kInst::Add(_, a, b)
+        | M68kInst::Sub(_, a, b)
+        | M68kInst::And(_, a, b)
+        | M68kInst::Or(_, a, b)
+        | M68kInst::Cmp(_, a, b)
+        | M68kInst::Btst(a, b)
+        | M68kInst::Bset(a, b)
+        | M68kInst::Bclr(a, b)
+        | M68kInst::Bchg(a, b) => vec![a, b],
+        M68kInst::Lea(op, _)
+        | M68kInst::Pea(op)
+        | M68kInst::Clr(_, op)
+        | M68kInst::Adda(_, op, _)
+        | M68kInst::Suba(_, op, _)
+        | M68kInst::Cmpa(_, op, _)
+        | M68kInst::Addq(_, _, op)
+        | M68kInst::Subq(_, _, op)
+        | M68kInst::Addi(_, _, op)
+        | M68kInst::Subi(_, _, op)
+        | M68kInst::Andi(_, _, op)
+        | M68kInst::Ori(_, _, op)
+        | M68kInst::Eori(_, _, op)
+        | M68kInst::Cmpi(_, _, op)
+        | M68kInst::Muls(op, _)
+        | M68kInst::Mulu(op, _)
+        | M68kInst::Divs(op, _)
+        | M68kInst::Divu(op, _)
+        | M68kInst::Neg(_, op)
+        | M68kInst::Not(_, op)
+        | M68kInst::Tst(_, op)
+        | M68kInst::Eor(_, _, op)
+        | M68kInst::Lsl(_, op, _)
+        | M68kInst::Lsr(_, op, _)
+        | M68kInst::Asl(_, op, _)
+        | M68kInst::Asr(_, op, _)
+        | M68kInst::Rol(_, op, _)
+        | M68kInst::Ror(_, op, _)
+        | M68kInst::Jmp(op)
+        | M68kInst::Jsr(op)
+        | M68kInst::Movem(_, _, op, _)
+        | M68kInst::Scc(_, op) => vec![op],
+        _ => Vec::new(),
+    }
+}
+
+pub(super) fn operands_mut(inst: &mut M68kInst) -> Vec<&mut Operand> {
+    match inst {
+        M68kInst::Move(_, a, b)
+        | M68kInst::Add(_, a, b)
+        | M68kInst::Sub(_, a, b)
+        | M68kInst::And(_, a, b)
+        | M68kInst::Or(_, a, b)
+        | M68kInst::Cmp(_, a, b)
+        | M68kInst::Btst(a, b)
+        | M68kInst::Bset(a, b)
+        | M68kInst::Bclr(a, b)
+        | M68kInst::Bchg(a, b) => vec![a, b],
+        M68kInst::Lea(op, _)
+        | M68kInst::Pea(op)
+        | M68kInst::Clr(_, op)
+        | M68kInst::Adda(_, op, _)
+        | M68kInst::Suba(_, op, _)
+        | M68kInst::Cmpa(_, op, _)
+        | M68kInst::Addq(_, _, op)
+        | M68kInst::Subq(_, _, op)
+        | M68kInst::Addi(_, _, op)
+        | M68kInst::Subi(_, _, op)
+        | M68kInst::Andi(_, _, op)
+        | M68kInst::Ori(_, _, op)
+        | M68kInst::Eori(_, _, op)
+        | M68kInst::Cmpi(_, _, op)
+        | M68kInst::Muls(op, _)
+        | M68kInst::Mulu(op, _)
+        | M68kInst::Divs(op, _)
+        | M68kInst::Divu(op, _)
+        | M68kInst::Neg(_, op)
+        | M68kInst::Not(_, op)
+        | M68kInst::Tst(_, op)
+        | M68kInst::Eor(_, _, op)
+        | M68kInst::Lsl(_, op, _)
+        | M68kInst::Lsr(_, op, _)
+        | M68kInst::Asl(_, op, _)
+        | M68kInst::Asr(_, op, _)
+        | M68kInst::Rol(_, op, _)
+        | M68kInst::Ror(_, op, _)
+        | M68kInst::Jmp(op)
+        | M68kInst::Jsr(op)
+        | M68kInst::Movem(_, _, op, _)
+        | M68kInst::Scc(_, op) => vec![op],
+        _ => Vec::new(),
+    }
+}
+
+/// Registers an instruction names outside its operands
+fn fixed_regs(inst: &M68kInst) -> RegMask {
+    let d = |d: &DataReg| Reg::Data(*d).mask();
+    let a = |a: &AddrReg| Reg::Addr(*a).mask();
+    match inst {
+        M68kInst::Moveq(_, r)
+        | M68kInst::Ext(_, r)
+        | M68kInst::Swap(r)
+        | M68kInst::Dbf(r, _)
+        | M68kInst::Eor(_, r, _)
+        | M68kInst::Muls(_, r)
+        | M68kInst::Mulu(_, r)
+        | M68kInst::Divs(_, r)
+        | M68kInst::Divu(_, r)
+        | M68kInst::Lsl(_, _, r)
+        | M68kInst::Lsr(_, _, r)
+        | M68kInst::Asl(_, _, r)
+        | M68kInst::Asr(_, _, r)
+        | M68kInst::Rol(_, _, r)
+        | M68kInst::Ror(_, _, r) => d(r),
+        M68kInst::Lea(_, r)
+        | M68kInst::Adda(_, _, r)
+        | M68kInst::Suba(_, _, r)
+        | M68kInst::Cmpa(_, _, r)
+        | M68kInst::Link(r, _)
+        | M68kInst::Unlk(r) => a(r),
+        M68kInst::Exg(r1, r2) => r1.mask() | r2.mask(),
+        M68kInst::Movem(_, regs, _, _) => regs.iter().fold(0, |m, r| m | r.mask()),
+        _ => 0,
+    }
+}
+
+/// Registers an instruction overwrites completely, without reading them
+fn kills(inst: &M68kInst) -> RegMask {
+    match inst {
+        M68kInst::Move(Size::Long, _, Operand::DataReg(d))
+        | M68kInst::Moveq(_, d)
+        | M68kInst::Clr(Size::Long, Operand::DataReg(d)) => Reg::Data(*d).mask(),
+        // MOVEA sign-extends word sources to the whole register
+        M68kInst::Move(_, _, Operand::AddrReg(a)) | M68kInst::Lea(_, a) => Reg::Addr(*a).mask(),
+        M68kInst::Movem(_, regs, _, false) => regs.iter().fold(0, |m, r| m | r.mask()),
+        _ => 0,
+    }
+}
+
+/// Registers an instruction reads
+fn reads(inst: &M68kInst) -> RegMask {
+    let sp = Reg::Addr(AddrReg::A7).mask();
+    let mentioned = operands(inst).iter().fold(0, |m, op| m | op.regs()) | fixed_regs(inst);
+    let implicit = match inst {
+        // Calls may take their first arguments in registers
+        M68kInst::Jsr(_) | M68kInst::Bsr(_) => ARG_REGS.iter().fold(sp, |m, r| m | r.mask()),
+        M68kInst::Pea(_) | M68kInst::Link(_, _) | M68kInst::Rts | M68kInst::Rte => sp,
+        _ => 0,
+    };
+    (mentioned & !kills(inst)) | implicit | address_regs(inst)
+}
+
+/// Registers used to address memory operands (never killed by the access)
+fn address_regs(inst: &M68kInst) -> RegMask {
+    operands(inst)
+        .iter()
+        .filter(|op| !matches!(op, Operand::DataReg(_) | Operand::AddrReg(_)))
+        .fold(0, |m, op| m | op.regs())
+}
+
+/// Operand that is a register, as a `Reg`
+fn as_reg(op: &Operand) -> Option<Reg> {
+    match op {
+        Operand::DataReg(d) => Some(Reg::Data(*d)),
+        Operand::AddrReg(a) => Some(Reg::Addr(*a)),
+        _ => None,
+    }
+}
+
+/// Memory only the compiler accesses: frame slots and named globals.
+/// Hardware registers are never reached this way, and volatile objects sit
+/// behind a `Barrier`, so a value stored here reads back unchanged.
+fn is_plain_memory(op: &Operand) -> bool {
+    matches!(op, Operand::Disp(_, AddrReg::A6) | Operand::Label(_))
+}
+
+/// Effective address produced by LEA that can replace `(An)` directly
+fn is_foldable_address(op: &Operand) -> bool {
+    matches!(
+        op,
+        Operand::AddrInd(_)
+            | Operand::Disp(_, _)
+            | Operand::Indexed(_, _, _)
+            | Operand::AbsShort(_)
+            | Operand::AbsLong(_)
+            | Operand::Label(_)
+    )
+}
+
+/// `add`/`sub` of `n` as ADDQ/SUBQ, if `n` is in range. A negative `n`
+/// swaps the operation, which changes the carry and overflow flags.
+fn quick_add(size: Size, n: i32, dst: &Operand, add: bool) -> Option<(M68kInst, bool)> {
+    if size == Size::Byte && matches!(dst, Operand::AddrReg(_)) {
+        return None;
+    }
+    let (add, q, swapped) = if n < 0 {
+        (!add, n.checked_neg()?, true)
+    } else {
+        (add, n, false)
+    };
+    let q = u8::try_from(q).ok().filter(|q| (1..=8).contains(q))?;
+    let inst = if add {
+        M68kInst::Addq(size, q, dst.clone())
+    } else {
+        M68kInst::Subq(size, q, dst.clone())
+    };
+    Some((inst, swapped))
+}
+
+/// Control flow facts for one function's code
+struct Flow {
+    /// Label positions; `None` for labels defined more than once
+    labels: HashMap<Symbol, Option<usize>>,
+    /// Registers live after each instruction
+    live_out: Vec<RegMask>,
+}
+
+impl Flow {
+    fn new(code: &[M68kInst]) -> Self {
+        let mut labels = HashMap::new();
+        for (i, inst) in code.iter().enumerate() {
+            if let M68kInst::Label(name) = inst {
+                labels
+                    .entry(*name)
+                    .and_modify(|pos| *pos = None)
+                    .or_insert(Some(i));
+            }
+        }
+        let mut flow = Self {
+            labels,
+            live_out: vec![0; code.len()],
+        };
+        flow.compute_liveness(code);
+        flow
+    }
+
+    fn target(&self, label: Symbol) -> Option<usize> {
+        self.labels.get(&label).copied().flatten()
+    }
+
+    fn compute_liveness(&mut self, code: &[M68kInst]) {
+        let mut live_in = vec![0; code.len()];
+        let at = |live_in: &[RegMask], i: Option<usize>| {
+            i.and_then(|i| live_in.get(i).copied()).unwrap_or(ALL_REGS)
+        };
+        loop {
+            let mut changed = false;
+            for i in (0..code.len()).rev() {
+                let out = match successors(&code[i]) {
+                    Succ::Next => at(&live_in, Some(i + 1)),
+                    Succ::Jump(label) => at(&live_in, self.target(label)),
+                    Succ::Branch(label) => {
+                        at(&live_in, Some(i + 1)) | at(&live_in, self.target(label))
+                    }
+                    Succ::Exit if matches!(code[i], M68kInst::Rts) => RETURN_LIVE,
+                    Succ::Exit => ALL_REGS,
+                };
+                let inp = reads(&code[i]) | (out & !kills(&code[i]));
+                if out != self.live_out[i] || inp != live_in[i] {
+                    self.live_out[i] = out;
+                    live_in[i] = inp;
+                    changed = true;
+                }
+            }
+            if !changed {
+                break;
+            }
+        }
+    }
+
+    fn dead_after(&self, i: usize, reg: Reg) -> bool {
+        self.live_out[i] & reg.mask() == 0
+    }
+
+    /// Whether the flags left by `code[i]` are overwritten before being read
+    fn flags_dead_after(&self, code: &[M68kInst], i: usize) -> bool {
+        match successors(&code[i]) {
+            Succ::Next => self.flags_dead_from(code, i + 1),
+            Succ::Jump(label) => self
+                .target(label)
+                .is_some_and(|t| self.flags_dead_from(code, t)),
+            Succ::Branch(label) => {
+                self.flags_dead_from(code, i + 1)
+                    && self
+                        .target(label)
+                        .is_some_and(|t| self.flags_dead_from(code, t))
+            }
+            Succ::Exit => matches!(code[i], M68kInst::Rts),
+        }
+    }
+
+    fn flags_dead_from(&self, code: &[M68kInst], mut pc: usize) -> bool {
+        for _ in 0..FLAG_SCAN_LIMIT {
+            let Some(inst) = code.get(pc) else {
+                return false;
+            };
+            match flag_effect(inst) {
+                Flags::Read => return false,
+                Flags::Set => return true,
+                Flags::Keep => {}
+            }
+            match successors(inst) {
+                Succ::Next => pc += 1,
+                Succ::Jump(label) => match self.target(label) {
+                    Some(t) => pc = t,
+                    None => return false,
+                },
+                Succ::Branch(_) => return false,
+                Succ::Exit => return matches!(inst, M68kInst::Rts),
+            }
+        }
+        false
+    }
+
+    fn rewrite(&self, rule: Rule, code: &[M68kInst], i: usize) -> Option<Rewrite> {
+        match rule {
+            Rule::QuickImmediates => self.quick_immediates(code, i),
+            Rule::ForwardStores => self.forward_stores(code, i),
+            Rule::ForwardCopies => self.forward_copies(code, i),
+            Rule::FoldAddresses => self.fold_addresses(code, i),
+            Rule::RedundantTests => self.redundant_tests(code, i),
+            Rule::FuseCompares => self.fuse_compares(code, i),
+        }
+    }
+
+    fn quick_immediates(&self, code: &[M68kInst], i: usize) -> Option<Rewrite> {
+        let single = |inst| Some(Rewrite::new(i, i, vec![inst]));
+        let quick = |size, n, dst: &Operand, add| {
+            let (inst, swapped) = quick_add(size, n, dst, add)?;
+            (!swapped || self.flags_dead_after(code, i)).then(|| Rewrite::new(i, i, vec![inst]))
+        };
+        match &code[i] {
+            M68kInst::Move(Size::Long, Operand::Imm(n), Operand::DataReg(d))
+                if i8::try_from(*n).is_ok() =>
+            {
+                return single(M68kInst::Moveq(*n as i8, *d));
+            }
+            M68kInst::Add(size, Operand::Imm(n), dst) | M68kInst::Addi(size, n, dst) => {
+                return quick(*size, *n, dst, true);
+            }
+            M68kInst::Sub(size, Operand::Imm(n), dst) | M68kInst::Subi(size, n, dst) => {
+                return quick(*size, *n, dst, false);
+            }
+            M68kInst::Adda(size, Operand::Imm(n), a) => {
+                return quick(*size, *n, &Operand::AddrReg(*a), true);
+            }
+            M68kInst::Suba(size, Operand::Imm(n), a) => {
+                return quick(*size, *n, &Operand::AddrReg(*a), false);
+            }
+            _ => {}
+        }
+        self.fold_constant(code, i)
+    }
+
+    /// A constant loaded into a scratch register that is read once
+    fn fold_constant(&self, code: &[M68kInst], i: usize) -> Option<Rewrite> {
+        let (value, scratch, wide) = match &code[i] {
+            M68kInst::Moveq(value, scratch) => (i32::from(*value), *scratch, false),
+            M68kInst::Move(Size::Long, Operand::Imm(value), Operand::DataReg(scratch)) => {
+                (*value, *scratch, true)
+            }
+            _ => return None,
+        };
+        let user = next(code, i)?;
+        let scratch_mask = Reg::Data(scratch).mask();
+        if !self.dead_after(user, Reg::Data(scratch)) {
+            return None;
+        }
+        let from_scratch = |op: &Operand| *op == Operand::DataReg(scratch);
+        let other = |op: &Operand| op.regs() & scratch_mask == 0;
+        let flags_ok = || self.flags_dead_after(code, user);
+        let folded = match &code[user] {
+            M68kInst::Add(size, src, dst) | M68kInst::Sub(size, src, dst)
+                if from_scratch(src) && other(dst) =>
+            {
+                let add = matches!(code[user], M68kInst::Add(..));
+                let n = size.truncate(i64::from(value));
+                // Below long size an immediate costs no more than MOVEQ
+                let wide = wide || *size != Size::Long;
+                match quick_add(*size, n, dst, add) {
+                    Some((inst, swapped)) if !swapped || flags_ok() => inst,
+                    _ if wide && add => M68kInst::Addi(*size, n, dst.clone()),
+                    _ if wide => M68kInst::Subi(*size, n, dst.clone()),
+                    _ => return None,
+                }
+            }
+            // ADDA leaves the flags alone, unlike the MOVEQ it replaces
+            M68kInst::Adda(Size::Long, src, a) | M68kInst::Suba(Size::Long, src, a)
+                if from_scratch(src) && flags_ok() =>
+            {
+                let add = matches!(code[user], M68kInst::Adda(..));
+                match quick_add(Size::Long, value, &Operand::AddrReg(*a), add) {
+                    Some((inst, _)) => inst,
+                    None if wide && add => M68kInst::Adda(Size::Long, Operand::Imm(value), *a),
+                    None if wide => M68kInst::Suba(Size::Long, Operand::Imm(value), *a),
+                    None => return None,
+                }
+            }
+            M68kInst::And(size, src, dst) | M68kInst::Or(size, src, dst)
+                if (wide || *size != Size::Long) && from_scratch(src) && other(dst) =>
+            {
+                let n = size.truncate(i64::from(value));
+                match &code[user] {
+                    M68kInst::And(..) => M68kInst::Andi(*size, n, dst.clone()),
+                    _ => M68kInst::Ori(*size, n, dst.clone()),
+                }
+            }
+            M68kInst::Eor(size, src, dst)
+                if (wide || *size != Size::Long) && *src == scratch && other(dst) =>
+            {
+                M68kInst::Eori(*size, size.truncate(i64::from(value)), dst.clone())
+            }
+            M68kInst::Cmp(size, src, dst @ Operand::DataReg(_))
+                if (wide || *size != Size::Long) && from_scratch(src) && other(dst) =>
+            {
+                M68kInst::Cmpi(*size, size.truncate(i64::from(value)), dst.clone())
+            }
+            M68kInst::Lsl(size, count, d)
+            | M68kInst::Lsr(size, count, d)
+            | M68kInst::Asl(size, count, d)
+            | M68kInst::Asr(size, count, d)
+                if from_scratch(count) && *d != scratch && (1..=8).contains(&value) =>
+            {
+                let count = Operand::Imm(value);
+                match &code[user] {
+                    M68kInst::Lsl(..) => M68kInst::Lsl(*size, count, *d),
+                    M68kInst::Lsr(..) => M68kInst::Lsr(*size, count, *d),
+                    M68kInst::Asl(..) => M68kInst::Asl(*size, count, *d),
+                    _ => M68kInst::Asr(*size, count, *d),
+                }
+            }
+            M68kInst::Move(Size::Long, src, dst) if from_scratch(src) && other(dst) => {
+                if matches!(dst, Operand::AddrReg(_)) && !flags_ok() {
+                    return None;
+                }
+                match dst {
+                    Operand::DataReg(d) => M68kInst::Moveq(i8::try_from(value).ok()?, *d),
+                    _ if wide => M68kInst::Move(Size::Long, Operand::Imm(value), dst.clone()),
+                    _ => return None,
+                }
+            }
+            _ => return None,
+        };
+        Some(Rewrite::new(i, user, vec![folded]))
+    }
+
+    fn forward_stores(&self, code: &[M68kInst], i: usize) -> Option<Rewrite> {
+        let M68kInst::Move(size, first_src, first_dst) = &code[i] else {
+            return None;
+        };
+        let j = next(code, i)?;
+        let M68kInst::Move(size2, src, dst) = &code[j] else {
+            return None;
+        };
+        if size != size2 || first_dst != src {
+            return None;
+        }
+
+        // move Rn,mem; move mem,Rm
+        if let Some(stored) = as_reg(first_src)
+            && is_plain_memory(first_dst)
+            && let Some(loaded) = as_reg(dst)
+        {
+            if stored == loaded {
+                return Some(Rewrite::new(j, j, Vec::new()));
+            }
+            let areg = |r| matches!(r, Reg::Addr(_));
+            if *size == Size::Byte && (areg(stored) || areg(loaded)) {
+                return None;
+            }
+            return Some(Rewrite::new(
+                j,
+                j,
+                vec![M68kInst::Move(*size, first_src.clone(), dst.clone())],
+            ));
+        }
+
+        // move mem,Rn; move Rn,mem stores back what was just loaded
+        if let Some(loaded) = as_reg(first_dst)
+            && is_plain_memory(first_src)
+            && first_src == dst
+            && first_src.regs() & loaded.mask() == 0
+            && (matches!(loaded, Reg::Data(_)) || self.flags_dead_after(code, j))
+        {
+            return Some(Rewrite::new(j, j, Vec::new()));
+        }
+        None
+    }
+
+    fn forward_copies(&self, code: &[M68kInst], i: usize) -> Option<Rewrite> {
+        let M68kInst::Move(Size::Long, src, copy) = &code[i] else {
+            return None;
+        };
+        let b = as_reg(copy)?;
+        if matches!(src, Operand::Imm(_)) || as_reg(src) == Some(b) {
+            return None;
+        }
+        let j = next(code, i)?;
+        if !self.dead_after(j, b) {
+            return None;
+        }
+        let src_is_areg = matches!(src, Operand::AddrReg(_));
+        let src_is_mem = as_reg(src).is_none();
+        let bmask = b.mask();
+        let clean = |op: &Operand| op.regs() & (bmask | src.side_effect_regs()) == 0;
+
+        let folded = match &code[j] {
+            M68kInst::Move(size, from, to) if *from == *copy && clean(to) => {
+                if (src_is_mem && *size != Size::Long) || (src_is_areg && *size == Size::Byte) {
+                    return None;
+                }
+                // MOVE to An sets no flags; the copy into Dn did
+                if matches!(to, Operand::AddrReg(_))
+                    && matches!(b, Reg::Data(_))
+                    && !self.flags_dead_after(code, j)
+                {
+                    return None;
+                }
+                M68kInst::Move(*size, src.clone(), to.clone())
+            }
+            M68kInst::Add(size, from, to @ Operand::DataReg(_))
+            | M68kInst::Sub(size, from, to @ Operand::DataReg(_))
+            | M68kInst::Cmp(size, from, to @ Operand::DataReg(_))
+            | M68kInst::And(size, from, to @ Operand::DataReg(_))
+            | M68kInst::Or(size, from, to @ Operand::DataReg(_))
+                if *from == *copy && clean(to) =>
+            {
+                let logical = matches!(code[j], M68kInst::And(..) | M68kInst::Or(..));
+                if (src_is_mem && *size != Size::Long)
+                    || (src_is_areg && (*size == Size::Byte || logical))
+                {
+                    return None;
+                }
+                let (size, src, to) = (*size, src.clone(), to.clone());
+                match &code[j] {
+                    M68kInst::Add(..) => M68kInst::Add(size, src, to),
+                    M68kInst::Sub(..) => M68kInst::Sub(size, src, to),
+                    M68kInst::Cmp(..) => M68kInst::Cmp(size, src, to),
+                    M68kInst::And(..) => M68kInst::And(size, src, to),
+                    _ => M68kInst::Or(size, src, to),
+                }
+            }
+            _ => return None,
+        };
+        Some(Rewrite::new(i, j, vec![folded]))
+    }
+
+    fn fold_addresses(&self, code: &[M68kInst], i: usize) -> Option<Rewrite> {
+        let M68kInst::Lea(ea, a) = &code[i] else {
+            return None;
+        };
+        let j = next(code, i)?;
+        let reg = Reg::Addr(*a);
+        if !self.dead_after(j, reg) || !is_foldable_address(ea) {
+            return None;
+        }
+
+        match &code[j] {
+            // The move sets N and Z from the address; PEA leaves them alone
+            M68kInst::Move(Size::Long, Operand::AddrReg(src), Operand::PreDec(AddrReg::A7))
+                if src == a && self.flags_dead_after(code, j) =>
+            {
+                return Some(Rewrite::new(i, j, vec![M68kInst::Pea(ea.clone())]));
+            }
+            M68kInst::Move(Size::Long, Operand::AddrReg(src), Operand::AddrReg(dst))
+                if src == a =>
+            {
+                return Some(Rewrite::new(i, j, vec![M68kInst::Lea(ea.clone(), *dst)]));
+            }
+            _ => {}
+        }
+
+        // One `(An)` or `d(An)` operand addressed through the LEA result
+        let user = &code[j];
+        if fixed_regs(user) & reg.mask() != 0 || user.written_regs() & ea.regs() != 0 {
+            return None;
+        }
+        let uses: Vec<&Operand> = operands(user)
+            .into_iter()
+            .filter(|op| op.regs() & reg.mask() != 0)
+            .collect();
+        let [addressed] = uses.as_slice() else {
+            return None;
+        };
+        let replacement = match (addressed, ea) {
+            (Operand::AddrInd(_), _) => ea.clone(),
+            (Operand::Disp(d, _), Operand::AddrInd(base)) => Operand::Disp(*d, *base),
+            (Operand::Disp(d, _), Operand::Disp(d0, base)) => {
+                Operand::Disp(d.checked_add(*d0)?, *base)
+            }
+            _ => return None,
+        };
+        let mut folded = user.clone();
+        for op in operands_mut(&mut folded) {
+            if op.regs() & reg.mask() != 0 {
+                *op = replacement.clone();
+            }
+        }
+        Some(Rewrite::new(i, j, vec![folded]))
+    }
+
+    fn redundant_tests(&self, code: &[M68kInst], i: usize) -> Option<Rewrite> {
+        let tst = next(code, i)?;
+        let M68kInst::Tst(size, Operand::DataReg(reg)) = &code[tst] else {
+            return None;
+        };
+        let is_n = |op: &Operand| *op == Operand::DataReg(*reg);
+        let same = |s: &Size| s == size;
+
+        // Sets N and Z from the value in Dn and clears V and C, as TST does
+        let exact = match &code[i] {
+            M68kInst::Move(s, src, dst) => {
+                same(s) && (is_n(dst) || (is_n(src) && !matches!(dst, Operand::AddrReg(_))))
+            }
+            M68kInst::Moveq(_, d) | M68kInst::Swap(d) => *size == Size::Long && d == reg,
+            M68kInst::Muls(_, d) | M68kInst::Mulu(_, d) => *size == Size::Long && d == reg,
+            M68kInst::Ext(s, d) => same(s) && d == reg,
+            M68kInst::Eor(s, _, dst)
+            | M68kInst::And(s, _, dst)
+            | M68kInst::Or(s, _, dst)
+            | M68kInst::Andi(s, _, dst)
+            | M68kInst::Ori(s, _, dst)
+            | M68kInst::Eori(s, _, dst)
+            | M68kInst::Not(s, dst)
+            | M68kInst::Clr(s, dst) => same(s) && is_n(dst),
+            _ => false,
+        };
+
+        // Sets N and Z from Dn but leaves arithmetic V and C, which only
+        // matter if something tests them.
+        let arith = || {
+            let produces = match &code[i] {
+                M68kInst::Add(s, _, dst)
+                | M68kInst::Sub(s, _, dst)
+                | M68kInst::Addq(s, _, dst)
+                | M68kInst::Subq(s, _, dst)
+                | M68kInst::Addi(s, _, dst)
+                | M68kInst::Subi(s, _, dst)
+                | M68kInst::Neg(s, dst) => same(s) && is_n(dst),
+                M68kInst::Lsl(s, _, d)
+                | M68kInst::Lsr(s, _, d)
+                | M68kInst::Asl(s, _, d)
+                | M68kInst::Asr(s, _, d) => same(s) && d == reg,
+                _ => false,
+            };
+            produces
+                && next(code, tst).is_some_and(|user| {
+                    matches!(
+                        code[user],
+                        M68kInst::Bcc(Cond::Eq | Cond::Ne | Cond::Mi | Cond::Pl, _)
+                            | M68kInst::Scc(Cond::Eq | Cond::Ne | Cond::Mi | Cond::Pl, _)
+                    ) && self.flags_dead_after(code, user)
+                })
+        };
+
+        (exact || arith()).then(|| Rewrite::new(tst, tst, Vec::new()))
+    }
+
+    fn fuse_compares(&self, code: &[M68kInst], i: usize) -> Option<Rewrite> {
+        let M68kInst::Scc(cond, Operand::DataReg(reg)) = &code[i] else {
+            return None;
+        };
+        let is_n = |op: &Operand| *op == Operand::DataReg(*reg);
+        let mask = next(code, i)?;
+        match &code[mask] {
+            M68kInst::And(Size::Long, Operand::Imm(1), dst)
+            | M68kInst::Andi(Size::Long, 1, dst)
+                if is_n(dst) => {}
+            _ => return None,
+        }
+        let mut branch_at = next(code, mask)?;
+        if matches!(&code[branch_at], M68kInst::Tst(Size::Long, op) if is_n(op)) {
+            branch_at = next(code, branch_at)?;
+        }
+        let M68kInst::Bcc(branch @ (Cond::Ne | Cond::Eq), label) = &code[branch_at] else {
+            return None;
+        };
+        if !self.dead_after(branch_at, Reg::Data(*reg)) || !self.flags_dead_after(code, branch_at) {
+            return None;
+        }
+        let taken = if *branch == Cond::Ne {
+            *cond
+        } else {
+            cond.negate()
+        };
+        let with = match taken {
+            Cond::True => vec![M68kInst::Bra(*label)],
+            Cond::False => Vec::new(),
+            c => vec![M68kInst::Bcc(c, *label)],
+        };
+        Some(Rewrite::new(i, branch_at, with))
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use pretty_assertions::assert_eq;
+
+    use AddrReg::*;
+    use DataReg::*;
+
+    fn dreg(d: DataReg) -> Operand {
+        Operand::DataReg(d)
+    }
+
+    fn areg(a: AddrReg) -> Operand {
+        Operand::AddrReg(a)
+    }
+
+    fn long(src: Operand, dst: Operand) -> M68kInst {
+        M68kInst::Move(Size::Long, src, dst)
+    }
+
+    /// Optimize `code` as the end of a function
+    fn optimize(mut code: Vec<M68kInst>) -> Vec<M68kInst> {
+        code.push(M68kInst::Rts);
+        Peephole::for_level(1).run(&mut code);
+        assert_eq!(code.pop(), Some(M68kInst::Rts));
+        code
+    }
+
+    #[test]
+    fn test_rule_set_by_level() {
+        assert!(Peephole::for_level(0).is_empty());
+        assert_eq!(
+            Peephole::for_level(2).rule_names(),
+            vec![
+                "quick-immediates",
+                "forward-stores",
+                "forward-copies",
+                "fold-addresses",
+                "redundant-tests",
+                "fuse-compares"
+            ]
+        );
+        let mut code = vec![long(Operand::Imm(1), dreg(D0)), M68kInst::Rts];
+        assert!(!Peephole::new().run(&mut code));
+    }
+
+    #[test]
+    fn test_store_then_reload() {
+        let slot = Operand::Disp(-8, A6);
+        assert_eq!(
+            optimize(vec![
+                long(dreg(D0), slot.clone()),
+                long(slot.clone(), dreg(D0)),
+                long(slot.clone(), dreg(D2)),
+            ]),
+            vec![long(dreg(D0), slot.clone()), long(dreg(D0), dreg(D2))]
+        );
+        assert_eq!(
+            optimize(vec![
+                long(slot.clone(), dreg(D2)),
+                long(dreg(D2), slot.clone())
+            ]),
+            vec![long(slot, dreg(D2))]
+        );
+        // A device register may not read back what was written
+        let port = Operand::Disp(4, A1);
+        let code = vec![long(dreg(D0), port.clone()), long(port, dreg(D0))];
+        assert_eq!(optimize(code.clone()), code);
+    }
+
+    #[test]
+    fn test_volatile_accesses_kept() {
+        let fenced = |inst| [M68kInst::Barrier, inst, M68kInst::Barrier];
+        let slot = Operand::Disp(-8, A6);
+        let code: Vec<_> = [
+            fenced(long(dreg(D0), slot.clone())),
+            fenced(long(slot.clone(), dreg(D2))),
+            fenced(long(dreg(D2), slot)),
+        ]
+        .concat();
+        assert_eq!(optimize(code.clone()), code);
+
+        // Folding the address would make the access a plain global
+        let ticks = Operand::Label("ticks".into());
+        let mut code = vec![M68kInst::Lea(ticks, A0)];
+        code.extend(fenced(long(Operand::AddrInd(A0), dreg(D0))));
+        assert_eq!(optimize(code.clone()), code);
+    }
+
+    #[test]
+    fn test_quick_immediates() {
+        assert_eq!(
+            optimize(vec![
+                long(Operand::Imm(-3), dreg(D2)),
+                M68kInst::Addi(Size::Long, 4, dreg(D2)),
+                M68kInst::Adda(Size::Long, Operand::Imm(8), A7),
+                M68kInst::Moveq(2, D1),
+                M68kInst::Lsl(Size::Long, dreg(D1), D2),
+                long(Operand::Imm(0x80), dreg(D1)),
+                M68kInst::Add(Size::Long, dreg(D1), dreg(D2)),
+                long(dreg(D2), dreg(D0)),
+            ]),
+            vec![
+                M68kInst::Moveq(-3, D2),
+                M68kInst::Addq(Size::Long, 4, dreg(D2)),
+                M68kInst::Addq(Size::Long, 8, areg(A7)),
+                M68kInst::Lsl(Size::Long, Operand::Imm(2), D2),
+                M68kInst::Addi(Size::Long, 0x80, dreg(D2)),
+                long(dreg(D2), dreg(D0)),
+            ]
+        );
+    }
+
+    #[test]
+    fn test_narrow_operations_take_immediates() {
+        assert_eq!(
+            optimize(vec![
+                M68kInst::Moveq(3, D1),
+                M68kInst::Add(Size::Byte, dreg(D1), dreg(D2)),
+                M68kInst::Moveq(100, D1),
+                M68kInst::And(Size::Word, dreg(D1), dreg(D2)),
+                long(Operand::Imm(0x12345), dreg(D1)),
+                M68kInst::Eor(Size::Word, D1, dreg(D2)),
+                long(dreg(D2), dreg(D0)),
+            ]),
+            vec![
+                M68kInst::Addq(Size::Byte, 3, dreg(D2)),
+                M68kInst::Andi(Size::Word, 100, dreg(D2)),
+                M68kInst::Eori(Size::Word, 0x2345, dreg(D2)),
+                long(dreg(D2), dreg(D0)),
+            ]
+        );
+    }
+
+    #[test]
+    fn test_scratch_constant_kept_while_live() {
+        let code = vec![
+            long(Operand::Imm(0x80), dreg(D1)),
+            M68kInst::Add(Size::Long, dreg(D1), dreg(D2)),
+            M68kInst::Add(Size::Long, dreg(D1), dreg(D2)),
+            long(dreg(D2), dreg(D0)),
+        ];
+        let optimized = optimize(code.clone());
+        assert_eq!(optimized[..2], code[..2]);
+    }
+
+    #[test]
+    fn test_negative_add_needs_dead_carry() {
+        // add.l #-1 and subq.l #1 disagree on carry, which bcs reads
+        let mut code = vec![
+            M68kInst::Add(Size::Long, Operand::Imm(-1), dreg(D0)),
+            M68kInst::Bcc(Cond::Cs, "out".into()),
+            M68kInst::Label("out".into()),
+            M68kInst::Rts,
+        ];
+        let before = code.clone();
+        Peephole::for_level(1).run(&mut code);
+        assert_eq!(code, before);
+    }
+
+    #[test]
+    fn test_redundant_tests() {
+        let code = vec![
+            M68kInst::Andi(Size::Long, 0xFF, dreg(D0)),
+            M68kInst::Tst(Size::Long, dreg(D0)),
+            M68kInst::Bcc(Cond::Ne, "out".into()),
+            M68kInst::Add(Size::Long, dreg(D1), dreg(D0)),
+            M68kInst::Tst(Size::Long, dreg(D0)),
+            M68kInst::Bcc(Cond::Gt, "out".into()),
+            M68kInst::Label("out".into()),
+            M68kInst::Rts,
+        ];
+        let mut optimized = code.clone();
+        Peephole::for_level(1).run(&mut optimized);
+        // The add leaves V and C for bgt, so its tst stays
+        let mut expected = code;
+        expected.remove(1);
+        assert_eq!(optimized, expected);
+    }
+
+    #[test]
+    fn test_lea_folds_into_use() {
+        assert_eq!(
+            optimize(vec![
+                M68kInst::Lea(Operand::Label("msg".into()), A0),
+                long(areg(A0), dreg(D0)),
+                long(dreg(D0), Operand::PreDec(A7)),
+                M68kInst::Lea(Operand::Disp(-12, A6), A0),
+                long(Operand::Disp(4, A0), dreg(D0)),
+            ]),
+            vec![
+                M68kInst::Pea(Operand::Label("msg".into())),
+                long(Operand::Disp(-8, A6), dreg(D0)),
+            ]
+        );
+    }
+
+    #[test]
+    fn test_push_kept_when_flags_read() {
+        // beq tests the pushed address, which PEA wouldn't set Z from
+        let mut code = vec![
+            M68kInst::Lea(Operand::Disp(8, A1), A0),
+            long(areg(A0), Operand::PreDec(A7)),
+            M68kInst::Bcc(Cond::Eq, "out".into()),
+            M68kInst::Label("out".into()),
+            M68kInst::Rts,
+        ];
+        let before = code.clone();
+        Peephole::for_level(1).run(&mut code);
+        assert_eq!(code, before);
+    }
+
+    #[test]
+    fn test_compare_fused_into_branch() {
+        let mut code = vec![
+            M68kInst::Cmp(Size::Long, dreg(D1), dreg(D0)),
+            M68kInst::Scc(Cond::Lt, dreg(D0)),
+            M68kInst::And(Size::Long, Operand::Imm(1), dreg(D0)),
+            M68kInst::Tst(Size::Long, dreg(D0)),
+            M68kInst::Bcc(Cond::Eq, "else".into()),
+            M68kInst::Moveq(1, D0),
+            M68kInst::Rts,
+            M68kInst::Label("else".into()),
+            M68kInst::Moveq(0, D0),
+            M68kInst::Rts,
+        ];
+        assert!(Peephole::for_level(1).run(&mut code));
+        assert_eq!(
+            code[..2],
+            [
+                M68kInst::Cmp(Size::Long, dreg(D1), dreg(D0)),
+                M68kInst::Bcc(Cond::Ge, "else".into()),
+            ]
+        );
+    }
+
+    #[test]
+    fn test_boolean_kept_when_read_after_branch() {
+        let code = vec![
+            M68kInst::Cmp(Size::Long, dreg(D1), dreg(D3)),
+            M68kInst::Scc(Cond::Eq, dreg(D3)),
+            M68kInst::And(Size::Long, Operand::Imm(1), dreg(D3)),
+            M68kInst::Bcc(Cond::Ne, "out".into()),
+            M68kInst::Label("out".into()),
+            long(dreg(D3), dreg(D0)),
+            M68kInst::Rts,
+        ];
+        let mut optimized = code.clone();
+        Peephole::for_level(1).run(&mut optimized);
+        assert_eq!(optimized, code);
+    }
+
+    #[test]
+    fn test_liveness_follows_loops() {
+        // d1 is read again at the top of the next iteration
+        let mut code = vec![
+            M68kInst::Label("loop".into()),
+            M68kInst::Add(Size::Long, dreg(D1), dreg(D0)),
+            M68kInst::Moveq(1, D1),
+            M68kInst::Add(Size::Long, dreg(D1), dreg(D2)),
+            M68kInst::Bra("loop".into()),
+        ];
+        let before = code.clone();
+        assert!(!Peephole::for_level(1).run(&mut code));
+        assert_eq!(code, before);
+    }
+}
@@ -0,0 +1,564 @@
+//! Register allocation for IR temps
+//!
+//! Linear scan over live intervals. Liveness is computed per straight-line
+//! region (split at labels and branches) with a backward dataflow pass, and
+//! every temp gets a single interval spanning all points where it is live.
+//! Temps are mapped onto D2-D7/A2-A5; D0/D1/A0/A1 are left to the code
+//! generator as scratch. Intervals that do not fit are spilled to the frame.
+//!
+//! Temps whose only definition is an `Alloca` or `LoadParam` hold a fixed
+//! frame address. They are not allocated at all: the code generator accesses
+//! the slot relative to A6 instead.
+
+use super::m68k::{AddrReg, DataReg, Reg, RegMask};
+use crate::ir::{Inst, IrFunction, Temp, Value};
+use std::collections::{HashMap, HashSet};
+
+/// Data registers available to the allocator, in preference order
+const DATA_REGS: [DataReg; 6] = [
+    DataReg::D2,
+    DataReg::D3,
+    DataReg::D4,
+    DataReg::D5,
+    DataReg::D6,
+    DataReg::D7,
+];
+
+/// Address registers available to the allocator, in preference order
+const ADDR_REGS: [AddrReg; 4] = [AddrReg::A2, AddrReg::A3, AddrReg::A4, AddrReg::A5];
+
+/// Result of register allocation for one function
+#[derive(Debug, Default)]
+pub struct Allocation {
+    regs: HashMap<Temp, Reg>,
+    frame_temps: HashSet<Temp>,
+}
+
+impl Allocation {
+    /// Register assigned to a temp, or `None` if it lives in the frame
+    pub fn reg(&self, temp: Temp) -> Option<Reg> {
+        self.regs.get(&temp).copied()
+    }
+
+    /// Whether the temp is a fixed frame address (`Alloca`/`LoadParam` result)
+    pub fn is_frame_temp(&self, temp: Temp) -> bool {
+        self.frame_temps.contains(&temp)
+    }
+}
+
+/// Live range of a temp in instruction positions.
+///
+/// Instruction `i` reads its operands at `2i` and writes its result at `2i + 1`,
+/// so an operand's last use and the result of the same instruction may share a
+/// register.
+#[derive(Debug, Clone)]
+struct Interval {
+    temp: Temp,
+    start: u32,
+    end: u32,
+    /// Used as a load/store address: prefer an address register
+    wants_addr: bool,
+}
+
+/// Straight-line run of instructions `[start, end)` with its CFG successors
+struct Region {
+    start: usize,
+    end: usize,
+    succs: Vec<usize>,
+}
+
+/// Fixed-size bitset over temp numbers
+#[derive(Clone, PartialEq, Eq)]
+struct TempSet(Vec<u64>);
+
+impl TempSet {
+    fn new(n: usize) -> Self {
+        Self(vec![0; n.div_ceil(64)])
+    }
+
+    fn insert(&mut self, t: Temp) {
+        self.0[t.0 as usize / 64] |= 1 << (t.0 % 64);
+    }
+
+    fn remove(&mut self, t: Temp) {
+        self.0[t.0 as usize / 64] &= !(1 << (t.0 % 64));
+    }
+
+    fn union_with(&mut self, other: &TempSet) {
+        for (a, b) in self.0.iter_mut().zip(&other.0) {
+            *a |= b;
+        }
+    }
+
+    fn iter(&self) -> impl Iterator<Item = Temp> + '_ {
+        self.0.iter().enumerate().flat_map(|(w, &bits)| {
+            (0..64)
+                .filter(move |b| bits & (1 << b) != 0)
+                .map(move |b| Temp((w * 64 + b) as u32))
+        })
+    }
+}
+
+/// Allocate registers for every temp in `func`.
+///
+/// `clobbers` reports the registers an instruction's generated code destroys
+/// (e.g. the argument registers and scratch used by an inlined SDK call); no
+/// temp that is live across such an instruction is placed in those registers.
+pub fn allocate(func: &IrFunction, mut clobbers: impl FnMut(&Inst) -> RegMask) -> Allocation {
+    // Labels neither read nor write temps; they only delimit regions
+    let insts: Vec<&Inst> = func
+        .blocks
+        .iter()
+        .flat_map(|b| b.insts.iter().map(|s| &s.inst))
+        .filter(|i| !matches!(i, Inst::Label(_)))
+        .collect();
+    let frame_temps = find_frame_temps(&insts);
+    let regions = build_regions(func, &insts);
+
+    let num_temps = insts
+        .iter()
+        .flat_map(|inst| inst.def().into_iter().chain(inst.uses()))
+        .map(|t| t.0 as usize + 1)
+        .max()
+        .unwrap_or(0);
+
+    let (live_in, live_out) = liveness(&insts, &regions, num_temps);
+
+    // Build one interval per temp
+    let mut ranges: HashMap<Temp, (u32, u32)> = HashMap::new();
+    let mut extend = |t: Temp, pos: u32| {
+        let r = ranges.entry(t).or_insert((pos, pos));
+        r.0 = r.0.min(pos);
+        r.1 = r.1.max(pos);
+    };
+    for (r, region) in regions.iter().enumerate() {
+        if region.start == region.end {
+            continue;
+        }
+        for t in live_in[r].iter() {
+            extend(t, 2 * region.start as u32);
+        }
+        for t in live_out[r].iter() {
+            extend(t, 2 * region.end as u32 - 1);
+        }
+    }
+    let mut wants_addr = HashSet::new();
+    let mut clobber_points = Vec::new();
+    for (i, inst) in insts.iter().enumerate() {
+        let pos = 2 * i as u32;
+        for t in inst.uses() {
+            extend(t, pos);
+        }
+        if let Some(t) = inst.def() {
+            extend(t, pos + 1);
+        }
+        if let Inst::Load {
+            addr: Value::Temp(t),
+            ..
+        }
+        | Inst::Store {
+            addr: Value::Temp(t),
+            ..
+        } = inst
+        {
+            wants_addr.insert(*t);
+        }
+        let mask = clobbers(inst);
+        if mask != 0 {
+            clobber_points.push((pos, mask));
+        }
+    }
+
+    let mut intervals: Vec<Interval> = ranges
+        .into_iter()
+        .filter(|(t, _)| !frame_temps.contains(t))
+        .map(|(temp, (start, end))| Interval {
+            temp,
+            start,
+            end,
+            wants_addr: wants_addr.contains(&temp),
+        })
+        .collect();
+    intervals.sort_by_key(|iv| (iv.start, iv.temp.0));
+
+    Allocation {
+        regs: linear_scan(&intervals, &clobber_points),
+        frame_temps,
+    }
+}
+
+/// Temps defined exactly once, by an `Alloca` or `LoadParam`
+fn find_frame_temps(insts: &[&Inst]) -> HashSet<Temp> {
+    let mut defs: HashMap<Temp, (usize, bool)> = HashMap::new();
+    for inst in insts {
+        if let Some(t) = inst.def() {
+            let is_frame = matches!(inst, Inst::Alloca { .. } | Inst::LoadParam { .. });
+            let entry = defs.entry(t).or_insert((0, true));
+            entry.0 += 1;
+            entry.1 &= is_frame;
+        }
+    }
+    defs.into_iter()
+        .filter(|(_, (count, is_frame))| *count == 1 && *is_frame)
+        .map(|(t, _)| t)
+        .collect()
+}
+
+/// Split the flattened (label-free) instruction list into regions and link
+/// them into a CFG
+fn build_regions(func: &IrFunction, insts: &[&Inst]) -> Vec<Region> {
+    let mut starts = vec![0usize];
+    let mut label_region: HashMap<&str, usize> = HashMap::new();
+    let mut idx = 0usize;
+
+    for block in &func.blocks {
+        let mut labels = vec![block.label.0.as_str()];
+        for sinst in &block.insts {
+            if let Inst::Label(l) = &sinst.inst {
+                labels.push(l.0.as_str());
+                continue;
+            }
+            for label in labels.drain(..) {
+                if idx > *starts.last().unwrap() {
+                    starts.push(idx);
+                }
+                label_region.insert(label, starts.len() - 1);
+            }
+            idx += 1;
+            if sinst.inst.is_terminator() || !sinst.inst.branch_targets().is_empty() {
+                starts.push(idx);
+            }
+        }
+        // Labels with no instruction after them in this block mark the next region
+        for label in labels {
+            if idx > *starts.last().unwrap() {
+                starts.push(idx);
+            }
+            label_region.insert(label, starts.len() - 1);
+        }
+    }
+
+    let count = starts.len();
+    let mut regions: Vec<Region> = (0..count)
+        .map(|r| Region {
+            start: starts[r],
+            end: starts.get(r + 1).copied().unwrap_or(insts.len()),
+            succs: Vec::new(),
+        })
+        .collect();
+
+    for (r, region) in regions.iter_mut().enumerate() {
+        let falls_through = r + 1 < count;
+        if region.start == region.end {
+            if falls_through {
+                region.succs.push(r + 1);
+            }
+            continue;
+        }
+        let last = insts[region.end - 1];
+        for target in last.branch_targets() {
+            if let Some(&succ) = label_region.get(target.0.as_str())
+                && !region.succs.contains(&succ)
+            {
+                region.succs.push(succ);
+            }
+        }
+        if !last.is_terminator() && falls_through {
+            region.succs.push(r + 1);
+        }
+    }
+    regions
+}
+
+/// Backward dataflow: live-in/live-out temp sets per region
+fn liveness(insts: &[&Inst], regions: &[Region], num_temps: usize) -> (Vec<TempSet>, Vec<TempSet>) {
+    let mut gen_sets = Vec::with_capacity(regions.len());
+    let mut kill_sets = Vec::with_capacity(regions.len());
+    for region in regions {
+        let mut generated = TempSet::new(num_temps);
+        let mut killed = TempSet::new(num_temps);
+        for inst in insts[region.start..region.end].iter().rev() {
+            if let Some(t) = inst.def() {
+                killed.insert(t);
+                generated.remove(t);
+            }
+            for t in inst.uses() {
+                generated.insert(t);
+            }
+        }
+        gen_sets.push(generated);
+        kill_sets.push(killed);
+    }
+
+    let mut live_in = vec![TempSet::new(num_temps); regions.len()];
+    let mut live_out = vec![TempSet::new(num_temps); regions.len()];
+    let mut changed = true;
+    while changed {
+        changed = false;
+        for r in (0..regions.len()).rev() {
+            let mut out = TempSet::new(num_temps);
+            for &s in &regions[r].succs {
+                out.union_with(&live_in[s]);
+            }
+            let mut inn = out.clone();
+            for (w, k) in inn.0.iter_mut().zip(&kill_sets[r].0) {
+                *w &= !k;
+            }
+            inn.union_with(&gen_sets[r]);
+            if inn != live_in[r] || out != live_out[r] {
+                live_in[r] = inn;
+                live_out[r] = out;
+                changed = true;
+            }
+        }
+    }
+    (live_in, live_out)
+}
+
+/// Whether `reg` is destroyed somewhere strictly inside the interval
+fn is_clobbered(reg: Reg, iv: &Interval, clobber_points: &[(u32, RegMask)]) -> bool {
+    clobber_points
+        .iter()
+        .any(|&(pos, mask)| mask & reg.mask() != 0 && iv.start < pos && pos <= iv.end)
+}
+
+fn linear_scan(intervals: &[Interval], clobber_points: &[(u32, RegMask)]) -> HashMap<Temp, Reg> {
+    let data = DATA_REGS.iter().map(|&d| Reg::Data(d));
+    let addr = ADDR_REGS.iter().map(|&a| Reg::Addr(a));
+    let data_first: Vec<Reg> = data.clone().chain(addr.clone()).collect();
+    let addr_first: Vec<Reg> = addr.chain(data).collect();
+
+    let mut assigned: HashMap<Temp, Reg> = HashMap::new();
+    // (interval index, register) for intervals currently holding a register
+    let mut active: Vec<(usize, Reg)> = Vec::new();
+
+    for (i, iv) in intervals.iter().enumerate() {
+        active.retain(|&(j, _)| intervals[j].end >= iv.start);
+
+        let candidates = if iv.wants_addr {
+            &addr_first
+        } else {
+            &data_first
+        };
+        let free = candidates.iter().copied().find(|&reg| {
+            !active.iter().any(|&(_, r)| r == reg) && !is_clobbered(reg, iv, clobber_points)
+        });
+        if let Some(reg) = free {
+            assigned.insert(iv.temp, reg);
+            active.push((i, reg));
+            continue;
+        }
+
+        // No free register: evict the active interval that ends last, if it
+        // outlives this one and its register is usable here
+        let victim = active
+            .iter()
+            .enumerate()
+            .filter(|&(_, &(_, r))| !is_clobbered(r, iv, clobber_points))
+            .max_by_key(|&(_, &(j, _))| intervals[j].end)
+            .map(|(slot, &(j, r))| (slot, j, r));
+        if let Some((slot, j, reg)) = victim
+            && intervals[j].end > iv.end
+        {
+            assigned.remove(&intervals[j].temp);
+            active.swap_remove(slot);
+            assigned.insert(iv.temp, reg);
+            active.push((i, reg));
+        }
+    }
+    assigned
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::ir::{BasicBlock, BinOp, Label, SpannedInst};
+    use crate::types::IrType;
+
+    fn func_with(insts: Vec<Inst>) -> IrFunction {
+        let mut func = IrFunction::new("f".to_string(), vec![], IrType::void());
+        let mut bb = BasicBlock::new(Label("entry".into()));
+        bb.insts = insts.into_iter().map(SpannedInst::bare).collect();
+        func.blocks.push(bb);
+        func
+    }
+
+    fn t(n: u32) -> Value {
+        Value::Temp(Temp(n))
+    }
+
+    fn add(dst: u32, left: Value, right: Value) -> Inst {
+        Inst::Binary {
+            dst: Temp(dst),
+            op: BinOp::Add,
+            left,
+            right,
+            width: 4,
+        }
+    }
+
+    #[test]
+    fn test_straight_line_reuses_registers() {
+        let func = func_with(vec![
+            Inst::Copy {
+                dst: Temp(0),
+                src: Value::IntConst(1),
+                width: 4,
+            },
+            Inst::Copy {
+                dst: Temp(1),
+                src: Value::IntConst(2),
+                width: 4,
+            },
+            add(2, t(0), t(1)),
+            add(3, t(2), Value::IntConst(1)),
+            Inst::Return(Some(t(3))),
+        ]);
+        let alloc = allocate(&func, |_| 0);
+        let r0 = alloc.reg(Temp(0)).unwrap();
+        let r1 = alloc.reg(Temp(1)).unwrap();
+        assert_ne!(r0, r1);
+        // t2 starts where t0/t1 die, so it can reuse one of their registers
+        assert!(alloc.reg(Temp(2)) == Some(r0) || alloc.reg(Temp(2)) == Some(r1));
+        assert!(alloc.reg(Temp(3)).is_some());
+    }
+
+    #[test]
+    fn test_frame_temps_are_not_allocated() {
+        let func = func_with(vec![
+            Inst::Alloca {
+                dst: Temp(0),
+                size: 4,
+                align: 2,
+            },
+            Inst::LoadParam {
+                dst: Temp(1),
+                index: 0,
+                size: 4,
+            },
+            Inst::Load {
+                dst: Temp(2),
+                addr: t(1),
+                size: 4,
+                volatile: false,
+                signed: true,
+                width: 4,
+            },
+            Inst::Store {
+                addr: t(0),
+                src: t(2),
+                size: 4,
+                volatile: false,
+            },
+            Inst::Return(None),
+        ]);
+        let alloc = allocate(&func, |_| 0);
+        assert!(alloc.is_frame_temp(Temp(0)));
+        assert!(alloc.is_frame_temp(Temp(1)));
+        assert!(alloc.reg(Temp(0)).is_none());
+        assert!(alloc.reg(Temp(2)).is_some());
+    }
+
+    #[test]
+    fn test_address_temps_prefer_address_registers() {
+        let func = func_with(vec![
+            Inst::AddrOf {
+                dst: Temp(0),
+                name: "g".into(),
+            },
+            Inst::Load {
+                dst: Temp(1),
+                addr: t(0),
+                size: 2,
+                volatile: false,
+                signed: false,
+                width: 4,
+            },
+            Inst::Return(Some(t(1))),
+        ]);
+        let alloc = allocate(&func, |_| 0);
+        assert!(matches!(alloc.reg(Temp(0)), Some(Reg::Addr(_))));
+        assert!(matches!(alloc.reg(Temp(1)), Some(Reg::Data(_))));
+    }
+
+    #[test]
+    fn test_clobbered_registers_avoided_across_call() {
+        let call = Inst::Call {
+            dst: None,
+            func: "sdk".into(),
+            args: vec![],
+        };
+        let func = func_with(vec![
+            Inst::Copy {
+                dst: Temp(0),
+                src: Value::IntConst(5),
+                width: 4,
+            },
+            call,
+            Inst::Return(Some(t(0))),
+        ]);
+        let all_data: RegMask = 0x00FC;
+        let alloc = allocate(&func, |inst| {
+            if matches!(inst, Inst::Call { .. }) {
+                all_data
+            } else {
+                0
+            }
+        });
+        assert!(matches!(alloc.reg(Temp(0)), Some(Reg::Addr(_))));
+    }
+
+    #[test]
+    fn test_pressure_spills_without_overlap() {
+        // 14 temps all live at the final instruction; only 10 registers exist
+        let mut insts: Vec<Inst> = (0..14)
+            .map(|n| Inst::Copy {
+                dst: Temp(n),
+                src: Value::IntConst(i64::from(n)),
+                width: 4,
+            })
+            .collect();
+        insts.push(Inst::Call {
+            dst: None,
+            func: "use_all".into(),
+            args: (0..14).map(t).collect(),
+        });
+        insts.push(Inst::Return(None));
+        let func = func_with(insts);
+        let alloc = allocate(&func, |_| 0);
+
+        let regs: Vec<Reg> = (0..14).filter_map(|n| alloc.reg(Temp(n))).collect();
+        assert_eq!(regs.len(), 10);
+        let unique: HashSet<Reg> = regs.iter().copied().collect();
+        assert_eq!(unique.len(), regs.len());
+    }
+
+    #[test]
+    fn test_value_live_around_loop() {
+        // t0 is defined before the loop and read on every iteration, so it must
+        // not share a register with t1, which is defined inside the loop body.
+        let mut func = IrFunction::new("f".to_string(), vec![], IrType::void());
+        let mut entry = BasicBlock::new(Label("entry".into()));
+        entry.insts.push(SpannedInst::bare(Inst::Copy {
+            dst: Temp(0),
+            src: Value::IntConst(3),
+            width: 4,
+        }));
+        let mut body = BasicBlock::new(Label("loop".into()));
+        body.insts
+            .push(SpannedInst::bare(add(1, t(0), Value::IntConst(1))));
+        body.insts.push(SpannedInst::bare(Inst::Store {
+            addr: Value::IntConst(0xFF0000),
+            src: t(1),
+            size: 4,
+            volatile: true,
+        }));
+        body.insts
+            .push(SpannedInst::bare(Inst::Jump(Label("loop".into()))));
+        func.blocks.push(entry);
+        func.blocks.push(body);
+
+        let alloc = allocate(&func, |_| 0);
+        assert_ne!(alloc.reg(Temp(0)), alloc.reg(Temp(1)));
+    }
+}
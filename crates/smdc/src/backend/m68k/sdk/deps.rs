@@ -1,6 +1,9 @@
 //! SDK dependency resolution and static data generation
 
-use crate::backend::m68k::m68k::M68kInst;
+use super::library::{DMA_QUEUE_LEN, SIN_TABLE, SQRT_TABLE, UNPACK_WINDOW, Z80_DRIVER};
+use super::z80::driver::DRIVER;
+use crate::backend::m68k::m68k::{Directive, M68kInst, SectionName};
+use crate::common::fixed;
 use std::collections::HashSet;
 
 /// Get the set of SDK functions that a given function depends on
@@ -9,6 +12,12 @@ pub fn get_sdk_dependencies(func_name: &str) -> &'static [&'static str] {
         // VDP dependencies
         "vdp_vsync" => &["vdp_wait_vblank_start"],
         "vdp_wait_frame" => &["vdp_wait_vblank_start", "vdp_wait_vblank_end"],
+        "vdp_load_tiles_packed" => &["dma_queue_transfer", "vdp_wait_vblank_start"],
+
+        // DMA queue dependencies
+        "dma_queue_transfer" => &["dma_queue_flush"],
+        "dma_queue_fill" | "dma_queue_copy" => &["dma_queue_transfer"],
+        "dma_queue_flush" => &["vdp_dma_transfer", "vdp_dma_fill", "vdp_dma_copy"],
 
         // YM2612 dependencies
         "ym_reset" => &["ym_init"],
@@ -30,7 +39,14 @@ pub fn get_sdk_dependencies(func_name: &str) -> &'static [&'static str] {
         "psg_beep" => &["psg_set_tone"],
         "psg_note_on" => &["psg_beep", "psg_set_tone"],
 
+        // Sound driver dependencies
+        "snd_play_sample" | "snd_stop_sample" | "snd_play_song" | "snd_stop_song" => &["snd_init"],
+
         // Sprite dependencies
+        "sprite_init" | "sprite_set" | "sprite_set_pos" | "sprite_hide" | "sprite_set_link" => {
+            &["sprite_flush"]
+        }
+        "sprite_flush" => &["dma_queue_transfer"],
         "sprite_clear" => &["sprite_hide"],
         "sprite_clear_all" => &["sprite_init"],
 
@@ -38,6 +54,10 @@ pub fn get_sdk_dependencies(func_name: &str) -> &'static [&'static str] {
         "input_held" => &["input_read"],
         "input_pressed" => &["input_read"],
 
+        // Util dependencies
+        "mem_copy" => &["mem_copy_w"],
+        "mem_set" => &["mem_set_l"],
+
         _ => &[],
     }
 }
@@ -72,6 +92,21 @@ pub fn needs_frame_counter(functions: &HashSet<String>) -> bool {
     })
 }
 
+/// Check if any functions need the DMA queue ring
+pub fn needs_dma_queue(functions: &HashSet<String>) -> bool {
+    functions.iter().any(|f| f.starts_with("dma_queue_"))
+}
+
+/// Check if any functions need the shadow sprite table
+pub fn needs_sprite_table(functions: &HashSet<String>) -> bool {
+    functions.contains("sprite_flush")
+}
+
+/// Check if any functions need the window packed tiles are unpacked into
+pub fn needs_unpack_window(functions: &HashSet<String>) -> bool {
+    functions.contains("vdp_load_tiles_packed")
+}
+
 /// Check if any functions need the random state variable
 pub fn needs_rand_state(functions: &HashSet<String>) -> bool {
     functions
@@ -86,31 +121,116 @@ pub fn needs_op_offsets(functions: &HashSet<String>) -> bool {
         .any(|f| matches!(f.as_str(), "ym_write_op" | "ym_load_operator" | "ym_init"))
 }
 
+/// Check if any functions need the sine table
+pub fn needs_sin_table(functions: &HashSet<String>) -> bool {
+    functions
+        .iter()
+        .any(|f| matches!(f.as_str(), "sin_fix" | "cos_fix"))
+}
+
+/// Check if inline code for `func` reads SDK static data, so it must be
+/// recorded like a library call
+pub fn inline_uses_static_data(func: &str) -> bool {
+    matches!(func, "sin_fix" | "cos_fix")
+}
+
+/// Check if any functions need the square root table
+pub fn needs_sqrt_table(functions: &HashSet<String>) -> bool {
+    functions.contains("sqrt_fix")
+}
+
+/// Check if any functions need the Z80 sound driver image
+pub fn needs_z80_driver(functions: &HashSet<String>) -> bool {
+    functions.contains("snd_init")
+}
+
 /// Generate SDK static data section
 pub fn generate_static_data(functions: &HashSet<String>) -> Vec<M68kInst> {
     let mut insts = Vec::new();
 
-    if needs_frame_counter(functions) || needs_op_offsets(functions) || needs_rand_state(functions)
+    if needs_frame_counter(functions)
+        || needs_op_offsets(functions)
+        || needs_rand_state(functions)
+        || needs_dma_queue(functions)
+        || needs_sprite_table(functions)
+        || needs_unpack_window(functions)
     {
-        insts.push(M68kInst::Directive(".section .bss".to_string()));
-        insts.push(M68kInst::Directive(".align 4".to_string()));
+        insts.push(M68kInst::Directive(Directive::Section(SectionName::Bss)));
+        insts.push(M68kInst::Directive(Directive::Align(4)));
     }
 
     if needs_frame_counter(functions) {
-        insts.push(M68kInst::Label("__sdk_frame_count".to_string()));
-        insts.push(M68kInst::Directive(".space 4".to_string()));
+        insts.push(M68kInst::Label("__sdk_frame_count".into()));
+        insts.push(M68kInst::Directive(Directive::Space(4)));
     }
 
     if needs_rand_state(functions) {
-        insts.push(M68kInst::Label("__sdk_rand_state".to_string()));
-        insts.push(M68kInst::Directive(".space 4".to_string()));
+        insts.push(M68kInst::Label("__sdk_rand_state".into()));
+        insts.push(M68kInst::Directive(Directive::Space(4)));
+    }
+
+    if needs_dma_queue(functions) {
+        // head.w and count.w, cleared together by dma_queue_clear
+        insts.push(M68kInst::Label("__sdk_dma_head".into()));
+        insts.push(M68kInst::Directive(Directive::Space(4)));
+        insts.push(M68kInst::Label("__sdk_dma_queue".into()));
+        insts.push(M68kInst::Directive(Directive::Space(
+            DMA_QUEUE_LEN as u32 * 16,
+        )));
+    }
+
+    if needs_sprite_table(functions) {
+        // lo.w and hi.w of the dirty entry range (clean when hi is 0), then
+        // the table itself
+        insts.push(M68kInst::Label("__sdk_sprite_dirty".into()));
+        insts.push(M68kInst::Directive(Directive::Space(4)));
+        insts.push(M68kInst::Label("__sdk_sprite_table".into()));
+        insts.push(M68kInst::Directive(Directive::Space(640)));
+    }
+
+    if needs_unpack_window(functions) {
+        // Bytes in use (.w, padded), then the window itself
+        insts.push(M68kInst::Label("__sdk_unpack_used".into()));
+        insts.push(M68kInst::Directive(Directive::Space(4)));
+        insts.push(M68kInst::Label("__sdk_unpack_window".into()));
+        insts.push(M68kInst::Directive(Directive::Space(UNPACK_WINDOW as u32)));
+    }
+
+    if needs_op_offsets(functions)
+        || needs_sin_table(functions)
+        || needs_sqrt_table(functions)
+        || needs_z80_driver(functions)
+    {
+        insts.push(M68kInst::Directive(Directive::Section(SectionName::Rodata)));
+        insts.push(M68kInst::Directive(Directive::Align(4)));
     }
 
     if needs_op_offsets(functions) {
-        insts.push(M68kInst::Directive(".section .rodata".to_string()));
-        insts.push(M68kInst::Directive(".align 4".to_string()));
-        insts.push(M68kInst::Label("__sdk_op_offsets".to_string()));
-        insts.push(M68kInst::Directive(".long 0, 8, 4, 12".to_string()));
+        insts.push(M68kInst::Label("__sdk_op_offsets".into()));
+        for offset in [0, 8, 4, 12] {
+            insts.push(M68kInst::Directive(Directive::Long(offset)));
+        }
+    }
+
+    if needs_sin_table(functions) {
+        insts.push(M68kInst::Label(SIN_TABLE.into()));
+        for &value in fixed::SIN_TABLE.iter() {
+            insts.push(M68kInst::Directive(Directive::Word(value as u16)));
+        }
+    }
+
+    if needs_sqrt_table(functions) {
+        insts.push(M68kInst::Label(SQRT_TABLE.into()));
+        for &value in fixed::SQRT_TABLE.iter() {
+            insts.push(M68kInst::Directive(Directive::Byte(value)));
+        }
+    }
+
+    if needs_z80_driver(functions) {
+        insts.push(M68kInst::Label(Z80_DRIVER.into()));
+        for &byte in DRIVER.iter() {
+            insts.push(M68kInst::Directive(Directive::Byte(byte)));
+        }
     }
 
     insts
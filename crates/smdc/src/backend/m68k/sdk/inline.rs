@@ -1,9 +1,11 @@
 //! Inline code generation for simple SDK functions
 
+use super::library::SIN_TABLE;
 use super::{
     PSG_PORT, SRAM_BASE, SRAM_CTRL, VDP_CTRL, VDP_DATA, YM_ADDR0, YM_ADDR1, YM_DATA0, YM_DATA1,
 };
 use crate::backend::m68k::m68k::*;
+use crate::common::fixed;
 
 /// Generates inline M68k instructions for simple SDK functions
 pub struct SdkInlineGenerator;
@@ -48,6 +50,8 @@ impl SdkInlineGenerator {
 
             // Util inline functions
             "abs_val" => Self::gen_abs_val(),
+            "sin_fix" => Self::gen_sin_fix(0),
+            "cos_fix" => Self::gen_sin_fix(fixed::ANGLE_STEPS as i32 / 4),
 
             // VDP window inline functions
             "vdp_set_window_x" => Self::gen_vdp_set_window_x(),
@@ -536,12 +540,46 @@ impl SdkInlineGenerator {
     fn gen_abs_val() -> Vec<M68kInst> {
         vec![
             M68kInst::Tst(Size::Long, Operand::DataReg(DataReg::D0)),
-            M68kInst::Bcc(Cond::Ge, ".abs_done".to_string()),
+            M68kInst::Bcc(Cond::Ge, ".abs_done".into()),
             M68kInst::Neg(Size::Long, Operand::DataReg(DataReg::D0)),
-            M68kInst::Label(".abs_done".to_string()),
+            M68kInst::Label(".abs_done".into()),
         ]
     }
 
+    /// sin_fix(angle) -> SIN_TABLE[angle & 255], and cos_fix(angle) as the
+    /// sine a quarter turn on (`phase`)
+    /// Args: D0 = angle, Returns: D0 = 8.8 result
+    fn gen_sin_fix(phase: i32) -> Vec<M68kInst> {
+        let mut code = Vec::new();
+        if phase != 0 {
+            code.push(M68kInst::Addi(
+                Size::Long,
+                phase,
+                Operand::DataReg(DataReg::D0),
+            ));
+        }
+        code.extend([
+            M68kInst::Andi(
+                Size::Long,
+                fixed::ANGLE_STEPS as i32 - 1,
+                Operand::DataReg(DataReg::D0),
+            ),
+            M68kInst::Add(
+                Size::Word,
+                Operand::DataReg(DataReg::D0),
+                Operand::DataReg(DataReg::D0),
+            ),
+            M68kInst::Lea(Operand::Label(SIN_TABLE.into()), AddrReg::A0),
+            M68kInst::Move(
+                Size::Word,
+                Operand::Indexed(0, AddrReg::A0, DataReg::D0),
+                Operand::DataReg(DataReg::D0),
+            ),
+            M68kInst::Ext(Size::Long, DataReg::D0),
+        ]);
+        code
+    }
+
     // -------------------------------------------------------------------------
     // VDP Window Inline Functions
     // -------------------------------------------------------------------------
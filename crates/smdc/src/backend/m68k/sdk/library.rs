@@ -1,7 +1,65 @@
 //! Library code generation for complex SDK functions
 
-use super::{PSG_PORT, SRAM_BASE, VDP_CTRL, VDP_DATA, YM_ADDR0};
+use super::deps::{needs_dma_queue, needs_frame_counter, needs_sprite_table};
+use super::z80::driver::{
+    CMD_PLAY_SAMPLE, CMD_PLAY_SONG, CMD_STOP_SAMPLE, CMD_STOP_SONG, DRIVER, MAILBOX,
+};
+use super::{PSG_PORT, SRAM_BASE, VDP_CTRL, VDP_DATA, YM_ADDR0, Z80_BUS_REQ, Z80_RAM, Z80_RESET};
 use crate::backend::m68k::m68k::*;
+use crate::common::Symbol;
+use std::collections::HashSet;
+
+/// Label of the level-6 (VBlank) interrupt handler
+pub const VBLANK_HANDLER: &str = "__sdk_vblank";
+
+/// User function the VBlank handler calls every frame, when the program
+/// defines one
+pub const VBLANK_CALLBACK: &str = "vblank_handler";
+
+/// Per-frame VDP work `vdp_wait_vblank_start` runs once vblank has begun:
+/// queueing the sprite table and draining the DMA queue. It runs on the main
+/// thread because the VDP routines write a command and then its data with
+/// interrupts on, so the VBlank interrupt must leave the VDP ports alone.
+pub const VBLANK_WORK: &str = "__sdk_vblank_work";
+
+/// Entries in the DMA queue ring (a power of two)
+pub const DMA_QUEUE_LEN: usize = 32;
+
+/// Bytes of RAM `vdp_load_tiles_packed` unpacks into: two chunks, so one
+/// can unpack while the last waits for its DMA
+pub const UNPACK_WINDOW: usize = 2 * crate::asset::lz::CHUNK;
+
+/// Enqueue routine shared by the `dma_queue_*` calls
+const DMA_PUSH: &str = "__sdk_dma_push";
+
+/// Dirty-range update shared by the sprite_* calls, emitted with
+/// `sprite_flush`
+const SPRITE_MARK: &str = "__sdk_sprite_mark";
+
+/// ROM table of `sin_fix` results, one word per angle
+pub const SIN_TABLE: &str = "__sdk_sin_table";
+
+/// ROM table `sqrt_fix` looks its results up in, one byte per entry
+pub const SQRT_TABLE: &str = "__sdk_sqrt_table";
+
+/// ROM copy of the Z80 sound driver, which `snd_init` loads
+pub const Z80_DRIVER: &str = "__sdk_z80_driver";
+
+/// Mailbox wait shared by the `snd_*` commands, emitted with `snd_init`:
+/// returns with the Z80 bus held, the mailbox empty and A1 pointing at it
+const SND_POST: &str = "__sdk_snd_post";
+
+/// Bytes moved per unrolled iteration of the `mem_*` bulk loops
+const MEM_BLOCK: usize = 32;
+
+/// Internal entries of `mem_copy_w`, shared with `mem_copy`: the bulk copy
+/// (A0=src, A1=dst, D1=len, both even) and the byte loop (D0=count)
+const MEM_COPY_BULK: &str = "__sdk_mem_copy_bulk";
+const MEM_COPY_BYTES: &str = "__sdk_mem_copy_bytes";
+
+/// Internal entry of `mem_set_l`, shared with `mem_set` (A1=dst, D1=pattern,
+/// A0=len)
+const MEM_SET_BULK: &str = "__sdk_mem_set_bulk";
 
 /// Generates full M68k function bodies for complex SDK functions
 pub struct SdkLibraryGenerator {
@@ -13,10 +71,10 @@ impl SdkLibraryGenerator {
         Self { label_counter: 0 }
     }
 
-    fn next_label(&mut self, prefix: &str) -> String {
+    fn next_label(&mut self, prefix: &str) -> Symbol {
         let label = format!(".sdk_{}_{}", prefix, self.label_counter);
         self.label_counter += 1;
-        label
+        label.into()
     }
 
     /// Generate a complete function with prologue/epilogue
@@ -30,6 +88,7 @@ impl SdkLibraryGenerator {
             "vdp_wait_frame" => self.gen_vdp_wait_frame(),
             "vdp_load_palette" => self.gen_vdp_load_palette(),
             "vdp_load_tiles" => self.gen_vdp_load_tiles(),
+            "vdp_load_tiles_packed" => self.gen_vdp_load_tiles_packed(),
             "vdp_set_tile_a" => self.gen_vdp_set_tile_a(),
             "vdp_set_tile_b" => self.gen_vdp_set_tile_b(),
             "vdp_clear_plane_a" => self.gen_vdp_clear_plane_a(),
@@ -72,6 +131,7 @@ impl SdkLibraryGenerator {
             "sprite_clear" => self.gen_sprite_clear(),
             "sprite_clear_all" => self.gen_sprite_clear_all(),
             "sprite_set_link" => self.gen_sprite_set_link(),
+            "sprite_flush" => self.gen_sprite_flush(),
 
             // Input library functions
             "input_init" => self.gen_input_init(),
@@ -84,15 +144,32 @@ impl SdkLibraryGenerator {
 
             // Util library functions
             "mem_copy" => self.gen_mem_copy(),
+            "mem_copy_w" => self.gen_mem_copy_w(),
             "mem_set" => self.gen_mem_set(),
+            "mem_set_l" => self.gen_mem_set_l(),
             "rand_next" => self.gen_rand_next(),
             "rand_seed" => self.gen_rand_seed(),
+            "sqrt_fix" => self.gen_sqrt_fix(),
+
+            // Sound driver functions
+            "snd_init" => self.gen_snd_init(),
+            "snd_play_sample" => self.gen_snd_play_sample(),
+            "snd_stop_sample" => self.gen_snd_stop_sample(),
+            "snd_play_song" => self.gen_snd_play_song(),
+            "snd_stop_song" => self.gen_snd_stop_song(),
 
             // VDP DMA library functions
             "vdp_dma_transfer" => self.gen_vdp_dma_transfer(),
             "vdp_dma_fill" => self.gen_vdp_dma_fill(),
             "vdp_dma_copy" => self.gen_vdp_dma_copy(),
 
+            // DMA queue library functions
+            "dma_queue_transfer" => self.gen_dma_queue_transfer(),
+            "dma_queue_fill" => self.gen_dma_queue_fill(),
+            "dma_queue_copy" => self.gen_dma_queue_copy(),
+            "dma_queue_flush" => self.gen_dma_queue_flush(),
+            "dma_queue_clear" => self.gen_dma_queue_clear(),
+
             // VDP window library functions
             "vdp_set_tile_w" => self.gen_vdp_set_tile_w(),
 
@@ -106,7 +183,7 @@ impl SdkLibraryGenerator {
             _ => {
                 // For unimplemented functions, generate a stub
                 vec![
-                    M68kInst::Label(func_name.to_string()),
+                    M68kInst::Label(func_name.into()),
                     M68kInst::Comment(format!("TODO: implement {func_name}")),
                     M68kInst::Rts,
                 ]
@@ -114,13 +191,90 @@ impl SdkLibraryGenerator {
         }
     }
 
+    /// Generate the VBlank interrupt handler for a program using `functions`
+    ///
+    /// Counts the frame when the program uses the frame counter and calls the
+    /// user's `vblank_handler` if there is one. It never touches the VDP
+    /// itself: see [`VBLANK_WORK`]. Everything called follows the normal
+    /// convention, so only the scratch registers need saving here.
+    pub fn generate_vblank_handler(
+        &mut self,
+        functions: &HashSet<String>,
+        callback: bool,
+    ) -> Vec<M68kInst> {
+        let scratch = vec![
+            Reg::Data(DataReg::D0),
+            Reg::Data(DataReg::D1),
+            Reg::Addr(AddrReg::A0),
+            Reg::Addr(AddrReg::A1),
+        ];
+        let mut insts = vec![
+            M68kInst::Label(VBLANK_HANDLER.into()),
+            M68kInst::Movem(
+                Size::Long,
+                scratch.clone(),
+                Operand::PreDec(AddrReg::A7),
+                true,
+            ),
+        ];
+        if needs_frame_counter(functions) {
+            insts.extend([
+                M68kInst::Lea(Operand::Label("__sdk_frame_count".into()), AddrReg::A0),
+                M68kInst::Addq(Size::Long, 1, Operand::AddrInd(AddrReg::A0)),
+            ]);
+        }
+        if callback {
+            insts.push(M68kInst::Jsr(Operand::Label(VBLANK_CALLBACK.into())));
+        }
+        insts.extend([
+            M68kInst::Movem(Size::Long, scratch, Operand::PostInc(AddrReg::A7), false),
+            M68kInst::Rte,
+        ]);
+        insts
+    }
+
+    /// Generate [`VBLANK_WORK`] for a program using `functions`
+    ///
+    /// Queues the dirty part of the shadow sprite table, then drains the DMA
+    /// queue while most of vblank is still ahead. Callers of
+    /// `vdp_wait_vblank_start` only expect D0 and A0 to change, so the rest
+    /// of the scratch registers are saved.
+    pub fn generate_vblank_work(&mut self, functions: &HashSet<String>) -> Vec<M68kInst> {
+        let mut calls = Vec::new();
+        if needs_sprite_table(functions) {
+            calls.push(M68kInst::Jsr(Operand::Label("sprite_flush".into())));
+        }
+        if needs_dma_queue(functions) {
+            calls.push(M68kInst::Jsr(Operand::Label("dma_queue_flush".into())));
+        }
+        let mut insts = vec![M68kInst::Label(VBLANK_WORK.into())];
+        if !calls.is_empty() {
+            let saved = vec![Reg::Data(DataReg::D1), Reg::Addr(AddrReg::A1)];
+            insts.push(M68kInst::Movem(
+                Size::Long,
+                saved.clone(),
+                Operand::PreDec(AddrReg::A7),
+                true,
+            ));
+            insts.extend(calls);
+            insts.push(M68kInst::Movem(
+                Size::Long,
+                saved,
+                Operand::PostInc(AddrReg::A7),
+                false,
+            ));
+        }
+        insts.push(M68kInst::Rts);
+        insts
+    }
+
     // -------------------------------------------------------------------------
     // VDP Library Functions
     // -------------------------------------------------------------------------
 
     fn gen_vdp_init(&mut self) -> Vec<M68kInst> {
         let mut insts = vec![
-            M68kInst::Label("vdp_init".to_string()),
+            M68kInst::Label("vdp_init".into()),
             M68kInst::Lea(Operand::AbsLong(VDP_CTRL), AddrReg::A0),
         ];
 
@@ -129,9 +283,9 @@ impl SdkLibraryGenerator {
         // and enable display immediately
         let regs: [(i32, i32); 15] = [
             (0x00, 0x04),
-            (0x01, 0x44),
+            (0x01, 0x74),
             (0x02, 0x30),
-            (0x03, 0x3C), // 0x01=0x44: display ON
+            (0x03, 0x3C), // 0x01=0x74: display ON, VBlank interrupt ON, DMA ON
             (0x04, 0x07),
             (0x05, 0x78),
             (0x07, 0x00),
@@ -156,7 +310,7 @@ impl SdkLibraryGenerator {
 
         // Reset frame counter
         insts.extend([
-            M68kInst::Lea(Operand::Label("__sdk_frame_count".to_string()), AddrReg::A0),
+            M68kInst::Lea(Operand::Label("__sdk_frame_count".into()), AddrReg::A0),
             M68kInst::Clr(Size::Long, Operand::AddrInd(AddrReg::A0)),
             M68kInst::Rts,
         ]);
@@ -166,43 +320,33 @@ impl SdkLibraryGenerator {
 
     fn gen_vdp_vsync(&mut self) -> Vec<M68kInst> {
         vec![
-            M68kInst::Label("vdp_vsync".to_string()),
-            M68kInst::Bra("vdp_wait_vblank_start".to_string()),
+            M68kInst::Label("vdp_vsync".into()),
+            M68kInst::Bra("vdp_wait_vblank_start".into()),
         ]
     }
 
     fn gen_vdp_wait_vblank_start(&mut self) -> Vec<M68kInst> {
-        let wait_not = self.next_label("vwvs_not");
-        let wait_in = self.next_label("vwvs_in");
+        let wait = self.next_label("vwvs_wait");
 
-        // Note: Must read status as WORD and test bit in register.
-        // BTST on memory does a byte read, which at even address 0xC00004
-        // reads the HIGH byte (bits 8-15), missing the VBlank flag in bit 3.
+        // The VBlank interrupt bumps the frame counter, so waiting for the
+        // next vblank is waiting for the counter to change. The frame's VDP
+        // work then runs from here rather than in the interrupt.
         vec![
-            M68kInst::Label("vdp_wait_vblank_start".to_string()),
-            M68kInst::Lea(Operand::AbsLong(VDP_CTRL), AddrReg::A0),
-            // Wait until NOT in VBlank
-            M68kInst::Label(wait_not.clone()),
+            M68kInst::Label("vdp_wait_vblank_start".into()),
+            M68kInst::Lea(Operand::Label("__sdk_frame_count".into()), AddrReg::A0),
             M68kInst::Move(
-                Size::Word,
+                Size::Long,
                 Operand::AddrInd(AddrReg::A0),
                 Operand::DataReg(DataReg::D0),
             ),
-            M68kInst::Btst(Operand::Imm(3), Operand::DataReg(DataReg::D0)),
-            M68kInst::Bcc(Cond::Ne, wait_not),
-            // Wait until IN VBlank
-            M68kInst::Label(wait_in.clone()),
-            M68kInst::Move(
-                Size::Word,
+            M68kInst::Label(wait),
+            M68kInst::Cmp(
+                Size::Long,
                 Operand::AddrInd(AddrReg::A0),
                 Operand::DataReg(DataReg::D0),
             ),
-            M68kInst::Btst(Operand::Imm(3), Operand::DataReg(DataReg::D0)),
-            M68kInst::Bcc(Cond::Eq, wait_in),
-            // Increment frame counter
-            M68kInst::Lea(Operand::Label("__sdk_frame_count".to_string()), AddrReg::A0),
-            M68kInst::Addq(Size::Long, 1, Operand::AddrInd(AddrReg::A0)),
-            M68kInst::Rts,
+            M68kInst::Bcc(Cond::Eq, wait),
+            M68kInst::Bra(VBLANK_WORK.into()),
         ]
     }
 
@@ -214,10 +358,10 @@ impl SdkLibraryGenerator {
         // BTST on memory does a byte read, which at even address 0xC00004
         // reads the HIGH byte (bits 8-15), missing the VBlank flag in bit 3.
         vec![
-            M68kInst::Label("vdp_wait_vblank_end".to_string()),
+            M68kInst::Label("vdp_wait_vblank_end".into()),
             M68kInst::Lea(Operand::AbsLong(VDP_CTRL), AddrReg::A0),
             // Wait until IN VBlank
-            M68kInst::Label(wait_in.clone()),
+            M68kInst::Label(wait_in),
             M68kInst::Move(
                 Size::Word,
                 Operand::AddrInd(AddrReg::A0),
@@ -226,7 +370,7 @@ impl SdkLibraryGenerator {
             M68kInst::Btst(Operand::Imm(3), Operand::DataReg(DataReg::D0)),
             M68kInst::Bcc(Cond::Eq, wait_in),
             // Wait until out of VBlank
-            M68kInst::Label(wait_out.clone()),
+            M68kInst::Label(wait_out),
             M68kInst::Move(
                 Size::Word,
                 Operand::AddrInd(AddrReg::A0),
@@ -240,9 +384,9 @@ impl SdkLibraryGenerator {
 
     fn gen_vdp_wait_frame(&mut self) -> Vec<M68kInst> {
         vec![
-            M68kInst::Label("vdp_wait_frame".to_string()),
-            M68kInst::Bsr("vdp_wait_vblank_start".to_string()),
-            M68kInst::Bra("vdp_wait_vblank_end".to_string()),
+            M68kInst::Label("vdp_wait_frame".into()),
+            M68kInst::Bsr("vdp_wait_vblank_start".into()),
+            M68kInst::Bra("vdp_wait_vblank_end".into()),
         ]
     }
 
@@ -251,7 +395,7 @@ impl SdkLibraryGenerator {
         let loop_label = self.next_label("vlp_loop");
 
         vec![
-            M68kInst::Label("vdp_load_palette".to_string()),
+            M68kInst::Label("vdp_load_palette".into()),
             M68kInst::Link(AddrReg::A6, 0),
             // Set CRAM address
             M68kInst::Move(
@@ -284,16 +428,16 @@ impl SdkLibraryGenerator {
                 Operand::DataReg(DataReg::D1),
             ),
             M68kInst::Subq(Size::Long, 1, Operand::DataReg(DataReg::D1)),
-            M68kInst::Bcc(Cond::Mi, ".vlp_done".to_string()),
+            M68kInst::Bcc(Cond::Mi, ".vlp_done".into()),
             // Loop
-            M68kInst::Label(loop_label.clone()),
+            M68kInst::Label(loop_label),
             M68kInst::Move(
                 Size::Word,
                 Operand::PostInc(AddrReg::A0),
                 Operand::AbsLong(VDP_DATA),
             ),
             M68kInst::Dbf(DataReg::D1, loop_label),
-            M68kInst::Label(".vlp_done".to_string()),
+            M68kInst::Label(".vlp_done".into()),
             M68kInst::Unlk(AddrReg::A6),
             M68kInst::Rts,
         ]
@@ -304,7 +448,7 @@ impl SdkLibraryGenerator {
         let loop_label = self.next_label("vlt_loop");
 
         vec![
-            M68kInst::Label("vdp_load_tiles".to_string()),
+            M68kInst::Label("vdp_load_tiles".into()),
             M68kInst::Link(AddrReg::A6, 0),
             // Calculate VRAM address: index * 32
             M68kInst::Move(
@@ -347,16 +491,16 @@ impl SdkLibraryGenerator {
             ),
             M68kInst::Lsl(Size::Long, Operand::Imm(4), DataReg::D1),
             M68kInst::Subq(Size::Long, 1, Operand::DataReg(DataReg::D1)),
-            M68kInst::Bcc(Cond::Mi, ".vlt_done".to_string()),
+            M68kInst::Bcc(Cond::Mi, ".vlt_done".into()),
             // Loop
-            M68kInst::Label(loop_label.clone()),
+            M68kInst::Label(loop_label),
             M68kInst::Move(
                 Size::Word,
                 Operand::PostInc(AddrReg::A0),
                 Operand::AbsLong(VDP_DATA),
             ),
             M68kInst::Dbf(DataReg::D1, loop_label),
-            M68kInst::Label(".vlt_done".to_string()),
+            M68kInst::Label(".vlt_done".into()),
             M68kInst::Unlk(AddrReg::A6),
             M68kInst::Rts,
         ]
@@ -365,7 +509,7 @@ impl SdkLibraryGenerator {
     fn gen_vdp_set_tile_a(&mut self) -> Vec<M68kInst> {
         // Args: 8(a6)=x, 12(a6)=y, 16(a6)=tile
         vec![
-            M68kInst::Label("vdp_set_tile_a".to_string()),
+            M68kInst::Label("vdp_set_tile_a".into()),
             M68kInst::Link(AddrReg::A6, 0),
             // addr = VRAM_PLANE_A + (y * 128) + (x * 2)
             // VRAM_PLANE_A = 0xC000
@@ -430,7 +574,7 @@ impl SdkLibraryGenerator {
     fn gen_vdp_set_tile_b(&mut self) -> Vec<M68kInst> {
         // Same as tile_a but with VRAM_PLANE_B = 0xE000
         vec![
-            M68kInst::Label("vdp_set_tile_b".to_string()),
+            M68kInst::Label("vdp_set_tile_b".into()),
             M68kInst::Link(AddrReg::A6, 0),
             M68kInst::Move(
                 Size::Long,
@@ -493,7 +637,7 @@ impl SdkLibraryGenerator {
         let loop_label = self.next_label("vcpa_loop");
 
         vec![
-            M68kInst::Label("vdp_clear_plane_a".to_string()),
+            M68kInst::Label("vdp_clear_plane_a".into()),
             // Set write address to VRAM_PLANE_A (0xC000)
             M68kInst::Move(Size::Word, Operand::Imm(0x4000), Operand::AbsLong(VDP_CTRL)),
             M68kInst::Move(Size::Word, Operand::Imm(0x0003), Operand::AbsLong(VDP_CTRL)),
@@ -503,7 +647,7 @@ impl SdkLibraryGenerator {
                 Operand::Imm(2047),
                 Operand::DataReg(DataReg::D0),
             ),
-            M68kInst::Label(loop_label.clone()),
+            M68kInst::Label(loop_label),
             M68kInst::Clr(Size::Word, Operand::AbsLong(VDP_DATA)),
             M68kInst::Dbf(DataReg::D0, loop_label),
             M68kInst::Rts,
@@ -514,7 +658,7 @@ impl SdkLibraryGenerator {
         let loop_label = self.next_label("vcpb_loop");
 
         vec![
-            M68kInst::Label("vdp_clear_plane_b".to_string()),
+            M68kInst::Label("vdp_clear_plane_b".into()),
             // Set write address to VRAM_PLANE_B (0xE000)
             M68kInst::Move(Size::Word, Operand::Imm(0x6000), Operand::AbsLong(VDP_CTRL)),
             M68kInst::Move(Size::Word, Operand::Imm(0x0003), Operand::AbsLong(VDP_CTRL)),
@@ -524,7 +668,7 @@ impl SdkLibraryGenerator {
                 Operand::Imm(2047),
                 Operand::DataReg(DataReg::D0),
             ),
-            M68kInst::Label(loop_label.clone()),
+            M68kInst::Label(loop_label),
             M68kInst::Clr(Size::Word, Operand::AbsLong(VDP_DATA)),
             M68kInst::Dbf(DataReg::D0, loop_label),
             M68kInst::Rts,
@@ -535,7 +679,7 @@ impl SdkLibraryGenerator {
         // VRAM_HSCROLL = 0xFC00
         // Arg on stack as 32-bit long: 4(SP)=value, low word at 6(SP)
         vec![
-            M68kInst::Label("vdp_set_hscroll_a".to_string()),
+            M68kInst::Label("vdp_set_hscroll_a".into()),
             M68kInst::Move(Size::Word, Operand::Imm(0x7C00), Operand::AbsLong(VDP_CTRL)),
             M68kInst::Move(Size::Word, Operand::Imm(0x0003), Operand::AbsLong(VDP_CTRL)),
             M68kInst::Move(
@@ -550,7 +694,7 @@ impl SdkLibraryGenerator {
     fn gen_vdp_set_hscroll_b(&mut self) -> Vec<M68kInst> {
         // Arg on stack as 32-bit long: 4(SP)=value, low word at 6(SP)
         vec![
-            M68kInst::Label("vdp_set_hscroll_b".to_string()),
+            M68kInst::Label("vdp_set_hscroll_b".into()),
             M68kInst::Move(Size::Word, Operand::Imm(0x7C02), Operand::AbsLong(VDP_CTRL)),
             M68kInst::Move(Size::Word, Operand::Imm(0x0003), Operand::AbsLong(VDP_CTRL)),
             M68kInst::Move(
@@ -565,7 +709,7 @@ impl SdkLibraryGenerator {
     fn gen_vdp_set_vscroll_a(&mut self) -> Vec<M68kInst> {
         // Arg on stack as 32-bit long: 4(SP)=value, low word at 6(SP)
         vec![
-            M68kInst::Label("vdp_set_vscroll_a".to_string()),
+            M68kInst::Label("vdp_set_vscroll_a".into()),
             M68kInst::Move(Size::Word, Operand::Imm(0x4000), Operand::AbsLong(VDP_CTRL)),
             M68kInst::Move(Size::Word, Operand::Imm(0x0010), Operand::AbsLong(VDP_CTRL)),
             M68kInst::Move(
@@ -580,7 +724,7 @@ impl SdkLibraryGenerator {
     fn gen_vdp_set_vscroll_b(&mut self) -> Vec<M68kInst> {
         // Arg on stack as 32-bit long: 4(SP)=value, low word at 6(SP)
         vec![
-            M68kInst::Label("vdp_set_vscroll_b".to_string()),
+            M68kInst::Label("vdp_set_vscroll_b".into()),
             M68kInst::Move(Size::Word, Operand::Imm(0x4002), Operand::AbsLong(VDP_CTRL)),
             M68kInst::Move(Size::Word, Operand::Imm(0x0010), Operand::AbsLong(VDP_CTRL)),
             M68kInst::Move(
@@ -594,10 +738,10 @@ impl SdkLibraryGenerator {
 
     fn gen_vdp_get_frame_count(&mut self) -> Vec<M68kInst> {
         vec![
-            M68kInst::Label("vdp_get_frame_count".to_string()),
+            M68kInst::Label("vdp_get_frame_count".into()),
             M68kInst::Move(
                 Size::Long,
-                Operand::Label("__sdk_frame_count".to_string()),
+                Operand::Label("__sdk_frame_count".into()),
                 Operand::DataReg(DataReg::D0),
             ),
             M68kInst::Rts,
@@ -606,8 +750,8 @@ impl SdkLibraryGenerator {
 
     fn gen_vdp_reset_frame_count(&mut self) -> Vec<M68kInst> {
         vec![
-            M68kInst::Label("vdp_reset_frame_count".to_string()),
-            M68kInst::Clr(Size::Long, Operand::Label("__sdk_frame_count".to_string())),
+            M68kInst::Label("vdp_reset_frame_count".into()),
+            M68kInst::Clr(Size::Long, Operand::Label("__sdk_frame_count".into())),
             M68kInst::Rts,
         ]
     }
@@ -622,37 +766,37 @@ impl SdkLibraryGenerator {
         let tl_loop_op = self.next_label("ymi_tl_op");
 
         vec![
-            M68kInst::Label("ym_init".to_string()),
+            M68kInst::Label("ym_init".into()),
             M68kInst::Link(AddrReg::A6, -8),
             // Disable LFO
             M68kInst::Moveq(0x22, DataReg::D0),
             M68kInst::Clr(Size::Long, Operand::DataReg(DataReg::D1)),
-            M68kInst::Bsr("ym_write0".to_string()),
+            M68kInst::Bsr("ym_write0".into()),
             // Disable timer control
             M68kInst::Moveq(0x27, DataReg::D0),
             M68kInst::Clr(Size::Long, Operand::DataReg(DataReg::D1)),
-            M68kInst::Bsr("ym_write0".to_string()),
+            M68kInst::Bsr("ym_write0".into()),
             // Disable DAC
             M68kInst::Moveq(0x2B, DataReg::D0),
             M68kInst::Clr(Size::Long, Operand::DataReg(DataReg::D1)),
-            M68kInst::Bsr("ym_write0".to_string()),
+            M68kInst::Bsr("ym_write0".into()),
             // Key off all channels
             M68kInst::Clr(Size::Long, Operand::DataReg(DataReg::D7)),
-            M68kInst::Label(keyoff_loop.clone()),
+            M68kInst::Label(keyoff_loop),
             M68kInst::Move(
                 Size::Long,
                 Operand::DataReg(DataReg::D7),
                 Operand::DataReg(DataReg::D0),
             ),
-            M68kInst::Bsr("ym_key_off".to_string()),
+            M68kInst::Bsr("ym_key_off".into()),
             M68kInst::Addq(Size::Long, 1, Operand::DataReg(DataReg::D7)),
             M68kInst::Cmpi(Size::Long, 6, Operand::DataReg(DataReg::D7)),
             M68kInst::Bcc(Cond::Lt, keyoff_loop),
             // Set all TL to 0x7F (max attenuation)
             M68kInst::Clr(Size::Long, Operand::DataReg(DataReg::D7)), // channel
-            M68kInst::Label(tl_loop_ch.clone()),
+            M68kInst::Label(tl_loop_ch),
             M68kInst::Clr(Size::Long, Operand::DataReg(DataReg::D6)), // operator
-            M68kInst::Label(tl_loop_op.clone()),
+            M68kInst::Label(tl_loop_op),
             M68kInst::Move(
                 Size::Long,
                 Operand::DataReg(DataReg::D7),
@@ -665,7 +809,7 @@ impl SdkLibraryGenerator {
             ),
             M68kInst::Moveq(0x40, DataReg::D2), // TL register base
             M68kInst::Moveq(0x7F, DataReg::D3), // max attenuation
-            M68kInst::Bsr("ym_write_op".to_string()),
+            M68kInst::Bsr("ym_write_op".into()),
             M68kInst::Addq(Size::Long, 1, Operand::DataReg(DataReg::D6)),
             M68kInst::Cmpi(Size::Long, 4, Operand::DataReg(DataReg::D6)),
             M68kInst::Bcc(Cond::Lt, tl_loop_op),
@@ -679,8 +823,8 @@ impl SdkLibraryGenerator {
 
     fn gen_ym_reset(&mut self) -> Vec<M68kInst> {
         vec![
-            M68kInst::Label("ym_reset".to_string()),
-            M68kInst::Bra("ym_init".to_string()),
+            M68kInst::Label("ym_reset".into()),
+            M68kInst::Bra("ym_init".into()),
         ]
     }
 
@@ -688,8 +832,8 @@ impl SdkLibraryGenerator {
         let wait_loop = self.next_label("ymw_loop");
 
         vec![
-            M68kInst::Label("ym_wait".to_string()),
-            M68kInst::Label(wait_loop.clone()),
+            M68kInst::Label("ym_wait".into()),
+            M68kInst::Label(wait_loop),
             M68kInst::Btst(Operand::Imm(7), Operand::AbsLong(YM_ADDR0)),
             M68kInst::Bcc(Cond::Ne, wait_loop),
             M68kInst::Rts,
@@ -701,7 +845,7 @@ impl SdkLibraryGenerator {
         let use_port1 = self.next_label("ywc_p1");
 
         vec![
-            M68kInst::Label("ym_write_ch".to_string()),
+            M68kInst::Label("ym_write_ch".into()),
             M68kInst::Link(AddrReg::A6, 0),
             M68kInst::Move(
                 Size::Long,
@@ -720,7 +864,7 @@ impl SdkLibraryGenerator {
             ),
             // Check if ch >= 3
             M68kInst::Cmpi(Size::Long, 3, Operand::DataReg(DataReg::D0)),
-            M68kInst::Bcc(Cond::Ge, use_port1.clone()),
+            M68kInst::Bcc(Cond::Ge, use_port1),
             // Port 0: reg + ch
             M68kInst::Add(
                 Size::Long,
@@ -738,7 +882,7 @@ impl SdkLibraryGenerator {
                 Operand::DataReg(DataReg::D1),
             ),
             M68kInst::Unlk(AddrReg::A6),
-            M68kInst::Bra("ym_write0".to_string()),
+            M68kInst::Bra("ym_write0".into()),
             // Port 1: reg + (ch - 3)
             M68kInst::Label(use_port1),
             M68kInst::Subq(Size::Long, 3, Operand::DataReg(DataReg::D0)),
@@ -758,7 +902,7 @@ impl SdkLibraryGenerator {
                 Operand::DataReg(DataReg::D1),
             ),
             M68kInst::Unlk(AddrReg::A6),
-            M68kInst::Bra("ym_write1".to_string()),
+            M68kInst::Bra("ym_write1".into()),
         ]
     }
 
@@ -767,7 +911,7 @@ impl SdkLibraryGenerator {
         let use_port1 = self.next_label("ywo_p1");
 
         vec![
-            M68kInst::Label("ym_write_op".to_string()),
+            M68kInst::Label("ym_write_op".into()),
             M68kInst::Link(AddrReg::A6, 0),
             // Get operator offset: [0, 8, 4, 12]
             M68kInst::Move(
@@ -775,7 +919,7 @@ impl SdkLibraryGenerator {
                 Operand::Disp(12, AddrReg::A6),
                 Operand::DataReg(DataReg::D0),
             ),
-            M68kInst::Lea(Operand::Label("__sdk_op_offsets".to_string()), AddrReg::A0),
+            M68kInst::Lea(Operand::Label("__sdk_op_offsets".into()), AddrReg::A0),
             M68kInst::Lsl(Size::Long, Operand::Imm(2), DataReg::D0),
             M68kInst::Move(
                 Size::Long,
@@ -806,7 +950,7 @@ impl SdkLibraryGenerator {
             ),
             // Check port
             M68kInst::Cmpi(Size::Long, 3, Operand::DataReg(DataReg::D0)),
-            M68kInst::Bcc(Cond::Ge, use_port1.clone()),
+            M68kInst::Bcc(Cond::Ge, use_port1),
             // Port 0
             M68kInst::Add(
                 Size::Long,
@@ -824,7 +968,7 @@ impl SdkLibraryGenerator {
                 Operand::DataReg(DataReg::D1),
             ),
             M68kInst::Unlk(AddrReg::A6),
-            M68kInst::Bra("ym_write0".to_string()),
+            M68kInst::Bra("ym_write0".into()),
             // Port 1
             M68kInst::Label(use_port1),
             M68kInst::Subq(Size::Long, 3, Operand::DataReg(DataReg::D0)),
@@ -844,7 +988,7 @@ impl SdkLibraryGenerator {
                 Operand::DataReg(DataReg::D1),
             ),
             M68kInst::Unlk(AddrReg::A6),
-            M68kInst::Bra("ym_write1".to_string()),
+            M68kInst::Bra("ym_write1".into()),
         ]
     }
 
@@ -853,7 +997,7 @@ impl SdkLibraryGenerator {
         let ch_hi = self.next_label("ykon_hi");
 
         vec![
-            M68kInst::Label("ym_key_on".to_string()),
+            M68kInst::Label("ym_key_on".into()),
             // Calculate slot: ch < 3 ? ch : (ch - 3) | 4
             M68kInst::Move(
                 Size::Long,
@@ -861,16 +1005,16 @@ impl SdkLibraryGenerator {
                 Operand::DataReg(DataReg::D1),
             ),
             M68kInst::Cmpi(Size::Long, 3, Operand::DataReg(DataReg::D1)),
-            M68kInst::Bcc(Cond::Ge, ch_hi.clone()),
-            M68kInst::Bra(".ykon_write".to_string()),
+            M68kInst::Bcc(Cond::Ge, ch_hi),
+            M68kInst::Bra(".ykon_write".into()),
             M68kInst::Label(ch_hi),
             M68kInst::Subq(Size::Long, 3, Operand::DataReg(DataReg::D1)),
             M68kInst::Ori(Size::Long, 4, Operand::DataReg(DataReg::D1)),
-            M68kInst::Label(".ykon_write".to_string()),
+            M68kInst::Label(".ykon_write".into()),
             // Set all operators on: 0xF0 | slot
             M68kInst::Ori(Size::Long, 0xF0, Operand::DataReg(DataReg::D1)),
             M68kInst::Moveq(0x28, DataReg::D0),
-            M68kInst::Bra("ym_write0".to_string()),
+            M68kInst::Bra("ym_write0".into()),
         ]
     }
 
@@ -878,22 +1022,22 @@ impl SdkLibraryGenerator {
         let ch_hi = self.next_label("ykof_hi");
 
         vec![
-            M68kInst::Label("ym_key_off".to_string()),
+            M68kInst::Label("ym_key_off".into()),
             M68kInst::Move(
                 Size::Long,
                 Operand::Disp(4, AddrReg::A7),
                 Operand::DataReg(DataReg::D1),
             ),
             M68kInst::Cmpi(Size::Long, 3, Operand::DataReg(DataReg::D1)),
-            M68kInst::Bcc(Cond::Ge, ch_hi.clone()),
-            M68kInst::Bra(".ykof_write".to_string()),
+            M68kInst::Bcc(Cond::Ge, ch_hi),
+            M68kInst::Bra(".ykof_write".into()),
             M68kInst::Label(ch_hi),
             M68kInst::Subq(Size::Long, 3, Operand::DataReg(DataReg::D1)),
             M68kInst::Ori(Size::Long, 4, Operand::DataReg(DataReg::D1)),
-            M68kInst::Label(".ykof_write".to_string()),
+            M68kInst::Label(".ykof_write".into()),
             // All operators off: just slot, no 0xF0
             M68kInst::Moveq(0x28, DataReg::D0),
-            M68kInst::Bra("ym_write0".to_string()),
+            M68kInst::Bra("ym_write0".into()),
         ]
     }
 
@@ -901,7 +1045,7 @@ impl SdkLibraryGenerator {
         let ch_hi = self.next_label("ykoo_hi");
 
         vec![
-            M68kInst::Label("ym_key_on_ops".to_string()),
+            M68kInst::Label("ym_key_on_ops".into()),
             // Args: 4(a7)=ch, 8(a7)=ops
             M68kInst::Move(
                 Size::Long,
@@ -909,12 +1053,12 @@ impl SdkLibraryGenerator {
                 Operand::DataReg(DataReg::D1),
             ),
             M68kInst::Cmpi(Size::Long, 3, Operand::DataReg(DataReg::D1)),
-            M68kInst::Bcc(Cond::Ge, ch_hi.clone()),
-            M68kInst::Bra(".ykoo_write".to_string()),
+            M68kInst::Bcc(Cond::Ge, ch_hi),
+            M68kInst::Bra(".ykoo_write".into()),
             M68kInst::Label(ch_hi),
             M68kInst::Subq(Size::Long, 3, Operand::DataReg(DataReg::D1)),
             M68kInst::Ori(Size::Long, 4, Operand::DataReg(DataReg::D1)),
-            M68kInst::Label(".ykoo_write".to_string()),
+            M68kInst::Label(".ykoo_write".into()),
             // Combine ops << 4 with slot
             M68kInst::Move(
                 Size::Long,
@@ -928,14 +1072,14 @@ impl SdkLibraryGenerator {
                 Operand::DataReg(DataReg::D1),
             ),
             M68kInst::Moveq(0x28, DataReg::D0),
-            M68kInst::Bra("ym_write0".to_string()),
+            M68kInst::Bra("ym_write0".into()),
         ]
     }
 
     fn gen_ym_set_freq(&mut self) -> Vec<M68kInst> {
         // Args: 8(a6)=ch, 12(a6)=block, 16(a6)=fnum
         vec![
-            M68kInst::Label("ym_set_freq".to_string()),
+            M68kInst::Label("ym_set_freq".into()),
             M68kInst::Link(AddrReg::A6, 0),
             // Build freq_hi: (block << 3) | (fnum >> 8)
             M68kInst::Move(
@@ -988,7 +1132,7 @@ impl SdkLibraryGenerator {
                 Operand::DataReg(DataReg::D3),
                 Operand::PreDec(AddrReg::A7),
             ),
-            M68kInst::Bsr("ym_write_ch".to_string()),
+            M68kInst::Bsr("ym_write_ch".into()),
             M68kInst::Adda(Size::Long, Operand::Imm(12), AddrReg::A7),
             // Write freq_lo (reg 0xA0)
             M68kInst::Move(
@@ -1003,7 +1147,7 @@ impl SdkLibraryGenerator {
                 Operand::DataReg(DataReg::D4),
                 Operand::PreDec(AddrReg::A7),
             ),
-            M68kInst::Bsr("ym_write_ch".to_string()),
+            M68kInst::Bsr("ym_write_ch".into()),
             M68kInst::Adda(Size::Long, Operand::Imm(12), AddrReg::A7),
             M68kInst::Unlk(AddrReg::A6),
             M68kInst::Rts,
@@ -1013,7 +1157,7 @@ impl SdkLibraryGenerator {
     fn gen_ym_set_algo(&mut self) -> Vec<M68kInst> {
         // Args: 8(a6)=ch, 12(a6)=algo, 16(a6)=feedback
         vec![
-            M68kInst::Label("ym_set_algo".to_string()),
+            M68kInst::Label("ym_set_algo".into()),
             M68kInst::Link(AddrReg::A6, 0),
             // val = (feedback << 3) | algo
             M68kInst::Move(
@@ -1044,7 +1188,7 @@ impl SdkLibraryGenerator {
                 Operand::DataReg(DataReg::D0),
                 Operand::PreDec(AddrReg::A7),
             ),
-            M68kInst::Bsr("ym_write_ch".to_string()),
+            M68kInst::Bsr("ym_write_ch".into()),
             M68kInst::Adda(Size::Long, Operand::Imm(12), AddrReg::A7),
             M68kInst::Unlk(AddrReg::A6),
             M68kInst::Rts,
@@ -1054,7 +1198,7 @@ impl SdkLibraryGenerator {
     fn gen_ym_set_pan(&mut self) -> Vec<M68kInst> {
         // Args: 8(a6)=ch, 12(a6)=pan
         vec![
-            M68kInst::Label("ym_set_pan".to_string()),
+            M68kInst::Label("ym_set_pan".into()),
             M68kInst::Link(AddrReg::A6, 0),
             // ym_write_ch(ch, 0xB4, pan)
             M68kInst::Move(
@@ -1068,7 +1212,7 @@ impl SdkLibraryGenerator {
                 Operand::Disp(12, AddrReg::A6),
                 Operand::PreDec(AddrReg::A7),
             ),
-            M68kInst::Bsr("ym_write_ch".to_string()),
+            M68kInst::Bsr("ym_write_ch".into()),
             M68kInst::Adda(Size::Long, Operand::Imm(12), AddrReg::A7),
             M68kInst::Unlk(AddrReg::A6),
             M68kInst::Rts,
@@ -1078,7 +1222,7 @@ impl SdkLibraryGenerator {
     fn gen_ym_set_volume(&mut self) -> Vec<M68kInst> {
         // Args: 8(a6)=ch, 12(a6)=vol -> set TL of operator 3 (carrier)
         vec![
-            M68kInst::Label("ym_set_volume".to_string()),
+            M68kInst::Label("ym_set_volume".into()),
             M68kInst::Link(AddrReg::A6, 0),
             // ym_write_op(ch, 3, 0x40, vol)
             M68kInst::Move(
@@ -1093,7 +1237,7 @@ impl SdkLibraryGenerator {
                 Operand::Disp(12, AddrReg::A6),
                 Operand::PreDec(AddrReg::A7),
             ),
-            M68kInst::Bsr("ym_write_op".to_string()),
+            M68kInst::Bsr("ym_write_op".into()),
             M68kInst::Adda(Size::Long, Operand::Imm(16), AddrReg::A7),
             M68kInst::Unlk(AddrReg::A6),
             M68kInst::Rts,
@@ -1103,14 +1247,14 @@ impl SdkLibraryGenerator {
     fn gen_ym_set_lfo(&mut self) -> Vec<M68kInst> {
         // Arg: 4(a7)=mode
         vec![
-            M68kInst::Label("ym_set_lfo".to_string()),
+            M68kInst::Label("ym_set_lfo".into()),
             M68kInst::Moveq(0x22, DataReg::D0),
             M68kInst::Move(
                 Size::Long,
                 Operand::Disp(4, AddrReg::A7),
                 Operand::DataReg(DataReg::D1),
             ),
-            M68kInst::Bra("ym_write0".to_string()),
+            M68kInst::Bra("ym_write0".into()),
         ]
     }
 
@@ -1120,15 +1264,15 @@ impl SdkLibraryGenerator {
 
     fn gen_psg_init(&mut self) -> Vec<M68kInst> {
         vec![
-            M68kInst::Label("psg_init".to_string()),
-            M68kInst::Bra("psg_stop".to_string()),
+            M68kInst::Label("psg_init".into()),
+            M68kInst::Bra("psg_stop".into()),
         ]
     }
 
     fn gen_psg_set_tone(&mut self) -> Vec<M68kInst> {
         // Args: 4(a7)=channel, 8(a7)=divider
         vec![
-            M68kInst::Label("psg_set_tone".to_string()),
+            M68kInst::Label("psg_set_tone".into()),
             // Latch byte: 0x80 | (channel << 5) | (divider & 0x0F)
             M68kInst::Move(
                 Size::Long,
@@ -1175,7 +1319,7 @@ impl SdkLibraryGenerator {
         // Args: 4(a7)=channel, 8(a7)=freq
         // divider = 3579545 / (32 * freq)
         vec![
-            M68kInst::Label("psg_set_freq".to_string()),
+            M68kInst::Label("psg_set_freq".into()),
             M68kInst::Link(AddrReg::A6, 0),
             // freq in D1
             M68kInst::Move(
@@ -1185,9 +1329,9 @@ impl SdkLibraryGenerator {
             ),
             // Clamp freq >= 1
             M68kInst::Tst(Size::Long, Operand::DataReg(DataReg::D1)),
-            M68kInst::Bcc(Cond::Gt, ".psf_calc".to_string()),
+            M68kInst::Bcc(Cond::Gt, ".psf_calc".into()),
             M68kInst::Moveq(1, DataReg::D1),
-            M68kInst::Label(".psf_calc".to_string()),
+            M68kInst::Label(".psf_calc".into()),
             // 32 * freq
             M68kInst::Lsl(Size::Long, Operand::Imm(5), DataReg::D1),
             // 3579545 / (32 * freq)
@@ -1200,13 +1344,13 @@ impl SdkLibraryGenerator {
             M68kInst::Andi(Size::Long, 0xFFFF, Operand::DataReg(DataReg::D0)),
             // Clamp to 1023
             M68kInst::Cmpi(Size::Long, 1023, Operand::DataReg(DataReg::D0)),
-            M68kInst::Bcc(Cond::Le, ".psf_ok".to_string()),
+            M68kInst::Bcc(Cond::Le, ".psf_ok".into()),
             M68kInst::Move(
                 Size::Long,
                 Operand::Imm(1023),
                 Operand::DataReg(DataReg::D0),
             ),
-            M68kInst::Label(".psf_ok".to_string()),
+            M68kInst::Label(".psf_ok".into()),
             // Call psg_set_tone(channel, divider)
             M68kInst::Move(
                 Size::Long,
@@ -1218,7 +1362,7 @@ impl SdkLibraryGenerator {
                 Operand::DataReg(DataReg::D0),
                 Operand::PreDec(AddrReg::A7),
             ),
-            M68kInst::Bsr("psg_set_tone".to_string()),
+            M68kInst::Bsr("psg_set_tone".into()),
             M68kInst::Addq(Size::Long, 8, Operand::AddrReg(AddrReg::A7)),
             M68kInst::Unlk(AddrReg::A6),
             M68kInst::Rts,
@@ -1227,7 +1371,7 @@ impl SdkLibraryGenerator {
 
     fn gen_psg_stop(&mut self) -> Vec<M68kInst> {
         vec![
-            M68kInst::Label("psg_stop".to_string()),
+            M68kInst::Label("psg_stop".into()),
             // Set all 4 channels to volume 15 (silent)
             M68kInst::Move(Size::Byte, Operand::Imm(0x9F), Operand::AbsLong(PSG_PORT)), // Ch 0
             M68kInst::Move(Size::Byte, Operand::Imm(0xBF), Operand::AbsLong(PSG_PORT)), // Ch 1
@@ -1240,7 +1384,7 @@ impl SdkLibraryGenerator {
     fn gen_psg_beep(&mut self) -> Vec<M68kInst> {
         // Args: 4(a7)=channel, 8(a7)=divider, 12(a7)=volume
         vec![
-            M68kInst::Label("psg_beep".to_string()),
+            M68kInst::Label("psg_beep".into()),
             M68kInst::Link(AddrReg::A6, 0),
             // psg_set_tone(channel, divider)
             M68kInst::Move(
@@ -1253,7 +1397,7 @@ impl SdkLibraryGenerator {
                 Operand::Disp(12, AddrReg::A6),
                 Operand::PreDec(AddrReg::A7),
             ),
-            M68kInst::Bsr("psg_set_tone".to_string()),
+            M68kInst::Bsr("psg_set_tone".into()),
             M68kInst::Addq(Size::Long, 8, Operand::AddrReg(AddrReg::A7)),
             // psg_set_volume(channel, volume) - inline
             M68kInst::Move(
@@ -1288,345 +1432,241 @@ impl SdkLibraryGenerator {
     fn gen_psg_note_on(&mut self) -> Vec<M68kInst> {
         // Same as psg_beep
         vec![
-            M68kInst::Label("psg_note_on".to_string()),
-            M68kInst::Bra("psg_beep".to_string()),
+            M68kInst::Label("psg_note_on".into()),
+            M68kInst::Bra("psg_beep".into()),
         ]
     }
 
     // -------------------------------------------------------------------------
     // Sprite Library Functions
     // -------------------------------------------------------------------------
+    //
+    // The sprite_* calls edit a copy of the sprite attribute table in work
+    // RAM and widen a dirty range of entries. sprite_flush queues that range
+    // as one DMA; vdp_wait_vblank_start flushes by itself, so a program only
+    // needs to call it to pick the moment.
 
     /// Sprite Attribute Table base address (default at 0xF000 in VRAM)
     const SPRITE_TABLE: u32 = 0xF000;
 
+    /// Hardware sprites in the table (H40)
+    const SPRITE_COUNT: i32 = 80;
+
+    /// Point A1 at the shadow entry for the sprite index in D0, leaving D0 as is
+    fn sprite_shadow_entry() -> Vec<M68kInst> {
+        vec![
+            M68kInst::Lea(Operand::Label("__sdk_sprite_table".into()), AddrReg::A1),
+            M68kInst::Lsl(Size::Word, Operand::Imm(3), DataReg::D0),
+            M68kInst::Adda(Size::Word, Operand::DataReg(DataReg::D0), AddrReg::A1),
+            M68kInst::Lsr(Size::Word, Operand::Imm(3), DataReg::D0),
+        ]
+    }
+
     fn gen_sprite_init(&mut self) -> Vec<M68kInst> {
-        // Initialize sprite table - set all sprites to hidden (y = 0 or offscreen)
+        // Hide every sprite (Y = 0 is offscreen, link 0 ends the list) and
+        // mark the whole table dirty
         let loop_label = self.next_label("sprite_init");
         vec![
-            M68kInst::Label("sprite_init".to_string()),
-            // Set up VRAM write address to sprite table
+            M68kInst::Label("sprite_init".into()),
+            M68kInst::Lea(Operand::Label("__sdk_sprite_table".into()), AddrReg::A0),
             M68kInst::Move(
-                Size::Long,
-                Operand::Imm(Self::SPRITE_TABLE as i32),
+                Size::Word,
+                Operand::Imm(Self::SPRITE_COUNT * 2 - 1),
                 Operand::DataReg(DataReg::D0),
             ),
+            M68kInst::Label(loop_label),
+            M68kInst::Clr(Size::Long, Operand::PostInc(AddrReg::A0)),
+            M68kInst::Dbf(DataReg::D0, loop_label),
+            M68kInst::Lea(Operand::Label("__sdk_sprite_dirty".into()), AddrReg::A0),
             M68kInst::Move(
                 Size::Long,
-                Operand::DataReg(DataReg::D0),
-                Operand::DataReg(DataReg::D1),
-            ),
-            M68kInst::Andi(Size::Word, 0x3FFF, Operand::DataReg(DataReg::D1)),
-            M68kInst::Ori(Size::Word, 0x4000, Operand::DataReg(DataReg::D1)),
-            M68kInst::Move(
-                Size::Word,
-                Operand::DataReg(DataReg::D1),
-                Operand::AbsLong(VDP_CTRL),
-            ),
-            M68kInst::Lsr(Size::Long, Operand::Imm(14), DataReg::D0),
-            M68kInst::Move(
-                Size::Word,
-                Operand::DataReg(DataReg::D0),
-                Operand::AbsLong(VDP_CTRL),
+                Operand::Imm(Self::SPRITE_COUNT),
+                Operand::AddrInd(AddrReg::A0),
             ),
-            // Clear 80 sprites (80 * 8 = 640 bytes)
-            M68kInst::Moveq(79, DataReg::D0),
-            M68kInst::Label(loop_label.clone()),
-            // Y = 0 (offscreen), size/link = 0, attr = 0, X = 0
-            M68kInst::Move(Size::Long, Operand::Imm(0), Operand::AbsLong(VDP_DATA)),
-            M68kInst::Move(Size::Long, Operand::Imm(0), Operand::AbsLong(VDP_DATA)),
-            M68kInst::Dbf(DataReg::D0, loop_label),
             M68kInst::Rts,
         ]
     }
 
     fn gen_sprite_set(&mut self) -> Vec<M68kInst> {
         // sprite_set(index, x, y, size, attr)
-        // Args on stack as 32-bit longs: 4(SP)=index, 8(SP)=x, 12(SP)=y, 16(SP)=size, 20(SP)=attr
+        // Register args: D0=index, D1=x, A0=y, A1=size; 4(SP)=attr as a long
         // On big-endian 68k, to read low word of long at offset N, read from N+2
-        vec![
-            M68kInst::Label("sprite_set".to_string()),
-            // Calculate sprite table address: SPRITE_TABLE + index * 8
-            M68kInst::Move(
-                Size::Long,
-                Operand::Disp(4, AddrReg::A7),
-                Operand::DataReg(DataReg::D0),
-            ),
-            M68kInst::Lsl(Size::Long, Operand::Imm(3), DataReg::D0), // index * 8
-            M68kInst::Addi(
-                Size::Long,
-                Self::SPRITE_TABLE as i32,
-                Operand::DataReg(DataReg::D0),
-            ),
-            // Set VRAM write address
+        let mut code = vec![
+            M68kInst::Label("sprite_set".into()),
+            // Park the size on the stack to free A1
             M68kInst::Move(
                 Size::Long,
-                Operand::DataReg(DataReg::D0),
-                Operand::DataReg(DataReg::D1),
-            ),
-            M68kInst::Andi(Size::Word, 0x3FFF, Operand::DataReg(DataReg::D1)),
-            M68kInst::Ori(Size::Word, 0x4000, Operand::DataReg(DataReg::D1)),
-            M68kInst::Move(
-                Size::Word,
-                Operand::DataReg(DataReg::D1),
-                Operand::AbsLong(VDP_CTRL),
-            ),
-            M68kInst::Lsr(Size::Long, Operand::Imm(14), DataReg::D0),
-            M68kInst::Move(
-                Size::Word,
-                Operand::DataReg(DataReg::D0),
-                Operand::AbsLong(VDP_CTRL),
+                Operand::AddrReg(AddrReg::A1),
+                Operand::PreDec(AddrReg::A7),
             ),
-            // Write Y position (y + 128) - y is at 12(SP), low word at 14(SP)
+        ];
+        code.extend(Self::sprite_shadow_entry());
+        code.extend([
+            // Y position (y + 128)
+            M68kInst::Lea(Operand::Disp(128, AddrReg::A0), AddrReg::A0),
             M68kInst::Move(
                 Size::Word,
-                Operand::Disp(14, AddrReg::A7),
-                Operand::DataReg(DataReg::D0),
+                Operand::AddrReg(AddrReg::A0),
+                Operand::PostInc(AddrReg::A1),
             ),
-            M68kInst::Addi(Size::Word, 128, Operand::DataReg(DataReg::D0)),
+            // Size byte, then link = index + 1
             M68kInst::Move(
-                Size::Word,
-                Operand::DataReg(DataReg::D0),
-                Operand::AbsLong(VDP_DATA),
+                Size::Byte,
+                Operand::Disp(3, AddrReg::A7),
+                Operand::PostInc(AddrReg::A1),
             ),
-            // Write size/link (size in upper nibble, link = index+1)
-            // size is at 16(SP), low word at 18(SP); index is at 4(SP), low word at 6(SP)
             M68kInst::Move(
-                Size::Word,
-                Operand::Disp(18, AddrReg::A7),
+                Size::Byte,
                 Operand::DataReg(DataReg::D0),
+                Operand::AddrInd(AddrReg::A1),
             ),
-            M68kInst::Lsl(Size::Word, Operand::Imm(8), DataReg::D0),
+            M68kInst::Addq(Size::Byte, 1, Operand::PostInc(AddrReg::A1)),
+            M68kInst::Addq(Size::Long, 4, Operand::AddrReg(AddrReg::A7)),
+            // Attribute word - attr is at 4(SP), low word at 6(SP)
             M68kInst::Move(
                 Size::Word,
                 Operand::Disp(6, AddrReg::A7),
-                Operand::DataReg(DataReg::D1),
-            ),
-            M68kInst::Addq(Size::Word, 1, Operand::DataReg(DataReg::D1)),
-            M68kInst::Or(
-                Size::Word,
-                Operand::DataReg(DataReg::D1),
-                Operand::DataReg(DataReg::D0),
-            ),
-            M68kInst::Move(
-                Size::Word,
-                Operand::DataReg(DataReg::D0),
-                Operand::AbsLong(VDP_DATA),
-            ),
-            // Write attribute word - attr is at 20(SP), low word at 22(SP)
-            M68kInst::Move(
-                Size::Word,
-                Operand::Disp(22, AddrReg::A7),
-                Operand::AbsLong(VDP_DATA),
-            ),
-            // Write X position (x + 128) - x is at 8(SP), low word at 10(SP)
-            M68kInst::Move(
-                Size::Word,
-                Operand::Disp(10, AddrReg::A7),
-                Operand::DataReg(DataReg::D0),
+                Operand::PostInc(AddrReg::A1),
             ),
-            M68kInst::Addi(Size::Word, 128, Operand::DataReg(DataReg::D0)),
+            // X position (x + 128)
+            M68kInst::Addi(Size::Word, 128, Operand::DataReg(DataReg::D1)),
             M68kInst::Move(
                 Size::Word,
-                Operand::DataReg(DataReg::D0),
-                Operand::AbsLong(VDP_DATA),
+                Operand::DataReg(DataReg::D1),
+                Operand::AddrInd(AddrReg::A1),
             ),
-            M68kInst::Rts,
-        ]
+            M68kInst::Bra(SPRITE_MARK.into()),
+        ]);
+        code
     }
 
     fn gen_sprite_set_pos(&mut self) -> Vec<M68kInst> {
         // sprite_set_pos(index, x, y)
-        // Args on stack as 32-bit longs: 4(SP)=index, 8(SP)=x, 12(SP)=y
-        // On big-endian 68k, to read low word of long at offset N, read from N+2
-        vec![
-            M68kInst::Label("sprite_set_pos".to_string()),
-            // Calculate Y position address: SPRITE_TABLE + index * 8 + 0
-            M68kInst::Move(
-                Size::Long,
-                Operand::Disp(4, AddrReg::A7),
-                Operand::DataReg(DataReg::D0),
-            ),
-            M68kInst::Lsl(Size::Long, Operand::Imm(3), DataReg::D0),
-            M68kInst::Addi(
-                Size::Long,
-                Self::SPRITE_TABLE as i32,
-                Operand::DataReg(DataReg::D0),
-            ),
-            // Set VRAM write address
-            M68kInst::Move(
-                Size::Long,
-                Operand::DataReg(DataReg::D0),
-                Operand::DataReg(DataReg::D1),
-            ),
-            M68kInst::Andi(Size::Word, 0x3FFF, Operand::DataReg(DataReg::D1)),
-            M68kInst::Ori(Size::Word, 0x4000, Operand::DataReg(DataReg::D1)),
-            M68kInst::Move(
-                Size::Word,
-                Operand::DataReg(DataReg::D1),
-                Operand::AbsLong(VDP_CTRL),
-            ),
-            M68kInst::Lsr(Size::Long, Operand::Imm(14), DataReg::D0),
-            M68kInst::Move(
-                Size::Word,
-                Operand::DataReg(DataReg::D0),
-                Operand::AbsLong(VDP_CTRL),
-            ),
-            // Write Y position - y is at 12(SP), low word at 14(SP)
-            M68kInst::Move(
-                Size::Word,
-                Operand::Disp(14, AddrReg::A7),
-                Operand::DataReg(DataReg::D0),
-            ),
-            M68kInst::Addi(Size::Word, 128, Operand::DataReg(DataReg::D0)),
+        // Register args: D0=index, D1=x, A0=y
+        let mut code = vec![M68kInst::Label("sprite_set_pos".into())];
+        code.extend(Self::sprite_shadow_entry());
+        code.extend([
+            // Y is the first word of the entry, X the last
+            M68kInst::Lea(Operand::Disp(128, AddrReg::A0), AddrReg::A0),
             M68kInst::Move(
                 Size::Word,
-                Operand::DataReg(DataReg::D0),
-                Operand::AbsLong(VDP_DATA),
-            ),
-            // Skip size/link word, write attr (need to read-modify-write for X only)
-            // For simplicity, update X position at offset +6
-            M68kInst::Move(
-                Size::Long,
-                Operand::Disp(4, AddrReg::A7),
-                Operand::DataReg(DataReg::D0),
-            ),
-            M68kInst::Lsl(Size::Long, Operand::Imm(3), DataReg::D0),
-            M68kInst::Addi(
-                Size::Long,
-                (Self::SPRITE_TABLE + 6) as i32,
-                Operand::DataReg(DataReg::D0),
-            ),
-            M68kInst::Move(
-                Size::Long,
-                Operand::DataReg(DataReg::D0),
-                Operand::DataReg(DataReg::D1),
+                Operand::AddrReg(AddrReg::A0),
+                Operand::AddrInd(AddrReg::A1),
             ),
-            M68kInst::Andi(Size::Word, 0x3FFF, Operand::DataReg(DataReg::D1)),
-            M68kInst::Ori(Size::Word, 0x4000, Operand::DataReg(DataReg::D1)),
+            M68kInst::Addi(Size::Word, 128, Operand::DataReg(DataReg::D1)),
             M68kInst::Move(
                 Size::Word,
                 Operand::DataReg(DataReg::D1),
-                Operand::AbsLong(VDP_CTRL),
-            ),
-            M68kInst::Lsr(Size::Long, Operand::Imm(14), DataReg::D0),
-            M68kInst::Move(
-                Size::Word,
-                Operand::DataReg(DataReg::D0),
-                Operand::AbsLong(VDP_CTRL),
-            ),
-            // Write X position - x is at 8(SP), low word at 10(SP)
-            M68kInst::Move(
-                Size::Word,
-                Operand::Disp(10, AddrReg::A7),
-                Operand::DataReg(DataReg::D0),
-            ),
-            M68kInst::Addi(Size::Word, 128, Operand::DataReg(DataReg::D0)),
-            M68kInst::Move(
-                Size::Word,
-                Operand::DataReg(DataReg::D0),
-                Operand::AbsLong(VDP_DATA),
+                Operand::Disp(6, AddrReg::A1),
             ),
-            M68kInst::Rts,
-        ]
+            M68kInst::Bra(SPRITE_MARK.into()),
+        ]);
+        code
     }
 
     fn gen_sprite_hide(&mut self) -> Vec<M68kInst> {
         // sprite_hide(index) - set Y to 0 (offscreen) and link to 0 (end list)
-        vec![
-            M68kInst::Label("sprite_hide".to_string()),
-            M68kInst::Move(
-                Size::Long,
-                Operand::Disp(4, AddrReg::A7),
-                Operand::DataReg(DataReg::D0),
-            ),
-            M68kInst::Lsl(Size::Long, Operand::Imm(3), DataReg::D0),
-            M68kInst::Addi(
-                Size::Long,
-                Self::SPRITE_TABLE as i32,
-                Operand::DataReg(DataReg::D0),
-            ),
-            M68kInst::Move(
-                Size::Long,
-                Operand::DataReg(DataReg::D0),
-                Operand::DataReg(DataReg::D1),
-            ),
-            M68kInst::Andi(Size::Word, 0x3FFF, Operand::DataReg(DataReg::D1)),
-            M68kInst::Ori(Size::Word, 0x4000, Operand::DataReg(DataReg::D1)),
-            M68kInst::Move(
-                Size::Word,
-                Operand::DataReg(DataReg::D1),
-                Operand::AbsLong(VDP_CTRL),
-            ),
-            M68kInst::Lsr(Size::Long, Operand::Imm(14), DataReg::D0),
-            M68kInst::Move(
-                Size::Word,
-                Operand::DataReg(DataReg::D0),
-                Operand::AbsLong(VDP_CTRL),
-            ),
-            // Y = 0, link = 0 (end sprite list)
-            M68kInst::Clr(Size::Long, Operand::AbsLong(VDP_DATA)),
-            M68kInst::Rts,
-        ]
+        // Register args: D0=index
+        let mut code = vec![M68kInst::Label("sprite_hide".into())];
+        code.extend(Self::sprite_shadow_entry());
+        code.extend([
+            M68kInst::Clr(Size::Long, Operand::AddrInd(AddrReg::A1)),
+            M68kInst::Bra(SPRITE_MARK.into()),
+        ]);
+        code
     }
 
     fn gen_sprite_clear(&mut self) -> Vec<M68kInst> {
-        // Same as sprite_hide for now
+        // Same as sprite_hide for now (the index is already in D0)
         vec![
-            M68kInst::Label("sprite_clear".to_string()),
-            M68kInst::Bra("sprite_hide".to_string()),
+            M68kInst::Label("sprite_clear".into()),
+            M68kInst::Bra("sprite_hide".into()),
         ]
     }
 
     fn gen_sprite_clear_all(&mut self) -> Vec<M68kInst> {
         vec![
-            M68kInst::Label("sprite_clear_all".to_string()),
-            M68kInst::Bra("sprite_init".to_string()),
+            M68kInst::Label("sprite_clear_all".into()),
+            M68kInst::Bra("sprite_init".into()),
         ]
     }
 
     fn gen_sprite_set_link(&mut self) -> Vec<M68kInst> {
         // sprite_set_link(index, next)
-        // Args on stack as 32-bit longs: 4(SP)=index, 8(SP)=next
-        // On big-endian 68k, to read low byte of long at offset N, read from N+3
-        vec![
-            M68kInst::Label("sprite_set_link".to_string()),
-            // Address of link byte: SPRITE_TABLE + index * 8 + 3
+        // Register args: D0=index, D1=next
+        let mut code = vec![M68kInst::Label("sprite_set_link".into())];
+        code.extend(Self::sprite_shadow_entry());
+        code.extend([
+            // Link byte is the low byte of the second word
             M68kInst::Move(
-                Size::Long,
-                Operand::Disp(4, AddrReg::A7),
-                Operand::DataReg(DataReg::D0),
-            ),
-            M68kInst::Lsl(Size::Long, Operand::Imm(3), DataReg::D0),
-            M68kInst::Addi(
-                Size::Long,
-                (Self::SPRITE_TABLE + 3) as i32,
-                Operand::DataReg(DataReg::D0),
-            ),
-            M68kInst::Move(
-                Size::Long,
-                Operand::DataReg(DataReg::D0),
-                Operand::DataReg(DataReg::D1),
-            ),
-            M68kInst::Andi(Size::Word, 0x3FFF, Operand::DataReg(DataReg::D1)),
-            M68kInst::Ori(Size::Word, 0x4000, Operand::DataReg(DataReg::D1)),
-            M68kInst::Move(
-                Size::Word,
-                Operand::DataReg(DataReg::D1),
-                Operand::AbsLong(VDP_CTRL),
-            ),
-            M68kInst::Lsr(Size::Long, Operand::Imm(14), DataReg::D0),
-            M68kInst::Move(
-                Size::Word,
-                Operand::DataReg(DataReg::D0),
-                Operand::AbsLong(VDP_CTRL),
-            ),
-            // Write link value - next is at 8(SP), low byte at 11(SP)
-            M68kInst::Move(
-                Size::Byte,
-                Operand::Disp(11, AddrReg::A7),
-                Operand::AbsLong(VDP_DATA),
+                Size::Byte,
+                Operand::DataReg(DataReg::D1),
+                Operand::Disp(3, AddrReg::A1),
             ),
+            M68kInst::Bra(SPRITE_MARK.into()),
+        ]);
+        code
+    }
+
+    fn gen_sprite_flush(&mut self) -> Vec<M68kInst> {
+        // Queue the dirty entries [lo, hi) of the shadow table as one DMA.
+        // The range only resets once the DMA is queued, so a full queue
+        // just delays the update a frame.
+        let keep = self.next_label("sprite_flush_keep");
+        let set_lo = self.next_label("sprite_mark_set");
+        let skip_lo = self.next_label("sprite_mark_lo");
+        let skip_hi = self.next_label("sprite_mark_hi");
+        let d = Operand::DataReg;
+        vec![
+            M68kInst::Label("sprite_flush".into()),
+            M68kInst::Move(Size::Word, Operand::Sr, Operand::PreDec(AddrReg::A7)),
+            M68kInst::Move(Size::Word, Operand::Imm(0x2700), Operand::Sr),
+            M68kInst::Lea(Operand::Label("__sdk_sprite_dirty".into()), AddrReg::A1),
+            M68kInst::Moveq(0, DataReg::D0),
+            M68kInst::Move(Size::Word, Operand::AddrInd(AddrReg::A1), d(DataReg::D0)),
+            M68kInst::Move(Size::Word, Operand::Disp(2, AddrReg::A1), d(DataReg::D1)),
+            M68kInst::Sub(Size::Word, d(DataReg::D0), d(DataReg::D1)),
+            M68kInst::Bcc(Cond::Ls, keep),
+            // len = entries * 4 words
+            M68kInst::Lsl(Size::Word, Operand::Imm(2), DataReg::D1),
+            M68kInst::Move(Size::Word, d(DataReg::D1), Operand::AddrReg(AddrReg::A0)),
+            // src = shadow + lo * 8, dst = SPRITE_TABLE + lo * 8
+            M68kInst::Lsl(Size::Long, Operand::Imm(3), DataReg::D0),
+            M68kInst::Move(Size::Long, d(DataReg::D0), d(DataReg::D1)),
+            M68kInst::Addi(Size::Long, Self::SPRITE_TABLE as i32, d(DataReg::D1)),
+            M68kInst::Lea(Operand::Label("__sdk_sprite_table".into()), AddrReg::A1),
+            M68kInst::Adda(Size::Long, d(DataReg::D0), AddrReg::A1),
+            M68kInst::Move(Size::Long, Operand::AddrReg(AddrReg::A1), d(DataReg::D0)),
+            M68kInst::Bsr("dma_queue_transfer".into()),
+            M68kInst::Tst(Size::Long, d(DataReg::D0)),
+            M68kInst::Bcc(Cond::Eq, keep),
+            // Clean is hi = 0, so the zeroed .bss starts out clean
+            M68kInst::Lea(Operand::Label("__sdk_sprite_dirty".into()), AddrReg::A1),
+            M68kInst::Clr(Size::Long, Operand::AddrInd(AddrReg::A1)),
+            M68kInst::Label(keep),
+            M68kInst::Move(Size::Word, Operand::PostInc(AddrReg::A7), Operand::Sr),
+            M68kInst::Rts,
+            // Shared tail of the sprite_* calls: widen the dirty range to
+            // cover the index in D0. Masked, since a vblank_handler may move
+            // sprites too.
+            M68kInst::Label(SPRITE_MARK.into()),
+            M68kInst::Move(Size::Word, Operand::Sr, Operand::PreDec(AddrReg::A7)),
+            M68kInst::Move(Size::Word, Operand::Imm(0x2700), Operand::Sr),
+            M68kInst::Lea(Operand::Label("__sdk_sprite_dirty".into()), AddrReg::A1),
+            // A clean range has no lo to keep
+            M68kInst::Tst(Size::Word, Operand::Disp(2, AddrReg::A1)),
+            M68kInst::Bcc(Cond::Eq, set_lo),
+            M68kInst::Cmp(Size::Word, Operand::AddrInd(AddrReg::A1), d(DataReg::D0)),
+            M68kInst::Bcc(Cond::Cc, skip_lo),
+            M68kInst::Label(set_lo),
+            M68kInst::Move(Size::Word, d(DataReg::D0), Operand::AddrInd(AddrReg::A1)),
+            M68kInst::Label(skip_lo),
+            M68kInst::Addq(Size::Word, 1, d(DataReg::D0)),
+            M68kInst::Cmp(Size::Word, Operand::Disp(2, AddrReg::A1), d(DataReg::D0)),
+            M68kInst::Bcc(Cond::Ls, skip_hi),
+            M68kInst::Move(Size::Word, d(DataReg::D0), Operand::Disp(2, AddrReg::A1)),
+            M68kInst::Label(skip_hi),
+            M68kInst::Move(Size::Word, Operand::PostInc(AddrReg::A7), Operand::Sr),
             M68kInst::Rts,
         ]
     }
@@ -1644,7 +1684,7 @@ impl SdkLibraryGenerator {
     fn gen_input_init(&mut self) -> Vec<M68kInst> {
         // Initialize controller ports
         vec![
-            M68kInst::Label("input_init".to_string()),
+            M68kInst::Label("input_init".into()),
             // Set port 1 control (output TH, input the rest)
             M68kInst::Move(
                 Size::Byte,
@@ -1678,21 +1718,21 @@ impl SdkLibraryGenerator {
         let port1_label = self.next_label("port1");
         let done_label = self.next_label("done");
         vec![
-            M68kInst::Label("input_read".to_string()),
+            M68kInst::Label("input_read".into()),
             M68kInst::Move(
                 Size::Long,
                 Operand::Disp(4, AddrReg::A7),
                 Operand::DataReg(DataReg::D1),
             ),
             M68kInst::Tst(Size::Long, Operand::DataReg(DataReg::D1)),
-            M68kInst::Bcc(Cond::Eq, port1_label.clone()),
+            M68kInst::Bcc(Cond::Eq, port1_label),
             // Port 2
             M68kInst::Move(
                 Size::Byte,
                 Operand::AbsLong(Self::JOY2_DATA),
                 Operand::DataReg(DataReg::D0),
             ),
-            M68kInst::Bra(done_label.clone()),
+            M68kInst::Bra(done_label),
             // Port 1
             M68kInst::Label(port1_label),
             M68kInst::Move(
@@ -1710,29 +1750,29 @@ impl SdkLibraryGenerator {
 
     fn gen_input_update(&mut self) -> Vec<M68kInst> {
         // Placeholder - for more complex input state tracking
-        vec![M68kInst::Label("input_update".to_string()), M68kInst::Rts]
+        vec![M68kInst::Label("input_update".into()), M68kInst::Rts]
     }
 
     fn gen_input_held(&mut self) -> Vec<M68kInst> {
         // Same as input_read for simple implementation
         vec![
-            M68kInst::Label("input_held".to_string()),
-            M68kInst::Bra("input_read".to_string()),
+            M68kInst::Label("input_held".into()),
+            M68kInst::Bra("input_read".into()),
         ]
     }
 
     fn gen_input_pressed(&mut self) -> Vec<M68kInst> {
         // For simple implementation, same as input_read
         vec![
-            M68kInst::Label("input_pressed".to_string()),
-            M68kInst::Bra("input_read".to_string()),
+            M68kInst::Label("input_pressed".into()),
+            M68kInst::Bra("input_read".into()),
         ]
     }
 
     fn gen_input_released(&mut self) -> Vec<M68kInst> {
         // Return 0 for simple implementation
         vec![
-            M68kInst::Label("input_released".to_string()),
+            M68kInst::Label("input_released".into()),
             M68kInst::Moveq(0, DataReg::D0),
             M68kInst::Rts,
         ]
@@ -1741,7 +1781,7 @@ impl SdkLibraryGenerator {
     fn gen_input_is_6button(&mut self) -> Vec<M68kInst> {
         // Return 0 (not 6-button) for simple implementation
         vec![
-            M68kInst::Label("input_is_6button".to_string()),
+            M68kInst::Label("input_is_6button".into()),
             M68kInst::Moveq(0, DataReg::D0),
             M68kInst::Rts,
         ]
@@ -1752,74 +1792,259 @@ impl SdkLibraryGenerator {
     // -------------------------------------------------------------------------
 
     fn gen_mem_copy(&mut self) -> Vec<M68kInst> {
-        // Args: 8(a6)=dst, 12(a6)=src, 16(a6)=len
-        let loop_label = self.next_label("mcpy_loop");
+        // Register args: D0=dst, D1=src, A0=len
+        // Pointers of opposite parity can only be copied a byte at a time;
+        // otherwise one byte aligns both and the rest goes to the bulk copy.
+        let even = self.next_label("mcpy_even");
+        let done = self.next_label("mcpy_done");
         vec![
-            M68kInst::Label("mem_copy".to_string()),
-            M68kInst::Link(AddrReg::A6, 0),
+            M68kInst::Label("mem_copy".into()),
             M68kInst::Move(
                 Size::Long,
-                Operand::Disp(8, AddrReg::A6),
+                Operand::DataReg(DataReg::D0),
                 Operand::AddrReg(AddrReg::A1),
             ),
+            M68kInst::Exg(Reg::Data(DataReg::D1), Reg::Addr(AddrReg::A0)),
+            // Bit 0 of src + dst is set when the parities differ
             M68kInst::Move(
                 Size::Long,
-                Operand::Disp(12, AddrReg::A6),
                 Operand::AddrReg(AddrReg::A0),
+                Operand::DataReg(DataReg::D0),
             ),
+            M68kInst::Add(
+                Size::Long,
+                Operand::AddrReg(AddrReg::A1),
+                Operand::DataReg(DataReg::D0),
+            ),
+            M68kInst::Btst(Operand::Imm(0), Operand::DataReg(DataReg::D0)),
+            M68kInst::Bcc(Cond::Eq, even),
             M68kInst::Move(
                 Size::Long,
-                Operand::Disp(16, AddrReg::A6),
+                Operand::DataReg(DataReg::D1),
                 Operand::DataReg(DataReg::D0),
             ),
-            M68kInst::Subq(Size::Long, 1, Operand::DataReg(DataReg::D0)),
-            M68kInst::Bcc(Cond::Mi, ".mcpy_done".to_string()),
-            M68kInst::Label(loop_label.clone()),
+            M68kInst::Bra(MEM_COPY_BYTES.into()),
+            M68kInst::Label(even),
+            M68kInst::Move(
+                Size::Long,
+                Operand::AddrReg(AddrReg::A0),
+                Operand::DataReg(DataReg::D0),
+            ),
+            M68kInst::Btst(Operand::Imm(0), Operand::DataReg(DataReg::D0)),
+            M68kInst::Bcc(Cond::Eq, MEM_COPY_BULK.into()),
+            M68kInst::Tst(Size::Long, Operand::DataReg(DataReg::D1)),
+            M68kInst::Bcc(Cond::Eq, done),
             M68kInst::Move(
                 Size::Byte,
                 Operand::PostInc(AddrReg::A0),
                 Operand::PostInc(AddrReg::A1),
             ),
-            M68kInst::Dbf(DataReg::D0, loop_label),
-            M68kInst::Label(".mcpy_done".to_string()),
-            M68kInst::Unlk(AddrReg::A6),
+            M68kInst::Subq(Size::Long, 1, Operand::DataReg(DataReg::D1)),
+            M68kInst::Bra(MEM_COPY_BULK.into()),
+            M68kInst::Label(done),
             M68kInst::Rts,
         ]
     }
 
+    fn gen_mem_copy_w(&mut self) -> Vec<M68kInst> {
+        // Register args: D0=dst, D1=src, A0=len, both pointers even
+        let mut code = vec![
+            M68kInst::Label("mem_copy_w".into()),
+            M68kInst::Move(
+                Size::Long,
+                Operand::DataReg(DataReg::D0),
+                Operand::AddrReg(AddrReg::A1),
+            ),
+            M68kInst::Exg(Reg::Data(DataReg::D1), Reg::Addr(AddrReg::A0)),
+            // A0=src, A1=dst, D1=len
+            M68kInst::Label(MEM_COPY_BULK.into()),
+        ];
+        let copy_long = M68kInst::Move(
+            Size::Long,
+            Operand::PostInc(AddrReg::A0),
+            Operand::PostInc(AddrReg::A1),
+        );
+        code.extend(self.mem_bulk_loop(&copy_long, Operand::DataReg(DataReg::D1)));
+        // Byte tail, also the whole copy for pointers of opposite parity.
+        // D0 is a full 32-bit count.
+        let byte_loop = self.next_label("mcpy_byte");
+        let byte_test = self.next_label("mcpy_btest");
+        code.extend([
+            M68kInst::Moveq(3, DataReg::D0),
+            M68kInst::And(
+                Size::Word,
+                Operand::DataReg(DataReg::D1),
+                Operand::DataReg(DataReg::D0),
+            ),
+            M68kInst::Label(MEM_COPY_BYTES.into()),
+            M68kInst::Bra(byte_test),
+            M68kInst::Label(byte_loop),
+            M68kInst::Move(
+                Size::Byte,
+                Operand::PostInc(AddrReg::A0),
+                Operand::PostInc(AddrReg::A1),
+            ),
+            M68kInst::Label(byte_test),
+        ]);
+        code.extend(Self::dbf_long(DataReg::D0, byte_loop));
+        code.push(M68kInst::Rts);
+        code
+    }
+
     fn gen_mem_set(&mut self) -> Vec<M68kInst> {
-        // Args: 8(a6)=dst, 12(a6)=value, 16(a6)=len
-        let loop_label = self.next_label("mset_loop");
+        // Register args: D0=dst, D1=value, A0=len
+        // Spread the byte across a long, align dst, then fill in bulk
+        let done = self.next_label("mset_done");
         vec![
-            M68kInst::Label("mem_set".to_string()),
-            M68kInst::Link(AddrReg::A6, 0),
+            M68kInst::Label("mem_set".into()),
             M68kInst::Move(
                 Size::Long,
-                Operand::Disp(8, AddrReg::A6),
-                Operand::AddrReg(AddrReg::A0),
+                Operand::DataReg(DataReg::D0),
+                Operand::AddrReg(AddrReg::A1),
+            ),
+            M68kInst::Move(
+                Size::Byte,
+                Operand::DataReg(DataReg::D1),
+                Operand::DataReg(DataReg::D0),
+            ),
+            M68kInst::Lsl(Size::Word, Operand::Imm(8), DataReg::D1),
+            M68kInst::Move(
+                Size::Byte,
+                Operand::DataReg(DataReg::D0),
+                Operand::DataReg(DataReg::D1),
+            ),
+            M68kInst::Move(
+                Size::Word,
+                Operand::DataReg(DataReg::D1),
+                Operand::DataReg(DataReg::D0),
+            ),
+            M68kInst::Swap(DataReg::D1),
+            M68kInst::Move(
+                Size::Word,
+                Operand::DataReg(DataReg::D0),
+                Operand::DataReg(DataReg::D1),
             ),
             M68kInst::Move(
                 Size::Long,
-                Operand::Disp(12, AddrReg::A6),
+                Operand::AddrReg(AddrReg::A1),
+                Operand::DataReg(DataReg::D0),
+            ),
+            M68kInst::Btst(Operand::Imm(0), Operand::DataReg(DataReg::D0)),
+            M68kInst::Bcc(Cond::Eq, MEM_SET_BULK.into()),
+            M68kInst::Move(
+                Size::Long,
+                Operand::AddrReg(AddrReg::A0),
+                Operand::DataReg(DataReg::D0),
+            ),
+            M68kInst::Bcc(Cond::Eq, done),
+            M68kInst::Move(
+                Size::Byte,
                 Operand::DataReg(DataReg::D1),
+                Operand::PostInc(AddrReg::A1),
             ),
+            M68kInst::Subq(Size::Long, 1, Operand::AddrReg(AddrReg::A0)),
+            M68kInst::Bra(MEM_SET_BULK.into()),
+            M68kInst::Label(done),
+            M68kInst::Rts,
+        ]
+    }
+
+    fn gen_mem_set_l(&mut self) -> Vec<M68kInst> {
+        // Register args: D0=dst (even), D1=long pattern, A0=len
+        let mut code = vec![
+            M68kInst::Label("mem_set_l".into()),
             M68kInst::Move(
                 Size::Long,
-                Operand::Disp(16, AddrReg::A6),
                 Operand::DataReg(DataReg::D0),
+                Operand::AddrReg(AddrReg::A1),
             ),
-            M68kInst::Subq(Size::Long, 1, Operand::DataReg(DataReg::D0)),
-            M68kInst::Bcc(Cond::Mi, ".mset_done".to_string()),
-            M68kInst::Label(loop_label.clone()),
+            // A1=dst, D1=pattern, A0=len
+            M68kInst::Label(MEM_SET_BULK.into()),
+        ];
+        let set_long = M68kInst::Move(
+            Size::Long,
+            Operand::DataReg(DataReg::D1),
+            Operand::PostInc(AddrReg::A1),
+        );
+        code.extend(self.mem_bulk_loop(&set_long, Operand::AddrReg(AddrReg::A0)));
+        // Up to three bytes left, taken from the front of the pattern
+        let no_word = self.next_label("mset_noword");
+        let done = self.next_label("mset_done");
+        code.extend([
+            M68kInst::Move(
+                Size::Word,
+                Operand::AddrReg(AddrReg::A0),
+                Operand::DataReg(DataReg::D0),
+            ),
+            M68kInst::Btst(Operand::Imm(1), Operand::DataReg(DataReg::D0)),
+            M68kInst::Bcc(Cond::Eq, no_word),
+            M68kInst::Swap(DataReg::D1),
+            M68kInst::Move(
+                Size::Word,
+                Operand::DataReg(DataReg::D1),
+                Operand::PostInc(AddrReg::A1),
+            ),
+            M68kInst::Label(no_word),
+            M68kInst::Btst(Operand::Imm(0), Operand::DataReg(DataReg::D0)),
+            M68kInst::Bcc(Cond::Eq, done),
+            M68kInst::Rol(Size::Long, Operand::Imm(8), DataReg::D1),
             M68kInst::Move(
                 Size::Byte,
                 Operand::DataReg(DataReg::D1),
-                Operand::PostInc(AddrReg::A0),
+                Operand::PostInc(AddrReg::A1),
             ),
-            M68kInst::Dbf(DataReg::D0, loop_label),
-            M68kInst::Label(".mset_done".to_string()),
-            M68kInst::Unlk(AddrReg::A6),
+            M68kInst::Label(done),
             M68kInst::Rts,
+        ]);
+        code
+    }
+
+    /// Bulk part of the `mem_*` routines: `step` (one long) unrolled
+    /// `MEM_BLOCK / 4` times per iteration, then single longs up to the last
+    /// long boundary of the 32-bit length in `len`. Uses D0.
+    fn mem_bulk_loop(&mut self, step: &M68kInst, len: Operand) -> Vec<M68kInst> {
+        let block_loop = self.next_label("mem_block");
+        let block_tail = self.next_label("mem_tail");
+        let long_loop = self.next_label("mem_long");
+        let long_test = self.next_label("mem_ltest");
+        let mut code = vec![
+            M68kInst::Move(Size::Long, len.clone(), Operand::DataReg(DataReg::D0)),
+            M68kInst::Lsr(
+                Size::Long,
+                Operand::Imm(MEM_BLOCK.trailing_zeros() as i32),
+                DataReg::D0,
+            ),
+            M68kInst::Bcc(Cond::Eq, block_tail),
+            M68kInst::Subq(Size::Long, 1, Operand::DataReg(DataReg::D0)),
+            M68kInst::Label(block_loop),
+        ];
+        code.extend(std::iter::repeat_n(step.clone(), MEM_BLOCK / 4));
+        code.extend(Self::dbf_long(DataReg::D0, block_loop));
+        code.extend([
+            M68kInst::Label(block_tail),
+            M68kInst::Move(Size::Word, len, Operand::DataReg(DataReg::D0)),
+            M68kInst::Andi(
+                Size::Word,
+                (MEM_BLOCK - 1) as i32,
+                Operand::DataReg(DataReg::D0),
+            ),
+            M68kInst::Lsr(Size::Word, Operand::Imm(2), DataReg::D0),
+            M68kInst::Bra(long_test),
+            M68kInst::Label(long_loop),
+            step.clone(),
+            M68kInst::Label(long_test),
+            M68kInst::Dbf(DataReg::D0, long_loop),
+        ]);
+        code
+    }
+
+    /// `dbf` over all 32 bits of `reg`, for counts above 64K: when the low
+    /// word runs out, borrow from the high word and go round again.
+    fn dbf_long(reg: DataReg, target: Symbol) -> [M68kInst; 3] {
+        [
+            M68kInst::Dbf(reg, target),
+            M68kInst::Subi(Size::Long, 0x10000, Operand::DataReg(reg)),
+            M68kInst::Bcc(Cond::Pl, target),
         ]
     }
 
@@ -1830,8 +2055,8 @@ impl SdkLibraryGenerator {
         // multiplier = 1103515245 = 0x41C6_4E6D
         // hi16 = 0x41C6, lo16 = 0x4E6D
         vec![
-            M68kInst::Label("rand_next".to_string()),
-            M68kInst::Lea(Operand::Label("__sdk_rand_state".to_string()), AddrReg::A0),
+            M68kInst::Label("rand_next".into()),
+            M68kInst::Lea(Operand::Label("__sdk_rand_state".into()), AddrReg::A0),
             M68kInst::Move(
                 Size::Long,
                 Operand::AddrInd(AddrReg::A0),
@@ -1886,8 +2111,8 @@ impl SdkLibraryGenerator {
     fn gen_rand_seed(&mut self) -> Vec<M68kInst> {
         // Arg: 4(a7)=seed
         vec![
-            M68kInst::Label("rand_seed".to_string()),
-            M68kInst::Lea(Operand::Label("__sdk_rand_state".to_string()), AddrReg::A0),
+            M68kInst::Label("rand_seed".into()),
+            M68kInst::Lea(Operand::Label("__sdk_rand_state".into()), AddrReg::A0),
             M68kInst::Move(
                 Size::Long,
                 Operand::Disp(4, AddrReg::A7),
@@ -1897,6 +2122,230 @@ impl SdkLibraryGenerator {
         ]
     }
 
+    fn gen_sqrt_fix(&mut self) -> Vec<M68kInst> {
+        // Register arg: D0=x (8.8). Quarter x until it indexes the table,
+        // doubling the root for each step; see `common::fixed::sqrt_fix`.
+        let shift = self.next_label("sqrt_shift");
+        let lookup = self.next_label("sqrt_lookup");
+        vec![
+            M68kInst::Label("sqrt_fix".into()),
+            M68kInst::Andi(Size::Long, 0xFFFF, Operand::DataReg(DataReg::D0)),
+            M68kInst::Moveq(0, DataReg::D1),
+            M68kInst::Label(shift),
+            M68kInst::Cmpi(Size::Long, 256, Operand::DataReg(DataReg::D0)),
+            M68kInst::Bcc(Cond::Cs, lookup),
+            M68kInst::Lsr(Size::Long, Operand::Imm(2), DataReg::D0),
+            M68kInst::Addq(Size::Long, 1, Operand::DataReg(DataReg::D1)),
+            M68kInst::Bra(shift),
+            M68kInst::Label(lookup),
+            M68kInst::Lea(Operand::Label(SQRT_TABLE.into()), AddrReg::A0),
+            // D0 is below 256, so the byte load leaves it zero-extended
+            M68kInst::Move(
+                Size::Byte,
+                Operand::Indexed(0, AddrReg::A0, DataReg::D0),
+                Operand::DataReg(DataReg::D0),
+            ),
+            M68kInst::Lsl(Size::Long, Operand::DataReg(DataReg::D1), DataReg::D0),
+            M68kInst::Rts,
+        ]
+    }
+
+    // -------------------------------------------------------------------------
+    // Sound Driver Library Functions
+    // -------------------------------------------------------------------------
+
+    fn gen_snd_init(&mut self) -> Vec<M68kInst> {
+        // Copy the driver into Z80 RAM with the bus held, empty the mailbox,
+        // then pulse reset so the Z80 starts it
+        let grant = self.next_label("snd_grant");
+        let copy = self.next_label("snd_copy");
+        let hold = self.next_label("snd_hold");
+        let mut insts = vec![
+            M68kInst::Label("snd_init".into()),
+            M68kInst::Move(
+                Size::Word,
+                Operand::Imm(0x0100),
+                Operand::AbsLong(Z80_BUS_REQ),
+            ),
+            M68kInst::Move(
+                Size::Word,
+                Operand::Imm(0x0100),
+                Operand::AbsLong(Z80_RESET),
+            ),
+            M68kInst::Label(grant),
+            M68kInst::Btst(Operand::Imm(0), Operand::AbsLong(Z80_BUS_REQ)),
+            M68kInst::Bcc(Cond::Ne, grant),
+            M68kInst::Lea(Operand::Label(Z80_DRIVER.into()), AddrReg::A0),
+            M68kInst::Lea(Operand::AbsLong(Z80_RAM), AddrReg::A1),
+            M68kInst::Move(
+                Size::Word,
+                Operand::Imm(DRIVER.len() as i32 - 1),
+                Operand::DataReg(DataReg::D0),
+            ),
+            M68kInst::Label(copy),
+            M68kInst::Move(
+                Size::Byte,
+                Operand::PostInc(AddrReg::A0),
+                Operand::PostInc(AddrReg::A1),
+            ),
+            M68kInst::Dbf(DataReg::D0, copy),
+            M68kInst::Clr(Size::Byte, Operand::AbsLong(Z80_RAM + u32::from(MAILBOX))),
+            M68kInst::Clr(Size::Word, Operand::AbsLong(Z80_RESET)),
+            M68kInst::Clr(Size::Word, Operand::AbsLong(Z80_BUS_REQ)),
+            M68kInst::Moveq(15, DataReg::D0),
+            M68kInst::Label(hold),
+            M68kInst::Dbf(DataReg::D0, hold),
+            M68kInst::Move(
+                Size::Word,
+                Operand::Imm(0x0100),
+                Operand::AbsLong(Z80_RESET),
+            ),
+            M68kInst::Rts,
+        ];
+        insts.extend(self.gen_snd_post());
+        insts
+    }
+
+    /// Take the Z80 bus once the driver has emptied the mailbox, letting it
+    /// run for a while between tries; keeps D0, D1 and A0
+    fn gen_snd_post(&mut self) -> Vec<M68kInst> {
+        let retry = self.next_label("snd_retry");
+        let grant = self.next_label("snd_post_grant");
+        let delay = self.next_label("snd_delay");
+        let ready = self.next_label("snd_ready");
+        vec![
+            M68kInst::Label(SND_POST.into()),
+            M68kInst::Lea(Operand::AbsLong(Z80_RAM + u32::from(MAILBOX)), AddrReg::A1),
+            M68kInst::Label(retry),
+            M68kInst::Move(
+                Size::Word,
+                Operand::Imm(0x0100),
+                Operand::AbsLong(Z80_BUS_REQ),
+            ),
+            M68kInst::Label(grant),
+            M68kInst::Btst(Operand::Imm(0), Operand::AbsLong(Z80_BUS_REQ)),
+            M68kInst::Bcc(Cond::Ne, grant),
+            M68kInst::Tst(Size::Byte, Operand::AddrInd(AddrReg::A1)),
+            M68kInst::Bcc(Cond::Eq, ready),
+            M68kInst::Clr(Size::Word, Operand::AbsLong(Z80_BUS_REQ)),
+            M68kInst::Move(
+                Size::Long,
+                Operand::DataReg(DataReg::D2),
+                Operand::PreDec(AddrReg::A7),
+            ),
+            M68kInst::Move(Size::Word, Operand::Imm(255), Operand::DataReg(DataReg::D2)),
+            M68kInst::Label(delay),
+            M68kInst::Dbf(DataReg::D2, delay),
+            M68kInst::Move(
+                Size::Long,
+                Operand::PostInc(AddrReg::A7),
+                Operand::DataReg(DataReg::D2),
+            ),
+            M68kInst::Bra(retry),
+            M68kInst::Label(ready),
+            M68kInst::Rts,
+        ]
+    }
+
+    /// Write the driver's window address and bank for the 68k address in
+    /// `addr` to the mailbox at `offset`; clobbers both registers
+    fn snd_rom_args(addr: DataReg, tmp: DataReg, offset: i16) -> Vec<M68kInst> {
+        let arg = |i: i16| Operand::Disp(offset + i, AddrReg::A1);
+        vec![
+            M68kInst::Move(Size::Word, Operand::DataReg(addr), Operand::DataReg(tmp)),
+            M68kInst::Move(Size::Byte, Operand::DataReg(tmp), arg(0)),
+            M68kInst::Lsr(Size::Word, Operand::Imm(8), tmp),
+            M68kInst::Ori(Size::Byte, 0x80, Operand::DataReg(tmp)),
+            M68kInst::Move(Size::Byte, Operand::DataReg(tmp), arg(1)),
+            // Bank = addr >> 15
+            M68kInst::Lsl(Size::Long, Operand::Imm(1), addr),
+            M68kInst::Swap(addr),
+            M68kInst::Move(Size::Byte, Operand::DataReg(addr), arg(2)),
+            M68kInst::Lsr(Size::Word, Operand::Imm(8), addr),
+            M68kInst::Move(Size::Byte, Operand::DataReg(addr), arg(3)),
+        ]
+    }
+
+    /// Post `cmd` after its arguments and give the bus back
+    fn snd_send(cmd: u8) -> [M68kInst; 3] {
+        [
+            M68kInst::Move(
+                Size::Byte,
+                Operand::Imm(i32::from(cmd)),
+                Operand::AddrInd(AddrReg::A1),
+            ),
+            M68kInst::Clr(Size::Word, Operand::AbsLong(Z80_BUS_REQ)),
+            M68kInst::Rts,
+        ]
+    }
+
+    fn gen_snd_play_sample(&mut self) -> Vec<M68kInst> {
+        // Register args: D0=channel, D1=68k address, A0=length
+        let mut insts = vec![
+            M68kInst::Label("snd_play_sample".into()),
+            M68kInst::Bsr(SND_POST.into()),
+            M68kInst::Move(
+                Size::Byte,
+                Operand::DataReg(DataReg::D0),
+                Operand::Disp(1, AddrReg::A1),
+            ),
+            M68kInst::Move(
+                Size::Long,
+                Operand::AddrReg(AddrReg::A0),
+                Operand::DataReg(DataReg::D0),
+            ),
+            M68kInst::Move(
+                Size::Byte,
+                Operand::DataReg(DataReg::D0),
+                Operand::Disp(2, AddrReg::A1),
+            ),
+            M68kInst::Lsr(Size::Word, Operand::Imm(8), DataReg::D0),
+            M68kInst::Move(
+                Size::Byte,
+                Operand::DataReg(DataReg::D0),
+                Operand::Disp(3, AddrReg::A1),
+            ),
+        ];
+        insts.extend(Self::snd_rom_args(DataReg::D1, DataReg::D0, 4));
+        insts.extend(Self::snd_send(CMD_PLAY_SAMPLE));
+        insts
+    }
+
+    fn gen_snd_stop_sample(&mut self) -> Vec<M68kInst> {
+        // Register arg: D0=channel
+        let mut insts = vec![
+            M68kInst::Label("snd_stop_sample".into()),
+            M68kInst::Bsr(SND_POST.into()),
+            M68kInst::Move(
+                Size::Byte,
+                Operand::DataReg(DataReg::D0),
+                Operand::Disp(1, AddrReg::A1),
+            ),
+        ];
+        insts.extend(Self::snd_send(CMD_STOP_SAMPLE));
+        insts
+    }
+
+    fn gen_snd_play_song(&mut self) -> Vec<M68kInst> {
+        // Register arg: D0=68k address of the song
+        let mut insts = vec![
+            M68kInst::Label("snd_play_song".into()),
+            M68kInst::Bsr(SND_POST.into()),
+        ];
+        insts.extend(Self::snd_rom_args(DataReg::D0, DataReg::D1, 1));
+        insts.extend(Self::snd_send(CMD_PLAY_SONG));
+        insts
+    }
+
+    fn gen_snd_stop_song(&mut self) -> Vec<M68kInst> {
+        let mut insts = vec![
+            M68kInst::Label("snd_stop_song".into()),
+            M68kInst::Bsr(SND_POST.into()),
+        ];
+        insts.extend(Self::snd_send(CMD_STOP_SONG));
+        insts
+    }
+
     // -------------------------------------------------------------------------
     // VDP DMA Library Functions
     // -------------------------------------------------------------------------
@@ -1905,7 +2354,7 @@ impl SdkLibraryGenerator {
         // Args: 8(a6)=src (68k address), 12(a6)=dst (VRAM address), 16(a6)=len (words)
         // DMA from 68k bus to VRAM: regs 19-23, then command word
         vec![
-            M68kInst::Label("vdp_dma_transfer".to_string()),
+            M68kInst::Label("vdp_dma_transfer".into()),
             M68kInst::Link(AddrReg::A6, 0),
             M68kInst::Lea(Operand::AbsLong(VDP_CTRL), AddrReg::A0),
             // Set DMA length (regs 19-20)
@@ -2008,10 +2457,17 @@ impl SdkLibraryGenerator {
 
     fn gen_vdp_dma_fill(&mut self) -> Vec<M68kInst> {
         // Args: 8(a6)=dst (VRAM address), 12(a6)=value, 16(a6)=len (bytes)
+        let wait = self.next_label("fill_busy");
         vec![
-            M68kInst::Label("vdp_dma_fill".to_string()),
+            M68kInst::Label("vdp_dma_fill".into()),
             M68kInst::Link(AddrReg::A6, 0),
             M68kInst::Lea(Operand::AbsLong(VDP_CTRL), AddrReg::A0),
+            // Byte-wide DMA: auto-increment 1 until it completes
+            M68kInst::Move(
+                Size::Word,
+                Operand::Imm(0x8F01_u16 as i32),
+                Operand::AddrInd(AddrReg::A0),
+            ),
             // Set DMA length
             M68kInst::Move(
                 Size::Long,
@@ -2082,6 +2538,20 @@ impl SdkLibraryGenerator {
                 Operand::DataReg(DataReg::D0),
                 Operand::AbsLong(VDP_DATA),
             ),
+            // Wait for DMA busy to clear, then restore auto-increment 2
+            M68kInst::Label(wait),
+            M68kInst::Move(
+                Size::Word,
+                Operand::AddrInd(AddrReg::A0),
+                Operand::DataReg(DataReg::D0),
+            ),
+            M68kInst::Btst(Operand::Imm(1), Operand::DataReg(DataReg::D0)),
+            M68kInst::Bcc(Cond::Ne, wait),
+            M68kInst::Move(
+                Size::Word,
+                Operand::Imm(0x8F02_u16 as i32),
+                Operand::AddrInd(AddrReg::A0),
+            ),
             M68kInst::Unlk(AddrReg::A6),
             M68kInst::Rts,
         ]
@@ -2089,10 +2559,17 @@ impl SdkLibraryGenerator {
 
     fn gen_vdp_dma_copy(&mut self) -> Vec<M68kInst> {
         // Args: 8(a6)=src (VRAM address), 12(a6)=dst (VRAM address), 16(a6)=len (bytes)
+        let wait = self.next_label("copy_busy");
         vec![
-            M68kInst::Label("vdp_dma_copy".to_string()),
+            M68kInst::Label("vdp_dma_copy".into()),
             M68kInst::Link(AddrReg::A6, 0),
             M68kInst::Lea(Operand::AbsLong(VDP_CTRL), AddrReg::A0),
+            // Byte-wide DMA: auto-increment 1 until it completes
+            M68kInst::Move(
+                Size::Word,
+                Operand::Imm(0x8F01_u16 as i32),
+                Operand::AddrInd(AddrReg::A0),
+            ),
             // Set DMA length
             M68kInst::Move(
                 Size::Long,
@@ -2178,11 +2655,473 @@ impl SdkLibraryGenerator {
                 Operand::DataReg(DataReg::D1),
                 Operand::AddrInd(AddrReg::A0),
             ),
+            // Wait for DMA busy to clear, then restore auto-increment 2
+            M68kInst::Label(wait),
+            M68kInst::Move(
+                Size::Word,
+                Operand::AddrInd(AddrReg::A0),
+                Operand::DataReg(DataReg::D0),
+            ),
+            M68kInst::Btst(Operand::Imm(1), Operand::DataReg(DataReg::D0)),
+            M68kInst::Bcc(Cond::Ne, wait),
+            M68kInst::Move(
+                Size::Word,
+                Operand::Imm(0x8F02_u16 as i32),
+                Operand::AddrInd(AddrReg::A0),
+            ),
             M68kInst::Unlk(AddrReg::A6),
             M68kInst::Rts,
         ]
     }
 
+    // -------------------------------------------------------------------------
+    // DMA Queue Library Functions
+    // -------------------------------------------------------------------------
+    //
+    // Queued DMAs wait in a RAM ring and run once vdp_wait_vblank_start sees
+    // vblank begin, when the VDP moves data several times faster than during
+    // active display.
+    // Each 16-byte entry holds, in order: type.w (0 = 68k transfer, 1 = fill,
+    // 2 = VRAM copy), dst.w, len.w (words for transfers, bytes otherwise),
+    // value.w (fill value) and src.l.
+
+    /// DMA bytes the flush starts per frame, about what one NTSC vblank
+    /// moves in H40
+    const DMA_BUDGET: i32 = 7200;
+
+    fn gen_dma_queue_transfer(&mut self) -> Vec<M68kInst> {
+        // Args: d0=src (68k address), d1=dst (VRAM address), a0=len (words)
+        let mut insts = vec![
+            M68kInst::Label("dma_queue_transfer".into()),
+            M68kInst::Andi(Size::Long, 0xFFFF, Operand::DataReg(DataReg::D1)),
+        ];
+        insts.extend(self.gen_dma_push());
+        insts
+    }
+
+    fn gen_dma_queue_fill(&mut self) -> Vec<M68kInst> {
+        // Args: d0=dst (VRAM address), d1=value, a0=len (bytes)
+        vec![
+            M68kInst::Label("dma_queue_fill".into()),
+            M68kInst::Move(
+                Size::Long,
+                Operand::DataReg(DataReg::D1),
+                Operand::AddrReg(AddrReg::A1),
+            ),
+            M68kInst::Move(
+                Size::Long,
+                Operand::DataReg(DataReg::D0),
+                Operand::DataReg(DataReg::D1),
+            ),
+            M68kInst::Andi(Size::Long, 0xFFFF, Operand::DataReg(DataReg::D1)),
+            M68kInst::Ori(Size::Long, 0x0001_0000, Operand::DataReg(DataReg::D1)),
+            M68kInst::Moveq(0, DataReg::D0),
+            M68kInst::Bra(DMA_PUSH.into()),
+        ]
+    }
+
+    fn gen_dma_queue_copy(&mut self) -> Vec<M68kInst> {
+        // Args: d0=src (VRAM address), d1=dst (VRAM address), a0=len (bytes)
+        vec![
+            M68kInst::Label("dma_queue_copy".into()),
+            M68kInst::Andi(Size::Long, 0xFFFF, Operand::DataReg(DataReg::D1)),
+            M68kInst::Ori(Size::Long, 0x0002_0000, Operand::DataReg(DataReg::D1)),
+            M68kInst::Bra(DMA_PUSH.into()),
+        ]
+    }
+
+    /// Shared tail of the `dma_queue_*` calls, emitted with
+    /// `dma_queue_transfer`
+    ///
+    /// Takes d0=src, d1=type:dst, a0=len, a1=value and returns 1 in d0, or 0
+    /// when the ring is full. A transfer that continues the previous one in
+    /// both 68k memory and VRAM extends that entry instead of taking a new one.
+    fn gen_dma_push(&mut self) -> Vec<M68kInst> {
+        let append = self.next_label("dmaq_append");
+        let full = self.next_label("dmaq_full");
+        let done = self.next_label("dmaq_done");
+        let saved = vec![
+            Reg::Data(DataReg::D2),
+            Reg::Data(DataReg::D3),
+            Reg::Data(DataReg::D4),
+            Reg::Addr(AddrReg::A2),
+        ];
+        let d = Operand::DataReg;
+        vec![
+            M68kInst::Label(DMA_PUSH.into()),
+            // A vblank_handler may queue too, so keep it out while we edit
+            M68kInst::Move(Size::Word, Operand::Sr, Operand::PreDec(AddrReg::A7)),
+            M68kInst::Move(Size::Word, Operand::Imm(0x2700), Operand::Sr),
+            M68kInst::Movem(
+                Size::Long,
+                saved.clone(),
+                Operand::PreDec(AddrReg::A7),
+                true,
+            ),
+            M68kInst::Lea(Operand::Label("__sdk_dma_head".into()), AddrReg::A2),
+            M68kInst::Move(Size::Word, Operand::Disp(2, AddrReg::A2), d(DataReg::D2)),
+            M68kInst::Bcc(Cond::Eq, append),
+            // Only a transfer can join the newest entry
+            M68kInst::Move(Size::Long, d(DataReg::D1), d(DataReg::D3)),
+            M68kInst::Swap(DataReg::D3),
+            M68kInst::Tst(Size::Word, d(DataReg::D3)),
+            M68kInst::Bcc(Cond::Ne, append),
+            M68kInst::Add(Size::Word, Operand::AddrInd(AddrReg::A2), d(DataReg::D2)),
+            M68kInst::Subq(Size::Word, 1, d(DataReg::D2)),
+            M68kInst::Andi(Size::Word, DMA_QUEUE_LEN as i32 - 1, d(DataReg::D2)),
+            M68kInst::Lsl(Size::Word, Operand::Imm(4), DataReg::D2),
+            M68kInst::Lea(Operand::Label("__sdk_dma_queue".into()), AddrReg::A2),
+            M68kInst::Adda(Size::Word, d(DataReg::D2), AddrReg::A2),
+            M68kInst::Tst(Size::Word, Operand::AddrInd(AddrReg::A2)),
+            M68kInst::Bcc(Cond::Ne, append),
+            // Both ends must meet: src == last src + bytes, dst == last dst + bytes
+            M68kInst::Moveq(0, DataReg::D3),
+            M68kInst::Move(Size::Word, Operand::Disp(4, AddrReg::A2), d(DataReg::D3)),
+            M68kInst::Add(Size::Long, d(DataReg::D3), d(DataReg::D3)),
+            M68kInst::Move(Size::Long, Operand::Disp(8, AddrReg::A2), d(DataReg::D4)),
+            M68kInst::Add(Size::Long, d(DataReg::D3), d(DataReg::D4)),
+            M68kInst::Cmp(Size::Long, d(DataReg::D0), d(DataReg::D4)),
+            M68kInst::Bcc(Cond::Ne, append),
+            M68kInst::Add(Size::Word, Operand::Disp(2, AddrReg::A2), d(DataReg::D3)),
+            M68kInst::Cmp(Size::Word, d(DataReg::D1), d(DataReg::D3)),
+            M68kInst::Bcc(Cond::Ne, append),
+            // The joined length must fit the length registers...
+            M68kInst::Moveq(0, DataReg::D3),
+            M68kInst::Move(Size::Word, Operand::Disp(4, AddrReg::A2), d(DataReg::D3)),
+            M68kInst::Moveq(0, DataReg::D4),
+            M68kInst::Move(Size::Word, Operand::AddrReg(AddrReg::A0), d(DataReg::D4)),
+            M68kInst::Add(Size::Long, d(DataReg::D4), d(DataReg::D3)),
+            M68kInst::Cmpi(Size::Long, 0xFFFF, d(DataReg::D3)),
+            M68kInst::Bcc(Cond::Hi, append),
+            // ...and the source may not cross a 128 KB bank
+            M68kInst::Move(Size::Long, d(DataReg::D3), d(DataReg::D4)),
+            M68kInst::Add(Size::Long, d(DataReg::D4), d(DataReg::D4)),
+            M68kInst::Move(Size::Long, Operand::Disp(8, AddrReg::A2), d(DataReg::D2)),
+            M68kInst::Add(Size::Long, d(DataReg::D2), d(DataReg::D4)),
+            M68kInst::Subq(Size::Long, 1, d(DataReg::D4)),
+            M68kInst::Eor(Size::Long, DataReg::D2, d(DataReg::D4)),
+            M68kInst::Andi(Size::Long, 0xFFFE_0000_u32 as i32, d(DataReg::D4)),
+            M68kInst::Bcc(Cond::Ne, append),
+            M68kInst::Move(Size::Word, d(DataReg::D3), Operand::Disp(4, AddrReg::A2)),
+            M68kInst::Moveq(1, DataReg::D0),
+            M68kInst::Bra(done),
+            // New entry at (head + count) & mask
+            M68kInst::Label(append),
+            M68kInst::Lea(Operand::Label("__sdk_dma_head".into()), AddrReg::A2),
+            M68kInst::Move(Size::Word, Operand::Disp(2, AddrReg::A2), d(DataReg::D2)),
+            M68kInst::Cmpi(Size::Word, DMA_QUEUE_LEN as i32, d(DataReg::D2)),
+            M68kInst::Bcc(Cond::Cc, full),
+            M68kInst::Addq(Size::Word, 1, Operand::Disp(2, AddrReg::A2)),
+            M68kInst::Add(Size::Word, Operand::AddrInd(AddrReg::A2), d(DataReg::D2)),
+            M68kInst::Andi(Size::Word, DMA_QUEUE_LEN as i32 - 1, d(DataReg::D2)),
+            M68kInst::Lsl(Size::Word, Operand::Imm(4), DataReg::D2),
+            M68kInst::Lea(Operand::Label("__sdk_dma_queue".into()), AddrReg::A2),
+            M68kInst::Adda(Size::Word, d(DataReg::D2), AddrReg::A2),
+            M68kInst::Swap(DataReg::D1),
+            M68kInst::Move(Size::Word, d(DataReg::D1), Operand::PostInc(AddrReg::A2)),
+            M68kInst::Swap(DataReg::D1),
+            M68kInst::Move(Size::Word, d(DataReg::D1), Operand::PostInc(AddrReg::A2)),
+            M68kInst::Move(
+                Size::Word,
+                Operand::AddrReg(AddrReg::A0),
+                Operand::PostInc(AddrReg::A2),
+            ),
+            M68kInst::Move(
+                Size::Word,
+                Operand::AddrReg(AddrReg::A1),
+                Operand::PostInc(AddrReg::A2),
+            ),
+            M68kInst::Move(Size::Long, d(DataReg::D0), Operand::AddrInd(AddrReg::A2)),
+            M68kInst::Moveq(1, DataReg::D0),
+            M68kInst::Bra(done),
+            M68kInst::Label(full),
+            M68kInst::Moveq(0, DataReg::D0),
+            M68kInst::Label(done),
+            M68kInst::Movem(Size::Long, saved, Operand::PostInc(AddrReg::A7), false),
+            M68kInst::Move(Size::Word, Operand::PostInc(AddrReg::A7), Operand::Sr),
+            M68kInst::Rts,
+        ]
+    }
+
+    fn gen_dma_queue_flush(&mut self) -> Vec<M68kInst> {
+        // Starts queued DMAs, oldest first, until the ring is empty or this
+        // frame's byte budget is spent. The first entry always goes, so an
+        // entry larger than the budget cannot stall the ring.
+        let next_entry = self.next_label("dmaq_entry");
+        let fill = self.next_label("dmaq_fill");
+        let transfer = self.next_label("dmaq_transfer");
+        let next = self.next_label("dmaq_next");
+        let store = self.next_label("dmaq_store");
+        let done = self.next_label("dmaq_flushed");
+        let saved = vec![
+            Reg::Data(DataReg::D2),
+            Reg::Data(DataReg::D3),
+            Reg::Data(DataReg::D4),
+            Reg::Addr(AddrReg::A2),
+        ];
+        let d = Operand::DataReg;
+        // Zero-extended word from the entry, pushed as a long argument
+        let push_word = |offset: i16| {
+            [
+                M68kInst::Moveq(0, DataReg::D0),
+                M68kInst::Move(
+                    Size::Word,
+                    Operand::Disp(offset, AddrReg::A2),
+                    d(DataReg::D0),
+                ),
+                M68kInst::Move(Size::Long, d(DataReg::D0), Operand::PreDec(AddrReg::A7)),
+            ]
+        };
+        let mut insts = vec![
+            M68kInst::Label("dma_queue_flush".into()),
+            M68kInst::Move(Size::Word, Operand::Sr, Operand::PreDec(AddrReg::A7)),
+            M68kInst::Move(Size::Word, Operand::Imm(0x2700), Operand::Sr),
+            M68kInst::Movem(
+                Size::Long,
+                saved.clone(),
+                Operand::PreDec(AddrReg::A7),
+                true,
+            ),
+            M68kInst::Lea(Operand::Label("__sdk_dma_head".into()), AddrReg::A2),
+            M68kInst::Move(Size::Word, Operand::AddrInd(AddrReg::A2), d(DataReg::D4)),
+            M68kInst::Move(Size::Word, Operand::Disp(2, AddrReg::A2), d(DataReg::D2)),
+            M68kInst::Bcc(Cond::Eq, done),
+            M68kInst::Move(Size::Long, Operand::Imm(Self::DMA_BUDGET), d(DataReg::D3)),
+            M68kInst::Label(next_entry),
+            M68kInst::Move(Size::Word, d(DataReg::D4), d(DataReg::D0)),
+            M68kInst::Lsl(Size::Word, Operand::Imm(4), DataReg::D0),
+            M68kInst::Lea(Operand::Label("__sdk_dma_queue".into()), AddrReg::A2),
+            M68kInst::Adda(Size::Word, d(DataReg::D0), AddrReg::A2),
+        ];
+        // Every routine takes len last, so push it first and charge it
+        insts.extend(push_word(4));
+        insts.extend([
+            M68kInst::Sub(Size::Long, d(DataReg::D0), d(DataReg::D3)),
+            M68kInst::Move(Size::Word, Operand::AddrInd(AddrReg::A2), d(DataReg::D1)),
+            M68kInst::Bcc(Cond::Eq, transfer),
+            M68kInst::Subq(Size::Word, 1, d(DataReg::D1)),
+            M68kInst::Bcc(Cond::Eq, fill),
+            // vdp_dma_copy(src, dst, len)
+        ]);
+        insts.extend(push_word(2));
+        insts.extend([
+            M68kInst::Move(
+                Size::Long,
+                Operand::Disp(8, AddrReg::A2),
+                Operand::PreDec(AddrReg::A7),
+            ),
+            M68kInst::Bsr("vdp_dma_copy".into()),
+            M68kInst::Bra(next),
+            // vdp_dma_fill(dst, value, len)
+            M68kInst::Label(fill),
+        ]);
+        insts.extend(push_word(6));
+        insts.extend(push_word(2));
+        insts.extend([
+            M68kInst::Bsr("vdp_dma_fill".into()),
+            M68kInst::Bra(next),
+            // vdp_dma_transfer(src, dst, len), len in words
+            M68kInst::Label(transfer),
+            M68kInst::Sub(Size::Long, d(DataReg::D0), d(DataReg::D3)),
+        ]);
+        insts.extend(push_word(2));
+        insts.extend([
+            M68kInst::Move(
+                Size::Long,
+                Operand::Disp(8, AddrReg::A2),
+                Operand::PreDec(AddrReg::A7),
+            ),
+            M68kInst::Bsr("vdp_dma_transfer".into()),
+            M68kInst::Label(next),
+            M68kInst::Lea(Operand::Disp(12, AddrReg::A7), AddrReg::A7),
+            M68kInst::Addq(Size::Word, 1, d(DataReg::D4)),
+            M68kInst::Andi(Size::Word, DMA_QUEUE_LEN as i32 - 1, d(DataReg::D4)),
+            M68kInst::Subq(Size::Word, 1, d(DataReg::D2)),
+            M68kInst::Bcc(Cond::Eq, store),
+            M68kInst::Tst(Size::Long, d(DataReg::D3)),
+            M68kInst::Bcc(Cond::Gt, next_entry),
+            M68kInst::Label(store),
+            M68kInst::Lea(Operand::Label("__sdk_dma_head".into()), AddrReg::A2),
+            M68kInst::Move(Size::Word, d(DataReg::D4), Operand::AddrInd(AddrReg::A2)),
+            M68kInst::Move(Size::Word, d(DataReg::D2), Operand::Disp(2, AddrReg::A2)),
+            M68kInst::Label(done),
+            M68kInst::Movem(Size::Long, saved, Operand::PostInc(AddrReg::A7), false),
+            M68kInst::Move(Size::Word, Operand::PostInc(AddrReg::A7), Operand::Sr),
+            M68kInst::Rts,
+        ]);
+        insts
+    }
+
+    fn gen_dma_queue_clear(&mut self) -> Vec<M68kInst> {
+        vec![
+            M68kInst::Label("dma_queue_clear".into()),
+            M68kInst::Lea(Operand::Label("__sdk_dma_head".into()), AddrReg::A0),
+            M68kInst::Clr(Size::Long, Operand::AddrInd(AddrReg::A0)),
+            M68kInst::Rts,
+        ]
+    }
+
+    /// Unpack tiles packed by `smdc --asset` (see `asset::lz`) into the RAM
+    /// window and queue their DMA to VRAM by chunks, so the copy to VRAM runs
+    /// in vblank instead of stalling the caller on the data port.
+    ///
+    /// The window is handed out front to back and starts over once the DMA
+    /// queue is empty, as nothing queued reads it any more. When a chunk
+    /// doesn't fit or the ring is full, this waits a frame for
+    /// `vdp_wait_vblank_start` to drain the queue, so it must not be called
+    /// with interrupts off.
+    fn gen_vdp_load_tiles_packed(&mut self) -> Vec<M68kInst> {
+        // Args: 8(a6)=packed data, 12(a6)=first tile index
+        // a2 = packed stream, a3 = chunk in the window, a1 = output,
+        // d2 = bytes left in the chunk, d3 = chunk bytes, d4 = VRAM address
+        let chunk = self.next_label("vltp_chunk");
+        let room = self.next_label("vltp_room");
+        let wait = self.next_label("vltp_wait");
+        let fits = self.next_label("vltp_fits");
+        let token = self.next_label("vltp_token");
+        let literal = self.next_label("vltp_literal");
+        let matched = self.next_label("vltp_match");
+        let copy = self.next_label("vltp_copy");
+        let queue = self.next_label("vltp_queue");
+        let queued = self.next_label("vltp_queued");
+        let done = self.next_label("vltp_done");
+        let saved = vec![
+            Reg::Data(DataReg::D2),
+            Reg::Data(DataReg::D3),
+            Reg::Data(DataReg::D4),
+            Reg::Addr(AddrReg::A2),
+            Reg::Addr(AddrReg::A3),
+        ];
+        let d = Operand::DataReg;
+        // Big-endian word from the unaligned stream into `reg`, zero-extended
+        let read_word = |reg: DataReg| {
+            [
+                M68kInst::Moveq(0, reg),
+                M68kInst::Move(Size::Byte, Operand::PostInc(AddrReg::A2), d(reg)),
+                M68kInst::Lsl(Size::Word, Operand::Imm(8), reg),
+                M68kInst::Move(Size::Byte, Operand::PostInc(AddrReg::A2), d(reg)),
+            ]
+        };
+        let queue_empty = [
+            M68kInst::Lea(Operand::Label("__sdk_dma_head".into()), AddrReg::A0),
+            M68kInst::Tst(Size::Word, Operand::Disp(2, AddrReg::A0)),
+        ];
+        let mut insts = vec![
+            M68kInst::Label("vdp_load_tiles_packed".into()),
+            M68kInst::Link(AddrReg::A6, 0),
+            M68kInst::Movem(
+                Size::Long,
+                saved.clone(),
+                Operand::PreDec(AddrReg::A7),
+                true,
+            ),
+            M68kInst::Move(
+                Size::Long,
+                Operand::Disp(8, AddrReg::A6),
+                Operand::AddrReg(AddrReg::A2),
+            ),
+            M68kInst::Move(Size::Long, Operand::Disp(12, AddrReg::A6), d(DataReg::D4)),
+            M68kInst::Lsl(Size::Long, Operand::Imm(5), DataReg::D4),
+            M68kInst::Label(chunk),
+        ];
+        insts.extend(read_word(DataReg::D3));
+        insts.extend([
+            M68kInst::Tst(Size::Word, d(DataReg::D3)),
+            M68kInst::Bcc(Cond::Eq, done),
+        ]);
+        // Claim d3 bytes of the window
+        insts.extend(queue_empty.clone());
+        insts.extend([
+            M68kInst::Lea(Operand::Label("__sdk_unpack_used".into()), AddrReg::A1),
+            M68kInst::Bcc(Cond::Ne, room),
+            M68kInst::Clr(Size::Word, Operand::AddrInd(AddrReg::A1)),
+            M68kInst::Label(room),
+            M68kInst::Move(Size::Word, Operand::AddrInd(AddrReg::A1), d(DataReg::D0)),
+            M68kInst::Add(Size::Word, d(DataReg::D3), d(DataReg::D0)),
+            M68kInst::Cmpi(Size::Word, UNPACK_WINDOW as i32, d(DataReg::D0)),
+            M68kInst::Bcc(Cond::Ls, fits),
+            M68kInst::Label(wait),
+            M68kInst::Bsr("vdp_wait_vblank_start".into()),
+        ]);
+        insts.extend(queue_empty);
+        insts.extend([
+            M68kInst::Bcc(Cond::Ne, wait),
+            M68kInst::Lea(Operand::Label("__sdk_unpack_used".into()), AddrReg::A1),
+            M68kInst::Clr(Size::Word, Operand::AddrInd(AddrReg::A1)),
+            M68kInst::Move(Size::Word, d(DataReg::D3), d(DataReg::D0)),
+            M68kInst::Label(fits),
+            M68kInst::Lea(Operand::Label("__sdk_unpack_window".into()), AddrReg::A3),
+            M68kInst::Adda(Size::Word, Operand::AddrInd(AddrReg::A1), AddrReg::A3),
+            M68kInst::Move(Size::Word, d(DataReg::D0), Operand::AddrInd(AddrReg::A1)),
+            M68kInst::Move(
+                Size::Long,
+                Operand::AddrReg(AddrReg::A3),
+                Operand::AddrReg(AddrReg::A1),
+            ),
+            M68kInst::Move(Size::Word, d(DataReg::D3), d(DataReg::D2)),
+            // Tokens until the chunk is complete
+            M68kInst::Label(token),
+            M68kInst::Moveq(0, DataReg::D0),
+            M68kInst::Move(Size::Byte, Operand::PostInc(AddrReg::A2), d(DataReg::D0)),
+            M68kInst::Bcc(Cond::Mi, matched),
+            // d0 + 1 literal bytes
+            M68kInst::Sub(Size::Word, d(DataReg::D0), d(DataReg::D2)),
+            M68kInst::Label(literal),
+            M68kInst::Move(
+                Size::Byte,
+                Operand::PostInc(AddrReg::A2),
+                Operand::PostInc(AddrReg::A1),
+            ),
+            M68kInst::Dbf(DataReg::D0, literal),
+            M68kInst::Subq(Size::Word, 1, d(DataReg::D2)),
+            M68kInst::Bcc(Cond::Ne, token),
+            M68kInst::Bra(queue),
+            // (d0 & 0x7F) + 3 bytes from distance bytes back
+            M68kInst::Label(matched),
+            M68kInst::Andi(Size::Word, 0x7F, d(DataReg::D0)),
+            M68kInst::Addq(Size::Word, 2, d(DataReg::D0)),
+            M68kInst::Sub(Size::Word, d(DataReg::D0), d(DataReg::D2)),
+        ]);
+        insts.extend(read_word(DataReg::D1));
+        insts.extend([
+            M68kInst::Move(
+                Size::Long,
+                Operand::AddrReg(AddrReg::A1),
+                Operand::AddrReg(AddrReg::A0),
+            ),
+            M68kInst::Suba(Size::Long, d(DataReg::D1), AddrReg::A0),
+            M68kInst::Label(copy),
+            M68kInst::Move(
+                Size::Byte,
+                Operand::PostInc(AddrReg::A0),
+                Operand::PostInc(AddrReg::A1),
+            ),
+            M68kInst::Dbf(DataReg::D0, copy),
+            M68kInst::Subq(Size::Word, 1, d(DataReg::D2)),
+            M68kInst::Bcc(Cond::Ne, token),
+            // Queue the chunk, retrying a frame later while the ring is full
+            M68kInst::Label(queue),
+            M68kInst::Move(Size::Long, Operand::AddrReg(AddrReg::A3), d(DataReg::D0)),
+            M68kInst::Move(Size::Long, d(DataReg::D3), d(DataReg::D1)),
+            M68kInst::Lsr(Size::Word, Operand::Imm(1), DataReg::D1),
+            M68kInst::Move(Size::Long, d(DataReg::D1), Operand::AddrReg(AddrReg::A0)),
+            M68kInst::Move(Size::Long, d(DataReg::D4), d(DataReg::D1)),
+            M68kInst::Bsr("dma_queue_transfer".into()),
+            M68kInst::Tst(Size::Long, d(DataReg::D0)),
+            M68kInst::Bcc(Cond::Ne, queued),
+            M68kInst::Bsr("vdp_wait_vblank_start".into()),
+            M68kInst::Bra(queue),
+            M68kInst::Label(queued),
+            M68kInst::Add(Size::Long, d(DataReg::D3), d(DataReg::D4)),
+            M68kInst::Bra(chunk),
+            M68kInst::Label(done),
+            M68kInst::Movem(Size::Long, saved, Operand::PostInc(AddrReg::A7), false),
+            M68kInst::Unlk(AddrReg::A6),
+            M68kInst::Rts,
+        ]);
+        insts
+    }
+
     // -------------------------------------------------------------------------
     // VDP Window Library Functions
     // -------------------------------------------------------------------------
@@ -2191,7 +3130,7 @@ impl SdkLibraryGenerator {
         // Args: 8(a6)=x, 12(a6)=y, 16(a6)=tile
         // Window plane at VRAM 0xD000
         vec![
-            M68kInst::Label("vdp_set_tile_w".to_string()),
+            M68kInst::Label("vdp_set_tile_w".into()),
             M68kInst::Link(AddrReg::A6, 0),
             // addr = 0xD000 + (y * 128) + (x * 2)
             M68kInst::Move(
@@ -2264,7 +3203,7 @@ impl SdkLibraryGenerator {
         // AABB test: overlap if x1 < x2+w2 && x2 < x1+w1 && y1 < y2+h2 && y2 < y1+h1
         let no_overlap = self.next_label("ro_no");
         vec![
-            M68kInst::Label("rect_overlap".to_string()),
+            M68kInst::Label("rect_overlap".into()),
             // Test x1 < x2 + w2
             M68kInst::Move(
                 Size::Long,
@@ -2281,7 +3220,7 @@ impl SdkLibraryGenerator {
                 Operand::Disp(4, AddrReg::A7),
                 Operand::DataReg(DataReg::D0),
             ),
-            M68kInst::Bcc(Cond::Le, no_overlap.clone()),
+            M68kInst::Bcc(Cond::Le, no_overlap),
             // Test x2 < x1 + w1
             M68kInst::Move(
                 Size::Long,
@@ -2298,7 +3237,7 @@ impl SdkLibraryGenerator {
                 Operand::Disp(20, AddrReg::A7),
                 Operand::DataReg(DataReg::D0),
             ),
-            M68kInst::Bcc(Cond::Le, no_overlap.clone()),
+            M68kInst::Bcc(Cond::Le, no_overlap),
             // Test y1 < y2 + h2
             M68kInst::Move(
                 Size::Long,
@@ -2315,7 +3254,7 @@ impl SdkLibraryGenerator {
                 Operand::Disp(8, AddrReg::A7),
                 Operand::DataReg(DataReg::D0),
             ),
-            M68kInst::Bcc(Cond::Le, no_overlap.clone()),
+            M68kInst::Bcc(Cond::Le, no_overlap),
             // Test y2 < y1 + h1
             M68kInst::Move(
                 Size::Long,
@@ -2332,7 +3271,7 @@ impl SdkLibraryGenerator {
                 Operand::Disp(24, AddrReg::A7),
                 Operand::DataReg(DataReg::D0),
             ),
-            M68kInst::Bcc(Cond::Le, no_overlap.clone()),
+            M68kInst::Bcc(Cond::Le, no_overlap),
             // All tests passed — overlap
             M68kInst::Moveq(1, DataReg::D0),
             M68kInst::Rts,
@@ -2351,7 +3290,7 @@ impl SdkLibraryGenerator {
         // Args: 8(a6)=dst, 12(a6)=offset, 16(a6)=len
         let loop_label = self.next_label("srd_loop");
         vec![
-            M68kInst::Label("sram_read".to_string()),
+            M68kInst::Label("sram_read".into()),
             M68kInst::Link(AddrReg::A6, 0),
             M68kInst::Move(
                 Size::Long,
@@ -2380,8 +3319,8 @@ impl SdkLibraryGenerator {
                 Operand::DataReg(DataReg::D0),
             ),
             M68kInst::Subq(Size::Long, 1, Operand::DataReg(DataReg::D0)),
-            M68kInst::Bcc(Cond::Mi, ".srd_done".to_string()),
-            M68kInst::Label(loop_label.clone()),
+            M68kInst::Bcc(Cond::Mi, ".srd_done".into()),
+            M68kInst::Label(loop_label),
             M68kInst::Move(
                 Size::Byte,
                 Operand::AddrInd(AddrReg::A0),
@@ -2389,7 +3328,7 @@ impl SdkLibraryGenerator {
             ),
             M68kInst::Addq(Size::Long, 2, Operand::AddrReg(AddrReg::A0)),
             M68kInst::Dbf(DataReg::D0, loop_label),
-            M68kInst::Label(".srd_done".to_string()),
+            M68kInst::Label(".srd_done".into()),
             M68kInst::Unlk(AddrReg::A6),
             M68kInst::Rts,
         ]
@@ -2399,7 +3338,7 @@ impl SdkLibraryGenerator {
         // Args: 8(a6)=src, 12(a6)=offset, 16(a6)=len
         let loop_label = self.next_label("swr_loop");
         vec![
-            M68kInst::Label("sram_write".to_string()),
+            M68kInst::Label("sram_write".into()),
             M68kInst::Link(AddrReg::A6, 0),
             M68kInst::Move(
                 Size::Long,
@@ -2428,8 +3367,8 @@ impl SdkLibraryGenerator {
                 Operand::DataReg(DataReg::D0),
             ),
             M68kInst::Subq(Size::Long, 1, Operand::DataReg(DataReg::D0)),
-            M68kInst::Bcc(Cond::Mi, ".swr_done".to_string()),
-            M68kInst::Label(loop_label.clone()),
+            M68kInst::Bcc(Cond::Mi, ".swr_done".into()),
+            M68kInst::Label(loop_label),
             M68kInst::Move(
                 Size::Byte,
                 Operand::PostInc(AddrReg::A0),
@@ -2437,7 +3376,7 @@ impl SdkLibraryGenerator {
             ),
             M68kInst::Addq(Size::Long, 2, Operand::AddrReg(AddrReg::A1)),
             M68kInst::Dbf(DataReg::D0, loop_label),
-            M68kInst::Label(".swr_done".to_string()),
+            M68kInst::Label(".swr_done".into()),
             M68kInst::Unlk(AddrReg::A6),
             M68kInst::Rts,
         ]
@@ -7,11 +7,17 @@ mod deps;
 mod inline;
 mod library;
 mod registry;
+mod specialize;
+mod z80;
 
-pub use deps::{generate_static_data, get_sdk_dependencies, resolve_dependencies};
+pub use deps::{
+    generate_static_data, get_sdk_dependencies, inline_uses_static_data, needs_dma_queue,
+    needs_frame_counter, resolve_dependencies,
+};
 pub use inline::SdkInlineGenerator;
-pub use library::SdkLibraryGenerator;
+pub use library::{SdkLibraryGenerator, VBLANK_CALLBACK, VBLANK_HANDLER, VBLANK_WORK};
 pub use registry::SdkRegistry;
+pub use specialize::SdkSpecializer;
 
 // ============================================================================
 // Hardware Addresses
@@ -30,6 +36,11 @@ pub const YM_DATA0: u32 = 0xA04001;
 pub const YM_ADDR1: u32 = 0xA04002;
 pub const YM_DATA1: u32 = 0xA04003;
 
+/// Z80 RAM (68000 view), bus request and reset registers
+pub const Z80_RAM: u32 = 0xA00000;
+pub const Z80_BUS_REQ: u32 = 0xA11100;
+pub const Z80_RESET: u32 = 0xA11200;
+
 /// SRAM (battery-backed save RAM)
 pub const SRAM_CTRL: u32 = 0xA130F1;
 pub const SRAM_BASE: u32 = 0x200001; // Odd-byte addressing
@@ -55,6 +66,7 @@ pub enum SdkCategory {
     Input,
     Ym2612,
     Psg,
+    Sound,
     Util,
     Sram,
 }
@@ -67,6 +79,9 @@ pub struct SdkFunction {
     pub category: SdkCategory,
     pub param_count: usize,
     pub has_return: bool,
+    /// Library routine taking its first `min(param_count, 4)` arguments in
+    /// the register convention's argument registers (D0, D1, A0, A1)
+    pub reg_args: bool,
 }
 
 #[cfg(test)]
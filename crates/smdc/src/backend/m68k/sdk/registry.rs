@@ -27,6 +27,9 @@ impl SdkRegistry {
         // PSG Functions
         Self::register_psg_functions(&mut functions);
 
+        // Sound driver Functions
+        Self::register_sound_functions(&mut functions);
+
         // Util Functions
         Self::register_util_functions(&mut functions);
 
@@ -57,6 +60,7 @@ impl SdkRegistry {
                 category: Vdp,
                 param_count: 2,
                 has_return: false,
+                reg_args: false,
             },
         );
         map.insert(
@@ -67,6 +71,7 @@ impl SdkRegistry {
                 category: Vdp,
                 param_count: 0,
                 has_return: true,
+                reg_args: false,
             },
         );
         map.insert(
@@ -77,6 +82,7 @@ impl SdkRegistry {
                 category: Vdp,
                 param_count: 1,
                 has_return: false,
+                reg_args: false,
             },
         );
         map.insert(
@@ -87,6 +93,7 @@ impl SdkRegistry {
                 category: Vdp,
                 param_count: 1,
                 has_return: false,
+                reg_args: false,
             },
         );
         map.insert(
@@ -97,6 +104,7 @@ impl SdkRegistry {
                 category: Vdp,
                 param_count: 2,
                 has_return: false,
+                reg_args: false,
             },
         );
         map.insert(
@@ -107,6 +115,7 @@ impl SdkRegistry {
                 category: Vdp,
                 param_count: 2,
                 has_return: false,
+                reg_args: false,
             },
         );
         map.insert(
@@ -117,6 +126,7 @@ impl SdkRegistry {
                 category: Vdp,
                 param_count: 0,
                 has_return: true,
+                reg_args: false,
             },
         );
 
@@ -129,6 +139,7 @@ impl SdkRegistry {
                 category: Vdp,
                 param_count: 0,
                 has_return: false,
+                reg_args: false,
             },
         );
         map.insert(
@@ -139,6 +150,7 @@ impl SdkRegistry {
                 category: Vdp,
                 param_count: 0,
                 has_return: false,
+                reg_args: false,
             },
         );
         map.insert(
@@ -149,6 +161,7 @@ impl SdkRegistry {
                 category: Vdp,
                 param_count: 0,
                 has_return: false,
+                reg_args: false,
             },
         );
         map.insert(
@@ -159,6 +172,7 @@ impl SdkRegistry {
                 category: Vdp,
                 param_count: 0,
                 has_return: false,
+                reg_args: false,
             },
         );
         map.insert(
@@ -169,6 +183,7 @@ impl SdkRegistry {
                 category: Vdp,
                 param_count: 0,
                 has_return: false,
+                reg_args: false,
             },
         );
         map.insert(
@@ -179,6 +194,7 @@ impl SdkRegistry {
                 category: Vdp,
                 param_count: 3,
                 has_return: false,
+                reg_args: false,
             },
         );
         map.insert(
@@ -189,6 +205,18 @@ impl SdkRegistry {
                 category: Vdp,
                 param_count: 3,
                 has_return: false,
+                reg_args: false,
+            },
+        );
+        map.insert(
+            "vdp_load_tiles_packed",
+            SdkFunction {
+                name: "vdp_load_tiles_packed",
+                kind: Library,
+                category: Vdp,
+                param_count: 2,
+                has_return: false,
+                reg_args: false,
             },
         );
         map.insert(
@@ -199,6 +227,7 @@ impl SdkRegistry {
                 category: Vdp,
                 param_count: 3,
                 has_return: false,
+                reg_args: false,
             },
         );
         map.insert(
@@ -209,6 +238,7 @@ impl SdkRegistry {
                 category: Vdp,
                 param_count: 3,
                 has_return: false,
+                reg_args: false,
             },
         );
         map.insert(
@@ -219,6 +249,7 @@ impl SdkRegistry {
                 category: Vdp,
                 param_count: 0,
                 has_return: false,
+                reg_args: false,
             },
         );
         map.insert(
@@ -229,6 +260,7 @@ impl SdkRegistry {
                 category: Vdp,
                 param_count: 0,
                 has_return: false,
+                reg_args: false,
             },
         );
         map.insert(
@@ -239,6 +271,7 @@ impl SdkRegistry {
                 category: Vdp,
                 param_count: 1,
                 has_return: false,
+                reg_args: false,
             },
         );
         map.insert(
@@ -249,6 +282,7 @@ impl SdkRegistry {
                 category: Vdp,
                 param_count: 1,
                 has_return: false,
+                reg_args: false,
             },
         );
         map.insert(
@@ -259,6 +293,7 @@ impl SdkRegistry {
                 category: Vdp,
                 param_count: 1,
                 has_return: false,
+                reg_args: false,
             },
         );
         map.insert(
@@ -269,6 +304,7 @@ impl SdkRegistry {
                 category: Vdp,
                 param_count: 1,
                 has_return: false,
+                reg_args: false,
             },
         );
         map.insert(
@@ -279,6 +315,7 @@ impl SdkRegistry {
                 category: Vdp,
                 param_count: 0,
                 has_return: true,
+                reg_args: false,
             },
         );
         map.insert(
@@ -289,6 +326,7 @@ impl SdkRegistry {
                 category: Vdp,
                 param_count: 0,
                 has_return: false,
+                reg_args: false,
             },
         );
 
@@ -301,6 +339,7 @@ impl SdkRegistry {
                 category: Vdp,
                 param_count: 3,
                 has_return: false,
+                reg_args: false,
             },
         );
         map.insert(
@@ -311,6 +350,7 @@ impl SdkRegistry {
                 category: Vdp,
                 param_count: 3,
                 has_return: false,
+                reg_args: false,
             },
         );
         map.insert(
@@ -321,6 +361,63 @@ impl SdkRegistry {
                 category: Vdp,
                 param_count: 3,
                 has_return: false,
+                reg_args: false,
+            },
+        );
+        // DMA queue functions
+        map.insert(
+            "dma_queue_transfer",
+            SdkFunction {
+                name: "dma_queue_transfer",
+                kind: Library,
+                category: Vdp,
+                param_count: 3,
+                has_return: true,
+                reg_args: true,
+            },
+        );
+        map.insert(
+            "dma_queue_fill",
+            SdkFunction {
+                name: "dma_queue_fill",
+                kind: Library,
+                category: Vdp,
+                param_count: 3,
+                has_return: true,
+                reg_args: true,
+            },
+        );
+        map.insert(
+            "dma_queue_copy",
+            SdkFunction {
+                name: "dma_queue_copy",
+                kind: Library,
+                category: Vdp,
+                param_count: 3,
+                has_return: true,
+                reg_args: true,
+            },
+        );
+        map.insert(
+            "dma_queue_flush",
+            SdkFunction {
+                name: "dma_queue_flush",
+                kind: Library,
+                category: Vdp,
+                param_count: 0,
+                has_return: false,
+                reg_args: false,
+            },
+        );
+        map.insert(
+            "dma_queue_clear",
+            SdkFunction {
+                name: "dma_queue_clear",
+                kind: Library,
+                category: Vdp,
+                param_count: 0,
+                has_return: false,
+                reg_args: false,
             },
         );
         // Window plane functions
@@ -332,6 +429,7 @@ impl SdkRegistry {
                 category: Vdp,
                 param_count: 1,
                 has_return: false,
+                reg_args: false,
             },
         );
         map.insert(
@@ -342,6 +440,7 @@ impl SdkRegistry {
                 category: Vdp,
                 param_count: 1,
                 has_return: false,
+                reg_args: false,
             },
         );
         map.insert(
@@ -352,6 +451,7 @@ impl SdkRegistry {
                 category: Vdp,
                 param_count: 3,
                 has_return: false,
+                reg_args: false,
             },
         );
     }
@@ -369,6 +469,7 @@ impl SdkRegistry {
                 category: Sprite,
                 param_count: 5,
                 has_return: true,
+                reg_args: false,
             },
         );
         map.insert(
@@ -379,6 +480,7 @@ impl SdkRegistry {
                 category: Sprite,
                 param_count: 1,
                 has_return: true,
+                reg_args: false,
             },
         );
         map.insert(
@@ -389,6 +491,7 @@ impl SdkRegistry {
                 category: Sprite,
                 param_count: 1,
                 has_return: true,
+                reg_args: false,
             },
         );
 
@@ -401,6 +504,7 @@ impl SdkRegistry {
                 category: Sprite,
                 param_count: 0,
                 has_return: false,
+                reg_args: false,
             },
         );
         map.insert(
@@ -411,6 +515,7 @@ impl SdkRegistry {
                 category: Sprite,
                 param_count: 5,
                 has_return: false,
+                reg_args: true,
             },
         );
         map.insert(
@@ -421,6 +526,7 @@ impl SdkRegistry {
                 category: Sprite,
                 param_count: 3,
                 has_return: false,
+                reg_args: true,
             },
         );
         map.insert(
@@ -431,6 +537,7 @@ impl SdkRegistry {
                 category: Sprite,
                 param_count: 1,
                 has_return: false,
+                reg_args: true,
             },
         );
         map.insert(
@@ -441,6 +548,7 @@ impl SdkRegistry {
                 category: Sprite,
                 param_count: 1,
                 has_return: false,
+                reg_args: true,
             },
         );
         map.insert(
@@ -451,6 +559,7 @@ impl SdkRegistry {
                 category: Sprite,
                 param_count: 0,
                 has_return: false,
+                reg_args: false,
             },
         );
         map.insert(
@@ -461,6 +570,18 @@ impl SdkRegistry {
                 category: Sprite,
                 param_count: 2,
                 has_return: false,
+                reg_args: true,
+            },
+        );
+        map.insert(
+            "sprite_flush",
+            SdkFunction {
+                name: "sprite_flush",
+                kind: Library,
+                category: Sprite,
+                param_count: 0,
+                has_return: false,
+                reg_args: false,
             },
         );
         map.insert(
@@ -471,6 +592,7 @@ impl SdkRegistry {
                 category: Sprite,
                 param_count: 8,
                 has_return: true,
+                reg_args: false,
             },
         );
     }
@@ -488,6 +610,7 @@ impl SdkRegistry {
                 category: Input,
                 param_count: 0,
                 has_return: true,
+                reg_args: false,
             },
         );
         map.insert(
@@ -498,6 +621,7 @@ impl SdkRegistry {
                 category: Input,
                 param_count: 0,
                 has_return: true,
+                reg_args: false,
             },
         );
 
@@ -510,6 +634,7 @@ impl SdkRegistry {
                 category: Input,
                 param_count: 0,
                 has_return: false,
+                reg_args: false,
             },
         );
         map.insert(
@@ -520,6 +645,7 @@ impl SdkRegistry {
                 category: Input,
                 param_count: 1,
                 has_return: true,
+                reg_args: false,
             },
         );
         map.insert(
@@ -530,6 +656,7 @@ impl SdkRegistry {
                 category: Input,
                 param_count: 0,
                 has_return: false,
+                reg_args: false,
             },
         );
         map.insert(
@@ -540,6 +667,7 @@ impl SdkRegistry {
                 category: Input,
                 param_count: 1,
                 has_return: true,
+                reg_args: false,
             },
         );
         map.insert(
@@ -550,6 +678,7 @@ impl SdkRegistry {
                 category: Input,
                 param_count: 1,
                 has_return: true,
+                reg_args: false,
             },
         );
         map.insert(
@@ -560,6 +689,7 @@ impl SdkRegistry {
                 category: Input,
                 param_count: 1,
                 has_return: true,
+                reg_args: false,
             },
         );
         map.insert(
@@ -570,6 +700,7 @@ impl SdkRegistry {
                 category: Input,
                 param_count: 1,
                 has_return: true,
+                reg_args: false,
             },
         );
     }
@@ -587,6 +718,7 @@ impl SdkRegistry {
                 category: Ym2612,
                 param_count: 0,
                 has_return: true,
+                reg_args: false,
             },
         );
         map.insert(
@@ -597,6 +729,7 @@ impl SdkRegistry {
                 category: Ym2612,
                 param_count: 2,
                 has_return: false,
+                reg_args: false,
             },
         );
         map.insert(
@@ -607,6 +740,7 @@ impl SdkRegistry {
                 category: Ym2612,
                 param_count: 2,
                 has_return: false,
+                reg_args: false,
             },
         );
         map.insert(
@@ -617,6 +751,7 @@ impl SdkRegistry {
                 category: Ym2612,
                 param_count: 0,
                 has_return: false,
+                reg_args: false,
             },
         );
         map.insert(
@@ -627,6 +762,7 @@ impl SdkRegistry {
                 category: Ym2612,
                 param_count: 0,
                 has_return: false,
+                reg_args: false,
             },
         );
         map.insert(
@@ -637,6 +773,7 @@ impl SdkRegistry {
                 category: Ym2612,
                 param_count: 1,
                 has_return: false,
+                reg_args: false,
             },
         );
 
@@ -649,6 +786,7 @@ impl SdkRegistry {
                 category: Ym2612,
                 param_count: 0,
                 has_return: false,
+                reg_args: false,
             },
         );
         map.insert(
@@ -659,6 +797,7 @@ impl SdkRegistry {
                 category: Ym2612,
                 param_count: 0,
                 has_return: false,
+                reg_args: false,
             },
         );
         map.insert(
@@ -669,6 +808,7 @@ impl SdkRegistry {
                 category: Ym2612,
                 param_count: 0,
                 has_return: false,
+                reg_args: false,
             },
         );
         map.insert(
@@ -679,6 +819,7 @@ impl SdkRegistry {
                 category: Ym2612,
                 param_count: 3,
                 has_return: false,
+                reg_args: false,
             },
         );
         map.insert(
@@ -689,6 +830,7 @@ impl SdkRegistry {
                 category: Ym2612,
                 param_count: 4,
                 has_return: false,
+                reg_args: false,
             },
         );
         map.insert(
@@ -699,6 +841,7 @@ impl SdkRegistry {
                 category: Ym2612,
                 param_count: 1,
                 has_return: false,
+                reg_args: false,
             },
         );
         map.insert(
@@ -709,6 +852,7 @@ impl SdkRegistry {
                 category: Ym2612,
                 param_count: 1,
                 has_return: false,
+                reg_args: false,
             },
         );
         map.insert(
@@ -719,6 +863,7 @@ impl SdkRegistry {
                 category: Ym2612,
                 param_count: 2,
                 has_return: false,
+                reg_args: false,
             },
         );
         map.insert(
@@ -729,6 +874,7 @@ impl SdkRegistry {
                 category: Ym2612,
                 param_count: 3,
                 has_return: false,
+                reg_args: false,
             },
         );
         map.insert(
@@ -739,6 +885,7 @@ impl SdkRegistry {
                 category: Ym2612,
                 param_count: 4,
                 has_return: false,
+                reg_args: false,
             },
         );
         map.insert(
@@ -749,6 +896,7 @@ impl SdkRegistry {
                 category: Ym2612,
                 param_count: 3,
                 has_return: false,
+                reg_args: false,
             },
         );
         map.insert(
@@ -759,6 +907,7 @@ impl SdkRegistry {
                 category: Ym2612,
                 param_count: 2,
                 has_return: false,
+                reg_args: false,
             },
         );
         map.insert(
@@ -769,6 +918,7 @@ impl SdkRegistry {
                 category: Ym2612,
                 param_count: 2,
                 has_return: false,
+                reg_args: false,
             },
         );
         map.insert(
@@ -779,6 +929,7 @@ impl SdkRegistry {
                 category: Ym2612,
                 param_count: 1,
                 has_return: false,
+                reg_args: false,
             },
         );
         map.insert(
@@ -789,6 +940,7 @@ impl SdkRegistry {
                 category: Ym2612,
                 param_count: 3,
                 has_return: false,
+                reg_args: false,
             },
         );
         map.insert(
@@ -799,6 +951,7 @@ impl SdkRegistry {
                 category: Ym2612,
                 param_count: 2,
                 has_return: false,
+                reg_args: false,
             },
         );
         map.insert(
@@ -809,6 +962,7 @@ impl SdkRegistry {
                 category: Ym2612,
                 param_count: 3,
                 has_return: false,
+                reg_args: false,
             },
         );
         map.insert(
@@ -819,6 +973,7 @@ impl SdkRegistry {
                 category: Ym2612,
                 param_count: 3,
                 has_return: false,
+                reg_args: false,
             },
         );
         map.insert(
@@ -829,6 +984,7 @@ impl SdkRegistry {
                 category: Ym2612,
                 param_count: 1,
                 has_return: false,
+                reg_args: false,
             },
         );
         map.insert(
@@ -839,6 +995,7 @@ impl SdkRegistry {
                 category: Ym2612,
                 param_count: 1,
                 has_return: false,
+                reg_args: false,
             },
         );
         map.insert(
@@ -849,6 +1006,7 @@ impl SdkRegistry {
                 category: Ym2612,
                 param_count: 1,
                 has_return: false,
+                reg_args: false,
             },
         );
         map.insert(
@@ -859,6 +1017,7 @@ impl SdkRegistry {
                 category: Ym2612,
                 param_count: 0,
                 has_return: false,
+                reg_args: false,
             },
         );
         map.insert(
@@ -869,6 +1028,7 @@ impl SdkRegistry {
                 category: Ym2612,
                 param_count: 0,
                 has_return: true,
+                reg_args: false,
             },
         );
         map.insert(
@@ -879,6 +1039,7 @@ impl SdkRegistry {
                 category: Ym2612,
                 param_count: 0,
                 has_return: true,
+                reg_args: false,
             },
         );
 
@@ -908,6 +1069,7 @@ impl SdkRegistry {
                     category: Ym2612,
                     param_count: 1,
                     has_return: false,
+                    reg_args: false,
                 },
             );
         }
@@ -921,6 +1083,7 @@ impl SdkRegistry {
                 category: Ym2612,
                 param_count: 5,
                 has_return: false,
+                reg_args: false,
             },
         );
         map.insert(
@@ -931,6 +1094,7 @@ impl SdkRegistry {
                 category: Ym2612,
                 param_count: 2,
                 has_return: false,
+                reg_args: false,
             },
         );
         map.insert(
@@ -941,6 +1105,7 @@ impl SdkRegistry {
                 category: Ym2612,
                 param_count: 4,
                 has_return: true,
+                reg_args: false,
             },
         );
     }
@@ -958,6 +1123,7 @@ impl SdkRegistry {
                 category: Psg,
                 param_count: 1,
                 has_return: false,
+                reg_args: false,
             },
         );
         map.insert(
@@ -968,6 +1134,7 @@ impl SdkRegistry {
                 category: Psg,
                 param_count: 2,
                 has_return: false,
+                reg_args: false,
             },
         );
         map.insert(
@@ -978,6 +1145,7 @@ impl SdkRegistry {
                 category: Psg,
                 param_count: 1,
                 has_return: false,
+                reg_args: false,
             },
         );
         map.insert(
@@ -988,6 +1156,7 @@ impl SdkRegistry {
                 category: Psg,
                 param_count: 1,
                 has_return: false,
+                reg_args: false,
             },
         );
         map.insert(
@@ -998,6 +1167,7 @@ impl SdkRegistry {
                 category: Psg,
                 param_count: 1,
                 has_return: false,
+                reg_args: false,
             },
         );
 
@@ -1010,6 +1180,7 @@ impl SdkRegistry {
                 category: Psg,
                 param_count: 0,
                 has_return: false,
+                reg_args: false,
             },
         );
         map.insert(
@@ -1020,6 +1191,7 @@ impl SdkRegistry {
                 category: Psg,
                 param_count: 2,
                 has_return: false,
+                reg_args: false,
             },
         );
         map.insert(
@@ -1030,6 +1202,7 @@ impl SdkRegistry {
                 category: Psg,
                 param_count: 2,
                 has_return: false,
+                reg_args: false,
             },
         );
         map.insert(
@@ -1040,6 +1213,7 @@ impl SdkRegistry {
                 category: Psg,
                 param_count: 0,
                 has_return: false,
+                reg_args: false,
             },
         );
         map.insert(
@@ -1050,6 +1224,7 @@ impl SdkRegistry {
                 category: Psg,
                 param_count: 3,
                 has_return: false,
+                reg_args: false,
             },
         );
         map.insert(
@@ -1060,6 +1235,7 @@ impl SdkRegistry {
                 category: Psg,
                 param_count: 3,
                 has_return: false,
+                reg_args: false,
             },
         );
         map.insert(
@@ -1070,6 +1246,7 @@ impl SdkRegistry {
                 category: Psg,
                 param_count: 1,
                 has_return: false,
+                reg_args: false,
             },
         );
         map.insert(
@@ -1080,6 +1257,7 @@ impl SdkRegistry {
                 category: Psg,
                 param_count: 1,
                 has_return: false,
+                reg_args: false,
             },
         );
         map.insert(
@@ -1090,6 +1268,7 @@ impl SdkRegistry {
                 category: Psg,
                 param_count: 1,
                 has_return: false,
+                reg_args: false,
             },
         );
         map.insert(
@@ -1100,6 +1279,7 @@ impl SdkRegistry {
                 category: Psg,
                 param_count: 1,
                 has_return: false,
+                reg_args: false,
             },
         );
         map.insert(
@@ -1110,6 +1290,7 @@ impl SdkRegistry {
                 category: Psg,
                 param_count: 2,
                 has_return: false,
+                reg_args: false,
             },
         );
         map.insert(
@@ -1120,6 +1301,7 @@ impl SdkRegistry {
                 category: Psg,
                 param_count: 3,
                 has_return: false,
+                reg_args: false,
             },
         );
         map.insert(
@@ -1130,6 +1312,7 @@ impl SdkRegistry {
                 category: Psg,
                 param_count: 2,
                 has_return: false,
+                reg_args: false,
             },
         );
         map.insert(
@@ -1140,9 +1323,71 @@ impl SdkRegistry {
                 category: Psg,
                 param_count: 1,
                 has_return: true,
+                reg_args: false,
+            },
+        );
+    }
+    fn register_sound_functions(map: &mut HashMap<&'static str, SdkFunction>) {
+        use SdkCategory::Sound;
+        use SdkFunctionKind::Library;
+
+        map.insert(
+            "snd_init",
+            SdkFunction {
+                name: "snd_init",
+                kind: Library,
+                category: Sound,
+                param_count: 0,
+                has_return: false,
+                reg_args: false,
+            },
+        );
+        map.insert(
+            "snd_play_sample",
+            SdkFunction {
+                name: "snd_play_sample",
+                kind: Library,
+                category: Sound,
+                param_count: 3,
+                has_return: false,
+                reg_args: true,
+            },
+        );
+        map.insert(
+            "snd_stop_sample",
+            SdkFunction {
+                name: "snd_stop_sample",
+                kind: Library,
+                category: Sound,
+                param_count: 1,
+                has_return: false,
+                reg_args: true,
+            },
+        );
+        map.insert(
+            "snd_play_song",
+            SdkFunction {
+                name: "snd_play_song",
+                kind: Library,
+                category: Sound,
+                param_count: 1,
+                has_return: false,
+                reg_args: true,
+            },
+        );
+        map.insert(
+            "snd_stop_song",
+            SdkFunction {
+                name: "snd_stop_song",
+                kind: Library,
+                category: Sound,
+                param_count: 0,
+                has_return: false,
+                reg_args: false,
             },
         );
     }
+
     fn register_util_functions(map: &mut HashMap<&'static str, SdkFunction>) {
         use SdkCategory::Util;
         use SdkFunctionKind::{Inline, Library};
@@ -1155,6 +1400,7 @@ impl SdkRegistry {
                 category: Util,
                 param_count: 1,
                 has_return: true,
+                reg_args: false,
             },
         );
         map.insert(
@@ -1165,6 +1411,18 @@ impl SdkRegistry {
                 category: Util,
                 param_count: 3,
                 has_return: false,
+                reg_args: true,
+            },
+        );
+        map.insert(
+            "mem_copy_w",
+            SdkFunction {
+                name: "mem_copy_w",
+                kind: Library,
+                category: Util,
+                param_count: 3,
+                has_return: false,
+                reg_args: true,
             },
         );
         map.insert(
@@ -1175,6 +1433,18 @@ impl SdkRegistry {
                 category: Util,
                 param_count: 3,
                 has_return: false,
+                reg_args: true,
+            },
+        );
+        map.insert(
+            "mem_set_l",
+            SdkFunction {
+                name: "mem_set_l",
+                kind: Library,
+                category: Util,
+                param_count: 3,
+                has_return: false,
+                reg_args: true,
             },
         );
         map.insert(
@@ -1185,6 +1455,7 @@ impl SdkRegistry {
                 category: Util,
                 param_count: 0,
                 has_return: true,
+                reg_args: false,
             },
         );
         map.insert(
@@ -1195,6 +1466,42 @@ impl SdkRegistry {
                 category: Util,
                 param_count: 1,
                 has_return: false,
+                reg_args: false,
+            },
+        );
+
+        // Fixed-point math, looked up in ROM tables
+        map.insert(
+            "sin_fix",
+            SdkFunction {
+                name: "sin_fix",
+                kind: Inline,
+                category: Util,
+                param_count: 1,
+                has_return: true,
+                reg_args: false,
+            },
+        );
+        map.insert(
+            "cos_fix",
+            SdkFunction {
+                name: "cos_fix",
+                kind: Inline,
+                category: Util,
+                param_count: 1,
+                has_return: true,
+                reg_args: false,
+            },
+        );
+        map.insert(
+            "sqrt_fix",
+            SdkFunction {
+                name: "sqrt_fix",
+                kind: Library,
+                category: Util,
+                param_count: 1,
+                has_return: true,
+                reg_args: true,
             },
         );
     }
@@ -1211,6 +1518,7 @@ impl SdkRegistry {
                 category: Sram,
                 param_count: 0,
                 has_return: false,
+                reg_args: false,
             },
         );
         map.insert(
@@ -1221,6 +1529,7 @@ impl SdkRegistry {
                 category: Sram,
                 param_count: 0,
                 has_return: false,
+                reg_args: false,
             },
         );
         map.insert(
@@ -1231,6 +1540,7 @@ impl SdkRegistry {
                 category: Sram,
                 param_count: 1,
                 has_return: true,
+                reg_args: false,
             },
         );
         map.insert(
@@ -1241,6 +1551,7 @@ impl SdkRegistry {
                 category: Sram,
                 param_count: 2,
                 has_return: false,
+                reg_args: false,
             },
         );
         map.insert(
@@ -1251,6 +1562,7 @@ impl SdkRegistry {
                 category: Sram,
                 param_count: 3,
                 has_return: false,
+                reg_args: false,
             },
         );
         map.insert(
@@ -1261,6 +1573,7 @@ impl SdkRegistry {
                 category: Sram,
                 param_count: 3,
                 has_return: false,
+                reg_args: false,
             },
         );
     }
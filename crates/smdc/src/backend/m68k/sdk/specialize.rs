@@ -0,0 +1,107 @@
+//! Call-site specialization of SDK functions with constant arguments
+//!
+//! Most VDP calls spend their time turning a tile position or palette index
+//! into a control port command. When those arguments are constants the
+//! command is known at compile time, and the call shrinks to a single
+//! `move.l #command` to the control port (which writes both command words,
+//! high word first) followed by the data write.
+//!
+//! The fixed-point math builtins need no code at all for a constant
+//! argument: the result is computed here and loaded into D0.
+
+use super::{VDP_CTRL, VDP_DATA};
+use crate::backend::m68k::m68k::*;
+use crate::common::fixed;
+
+/// Plane A name table base in VRAM
+const PLANE_A: i64 = 0xC000;
+/// Plane B name table base in VRAM
+const PLANE_B: i64 = 0xE000;
+/// Window name table base in VRAM
+const PLANE_W: i64 = 0xD000;
+/// Bytes per name table row (64 cells of 2 bytes)
+const PLANE_PITCH: i64 = 128;
+
+/// VDP access code of a VRAM write, in the first command word
+const VRAM_WRITE: u32 = 0x4000;
+/// VDP access code of a CRAM write, in the first command word
+const CRAM_WRITE: u32 = 0xC000;
+
+/// Generates specialized code for SDK calls with constant arguments
+pub struct SdkSpecializer;
+
+impl SdkSpecializer {
+    /// Code for a call to `func_name` whose known argument values are
+    /// `consts` (`None` for an argument only known at run time). Runtime
+    /// arguments are expected in D0, D1, D2, D3 by position, as for inline
+    /// functions. Returns `None` when the constants don't make the call any
+    /// cheaper.
+    pub fn generate(func_name: &str, consts: &[Option<i64>]) -> Option<Vec<M68kInst>> {
+        let arg = |i: usize| consts.get(i).copied().flatten();
+        match func_name {
+            "vdp_set_tile_a" => Some(Self::gen_set_tile(PLANE_A, arg(0)?, arg(1)?, arg(2))),
+            "vdp_set_tile_b" => Some(Self::gen_set_tile(PLANE_B, arg(0)?, arg(1)?, arg(2))),
+            "vdp_set_tile_w" => Some(Self::gen_set_tile(PLANE_W, arg(0)?, arg(1)?, arg(2))),
+            "vdp_set_write_addr" => Some(vec![command(VRAM_WRITE, arg(0)?)]),
+            "vdp_set_cram_addr" => Some(vec![command(CRAM_WRITE, arg(0)? * 2)]),
+            "vdp_set_color" => {
+                let mut code = vec![command(CRAM_WRITE, arg(0)? * 2)];
+                code.push(write_data(arg(1), DataReg::D1));
+                Some(code)
+            }
+            "vdp_set_reg" => {
+                let word = 0x8000 | (arg(0)? << 8) | arg(1)?;
+                Some(vec![M68kInst::Move(
+                    Size::Word,
+                    Operand::Imm(Size::Word.truncate(word)),
+                    Operand::AbsLong(VDP_CTRL),
+                )])
+            }
+            "sin_fix" | "cos_fix" | "sqrt_fix" => {
+                let value = fixed::eval_builtin(func_name, &[arg(0)?])?;
+                Some(vec![load_result(value)])
+            }
+            _ => None,
+        }
+    }
+
+    /// `vdp_set_tile_*(x, y, tile)` with a constant position
+    fn gen_set_tile(plane: i64, x: i64, y: i64, tile: Option<i64>) -> Vec<M68kInst> {
+        let addr = plane + y * PLANE_PITCH + x * 2;
+        vec![command(VRAM_WRITE, addr), write_data(tile, DataReg::D2)]
+    }
+}
+
+/// Write the two-word VDP command for an access to `addr` with `code`
+fn command(code: u32, addr: i64) -> M68kInst {
+    let addr = addr as u32;
+    let first = code | (addr & 0x3FFF);
+    let second = (addr >> 14) & 0x03;
+    M68kInst::Move(
+        Size::Long,
+        Operand::Imm(((first << 16) | second) as i32),
+        Operand::AbsLong(VDP_CTRL),
+    )
+}
+
+/// Load a constant result into D0
+fn load_result(value: i64) -> M68kInst {
+    match i8::try_from(value) {
+        Ok(n) => M68kInst::Moveq(n, DataReg::D0),
+        Err(_) => M68kInst::Move(
+            Size::Long,
+            Operand::Imm(value as i32),
+            Operand::DataReg(DataReg::D0),
+        ),
+    }
+}
+
+/// Write the low word of a constant `value`, or else of `reg`, to the VDP
+/// data port
+fn write_data(value: Option<i64>, reg: DataReg) -> M68kInst {
+    let src = match value {
+        Some(n) => Operand::Imm(Size::Word.truncate(n)),
+        None => Operand::DataReg(reg),
+    };
+    M68kInst::Move(Size::Word, src, Operand::AbsLong(VDP_DATA))
+}
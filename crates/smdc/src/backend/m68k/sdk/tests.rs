@@ -26,6 +26,7 @@ fn registry_contains_all_vdp_functions() {
         "vdp_wait_frame",
         "vdp_load_palette",
         "vdp_load_tiles",
+        "vdp_load_tiles_packed",
         "vdp_set_tile_a",
         "vdp_set_tile_b",
         "vdp_clear_plane_a",
@@ -113,6 +114,26 @@ fn registry_contains_all_psg_functions() {
     }
 }
 
+#[test]
+fn registry_contains_all_sound_functions() {
+    let reg = SdkRegistry::new();
+    let snd_names = [
+        "snd_init",
+        "snd_play_sample",
+        "snd_stop_sample",
+        "snd_play_song",
+        "snd_stop_song",
+    ];
+    for name in &snd_names {
+        assert!(
+            reg.is_sdk_function(name),
+            "sound function '{name}' not found in registry"
+        );
+        let f = reg.lookup(name).unwrap();
+        assert_eq!(f.category, SdkCategory::Sound);
+    }
+}
+
 #[test]
 fn registry_contains_all_sprite_functions() {
     let reg = SdkRegistry::new();
@@ -227,6 +248,17 @@ fn registry_param_counts() {
     assert_eq!(reg.lookup("psg_write").unwrap().param_count, 1);
 }
 
+#[test]
+fn registry_register_args() {
+    let reg = SdkRegistry::new();
+
+    assert!(reg.lookup("sprite_set").unwrap().reg_args);
+    assert!(reg.lookup("mem_copy").unwrap().reg_args);
+    assert!(!reg.lookup("psg_set_tone").unwrap().reg_args);
+    // Inline functions have no calling convention
+    assert!(!reg.lookup("vdp_set_reg").unwrap().reg_args);
+}
+
 #[test]
 fn registry_return_values() {
     let reg = SdkRegistry::new();
@@ -470,6 +502,75 @@ fn library_generate_vdp_vsync_tail_calls_vblank_start() {
     ));
 }
 
+#[test]
+fn library_generate_vblank_handler_returns_from_exception() {
+    let mut libgen = SdkLibraryGenerator::new();
+    let functions = HashSet::from(["vdp_init".to_string(), "dma_queue_fill".to_string()]);
+    let insts = libgen.generate_vblank_handler(&functions, true);
+    assert!(matches!(&insts[0], M68kInst::Label(name) if name == VBLANK_HANDLER));
+    assert!(insts.contains(&M68kInst::Jsr(Operand::Label(VBLANK_CALLBACK.into()))));
+    assert!(matches!(insts.last(), Some(M68kInst::Rte)));
+
+    let insts = libgen.generate_vblank_handler(&HashSet::new(), true);
+    assert!(!insts.iter().any(|i| matches!(i, M68kInst::Addq(..))));
+}
+
+#[test]
+fn library_vblank_handler_leaves_the_vdp_to_the_main_thread() {
+    // Main-thread routines write a VDP command and then its data with
+    // interrupts on, so an interrupt writing commands of its own in between
+    // would send the data astray. The flushes run from vdp_wait_vblank_start.
+    let functions = resolve_dependencies(&HashSet::from([
+        "vdp_vsync".to_string(),
+        "sprite_set".to_string(),
+        "dma_queue_transfer".to_string(),
+    ]));
+    let mut libgen = SdkLibraryGenerator::new();
+    let handler = libgen.generate_vblank_handler(&functions, true);
+    let calls: Vec<_> = handler
+        .iter()
+        .filter_map(|i| match i {
+            M68kInst::Jsr(Operand::Label(name)) => Some(name.as_str()),
+            _ => None,
+        })
+        .collect();
+    assert_eq!(calls, [VBLANK_CALLBACK]);
+    assert!(!handler.iter().any(|i| matches!(
+        i,
+        M68kInst::Move(_, _, Operand::AbsLong(VDP_CTRL | VDP_DATA))
+    )));
+
+    let wait = libgen.generate("vdp_wait_vblank_start");
+    assert!(matches!(wait.last(), Some(M68kInst::Bra(target)) if target == VBLANK_WORK));
+    let work = libgen.generate_vblank_work(&functions);
+    let calls: Vec<_> = work
+        .iter()
+        .filter_map(|i| match i {
+            M68kInst::Jsr(Operand::Label(name)) => Some(name.as_str()),
+            _ => None,
+        })
+        .collect();
+    assert_eq!(calls, ["sprite_flush", "dma_queue_flush"]);
+
+    let work = libgen.generate_vblank_work(&HashSet::from(["vdp_vsync".to_string()]));
+    assert_eq!(work, [M68kInst::Label(VBLANK_WORK.into()), M68kInst::Rts]);
+}
+
+#[test]
+fn library_generate_sprite_set_writes_shadow_table() {
+    let mut libgen = SdkLibraryGenerator::new();
+    let insts = libgen.generate("sprite_set");
+    assert!(insts.contains(&M68kInst::Lea(
+        Operand::Label("__sdk_sprite_table".into()),
+        AddrReg::A1
+    )));
+    // No VDP port traffic until the flush
+    assert!(!insts.iter().any(|i| matches!(
+        i,
+        M68kInst::Move(_, _, Operand::AbsLong(VDP_CTRL | VDP_DATA))
+    )));
+}
+
 #[test]
 fn library_generate_psg_stop_silences_all_channels() {
     let mut libgen = SdkLibraryGenerator::new();
@@ -487,6 +588,30 @@ fn library_generate_psg_stop_silences_all_channels() {
     assert_eq!(psg_writes.len(), 4);
 }
 
+#[test]
+fn library_generate_snd_play_sample_posts_command_last() {
+    let mut libgen = SdkLibraryGenerator::new();
+    let insts = libgen.generate("snd_play_sample");
+    let cmd = insts
+        .iter()
+        .position(|i| {
+            matches!(
+                i,
+                M68kInst::Move(
+                    Size::Byte,
+                    Operand::Imm(0x20),
+                    Operand::AddrInd(AddrReg::A1)
+                )
+            )
+        })
+        .expect("command byte written to the mailbox");
+    // The Z80 gets its bus back only after the command is in place
+    assert_eq!(
+        insts[cmd + 1],
+        M68kInst::Clr(Size::Word, Operand::AbsLong(Z80_BUS_REQ))
+    );
+}
+
 #[test]
 fn library_generate_unknown_produces_stub() {
     let mut libgen = SdkLibraryGenerator::new();
@@ -509,14 +634,14 @@ fn library_generate_unique_labels() {
     let labels1: Vec<_> = insts1
         .iter()
         .filter_map(|i| match i {
-            M68kInst::Label(l) if l.starts_with(".sdk_") => Some(l.clone()),
+            M68kInst::Label(l) if l.starts_with(".sdk_") => Some(*l),
             _ => None,
         })
         .collect();
     let labels2: Vec<_> = insts2
         .iter()
         .filter_map(|i| match i {
-            M68kInst::Label(l) if l.starts_with(".sdk_") => Some(l.clone()),
+            M68kInst::Label(l) if l.starts_with(".sdk_") => Some(*l),
             _ => None,
         })
         .collect();
@@ -542,6 +667,7 @@ fn library_all_registered_library_functions_generate() {
         "vdp_wait_frame",
         "vdp_load_palette",
         "vdp_load_tiles",
+        "vdp_load_tiles_packed",
         "vdp_set_tile_a",
         "vdp_set_tile_b",
         "vdp_clear_plane_a",
@@ -586,7 +712,9 @@ fn library_all_registered_library_functions_generate() {
         "input_released",
         "input_is_6button",
         "mem_copy",
+        "mem_copy_w",
         "mem_set",
+        "mem_set_l",
         "rand_next",
         "rand_seed",
         "vdp_dma_transfer",
@@ -694,10 +822,71 @@ fn deps_resolve_psg_chain() {
     assert!(resolved.contains("psg_set_tone"));
 }
 
+#[test]
+fn deps_resolve_dma_queue_chain() {
+    // dma_queue_fill -> dma_queue_transfer -> dma_queue_flush -> vdp_dma_*
+    let mut funcs = HashSet::new();
+    funcs.insert("dma_queue_fill".to_string());
+    let resolved = resolve_dependencies(&funcs);
+    assert!(resolved.contains("dma_queue_transfer"));
+    assert!(resolved.contains("dma_queue_flush"));
+    assert!(resolved.contains("vdp_dma_transfer"));
+    assert!(resolved.contains("vdp_dma_fill"));
+    assert!(resolved.contains("vdp_dma_copy"));
+}
+
+#[test]
+fn deps_resolve_sound_needs_init() {
+    let mut funcs = HashSet::new();
+    funcs.insert("snd_play_sample".to_string());
+    let resolved = resolve_dependencies(&funcs);
+    assert!(resolved.contains("snd_init"));
+}
+
 // ============================================================================
 // Static Data Tests
 // ============================================================================
 
+#[test]
+fn static_data_sprite_table() {
+    let mut funcs = HashSet::new();
+    funcs.insert("sprite_set_pos".to_string());
+    let resolved = resolve_dependencies(&funcs);
+    assert!(deps::needs_sprite_table(&resolved));
+    assert!(deps::needs_dma_queue(&resolved));
+    let data = generate_static_data(&resolved);
+    assert!(data.contains(&M68kInst::Label("__sdk_sprite_table".into())));
+}
+
+#[test]
+fn static_data_dma_queue_ring() {
+    let mut funcs = HashSet::new();
+    funcs.insert("dma_queue_clear".to_string());
+    assert!(deps::needs_dma_queue(&funcs));
+    let data = generate_static_data(&funcs);
+    assert!(data.contains(&M68kInst::Label("__sdk_dma_head".into())));
+    assert!(data.contains(&M68kInst::Directive(Directive::Space(512))));
+}
+
+#[test]
+fn static_data_z80_driver() {
+    let mut funcs = HashSet::new();
+    funcs.insert("snd_init".to_string());
+    let data = generate_static_data(&funcs);
+    let at = data
+        .iter()
+        .position(|i| matches!(i, M68kInst::Label(l) if l == "__sdk_z80_driver"))
+        .expect("driver label");
+    let bytes: Vec<u8> = data[at + 1..]
+        .iter()
+        .map_while(|i| match i {
+            M68kInst::Directive(Directive::Byte(b)) => Some(*b),
+            _ => None,
+        })
+        .collect();
+    assert_eq!(bytes, *z80::driver::DRIVER);
+}
+
 #[test]
 fn static_data_frame_counter_needed() {
     let mut funcs = HashSet::new();
@@ -785,6 +974,9 @@ fn hardware_addresses_correct() {
     assert_eq!(YM_DATA0, 0xA04001);
     assert_eq!(YM_ADDR1, 0xA04002);
     assert_eq!(YM_DATA1, 0xA04003);
+    assert_eq!(Z80_RAM, 0xA00000);
+    assert_eq!(Z80_BUS_REQ, 0xA11100);
+    assert_eq!(Z80_RESET, 0xA11200);
 }
 
 // ============================================================================
@@ -794,7 +986,15 @@ fn hardware_addresses_correct() {
 #[test]
 fn registry_contains_all_util_functions() {
     let reg = SdkRegistry::new();
-    let util_names = ["mem_copy", "mem_set", "abs_val", "rand_next", "rand_seed"];
+    let util_names = [
+        "mem_copy",
+        "mem_copy_w",
+        "mem_set",
+        "mem_set_l",
+        "abs_val",
+        "rand_next",
+        "rand_seed",
+    ];
     for name in &util_names {
         assert!(
             reg.is_sdk_function(name),
@@ -860,10 +1060,62 @@ fn library_generate_mem_copy_has_loop() {
     let mut libgen = SdkLibraryGenerator::new();
     let insts = libgen.generate("mem_copy");
     assert!(matches!(&insts[0], M68kInst::Label(name) if name == "mem_copy"));
+    assert!(matches!(insts.last(), Some(M68kInst::Rts)));
+
+    let insts = libgen.generate("mem_copy_w");
+    assert!(matches!(&insts[0], M68kInst::Label(name) if name == "mem_copy_w"));
     assert!(insts.iter().any(|i| matches!(i, M68kInst::Dbf(..))));
     assert!(matches!(insts.last(), Some(M68kInst::Rts)));
 }
 
+#[test]
+fn library_generate_mem_bulk_loops_are_unrolled_and_32_bit() {
+    let mut libgen = SdkLibraryGenerator::new();
+    for (name, step) in [
+        (
+            "mem_copy_w",
+            M68kInst::Move(
+                Size::Long,
+                Operand::PostInc(AddrReg::A0),
+                Operand::PostInc(AddrReg::A1),
+            ),
+        ),
+        (
+            "mem_set_l",
+            M68kInst::Move(
+                Size::Long,
+                Operand::DataReg(DataReg::D1),
+                Operand::PostInc(AddrReg::A1),
+            ),
+        ),
+    ] {
+        let insts = libgen.generate(name);
+        let longest_run = insts
+            .split(|i| *i != step)
+            .map(<[M68kInst]>::len)
+            .max()
+            .unwrap();
+        assert_eq!(longest_run, 8, "{name} should move 32 bytes per iteration");
+        // The block count borrows from its high word once dbf runs out
+        assert!(
+            insts
+                .iter()
+                .any(|i| matches!(i, M68kInst::Subi(Size::Long, 0x10000, _))),
+            "{name} should count past 64K"
+        );
+    }
+}
+
+#[test]
+fn deps_resolve_mem_bulk_entries() {
+    let mut funcs = HashSet::new();
+    funcs.insert("mem_copy".to_string());
+    funcs.insert("mem_set".to_string());
+    let resolved = resolve_dependencies(&funcs);
+    assert!(resolved.contains("mem_copy_w"));
+    assert!(resolved.contains("mem_set_l"));
+}
+
 #[test]
 fn library_generate_rand_next() {
     let mut libgen = SdkLibraryGenerator::new();
@@ -926,3 +1178,134 @@ fn hardware_addresses_sram_correct() {
     assert_eq!(SRAM_CTRL, 0xA130F1);
     assert_eq!(SRAM_BASE, 0x200001);
 }
+
+// ============================================================================
+// Specialization Tests
+// ============================================================================
+
+#[test]
+fn specialize_tile_a_with_constant_position() {
+    let code = SdkSpecializer::generate("vdp_set_tile_a", &[Some(3), Some(2), None]).unwrap();
+    // 0xC000 + 2*128 + 3*2 = 0xC106
+    assert_eq!(
+        code,
+        vec![
+            M68kInst::Move(
+                Size::Long,
+                Operand::Imm(0x4106_0003),
+                Operand::AbsLong(VDP_CTRL)
+            ),
+            M68kInst::Move(
+                Size::Word,
+                Operand::DataReg(DataReg::D2),
+                Operand::AbsLong(VDP_DATA)
+            ),
+        ]
+    );
+}
+
+#[test]
+fn specialize_constant_tile_and_color() {
+    let code = SdkSpecializer::generate("vdp_set_tile_b", &[Some(0), Some(0), Some(0x8005)]);
+    assert_eq!(
+        code.unwrap()[1],
+        M68kInst::Move(
+            Size::Word,
+            Operand::Imm(Size::Word.truncate(0x8005)),
+            Operand::AbsLong(VDP_DATA)
+        )
+    );
+    let code = SdkSpecializer::generate("vdp_set_color", &[Some(17), None]).unwrap();
+    assert_eq!(
+        code[0],
+        M68kInst::Move(
+            Size::Long,
+            Operand::Imm(0xC022_0000_u32 as i32),
+            Operand::AbsLong(VDP_CTRL)
+        )
+    );
+}
+
+#[test]
+fn specialize_vdp_set_reg() {
+    let code = SdkSpecializer::generate("vdp_set_reg", &[Some(1), Some(0x74)]).unwrap();
+    assert_eq!(
+        code,
+        vec![M68kInst::Move(
+            Size::Word,
+            Operand::Imm(Size::Word.truncate(0x8174)),
+            Operand::AbsLong(VDP_CTRL)
+        )]
+    );
+}
+
+#[test]
+fn specialize_needs_constant_position() {
+    assert!(SdkSpecializer::generate("vdp_set_tile_a", &[None, Some(2), Some(1)]).is_none());
+    assert!(SdkSpecializer::generate("vdp_set_reg", &[Some(1), None]).is_none());
+    assert!(SdkSpecializer::generate("mem_copy", &[Some(1), Some(2), Some(3)]).is_none());
+}
+
+#[test]
+fn specialize_fixed_math_to_constant() {
+    let code = SdkSpecializer::generate("sin_fix", &[Some(32)]).unwrap();
+    assert_eq!(
+        code,
+        vec![M68kInst::Move(
+            Size::Long,
+            Operand::Imm(181),
+            Operand::DataReg(DataReg::D0)
+        )]
+    );
+    let code = SdkSpecializer::generate("cos_fix", &[Some(64)]).unwrap();
+    assert_eq!(code, vec![M68kInst::Moveq(0, DataReg::D0)]);
+    let code = SdkSpecializer::generate("sqrt_fix", &[Some(4 << 8)]).unwrap();
+    assert_eq!(
+        code,
+        vec![M68kInst::Move(
+            Size::Long,
+            Operand::Imm(2 << 8),
+            Operand::DataReg(DataReg::D0)
+        )]
+    );
+    assert!(SdkSpecializer::generate("sin_fix", &[None]).is_none());
+}
+
+#[test]
+fn inline_fixed_math_reads_sine_table() {
+    let sin = SdkInlineGenerator::generate("sin_fix").unwrap();
+    let cos = SdkInlineGenerator::generate("cos_fix").unwrap();
+    let table = M68kInst::Lea(Operand::Label("__sdk_sin_table".into()), AddrReg::A0);
+    assert!(sin.contains(&table));
+    // Cosine is the sine a quarter turn on
+    assert_eq!(
+        cos[0],
+        M68kInst::Addi(Size::Long, 64, Operand::DataReg(DataReg::D0))
+    );
+    assert_eq!(cos[1..], sin[..]);
+    assert!(inline_uses_static_data("cos_fix"));
+    assert!(!inline_uses_static_data("vdp_set_reg"));
+}
+
+#[test]
+fn static_data_contains_fixed_math_tables() {
+    let funcs: HashSet<String> = ["sin_fix", "sqrt_fix"].map(String::from).into();
+    let data = generate_static_data(&funcs);
+    let table = |name: &str| {
+        let start = data
+            .iter()
+            .position(|i| *i == M68kInst::Label(name.into()))
+            .unwrap();
+        &data[start + 1..]
+    };
+    let sines = table("__sdk_sin_table");
+    assert_eq!(sines[64], M68kInst::Directive(Directive::Word(256)));
+    assert_eq!(sines[192], M68kInst::Directive(Directive::Word(0xFF00)));
+    let roots = table("__sdk_sqrt_table");
+    assert_eq!(roots[4], M68kInst::Directive(Directive::Byte(32)));
+    assert_eq!(roots[255], M68kInst::Directive(Directive::Byte(255)));
+
+    let funcs: HashSet<String> = ["cos_fix"].map(String::from).into();
+    let data = generate_static_data(&funcs);
+    assert!(!data.contains(&M68kInst::Label("__sdk_sqrt_table".into())));
+}
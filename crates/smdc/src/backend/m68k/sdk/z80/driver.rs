@@ -0,0 +1,513 @@
+//! Built-in Z80 sound driver
+//!
+//! The driver mixes two PCM channels from ROM to the YM2612 DAC and plays an
+//! FM song, so the 68000 only posts commands (`snd_*`). Its loop is paced by
+//! YM Timer A, one DAC sample per overflow (about 13.3 kHz). Each pass
+//! writes the average of the two channels' next bytes, then does one slice of
+//! background work:
+//!
+//! - planning a copy of up to [`JOB_LEN`] bytes of one channel into its ring,
+//!   selecting the ROM bank holding them; a channel with nothing playing
+//!   copies silence
+//! - copying [`FETCH_BYTES`] bytes of the planned segment
+//! - when neither ring has room: running a posted command, or stepping the
+//!   song
+//!
+//! Both rings are read at the same index, so copies run up to a ring ahead of
+//! playback and a new sample starts within 256 samples.
+//!
+//! Songs are byte streams of YM register writes and waits (`SONG_*`). The
+//! song advances one tick every 256 samples, about 52 times a second.
+//!
+//! Samples and songs must be in ROM, and must not be read while a VDP DMA
+//! from ROM is running. Channel 3 is kept in normal mode.
+
+use super::{Alu, Cond, R8, R16, Z80Asm};
+use std::sync::LazyLock;
+
+/// Mailbox in Z80 RAM: command byte, then its arguments
+///
+/// The 68000 writes the arguments first and the command last; the driver
+/// clears the command byte when it has taken it.
+pub const MAILBOX: u16 = 0x1F00;
+
+/// Play a sample: channel, length (word), window address (word, from
+/// 0x8000), bank (word, 68000 address >> 15)
+pub const CMD_PLAY_SAMPLE: u8 = 0x20;
+/// Stop a channel: channel
+pub const CMD_STOP_SAMPLE: u8 = 0x21;
+/// Play a song from the start, looping to it on `SONG_LOOP`: window address
+/// (word), bank (word)
+pub const CMD_PLAY_SONG: u8 = 0x10;
+/// Stop the song and key off every FM channel
+pub const CMD_STOP_SONG: u8 = 0x11;
+
+/// Song event: end of the song
+pub const SONG_END: u8 = 0x00;
+/// Song event: write register, value to YM port 0
+pub const SONG_YM0: u8 = 0x01;
+/// Song event: write register, value to YM port 1
+pub const SONG_YM1: u8 = 0x02;
+/// Song event: wait this many ticks
+pub const SONG_WAIT: u8 = 0x03;
+/// Song event: continue from the start
+pub const SONG_LOOP: u8 = 0x04;
+
+/// PCM channels
+pub const CHANNELS: u8 = 2;
+
+/// Bytes a job copies into a ring
+pub const JOB_LEN: u8 = 64;
+
+/// Bytes copied per pass of the loop
+pub const FETCH_BYTES: usize = 3;
+
+/// Timer A count: overflows every 1024 - N ticks of 18.77 us / 4, about
+/// 13.3 kHz
+const TIMER_A: u16 = 1020;
+
+/// Reg 0x27: reset the Timer A flag, keep Timer A loaded and flagging
+const TIMER_CTRL: u8 = 0x15;
+
+// Z80 memory map
+const RING0: u16 = 0x1B00;
+const SILENCE: u16 = 0x1D00;
+const STACK_TOP: u16 = MAILBOX;
+const YM_PORT0: u16 = 0x4000;
+const BANK_REG: u16 = 0x6000;
+
+/// Channel states: left (word), window address (word), bank (word), ring
+/// fill index (byte), padding
+const CHANNEL_STATE: u16 = 0x1F10;
+const STATE_STRIDE: u8 = 8;
+const LEFT: u8 = 0;
+const PTR: u8 = 2;
+const BANK: u8 = 4;
+const FILL: u8 = 6;
+
+/// Song state: window address, bank, both again for the loop point (words),
+/// ticks to wait, playing flag
+const SONG: u16 = 0x1F20;
+const SONG_START: u16 = SONG + 4;
+const SONG_TICKS: u16 = SONG + 8;
+const SONG_PLAYING: u16 = SONG + 9;
+
+/// Bank last selected
+const CUR_BANK: u16 = 0x1F30;
+/// Song ticks due
+const SEQ_TICK: u16 = 0x1F32;
+/// Channel of the current job, and its bytes still to plan
+const JOB_CH: u16 = 0x1F33;
+const JOB_LEFT: u16 = 0x1F34;
+/// End of the state cleared at startup
+const STATE_END: u16 = 0x1F40;
+
+/// The driver image, loaded at Z80 address 0
+pub static DRIVER: LazyLock<Vec<u8>> = LazyLock::new(assemble);
+
+fn lo(addr: u16) -> u8 {
+    addr as u8
+}
+
+fn hi(addr: u16) -> u8 {
+    (addr >> 8) as u8
+}
+
+/// Assemble the driver
+pub fn assemble() -> Vec<u8> {
+    use R8::{A, B, C, D, E, H, HlInd, L};
+    use R16::{AF, BC, DE, HL, SP};
+
+    let mut a = Z80Asm::new();
+
+    // Startup: rings and the silence block to the DAC midpoint, state to
+    // zero except the bank (none selected yet), then Timer A and the DAC
+    a.di();
+    a.im1();
+    a.ld_rp(SP, STACK_TOP);
+    a.ld_rp(HL, RING0);
+    a.ld_rp(DE, RING0 + 1);
+    a.ld_rp(BC, SILENCE + u16::from(JOB_LEN) - RING0 - 1);
+    a.ld_n(HlInd, 0x80);
+    a.ldir();
+    a.ld_rp(HL, CHANNEL_STATE);
+    a.ld_rp(DE, CHANNEL_STATE + 1);
+    a.ld_rp(BC, STATE_END - CHANNEL_STATE - 1);
+    a.ld_n(HlInd, 0);
+    a.ldir();
+    a.ld_rp(HL, 0xFFFF);
+    a.ld_mem_rp(CUR_BANK, HL);
+    a.ld_rp(HL, YM_PORT0);
+    for (reg, value) in [
+        (0x24, (TIMER_A >> 2) as u8),
+        (0x25, (TIMER_A & 3) as u8),
+        (0x2B, 0x80),
+        (0x27, TIMER_CTRL),
+    ] {
+        a.ld_rp(DE, u16::from_be_bytes([reg, value]));
+        a.call("ym_write");
+    }
+    a.call("keys_off");
+    a.ld_n(C, 0);
+
+    // Main loop; C is the play index throughout
+    a.label("main_loop");
+    a.ld_a_mem(YM_PORT0);
+    a.rrca();
+    a.jr_cc(Cond::Nc, "main_loop");
+    a.ld_rp(HL, YM_PORT0);
+    a.ld_n(HlInd, 0x27);
+    a.inc(L);
+    a.ld_n(HlInd, TIMER_CTRL);
+    a.dec(L);
+    a.ld_n(HlInd, 0x2A);
+    a.ld_n(D, hi(RING0));
+    a.ld(E, C);
+    a.ld_a_de();
+    a.inc(D);
+    a.ex_de_hl();
+    a.alu(Alu::Add, HlInd);
+    a.rra();
+    a.ex_de_hl();
+    a.inc(L);
+    a.ld(HlInd, A);
+    a.inc(C);
+    a.jr_cc(Cond::Nz, "state_jump");
+    a.ld_rp(HL, SEQ_TICK);
+    a.inc(HlInd);
+    // Patched to the current state
+    a.label("state_jump");
+    a.jp("plan");
+
+    // Copy state: BC', DE', HL' hold the segment's count, ring address and
+    // source
+    a.label("fetch");
+    a.exx();
+    for _ in 0..FETCH_BYTES {
+        a.ldi();
+        a.jp_cc(Cond::Po, "fetch_done");
+    }
+    a.exx();
+    a.jp("main_loop");
+    a.label("fetch_done");
+    a.exx();
+    a.ld_rp_label(HL, "plan");
+    a.ld_label_hl("state_jump", 1);
+    a.jp("main_loop");
+
+    // Plan state: start a job on the other channel if its ring has room,
+    // else do service work; then plan the job's next segment, up to the end
+    // of the sample or the bank
+    a.label("plan");
+    a.ld_a_mem(JOB_LEFT);
+    a.alu(Alu::Or, A);
+    a.jr_cc(Cond::Nz, "segment");
+    a.ld_a_mem(JOB_CH);
+    a.alu_n(Alu::Xor, 1);
+    a.ld_mem_a(JOB_CH);
+    for _ in 0..3 {
+        a.alu(Alu::Add, A);
+    }
+    a.alu_n(Alu::Add, lo(CHANNEL_STATE) + FILL);
+    a.ld(L, A);
+    a.ld_n(H, hi(CHANNEL_STATE));
+    a.ld(A, HlInd);
+    a.alu(Alu::Sub, C);
+    a.alu_n(Alu::Cp, 0u8.wrapping_sub(JOB_LEN));
+    a.jp_cc(Cond::Nc, "service");
+    a.ld_n(A, JOB_LEN);
+    a.ld_mem_a(JOB_LEFT);
+
+    a.label("segment");
+    a.ld_ix(CHANNEL_STATE);
+    a.ld_a_mem(JOB_CH);
+    a.alu(Alu::Or, A);
+    a.jr_cc(Cond::Z, "segment_state");
+    a.ld_rp(DE, u16::from(STATE_STRIDE));
+    a.add_ix(DE);
+    a.label("segment_state");
+    a.ld_a_mem(JOB_LEFT);
+    a.ld(B, A);
+    a.ld_r_ix(A, LEFT);
+    a.alu_ix(Alu::Or, LEFT + 1);
+    a.jr_cc(Cond::Z, "segment_silence");
+    // B = min(job left, sample left, bytes to the end of the bank)
+    a.ld_r_ix(A, LEFT + 1);
+    a.alu(Alu::Or, A);
+    a.jr_cc(Cond::Nz, "segment_sample_ok");
+    a.ld_r_ix(A, LEFT);
+    a.alu(Alu::Cp, B);
+    a.jr_cc(Cond::Nc, "segment_sample_ok");
+    a.ld(B, A);
+    a.label("segment_sample_ok");
+    a.ld_r_ix(A, PTR + 1);
+    a.inc(A);
+    a.jr_cc(Cond::Nz, "segment_bank_ok");
+    a.alu(Alu::Xor, A);
+    a.alu_ix(Alu::Sub, PTR);
+    a.jr_cc(Cond::Z, "segment_bank_ok");
+    a.alu(Alu::Cp, B);
+    a.jr_cc(Cond::Nc, "segment_bank_ok");
+    a.ld(B, A);
+    a.label("segment_bank_ok");
+    a.ld_r_ix(E, BANK);
+    a.ld_r_ix(D, BANK + 1);
+    a.call("set_bank");
+    a.ld_r_ix(L, PTR);
+    a.ld_r_ix(H, PTR + 1);
+    a.call("start_copy");
+    // Advance the channel past the segment, into the next bank at the end
+    // of the window
+    a.ld_r_ix(A, LEFT);
+    a.alu(Alu::Sub, B);
+    a.ld_ix_r(LEFT, A);
+    a.ld_r_ix(A, LEFT + 1);
+    a.alu_n(Alu::Sbc, 0);
+    a.ld_ix_r(LEFT + 1, A);
+    a.ld_r_ix(A, PTR);
+    a.alu(Alu::Add, B);
+    a.ld_ix_r(PTR, A);
+    a.ld_r_ix(A, PTR + 1);
+    a.alu_n(Alu::Adc, 0);
+    a.ld_ix_r(PTR + 1, A);
+    a.jr_cc(Cond::Nc, "segment_queued");
+    a.ld_ix_n(PTR + 1, 0x80);
+    a.inc_ix(BANK);
+    a.jr_cc(Cond::Nz, "segment_queued");
+    a.inc_ix(BANK + 1);
+    a.jr("segment_queued");
+    a.label("segment_silence");
+    a.ld_rp(HL, SILENCE);
+    a.call("start_copy");
+    a.label("segment_queued");
+    a.ld_r_ix(A, FILL);
+    a.alu(Alu::Add, B);
+    a.ld_ix_r(FILL, A);
+    a.ld_a_mem(JOB_LEFT);
+    a.alu(Alu::Sub, B);
+    a.ld_mem_a(JOB_LEFT);
+    a.ld_rp_label(HL, "fetch");
+    a.ld_label_hl("state_jump", 1);
+    a.jp("main_loop");
+
+    // HL = source, B = count, IX = channel state: load the copy registers
+    a.label("start_copy");
+    a.ld_a_mem(JOB_CH);
+    a.alu_n(Alu::Add, hi(RING0));
+    a.ld(D, A);
+    a.ld_r_ix(E, FILL);
+    a.push(BC);
+    a.push(DE);
+    a.push(HL);
+    a.exx();
+    a.pop(HL);
+    a.pop(DE);
+    a.pop(BC);
+    a.ld(C, B);
+    a.ld_n(B, 0);
+    a.exx();
+    a.ret();
+
+    // Service work, one step per pass
+    a.label("service");
+    a.ld_a_mem(MAILBOX);
+    a.alu(Alu::Or, A);
+    a.jr_cc(Cond::Nz, "command");
+    a.ld_a_mem(SEQ_TICK);
+    a.alu(Alu::Or, A);
+    a.jp_cc(Cond::Nz, "sequencer");
+    a.jp("main_loop");
+
+    a.label("command");
+    for (cmd, label) in [
+        (CMD_PLAY_SAMPLE, "cmd_play_sample"),
+        (CMD_STOP_SAMPLE, "cmd_stop_sample"),
+        (CMD_PLAY_SONG, "cmd_play_song"),
+        (CMD_STOP_SONG, "cmd_stop_song"),
+    ] {
+        a.alu_n(Alu::Cp, cmd);
+        a.jr_cc(Cond::Z, label);
+    }
+    a.label("cmd_done");
+    a.alu(Alu::Xor, A);
+    a.ld_mem_a(MAILBOX);
+    a.jp("main_loop");
+
+    a.label("cmd_play_sample");
+    a.call("mailbox_channel");
+    a.ex_de_hl();
+    a.ld_rp(HL, MAILBOX + 2);
+    a.push(BC);
+    a.ld_rp(BC, u16::from(FILL - LEFT));
+    a.ldir();
+    a.pop(BC);
+    a.jr("cmd_done");
+
+    a.label("cmd_stop_sample");
+    a.call("mailbox_channel");
+    a.ld_n(HlInd, 0);
+    a.inc(L);
+    a.ld_n(HlInd, 0);
+    a.jr("cmd_done");
+
+    a.label("cmd_play_song");
+    a.push(BC);
+    a.ld_rp(HL, MAILBOX + 1);
+    a.ld_rp(DE, SONG);
+    a.ld_rp(BC, 4);
+    a.ldir();
+    a.ld_rp(HL, MAILBOX + 1);
+    a.ld_rp(BC, 4);
+    a.ldir();
+    a.pop(BC);
+    a.ex_de_hl();
+    a.ld_n(HlInd, 0);
+    a.inc(L);
+    a.ld_n(HlInd, 1);
+    a.jr("cmd_done");
+
+    a.label("cmd_stop_song");
+    a.alu(Alu::Xor, A);
+    a.ld_mem_a(SONG_PLAYING);
+    a.call("keys_off");
+    a.jr("cmd_done");
+
+    // HL = state of the channel the mailbox names
+    a.label("mailbox_channel");
+    a.ld_a_mem(MAILBOX + 1);
+    a.alu_n(Alu::And, CHANNELS - 1);
+    for _ in 0..3 {
+        a.alu(Alu::Add, A);
+    }
+    a.alu_n(Alu::Add, lo(CHANNEL_STATE));
+    a.ld(L, A);
+    a.ld_n(H, hi(CHANNEL_STATE));
+    a.ret();
+
+    // One tick of waiting, or one song event
+    a.label("sequencer");
+    a.ld_a_mem(SONG_PLAYING);
+    a.alu(Alu::Or, A);
+    a.jr_cc(Cond::Z, "seq_tick_done");
+    a.ld_rp(HL, SONG_TICKS);
+    a.ld(A, HlInd);
+    a.alu(Alu::Or, A);
+    a.jr_cc(Cond::Z, "seq_event");
+    a.dec(HlInd);
+    a.label("seq_tick_done");
+    a.ld_rp(HL, SEQ_TICK);
+    a.dec(HlInd);
+    a.jp("main_loop");
+
+    a.label("seq_event");
+    a.call("song_byte");
+    for (event, label) in [
+        (SONG_YM0, "seq_ym0"),
+        (SONG_YM1, "seq_ym1"),
+        (SONG_WAIT, "seq_wait"),
+        (SONG_LOOP, "seq_loop"),
+        (SONG_END, "seq_end"),
+    ] {
+        a.alu_n(Alu::Cp, event);
+        a.jr_cc(Cond::Z, label);
+    }
+    // Anything unknown ends the song too
+    a.label("seq_end");
+    a.alu(Alu::Xor, A);
+    a.ld_mem_a(SONG_PLAYING);
+    a.jr("seq_tick_done");
+
+    a.label("seq_ym0");
+    a.ld_n(B, lo(YM_PORT0));
+    a.jr("seq_ym_write");
+    a.label("seq_ym1");
+    a.ld_n(B, lo(YM_PORT0) + 2);
+    a.label("seq_ym_write");
+    a.call("song_byte");
+    a.push(AF);
+    a.call("song_byte");
+    a.ld(E, A);
+    a.pop(AF);
+    a.ld(D, A);
+    a.ld_n(H, hi(YM_PORT0));
+    a.ld(L, B);
+    a.call("ym_write");
+    a.jp("main_loop");
+
+    a.label("seq_wait");
+    a.call("song_byte");
+    a.ld_mem_a(SONG_TICKS);
+    a.jp("main_loop");
+
+    a.label("seq_loop");
+    a.ld_rp_mem(HL, SONG_START);
+    a.ld_mem_rp(SONG, HL);
+    a.ld_rp_mem(HL, SONG_START + 2);
+    a.ld_mem_rp(SONG + 2, HL);
+    a.jp("main_loop");
+
+    // A = next song byte; clobbers DE, HL
+    a.label("song_byte");
+    a.ld_rp_mem(DE, SONG + 2);
+    a.call("set_bank");
+    a.ld_rp_mem(HL, SONG);
+    a.ld(A, HlInd);
+    a.inc_rp(HL);
+    a.push(AF);
+    a.ld(A, H);
+    a.alu(Alu::Or, L);
+    a.jr_cc(Cond::Nz, "song_byte_store");
+    a.ld_n(H, 0x80);
+    a.inc_rp(DE);
+    a.ld_mem_rp(SONG + 2, DE);
+    a.label("song_byte_store");
+    a.ld_mem_rp(SONG, HL);
+    a.pop(AF);
+    a.ret();
+
+    // DE = bank, shifted into the bank register a bit at a time from A15;
+    // clobbers A, HL
+    a.label("set_bank");
+    a.ld_rp_mem(HL, CUR_BANK);
+    a.alu(Alu::Or, A);
+    a.sbc_hl(DE);
+    a.ret_cc(Cond::Z);
+    a.ld_mem_rp(CUR_BANK, DE);
+    a.ld_rp(HL, BANK_REG);
+    a.ld(A, E);
+    for _ in 0..8 {
+        a.ld(HlInd, A);
+        a.rrca();
+    }
+    a.ld(A, D);
+    a.ld(HlInd, A);
+    a.ret();
+
+    // HL = port, D = register, E = value; waits for the YM to be ready
+    a.label("ym_write");
+    a.ld_a_mem(YM_PORT0);
+    a.rlca();
+    a.jr_cc(Cond::C, "ym_write");
+    a.ld(HlInd, D);
+    a.inc(L);
+    a.ld(HlInd, E);
+    a.dec(L);
+    a.ret();
+
+    // Key off all six FM channels
+    a.label("keys_off");
+    a.ld_rp(HL, YM_PORT0);
+    a.ld_n(D, 0x28);
+    a.ld_n(E, 6);
+    a.label("keys_off_next");
+    a.ld(A, E);
+    a.alu_n(Alu::Cp, 3);
+    a.call_cc(Cond::Nz, "ym_write");
+    a.dec(E);
+    a.jp_cc(Cond::P, "keys_off_next");
+    a.ret();
+
+    let code = a.finish();
+    debug_assert!(code.len() <= usize::from(RING0));
+    code
+}
@@ -0,0 +1,412 @@
+//! Z80 code for the sound CPU
+//!
+//! A minimal assembler, with just the instructions the built-in sound driver
+//! uses, and the driver itself. Each method emits one instruction; labels
+//! may be used before they are defined and are patched in by `finish`.
+
+pub mod driver;
+
+#[cfg(test)]
+mod tests;
+
+use std::collections::HashMap;
+
+/// 8-bit operand, in encoding order; `HlInd` is `(hl)`
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum R8 {
+    B,
+    C,
+    D,
+    E,
+    H,
+    L,
+    HlInd,
+    A,
+}
+
+/// Register pair; `SP` and `AF` share an encoding, `AF` being the one
+/// `push` and `pop` take
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum R16 {
+    BC,
+    DE,
+    HL,
+    SP,
+    AF,
+}
+
+impl R16 {
+    fn code(self) -> u8 {
+        match self {
+            R16::BC => 0,
+            R16::DE => 1,
+            R16::HL => 2,
+            R16::SP | R16::AF => 3,
+        }
+    }
+}
+
+/// Branch condition
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum Cond {
+    Nz = 0,
+    Z = 1,
+    Nc = 2,
+    C = 3,
+    Po = 4,
+    P = 6,
+}
+
+/// Operation on the accumulator, in encoding order
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum Alu {
+    Add,
+    Adc,
+    Sub,
+    Sbc,
+    And,
+    Xor,
+    Or,
+    Cp,
+}
+
+/// Reference to a label waiting for its address
+enum Fixup {
+    /// Address plus an offset, as a little-endian word
+    Abs(usize, &'static str, u16),
+    /// `jr`/`djnz` displacement byte
+    Rel(usize, &'static str),
+}
+
+/// Z80 assembler; code is placed from address 0
+#[derive(Default)]
+pub struct Z80Asm {
+    code: Vec<u8>,
+    labels: HashMap<&'static str, u16>,
+    fixups: Vec<Fixup>,
+}
+
+const IX: u8 = 0xDD;
+const ED: u8 = 0xED;
+
+impl Z80Asm {
+    pub fn new() -> Self {
+        Self::default()
+    }
+
+    /// Current address
+    pub fn here(&self) -> u16 {
+        self.code.len() as u16
+    }
+
+    /// Define `name` at the current address
+    ///
+    /// # Panics
+    /// If `name` is already defined
+    pub fn label(&mut self, name: &'static str) {
+        let here = self.here();
+        assert!(
+            self.labels.insert(name, here).is_none(),
+            "duplicate Z80 label {name}"
+        );
+    }
+
+    /// Resolve the labels and return the code
+    ///
+    /// # Panics
+    /// If a label is used but not defined, or a relative branch is out of
+    /// range
+    pub fn finish(mut self) -> Vec<u8> {
+        for fixup in std::mem::take(&mut self.fixups) {
+            match fixup {
+                Fixup::Abs(at, label, offset) => {
+                    let addr = self.address(label).wrapping_add(offset);
+                    self.code[at..at + 2].copy_from_slice(&addr.to_le_bytes());
+                }
+                Fixup::Rel(at, label) => {
+                    let disp = i32::from(self.address(label)) - (at as i32 + 1);
+                    let disp = i8::try_from(disp)
+                        .unwrap_or_else(|_| panic!("Z80 branch to {label} out of range"));
+                    self.code[at] = disp as u8;
+                }
+            }
+        }
+        self.code
+    }
+
+    fn address(&self, label: &str) -> u16 {
+        *self
+            .labels
+            .get(label)
+            .unwrap_or_else(|| panic!("undefined Z80 label {label}"))
+    }
+
+    fn emit(&mut self, bytes: &[u8]) {
+        self.code.extend_from_slice(bytes);
+    }
+
+    fn emit_word(&mut self, word: u16) {
+        self.emit(&word.to_le_bytes());
+    }
+
+    fn emit_label(&mut self, label: &'static str, offset: u16) {
+        self.fixups.push(Fixup::Abs(self.code.len(), label, offset));
+        self.emit_word(0);
+    }
+
+    fn emit_rel(&mut self, opcode: u8, label: &'static str) {
+        self.emit(&[opcode]);
+        self.fixups.push(Fixup::Rel(self.code.len(), label));
+        self.emit(&[0]);
+    }
+
+    // ---------------------------------------------------------------------
+    // Loads
+    // ---------------------------------------------------------------------
+
+    /// `ld dst,src`
+    ///
+    /// # Panics
+    /// If both operands are `(hl)`, which encodes `halt`
+    pub fn ld(&mut self, dst: R8, src: R8) {
+        assert!(!(dst == R8::HlInd && src == R8::HlInd), "ld (hl),(hl)");
+        self.emit(&[0x40 | (dst as u8) << 3 | src as u8]);
+    }
+
+    /// `ld r,n`
+    pub fn ld_n(&mut self, r: R8, n: u8) {
+        self.emit(&[0x06 | (r as u8) << 3, n]);
+    }
+
+    /// `ld rr,nn`
+    pub fn ld_rp(&mut self, rp: R16, nn: u16) {
+        self.emit(&[0x01 | rp.code() << 4]);
+        self.emit_word(nn);
+    }
+
+    /// `ld rr,label`
+    pub fn ld_rp_label(&mut self, rp: R16, label: &'static str) {
+        self.emit(&[0x01 | rp.code() << 4]);
+        self.emit_label(label, 0);
+    }
+
+    /// `ld a,(nn)`
+    pub fn ld_a_mem(&mut self, addr: u16) {
+        self.emit(&[0x3A]);
+        self.emit_word(addr);
+    }
+
+    /// `ld (nn),a`
+    pub fn ld_mem_a(&mut self, addr: u16) {
+        self.emit(&[0x32]);
+        self.emit_word(addr);
+    }
+
+    /// `ld a,(de)`
+    pub fn ld_a_de(&mut self) {
+        self.emit(&[0x1A]);
+    }
+
+    /// `ld rr,(nn)`
+    pub fn ld_rp_mem(&mut self, rp: R16, addr: u16) {
+        if rp == R16::HL {
+            self.emit(&[0x2A]);
+        } else {
+            self.emit(&[ED, 0x4B | rp.code() << 4]);
+        }
+        self.emit_word(addr);
+    }
+
+    /// `ld (nn),rr`
+    pub fn ld_mem_rp(&mut self, addr: u16, rp: R16) {
+        if rp == R16::HL {
+            self.emit(&[0x22]);
+        } else {
+            self.emit(&[ED, 0x43 | rp.code() << 4]);
+        }
+        self.emit_word(addr);
+    }
+
+    /// `ld (label+offset),hl`, for patching code
+    pub fn ld_label_hl(&mut self, label: &'static str, offset: u16) {
+        self.emit(&[0x22]);
+        self.emit_label(label, offset);
+    }
+
+    /// `ld ix,nn`
+    pub fn ld_ix(&mut self, nn: u16) {
+        self.emit(&[IX, 0x21]);
+        self.emit_word(nn);
+    }
+
+    /// `ld r,(ix+d)`
+    pub fn ld_r_ix(&mut self, r: R8, d: u8) {
+        self.emit(&[IX, 0x46 | (r as u8) << 3, d]);
+    }
+
+    /// `ld (ix+d),r`
+    pub fn ld_ix_r(&mut self, d: u8, r: R8) {
+        self.emit(&[IX, 0x70 | r as u8, d]);
+    }
+
+    /// `ld (ix+d),n`
+    pub fn ld_ix_n(&mut self, d: u8, n: u8) {
+        self.emit(&[IX, 0x36, d, n]);
+    }
+
+    /// `push rr`
+    pub fn push(&mut self, rp: R16) {
+        self.emit(&[0xC5 | rp.code() << 4]);
+    }
+
+    /// `pop rr`
+    pub fn pop(&mut self, rp: R16) {
+        self.emit(&[0xC1 | rp.code() << 4]);
+    }
+
+    /// `ex de,hl`
+    pub fn ex_de_hl(&mut self) {
+        self.emit(&[0xEB]);
+    }
+
+    /// `exx`
+    pub fn exx(&mut self) {
+        self.emit(&[0xD9]);
+    }
+
+    /// `ldi`
+    pub fn ldi(&mut self) {
+        self.emit(&[ED, 0xA0]);
+    }
+
+    /// `ldir`
+    pub fn ldir(&mut self) {
+        self.emit(&[ED, 0xB0]);
+    }
+
+    // ---------------------------------------------------------------------
+    // Arithmetic
+    // ---------------------------------------------------------------------
+
+    /// `op a,r`
+    pub fn alu(&mut self, op: Alu, r: R8) {
+        self.emit(&[0x80 | (op as u8) << 3 | r as u8]);
+    }
+
+    /// `op a,n`
+    pub fn alu_n(&mut self, op: Alu, n: u8) {
+        self.emit(&[0xC6 | (op as u8) << 3, n]);
+    }
+
+    /// `op a,(ix+d)`
+    pub fn alu_ix(&mut self, op: Alu, d: u8) {
+        self.emit(&[IX, 0x86 | (op as u8) << 3, d]);
+    }
+
+    /// `inc r`
+    pub fn inc(&mut self, r: R8) {
+        self.emit(&[0x04 | (r as u8) << 3]);
+    }
+
+    /// `dec r`
+    pub fn dec(&mut self, r: R8) {
+        self.emit(&[0x05 | (r as u8) << 3]);
+    }
+
+    /// `inc (ix+d)`
+    pub fn inc_ix(&mut self, d: u8) {
+        self.emit(&[IX, 0x34, d]);
+    }
+
+    /// `inc rr`
+    pub fn inc_rp(&mut self, rp: R16) {
+        self.emit(&[0x03 | rp.code() << 4]);
+    }
+
+    /// `add ix,rr`
+    pub fn add_ix(&mut self, rp: R16) {
+        self.emit(&[IX, 0x09 | rp.code() << 4]);
+    }
+
+    /// `sbc hl,rr`
+    pub fn sbc_hl(&mut self, rp: R16) {
+        self.emit(&[ED, 0x42 | rp.code() << 4]);
+    }
+
+    /// `rra`
+    pub fn rra(&mut self) {
+        self.emit(&[0x1F]);
+    }
+
+    /// `rrca`
+    pub fn rrca(&mut self) {
+        self.emit(&[0x0F]);
+    }
+
+    /// `rlca`
+    pub fn rlca(&mut self) {
+        self.emit(&[0x07]);
+    }
+
+    // ---------------------------------------------------------------------
+    // Control
+    // ---------------------------------------------------------------------
+
+    /// `jp label`
+    pub fn jp(&mut self, label: &'static str) {
+        self.emit(&[0xC3]);
+        self.emit_label(label, 0);
+    }
+
+    /// `jp cc,label`
+    pub fn jp_cc(&mut self, cc: Cond, label: &'static str) {
+        self.emit(&[0xC2 | (cc as u8) << 3]);
+        self.emit_label(label, 0);
+    }
+
+    /// `jr label`
+    pub fn jr(&mut self, label: &'static str) {
+        self.emit_rel(0x18, label);
+    }
+
+    /// `jr cc,label`
+    ///
+    /// # Panics
+    /// For conditions `jr` does not have
+    pub fn jr_cc(&mut self, cc: Cond, label: &'static str) {
+        assert!((cc as u8) < 4, "no jr {cc:?}");
+        self.emit_rel(0x20 | (cc as u8) << 3, label);
+    }
+
+    /// `call label`
+    pub fn call(&mut self, label: &'static str) {
+        self.emit(&[0xCD]);
+        self.emit_label(label, 0);
+    }
+
+    /// `call cc,label`
+    pub fn call_cc(&mut self, cc: Cond, label: &'static str) {
+        self.emit(&[0xC4 | (cc as u8) << 3]);
+        self.emit_label(label, 0);
+    }
+
+    /// `ret`
+    pub fn ret(&mut self) {
+        self.emit(&[0xC9]);
+    }
+
+    /// `ret cc`
+    pub fn ret_cc(&mut self, cc: Cond) {
+        self.emit(&[0xC0 | (cc as u8) << 3]);
+    }
+
+    /// `di`
+    pub fn di(&mut self) {
+        self.emit(&[0xF3]);
+    }
+
+    /// `im 1`
+    pub fn im1(&mut self) {
+        self.emit(&[ED, 0x56]);
+    }
+}
@@ -0,0 +1,622 @@
+//! Tests for the Z80 assembler and sound driver
+//!
+//! The driver runs on a small interpreter for the instructions the assembler
+//! emits, with the YM2612 and bank register stubbed: Timer A always due,
+//! never busy, DAC writes, Timer A resets and other register writes
+//! recorded.
+
+use super::driver::*;
+use super::{Alu, Cond, R8, R16, Z80Asm};
+
+const FLAG_S: u8 = 0x80;
+const FLAG_Z: u8 = 0x40;
+const FLAG_PV: u8 = 0x04;
+const FLAG_C: u8 = 0x01;
+
+/// A YM register write outside the DAC: port, register, value
+type YmWrite = (u8, u8, u8);
+
+struct Machine {
+    regs: [u8; 8],
+    alt: [u8; 8],
+    ix: u16,
+    sp: u16,
+    pc: u16,
+    ram: Vec<u8>,
+    rom: Vec<u8>,
+    bank: u32,
+    latch: [u8; 2],
+    dac: Vec<u8>,
+    timer_resets: usize,
+    ym: Vec<YmWrite>,
+}
+
+// Register file order matches the R8 encoding, with F in the (hl) slot
+const B: usize = 0;
+const C: usize = 1;
+const D: usize = 2;
+const E: usize = 3;
+const H: usize = 4;
+const L: usize = 5;
+const F: usize = 6;
+const A: usize = 7;
+
+impl Machine {
+    fn new(rom: Vec<u8>) -> Self {
+        let mut ram = vec![0; 0x2000];
+        ram[..DRIVER.len()].copy_from_slice(&DRIVER);
+        Self {
+            regs: [0; 8],
+            alt: [0; 8],
+            ix: 0,
+            sp: 0,
+            pc: 0,
+            ram,
+            rom,
+            bank: 0,
+            latch: [0; 2],
+            dac: Vec::new(),
+            timer_resets: 0,
+            ym: Vec::new(),
+        }
+    }
+
+    fn read(&self, addr: u16) -> u8 {
+        match addr {
+            0..0x2000 => self.ram[addr as usize],
+            // Timer A due, not busy
+            0x4000..0x4004 => 0x01,
+            0x8000.. => {
+                let rom_addr = (self.bank << 15) as usize | (addr as usize & 0x7FFF);
+                self.rom.get(rom_addr).copied().unwrap_or(0xFF)
+            }
+            _ => 0xFF,
+        }
+    }
+
+    fn write(&mut self, addr: u16, value: u8) {
+        match addr {
+            0..0x2000 => self.ram[addr as usize] = value,
+            0x4000 | 0x4002 => self.latch[(addr as usize - 0x4000) / 2] = value,
+            0x4001 | 0x4003 => {
+                let port = (addr as usize - 0x4001) / 2;
+                if port == 0 && self.latch[0] == 0x2A {
+                    self.dac.push(value);
+                } else if port == 0 && self.latch[0] == 0x27 && value == 0x15 {
+                    self.timer_resets += 1;
+                } else {
+                    self.ym.push((port as u8, self.latch[port], value));
+                }
+            }
+            0x6000 => self.bank = (self.bank >> 1) | (u32::from(value & 1) << 8),
+            _ => {}
+        }
+    }
+
+    fn pair(&self, hi: usize) -> u16 {
+        u16::from_be_bytes([self.regs[hi], self.regs[hi + 1]])
+    }
+
+    fn set_pair(&mut self, hi: usize, value: u16) {
+        [self.regs[hi], self.regs[hi + 1]] = value.to_be_bytes();
+    }
+
+    fn hl(&self) -> u16 {
+        self.pair(H)
+    }
+
+    fn rp(&self, code: u8) -> u16 {
+        match code {
+            0 => self.pair(B),
+            1 => self.pair(D),
+            2 => self.pair(H),
+            _ => self.sp,
+        }
+    }
+
+    fn set_rp(&mut self, code: u8, value: u16) {
+        match code {
+            0 => self.set_pair(B, value),
+            1 => self.set_pair(D, value),
+            2 => self.set_pair(H, value),
+            _ => self.sp = value,
+        }
+    }
+
+    fn r(&self, code: u8) -> u8 {
+        if code == 6 {
+            self.read(self.hl())
+        } else {
+            self.regs[code as usize]
+        }
+    }
+
+    fn set_r(&mut self, code: u8, value: u8) {
+        if code == 6 {
+            self.write(self.hl(), value);
+        } else {
+            self.regs[code as usize] = value;
+        }
+    }
+
+    fn fetch(&mut self) -> u8 {
+        let byte = self.read(self.pc);
+        self.pc = self.pc.wrapping_add(1);
+        byte
+    }
+
+    fn fetch_word(&mut self) -> u16 {
+        u16::from_le_bytes([self.fetch(), self.fetch()])
+    }
+
+    fn read_word(&self, addr: u16) -> u16 {
+        u16::from_le_bytes([self.read(addr), self.read(addr.wrapping_add(1))])
+    }
+
+    fn write_word(&mut self, addr: u16, value: u16) {
+        let [lo, hi] = value.to_le_bytes();
+        self.write(addr, lo);
+        self.write(addr.wrapping_add(1), hi);
+    }
+
+    fn push(&mut self, value: u16) {
+        self.sp = self.sp.wrapping_sub(2);
+        self.write_word(self.sp, value);
+    }
+
+    fn pop(&mut self) -> u16 {
+        let value = self.read_word(self.sp);
+        self.sp = self.sp.wrapping_add(2);
+        value
+    }
+
+    fn flag(&self, flag: u8) -> bool {
+        self.regs[F] & flag != 0
+    }
+
+    fn cond(&self, cc: u8) -> bool {
+        let (flag, set) = match cc >> 1 {
+            0 => (FLAG_Z, cc & 1 == 1),
+            1 => (FLAG_C, cc & 1 == 1),
+            2 => (FLAG_PV, cc & 1 == 1),
+            _ => (FLAG_S, cc & 1 == 1),
+        };
+        self.flag(flag) == set
+    }
+
+    fn sz(value: u8) -> u8 {
+        (value & FLAG_S) | if value == 0 { FLAG_Z } else { 0 }
+    }
+
+    fn alu(&mut self, op: u8, value: u8) {
+        let a = self.regs[A];
+        let carry = u8::from(self.flag(FLAG_C));
+        let (result, flags) = match op {
+            0 | 1 => {
+                let c = if op == 1 { carry } else { 0 };
+                let sum = u16::from(a) + u16::from(value) + u16::from(c);
+                let result = sum as u8;
+                let overflow = (a ^ result) & (value ^ result) & 0x80 != 0;
+                (
+                    result,
+                    u8::from(sum > 0xFF) | if overflow { FLAG_PV } else { 0 },
+                )
+            }
+            2 | 3 | 7 => {
+                let c = if op == 3 { carry } else { 0 };
+                let diff = i16::from(a) - i16::from(value) - i16::from(c);
+                let result = diff as u8;
+                let overflow = (a ^ value) & (a ^ result) & 0x80 != 0;
+                (
+                    result,
+                    u8::from(diff < 0) | if overflow { FLAG_PV } else { 0 },
+                )
+            }
+            4 => (a & value, 0),
+            5 => (a ^ value, 0),
+            _ => (a | value, 0),
+        };
+        let parity = if op >= 4 && op != 7 && result.count_ones() % 2 == 0 {
+            FLAG_PV
+        } else {
+            0
+        };
+        self.regs[F] = Self::sz(result) | flags | parity;
+        if op != 7 {
+            self.regs[A] = result;
+        }
+    }
+
+    fn inc_dec(&mut self, value: u8, delta: i8) -> u8 {
+        let result = value.wrapping_add_signed(delta);
+        self.regs[F] = (self.regs[F] & FLAG_C) | Self::sz(result);
+        result
+    }
+
+    fn ix_addr(&mut self) -> u16 {
+        let d = self.fetch() as i8;
+        self.ix.wrapping_add_signed(i16::from(d))
+    }
+
+    fn ldi(&mut self) {
+        let value = self.read(self.hl());
+        self.write(self.pair(D), value);
+        self.set_pair(H, self.hl().wrapping_add(1));
+        self.set_pair(D, self.pair(D).wrapping_add(1));
+        let count = self.pair(B).wrapping_sub(1);
+        self.set_pair(B, count);
+        self.regs[F] = (self.regs[F] & !FLAG_PV) | if count != 0 { FLAG_PV } else { 0 };
+    }
+
+    fn step(&mut self) {
+        let at = self.pc;
+        let op = self.fetch();
+        let y = (op >> 3) & 7;
+        let z = op & 7;
+        let p = y >> 1;
+        match op {
+            0x01 | 0x11 | 0x21 | 0x31 => {
+                let nn = self.fetch_word();
+                self.set_rp(p, nn);
+            }
+            0x03 | 0x13 | 0x23 | 0x33 => self.set_rp(p, self.rp(p).wrapping_add(1)),
+            _ if op < 0x40 && z == 4 => {
+                let value = self.inc_dec(self.r(y), 1);
+                self.set_r(y, value);
+            }
+            _ if op < 0x40 && z == 5 => {
+                let value = self.inc_dec(self.r(y), -1);
+                self.set_r(y, value);
+            }
+            _ if op < 0x40 && z == 6 => {
+                let n = self.fetch();
+                self.set_r(y, n);
+            }
+            0x07 => {
+                let a = self.regs[A].rotate_left(1);
+                self.regs[A] = a;
+                self.regs[F] = (self.regs[F] & !FLAG_C) | (a & 1);
+            }
+            0x0F => {
+                let a = self.regs[A];
+                self.regs[A] = a.rotate_right(1);
+                self.regs[F] = (self.regs[F] & !FLAG_C) | (a & 1);
+            }
+            0x1F => {
+                let a = self.regs[A];
+                self.regs[A] = (a >> 1) | (u8::from(self.flag(FLAG_C)) << 7);
+                self.regs[F] = (self.regs[F] & !FLAG_C) | (a & 1);
+            }
+            0x18 | 0x20 | 0x28 | 0x30 | 0x38 => {
+                let d = self.fetch() as i8;
+                if op == 0x18 || self.cond(y - 4) {
+                    self.pc = self.pc.wrapping_add_signed(i16::from(d));
+                }
+            }
+            0x1A => self.regs[A] = self.read(self.pair(D)),
+            0x22 => {
+                let nn = self.fetch_word();
+                self.write_word(nn, self.hl());
+            }
+            0x2A => {
+                let nn = self.fetch_word();
+                self.set_pair(H, self.read_word(nn));
+            }
+            0x32 => {
+                let nn = self.fetch_word();
+                self.write(nn, self.regs[A]);
+            }
+            0x3A => {
+                let nn = self.fetch_word();
+                self.regs[A] = self.read(nn);
+            }
+            0x40..=0x7F if op != 0x76 => self.set_r(y, self.r(z)),
+            0x80..=0xBF => self.alu(y, self.r(z)),
+            _ if op >= 0xC0 && z == 0 => {
+                if self.cond(y) {
+                    self.pc = self.pop();
+                }
+            }
+            0xC1 | 0xD1 | 0xE1 | 0xF1 => {
+                let value = self.pop();
+                if p == 3 {
+                    [self.regs[A], self.regs[F]] = value.to_be_bytes();
+                } else {
+                    self.set_rp(p, value);
+                }
+            }
+            _ if op >= 0xC0 && z == 2 => {
+                let nn = self.fetch_word();
+                if self.cond(y) {
+                    self.pc = nn;
+                }
+            }
+            0xC3 => self.pc = self.fetch_word(),
+            _ if op >= 0xC0 && (z == 4 || op == 0xCD) => {
+                let nn = self.fetch_word();
+                if op == 0xCD || self.cond(y) {
+                    self.push(self.pc);
+                    self.pc = nn;
+                }
+            }
+            0xC5 | 0xD5 | 0xE5 | 0xF5 => {
+                let value = if p == 3 {
+                    u16::from_be_bytes([self.regs[A], self.regs[F]])
+                } else {
+                    self.rp(p)
+                };
+                self.push(value);
+            }
+            _ if op >= 0xC0 && z == 6 => {
+                let n = self.fetch();
+                self.alu(y, n);
+            }
+            0xC9 => self.pc = self.pop(),
+            0xD9 => {
+                for r in [B, C, D, E, H, L] {
+                    std::mem::swap(&mut self.regs[r], &mut self.alt[r]);
+                }
+            }
+            0xE9 => self.pc = self.hl(),
+            0xEB => {
+                let de = self.pair(D);
+                self.set_pair(D, self.hl());
+                self.set_pair(H, de);
+            }
+            0xF3 => {}
+            0xED => self.step_ed(at),
+            0xDD => self.step_ix(at),
+            _ => panic!("unsupported Z80 opcode {op:02X} at {at:04X}"),
+        }
+    }
+
+    fn step_ed(&mut self, at: u16) {
+        let op = self.fetch();
+        let p = (op >> 4) & 3;
+        match op {
+            0x42 | 0x52 | 0x62 | 0x72 => {
+                let result =
+                    i32::from(self.hl()) - i32::from(self.rp(p)) - i32::from(self.flag(FLAG_C));
+                self.set_pair(H, result as u16);
+                let zero = if result as u16 == 0 { FLAG_Z } else { 0 };
+                self.regs[F] = zero | u8::from(result < 0);
+            }
+            0x43 | 0x53 | 0x63 | 0x73 => {
+                let nn = self.fetch_word();
+                self.write_word(nn, self.rp(p));
+            }
+            0x4B | 0x5B | 0x6B | 0x7B => {
+                let nn = self.fetch_word();
+                self.set_rp(p, self.read_word(nn));
+            }
+            0x56 => {}
+            0xA0 => self.ldi(),
+            0xB0 => {
+                self.ldi();
+                while self.flag(FLAG_PV) {
+                    self.ldi();
+                }
+            }
+            _ => panic!("unsupported Z80 opcode ED {op:02X} at {at:04X}"),
+        }
+    }
+
+    fn step_ix(&mut self, at: u16) {
+        let op = self.fetch();
+        let y = (op >> 3) & 7;
+        match op {
+            0x21 => self.ix = self.fetch_word(),
+            0x09 | 0x19 | 0x29 | 0x39 => self.ix = self.ix.wrapping_add(self.rp((op >> 4) & 3)),
+            0x34 => {
+                let addr = self.ix_addr();
+                let value = self.inc_dec(self.read(addr), 1);
+                self.write(addr, value);
+            }
+            0x36 => {
+                let addr = self.ix_addr();
+                let n = self.fetch();
+                self.write(addr, n);
+            }
+            0x46 | 0x4E | 0x56 | 0x5E | 0x66 | 0x6E | 0x7E => {
+                let addr = self.ix_addr();
+                self.regs[y as usize] = self.read(addr);
+            }
+            0x70..0x78 if op != 0x76 => {
+                let addr = self.ix_addr();
+                self.write(addr, self.regs[(op & 7) as usize]);
+            }
+            _ if op & 0xC7 == 0x86 => {
+                let addr = self.ix_addr();
+                self.alu(y, self.read(addr));
+            }
+            _ => panic!("unsupported Z80 opcode DD {op:02X} at {at:04X}"),
+        }
+    }
+
+    /// Run until `done`, within a generous step budget
+    fn run_until(&mut self, done: impl Fn(&Self) -> bool) {
+        for _ in 0..20_000_000 {
+            if done(self) {
+                return;
+            }
+            self.step();
+        }
+        panic!("driver did not finish");
+    }
+
+    /// Run until `n` more DAC samples are out
+    fn run_samples(&mut self, n: usize) {
+        let target = self.dac.len() + n;
+        self.run_until(|m| m.dac.len() >= target);
+    }
+
+    /// Post a command the way the 68000 does, and run until it is taken
+    fn post(&mut self, cmd: u8, args: &[u8]) {
+        self.run_until(|m| m.ram[MAILBOX as usize] == 0);
+        let at = MAILBOX as usize + 1;
+        self.ram[at..at + args.len()].copy_from_slice(args);
+        self.ram[MAILBOX as usize] = cmd;
+        self.run_until(|m| m.ram[MAILBOX as usize] == 0);
+    }
+}
+
+/// Window address and bank of a 68000 address, as the mailbox takes them
+fn rom_args(addr: u32) -> [u8; 4] {
+    let [p0, p1] = ((addr as u16 & 0x7FFF) | 0x8000).to_le_bytes();
+    let [b0, b1] = ((addr >> 15) as u16).to_le_bytes();
+    [p0, p1, b0, b1]
+}
+
+fn sample_args(channel: u8, addr: u32, len: u16) -> Vec<u8> {
+    let mut args = vec![channel];
+    args.extend(len.to_le_bytes());
+    args.extend(rom_args(addr));
+    args
+}
+
+/// Index of `needle` in `haystack`
+fn find(haystack: &[u8], needle: &[u8]) -> Option<usize> {
+    haystack.windows(needle.len()).position(|w| w == needle)
+}
+
+#[test]
+fn test_encodings() {
+    let mut a = Z80Asm::new();
+    a.label("top");
+    a.ld(R8::A, R8::HlInd);
+    a.ld_n(R8::HlInd, 0x80);
+    a.alu(Alu::Add, R8::HlInd);
+    a.alu_n(Alu::Cp, 3);
+    a.ld_rp(R16::DE, 0x1234);
+    a.ld_mem_rp(0x1F30, R16::DE);
+    a.ld_r_ix(R8::E, 6);
+    a.ld_ix_r(2, R8::A);
+    a.sbc_hl(R16::DE);
+    a.push(R16::AF);
+    a.jr_cc(Cond::Nz, "top");
+    a.ld_label_hl("top", 1);
+    a.jp_cc(Cond::Po, "top");
+    assert_eq!(
+        a.finish(),
+        [
+            0x7E, 0x36, 0x80, 0x86, 0xFE, 0x03, 0x11, 0x34, 0x12, 0xED, 0x53, 0x30, 0x1F, 0xDD,
+            0x5E, 0x06, 0xDD, 0x77, 0x02, 0xED, 0x52, 0xF5, 0x20, 0xE8, 0x22, 0x01, 0x00, 0xE2,
+            0x00, 0x00
+        ]
+    );
+}
+
+#[test]
+fn test_driver_fits() {
+    assert!(!DRIVER.is_empty());
+    assert!(DRIVER.len() < 0x1B00, "driver is {} bytes", DRIVER.len());
+}
+
+#[test]
+fn test_sample_streams_across_banks() {
+    // Starts 0x80 bytes before the end of bank 2
+    let start = 0x17F80;
+    let sample: Vec<u8> = (0..300u32).map(|i| (i * 7 % 251) as u8).collect();
+    let mut rom = vec![0x80; 0x20000];
+    rom[start as usize..start as usize + sample.len()].copy_from_slice(&sample);
+
+    let mut m = Machine::new(rom);
+    m.run_samples(16);
+    assert!(m.dac.iter().all(|&s| s == 0x80));
+    // DAC on, Timer A running, keys off
+    assert!(m.ym.contains(&(0, 0x2B, 0x80)));
+    assert!(m.ym.contains(&(0, 0x24, 0xFF)));
+    assert!(m.timer_resets >= m.dac.len());
+    assert!(m.ym.contains(&(0, 0x28, 6)));
+
+    m.post(CMD_PLAY_SAMPLE, &sample_args(0, start, sample.len() as u16));
+    m.run_samples(1024);
+    // Mixed with silence on the other channel
+    let expected: Vec<u8> = sample
+        .iter()
+        .map(|&s| u16::midpoint(u16::from(s), 0x80) as u8)
+        .collect();
+    let at = find(&m.dac, &expected).expect("sample not played in order");
+    assert!(m.dac[at + expected.len()..].iter().all(|&s| s == 0x80));
+}
+
+#[test]
+fn test_two_channels_mix() {
+    let mut rom = vec![0x80; 0x10000];
+    rom[0x1000..0x1000 + 300].fill(200);
+    rom[0x9000..0x9000 + 300].fill(100);
+
+    let mut m = Machine::new(rom);
+    m.post(CMD_PLAY_SAMPLE, &sample_args(0, 0x1000, 300));
+    m.post(CMD_PLAY_SAMPLE, &sample_args(1, 0x9000, 300));
+    m.run_samples(1024);
+    let count = |v: u8| m.dac.iter().copied().filter(|&s| s == v).count();
+    let (both, first, second) = (count(150), count(164), count(114));
+    assert!(both > 0);
+    assert_eq!(both + first, 300);
+    assert_eq!(both + second, 300);
+    assert_eq!(m.dac.len(), count(0x80) + both + first + second);
+
+    // Stopping one channel cuts it short and leaves the other playing
+    let mut m = Machine::new(m.rom);
+    m.post(CMD_PLAY_SAMPLE, &sample_args(0, 0x1000, 300));
+    m.post(CMD_PLAY_SAMPLE, &sample_args(1, 0x9000, 300));
+    m.post(CMD_STOP_SAMPLE, &[0]);
+    m.run_samples(1024);
+    let count = |v: u8| m.dac.iter().copied().filter(|&s| s == v).count();
+    assert_eq!(count(150) + count(114), 300);
+    assert!(count(150) + count(164) < 300);
+}
+
+#[test]
+fn test_song_events() {
+    let song = [
+        SONG_YM0, 0x28, 0xF0, SONG_WAIT, 2, SONG_YM1, 0x30, 0x71, SONG_END,
+    ];
+    let start = 0x2_7FFC; // crosses into the next bank
+    let mut rom = vec![0; 0x30000];
+    rom[start as usize..start as usize + song.len()].copy_from_slice(&song);
+
+    let mut m = Machine::new(rom);
+    m.post(CMD_PLAY_SONG, &rom_args(start));
+    m.run_samples(256 * 6);
+    let key_on = m.ym.iter().position(|&w| w == (0, 0x28, 0xF0));
+    let write1 = m.ym.iter().position(|&w| w == (1, 0x30, 0x71));
+    let (key_on, write1) = (key_on.expect("key on"), write1.expect("port 1 write"));
+    assert!(key_on < write1);
+    // The song ended: nothing more is written
+    let writes = m.ym.len();
+    m.run_samples(256 * 4);
+    assert_eq!(m.ym.len(), writes);
+
+    // Waits are counted in ticks of 256 samples
+    let mut m = Machine::new(m.rom);
+    m.post(CMD_PLAY_SONG, &rom_args(start));
+    m.run_until(|m| m.ym.contains(&(0, 0x28, 0xF0)));
+    let from = m.dac.len();
+    m.run_until(|m| m.ym.contains(&(1, 0x30, 0x71)));
+    let waited = m.dac.len() - from;
+    assert!((256..=3 * 256).contains(&waited), "waited {waited} samples");
+}
+
+#[test]
+fn test_song_loops_and_stops() {
+    let song = [SONG_YM0, 0xB0, 0x07, SONG_WAIT, 1, SONG_LOOP];
+    let mut rom = vec![0; 0x10000];
+    rom[0x100..0x100 + song.len()].copy_from_slice(&song);
+
+    let mut m = Machine::new(rom);
+    m.post(CMD_PLAY_SONG, &rom_args(0x100));
+    m.run_samples(256 * 8);
+    let repeats = m.ym.iter().filter(|&&w| w == (0, 0xB0, 0x07)).count();
+    assert!(repeats >= 3, "played {repeats} times");
+
+    m.post(CMD_STOP_SONG, &[]);
+    let keys_off: Vec<_> = m.ym.iter().rev().take(6).copied().collect();
+    for ch in [0, 1, 2, 4, 5, 6] {
+        assert!(keys_off.contains(&(0, 0x28, ch)));
+    }
+    let writes = m.ym.len();
+    m.run_samples(256 * 4);
+    assert_eq!(m.ym.len(), writes);
+}
@@ -0,0 +1,677 @@
+//! Strength reduction of multiplication and division by constants
+//!
+//! MULS takes 38-70 cycles on the 68000 and DIVS up to 158, so when one
+//! operand is a constant the emitter asks this module for a cheaper sequence
+//! computing the same result as the generic lowering:
+//!
+//! - `x * c` becomes shifts and adds of `x`'s sign-extended low word (MULS
+//!   only sees the low words), when that is cheaper than `muls.w #c`
+//! - `x / 2^k` and `x % 2^k` become shifts and masks that round toward zero
+//! - `x / c` for a dividend known to fit in 16 unsigned bits becomes a
+//!   multiplication by a fixed-point reciprocal with MULU
+//!
+//! Everything else keeps MULS/DIVS/DIVU, with the constant as an immediate.
+//! The shift sequences produce the full 32-bit quotient, so they also give
+//! the right answer where DIVS would overflow and leave its operand alone.
+
+use super::cycles::instruction_cycles;
+use super::m68k::{Cond, DataReg, M68kInst, Operand, Size};
+use crate::common::Symbol;
+use crate::ir::{BinOp, Inst, IrFunction, Temp, UnOp, Value};
+use std::collections::HashSet;
+
+/// Largest count a single immediate shift can encode
+const MAX_SHIFT: u32 = 8;
+
+/// `reg = reg * c` with MULS semantics (low words, signed)
+pub fn multiply(reg: DataReg, scratch: DataReg, c: i64) -> Vec<M68kInst> {
+    let c = c as i16;
+    let muls = vec![M68kInst::Muls(Operand::Imm(i32::from(c)), reg)];
+    if c == 0 {
+        return vec![M68kInst::Moveq(0, reg)];
+    }
+
+    let magnitude = u32::from(c.unsigned_abs());
+    [binary_digits(magnitude), naf_digits(magnitude)]
+        .into_iter()
+        .map(|digits| {
+            let digits: Vec<_> = digits
+                .into_iter()
+                .map(|(p, neg)| (p, neg != (c < 0)))
+                .collect();
+            shift_add_chain(reg, scratch, &digits)
+        })
+        .chain(std::iter::once(muls))
+        .min_by_key(|code| cycles(code))
+        .unwrap_or_default()
+}
+
+/// `reg = reg op c` for a division or remainder, with the semantics of the
+/// generic DIVS/DIVU lowering. `narrow` says `reg` holds a value in
+/// `0..=0xFFFF`; `scratch` may be overwritten. Returns `None` for a zero
+/// divisor, which must still trap.
+pub fn divide(
+    op: BinOp,
+    reg: DataReg,
+    scratch: DataReg,
+    c: i64,
+    narrow: bool,
+    new_label: &mut dyn FnMut() -> Symbol,
+) -> Option<Vec<M68kInst>> {
+    let signed = matches!(op, BinOp::Div | BinOp::Mod);
+    let divisor = if signed {
+        i32::from(c as i16)
+    } else {
+        i32::from(c as u16)
+    };
+    if divisor == 0 {
+        return None;
+    }
+    let magnitude = divisor.unsigned_abs();
+    let dst = Operand::DataReg(reg);
+    let mut code = Vec::new();
+
+    if matches!(op, BinOp::Div | BinOp::UDiv)
+        && narrow
+        && !magnitude.is_power_of_two()
+        && let Some(reciprocal) = Reciprocal::find(magnitude)
+    {
+        reciprocal.emit(&mut code, reg, scratch);
+        if divisor < 0 {
+            code.push(M68kInst::Neg(Size::Long, dst));
+        }
+        return Some(code);
+    }
+
+    match op {
+        BinOp::Div | BinOp::UDiv if magnitude.is_power_of_two() => {
+            let k = magnitude.trailing_zeros();
+            if signed && k > 0 {
+                // Bias negative dividends so the shift rounds toward zero
+                let skip = new_label();
+                code.push(M68kInst::Tst(Size::Long, dst.clone()));
+                code.push(M68kInst::Bcc(Cond::Pl, skip));
+                code.push(add_immediate((1 << k) - 1, reg));
+                code.push(M68kInst::Label(skip));
+            }
+            shift_right(&mut code, reg, k, signed);
+            if divisor < 0 {
+                code.push(M68kInst::Neg(Size::Long, dst));
+            }
+        }
+        BinOp::Mod | BinOp::UMod if magnitude == 1 => code.push(M68kInst::Moveq(0, reg)),
+        BinOp::UMod if magnitude.is_power_of_two() => {
+            code.push(M68kInst::Andi(Size::Long, (magnitude - 1) as i32, dst));
+        }
+        BinOp::Mod if magnitude.is_power_of_two() => {
+            // The remainder takes the sign of the dividend
+            let mask = (magnitude - 1) as i32;
+            let negative = new_label();
+            let done = new_label();
+            code.extend([
+                M68kInst::Tst(Size::Long, dst.clone()),
+                M68kInst::Bcc(Cond::Mi, negative),
+                M68kInst::Andi(Size::Long, mask, dst.clone()),
+                M68kInst::Bra(done),
+                M68kInst::Label(negative),
+                M68kInst::Neg(Size::Long, dst.clone()),
+                M68kInst::Andi(Size::Long, mask, dst.clone()),
+                M68kInst::Neg(Size::Long, dst),
+                M68kInst::Label(done),
+            ]);
+        }
+        BinOp::Div => {
+            code.push(M68kInst::Divs(Operand::Imm(divisor), reg));
+            code.push(M68kInst::Ext(Size::Long, reg));
+        }
+        BinOp::Mod => {
+            code.push(M68kInst::Divs(Operand::Imm(divisor), reg));
+            code.push(M68kInst::Swap(reg));
+            code.push(M68kInst::Ext(Size::Long, reg));
+        }
+        BinOp::UDiv => {
+            code.push(M68kInst::Divu(Operand::Imm(divisor), reg));
+            code.push(M68kInst::Andi(Size::Long, 0xFFFF, dst));
+        }
+        BinOp::UMod => {
+            code.push(M68kInst::Divu(Operand::Imm(divisor), reg));
+            code.push(M68kInst::Swap(reg));
+            code.push(M68kInst::Andi(Size::Long, 0xFFFF, dst));
+        }
+        _ => return None,
+    }
+    Some(code)
+}
+
+/// Temps of `func` whose every definition yields a value in `0..=0xFFFF`
+pub fn narrow_temps(func: &IrFunction) -> HashSet<Temp> {
+    let defs: Vec<&Inst> = func
+        .blocks
+        .iter()
+        .flat_map(|b| &b.insts)
+        .map(|s| &s.inst)
+        .filter(|inst| inst.def().is_some())
+        .collect();
+    let mut narrow: HashSet<Temp> = defs.iter().filter_map(|inst| inst.def()).collect();
+
+    // Drop temps with a wide definition until the set is stable
+    loop {
+        let wide: Vec<Temp> = defs
+            .iter()
+            .filter(|inst| !defines_narrow(inst, &narrow))
+            .filter_map(|inst| inst.def())
+            .filter(|t| narrow.contains(t))
+            .collect();
+        if wide.is_empty() {
+            return narrow;
+        }
+        for t in wide {
+            narrow.remove(&t);
+        }
+    }
+}
+
+fn defines_narrow(inst: &Inst, narrow: &HashSet<Temp>) -> bool {
+    let is_narrow = |v: &Value| match v {
+        Value::IntConst(n) => (0..=0xFFFF).contains(n),
+        Value::Temp(t) => narrow.contains(t),
+        _ => false,
+    };
+    match inst {
+        Inst::Copy { src, .. } => is_narrow(src),
+        Inst::Unary { op, .. } => *op == UnOp::Not,
+        Inst::Load { size, signed, .. } => *size <= 2 && !signed,
+        Inst::Binary {
+            op, left, right, ..
+        } => match op {
+            BinOp::And => is_narrow(left) || is_narrow(right),
+            BinOp::Or | BinOp::Xor => is_narrow(left) && is_narrow(right),
+            BinOp::Shr => {
+                is_narrow(left) || matches!(right, Value::IntConst(n) if (16..32).contains(n))
+            }
+            // Reduced unsigned division keeps all 32 bits of the quotient
+            BinOp::UDiv => is_narrow(left),
+            BinOp::UMod | BinOp::Eq | BinOp::Ne | BinOp::Lt | BinOp::Le | BinOp::Gt | BinOp::Ge => {
+                true
+            }
+            _ => false,
+        },
+        _ => false,
+    }
+}
+
+/// Fixed-point reciprocal of a 16-bit divisor
+struct Reciprocal {
+    /// Low 16 bits of the multiplier
+    multiplier: u32,
+    shift: u32,
+    /// The multiplier has a 17th bit, added back as `x` itself
+    add_back: bool,
+}
+
+impl Reciprocal {
+    /// A reciprocal exact for every dividend in `0..=0xFFFF`: `x / d` is
+    /// `(x * m) >> (16 + s)` with `m` in MULU's 16 bits, or failing that
+    /// `(t + ((x - t) >> 1)) >> (s - 1)` where `t = (x * (m - 0x10000)) >> 16`
+    fn find(d: u32) -> Option<Self> {
+        let d = u64::from(d);
+        let exact = |q: &dyn Fn(u64) -> u64| (0..=0xFFFF).all(|x| q(x) == x / d);
+        let short = (0..=16).find_map(|s| {
+            let m = (1u64 << (16 + s)).div_ceil(d);
+            (m <= 0xFFFF && exact(&|x| (x * m) >> (16 + s))).then_some(Self {
+                multiplier: m as u32,
+                shift: s,
+                add_back: false,
+            })
+        });
+        short.or_else(|| {
+            (1..=16).find_map(|s| {
+                let m = (1u64 << (16 + s)).div_ceil(d).checked_sub(0x1_0000)?;
+                let q = |x: u64| {
+                    let t = (x * m) >> 16;
+                    (t + ((x - t) >> 1)) >> (s - 1)
+                };
+                (m <= 0xFFFF && exact(&q)).then_some(Self {
+                    multiplier: m as u32,
+                    shift: s - 1,
+                    add_back: true,
+                })
+            })
+        })
+    }
+
+    /// `reg = reg / d` for `reg` in `0..=0xFFFF`
+    fn emit(&self, code: &mut Vec<M68kInst>, reg: DataReg, scratch: DataReg) {
+        let (dst, copy) = (Operand::DataReg(reg), Operand::DataReg(scratch));
+        if self.add_back {
+            code.push(M68kInst::Move(Size::Long, dst.clone(), copy.clone()));
+        }
+        code.extend([
+            M68kInst::Mulu(Operand::Imm(self.multiplier as i32), reg),
+            M68kInst::Clr(Size::Word, dst.clone()),
+            M68kInst::Swap(reg),
+        ]);
+        if self.add_back {
+            code.push(M68kInst::Sub(Size::Long, dst.clone(), copy.clone()));
+            code.push(M68kInst::Lsr(Size::Long, Operand::Imm(1), scratch));
+            code.push(M68kInst::Add(Size::Long, copy, dst));
+        }
+        shift_right(code, reg, self.shift, false);
+    }
+}
+
+/// Set bits of `n` as `(position, negative)` digits, lowest first
+fn binary_digits(n: u32) -> Vec<(u32, bool)> {
+    (0..32)
+        .filter(|bit| n & (1 << bit) != 0)
+        .map(|bit| (bit, false))
+        .collect()
+}
+
+/// Non-adjacent form of `n`: signed digits with no two neighbours nonzero
+fn naf_digits(mut n: u32) -> Vec<(u32, bool)> {
+    let mut digits = Vec::new();
+    let mut position = 0;
+    while n != 0 {
+        if n & 1 != 0 {
+            let negative = n & 3 == 3;
+            if negative {
+                n += 1;
+            } else {
+                n -= 1;
+            }
+            digits.push((position, negative));
+        }
+        n >>= 1;
+        position += 1;
+    }
+    digits
+}
+
+/// `reg = sum(±(x << p))` over `digits`, keeping the shifted `x` in `scratch`
+fn shift_add_chain(reg: DataReg, scratch: DataReg, digits: &[(u32, bool)]) -> Vec<M68kInst> {
+    let mut code = vec![M68kInst::Ext(Size::Long, reg)];
+    let Some(&(first, negative)) = digits.first() else {
+        return code;
+    };
+    shift_left(&mut code, reg, first);
+    if digits.len() > 1 {
+        code.push(M68kInst::Move(
+            Size::Long,
+            Operand::DataReg(reg),
+            Operand::DataReg(scratch),
+        ));
+    }
+    if negative {
+        code.push(M68kInst::Neg(Size::Long, Operand::DataReg(reg)));
+    }
+    let mut shifted = first;
+    for &(position, negative) in &digits[1..] {
+        shift_left(&mut code, scratch, position - shifted);
+        shifted = position;
+        let (src, dst) = (Operand::DataReg(scratch), Operand::DataReg(reg));
+        code.push(if negative {
+            M68kInst::Sub(Size::Long, src, dst)
+        } else {
+            M68kInst::Add(Size::Long, src, dst)
+        });
+    }
+    code
+}
+
+fn shift_left(code: &mut Vec<M68kInst>, reg: DataReg, mut count: u32) {
+    if count >= 16 {
+        code.push(M68kInst::Swap(reg));
+        code.push(M68kInst::Clr(Size::Word, Operand::DataReg(reg)));
+        count -= 16;
+    }
+    while count > 0 {
+        if count == 1 {
+            code.push(M68kInst::Add(
+                Size::Long,
+                Operand::DataReg(reg),
+                Operand::DataReg(reg),
+            ));
+            return;
+        }
+        let step = count.min(MAX_SHIFT);
+        code.push(M68kInst::Lsl(Size::Long, Operand::Imm(step as i32), reg));
+        count -= step;
+    }
+}
+
+fn shift_right(code: &mut Vec<M68kInst>, reg: DataReg, mut count: u32, arithmetic: bool) {
+    if count >= 16 {
+        if arithmetic {
+            code.push(M68kInst::Swap(reg));
+            code.push(M68kInst::Ext(Size::Long, reg));
+        } else {
+            code.push(M68kInst::Clr(Size::Word, Operand::DataReg(reg)));
+            code.push(M68kInst::Swap(reg));
+        }
+        count -= 16;
+    }
+    while count > 0 {
+        let step = Operand::Imm(count.min(MAX_SHIFT) as i32);
+        code.push(if arithmetic {
+            M68kInst::Asr(Size::Long, step, reg)
+        } else {
+            M68kInst::Lsr(Size::Long, step, reg)
+        });
+        count = count.saturating_sub(MAX_SHIFT);
+    }
+}
+
+fn add_immediate(value: i32, reg: DataReg) -> M68kInst {
+    if (1..=8).contains(&value) {
+        M68kInst::Addq(Size::Long, value as u8, Operand::DataReg(reg))
+    } else {
+        M68kInst::Addi(Size::Long, value, Operand::DataReg(reg))
+    }
+}
+
+/// Execution time of `code`
+fn cycles(code: &[M68kInst]) -> u32 {
+    code.iter().map(instruction_cycles).sum()
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::opt::test_util::function;
+
+    /// Run `code` on a data register holding `x` and return the result
+    fn run(code: &[M68kInst], x: i32) -> i32 {
+        let (mut reg, mut scratch) = (x as u32, 0u32);
+        let mut negative = false;
+        let mut pc = 0;
+        let jump = |label: &str| {
+            code.iter()
+                .position(|i| matches!(i, M68kInst::Label(l) if l == label))
+                .unwrap()
+        };
+        while pc < code.len() {
+            let inst = &code[pc];
+            pc += 1;
+            let value = |op: &Operand, reg: u32, scratch: u32| match op {
+                Operand::DataReg(DataReg::D0) => reg,
+                Operand::DataReg(DataReg::D1) => scratch,
+                Operand::Imm(n) => *n as u32,
+                _ => panic!("unexpected operand {op:?}"),
+            };
+            let result = match inst {
+                M68kInst::Label(_) => continue,
+                M68kInst::Tst(_, _) => {
+                    negative = (reg as i32) < 0;
+                    continue;
+                }
+                M68kInst::Bcc(cond, label) => {
+                    if (*cond == Cond::Mi) == negative {
+                        pc = jump(label);
+                    }
+                    continue;
+                }
+                M68kInst::Bra(label) => {
+                    pc = jump(label);
+                    continue;
+                }
+                M68kInst::Move(_, _, _) => {
+                    scratch = reg;
+                    continue;
+                }
+                M68kInst::Sub(_, Operand::DataReg(DataReg::D0), Operand::DataReg(DataReg::D1)) => {
+                    scratch = scratch.wrapping_sub(reg);
+                    continue;
+                }
+                M68kInst::Lsr(_, n, DataReg::D1) => {
+                    scratch >>= value(n, reg, scratch);
+                    continue;
+                }
+                M68kInst::Moveq(n, _) => *n as u32,
+                M68kInst::Ext(_, _) => i32::from(reg as u16 as i16) as u32,
+                M68kInst::Neg(_, _) => reg.wrapping_neg(),
+                M68kInst::Swap(_) => reg.rotate_left(16),
+                M68kInst::Clr(_, _) => reg & 0xFFFF_0000,
+                M68kInst::Addq(_, n, _) => reg.wrapping_add(u32::from(*n)),
+                M68kInst::Addi(_, n, _) => reg.wrapping_add(*n as u32),
+                M68kInst::Andi(_, n, _) => reg & *n as u32,
+                M68kInst::Asr(_, n, _) => ((reg as i32) >> value(n, reg, scratch)) as u32,
+                M68kInst::Lsr(_, n, _) => reg >> value(n, reg, scratch),
+                M68kInst::Mulu(n, _) => (reg & 0xFFFF) * (value(n, reg, scratch) & 0xFFFF),
+                M68kInst::Muls(n, _) => {
+                    let m = value(n, reg, scratch) as u16 as i16;
+                    (i32::from(reg as u16 as i16) * i32::from(m)) as u32
+                }
+                M68kInst::Lsl(_, n, DataReg::D1) => {
+                    scratch <<= value(n, reg, scratch);
+                    continue;
+                }
+                M68kInst::Add(_, Operand::DataReg(DataReg::D1), Operand::DataReg(DataReg::D1)) => {
+                    scratch = scratch.wrapping_add(scratch);
+                    continue;
+                }
+                M68kInst::Lsl(_, n, _) => reg << value(n, reg, scratch),
+                M68kInst::Add(_, src, _) => reg.wrapping_add(value(src, reg, scratch)),
+                M68kInst::Sub(_, src, _) => reg.wrapping_sub(value(src, reg, scratch)),
+                M68kInst::Divs(n, _) => {
+                    let divisor = i32::from(value(n, reg, scratch) as i16);
+                    let quotient = (reg as i32) / divisor;
+                    let remainder = (reg as i32) % divisor;
+                    ((remainder as u32) << 16) | (quotient as u32 & 0xFFFF)
+                }
+                _ => panic!("unexpected instruction {inst:?}"),
+            };
+            reg = result;
+        }
+        reg as i32
+    }
+
+    fn labels() -> impl FnMut() -> Symbol {
+        let mut n = 0;
+        move || {
+            n += 1;
+            format!(".L{n}").into()
+        }
+    }
+
+    #[test]
+    fn test_multiply_matches_muls() {
+        let inputs = [0, 1, -1, 7, -300, 0x7FFF, -0x8000, 0x12345, -0x1_0003];
+        for c in [
+            -32768, -129, -7, -3, -1, 0, 1, 2, 3, 5, 7, 10, 100, 128, 320, 1000, 32767,
+        ] {
+            let code = multiply(DataReg::D0, DataReg::D1, c);
+            for x in inputs {
+                let expected = i32::from(x as i16) * c as i32;
+                assert_eq!(run(&code, x), expected, "{x} * {c}: {code:?}");
+            }
+        }
+    }
+
+    #[test]
+    fn test_multiply_picks_cheapest() {
+        assert_eq!(
+            multiply(DataReg::D0, DataReg::D1, 128),
+            vec![
+                M68kInst::Ext(Size::Long, DataReg::D0),
+                M68kInst::Lsl(Size::Long, Operand::Imm(7), DataReg::D0),
+            ]
+        );
+        // A dense constant is cheaper as a real multiply
+        assert_eq!(
+            multiply(DataReg::D0, DataReg::D1, 0x5555),
+            vec![M68kInst::Muls(Operand::Imm(0x5555), DataReg::D0)]
+        );
+    }
+
+    #[test]
+    fn test_power_of_two_division_rounds_toward_zero() {
+        let inputs = [
+            0,
+            1,
+            -1,
+            7,
+            -7,
+            8,
+            -8,
+            1000,
+            -1000,
+            0x7FFF_FFFF,
+            -0x8000_0000,
+        ];
+        for c in [1, -1, 2, -2, 4, 16, -16, 256, 1024, 0x4000, -0x8000] {
+            let div = divide(
+                BinOp::Div,
+                DataReg::D0,
+                DataReg::D1,
+                c,
+                false,
+                &mut labels(),
+            )
+            .unwrap();
+            let rem = divide(
+                BinOp::Mod,
+                DataReg::D0,
+                DataReg::D1,
+                c,
+                false,
+                &mut labels(),
+            )
+            .unwrap();
+            for x in inputs {
+                let d = c as i32;
+                assert_eq!(run(&div, x), x.wrapping_div(d), "{x} / {c}");
+                assert_eq!(run(&rem, x), x.wrapping_rem(d), "{x} % {c}");
+            }
+        }
+    }
+
+    #[test]
+    fn test_unsigned_power_of_two() {
+        let udiv = divide(
+            BinOp::UDiv,
+            DataReg::D0,
+            DataReg::D1,
+            0x1_0010,
+            false,
+            &mut labels(),
+        )
+        .unwrap();
+        assert_eq!(run(&udiv, -1), (u32::MAX / 16) as i32);
+        let umod = divide(
+            BinOp::UMod,
+            DataReg::D0,
+            DataReg::D1,
+            64,
+            false,
+            &mut labels(),
+        )
+        .unwrap();
+        assert_eq!(
+            umod,
+            vec![M68kInst::Andi(
+                Size::Long,
+                63,
+                Operand::DataReg(DataReg::D0)
+            )]
+        );
+    }
+
+    #[test]
+    fn test_reciprocal_division_of_narrow_values() {
+        for c in [3, 5, 6, 7, 10, 12, 100, 320, 1000, 30000] {
+            let code = divide(
+                BinOp::UDiv,
+                DataReg::D0,
+                DataReg::D1,
+                c,
+                true,
+                &mut labels(),
+            )
+            .unwrap();
+            assert!(!code.iter().any(|i| matches!(i, M68kInst::Divu(..))), "{c}");
+            for x in (0..=0xFFFF).step_by(7).chain([0xFFFF]) {
+                assert_eq!(run(&code, x) as u32, x as u32 / c as u32, "{x} / {c}");
+            }
+        }
+        // Without range information DIVS is kept, with an immediate divisor
+        let code = divide(
+            BinOp::Div,
+            DataReg::D0,
+            DataReg::D1,
+            10,
+            false,
+            &mut labels(),
+        )
+        .unwrap();
+        assert_eq!(code[0], M68kInst::Divs(Operand::Imm(10), DataReg::D0));
+        assert_eq!(run(&code, -1234), -123);
+    }
+
+    #[test]
+    fn test_zero_divisor_left_to_hardware() {
+        assert!(
+            divide(
+                BinOp::Div,
+                DataReg::D0,
+                DataReg::D1,
+                0x1_0000,
+                false,
+                &mut labels()
+            )
+            .is_none()
+        );
+    }
+
+    #[test]
+    fn test_narrow_temps() {
+        let load = |dst, size, signed| Inst::Load {
+            dst: Temp(dst),
+            addr: Value::Name("g".into()),
+            size,
+            volatile: false,
+            signed,
+            width: 4,
+        };
+        let func = function(vec![(
+            "entry",
+            vec![
+                load(0, 2, false),
+                load(1, 2, true),
+                Inst::Binary {
+                    dst: Temp(2),
+                    op: BinOp::And,
+                    left: Value::Temp(Temp(1)),
+                    right: Value::IntConst(0xFF),
+                    width: 4,
+                },
+                // t3 is narrow on both paths, t4 only on one
+                Inst::Copy {
+                    dst: Temp(3),
+                    src: Value::Temp(Temp(0)),
+                    width: 4,
+                },
+                Inst::Copy {
+                    dst: Temp(3),
+                    src: Value::IntConst(9),
+                    width: 4,
+                },
+                Inst::Copy {
+                    dst: Temp(4),
+                    src: Value::Temp(Temp(3)),
+                    width: 4,
+                },
+                Inst::Copy {
+                    dst: Temp(4),
+                    src: Value::Temp(Temp(1)),
+                    width: 4,
+                },
+            ],
+        )]);
+        let narrow = narrow_temps(&func);
+        assert!(
+            narrow.contains(&Temp(0)) && narrow.contains(&Temp(2)) && narrow.contains(&Temp(3))
+        );
+        assert!(!narrow.contains(&Temp(1)) && !narrow.contains(&Temp(4)));
+    }
+}
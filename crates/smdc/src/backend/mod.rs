@@ -27,6 +27,16 @@ pub enum OutputFormat {
     Binary,
 }
 
+/// What the startup stub clears before calling `main`
+#[derive(Debug, Clone, Copy, PartialEq, Eq, Default)]
+pub enum StartupMode {
+    /// All of work RAM, VRAM, CRAM and VSRAM
+    #[default]
+    Full,
+    /// The program's .bss, CRAM and VSRAM; VRAM is left to the program
+    Minimal,
+}
+
 /// Configuration options for backends
 #[derive(Debug, Clone, Default)]
 pub struct BackendConfig {
@@ -35,6 +45,10 @@ pub struct BackendConfig {
     pub debug_info: bool,
     pub dump_ir: bool,
     pub verbose: bool,
+    /// Estimate cycles per basic block (`BackendOutput::cycle_report`)
+    pub cycle_report: bool,
+    /// Startup stub variant
+    pub startup: StartupMode,
 }
 
 /// ROM-specific configuration for Sega Genesis
@@ -136,6 +150,8 @@ pub struct BackendOutput {
     /// Additional debug files to write alongside the main output.
     /// Each entry is (file_extension, content).
     pub side_artifacts: Vec<(String, String)>,
+    /// Per-block cycle estimates, when `BackendConfig::cycle_report` is set
+    pub cycle_report: Option<String>,
 }
 
 impl BackendOutput {
@@ -144,6 +160,7 @@ impl BackendOutput {
         Self {
             data: OutputKind::Text(s),
             side_artifacts: Vec::new(),
+            cycle_report: None,
         }
     }
 
@@ -152,6 +169,7 @@ impl BackendOutput {
         Self {
             data: OutputKind::Binary(b),
             side_artifacts: Vec::new(),
+            cycle_report: None,
         }
     }
 
@@ -16,11 +16,14 @@ pub use checksum::{calculate_checksum, update_checksum, verify_checksum};
 pub use header::RomHeader;
 pub use vectors::VectorTable;
 
-use crate::backend::m68k::{Assembler, CodeGenerator, generate_sym_file};
+use crate::backend::m68k::sdk::VBLANK_HANDLER;
+use crate::backend::m68k::{
+    Assembler, CodeGenerator, ObjectFile, cycle_report, generate_sym_file, link,
+};
 use crate::backend::{Backend, BackendConfig, BackendOutput, OutputFormat, RomConfig};
-use crate::common::{CompileError, CompileResult};
+use crate::common::{CompileError, CompileResult, stats};
 use crate::ir::IrModule;
-use std::collections::HashMap;
+use std::collections::{HashMap, HashSet};
 
 /// ROM builder backend
 ///
@@ -49,30 +52,39 @@ impl RomBackend {
 
     /// Build a ROM from the given IR module.
     ///
-    /// Returns the ROM binary and optionally the assembler symbol table
-    /// (when `config.debug_info` is true, for `.sym` file generation).
+    /// Returns the ROM binary, the assembler symbol table when
+    /// `config.debug_info` is true (for `.sym` file generation), and the
+    /// cycle report when `config.cycle_report` is.
     pub fn build_rom(
         &self,
         module: &IrModule,
         config: &BackendConfig,
-    ) -> CompileResult<(Vec<u8>, Option<HashMap<String, u32>>)> {
+    ) -> CompileResult<(Vec<u8>, Option<HashMap<String, u32>>, Option<String>)> {
         // 1. Generate M68k instructions from IR
         let mut codegen = CodeGenerator::new();
+        codegen.set_optimize_level(config.optimize_level);
+        codegen.set_startup(config.startup);
         if config.debug_info {
             if let Some(di) = &module.debug_info {
                 codegen.set_debug_info(di.filename.clone(), di.source.clone());
             }
         }
-        let instructions = codegen.generate_instructions(module)?;
+        let instructions = stats::time("codegen", || codegen.generate_instructions(module))?;
+        let report = config.cycle_report.then(|| cycle_report(&instructions));
 
         // 2. Assemble to binary (code starts at 0x200 after header)
         let mut assembler = Assembler::new(self.rom_config.entry_point);
-        let code_binary = assembler
-            .assemble(&instructions)
+        let code_binary = stats::time("assemble", || assembler.assemble(&instructions))
             .map_err(|e| CompileError::backend(format!("assembly error: {e}")))?;
 
         let symbols = if config.debug_info {
-            Some(assembler.symbols().clone())
+            Some(
+                assembler
+                    .symbols()
+                    .iter()
+                    .map(|(name, &addr)| (name.to_string(), addr))
+                    .collect(),
+            )
         } else {
             None
         };
@@ -80,9 +92,72 @@ impl RomBackend {
         // 3. Build ROM with actual code
         let mut builder = RomBuilder::new(self.rom_config.clone());
         builder.set_code(code_binary);
-        let rom = builder.build()?;
+        if let Some(&handler) = assembler.symbols().get(&VBLANK_HANDLER.into()) {
+            builder.set_vblank_handler(handler);
+        }
+        let rom = stats::time("rom", || builder.build())?;
+
+        Ok((rom, symbols, report))
+    }
+
+    /// Link separately compiled objects into a ROM.
+    ///
+    /// The startup stub, the SDK library routines the objects call and the
+    /// VBlank handler are generated into one more object, placed first at
+    /// the entry point.
+    pub fn link(
+        &self,
+        mut objects: Vec<ObjectFile>,
+        config: &BackendConfig,
+    ) -> CompileResult<BackendOutput> {
+        let defined: HashSet<String> = objects
+            .iter()
+            .flat_map(|o| &o.symbols)
+            .filter(|s| s.global)
+            .map(|s| s.name.clone())
+            .collect();
+        let sdk_functions: HashSet<String> = objects
+            .iter()
+            .flat_map(|o| &o.sdk_functions)
+            .filter(|f| !defined.contains(*f))
+            .cloned()
+            .collect();
+
+        let mut codegen = CodeGenerator::new();
+        codegen.set_optimize_level(config.optimize_level);
+        codegen.set_startup(config.startup);
+        let runtime = stats::time("codegen", || {
+            codegen.generate_runtime(&sdk_functions, &defined)
+        });
+        let runtime = stats::time("assemble", || Assembler::new(0).assemble_object(&runtime))
+            .map_err(|e| CompileError::backend(format!("assembly error: {e}")))?;
+        objects.insert(0, runtime);
+
+        let image = stats::time("link", || link(&objects, self.rom_config.entry_point))
+            .map_err(|e| CompileError::backend(format!("link error: {e}")))?;
 
-        Ok((rom, symbols))
+        let mut builder = RomBuilder::new(self.rom_config.clone());
+        builder.set_code(image.code);
+        if let Some(&handler) = image.symbols.get(VBLANK_HANDLER) {
+            builder.set_vblank_handler(handler);
+        }
+        let rom = stats::time("rom", || builder.build())?;
+
+        if config.verbose {
+            eprintln!(
+                "Linked {} objects, ROM size: {} bytes ({} KB)",
+                objects.len() - 1,
+                rom.len(),
+                rom.len() / 1024
+            );
+        }
+
+        let mut output = BackendOutput::binary(rom);
+        if config.debug_info {
+            let sym_content = generate_sym_file(&image.symbols);
+            output.side_artifacts.push(("sym".to_string(), sym_content));
+        }
+        Ok(output)
     }
 }
 
@@ -121,13 +196,14 @@ impl Backend for RomBackend {
             eprintln!("Building Sega Megadrive/Genesis ROM...");
         }
 
-        let (rom, symbols) = self.build_rom(module, config)?;
+        let (rom, symbols, report) = self.build_rom(module, config)?;
 
         if config.verbose {
             eprintln!("ROM size: {} bytes ({} KB)", rom.len(), rom.len() / 1024);
         }
 
         let mut output = BackendOutput::binary(rom);
+        output.cycle_report = report;
 
         // Generate .sym file when debug info is enabled
         if let Some(sym_table) = symbols {
@@ -0,0 +1,229 @@
+//! On-disk compilation cache
+//!
+//! `smdc --cache-dir DIR` keeps the results of earlier runs under `DIR`,
+//! keyed by a hash of everything that went into them: the compiler build,
+//! the source, the options and, for C, every header the source pulled in.
+//! Headers are only known after preprocessing, so an entry that depends on
+//! them is found in two steps: a manifest keyed by the source and options
+//! lists the headers the last run read, with their hashes, and the entry
+//! itself is keyed by those hashes too. If any header has changed since,
+//! the lookup misses.
+//!
+//! Entries are written to a temporary file and renamed into place, so
+//! parallel compiles sharing a cache never see a partial entry.
+
+use std::fmt::Write as _;
+use std::fs;
+use std::io;
+use std::path::{Path, PathBuf};
+use std::sync::OnceLock;
+use std::sync::atomic::{AtomicUsize, Ordering};
+
+/// 128-bit FNV-1a, stable across hosts and Rust releases
+#[derive(Debug, Clone, Copy)]
+pub struct Hasher(u128);
+
+const FNV_OFFSET: u128 = 0x6c62_272e_07bb_0142_62b8_2175_6295_c58d;
+const FNV_PRIME: u128 = 0x0000_0000_0100_0000_0000_0000_0000_013b;
+
+impl Hasher {
+    pub fn new() -> Self {
+        Self(FNV_OFFSET)
+    }
+
+    pub fn bytes(&mut self, bytes: &[u8]) -> &mut Self {
+        // Length first, so consecutive fields cannot run into each other
+        for &b in (bytes.len() as u64).to_le_bytes().iter().chain(bytes) {
+            self.0 ^= u128::from(b);
+            self.0 = self.0.wrapping_mul(FNV_PRIME);
+        }
+        self
+    }
+
+    pub fn str(&mut self, s: &str) -> &mut Self {
+        self.bytes(s.as_bytes())
+    }
+
+    pub fn finish(&self) -> Key {
+        Key(self.0)
+    }
+}
+
+impl Default for Hasher {
+    fn default() -> Self {
+        Self::new()
+    }
+}
+
+/// Cache key
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub struct Key(u128);
+
+impl std::fmt::Display for Key {
+    fn fmt(&self, f: &mut std::fmt::Formatter<'_>) -> std::fmt::Result {
+        write!(f, "{:032x}", self.0)
+    }
+}
+
+/// Identifies this compiler build: its version, plus the size and
+/// modification time of the executable, so a rebuilt compiler does not
+/// reuse entries from the old one
+pub fn compiler_version() -> &'static str {
+    static VERSION: OnceLock<String> = OnceLock::new();
+    VERSION.get_or_init(|| {
+        let mut version = env!("CARGO_PKG_VERSION").to_string();
+        if let Ok(meta) = std::env::current_exe().and_then(fs::metadata) {
+            let modified = meta
+                .modified()
+                .ok()
+                .and_then(|t| t.duration_since(std::time::UNIX_EPOCH).ok())
+                .unwrap_or_default();
+            let _ = write!(version, "+{}.{}", meta.len(), modified.as_nanos());
+        }
+        version
+    })
+}
+
+/// A hasher seeded with the compiler version and the kind of entry
+pub fn key_hasher(kind: &str) -> Hasher {
+    let mut hasher = Hasher::new();
+    hasher.str(compiler_version()).str(kind);
+    hasher
+}
+
+/// Cache directory
+#[derive(Debug, Clone)]
+pub struct BuildCache {
+    dir: PathBuf,
+}
+
+impl BuildCache {
+    pub fn new(dir: impl Into<PathBuf>) -> Self {
+        Self { dir: dir.into() }
+    }
+
+    fn path(&self, key: Key, ext: &str) -> PathBuf {
+        let name = key.to_string();
+        self.dir
+            .join(&name[..2])
+            .join(format!("{}.{ext}", &name[2..]))
+    }
+
+    /// The entry stored under `key`
+    pub fn get(&self, key: Key) -> Option<Vec<u8>> {
+        fs::read(self.path(key, "bin")).ok()
+    }
+
+    /// Store an entry under `key`
+    pub fn put(&self, key: Key, value: &[u8]) -> io::Result<()> {
+        write_atomic(&self.path(key, "bin"), value)
+    }
+
+    /// The entry stored by `put_with_deps` under `base`, if none of the
+    /// files it depended on have changed since
+    pub fn get_with_deps(&self, base: Key) -> Option<Vec<u8>> {
+        let manifest = fs::read_to_string(self.path(base, "deps")).ok()?;
+        let mut hasher = Hasher::new();
+        hasher.str(&base.to_string());
+        for line in manifest.lines() {
+            let (hash, path) = line.split_once(' ')?;
+            let current = file_hash(Path::new(path))?;
+            if current.to_string() != hash {
+                return None;
+            }
+            hasher.str(hash);
+        }
+        self.get(hasher.finish())
+    }
+
+    /// Store an entry that also depends on the contents of `deps`
+    pub fn put_with_deps(&self, base: Key, deps: &[PathBuf], value: &[u8]) -> io::Result<()> {
+        let mut manifest = String::new();
+        let mut hasher = Hasher::new();
+        hasher.str(&base.to_string());
+        for dep in deps {
+            let hash = file_hash(dep)
+                .ok_or_else(|| io::Error::other(format!("cannot hash {}", dep.display())))?
+                .to_string();
+            let _ = writeln!(manifest, "{hash} {}", dep.display());
+            hasher.str(&hash);
+        }
+        self.put(hasher.finish(), value)?;
+        write_atomic(&self.path(base, "deps"), manifest.as_bytes())
+    }
+}
+
+/// Hash of a file's contents
+fn file_hash(path: &Path) -> Option<Key> {
+    let contents = fs::read(path).ok()?;
+    Some(Hasher::new().bytes(&contents).finish())
+}
+
+/// Write `contents` to `path` by way of a temporary file
+fn write_atomic(path: &Path, contents: &[u8]) -> io::Result<()> {
+    static COUNTER: AtomicUsize = AtomicUsize::new(0);
+    if let Some(parent) = path.parent() {
+        fs::create_dir_all(parent)?;
+    }
+    let tmp = path.with_extension(format!(
+        "tmp{}.{}",
+        std::process::id(),
+        COUNTER.fetch_add(1, Ordering::Relaxed)
+    ));
+    fs::write(&tmp, contents)?;
+    fs::rename(&tmp, path).inspect_err(|_| {
+        let _ = fs::remove_file(&tmp);
+    })
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use std::time::{SystemTime, UNIX_EPOCH};
+
+    fn temp_dir() -> PathBuf {
+        let dir = std::env::temp_dir().join(format!(
+            "smdc_cache_test_{}_{}",
+            std::process::id(),
+            SystemTime::now()
+                .duration_since(UNIX_EPOCH)
+                .unwrap()
+                .as_nanos()
+        ));
+        fs::create_dir_all(&dir).unwrap();
+        dir
+    }
+
+    #[test]
+    fn test_hash_separates_fields() {
+        let ab = Hasher::new().str("ab").str("c").finish();
+        let a_bc = Hasher::new().str("a").str("bc").finish();
+        assert_ne!(ab, a_bc);
+        assert_eq!(ab, Hasher::new().str("ab").str("c").finish());
+    }
+
+    #[test]
+    fn test_entry_invalidated_by_changed_dependency() {
+        let dir = temp_dir();
+        let header = dir.join("smd.h");
+        fs::write(&header, "#define X 1\n").unwrap();
+        let cache = BuildCache::new(dir.join("cache"));
+        let base = key_hasher("test").str("int x = X;").finish();
+
+        assert_eq!(cache.get_with_deps(base), None);
+        cache
+            .put_with_deps(base, std::slice::from_ref(&header), b"int x = 1;")
+            .unwrap();
+        assert_eq!(
+            cache.get_with_deps(base).as_deref(),
+            Some(&b"int x = 1;"[..])
+        );
+
+        fs::write(&header, "#define X 2\n").unwrap();
+        assert_eq!(cache.get_with_deps(base), None);
+
+        cache.put(base, b"plain").unwrap();
+        assert_eq!(cache.get(base).as_deref(), Some(&b"plain"[..]));
+        let _ = fs::remove_dir_all(&dir);
+    }
+}
@@ -0,0 +1,96 @@
+//! Fixed-point math builtins
+//!
+//! `sin_fix`, `cos_fix` and `sqrt_fix` work in 8.8 fixed point and look
+//! their results up in tables. The SDK puts the tables in ROM for calls made
+//! at run time; constant initializers and calls with constant arguments are
+//! evaluated here instead, from the same tables, so both give the same
+//! answer.
+
+use std::sync::LazyLock;
+
+/// Fraction bits of the fixed-point format
+pub const FIX_SHIFT: u32 = 8;
+
+/// Steps in a full turn; angles wrap modulo this
+pub const ANGLE_STEPS: usize = 256;
+
+/// Names of the builtins
+pub const BUILTINS: [&str; 3] = ["sin_fix", "cos_fix", "sqrt_fix"];
+
+/// `sin_fix` of every angle
+pub static SIN_TABLE: LazyLock<[i16; ANGLE_STEPS]> = LazyLock::new(|| {
+    std::array::from_fn(|i| {
+        let turn = i as f64 / ANGLE_STEPS as f64;
+        let sin = (turn * std::f64::consts::TAU).sin();
+        (sin * f64::from(1 << FIX_SHIFT)).round() as i16
+    })
+});
+
+/// Square roots of `i << 8` for `i` below 256, rounded down; each fits in
+/// a byte
+pub static SQRT_TABLE: LazyLock<[u8; 256]> =
+    LazyLock::new(|| std::array::from_fn(|i| ((i as u32) << 8).isqrt() as u8));
+
+/// Sine of `angle`, in 1/256ths of a turn
+pub fn sin_fix(angle: i64) -> i64 {
+    i64::from(SIN_TABLE[(angle as usize) % ANGLE_STEPS])
+}
+
+/// Cosine of `angle`, in 1/256ths of a turn
+pub fn cos_fix(angle: i64) -> i64 {
+    sin_fix(angle.wrapping_add(ANGLE_STEPS as i64 / 4))
+}
+
+/// Square root of `x`, taken as unsigned 16-bit 8.8 fixed point
+///
+/// `x` is shifted right two bits at a time until it indexes the table, and
+/// the result shifted left one bit for each step.
+pub fn sqrt_fix(x: i64) -> i64 {
+    let mut x = x & 0xFFFF;
+    let mut shift = 0;
+    while x >= 256 {
+        x >>= 2;
+        shift += 1;
+    }
+    i64::from(SQRT_TABLE[x as usize]) << shift
+}
+
+/// Evaluate the builtin `name` on constant arguments
+pub fn eval_builtin(name: &str, args: &[i64]) -> Option<i64> {
+    match (name, args) {
+        ("sin_fix", &[angle]) => Some(sin_fix(angle)),
+        ("cos_fix", &[angle]) => Some(cos_fix(angle)),
+        ("sqrt_fix", &[x]) => Some(sqrt_fix(x)),
+        _ => None,
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_sin_cos() {
+        assert_eq!(sin_fix(0), 0);
+        assert_eq!(sin_fix(64), 256);
+        assert_eq!(sin_fix(128), 0);
+        assert_eq!(sin_fix(192), -256);
+        assert_eq!(sin_fix(32), 181);
+        assert_eq!(sin_fix(-64), -256);
+        assert_eq!(sin_fix(256 + 64), 256);
+        assert_eq!(cos_fix(0), 256);
+        assert_eq!(cos_fix(128), -256);
+    }
+
+    #[test]
+    fn test_sqrt() {
+        assert_eq!(sqrt_fix(0), 0);
+        assert_eq!(sqrt_fix(256), 256);
+        assert_eq!(sqrt_fix(4 << 8), 2 << 8);
+        assert_eq!(sqrt_fix(2 << 8), 362);
+        assert_eq!(sqrt_fix(100 << 8), 10 << 8);
+        assert_eq!(sqrt_fix(0xFFFF), 4080);
+        assert_eq!(eval_builtin("sqrt_fix", &[64]), Some(128));
+        assert_eq!(eval_builtin("sqrt_fix", &[]), None);
+    }
+}
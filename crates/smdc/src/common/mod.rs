@@ -1,7 +1,11 @@
 //! Common infrastructure shared across frontends and backends
 
 mod error;
+pub mod fixed;
 mod span;
+pub mod stats;
+mod symbol;
 
 pub use error::{CompileError, CompileResult, DiagnosticReporter};
 pub use span::{Span, byte_offset_to_line};
+pub use symbol::Symbol;
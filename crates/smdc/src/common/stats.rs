@@ -0,0 +1,426 @@
+//! Compile-time statistics (`--time-passes`, `--stats`)
+//!
+//! Phases, counters and per-function sizes are recorded into a collector
+//! belonging to the current thread, so the frontends, optimizer and backend
+//! report without a handle threaded through every call. Outside [`collect`]
+//! recording does nothing beyond checking that no collection is running.
+//! Each translation unit of a parallel build collects on its own worker;
+//! the driver merges the results.
+
+use std::cell::RefCell;
+use std::fmt::Write as _;
+use std::time::{Duration, Instant};
+
+/// Time spent in one phase, nested under the phase it ran in
+#[derive(Debug, Clone, PartialEq)]
+pub struct Phase {
+    pub name: &'static str,
+    /// Index of the enclosing phase
+    pub parent: Option<usize>,
+    pub time: Duration,
+    /// Times the phase ran
+    pub calls: u64,
+}
+
+/// Sizes of one generated function
+#[derive(Debug, Clone, Default, PartialEq, Eq)]
+pub struct FunctionStats {
+    pub name: String,
+    pub ir_insts: usize,
+    /// Temps the IR defines
+    pub temps: usize,
+    /// Of those, the ones given a stack slot
+    pub spills: usize,
+    /// Bytes the prologue reserves for locals and spills
+    pub frame_bytes: usize,
+    pub machine_insts: usize,
+    /// Code size, before the assembler shortens branches
+    pub code_bytes: usize,
+}
+
+/// Everything recorded during one [`collect`]
+#[derive(Debug, Clone, Default, PartialEq)]
+pub struct Stats {
+    /// Parents come before their children
+    pub phases: Vec<Phase>,
+    pub counters: Vec<(&'static str, u64)>,
+    pub functions: Vec<FunctionStats>,
+}
+
+struct Collector {
+    stats: Stats,
+    /// Phases currently running, innermost last
+    open: Vec<usize>,
+}
+
+thread_local! {
+    static COLLECTOR: RefCell<Option<Collector>> = const { RefCell::new(None) };
+}
+
+fn with_collector(f: impl FnOnce(&mut Collector)) {
+    COLLECTOR.with_borrow_mut(|collector| {
+        if let Some(collector) = collector {
+            f(collector);
+        }
+    });
+}
+
+/// Run `f`, recording what it reports on this thread
+pub fn collect<R>(f: impl FnOnce() -> R) -> (R, Stats) {
+    let outer = COLLECTOR.replace(Some(Collector {
+        stats: Stats::default(),
+        open: Vec::new(),
+    }));
+    let result = f();
+    let collector = COLLECTOR.replace(outer).expect("collector removed");
+    (result, collector.stats)
+}
+
+/// Whether a [`collect`] is running on this thread
+pub fn enabled() -> bool {
+    COLLECTOR.with_borrow(Option::is_some)
+}
+
+/// Run `f` as phase `name` of whatever phase is running now
+pub fn time<R>(name: &'static str, f: impl FnOnce() -> R) -> R {
+    if !enabled() {
+        return f();
+    }
+    with_collector(|c| {
+        let parent = c.open.last().copied();
+        let index = c.stats.phase(name, parent);
+        c.open.push(index);
+    });
+    let start = Instant::now();
+    let result = f();
+    let elapsed = start.elapsed();
+    with_collector(|c| {
+        if let Some(index) = c.open.pop() {
+            c.stats.phases[index].time += elapsed;
+            c.stats.phases[index].calls += 1;
+        }
+    });
+    result
+}
+
+/// Add `n` to counter `name`
+pub fn count(name: &'static str, n: u64) {
+    with_collector(|c| c.stats.add(name, n));
+}
+
+/// Record the sizes of a generated function
+pub fn function(stats: FunctionStats) {
+    with_collector(|c| c.stats.functions.push(stats));
+}
+
+/// Add what another thread collected, its phases under the one running here
+pub fn absorb(other: Stats) {
+    with_collector(|c| {
+        let parent = c.open.last().copied();
+        c.stats.merge_under(other, parent);
+    });
+}
+
+impl Stats {
+    /// Index of phase `name` under `parent`, added if it hasn't run yet
+    fn phase(&mut self, name: &'static str, parent: Option<usize>) -> usize {
+        if let Some(i) = self
+            .phases
+            .iter()
+            .position(|p| p.name == name && p.parent == parent)
+        {
+            return i;
+        }
+        self.phases.push(Phase {
+            name,
+            parent,
+            time: Duration::ZERO,
+            calls: 0,
+        });
+        self.phases.len() - 1
+    }
+
+    fn add(&mut self, name: &'static str, n: u64) {
+        match self
+            .counters
+            .iter_mut()
+            .find(|(counter, _)| *counter == name)
+        {
+            Some((_, value)) => *value += n,
+            None => self.counters.push((name, n)),
+        }
+    }
+
+    /// Value of counter `name`
+    pub fn counter(&self, name: &str) -> Option<u64> {
+        self.counters
+            .iter()
+            .find(|(counter, _)| *counter == name)
+            .map(|&(_, value)| value)
+    }
+
+    /// Total time in phases named `name`, wherever they ran
+    pub fn phase_time(&self, name: &str) -> Duration {
+        self.phases
+            .iter()
+            .filter(|p| p.name == name)
+            .map(|p| p.time)
+            .sum()
+    }
+
+    /// Add `other`'s phases, counters and functions to these. Phases with
+    /// the same path add up.
+    pub fn merge(&mut self, other: Stats) {
+        self.merge_under(other, None);
+    }
+
+    fn merge_under(&mut self, other: Stats, root: Option<usize>) {
+        let mut index = Vec::with_capacity(other.phases.len());
+        for phase in other.phases {
+            let parent = phase.parent.map_or(root, |p| Some(index[p]));
+            let i = self.phase(phase.name, parent);
+            self.phases[i].time += phase.time;
+            self.phases[i].calls += phase.calls;
+            index.push(i);
+        }
+        for (name, n) in other.counters {
+            self.add(name, n);
+        }
+        self.functions.extend(other.functions);
+    }
+
+    /// Nesting depth of each phase
+    fn depths(&self) -> Vec<usize> {
+        let mut depths: Vec<usize> = Vec::with_capacity(self.phases.len());
+        for phase in &self.phases {
+            depths.push(phase.parent.map_or(0, |p| depths[p] + 1));
+        }
+        depths
+    }
+
+    /// Phases in tree order: each followed by its children
+    fn tree_order(&self) -> Vec<usize> {
+        fn visit(stats: &Stats, parent: Option<usize>, order: &mut Vec<usize>) {
+            for (i, phase) in stats.phases.iter().enumerate() {
+                if phase.parent == parent {
+                    order.push(i);
+                    visit(stats, Some(i), order);
+                }
+            }
+        }
+        let mut order = Vec::with_capacity(self.phases.len());
+        visit(self, None, &mut order);
+        order
+    }
+
+    /// Phase timings as an indented table
+    pub fn phase_table(&self) -> String {
+        let depths = self.depths();
+        let total: Duration = self
+            .phases
+            .iter()
+            .filter(|p| p.parent.is_none())
+            .map(|p| p.time)
+            .sum();
+        let mut out = format!("{:<32} {:>12} {:>8} {:>7}\n", "phase", "time", "calls", "%");
+        for i in self.tree_order() {
+            let phase = &self.phases[i];
+            let name = format!("{:indent$}{}", "", phase.name, indent = depths[i] * 2);
+            let share = if total.is_zero() {
+                0.0
+            } else {
+                phase.time.as_secs_f64() * 100.0 / total.as_secs_f64()
+            };
+            let _ = writeln!(
+                out,
+                "{name:<32} {:>10.3}ms {:>8} {share:>6.1}%",
+                phase.time.as_secs_f64() * 1000.0,
+                phase.calls
+            );
+        }
+        out
+    }
+
+    /// Counters, then per-function sizes, as tables
+    pub fn counter_table(&self) -> String {
+        let mut out = String::new();
+        for (name, value) in &self.counters {
+            let _ = writeln!(out, "{name:<32} {value:>12}");
+        }
+        if !self.functions.is_empty() {
+            let _ = writeln!(
+                out,
+                "\n{:<32} {:>8} {:>6} {:>6} {:>6} {:>8} {:>6}",
+                "function", "ir", "temps", "spills", "frame", "insts", "bytes"
+            );
+            for f in &self.functions {
+                let _ = writeln!(
+                    out,
+                    "{:<32} {:>8} {:>6} {:>6} {:>6} {:>8} {:>6}",
+                    f.name,
+                    f.ir_insts,
+                    f.temps,
+                    f.spills,
+                    f.frame_bytes,
+                    f.machine_insts,
+                    f.code_bytes
+                );
+            }
+        }
+        out
+    }
+
+    /// Everything as one JSON object; times are in milliseconds
+    pub fn to_json(&self) -> String {
+        let depths = self.depths();
+        let mut out = String::from("{\n  \"phases\": [");
+        for (n, i) in self.tree_order().into_iter().enumerate() {
+            let phase = &self.phases[i];
+            let path = self.path(i).join("/");
+            let _ = write!(
+                out,
+                "{}\n    {{\"phase\": {}, \"depth\": {}, \"ms\": {:.3}, \"calls\": {}}}",
+                if n == 0 { "" } else { "," },
+                json_string(&path),
+                depths[i],
+                phase.time.as_secs_f64() * 1000.0,
+                phase.calls
+            );
+        }
+        out.push_str("\n  ],\n  \"counters\": {");
+        for (n, (name, value)) in self.counters.iter().enumerate() {
+            let comma = if n == 0 { "" } else { "," };
+            let _ = write!(out, "{comma}\n    {}: {value}", json_string(name));
+        }
+        out.push_str("\n  },\n  \"functions\": [");
+        for (n, f) in self.functions.iter().enumerate() {
+            let _ = write!(
+                out,
+                "{}\n    {{\"name\": {}, \"ir_insts\": {}, \"temps\": {}, \"spills\": {}, \
+                 \"frame_bytes\": {}, \"machine_insts\": {}, \"code_bytes\": {}}}",
+                if n == 0 { "" } else { "," },
+                json_string(&f.name),
+                f.ir_insts,
+                f.temps,
+                f.spills,
+                f.frame_bytes,
+                f.machine_insts,
+                f.code_bytes
+            );
+        }
+        out.push_str("\n  ]\n}\n");
+        out
+    }
+
+    /// Names from the outermost phase down to phase `i`
+    pub fn path(&self, mut i: usize) -> Vec<&'static str> {
+        let mut path = vec![self.phases[i].name];
+        while let Some(parent) = self.phases[i].parent {
+            path.push(self.phases[parent].name);
+            i = parent;
+        }
+        path.reverse();
+        path
+    }
+}
+
+fn json_string(s: &str) -> String {
+    let mut out = String::with_capacity(s.len() + 2);
+    out.push('"');
+    for c in s.chars() {
+        match c {
+            '"' => out.push_str("\\\""),
+            '\\' => out.push_str("\\\\"),
+            c if u32::from(c) < 0x20 => {
+                let _ = write!(out, "\\u{:04x}", u32::from(c));
+            }
+            c => out.push(c),
+        }
+    }
+    out.push('"');
+    out
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_nothing_recorded_outside_collect() {
+        assert!(!enabled());
+        assert_eq!(time("parse", || 7), 7);
+        count("lines", 3);
+        let ((), stats) = collect(|| {});
+        assert_eq!(stats, Stats::default());
+    }
+
+    #[test]
+    fn test_phases_nest_and_accumulate() {
+        let ((), stats) = collect(|| {
+            time("frontend", || {
+                time("parse", || {});
+                time("sema", || {});
+            });
+            time("backend", || {
+                for _ in 0..3 {
+                    time("parse", || count("insts", 2));
+                }
+            });
+        });
+        let names: Vec<_> = stats.phases.iter().map(|p| p.name).collect();
+        assert_eq!(names, ["frontend", "parse", "sema", "backend", "parse"]);
+        assert_eq!(stats.phases[1].parent, Some(0));
+        assert_eq!(stats.phases[4].parent, Some(3));
+        assert_eq!(stats.phases[4].calls, 3);
+        assert_eq!(stats.counter("insts"), Some(6));
+        assert_eq!(stats.path(4), ["backend", "parse"]);
+        assert!(!enabled());
+    }
+
+    #[test]
+    fn test_merge_matches_phases_by_path() {
+        let run = || {
+            collect(|| {
+                time("frontend", || time("parse", || count("lines", 10)));
+                function(FunctionStats {
+                    name: "main".into(),
+                    ..Default::default()
+                });
+            })
+            .1
+        };
+        let mut stats = run();
+        stats.merge(run());
+        assert_eq!(stats.phases.len(), 2);
+        assert_eq!(stats.phases[1].calls, 2);
+        assert_eq!(stats.counter("lines"), Some(20));
+        assert_eq!(stats.functions.len(), 2);
+
+        let ((), outer) = collect(|| time("build", || absorb(run())));
+        assert_eq!(outer.path(2), ["build", "frontend", "parse"]);
+    }
+
+    #[test]
+    fn test_output_formats() {
+        let ((), stats) = collect(|| {
+            time("frontend", || time("parse", || {}));
+            count("source lines", 42);
+            function(FunctionStats {
+                name: "say \"hi\"".into(),
+                ir_insts: 5,
+                code_bytes: 12,
+                ..Default::default()
+            });
+        });
+        let table = stats.phase_table();
+        assert!(table.contains("\n  parse "), "{table}");
+        assert!(stats.counter_table().contains("source lines"));
+        let json = stats.to_json();
+        assert!(
+            json.contains("\"phase\": \"frontend/parse\", \"depth\": 1"),
+            "{json}"
+        );
+        assert!(json.contains("\"source lines\": 42"), "{json}");
+        assert!(json.contains("\"name\": \"say \\\"hi\\\"\""), "{json}");
+    }
+}
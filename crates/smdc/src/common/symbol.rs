@@ -0,0 +1,177 @@
+//! Interned symbol names
+//!
+//! Labels, function names and global names are interned once into a
+//! process-wide table and passed around as `Symbol`, a copyable handle.
+//! Comparing or hashing a symbol looks at its address, never its text, so
+//! symbol tables keyed on them do no string hashing. Symbol text lives in
+//! arena chunks that are never freed.
+
+use std::collections::HashSet;
+use std::hash::{Hash, Hasher};
+use std::sync::{LazyLock, Mutex};
+
+/// Interned name
+#[derive(Clone, Copy)]
+pub struct Symbol(&'static str);
+
+/// Size of each arena chunk; longer names get a chunk of their own
+const CHUNK_SIZE: usize = 16 * 1024;
+
+struct Interner {
+    names: HashSet<&'static str>,
+    /// Unused tail of the current chunk
+    free: &'static mut [u8],
+}
+
+impl Interner {
+    fn intern(&mut self, name: &str) -> &'static str {
+        if let Some(&interned) = self.names.get(name) {
+            return interned;
+        }
+        if self.free.len() < name.len() {
+            let chunk = vec![0u8; CHUNK_SIZE.max(name.len())].into_boxed_slice();
+            self.free = Box::leak(chunk);
+        }
+        let (slot, rest) = std::mem::take(&mut self.free).split_at_mut(name.len());
+        self.free = rest;
+        slot.copy_from_slice(name.as_bytes());
+        // Copied from a str, so still valid UTF-8
+        let interned = std::str::from_utf8(slot).unwrap_or_default();
+        self.names.insert(interned);
+        interned
+    }
+}
+
+static INTERNER: LazyLock<Mutex<Interner>> = LazyLock::new(|| {
+    Mutex::new(Interner {
+        names: HashSet::new(),
+        free: &mut [],
+    })
+});
+
+impl Symbol {
+    /// The symbol for `name`
+    pub fn intern(name: &str) -> Self {
+        let mut interner = INTERNER.lock().unwrap_or_else(|e| e.into_inner());
+        Symbol(interner.intern(name))
+    }
+
+    pub fn as_str(self) -> &'static str {
+        self.0
+    }
+}
+
+impl PartialEq for Symbol {
+    fn eq(&self, other: &Self) -> bool {
+        // Every name is stored once
+        std::ptr::eq(self.0, other.0)
+    }
+}
+
+impl Eq for Symbol {}
+
+impl Hash for Symbol {
+    fn hash<H: Hasher>(&self, state: &mut H) {
+        self.0.as_ptr().hash(state);
+    }
+}
+
+impl PartialOrd for Symbol {
+    fn partial_cmp(&self, other: &Self) -> Option<std::cmp::Ordering> {
+        Some(self.cmp(other))
+    }
+}
+
+impl Ord for Symbol {
+    fn cmp(&self, other: &Self) -> std::cmp::Ordering {
+        self.0.cmp(other.0)
+    }
+}
+
+impl std::ops::Deref for Symbol {
+    type Target = str;
+
+    fn deref(&self) -> &str {
+        self.0
+    }
+}
+
+impl AsRef<str> for Symbol {
+    fn as_ref(&self) -> &str {
+        self.0
+    }
+}
+
+impl PartialEq<str> for Symbol {
+    fn eq(&self, other: &str) -> bool {
+        self.0 == other
+    }
+}
+
+impl PartialEq<&str> for Symbol {
+    fn eq(&self, other: &&str) -> bool {
+        self.0 == *other
+    }
+}
+
+impl PartialEq<String> for Symbol {
+    fn eq(&self, other: &String) -> bool {
+        self.0 == other
+    }
+}
+
+impl From<&str> for Symbol {
+    fn from(name: &str) -> Self {
+        Symbol::intern(name)
+    }
+}
+
+impl From<String> for Symbol {
+    fn from(name: String) -> Self {
+        Symbol::intern(&name)
+    }
+}
+
+impl From<&String> for Symbol {
+    fn from(name: &String) -> Self {
+        Symbol::intern(name)
+    }
+}
+
+impl From<Symbol> for String {
+    fn from(symbol: Symbol) -> Self {
+        symbol.0.to_string()
+    }
+}
+
+impl std::fmt::Display for Symbol {
+    fn fmt(&self, f: &mut std::fmt::Formatter<'_>) -> std::fmt::Result {
+        f.write_str(self.0)
+    }
+}
+
+impl std::fmt::Debug for Symbol {
+    fn fmt(&self, f: &mut std::fmt::Formatter<'_>) -> std::fmt::Result {
+        write!(f, "{:?}", self.0)
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_interning() {
+        let a = Symbol::intern("vdp_init");
+        let b = Symbol::from(String::from("vdp_init"));
+        assert_eq!(a, b);
+        assert!(std::ptr::eq(a.as_str(), b.as_str()));
+        assert_ne!(a, Symbol::intern("vdp_init2"));
+        assert_eq!(a, "vdp_init");
+        assert!(Symbol::intern(".L1") < Symbol::intern(".L2"));
+
+        let long = "x".repeat(CHUNK_SIZE + 1);
+        assert_eq!(Symbol::intern(&long).len(), CHUNK_SIZE + 1);
+        assert_eq!(Symbol::intern(""), "");
+    }
+}
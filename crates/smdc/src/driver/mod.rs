@@ -1,10 +1,12 @@
 //! Compilation driver and pipeline orchestration
 
 use crate::backend::{Backend, BackendConfig, BackendOutput, BackendRegistry};
-use crate::common::{CompileResult, DiagnosticReporter};
+use crate::common::{CompileResult, DiagnosticReporter, stats};
 use crate::frontend::{CompileContext, Frontend, FrontendConfig, FrontendRegistry};
 use crate::ir::IrModule;
 use std::path::Path;
+use std::sync::atomic::{AtomicUsize, Ordering};
+use std::thread;
 
 /// Compilation pipeline that coordinates frontends and backends
 pub struct Pipeline {
@@ -63,7 +65,7 @@ impl Pipeline {
         })?;
 
         let ctx = CompileContext::new(filename.to_string(), file_id, reporter);
-        frontend.compile(source, &ctx, config)
+        stats::time("frontend", || frontend.compile(source, &ctx, config))
     }
 
     /// Generate output using the specified backend
@@ -78,7 +80,7 @@ impl Pipeline {
             crate::common::CompileError::backend(format!("backend not found: {backend_name}"))
         })?;
 
-        backend.generate(module, ctx, config)
+        stats::time("backend", || backend.generate(module, ctx, config))
     }
 }
 
@@ -87,3 +89,111 @@ impl Default for Pipeline {
         Self::new()
     }
 }
+
+/// Number of worker threads to use: `jobs`, or one per host core for 0
+pub fn job_count(jobs: usize) -> usize {
+    if jobs > 0 {
+        jobs
+    } else {
+        thread::available_parallelism().map_or(1, |n| n.get())
+    }
+}
+
+/// Apply `f` to every item on up to `jobs` threads, for compiling
+/// translation units in parallel. Results come back in item order.
+pub fn parallel_map<T, R, F>(items: &[T], jobs: usize, f: F) -> Vec<R>
+where
+    T: Sync,
+    R: Send,
+    F: Fn(&T) -> R + Sync,
+{
+    let workers = jobs.clamp(1, items.len().max(1));
+    if workers == 1 {
+        return items.iter().map(f).collect();
+    }
+
+    // Each worker takes the next unclaimed item until none are left
+    let next = AtomicUsize::new(0);
+    let mut results: Vec<(usize, R)> = thread::scope(|scope| {
+        let handles: Vec<_> = (0..workers)
+            .map(|_| {
+                scope.spawn(|| {
+                    let mut done = Vec::new();
+                    loop {
+                        let i = next.fetch_add(1, Ordering::Relaxed);
+                        let Some(item) = items.get(i) else {
+                            return done;
+                        };
+                        done.push((i, f(item)));
+                    }
+                })
+            })
+            .collect();
+        handles
+            .into_iter()
+            .flat_map(|h| h.join().expect("compile worker panicked"))
+            .collect()
+    });
+    results.sort_by_key(|&(i, _)| i);
+    results.into_iter().map(|(_, r)| r).collect()
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_parallel_map_keeps_order() {
+        let items: Vec<u32> = (0..100).collect();
+        let squares = parallel_map(&items, 4, |&n| n * n);
+        assert_eq!(squares, items.iter().map(|n| n * n).collect::<Vec<_>>());
+        assert_eq!(parallel_map(&items[..0], 4, |&n| n), Vec::<u32>::new());
+    }
+
+    #[test]
+    fn test_pipeline_reports_stats() {
+        use crate::backend::{OutputFormat, RomBackend};
+        use crate::frontend::CFrontend;
+
+        let mut pipeline = Pipeline::new();
+        pipeline.register_frontend(Box::new(CFrontend::new()));
+        pipeline.register_backend(Box::new(RomBackend::new()));
+        let source = "int total;\nint main(void) { for (int i = 0; i < 4; i++) { total += i; } return 0; }\n";
+        let mut reporter = DiagnosticReporter::new();
+        let file_id = reporter.add_file("main.c", source);
+        let config = BackendConfig {
+            output_format: OutputFormat::Binary,
+            ..Default::default()
+        };
+
+        let (rom, stats) = stats::collect(|| {
+            let frontend_config = FrontendConfig::default();
+            let module = pipeline
+                .compile_source(source, "main.c", None, &frontend_config, &reporter, file_id)
+                .unwrap();
+            let ctx = CompileContext::new("main.c".to_string(), file_id, &reporter);
+            pipeline
+                .generate_output(&module, &ctx, "rom", &config)
+                .unwrap()
+        });
+        assert!(rom.as_binary().is_some());
+        let paths: Vec<_> = (0..stats.phases.len())
+            .map(|i| stats.path(i).join("/"))
+            .collect();
+        for path in [
+            "frontend/parse",
+            "frontend/lower",
+            "backend/codegen/regalloc",
+            "backend/assemble/encode",
+        ] {
+            assert!(
+                paths.iter().any(|p| p == path),
+                "{path} missing from {paths:?}"
+            );
+        }
+        assert_eq!(stats.counter("source lines"), Some(2));
+        assert!(stats.counter("image bytes").unwrap() > 0);
+        let main = stats.functions.iter().find(|f| f.name == "main").unwrap();
+        assert!(main.ir_insts > 0 && main.code_bytes > 0);
+    }
+}
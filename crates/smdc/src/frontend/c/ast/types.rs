@@ -115,6 +115,15 @@ impl CType {
         matches!(self.kind, TypeKind::Array { .. })
     }
 
+    /// Check if objects of this type are read-only: const-qualified, or an
+    /// array of const elements
+    pub fn is_const(&self) -> bool {
+        match &self.kind {
+            TypeKind::Array { element, .. } => self.qualifiers.is_const || element.is_const(),
+            _ => self.qualifiers.is_const,
+        }
+    }
+
     /// Check if this type is void
     pub fn is_void(&self) -> bool {
         matches!(self.kind, TypeKind::Void)
@@ -15,7 +15,8 @@ pub mod sema;
 
 use std::path::Path;
 
-use crate::common::{CompileError, CompileResult};
+use crate::cache::{self, BuildCache};
+use crate::common::{CompileError, CompileResult, stats};
 use crate::frontend::{CompileContext, Frontend, FrontendConfig};
 use crate::ir::IrModule;
 
@@ -48,6 +49,42 @@ impl Frontend for CFrontend {
         &[".c", ".h"]
     }
 
+    fn preprocess(
+        &self,
+        source: &str,
+        ctx: &CompileContext,
+        config: &FrontendConfig,
+    ) -> CompileResult<String> {
+        let source_path = Path::new(&ctx.filename);
+        let Some(dir) = &config.cache_dir else {
+            return preprocessor::preprocess(source, source_path, config.include_paths.clone());
+        };
+
+        // Keyed by the source and where headers are searched for; the
+        // headers themselves are checked through the manifest
+        let cache = BuildCache::new(dir);
+        let mut hasher = cache::key_hasher("preprocessed");
+        hasher.str(&ctx.filename).str(source);
+        for path in &config.include_paths {
+            hasher.str(&path.display().to_string());
+        }
+        let base = hasher.finish();
+        if let Some(text) = cache
+            .get_with_deps(base)
+            .and_then(|b| String::from_utf8(b).ok())
+        {
+            return Ok(text);
+        }
+
+        let mut pp = preprocessor::Preprocessor::new(config.include_paths.clone());
+        let text = pp.process(source, source_path)?;
+        if !pp.uses_clock() {
+            // A full or read-only cache only costs the speedup
+            let _ = cache.put_with_deps(base, pp.dependencies(), text.as_bytes());
+        }
+        Ok(text)
+    }
+
     fn compile(
         &self,
         source: &str,
@@ -55,20 +92,28 @@ impl Frontend for CFrontend {
         config: &FrontendConfig,
     ) -> CompileResult<IrModule> {
         // Phase 0: Preprocessing (#include expansion)
-        let source_path = Path::new(&ctx.filename);
         if config.verbose {
             eprintln!("Preprocessing...");
         }
         let processed_source =
-            match preprocessor::preprocess(source, source_path, config.include_paths.clone()) {
+            match stats::time("preprocess", || self.preprocess(source, ctx, config)) {
                 Ok(s) => s,
                 Err(e) => {
                     ctx.reporter.report_error(ctx.file_id, &e);
                     return Err(e);
                 }
             };
+        self.compile_preprocessed(&processed_source, ctx, config)
+    }
 
-        let source = &processed_source;
+    fn compile_preprocessed(
+        &self,
+        source: &str,
+        ctx: &CompileContext,
+        config: &FrontendConfig,
+    ) -> CompileResult<IrModule> {
+        stats::count("source bytes", source.len() as u64);
+        stats::count("source lines", source.lines().count() as u64);
 
         // Phase 1: Lexing (optional token dump)
         if config.dump_tokens {
@@ -88,20 +133,24 @@ impl Frontend for CFrontend {
             }
         }
 
-        // Phase 2: Parsing
+        // Phase 2: Parsing, lexing on demand
         if config.verbose {
             eprintln!("Parsing C...");
         }
 
-        let mut parser = match Parser::new(source) {
-            Ok(p) => p,
+        let parsed = stats::time("parse", || {
+            let mut parser = Parser::new(source)?;
+            Ok::<_, CompileError>(parser.parse())
+        });
+        let parsed = match parsed {
+            Ok(parsed) => parsed,
             Err(e) => {
                 ctx.reporter.report_error(ctx.file_id, &e);
                 return Err(e);
             }
         };
 
-        let mut ast = match parser.parse() {
+        let mut ast = match parsed {
             Ok(ast) => ast,
             Err(e) => {
                 ctx.reporter.report_error(ctx.file_id, &e);
@@ -124,7 +173,7 @@ impl Frontend for CFrontend {
         }
 
         let mut analyzer = SemanticAnalyzer::new();
-        if let Err(e) = analyzer.analyze(&mut ast) {
+        if let Err(e) = stats::time("sema", || analyzer.analyze(&mut ast)) {
             ctx.reporter.report_error(ctx.file_id, &e);
             return Err(e);
         }
@@ -135,7 +184,7 @@ impl Frontend for CFrontend {
         }
 
         let mut ir_builder = crate::ir::IrBuilder::new();
-        let mut ir_module = match ir_builder.build(&ast) {
+        let mut ir_module = match stats::time("lower", || ir_builder.build(&ast)) {
             Ok(m) => m,
             Err(e) => {
                 ctx.reporter.report_error(ctx.file_id, &e);
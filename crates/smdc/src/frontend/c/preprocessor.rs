@@ -13,9 +13,11 @@
 //! - `#` (stringification) and `##` (token pasting) in macro bodies
 //! - Predefined macros: __FILE__, __LINE__, __DATE__, __TIME__, __STDC__
 
+use std::borrow::Cow;
 use std::collections::HashMap;
 use std::fs;
 use std::path::{Path, PathBuf};
+use std::rc::Rc;
 
 use crate::common::{CompileError, CompileResult, Span};
 
@@ -59,6 +61,10 @@ pub struct Preprocessor {
     date_str: String,
     /// Time string for __TIME__
     time_str: String,
+    /// Every file read through `#include`, in order
+    dependencies: Vec<PathBuf>,
+    /// Whether the source or a header mentions __DATE__ or __TIME__
+    uses_clock: bool,
 }
 
 impl Preprocessor {
@@ -97,6 +103,8 @@ impl Preprocessor {
             macros: HashMap::new(),
             date_str,
             time_str,
+            dependencies: Vec::new(),
+            uses_clock: false,
         };
 
         // Register predefined macros
@@ -168,6 +176,8 @@ impl Preprocessor {
             pushed_root = true;
         }
 
+        self.note_clock_use(source);
+
         // Phase 1: Replace trigraphs (C89 feature)
         let trigraph_replaced = Self::replace_trigraphs(source);
 
@@ -195,6 +205,20 @@ impl Preprocessor {
         Ok(expanded)
     }
 
+    /// Files read through `#include` by `process`, so far
+    pub fn dependencies(&self) -> &[PathBuf] {
+        &self.dependencies
+    }
+
+    /// Whether the output depends on when it was produced
+    pub fn uses_clock(&self) -> bool {
+        self.uses_clock
+    }
+
+    fn note_clock_use(&mut self, text: &str) {
+        self.uses_clock |= text.contains("__DATE__") || text.contains("__TIME__");
+    }
+
     /// Replace comments with spaces (preserving newlines for line counting)
     /// Both C89 block comments /* */ and C99 line comments // are handled
     fn strip_comments(source: &str) -> String {
@@ -950,255 +974,26 @@ impl Preprocessor {
     }
 
     /// Expand all macros in the source
+    ///
+    /// One pass over the source: a macro's replacement is rescanned ahead
+    /// of the rest of the input, and tokens carry the names of the macros
+    /// they came out of so a macro never expands inside itself.
     fn expand_macros(&self, source: &str) -> String {
-        let mut result = source.to_string();
-
-        // Keep expanding until no more expansions possible
-        let mut changed = true;
-        let mut iterations = 0;
-        const MAX_ITERATIONS: usize = 100;
-
-        while changed && iterations < MAX_ITERATIONS {
-            changed = false;
-            iterations += 1;
-
-            let mut new_result = String::with_capacity(result.len());
-            let mut chars = result.chars().peekable();
-            let mut logical_line = 1usize;
-            let mut current_file = self.current_file.clone();
-            let mut at_line_start = true;
-
-            while let Some(c) = chars.next() {
-                if at_line_start && c == '#' {
-                    let mut directive = String::new();
-                    directive.push(c);
-                    while let Some(next) = chars.peek().copied() {
-                        directive.push(chars.next().unwrap());
-                        if next == '\n' {
-                            break;
-                        }
-                    }
-
-                    if let Some((new_line, new_file)) = parse_line_directive(&directive) {
-                        logical_line = new_line;
-                        if let Some(file) = new_file {
-                            current_file = file;
-                        }
-                        if directive.ends_with('\n') {
-                            new_result.push('\n');
-                            at_line_start = true;
-                        } else {
-                            at_line_start = false;
-                        }
-                        continue;
-                    }
-
-                    new_result.push_str(&directive);
-                    if directive.ends_with('\n') {
-                        logical_line += 1;
-                        at_line_start = true;
-                    } else {
-                        at_line_start = false;
-                    }
-                    continue;
-                }
-
-                if c == '\n' {
-                    logical_line += 1;
-                    new_result.push(c);
-                    at_line_start = true;
-                    continue;
-                }
-
-                // Check for start of identifier
-                if c.is_alphabetic() || c == '_' {
-                    let mut ident = String::new();
-                    ident.push(c);
-
-                    // Collect rest of identifier
-                    while let Some(&next) = chars.peek() {
-                        if next.is_alphanumeric() || next == '_' {
-                            ident.push(chars.next().unwrap());
-                        } else {
-                            break;
-                        }
-                    }
-
-                    // Check if it's a macro
-                    if let Some(mac) = self.macros.get(&ident) {
-                        // Handle predefined macros
-                        if mac.is_predefined {
-                            let expansion = match ident.as_str() {
-                                "__FILE__" => format!("\"{}\"", current_file.display()),
-                                "__LINE__" => format!("{logical_line}"),
-                                "__DATE__" => self.date_str.clone(),
-                                "__TIME__" => self.time_str.clone(),
-                                _ => ident.clone(),
-                            };
-                            new_result.push_str(&expansion);
-                            changed = true;
-                            at_line_start = false;
-                            continue;
-                        }
-
-                        if let Some(ref params) = mac.params {
-                            // Function-like macro - look for arguments
-                            // Skip whitespace
-                            while let Some(&next) = chars.peek() {
-                                if next.is_whitespace() && next != '\n' {
-                                    chars.next();
-                                } else {
-                                    break;
-                                }
-                            }
+        let mut result = String::with_capacity(source.len());
+        let mut expander = MacroExpander::new(self, source);
 
-                            if chars.peek() == Some(&'(') {
-                                chars.next(); // consume '('
-
-                                // Parse arguments
-                                let mut args: Vec<String> = vec![];
-                                let mut current_arg = String::new();
-                                let mut paren_depth = 1;
-
-                                for c in chars.by_ref() {
-                                    match c {
-                                        '(' => {
-                                            paren_depth += 1;
-                                            current_arg.push(c);
-                                        }
-                                        ')' => {
-                                            paren_depth -= 1;
-                                            if paren_depth == 0 {
-                                                args.push(current_arg.trim().to_string());
-                                                break;
-                                            }
-                                            current_arg.push(c);
-                                        }
-                                        ',' if paren_depth == 1 => {
-                                            args.push(current_arg.trim().to_string());
-                                            current_arg = String::new();
-                                        }
-                                        _ => current_arg.push(c),
-                                    }
-                                }
-
-                                // Process stringification and token pasting first
-                                let mut expanded = mac.body.clone();
-
-                                // Handle # (stringification)
-                                for (i, param) in params.iter().enumerate() {
-                                    if let Some(arg) = args.get(i) {
-                                        let pattern = format!("#{param}");
-                                        let stringified = format!("\"{arg}\"");
-                                        expanded = expanded.replace(&pattern, &stringified);
-                                    }
-                                }
-
-                                // Handle ## (token pasting)
-                                for (i, param) in params.iter().enumerate() {
-                                    if let Some(arg) = args.get(i) {
-                                        // Pattern: identifier ## param
-                                        let pattern = format!(" ## {param}");
-                                        expanded = expanded.replace(&pattern, arg);
-                                        let pattern = format!("## {param}");
-                                        expanded = expanded.replace(&pattern, arg);
-                                        // Pattern: param ## identifier
-                                        let pattern = format!("{param} ##");
-                                        expanded = expanded.replace(&pattern, arg);
-                                        let pattern = format!("{param}##");
-                                        expanded = expanded.replace(&pattern, arg);
-                                    }
-                                }
-
-                                // Remove remaining ## (for cases where both sides were substituted)
-                                expanded = expanded.replace(" ## ", "");
-                                expanded = expanded.replace("## ", "");
-                                expanded = expanded.replace(" ##", "");
-                                expanded = expanded.replace("##", "");
-
-                                // Substitute parameters
-                                for (i, param) in params.iter().enumerate() {
-                                    if let Some(arg) = args.get(i) {
-                                        expanded = replace_identifier(&expanded, param, arg);
-                                    }
-                                }
-
-                                new_result.push_str(&expanded);
-                                changed = true;
-                                at_line_start = false;
-                            } else {
-                                // No arguments - not a macro invocation
-                                new_result.push_str(&ident);
-                                at_line_start = false;
-                            }
-                        } else {
-                            // Object-like macro
-                            if !mac.body.is_empty() {
-                                new_result.push_str(&mac.body);
-                                changed = true;
-                            } else {
-                                // Empty body - just remove the identifier
-                                changed = true;
-                            }
-                            at_line_start = false;
-                        }
-                    } else {
-                        // Not a macro
-                        new_result.push_str(&ident);
-                        at_line_start = false;
-                    }
-                } else if c == '/' && chars.peek() == Some(&'*') {
-                    // Skip block comments
-                    new_result.push(c);
-                    new_result.push(chars.next().unwrap());
-                    let mut saw_newline = false;
-                    while let Some(c) = chars.next() {
-                        if c == '\n' {
-                            logical_line += 1;
-                            saw_newline = true;
-                        }
-                        new_result.push(c);
-                        if c == '*' && chars.peek() == Some(&'/') {
-                            new_result.push(chars.next().unwrap());
-                            break;
-                        }
-                    }
-                    at_line_start = saw_newline;
-                } else if c == '/' && chars.peek() == Some(&'/') {
-                    // Skip line comments
-                    new_result.push(c);
-                    let mut ended_with_newline = false;
-                    for c in chars.by_ref() {
-                        new_result.push(c);
-                        if c == '\n' {
-                            logical_line += 1;
-                            ended_with_newline = true;
-                            break;
-                        }
-                    }
-                    at_line_start = ended_with_newline;
-                } else if c == '"' || c == '\'' {
-                    // Skip string/char literals
-                    let quote = c;
-                    new_result.push(c);
-                    while let Some(c) = chars.next() {
-                        new_result.push(c);
-                        if c == '\\' {
-                            if let Some(escaped) = chars.next() {
-                                new_result.push(escaped);
-                            }
-                        } else if c == quote {
-                            break;
-                        }
-                    }
-                    at_line_start = false;
-                } else {
-                    new_result.push(c);
-                    at_line_start = false;
+        while let Some(token) = expander.next_expanded() {
+            if token.kind == PpKind::Directive
+                && let Some((line, file)) = parse_line_directive(&token.text)
+            {
+                // The directive's own newline brings the count to `line`
+                expander.line = line.saturating_sub(1);
+                if let Some(file) = file {
+                    expander.file = Cow::Owned(file);
                 }
+                continue;
             }
-
-            result = new_result;
+            result.push_str(&token.text);
         }
 
         result
@@ -1300,6 +1095,11 @@ impl Preprocessor {
             )
         })?;
 
+        if !self.dependencies.contains(&canonical) {
+            self.dependencies.push(canonical.clone());
+        }
+        self.note_clock_use(&content);
+
         // Save current state
         let saved_dir = self.current_dir.clone();
         let saved_file = self.current_file.clone();
@@ -1336,35 +1136,456 @@ fn parse_line_directive(line: &str) -> Option<(usize, Option<PathBuf>)> {
     Some((line_num, file))
 }
 
-/// Replace identifier occurrences (not inside other identifiers)
-fn replace_identifier(text: &str, from: &str, to: &str) -> String {
-    let mut result = String::with_capacity(text.len());
-    let mut chars = text.chars().peekable();
+/// Kind of preprocessing token
+#[derive(Clone, Copy, Debug, PartialEq, Eq)]
+enum PpKind {
+    Ident,
+    /// Run of spaces and tabs
+    Space,
+    Newline,
+    /// Directive line left for this phase (`#line`), without its newline
+    Directive,
+    /// Number, literal, comment or punctuator
+    Other,
+}
+
+/// Names of the macros a token was produced by, which it may not expand
+type HideSet<'a> = Option<Rc<Vec<&'a str>>>;
 
-    while let Some(c) = chars.next() {
-        if c.is_alphabetic() || c == '_' {
-            let mut ident = String::new();
-            ident.push(c);
+/// Preprocessing token
+#[derive(Clone, Debug)]
+struct PpToken<'a> {
+    kind: PpKind,
+    text: Cow<'a, str>,
+    hide: HideSet<'a>,
+}
 
-            while let Some(&next) = chars.peek() {
-                if next.is_alphanumeric() || next == '_' {
-                    ident.push(chars.next().unwrap());
+impl<'a> PpToken<'a> {
+    fn new(kind: PpKind, text: impl Into<Cow<'a, str>>) -> Self {
+        Self {
+            kind,
+            text: text.into(),
+            hide: None,
+        }
+    }
+
+    fn is_space(&self) -> bool {
+        matches!(self.kind, PpKind::Space | PpKind::Newline)
+    }
+}
+
+fn is_hidden(hide: &HideSet, name: &str) -> bool {
+    hide.as_ref().is_some_and(|h| h.contains(&name))
+}
+
+fn hide_union<'a>(a: &HideSet<'a>, b: &HideSet<'a>) -> HideSet<'a> {
+    match (a, b) {
+        (None, x) | (x, None) => x.clone(),
+        (Some(x), Some(y)) if Rc::ptr_eq(x, y) || y.iter().all(|n| x.contains(n)) => a.clone(),
+        (Some(x), Some(y)) => {
+            let mut names = (**x).clone();
+            names.extend(y.iter().filter(|n| !x.contains(n)));
+            Some(Rc::new(names))
+        }
+    }
+}
+
+fn hide_intersection<'a>(a: &HideSet<'a>, b: &HideSet<'a>) -> HideSet<'a> {
+    let (Some(x), Some(y)) = (a, b) else {
+        return None;
+    };
+    let names: Vec<_> = x.iter().filter(|n| y.contains(n)).copied().collect();
+    (!names.is_empty()).then(|| Rc::new(names))
+}
+
+/// Kind and byte length of the token at the start of `text`
+fn lex_pp_token(text: &str, at_line_start: bool) -> (PpKind, usize) {
+    let bytes = text.as_bytes();
+    let Some(c) = text.chars().next() else {
+        return (PpKind::Other, 0);
+    };
+    let run = |from: usize, pred: &dyn Fn(char) -> bool| {
+        text[from..]
+            .find(|c| !pred(c))
+            .map_or(text.len(), |n| from + n)
+    };
+
+    match c {
+        '\n' => (PpKind::Newline, 1),
+        '#' if at_line_start => (PpKind::Directive, text.find('\n').unwrap_or(text.len())),
+        c if c.is_whitespace() => (
+            PpKind::Space,
+            run(0, &|c: char| c.is_whitespace() && c != '\n'),
+        ),
+        c if c.is_alphabetic() || c == '_' => (
+            PpKind::Ident,
+            run(0, &|c: char| c.is_alphanumeric() || c == '_'),
+        ),
+        '0'..='9' | '.' if c != '.' || bytes.get(1).is_some_and(u8::is_ascii_digit) => {
+            // pp-number, so the `x1F` of `0x1F` is not taken for a name
+            let mut end = 1;
+            while let Some(&b) = bytes.get(end) {
+                let exponent_sign =
+                    matches!(b, b'+' | b'-') && matches!(bytes[end - 1], b'e' | b'E' | b'p' | b'P');
+                if b.is_ascii_alphanumeric() || b == b'_' || b == b'.' || exponent_sign {
+                    end += 1;
                 } else {
                     break;
                 }
             }
+            (PpKind::Other, end)
+        }
+        '"' | '\'' => {
+            let mut end = 1;
+            while let Some(&b) = bytes.get(end) {
+                end += 1;
+                match b {
+                    b'\\' => end += 1,
+                    b'\n' => {
+                        // Unterminated; leave the newline to be counted
+                        end -= 1;
+                        break;
+                    }
+                    _ if b == c as u8 => break,
+                    _ => {}
+                }
+            }
+            (PpKind::Other, end.min(text.len()))
+        }
+        '/' if bytes.get(1) == Some(&b'*') => (
+            PpKind::Other,
+            text[2..].find("*/").map_or(text.len(), |n| n + 4),
+        ),
+        '/' if bytes.get(1) == Some(&b'/') => {
+            (PpKind::Other, text.find('\n').unwrap_or(text.len()))
+        }
+        '#' if bytes.get(1) == Some(&b'#') => (PpKind::Other, 2),
+        c => (PpKind::Other, c.len_utf8()),
+    }
+}
 
-            if ident == from {
-                result.push_str(to);
-            } else {
-                result.push_str(&ident);
+/// Tokens of a macro body
+fn tokenize_body(body: &str) -> Vec<PpToken<'_>> {
+    let mut tokens = Vec::new();
+    let mut rest = body;
+    while !rest.is_empty() {
+        let (kind, len) = lex_pp_token(rest, false);
+        tokens.push(PpToken::new(kind, &rest[..len]));
+        rest = &rest[len..];
+    }
+    tokens
+}
+
+/// The `#` operator: a macro argument as a string literal
+fn stringize<'a>(arg: &[PpToken<'a>]) -> PpToken<'a> {
+    let mut text = String::from("\"");
+    let mut space = false;
+    for token in arg {
+        if token.is_space() {
+            space = true;
+            continue;
+        }
+        if std::mem::take(&mut space) {
+            text.push(' ');
+        }
+        if token.text.starts_with(['"', '\'']) {
+            for c in token.text.chars() {
+                if c == '"' || c == '\\' {
+                    text.push('\\');
+                }
+                text.push(c);
             }
         } else {
-            result.push(c);
+            text.push_str(&token.text);
+        }
+    }
+    text.push('"');
+    PpToken::new(PpKind::Other, text)
+}
+
+/// The `##` operator: two tokens joined into one
+fn paste<'a>(left: &PpToken<'a>, right: &PpToken<'a>) -> PpToken<'a> {
+    let text = format!("{}{}", left.text, right.text);
+    let (kind, len) = lex_pp_token(&text, false);
+    let kind = if len == text.len() {
+        kind
+    } else {
+        PpKind::Other
+    };
+    PpToken {
+        kind,
+        text: Cow::Owned(text),
+        hide: hide_union(&left.hide, &right.hide),
+    }
+}
+
+/// Drop leading and trailing whitespace from a macro argument
+fn trim_tokens(mut tokens: Vec<PpToken<'_>>) -> Vec<PpToken<'_>> {
+    while tokens.last().is_some_and(PpToken::is_space) {
+        tokens.pop();
+    }
+    let lead = tokens.iter().take_while(|t| t.is_space()).count();
+    tokens.drain(..lead);
+    tokens
+}
+
+/// Token-stream macro expander
+struct MacroExpander<'a> {
+    pp: &'a Preprocessor,
+    /// Input not yet read
+    source: &'a str,
+    at_line_start: bool,
+    /// Tokens to read before the rest of the source, last first
+    pending: Vec<PpToken<'a>>,
+    /// Source newlines inside macro arguments, written after the expansion
+    deferred_newlines: usize,
+    /// Presumed line and file, for __LINE__ and __FILE__
+    line: usize,
+    file: Cow<'a, Path>,
+}
+
+impl<'a> MacroExpander<'a> {
+    fn new(pp: &'a Preprocessor, source: &'a str) -> Self {
+        Self {
+            pp,
+            source,
+            at_line_start: true,
+            pending: Vec::new(),
+            deferred_newlines: 0,
+            line: 1,
+            file: Cow::Borrowed(&pp.current_file),
+        }
+    }
+
+    /// Next token of the source itself
+    fn lex(&mut self) -> Option<PpToken<'a>> {
+        if self.source.is_empty() {
+            return None;
+        }
+        let (kind, len) = lex_pp_token(self.source, self.at_line_start);
+        let (text, rest) = self.source.split_at(len);
+        self.source = rest;
+        self.at_line_start = kind == PpKind::Newline;
+        if kind == PpKind::Newline {
+            self.line += 1;
+        }
+        Some(PpToken::new(kind, text))
+    }
+
+    /// Next token, before expansion
+    fn next_token(&mut self) -> Option<PpToken<'a>> {
+        if let Some(token) = self.pending.pop() {
+            return Some(token);
+        }
+        if self.deferred_newlines > 0 {
+            self.deferred_newlines -= 1;
+            return Some(PpToken::new(PpKind::Newline, "\n"));
         }
+        self.lex()
     }
 
-    result
+    /// Next token that is not a macro invocation
+    fn next_expanded(&mut self) -> Option<PpToken<'a>> {
+        loop {
+            let token = self.next_token()?;
+            if token.kind == PpKind::Ident
+                && let Some(expansion) = self.expand(&token)
+            {
+                self.pending.extend(expansion.into_iter().rev());
+                continue;
+            }
+            return Some(token);
+        }
+    }
+
+    /// The replacement for `token`, if it names a macro it may invoke
+    fn expand(&mut self, token: &PpToken<'a>) -> Option<Vec<PpToken<'a>>> {
+        let (name, mac) = self.pp.macros.get_key_value(token.text.as_ref())?;
+        let name = name.as_str();
+        if is_hidden(&token.hide, name) {
+            return None;
+        }
+
+        if mac.is_predefined {
+            let text = match name {
+                "__FILE__" => format!("\"{}\"", self.file.display()),
+                "__LINE__" => self.line.to_string(),
+                "__DATE__" => self.pp.date_str.clone(),
+                "__TIME__" => self.pp.time_str.clone(),
+                _ => return None,
+            };
+            return Some(vec![PpToken::new(PpKind::Other, text)]);
+        }
+
+        let Some(params) = &mac.params else {
+            let hide = hide_union(&token.hide, &Some(Rc::new(vec![name])));
+            return Some(self.substitute(&mac.body, None, &[], &hide));
+        };
+
+        // A function-like macro name without arguments is just a name
+        if !self.lparen_follows() {
+            return None;
+        }
+        let (args, rparen_hide) = self.collect_args();
+        let hide = hide_union(
+            &hide_intersection(&token.hide, &rparen_hide),
+            &Some(Rc::new(vec![name])),
+        );
+        Some(self.substitute(&mac.body, Some(params), &args, &hide))
+    }
+
+    fn lparen_follows(&self) -> bool {
+        match self.pending.iter().rev().find(|t| !t.is_space()) {
+            Some(token) => token.text == "(",
+            None => self.source.trim_start().starts_with('('),
+        }
+    }
+
+    /// Arguments of an invocation, up to and including its `)`, and the
+    /// hide set of that `)`
+    fn collect_args(&mut self) -> (Vec<Vec<PpToken<'a>>>, HideSet<'a>) {
+        let mut args = vec![Vec::new()];
+        let mut depth = 0usize;
+        let mut started = false;
+
+        while let Some(mut token) = self.pending.pop().or_else(|| self.lex()) {
+            if token.kind == PpKind::Newline {
+                self.deferred_newlines += 1;
+                token = PpToken::new(PpKind::Space, " ");
+            }
+            if !started {
+                started = token.text == "(";
+                continue;
+            }
+            match token.text.as_ref() {
+                "(" => depth += 1,
+                ")" if depth == 0 => {
+                    return (args.into_iter().map(trim_tokens).collect(), token.hide);
+                }
+                ")" => depth -= 1,
+                "," if depth == 0 => {
+                    args.push(Vec::new());
+                    continue;
+                }
+                _ => {}
+            }
+            if let Some(arg) = args.last_mut() {
+                arg.push(token);
+            }
+        }
+
+        // Unterminated: take what there is
+        (args.into_iter().map(trim_tokens).collect(), None)
+    }
+
+    /// A macro argument, fully expanded on its own
+    fn expand_arg(&self, arg: &[PpToken<'a>]) -> Vec<PpToken<'a>> {
+        let mut expander = MacroExpander {
+            pp: self.pp,
+            source: "",
+            at_line_start: false,
+            pending: arg.iter().rev().cloned().collect(),
+            deferred_newlines: 0,
+            line: self.line,
+            file: self.file.clone(),
+        };
+        let mut tokens = Vec::with_capacity(arg.len());
+        while let Some(token) = expander.next_expanded() {
+            tokens.push(token);
+        }
+        tokens
+    }
+
+    /// A macro body with its parameters replaced and `#` and `##` applied,
+    /// each token marked with `hide`
+    fn substitute(
+        &self,
+        body: &'a str,
+        params: Option<&[String]>,
+        args: &[Vec<PpToken<'a>>],
+        hide: &HideSet<'a>,
+    ) -> Vec<PpToken<'a>> {
+        let body = tokenize_body(body);
+        let params = params.unwrap_or_default();
+        let param = |t: &PpToken| {
+            (t.kind == PpKind::Ident)
+                .then(|| params.iter().position(|p| *p == t.text))
+                .flatten()
+        };
+        let arg = |i: usize| args.get(i).map_or(&[][..], Vec::as_slice);
+        let next_solid = |from: usize| (from..body.len()).find(|&j| !body[j].is_space());
+
+        let mut expanded_args: Vec<Option<Vec<PpToken<'a>>>> = vec![None; params.len()];
+        let mut out: Vec<PpToken<'a>> = Vec::with_capacity(body.len());
+        // Whether the left operand of a `##` came out empty
+        let mut left_empty = false;
+        let mut i = 0;
+
+        while i < body.len() {
+            let token = &body[i];
+            let operand = next_solid(i + 1);
+
+            if token.text == "#"
+                && !params.is_empty()
+                && let Some(p) = operand.and_then(|j| param(&body[j]))
+            {
+                out.push(stringize(arg(p)));
+                left_empty = false;
+                i = operand.map_or(body.len(), |j| j + 1);
+                continue;
+            }
+
+            if token.text == "##"
+                && let Some(j) = operand
+            {
+                while out.last().is_some_and(PpToken::is_space) {
+                    out.pop();
+                }
+                let right = match param(&body[j]) {
+                    Some(p) => arg(p).to_vec(),
+                    None => vec![body[j].clone()],
+                };
+                let mut right = right.into_iter();
+                if let Some(first) = right.next() {
+                    let joined = match out.pop() {
+                        Some(left) if !left_empty => paste(&left, &first),
+                        Some(left) => {
+                            out.push(left);
+                            first
+                        }
+                        None => first,
+                    };
+                    out.push(joined);
+                    left_empty = false;
+                }
+                out.extend(right);
+                i = j + 1;
+                continue;
+            }
+
+            if let Some(p) = param(token) {
+                if operand.is_some_and(|j| body[j].text == "##") {
+                    out.extend_from_slice(arg(p));
+                    left_empty = arg(p).is_empty();
+                } else {
+                    let expanded = expanded_args[p].get_or_insert_with(|| self.expand_arg(arg(p)));
+                    out.extend_from_slice(expanded);
+                    left_empty = false;
+                }
+                i += 1;
+                continue;
+            }
+
+            out.push(token.clone());
+            left_empty = false;
+            i += 1;
+        }
+
+        for token in &mut out {
+            token.hide = hide_union(&token.hide, hide);
+        }
+        out
+    }
 }
 
 /// Convenience function to preprocess source with default SDK include path
@@ -1460,6 +1681,41 @@ mod tests {
         assert!(result.contains("\"hello\""));
     }
 
+    #[test]
+    fn test_self_reference_expands_once() {
+        let source = "#define foo foo + 1\n#define f(x) x * f(x)\nint a = foo;\nint b = f(f(2));";
+        let mut pp = Preprocessor::new(vec![]);
+        let result = pp.process(source, Path::new("test.c")).unwrap();
+        assert!(result.contains("int a = foo + 1;"));
+        assert!(result.contains("int b = 2 * f(2) * f(2 * f(2));"));
+    }
+
+    #[test]
+    fn test_token_pasting() {
+        let source = "#define REG(n) VDP_REG_ ## n\n#define CAT(a, b) a##b\n#define VDP_REG_MODE 0x81\nint r = REG(MODE);\nint c = CAT(, x) + CAT(y, ) + CAT(1, 2);";
+        let mut pp = Preprocessor::new(vec![]);
+        let result = pp.process(source, Path::new("test.c")).unwrap();
+        assert!(result.contains("int r = 0x81;"));
+        assert!(result.contains("int c = x + y + 12;"));
+    }
+
+    #[test]
+    fn test_names_inside_numbers_not_expanded() {
+        let source = "#define x1F 0\n#define e 9\nint v = 0x1F + 1e5 + e;";
+        let mut pp = Preprocessor::new(vec![]);
+        let result = pp.process(source, Path::new("test.c")).unwrap();
+        assert!(result.contains("int v = 0x1F + 1e5 + 9;"));
+    }
+
+    #[test]
+    fn test_line_after_multiline_invocation() {
+        let source = "#define ADD(a, b) ((a) + (b))\nint x = ADD(1,\n  2);\nint y = __LINE__;";
+        let mut pp = Preprocessor::new(vec![]);
+        let result = pp.process(source, Path::new("test.c")).unwrap();
+        assert!(result.contains("int x = ((1) + (2))"));
+        assert_eq!(result.lines().nth(3), Some("int y = 4;"));
+    }
+
     #[test]
     fn test_predefined_stdc() {
         let source = "int x = __STDC__;";
@@ -1563,4 +1819,30 @@ mod tests {
         assert!(result.contains("int x = 1;"));
         assert!(result.contains(&format!("\"{}\"", header_path.display())));
     }
+
+    #[test]
+    fn test_dependencies_recorded() {
+        let temp_dir = std::env::temp_dir().join(format!(
+            "smdc_pp_deps_{}",
+            SystemTime::now()
+                .duration_since(UNIX_EPOCH)
+                .unwrap()
+                .as_nanos()
+        ));
+        fs::create_dir_all(&temp_dir).unwrap();
+        fs::write(temp_dir.join("a.h"), "#include \"b.h\"\n").unwrap();
+        fs::write(temp_dir.join("b.h"), "const char* d = __DATE__;\n").unwrap();
+
+        let source = "#include \"a.h\"\n#include \"b.h\"\n";
+        let mut pp = Preprocessor::new(vec![]);
+        pp.process(source, &temp_dir.join("main.c")).unwrap();
+
+        let names: Vec<_> = pp
+            .dependencies()
+            .iter()
+            .map(|p| p.file_name().unwrap().to_str().unwrap())
+            .collect();
+        assert_eq!(names, ["a.h", "b.h"]);
+        assert!(pp.uses_clock());
+    }
 }
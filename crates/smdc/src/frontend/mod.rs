@@ -26,6 +26,8 @@ pub struct FrontendConfig {
     pub verbose: bool,
     /// Include paths for preprocessor (C only)
     pub include_paths: Vec<PathBuf>,
+    /// Compilation cache directory (`--cache-dir`)
+    pub cache_dir: Option<PathBuf>,
 }
 
 /// Compilation context providing access to diagnostics and file info
@@ -55,6 +57,20 @@ pub trait Frontend: Send + Sync {
     /// File extensions this frontend handles (e.g., &[".c", ".h"] or &[".rs"])
     fn extensions(&self) -> &'static [&'static str];
 
+    /// Source as the rest of the frontend sees it, after any preprocessing
+    ///
+    /// Everything that determines the IR is in here, so the driver keys its
+    /// cache of compiled units on it.
+    fn preprocess(
+        &self,
+        source: &str,
+        ctx: &CompileContext,
+        config: &FrontendConfig,
+    ) -> CompileResult<String> {
+        let _ = (ctx, config);
+        Ok(source.to_string())
+    }
+
     /// Compile source code to IR
     ///
     /// This is the main entry point that orchestrates the entire
@@ -66,6 +82,19 @@ pub trait Frontend: Send + Sync {
         config: &FrontendConfig,
     ) -> CompileResult<IrModule>;
 
+    /// Compile text `preprocess` already returned, without preprocessing
+    /// it again
+    ///
+    /// The default suits frontends whose `preprocess` changes nothing.
+    fn compile_preprocessed(
+        &self,
+        text: &str,
+        ctx: &CompileContext,
+        config: &FrontendConfig,
+    ) -> CompileResult<IrModule> {
+        self.compile(text, ctx, config)
+    }
+
     /// Optional: dump tokens for debugging
     fn dump_tokens(&self, source: &str) -> CompileResult<String> {
         let _ = source;
@@ -0,0 +1,718 @@
+//! Compile-time evaluation of `const` and `static` initializers
+//!
+//! Initializers are run by a small interpreter over the AST, so tables can
+//! be built with `let`, `if`, `match`, loops and calls to `const fn`s, as in
+//! Rust. Integers are held as `i64` and wrapped to their type by `as` casts
+//! and when written out. The fixed-point math builtins evaluate from the
+//! same tables the SDK puts in ROM. Items are evaluated on first use, so
+//! they may refer to each other in any order.
+
+use super::ast::*;
+use crate::common::{CompileError, CompileResult, Span, fixed};
+use std::collections::{HashMap, HashSet};
+
+/// Evaluation steps allowed for one item before it is assumed not to
+/// terminate
+const STEP_LIMIT: usize = 1 << 22;
+
+/// Nesting of `const fn` calls allowed, to keep recursion off the host stack
+const CALL_DEPTH_LIMIT: usize = 256;
+
+/// Value of a constant expression; `()` and statements evaluate to zero
+#[derive(Debug, Clone, PartialEq, Eq)]
+pub enum ConstValue {
+    Int(i64),
+    Array(Vec<ConstValue>),
+}
+
+impl ConstValue {
+    /// Write the value as type `ty`, big-endian as the target stores it
+    pub fn to_bytes(&self, ty: &RustType, out: &mut Vec<u8>) -> Result<(), String> {
+        match (self, &ty.kind) {
+            (ConstValue::Int(v), RustTypeKind::Primitive(p)) => {
+                let size = p.size();
+                out.extend_from_slice(&v.to_be_bytes()[8 - size..]);
+                Ok(())
+            }
+            (ConstValue::Array(items), RustTypeKind::Array { element, size })
+                if items.len() == *size =>
+            {
+                items
+                    .iter()
+                    .try_for_each(|item| item.to_bytes(element, out))
+            }
+            _ => Err(format!("constant does not fit type {ty}")),
+        }
+    }
+}
+
+/// Control flow leaving an expression early
+enum Flow {
+    Break(Option<String>, ConstValue),
+    Continue(Option<String>),
+    Return(ConstValue),
+    Error(CompileError),
+}
+
+type Eval<T> = Result<T, Flow>;
+
+fn fail<T>(message: impl Into<String>, span: Span) -> Eval<T> {
+    Err(Flow::Error(CompileError::semantic(message, span)))
+}
+
+/// Wrap `value` to integer type `ty`; other types leave it alone
+pub fn wrap_to(value: i64, ty: &RustType) -> i64 {
+    match &ty.kind {
+        RustTypeKind::Primitive(PrimitiveType::Bool) => i64::from(value != 0),
+        RustTypeKind::Primitive(p) if ty.is_integer() && p.size() < 8 => {
+            let shift = 64 - 8 * p.size() as u32;
+            if p.is_signed() {
+                (value << shift) >> shift
+            } else {
+                ((value as u64) << shift >> shift) as i64
+            }
+        }
+        _ => value,
+    }
+}
+
+/// Evaluates the `const` and `static` items of a module
+pub struct ConstEvaluator<'a> {
+    /// Initializers of consts and statics, by name
+    items: HashMap<&'a str, (&'a RustType, &'a Expr)>,
+    /// Functions callable at compile time
+    functions: HashMap<&'a str, &'a FnDecl>,
+    /// Items already evaluated
+    values: HashMap<&'a str, ConstValue>,
+    /// Items being evaluated, to catch cycles
+    pending: HashSet<&'a str>,
+    /// Local variables of the innermost call, innermost scope last
+    scopes: Vec<HashMap<String, ConstValue>>,
+    steps: usize,
+    depth: usize,
+}
+
+impl<'a> ConstEvaluator<'a> {
+    pub fn new(items: &'a [Item]) -> Self {
+        let mut evaluator = Self {
+            items: HashMap::new(),
+            functions: HashMap::new(),
+            values: HashMap::new(),
+            pending: HashSet::new(),
+            scopes: Vec::new(),
+            steps: 0,
+            depth: 0,
+        };
+        for item in items {
+            match &item.kind {
+                ItemKind::Const(c) => {
+                    evaluator.items.insert(&c.name, (&c.ty, &c.value));
+                }
+                ItemKind::Static(s) => {
+                    evaluator.items.insert(&s.name, (&s.ty, &s.value));
+                }
+                ItemKind::Fn(f) if f.is_const => {
+                    evaluator.functions.insert(&f.name, f);
+                }
+                _ => {}
+            }
+        }
+        evaluator
+    }
+
+    /// Value of the const or static `name`, wrapped to its type
+    pub fn eval_item(&mut self, name: &str, span: Span) -> CompileResult<ConstValue> {
+        // item() turns stray control flow into errors
+        self.item(name, span).map_err(|flow| match flow {
+            Flow::Error(e) => e,
+            _ => CompileError::semantic("unexpected control flow in constant", span),
+        })
+    }
+
+    fn item(&mut self, name: &str, span: Span) -> Eval<ConstValue> {
+        let Some((&key, &(ty, expr))) = self.items.get_key_value(name) else {
+            return fail(format!("cannot evaluate `{name}` at compile time"), span);
+        };
+        if let Some(value) = self.values.get(key) {
+            return Ok(value.clone());
+        }
+        if !self.pending.insert(key) {
+            return fail(format!("`{name}` depends on itself"), span);
+        }
+
+        // Each item starts afresh, outside any function
+        let scopes = std::mem::take(&mut self.scopes);
+        let (steps, depth) = (self.steps, self.depth);
+        self.steps = 0;
+        self.depth = 0;
+        let value = match self.expr(expr) {
+            Ok(value) => Ok(wrap_value(value, ty)),
+            Err(Flow::Error(e)) => Err(Flow::Error(e)),
+            Err(_) => fail(
+                "`break`, `continue` or `return` outside a loop or function",
+                expr.span,
+            ),
+        };
+        self.scopes = scopes;
+        self.steps = steps;
+        self.depth = depth;
+        self.pending.remove(key);
+
+        let value = value?;
+        self.values.insert(key, value.clone());
+        Ok(value)
+    }
+
+    fn int(&mut self, expr: &Expr) -> Eval<i64> {
+        match self.expr(expr)? {
+            ConstValue::Int(v) => Ok(v),
+            ConstValue::Array(_) => fail("expected an integer, found an array", expr.span),
+        }
+    }
+
+    fn expr(&mut self, expr: &Expr) -> Eval<ConstValue> {
+        self.steps += 1;
+        if self.steps > STEP_LIMIT {
+            return fail(
+                "constant evaluation took too long; is there an infinite loop?",
+                expr.span,
+            );
+        }
+
+        let int = ConstValue::Int;
+        match &expr.kind {
+            ExprKind::IntLiteral(v) => Ok(int(*v)),
+            ExprKind::BoolLiteral(b) => Ok(int(i64::from(*b))),
+            ExprKind::CharLiteral(c) => Ok(int(i64::from(u32::from(*c)))),
+            ExprKind::ByteLiteral(b) => Ok(int(i64::from(*b))),
+            ExprKind::Identifier(name) => self.name(name, expr.span),
+            ExprKind::Path(path) => self.name(path.name(), expr.span),
+            ExprKind::Paren(inner) => self.expr(inner),
+            ExprKind::Binary { op, left, right } => {
+                // Logical operators short-circuit
+                match op {
+                    BinOp::And => {
+                        let value = self.int(left)? != 0 && self.int(right)? != 0;
+                        return Ok(int(i64::from(value)));
+                    }
+                    BinOp::Or => {
+                        let value = self.int(left)? != 0 || self.int(right)? != 0;
+                        return Ok(int(i64::from(value)));
+                    }
+                    _ => {}
+                }
+                let l = self.int(left)?;
+                let r = self.int(right)?;
+                binary(*op, l, r, expr.span).map(int)
+            }
+            ExprKind::Unary { op, operand } => {
+                let value = self.int(operand)?;
+                let is_bool = operand
+                    .ty
+                    .as_ref()
+                    .is_some_and(|ty| ty.kind == RustTypeKind::Primitive(PrimitiveType::Bool));
+                match op {
+                    UnaryOp::Neg => Ok(int(value.wrapping_neg())),
+                    UnaryOp::Not if is_bool => Ok(int(i64::from(value == 0))),
+                    UnaryOp::Not => Ok(int(!value)),
+                    _ => fail("references are not supported in constants", expr.span),
+                }
+            }
+            ExprKind::Cast { expr: inner, ty } => Ok(int(wrap_to(self.int(inner)?, ty))),
+            ExprKind::Block(block) | ExprKind::Unsafe(block) => self.block(block),
+            ExprKind::If {
+                condition,
+                then_block,
+                else_block,
+            } => {
+                if self.int(condition)? != 0 {
+                    self.block(then_block)
+                } else if let Some(else_expr) = else_block {
+                    self.expr(else_expr)
+                } else {
+                    Ok(int(0))
+                }
+            }
+            ExprKind::Match { scrutinee, arms } => {
+                let value = self.int(scrutinee)?;
+                for arm in arms {
+                    self.scopes.push(HashMap::new());
+                    let taken = self.bind(&arm.pattern, value)?
+                        && match &arm.guard {
+                            Some(guard) => self.int(guard)? != 0,
+                            None => true,
+                        };
+                    let result = if taken {
+                        Some(self.expr(&arm.body))
+                    } else {
+                        None
+                    };
+                    self.scopes.pop();
+                    if let Some(result) = result {
+                        return result;
+                    }
+                }
+                fail(format!("no match arm for {value}"), expr.span)
+            }
+            ExprKind::Loop { label, body } => loop {
+                match self.block(body) {
+                    Ok(_) => {}
+                    Err(Flow::Break(l, value)) if targets(label.as_ref(), l.as_ref()) => {
+                        break Ok(value);
+                    }
+                    Err(Flow::Continue(l)) if targets(label.as_ref(), l.as_ref()) => {}
+                    Err(flow) => break Err(flow),
+                }
+            },
+            ExprKind::While {
+                label,
+                condition,
+                body,
+            } => {
+                while self.int(condition)? != 0 {
+                    match self.block(body) {
+                        Ok(_) => {}
+                        Err(Flow::Break(l, _)) if targets(label.as_ref(), l.as_ref()) => break,
+                        Err(Flow::Continue(l)) if targets(label.as_ref(), l.as_ref()) => {}
+                        Err(flow) => return Err(flow),
+                    }
+                }
+                Ok(int(0))
+            }
+            ExprKind::For {
+                label,
+                pattern,
+                iter,
+                body,
+            } => {
+                let ExprKind::Range {
+                    start: Some(start),
+                    end: Some(end),
+                    inclusive,
+                } = &iter.kind
+                else {
+                    return fail("only ranges can be iterated over in constants", iter.span);
+                };
+                let start = self.int(start)?;
+                let end = self.int(end)? + i64::from(*inclusive);
+                for i in start..end {
+                    self.scopes.push(HashMap::new());
+                    self.bind(pattern, i)?;
+                    let result = self.block(body);
+                    self.scopes.pop();
+                    match result {
+                        Ok(_) => {}
+                        Err(Flow::Break(l, _)) if targets(label.as_ref(), l.as_ref()) => break,
+                        Err(Flow::Continue(l)) if targets(label.as_ref(), l.as_ref()) => {}
+                        Err(flow) => return Err(flow),
+                    }
+                }
+                Ok(int(0))
+            }
+            ExprKind::Break { label, value } => {
+                let value = match value {
+                    Some(value) => self.expr(value)?,
+                    None => int(0),
+                };
+                Err(Flow::Break(label.clone(), value))
+            }
+            ExprKind::Continue { label } => Err(Flow::Continue(label.clone())),
+            ExprKind::Return(value) => {
+                let value = match value {
+                    Some(value) => self.expr(value)?,
+                    None => int(0),
+                };
+                Err(Flow::Return(value))
+            }
+            ExprKind::Assign { target, op, value } => {
+                let value = self.expr(value)?;
+                let slot = self.slot(target)?;
+                *slot = match (op, slot.clone(), value) {
+                    (None, _, value) => value,
+                    (Some(op), ConstValue::Int(l), ConstValue::Int(r)) => {
+                        int(binary(*op, l, r, expr.span)?)
+                    }
+                    _ => return fail("compound assignment to an array", expr.span),
+                };
+                Ok(int(0))
+            }
+            ExprKind::Array(items) => items
+                .iter()
+                .map(|item| self.expr(item))
+                .collect::<Eval<_>>()
+                .map(ConstValue::Array),
+            ExprKind::ArrayRepeat { value, count } => {
+                let value = self.expr(value)?;
+                let count = self.int(count)?;
+                let Ok(count) = usize::try_from(count) else {
+                    return fail(format!("negative array length {count}"), expr.span);
+                };
+                Ok(ConstValue::Array(vec![value; count]))
+            }
+            ExprKind::Index { object, index } => {
+                let object = self.expr(object)?;
+                let index = self.int(index)?;
+                element(object, index, expr.span)
+            }
+            ExprKind::Call { callee, args } => {
+                let name = match &callee.kind {
+                    ExprKind::Identifier(name) => name.as_str(),
+                    ExprKind::Path(path) => path.name(),
+                    _ => return fail("cannot call this at compile time", callee.span),
+                };
+                let args = args
+                    .iter()
+                    .map(|arg| self.int(arg))
+                    .collect::<Eval<Vec<_>>>()?;
+                self.call(name, &args, expr.span).map(int)
+            }
+            _ => fail("expression not supported in constants", expr.span),
+        }
+    }
+
+    fn block(&mut self, block: &Block) -> Eval<ConstValue> {
+        self.scopes.push(HashMap::new());
+        let result = self.block_body(block);
+        self.scopes.pop();
+        result
+    }
+
+    fn block_body(&mut self, block: &Block) -> Eval<ConstValue> {
+        for stmt in &block.stmts {
+            match &stmt.kind {
+                StmtKind::Let { pattern, ty, init } => {
+                    let mut value = match init {
+                        Some(init) => self.expr(init)?,
+                        None => ConstValue::Int(0),
+                    };
+                    if let Some(ty) = ty {
+                        value = wrap_value(value, ty);
+                    }
+                    let Some(name) = binding_name(pattern) else {
+                        return fail("unsupported pattern in constant", pattern.span);
+                    };
+                    self.define(name, value);
+                }
+                StmtKind::Expr(expr) | StmtKind::ExprNoSemi(expr) => {
+                    self.expr(expr)?;
+                }
+                StmtKind::Item(_) | StmtKind::Empty => {}
+            }
+        }
+        match &block.expr {
+            Some(expr) => self.expr(expr),
+            None => Ok(ConstValue::Int(0)),
+        }
+    }
+
+    /// Value of a local, or else of a const or static item
+    fn name(&mut self, name: &str, span: Span) -> Eval<ConstValue> {
+        if let Some(value) = self.scopes.iter().rev().find_map(|scope| scope.get(name)) {
+            return Ok(value.clone());
+        }
+        self.item(name, span)
+    }
+
+    fn define(&mut self, name: &str, value: ConstValue) {
+        if let Some(scope) = self.scopes.last_mut() {
+            scope.insert(name.to_string(), value);
+        }
+    }
+
+    /// Bind `value` to `pattern` in the innermost scope, returning whether
+    /// it matched
+    fn bind(&mut self, pattern: &Pattern, value: i64) -> Eval<bool> {
+        match &pattern.kind {
+            PatternKind::Wildcard => Ok(true),
+            PatternKind::Binding { name, .. } => {
+                self.define(name, ConstValue::Int(value));
+                Ok(true)
+            }
+            PatternKind::Literal(expr) => Ok(self.int(expr)? == value),
+            PatternKind::Range {
+                start,
+                end,
+                inclusive,
+            } => {
+                let above = match start {
+                    Some(start) => value >= self.int(start)?,
+                    None => true,
+                };
+                let below = match end {
+                    Some(end) if *inclusive => value <= self.int(end)?,
+                    Some(end) => value < self.int(end)?,
+                    None => true,
+                };
+                Ok(above && below)
+            }
+            PatternKind::Or(patterns) => {
+                for pattern in patterns {
+                    if self.bind(pattern, value)? {
+                        return Ok(true);
+                    }
+                }
+                Ok(false)
+            }
+            PatternKind::Paren(inner) => self.bind(inner, value),
+            _ => fail("unsupported pattern in constant", pattern.span),
+        }
+    }
+
+    /// The local a place expression names, or the array element within it
+    fn slot(&mut self, target: &Expr) -> Eval<&mut ConstValue> {
+        let mut indices = Vec::new();
+        let mut place = target;
+        loop {
+            match &place.kind {
+                ExprKind::Index { object, index } => {
+                    indices.push((self.int(index)?, place.span));
+                    place = object;
+                }
+                ExprKind::Paren(inner) => place = inner,
+                _ => break,
+            }
+        }
+        let ExprKind::Identifier(name) = &place.kind else {
+            return fail("cannot assign to this in a constant", target.span);
+        };
+        let Some(mut slot) = self
+            .scopes
+            .iter_mut()
+            .rev()
+            .find_map(|scope| scope.get_mut(name))
+        else {
+            return fail(
+                format!("cannot assign to `{name}` in a constant"),
+                target.span,
+            );
+        };
+        for (index, span) in indices.into_iter().rev() {
+            let ConstValue::Array(items) = slot else {
+                return fail("cannot index into an integer", span);
+            };
+            let len = items.len();
+            slot = usize::try_from(index)
+                .ok()
+                .and_then(|i| items.get_mut(i))
+                .ok_or_else(|| {
+                    Flow::Error(CompileError::semantic(
+                        format!("index {index} out of bounds for length {len}"),
+                        span,
+                    ))
+                })?;
+        }
+        Ok(slot)
+    }
+
+    /// Call a builtin or `const fn`
+    fn call(&mut self, name: &str, args: &[i64], span: Span) -> Eval<i64> {
+        let Some(&func) = self.functions.get(name) else {
+            return fixed::eval_builtin(name, args)
+                .map_or_else(|| fail(format!("`{name}` is not a `const fn`"), span), Ok);
+        };
+        if func.params.len() != args.len() {
+            return fail(
+                format!(
+                    "`{name}` takes {} arguments but {} were given",
+                    func.params.len(),
+                    args.len()
+                ),
+                span,
+            );
+        }
+        if self.depth >= CALL_DEPTH_LIMIT {
+            return fail("constant evaluation recursed too deeply", span);
+        }
+        let Some(body) = &func.body else {
+            return fail(format!("`{name}` has no body"), span);
+        };
+
+        let mut frame = HashMap::new();
+        for (param, &arg) in func.params.iter().zip(args) {
+            let Some(param_name) = binding_name(&param.pattern) else {
+                return fail("unsupported pattern in constant", param.span);
+            };
+            frame.insert(
+                param_name.to_string(),
+                ConstValue::Int(wrap_to(arg, &param.ty)),
+            );
+        }
+        let scopes = std::mem::replace(&mut self.scopes, vec![frame]);
+        self.depth += 1;
+        let result = self.block_body(body);
+        self.depth -= 1;
+        self.scopes = scopes;
+
+        let value = match result {
+            Ok(ConstValue::Int(v)) | Err(Flow::Return(ConstValue::Int(v))) => v,
+            Ok(ConstValue::Array(_)) | Err(Flow::Return(ConstValue::Array(_))) => {
+                return fail("const fn returning an array", span);
+            }
+            Err(flow) => return Err(flow),
+        };
+        Ok(match &func.return_type {
+            Some(ty) => wrap_to(value, ty),
+            None => 0,
+        })
+    }
+}
+
+fn targets(label: Option<&String>, target: Option<&String>) -> bool {
+    target.is_none() || target == label
+}
+
+fn binding_name(pattern: &Pattern) -> Option<&str> {
+    match &pattern.kind {
+        PatternKind::Binding { name, .. } => Some(name),
+        PatternKind::Paren(inner) => binding_name(inner),
+        _ => None,
+    }
+}
+
+/// Wrap every integer in `value` to its place in `ty`
+fn wrap_value(value: ConstValue, ty: &RustType) -> ConstValue {
+    match (value, &ty.kind) {
+        (ConstValue::Int(v), _) => ConstValue::Int(wrap_to(v, ty)),
+        (ConstValue::Array(items), RustTypeKind::Array { element, .. }) => ConstValue::Array(
+            items
+                .into_iter()
+                .map(|item| wrap_value(item, element))
+                .collect(),
+        ),
+        (value, _) => value,
+    }
+}
+
+fn element(array: ConstValue, index: i64, span: Span) -> Eval<ConstValue> {
+    let ConstValue::Array(mut items) = array else {
+        return fail("cannot index into an integer", span);
+    };
+    let len = items.len();
+    match usize::try_from(index) {
+        Ok(i) if i < len => Ok(items.swap_remove(i)),
+        _ => fail(
+            format!("index {index} out of bounds for length {len}"),
+            span,
+        ),
+    }
+}
+
+fn binary(op: BinOp, l: i64, r: i64, span: Span) -> Eval<i64> {
+    Ok(match op {
+        BinOp::Add => l.wrapping_add(r),
+        BinOp::Sub => l.wrapping_sub(r),
+        BinOp::Mul => l.wrapping_mul(r),
+        BinOp::Div | BinOp::Rem if r == 0 => {
+            return fail("division by zero in constant", span);
+        }
+        BinOp::Div => l.wrapping_div(r),
+        BinOp::Rem => l.wrapping_rem(r),
+        BinOp::BitAnd => l & r,
+        BinOp::BitOr => l | r,
+        BinOp::BitXor => l ^ r,
+        BinOp::Shl => l.wrapping_shl(r as u32),
+        BinOp::Shr => l.wrapping_shr(r as u32),
+        BinOp::And => i64::from(l != 0 && r != 0),
+        BinOp::Or => i64::from(l != 0 || r != 0),
+        BinOp::Eq => i64::from(l == r),
+        BinOp::Ne => i64::from(l != r),
+        BinOp::Lt => i64::from(l < r),
+        BinOp::Le => i64::from(l <= r),
+        BinOp::Gt => i64::from(l > r),
+        BinOp::Ge => i64::from(l >= r),
+    })
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::frontend::rust::{RustAnalyzer, RustParser};
+
+    fn eval(source: &str, name: &str) -> CompileResult<ConstValue> {
+        let mut module = RustParser::new(source).parse_module()?;
+        RustAnalyzer::new().analyze(&mut module)?;
+        ConstEvaluator::new(&module.items).eval_item(name, Span::default())
+    }
+
+    fn ints(value: ConstValue) -> Vec<i64> {
+        let ConstValue::Array(items) = value else {
+            panic!("not an array: {value:?}");
+        };
+        items
+            .into_iter()
+            .map(|item| match item {
+                ConstValue::Int(v) => v,
+                ConstValue::Array(_) => panic!("nested array"),
+            })
+            .collect()
+    }
+
+    #[test]
+    fn test_loops_and_const_fn() {
+        let source = "
+            const fn tri(n: i32) -> i32 {
+                let mut sum = 0;
+                for i in 1..=n { sum += i; }
+                sum
+            }
+            const fn collatz(mut n: i32) -> i32 {
+                let mut steps = 0;
+                loop {
+                    if n == 1 { return steps; }
+                    n = if n % 2 == 0 { n / 2 } else { 3 * n + 1 };
+                    steps += 1;
+                }
+            }
+            const SIZE: i32 = 6;
+            const TABLE: [i32; 6] = {
+                let mut t = [0; 6];
+                let mut i = 0;
+                while i < SIZE {
+                    t[i] = tri(i) + collatz(i + 1) * 100;
+                    i += 1;
+                }
+                t
+            };";
+        assert_eq!(
+            ints(eval(source, "TABLE").unwrap()),
+            [0, 101, 703, 206, 510, 815]
+        );
+        assert_eq!(eval(source, "SIZE").unwrap(), ConstValue::Int(6));
+    }
+
+    #[test]
+    fn test_builtins_and_bytes() {
+        let source = "
+            const fn octant(a: i32) -> i32 {
+                match a / 32 { 0 | 1 => 1, 2 | 3 | 4 | 5 => 2, _ => 3 }
+            }
+            const SINES: [i16; 3] = [sin_fix(0) as i16, sin_fix(32) as i16, cos_fix(128) as i16];
+            const OCTANTS: [u8; 3] = [octant(0) as u8, octant(100) as u8, octant(255) as u8];";
+        let sines = eval(source, "SINES").unwrap();
+        let mut bytes = Vec::new();
+        let ty = RustType::new(
+            RustTypeKind::Array {
+                element: Box::new(RustType::new(
+                    RustTypeKind::Primitive(PrimitiveType::I16),
+                    Span::default(),
+                )),
+                size: 3,
+            },
+            Span::default(),
+        );
+        sines.to_bytes(&ty, &mut bytes).unwrap();
+        assert_eq!(bytes, [0, 0, 0, 181, 0xFF, 0]);
+        assert_eq!(ints(eval(source, "OCTANTS").unwrap()), [1, 2, 3]);
+    }
+
+    #[test]
+    fn test_errors() {
+        let err = |source: &str| eval(source, "X").unwrap_err().to_string();
+        assert!(err("const X: i32 = Y; const Y: i32 = X;").contains("depends on itself"));
+        let forever = err("const X: i32 = { let mut i = 0; while i >= 0 { i += 1; } i };");
+        assert!(forever.contains("too long"), "{forever}");
+        assert!(err("const A: [i32; 2] = [1, 2]; const X: i32 = A[2];").contains("bounds"));
+        assert!(err("fn f() -> i32 { 1 } const X: i32 = f();").contains("not a `const fn`"));
+        assert!(err("const X: i32 = 1 / 0;").contains("division by zero"));
+    }
+}
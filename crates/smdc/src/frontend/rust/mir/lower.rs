@@ -21,6 +21,10 @@ pub struct MirLowerer {
     const_values: HashMap<String, i64>,
     /// Static variable names (for global references)
     static_names: HashSet<String>,
+    /// Struct layouts, for resolving field names to indices
+    struct_fields: StructFields,
+    /// Element types of static and const arrays
+    global_arrays: HashMap<String, RustType>,
 }
 
 impl MirLowerer {
@@ -47,9 +51,23 @@ impl MirLowerer {
             continue_targets: Vec::new(),
             const_values,
             static_names,
+            struct_fields: StructFields::new(),
+            global_arrays: HashMap::new(),
         }
     }
 
+    /// Resolve struct field names using `struct_fields`
+    pub fn with_struct_fields(mut self, struct_fields: StructFields) -> Self {
+        self.struct_fields = struct_fields;
+        self
+    }
+
+    /// Index static and const arrays, given their element types
+    pub fn with_global_arrays(mut self, global_arrays: HashMap<String, RustType>) -> Self {
+        self.global_arrays = global_arrays;
+        self
+    }
+
     /// Lower a function declaration to MIR
     pub fn lower_function(mut self, func: &FnDecl) -> CompileResult<MirBody> {
         // Add parameters as locals
@@ -302,16 +320,19 @@ impl MirLowerer {
                 self.current_block = next_block;
                 Ok(Operand::Copy(Place::local(result)))
             }
-            ExprKind::Field { object, field: _ } => {
+            ExprKind::Field { object, field } => {
+                let index = self.field_index(object, field);
                 let obj = self.lower_place(object)?;
-                // We'd need field index from type info
-                Ok(Operand::Copy(obj.field(0))) // Simplified
+                Ok(Operand::Copy(obj.field(index)))
             }
             ExprKind::TupleField { object, index } => {
                 let obj = self.lower_place(object)?;
                 Ok(Operand::Copy(obj.field(*index)))
             }
             ExprKind::Index { object, index } => {
+                if let Some(place) = self.global_element(object, index)? {
+                    return Ok(Operand::Copy(place));
+                }
                 let obj = self.lower_place(object)?;
                 let idx = self.lower_expr(index)?;
                 Ok(Operand::Copy(obj.index(idx)))
@@ -619,14 +640,22 @@ impl MirLowerer {
                 let mut operands = Vec::new();
                 for field in fields {
                     if let Some(value) = &field.value {
-                        operands.push(self.lower_expr(value)?);
+                        operands.push((field.name.as_str(), self.lower_expr(value)?));
                     } else {
                         // Shorthand: use variable with same name
                         if let Some(&local) = self.locals_map.get(&field.name) {
-                            operands.push(Operand::Copy(Place::local(local)));
+                            operands
+                                .push((field.name.as_str(), Operand::Copy(Place::local(local))));
                         }
                     }
                 }
+                // Fields are evaluated as written but stored in declaration order
+                if let Some(layout) = self.struct_fields.get(path.name()) {
+                    operands.sort_by_key(|(name, _)| {
+                        layout.iter().position(|(field, _)| field == name)
+                    });
+                }
+                let operands = operands.into_iter().map(|(_, operand)| operand).collect();
 
                 let ty = expr.ty.clone().unwrap_or_else(|| RustType::unit(expr.span));
                 let result = self.new_temp(ty);
@@ -667,15 +696,19 @@ impl MirLowerer {
                 let place = self.lower_place(inner)?;
                 Ok(place.deref())
             }
-            ExprKind::Field { object, .. } => {
+            ExprKind::Field { object, field } => {
+                let index = self.field_index(object, field);
                 let place = self.lower_place(object)?;
-                Ok(place.field(0)) // Simplified
+                Ok(place.field(index))
             }
             ExprKind::TupleField { object, index } => {
                 let place = self.lower_place(object)?;
                 Ok(place.field(*index))
             }
             ExprKind::Index { object, index } => {
+                if let Some(place) = self.global_element(object, index)? {
+                    return Ok(place);
+                }
                 let place = self.lower_place(object)?;
                 let idx = self.lower_expr(index)?;
                 Ok(place.index(idx))
@@ -691,6 +724,104 @@ impl MirLowerer {
         }
     }
 
+    /// Element `index` of a static or const array, as a deref of its
+    /// address; `None` if `object` names no such array
+    fn global_element(&mut self, object: &Expr, index: &Expr) -> CompileResult<Option<Place>> {
+        let name = match &object.kind {
+            ExprKind::Identifier(name) if !self.locals_map.contains_key(name) => name.as_str(),
+            ExprKind::Path(path) => path.name(),
+            _ => return Ok(None),
+        };
+        let Some(element) = self.global_arrays.get(name).cloned() else {
+            return Ok(None);
+        };
+
+        let idx = self.lower_expr(index)?;
+        let offset = if element.size() == 1 {
+            idx
+        } else {
+            let offset = self.new_temp(RustType::i32(index.span));
+            self.emit_assign(
+                Place::local(offset),
+                Rvalue::BinaryOp {
+                    op: MirBinOp::Mul,
+                    left: idx,
+                    right: Operand::Constant(MirConstant::Int(element.size() as i64)),
+                },
+            );
+            Operand::Copy(Place::local(offset))
+        };
+        let addr = self.new_temp(RustType::pointer(element, true, object.span));
+        self.emit_assign(
+            Place::local(addr),
+            Rvalue::BinaryOp {
+                op: MirBinOp::Add,
+                left: Operand::Constant(MirConstant::StaticAddr(name.to_string())),
+                right: offset,
+            },
+        );
+        Ok(Some(Place::local(addr).deref()))
+    }
+
+    /// Index of `field` in the struct `object` evaluates to; 0 if the
+    /// struct is not known
+    fn field_index(&self, object: &Expr, field: &str) -> usize {
+        self.expr_type(object)
+            .and_then(|ty| match &ty.kind {
+                RustTypeKind::Named(path) => self.struct_fields.get(path.name()),
+                _ => None,
+            })
+            .and_then(|layout| layout.iter().position(|(name, _)| name == field))
+            .unwrap_or(0)
+    }
+
+    /// Type of a place expression, looking through fields and derefs that
+    /// sema leaves uninferred
+    fn expr_type(&self, expr: &Expr) -> Option<RustType> {
+        let ty = match &expr.kind {
+            ExprKind::Identifier(name) => self
+                .locals_map
+                .get(name)
+                .map(|local| self.body.locals[local.0].ty.clone()),
+            ExprKind::Field { object, field } => {
+                let object = self.expr_type(object)?;
+                let RustTypeKind::Named(path) = &object.kind else {
+                    return None;
+                };
+                self.struct_fields
+                    .get(path.name())?
+                    .iter()
+                    .find(|(name, _)| name == field)
+                    .map(|(_, ty)| ty.clone())
+            }
+            ExprKind::TupleField { object, index } => match self.expr_type(object)?.kind {
+                RustTypeKind::Tuple(mut types) if *index < types.len() => {
+                    Some(types.swap_remove(*index))
+                }
+                RustTypeKind::Named(path) => self
+                    .struct_fields
+                    .get(path.name())?
+                    .get(*index)
+                    .map(|(_, ty)| ty.clone()),
+                _ => None,
+            },
+            ExprKind::Dereference(inner)
+            | ExprKind::Unary {
+                op: UnaryOp::Deref,
+                operand: inner,
+            } => match self.expr_type(inner)?.kind {
+                RustTypeKind::Pointer { inner, .. } | RustTypeKind::Reference { inner, .. } => {
+                    Some(*inner)
+                }
+                _ => None,
+            },
+            ExprKind::Paren(inner) => self.expr_type(inner),
+            _ => None,
+        };
+        ty.filter(|ty| !matches!(ty.kind, RustTypeKind::Infer))
+            .or_else(|| expr.ty.clone())
+    }
+
     fn new_temp(&mut self, ty: RustType) -> LocalId {
         self.body.add_local(ty, None)
     }
@@ -4,9 +4,11 @@
 //! the shared IR. It makes control flow explicit and desugars patterns.
 
 mod lower;
+mod opt;
 mod to_ir;
 mod types;
 
 pub use lower::MirLowerer;
+pub use opt::optimize;
 pub use to_ir::MirToIr;
 pub use types::*;
@@ -0,0 +1,705 @@
+//! MIR optimizations
+//!
+//! Lowering gives nearly every subexpression a temp of its own and keeps
+//! structs and tuples whole. Before conversion to the shared IR:
+//!
+//! - copy propagation folds a temp that is only copied somewhere else back
+//!   into the statement or call that computed it
+//! - scalar replacement splits structs and tuples whose address is never
+//!   taken into a local per field, so each field can live in a register
+
+use super::types::*;
+use crate::frontend::rust::ast::{RustType, RustTypeKind};
+use std::collections::{HashMap, HashSet};
+
+/// Optimize `body`; `structs` gives the layout of the structs it uses
+pub fn optimize(body: &mut MirBody, structs: &StructFields) {
+    // Splitting a struct can expose fields that are structs themselves
+    loop {
+        propagate_copies(body);
+        if !scalar_replace(body, structs) {
+            break;
+        }
+    }
+}
+
+/// How a statement or terminator uses a place
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+enum Access {
+    Read,
+    Write,
+    /// Needs the place in memory: its address or length is taken
+    Borrow,
+}
+
+/// Visit `place` and the places its index operands read
+fn visit_place(place: &Place, access: Access, f: &mut impl FnMut(&Place, Access)) {
+    f(place, access);
+    for projection in &place.projections {
+        if let Projection::Index(operand) = projection {
+            visit_operand(operand, f);
+        }
+    }
+}
+
+fn visit_operand(operand: &Operand, f: &mut impl FnMut(&Place, Access)) {
+    if let Operand::Copy(place) | Operand::Move(place) = operand {
+        visit_place(place, Access::Read, f);
+    }
+}
+
+fn visit_rvalue(rvalue: &Rvalue, f: &mut impl FnMut(&Place, Access)) {
+    match rvalue {
+        Rvalue::Use(operand) | Rvalue::UnaryOp { operand, .. } | Rvalue::Cast { operand, .. } => {
+            visit_operand(operand, f);
+        }
+        Rvalue::BinaryOp { left, right, .. } => {
+            visit_operand(left, f);
+            visit_operand(right, f);
+        }
+        Rvalue::Aggregate { operands, .. } => {
+            for operand in operands {
+                visit_operand(operand, f);
+            }
+        }
+        Rvalue::Ref { place, .. } | Rvalue::Len(place) => visit_place(place, Access::Borrow, f),
+    }
+}
+
+fn visit_statement(stmt: &MirStatement, f: &mut impl FnMut(&Place, Access)) {
+    match stmt {
+        MirStatement::Assign { dest, value } => {
+            visit_rvalue(value, f);
+            visit_place(dest, Access::Write, f);
+        }
+        MirStatement::Drop(place) => visit_place(place, Access::Write, f),
+        MirStatement::Nop => {}
+    }
+}
+
+fn visit_terminator(term: &MirTerminator, f: &mut impl FnMut(&Place, Access)) {
+    match term {
+        MirTerminator::If { condition, .. } => visit_operand(condition, f),
+        MirTerminator::Switch { value, .. } => visit_operand(value, f),
+        MirTerminator::Call {
+            func, args, dest, ..
+        } => {
+            visit_operand(func, f);
+            for arg in args {
+                visit_operand(arg, f);
+            }
+            visit_place(dest, Access::Write, f);
+        }
+        MirTerminator::Return | MirTerminator::Goto(_) | MirTerminator::Unreachable => {}
+    }
+}
+
+fn visit_body(body: &MirBody, f: &mut impl FnMut(&Place, Access)) {
+    for block in &body.blocks {
+        for stmt in &block.statements {
+            visit_statement(stmt, f);
+        }
+        if let Some(term) = &block.terminator {
+            visit_terminator(term, f);
+        }
+    }
+}
+
+/// Apply `f` to every place in `stmt`, outermost first
+fn rewrite_places(stmt: &mut MirStatement, f: &mut impl FnMut(&mut Place)) {
+    match stmt {
+        MirStatement::Assign { dest, value } => {
+            rewrite_place(dest, f);
+            match value {
+                Rvalue::Use(operand)
+                | Rvalue::UnaryOp { operand, .. }
+                | Rvalue::Cast { operand, .. } => rewrite_operand(operand, f),
+                Rvalue::BinaryOp { left, right, .. } => {
+                    rewrite_operand(left, f);
+                    rewrite_operand(right, f);
+                }
+                Rvalue::Aggregate { operands, .. } => {
+                    for op in operands {
+                        rewrite_operand(op, f);
+                    }
+                }
+                Rvalue::Ref { place, .. } | Rvalue::Len(place) => rewrite_place(place, f),
+            }
+        }
+        MirStatement::Drop(place) => rewrite_place(place, f),
+        MirStatement::Nop => {}
+    }
+}
+
+fn rewrite_terminator(term: &mut MirTerminator, f: &mut impl FnMut(&mut Place)) {
+    match term {
+        MirTerminator::If { condition, .. } => rewrite_operand(condition, f),
+        MirTerminator::Switch { value, .. } => rewrite_operand(value, f),
+        MirTerminator::Call {
+            func, args, dest, ..
+        } => {
+            rewrite_operand(func, f);
+            for arg in args {
+                rewrite_operand(arg, f);
+            }
+            rewrite_place(dest, f);
+        }
+        MirTerminator::Return | MirTerminator::Goto(_) | MirTerminator::Unreachable => {}
+    }
+}
+
+fn rewrite_place(place: &mut Place, f: &mut impl FnMut(&mut Place)) {
+    f(place);
+    for projection in &mut place.projections {
+        if let Projection::Index(operand) = projection {
+            rewrite_operand(operand, f);
+        }
+    }
+}
+
+fn rewrite_operand(operand: &mut Operand, f: &mut impl FnMut(&mut Place)) {
+    if let Operand::Copy(place) | Operand::Move(place) = operand {
+        rewrite_place(place, f);
+    }
+}
+
+/// The local `place` names, if it has no projections
+fn whole_local(place: &Place) -> Option<LocalId> {
+    place.projections.is_empty().then_some(place.local)
+}
+
+/// The local an rvalue copies whole
+fn copied_local(rvalue: &Rvalue) -> Option<LocalId> {
+    match rvalue {
+        Rvalue::Use(Operand::Copy(place) | Operand::Move(place)) => whole_local(place),
+        _ => None,
+    }
+}
+
+/// Whether `local` is a compiler temp rather than a variable, parameter or
+/// the return value
+fn is_temp(body: &MirBody, local: LocalId) -> bool {
+    local.0 > body.arg_count && body.locals[local.0].name.is_none()
+}
+
+/// Fold `t = rvalue; ...; d = t` into `d = rvalue` where `t` is a temp used
+/// nowhere else, and `d = t` directly after a call into `t` into a call
+/// into `d`
+fn propagate_copies(body: &mut MirBody) -> bool {
+    let mut mentions: HashMap<LocalId, usize> = HashMap::new();
+    let mut borrowed = HashSet::new();
+    visit_body(body, &mut |place, access| {
+        *mentions.entry(place.local).or_default() += 1;
+        if access == Access::Borrow {
+            borrowed.insert(place.local);
+        }
+    });
+
+    let mut predecessors = vec![0usize; body.blocks.len()];
+    for term in body.blocks.iter().filter_map(|b| b.terminator.as_ref()) {
+        match term {
+            MirTerminator::Goto(target) | MirTerminator::Call { target, .. } => {
+                predecessors[target.0] += 1;
+            }
+            MirTerminator::If {
+                then_block,
+                else_block,
+                ..
+            } => {
+                predecessors[then_block.0] += 1;
+                predecessors[else_block.0] += 1;
+            }
+            MirTerminator::Switch {
+                targets, default, ..
+            } => {
+                for (_, target) in targets {
+                    predecessors[target.0] += 1;
+                }
+                predecessors[default.0] += 1;
+            }
+            MirTerminator::Return | MirTerminator::Unreachable => {}
+        }
+    }
+    // Calls into a temp, by the block they continue in
+    let mut call_into: HashMap<BlockId, (usize, LocalId)> = HashMap::new();
+    for (i, block) in body.blocks.iter().enumerate() {
+        if let Some(MirTerminator::Call { dest, target, .. }) = &block.terminator
+            && let Some(local) = whole_local(dest)
+            && predecessors[target.0] == 1
+        {
+            call_into.insert(*target, (i, local));
+        }
+    }
+
+    let mut changed = false;
+    for b in 0..body.blocks.len() {
+        for j in 0..body.blocks[b].statements.len() {
+            let MirStatement::Assign { dest, value } = &body.blocks[b].statements[j] else {
+                continue;
+            };
+            let Some(temp) = copied_local(value) else {
+                continue;
+            };
+            // The definition and this copy are the only mentions
+            if !is_temp(body, temp) || mentions.get(&temp) != Some(&2) {
+                continue;
+            }
+            let dest = dest.clone();
+            let statements = &body.blocks[b].statements;
+
+            let def = statements[..j].iter().rposition(|stmt| {
+                matches!(stmt, MirStatement::Assign { dest, .. } if whole_local(dest) == Some(temp))
+            });
+            if let Some(i) = def {
+                // Nothing in between may see `dest` written early
+                let mut dest_locals = HashSet::new();
+                visit_place(&dest, Access::Write, &mut |place, _| {
+                    dest_locals.insert(place.local);
+                });
+                let aliased = borrowed.contains(&dest.local)
+                    || dest
+                        .projections
+                        .iter()
+                        .any(|p| matches!(p, Projection::Deref));
+                let mut clash = false;
+                for stmt in &statements[i + 1..j] {
+                    visit_statement(stmt, &mut |place, _| {
+                        clash |= dest_locals.contains(&place.local)
+                            || (aliased
+                                && place
+                                    .projections
+                                    .iter()
+                                    .any(|p| matches!(p, Projection::Deref)));
+                    });
+                }
+                if clash {
+                    continue;
+                }
+                let statements = &mut body.blocks[b].statements;
+                if let MirStatement::Assign { dest: def_dest, .. } = &mut statements[i] {
+                    *def_dest = dest;
+                }
+                statements[j] = MirStatement::Nop;
+                changed = true;
+            } else if let Some(&(caller, local)) = call_into.get(&BlockId(b))
+                && local == temp
+                && dest.projections.is_empty()
+                && statements[..j]
+                    .iter()
+                    .all(|stmt| matches!(stmt, MirStatement::Nop))
+            {
+                if let Some(MirTerminator::Call {
+                    dest: call_dest, ..
+                }) = &mut body.blocks[caller].terminator
+                {
+                    *call_dest = dest;
+                }
+                body.blocks[b].statements[j] = MirStatement::Nop;
+                changed = true;
+            }
+        }
+    }
+
+    for block in &mut body.blocks {
+        block
+            .statements
+            .retain(|stmt| !matches!(stmt, MirStatement::Nop));
+    }
+    changed
+}
+
+/// Field names and types of a struct or tuple type
+fn layout(ty: &RustType, structs: &StructFields) -> Option<Vec<(String, RustType)>> {
+    match &ty.kind {
+        RustTypeKind::Tuple(types) if !types.is_empty() => Some(
+            types
+                .iter()
+                .enumerate()
+                .map(|(i, ty)| (i.to_string(), ty.clone()))
+                .collect(),
+        ),
+        RustTypeKind::Named(path) => structs.get(path.name()).filter(|f| !f.is_empty()).cloned(),
+        _ => None,
+    }
+}
+
+/// Replace struct and tuple locals whose fields are only ever used one at
+/// a time with a local per field
+fn scalar_replace(body: &mut MirBody, structs: &StructFields) -> bool {
+    // Locals already split are no longer mentioned
+    let mut mentioned = HashSet::new();
+    visit_body(body, &mut |place, _| {
+        mentioned.insert(place.local);
+    });
+    let mut layouts: HashMap<LocalId, Vec<(String, RustType)>> = body
+        .locals
+        .iter()
+        .filter(|local| local.id.0 > body.arg_count && mentioned.contains(&local.id))
+        .filter_map(|local| Some((local.id, layout(&local.ty, structs)?)))
+        .collect();
+    if layouts.is_empty() {
+        return false;
+    }
+
+    // Locals that must stay whole
+    let mut whole = HashSet::new();
+    // Whole-local copies, which can be split if both sides are
+    let mut copies = Vec::new();
+    let mut check = |place: &Place, access: Access| {
+        let Some(fields) = layouts.get(&place.local) else {
+            return;
+        };
+        let field_access = match place.projections.first() {
+            Some(Projection::Field(i)) => *i < fields.len(),
+            _ => false,
+        };
+        if access == Access::Borrow || !field_access {
+            whole.insert(place.local);
+        }
+    };
+    for block in &body.blocks {
+        for stmt in &block.statements {
+            if let MirStatement::Assign { dest, value } = stmt
+                && let Some(local) = whole_local(dest)
+            {
+                match value {
+                    Rvalue::Aggregate {
+                        kind: AggregateKind::Tuple | AggregateKind::Struct(_),
+                        operands,
+                    } => {
+                        if layouts
+                            .get(&local)
+                            .is_some_and(|f| f.len() != operands.len())
+                        {
+                            // Field counts disagree: leave it alone
+                            visit_place(dest, Access::Borrow, &mut check);
+                        }
+                        visit_rvalue(value, &mut check);
+                        continue;
+                    }
+                    _ => {
+                        if let Some(src) = copied_local(value)
+                            && src != local
+                        {
+                            copies.push((local, src));
+                            continue;
+                        }
+                    }
+                }
+            }
+            visit_statement(stmt, &mut check);
+        }
+        if let Some(term) = &block.terminator {
+            visit_terminator(term, &mut check);
+        }
+    }
+    loop {
+        let before = whole.len();
+        for &(dest, src) in &copies {
+            let same_shape = match (layouts.get(&dest), layouts.get(&src)) {
+                (Some(d), Some(s)) => d.len() == s.len(),
+                _ => false,
+            };
+            if !same_shape || whole.contains(&dest) || whole.contains(&src) {
+                whole.insert(dest);
+                whole.insert(src);
+            }
+        }
+        if whole.len() == before {
+            break;
+        }
+    }
+    layouts.retain(|local, _| !whole.contains(local));
+    if layouts.is_empty() {
+        return false;
+    }
+
+    let mut candidates: Vec<_> = layouts.into_iter().collect();
+    candidates.sort_by_key(|(local, _)| local.0);
+    let mut split: HashMap<LocalId, Vec<LocalId>> = HashMap::new();
+    for (local, fields) in candidates {
+        let name = body.locals[local.0].name.clone();
+        let locals = fields
+            .into_iter()
+            .map(|(field, ty)| {
+                let field_name = name.as_ref().map(|n| format!("{n}.{field}"));
+                body.add_local(ty, field_name)
+            })
+            .collect();
+        split.insert(local, locals);
+    }
+
+    let mut to_field = |place: &mut Place| {
+        if let Some(fields) = split.get(&place.local)
+            && let Some(&Projection::Field(i)) = place.projections.first()
+        {
+            place.local = fields[i];
+            place.projections.remove(0);
+        }
+    };
+    for b in 0..body.blocks.len() {
+        let statements = std::mem::take(&mut body.blocks[b].statements);
+        let mut out = Vec::with_capacity(statements.len());
+        for mut stmt in statements {
+            let MirStatement::Assign { dest, value } = &mut stmt else {
+                rewrite_places(&mut stmt, &mut to_field);
+                out.push(stmt);
+                continue;
+            };
+            let Some(fields) = whole_local(dest).and_then(|l| split.get(&l)) else {
+                rewrite_places(&mut stmt, &mut to_field);
+                out.push(stmt);
+                continue;
+            };
+            let fields = fields.clone();
+            match value {
+                Rvalue::Aggregate { operands, .. } => {
+                    let mut operands = std::mem::take(operands);
+                    for op in &mut operands {
+                        rewrite_operand(op, &mut to_field);
+                    }
+                    // `p = (p.1, p.0)` must read every field before writing any
+                    let reads_own = operands.iter().any(|op| {
+                        matches!(op, Operand::Copy(p) | Operand::Move(p) if fields.contains(&p.local))
+                    });
+                    if reads_own {
+                        for (field, operand) in fields.iter().zip(&mut operands) {
+                            let ty = body.locals[field.0].ty.clone();
+                            let temp = body.add_local(ty, None);
+                            let value = Rvalue::Use(std::mem::replace(
+                                operand,
+                                Operand::Copy(Place::local(temp)),
+                            ));
+                            out.push(MirStatement::Assign {
+                                dest: Place::local(temp),
+                                value,
+                            });
+                        }
+                    }
+                    for (field, operand) in fields.iter().zip(operands) {
+                        out.push(MirStatement::Assign {
+                            dest: Place::local(*field),
+                            value: Rvalue::Use(operand),
+                        });
+                    }
+                }
+                Rvalue::Use(operand) => {
+                    let moved = matches!(operand, Operand::Move(_));
+                    let (Operand::Copy(src) | Operand::Move(src)) = operand else {
+                        unreachable!("only whole-local copies reach here");
+                    };
+                    for (&field, &from) in fields.iter().zip(&split[&src.local]) {
+                        let from = Place::local(from);
+                        out.push(MirStatement::Assign {
+                            dest: Place::local(field),
+                            value: Rvalue::Use(if moved {
+                                Operand::Move(from)
+                            } else {
+                                Operand::Copy(from)
+                            }),
+                        });
+                    }
+                }
+                _ => unreachable!("split locals are only assigned whole by aggregates or copies"),
+            }
+        }
+        body.blocks[b].statements = out;
+        if let Some(term) = &mut body.blocks[b].terminator {
+            rewrite_terminator(term, &mut to_field);
+        }
+    }
+    true
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::frontend::rust::ast::{ItemKind, StructKind};
+    use crate::frontend::rust::mir::MirLowerer;
+    use crate::frontend::rust::{RustAnalyzer, RustParser};
+
+    /// Lower and optimize the last function in `source`
+    fn optimized(source: &str) -> MirBody {
+        let mut module = RustParser::new(source).parse_module().unwrap();
+        RustAnalyzer::new().analyze(&mut module).unwrap();
+        let mut structs = StructFields::new();
+        let mut func = None;
+        for item in &module.items {
+            match &item.kind {
+                ItemKind::Struct(s) => {
+                    if let StructKind::Named(fields) = &s.kind {
+                        let fields = fields
+                            .iter()
+                            .map(|f| (f.name.clone(), f.ty.clone()))
+                            .collect();
+                        structs.insert(s.name.clone(), fields);
+                    }
+                }
+                ItemKind::Fn(f) => func = Some(f),
+                _ => {}
+            }
+        }
+        let func = func.unwrap();
+        let return_type = func.return_type.clone().unwrap();
+        let mut body = MirLowerer::new(return_type)
+            .with_struct_fields(structs.clone())
+            .lower_function(func)
+            .unwrap();
+        optimize(&mut body, &structs);
+        body
+    }
+
+    fn statements(body: &MirBody) -> impl Iterator<Item = &MirStatement> {
+        body.blocks.iter().flat_map(|b| &b.statements)
+    }
+
+    /// Locals that are still read or written through a field
+    fn field_places(body: &MirBody) -> usize {
+        let mut count = 0;
+        visit_body(body, &mut |place, _| {
+            count += usize::from(matches!(
+                place.projections.first(),
+                Some(Projection::Field(_))
+            ));
+        });
+        count
+    }
+
+    /// Evaluate a straight-line body of scalar locals
+    fn run(body: &MirBody, args: &[i64]) -> i64 {
+        let mut values = vec![0; body.locals.len()];
+        values[1..=args.len()].copy_from_slice(args);
+        let read = |values: &[i64], op: &Operand| match op {
+            Operand::Copy(place) | Operand::Move(place) => {
+                assert!(place.projections.is_empty(), "{place:?}");
+                values[place.local.0]
+            }
+            Operand::Constant(MirConstant::Int(v)) => *v,
+            other => panic!("{other:?}"),
+        };
+        for stmt in statements(body) {
+            let MirStatement::Assign { dest, value } = stmt else {
+                continue;
+            };
+            assert!(dest.projections.is_empty(), "{dest:?}");
+            values[dest.local.0] = match value {
+                Rvalue::Use(op) => read(&values, op),
+                Rvalue::BinaryOp { op, left, right } => {
+                    let (l, r) = (read(&values, left), read(&values, right));
+                    match op {
+                        MirBinOp::Add => l + r,
+                        MirBinOp::Sub => l - r,
+                        MirBinOp::Mul => l * r,
+                        _ => panic!("{op:?}"),
+                    }
+                }
+                other => panic!("{other:?}"),
+            };
+        }
+        values[0]
+    }
+
+    #[test]
+    fn test_temp_folded_into_destination() {
+        let body = optimized("fn f(a: i32, b: i32) -> i32 { let x = a + b; x * 2 }");
+        // x = a + b; _0 = x * 2
+        let stmts: Vec<_> = statements(&body).collect();
+        assert_eq!(stmts.len(), 2, "{stmts:?}");
+        assert!(matches!(
+            stmts[0],
+            MirStatement::Assign { dest, value: Rvalue::BinaryOp { op: MirBinOp::Add, .. } }
+                if body.locals[dest.local.0].name.as_deref() == Some("x")
+        ));
+        assert!(matches!(
+            stmts[1],
+            MirStatement::Assign { dest, value: Rvalue::BinaryOp { op: MirBinOp::Mul, .. } }
+                if dest.local == LocalId(0)
+        ));
+    }
+
+    #[test]
+    fn test_call_result_stored_directly() {
+        let body = optimized("fn g() -> i32 { 1 } fn f() -> i32 { let x = g(); x }");
+        let call_dest = body.blocks.iter().find_map(|b| match &b.terminator {
+            Some(MirTerminator::Call { dest, .. }) => Some(dest.local),
+            _ => None,
+        });
+        assert_eq!(body.locals[call_dest.unwrap().0].name.as_deref(), Some("x"));
+    }
+
+    #[test]
+    fn test_struct_split_into_fields() {
+        let body = optimized(
+            "struct Vec2 { x: i32, y: i32 }
+             fn f(a: i32, b: i32) -> i32 {
+                 let p = Vec2 { y: b, x: a };
+                 let q = p;
+                 q.x - q.y
+             }",
+        );
+        assert_eq!(field_places(&body), 0);
+        assert!(statements(&body).all(|s| !matches!(
+            s,
+            MirStatement::Assign {
+                value: Rvalue::Aggregate { .. },
+                ..
+            }
+        )));
+        // q.x - q.y reads the fields p.x = a and p.y = b were copied from
+        let names = |op: &Operand| match op {
+            Operand::Copy(place) => body.locals[place.local.0].name.clone(),
+            _ => None,
+        };
+        let sub = statements(&body).find_map(|s| match s {
+            MirStatement::Assign {
+                value: Rvalue::BinaryOp { left, right, .. },
+                ..
+            } => Some((names(left), names(right))),
+            _ => None,
+        });
+        assert_eq!(
+            sub,
+            Some((Some("q.x".to_string()), Some("q.y".to_string())))
+        );
+        assert_eq!(run(&body, &[7, 3]), 4);
+    }
+
+    #[test]
+    fn test_nested_tuple_split() {
+        let body = optimized(
+            "struct Vec2 { x: i32, y: i32 }
+             fn f(a: i32) -> i32 {
+                 let t = (Vec2 { x: a, y: 2 }, 3);
+                 t.0.y + t.1
+             }",
+        );
+        assert_eq!(field_places(&body), 0);
+        assert_eq!(run(&body, &[5]), 5);
+    }
+
+    #[test]
+    fn test_swap_reads_before_writing() {
+        let body = optimized(
+            "fn f(a: i32, b: i32) -> i32 {
+                 let mut t = (a, b);
+                 t = (t.1, t.0);
+                 t.0 * 10 + t.1
+             }",
+        );
+        assert_eq!(field_places(&body), 0);
+        assert_eq!(run(&body, &[1, 2]), 21);
+    }
+
+    #[test]
+    fn test_borrowed_struct_kept_whole() {
+        let body = optimized(
+            "struct Vec2 { x: i32, y: i32 }
+             fn f(a: i32) -> i32 {
+                 let p = Vec2 { x: a, y: 2 };
+                 let r = &p;
+                 p.y
+             }",
+        );
+        assert_eq!(field_places(&body), 1);
+    }
+}
@@ -1,6 +1,7 @@
 //! Convert MIR to the shared IR
 
 use super::types::*;
+use crate::common::Symbol;
 use crate::frontend::rust::ast::RustTypeKind;
 use crate::ir::{BinOp as IrBinOp, Inst, IrFunction, Label, Temp, UnOp as IrUnOp, Value};
 use crate::types::IrType;
@@ -52,8 +53,8 @@ impl<'a> MirToIr<'a> {
 
         // Create labels for all blocks (include function name for uniqueness)
         for block in &mir.blocks {
-            let label = Label(format!(".L{}_bb{}", self.func_name, block.id.0));
-            self.block_to_label.insert(block.id, label.clone());
+            let label = Label(format!(".L{}_bb{}", self.func_name, block.id.0).into());
+            self.block_to_label.insert(block.id, label);
         }
 
         // Emit LoadParam instructions for function parameters
@@ -78,6 +79,7 @@ impl<'a> MirToIr<'a> {
                     size,
                     volatile: false,
                     signed: true,
+                    width: 4,
                 });
             }
         }
@@ -96,6 +98,7 @@ impl<'a> MirToIr<'a> {
             return_type,
             blocks: std::mem::take(&mut self.blocks),
             locals: Vec::new(),
+            internal: false,
         }
     }
 
@@ -164,6 +167,18 @@ impl<'a> MirToIr<'a> {
         4
     }
 
+    /// Whether the pointee of a dereferenced place is a signed integer
+    fn get_deref_signed(&self, place: &Place) -> bool {
+        if let Some(mir) = self.mir_body
+            && let Some(local) = mir.locals.get(place.local.0)
+            && let RustTypeKind::Pointer { inner, .. } = &local.ty.kind
+            && let RustTypeKind::Primitive(p) = &inner.kind
+        {
+            return p.is_signed();
+        }
+        true
+    }
+
     fn convert_rvalue(&mut self, dest: Temp, rvalue: &Rvalue) {
         match rvalue {
             Rvalue::Use(operand) => {
@@ -171,6 +186,7 @@ impl<'a> MirToIr<'a> {
                 self.emit(Inst::Copy {
                     dst: dest,
                     src: value,
+                    width: 4,
                 });
             }
             Rvalue::Ref { place, .. } => {
@@ -180,6 +196,7 @@ impl<'a> MirToIr<'a> {
                 self.emit(Inst::Copy {
                     dst: dest,
                     src: Value::Temp(base_temp),
+                    width: 4,
                 });
             }
             Rvalue::BinaryOp { op, left, right } => {
@@ -191,6 +208,7 @@ impl<'a> MirToIr<'a> {
                     op: ir_op,
                     left: left_val,
                     right: right_val,
+                    width: 4,
                 });
             }
             Rvalue::UnaryOp { op, operand } => {
@@ -200,6 +218,7 @@ impl<'a> MirToIr<'a> {
                     dst: dest,
                     op: ir_op,
                     src: val,
+                    width: 4,
                 });
             }
             Rvalue::Cast { operand, .. } => {
@@ -208,6 +227,7 @@ impl<'a> MirToIr<'a> {
                 self.emit(Inst::Copy {
                     dst: dest,
                     src: val,
+                    width: 4,
                 });
             }
             Rvalue::Aggregate { operands, .. } => {
@@ -219,12 +239,14 @@ impl<'a> MirToIr<'a> {
                         self.emit(Inst::Copy {
                             dst: dest,
                             src: val,
+                            width: 4,
                         });
                     } else {
                         let field_temp = self.new_temp();
                         self.emit(Inst::Copy {
                             dst: field_temp,
                             src: val,
+                            width: 4,
                         });
                     }
                 }
@@ -234,6 +256,7 @@ impl<'a> MirToIr<'a> {
                 self.emit(Inst::Copy {
                     dst: dest,
                     src: Value::IntConst(0),
+                    width: 4,
                 });
             }
         }
@@ -271,27 +294,17 @@ impl<'a> MirToIr<'a> {
                 targets,
                 default,
             } => {
-                let val = self.operand_to_value(value);
-                let default_label = self.get_block_label(default);
-
-                // Generate comparisons for each target
-                for (const_val, target) in targets {
-                    let target_label = self.get_block_label(target);
-                    let cmp_temp = self.new_temp();
-
-                    self.emit(Inst::Binary {
-                        dst: cmp_temp,
-                        op: IrBinOp::Eq,
-                        left: val.clone(),
-                        right: Value::IntConst(*const_val),
-                    });
-                    self.emit(Inst::CondJump {
-                        cond: Value::Temp(cmp_temp),
-                        target: target_label,
-                    });
-                }
-
-                self.emit(Inst::Jump(default_label));
+                let value = self.operand_to_value(value);
+                let cases = targets
+                    .iter()
+                    .map(|(const_val, target)| (*const_val, self.get_block_label(target)))
+                    .collect();
+                let default = self.get_block_label(default);
+                self.emit(Inst::Switch {
+                    value,
+                    cases,
+                    default,
+                });
             }
             MirTerminator::Call {
                 func,
@@ -309,7 +322,7 @@ impl<'a> MirToIr<'a> {
                 let dest_temp = self.place_to_temp(dest);
                 self.emit(Inst::Call {
                     dst: Some(dest_temp),
-                    func: func_name,
+                    func: func_name.into(),
                     args: arg_values,
                 });
 
@@ -327,8 +340,8 @@ impl<'a> MirToIr<'a> {
     fn get_block_label(&self, block_id: &BlockId) -> Label {
         self.block_to_label
             .get(block_id)
-            .cloned()
-            .unwrap_or_else(|| Label(format!("bb_unknown_{}", block_id.0)))
+            .copied()
+            .unwrap_or_else(|| Label(format!("bb_unknown_{}", block_id.0).into()))
     }
 
     /// Get the IR temp for a MIR local, with fallback for missing locals
@@ -350,13 +363,15 @@ impl<'a> MirToIr<'a> {
                     // Load through pointer
                     let addr_temp = self.get_local_temp(&place.local);
                     let size = self.get_deref_size(place);
+                    let signed = self.get_deref_signed(place);
                     let result_temp = self.new_temp();
                     self.emit(Inst::Load {
                         dst: result_temp,
                         addr: Value::Temp(addr_temp),
                         size,
                         volatile: false,
-                        signed: true,
+                        signed,
+                        width: 4,
                     });
                     Value::Temp(result_temp)
                 } else {
@@ -371,19 +386,34 @@ impl<'a> MirToIr<'a> {
                     MirConstant::Char(v) => Value::IntConst(*v as i64),
                     MirConstant::String(s) => {
                         // Create a label for the string
-                        Value::StringConst(Label(format!("str_{}", s.len())))
+                        Value::StringConst(Label(format!("str_{}", s.len()).into()))
                     }
                     MirConstant::Unit => Value::IntConst(0),
-                    MirConstant::Function(name) => Value::Name(name.clone()),
+                    MirConstant::Function(name) => Value::Name(Symbol::from(name.as_str())),
+                    MirConstant::StaticAddr(name) => {
+                        let result_temp = self.new_temp();
+                        self.emit(Inst::AddrOf {
+                            dst: result_temp,
+                            name: Symbol::from(name.as_str()),
+                        });
+                        Value::Temp(result_temp)
+                    }
                     MirConstant::Static(name) => {
-                        // Static variables need to be loaded from their address
+                        // Static variables need to be loaded from their address;
+                        // a `Name` operand would already be the static's value
+                        let addr = self.new_temp();
+                        self.emit(Inst::AddrOf {
+                            dst: addr,
+                            name: Symbol::from(name.as_str()),
+                        });
                         let result_temp = self.new_temp();
                         self.emit(Inst::Load {
                             dst: result_temp,
-                            addr: Value::Name(name.clone()),
+                            addr: Value::Temp(addr),
                             size: 4, // Assume i32 for now
                             volatile: false,
                             signed: true,
+                            width: 4,
                         });
                         Value::Temp(result_temp)
                     }
@@ -429,7 +459,7 @@ impl<'a> MirToIr<'a> {
     fn new_label(&mut self, prefix: &str) -> Label {
         let id = self.next_label;
         self.next_label += 1;
-        Label(format!(".L{}_{}{}", self.func_name, prefix, id))
+        Label(format!(".L{}_{}{}", self.func_name, prefix, id).into())
     }
 
     fn emit(&mut self, inst: Inst) {
@@ -437,7 +467,7 @@ impl<'a> MirToIr<'a> {
             self.blocks.push(crate::ir::BasicBlock::new(label));
         } else {
             if self.blocks.is_empty() {
-                let entry_label = Label(format!(".L{}_entry", self.func_name));
+                let entry_label = Label(format!(".L{}_entry", self.func_name).into());
                 self.blocks.push(crate::ir::BasicBlock::new(entry_label));
             }
             if let Some(block) = self.blocks.last_mut() {
@@ -452,3 +482,64 @@ impl Default for MirToIr<'_> {
         Self::new()
     }
 }
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::frontend::rust::ast::ItemKind;
+    use crate::frontend::rust::mir::MirLowerer;
+    use crate::frontend::rust::{RustAnalyzer, RustParser};
+    use std::collections::HashSet;
+
+    /// Lower the last function in `source` to IR, with its statics known
+    fn convert(source: &str) -> IrFunction {
+        let mut module = RustParser::new(source).parse_module().unwrap();
+        RustAnalyzer::new().analyze(&mut module).unwrap();
+        let mut statics = HashSet::new();
+        let mut func = None;
+        for item in &module.items {
+            match &item.kind {
+                ItemKind::Static(s) => {
+                    statics.insert(s.name.clone());
+                }
+                ItemKind::Fn(f) => func = Some(f),
+                _ => {}
+            }
+        }
+        let func = func.unwrap();
+        let return_type = func.return_type.clone().unwrap();
+        let body = MirLowerer::with_constants(return_type, HashMap::new(), statics)
+            .lower_function(func)
+            .unwrap();
+        MirToIr::new().convert(func.name.clone(), &body)
+    }
+
+    #[test]
+    fn test_static_read_loads_from_its_address() {
+        let func = convert(
+            "static LIMIT: i32 = 40;
+             fn limit() -> i32 { LIMIT + 2 }",
+        );
+        let insts: Vec<_> = func.blocks.iter().flat_map(|b| &b.insts).collect();
+        let addr = insts
+            .iter()
+            .find_map(|s| match &s.inst {
+                Inst::AddrOf { dst, name } if name.as_str() == "LIMIT" => Some(*dst),
+                _ => None,
+            })
+            .expect("no address taken of LIMIT");
+        // A `Name` operand is the static's value, so loading through one
+        // would read from the address the static holds
+        for s in &insts {
+            if let Inst::Load { addr: a, .. } = &s.inst {
+                assert!(!matches!(a, Value::Name(_)), "{:?}", s.inst);
+            }
+        }
+        assert!(
+            insts
+                .iter()
+                .any(|s| matches!(&s.inst, Inst::Load { addr: Value::Temp(t), .. } if *t == addr)),
+            "LIMIT is not loaded through its address"
+        );
+    }
+}
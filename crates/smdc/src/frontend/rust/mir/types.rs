@@ -1,6 +1,10 @@
 //! MIR type definitions
 
 use crate::frontend::rust::ast::RustType;
+use std::collections::HashMap;
+
+/// Fields of each struct in declaration order, by struct name
+pub type StructFields = HashMap<String, Vec<(String, RustType)>>;
 
 /// A MIR function body
 #[derive(Debug, Clone)]
@@ -231,6 +235,8 @@ pub enum MirConstant {
     Function(String),
     /// Static/global variable reference
     Static(String),
+    /// Address of a static or const item
+    StaticAddr(String),
 }
 
 /// Binary operations in MIR
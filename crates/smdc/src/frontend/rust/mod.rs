@@ -5,6 +5,7 @@
 //! target the Sega Megadrive/Genesis.
 
 pub mod ast;
+pub mod consteval;
 pub mod lexer;
 pub mod mir;
 pub mod parser;
@@ -14,9 +15,11 @@ pub use lexer::RustLexer;
 pub use parser::RustParser;
 pub use sema::RustAnalyzer;
 
-use crate::common::CompileResult;
+use crate::common::{CompileError, CompileResult, Span, stats};
 use crate::frontend::{CompileContext, Frontend, FrontendConfig};
 use crate::ir::{IrGlobal, IrModule};
+use crate::types::IrType;
+use consteval::{ConstEvaluator, ConstValue};
 use std::collections::{HashMap, HashSet};
 
 /// Rust language frontend
@@ -49,8 +52,8 @@ impl Frontend for RustFrontend {
         ctx: &CompileContext,
         config: &FrontendConfig,
     ) -> CompileResult<IrModule> {
-        use ast::ItemKind;
-        use mir::{MirLowerer, MirToIr};
+        use ast::{ItemKind, StructKind};
+        use mir::{MirLowerer, MirToIr, StructFields};
 
         // Phase 1: Lexing (optional token dump)
         if config.dump_tokens {
@@ -70,13 +73,16 @@ impl Frontend for RustFrontend {
             }
         }
 
-        // Phase 2: Parsing
+        stats::count("source bytes", source.len() as u64);
+        stats::count("source lines", source.lines().count() as u64);
+
+        // Phase 2: Parsing, lexing on demand
         if config.verbose {
             eprintln!("Parsing Rust...");
         }
 
         let mut parser = RustParser::new(source);
-        let mut module = match parser.parse_module() {
+        let mut module = match stats::time("parse", || parser.parse_module()) {
             Ok(m) => m,
             Err(e) => {
                 ctx.reporter.report_error(ctx.file_id, &e);
@@ -96,7 +102,7 @@ impl Frontend for RustFrontend {
         }
 
         let mut analyzer = RustAnalyzer::new();
-        if let Err(e) = analyzer.analyze(&mut module) {
+        if let Err(e) = stats::time("sema", || analyzer.analyze(&mut module)) {
             ctx.reporter.report_error(ctx.file_id, &e);
             return Err(e);
         }
@@ -108,32 +114,101 @@ impl Frontend for RustFrontend {
 
         let mut ir_module = IrModule::new();
 
-        // First pass: collect const values and add statics as globals
+        // First pass: evaluate consts and statics, and collect struct
+        // layouts. Scalar consts are inlined where used; const arrays and
+        // statics become globals holding their evaluated bytes.
         let mut const_values: HashMap<String, i64> = HashMap::new();
         let mut static_names: HashSet<String> = HashSet::new();
+        let mut global_arrays: HashMap<String, ast::RustType> = HashMap::new();
+        let mut struct_fields = StructFields::new();
+        let mut evaluator = ConstEvaluator::new(&module.items);
 
         for item in &module.items {
             match &item.kind {
                 ItemKind::Const(c) => {
-                    // Evaluate const value (only integer literals for now)
-                    if let Some(value) = Self::eval_const_expr(&c.value) {
-                        const_values.insert(c.name.clone(), value);
+                    let value = stats::time("consteval", || {
+                        Self::eval_global(&mut evaluator, &c.name, &c.ty, c.span)
+                    });
+                    match value {
+                        Ok(Some(ConstValue::Int(value))) => {
+                            const_values.insert(c.name.clone(), value);
+                        }
+                        Ok(Some(value)) => {
+                            let init = Self::global_bytes(&value, &c.ty, c.span);
+                            let init = match init {
+                                Ok(init) => init,
+                                Err(e) => {
+                                    ctx.reporter.report_error(ctx.file_id, &e);
+                                    return Err(e);
+                                }
+                            };
+                            if let ast::RustTypeKind::Array { element, .. } = &c.ty.kind {
+                                global_arrays.insert(c.name.clone(), (**element).clone());
+                            }
+                            ir_module.globals.push(IrGlobal {
+                                name: c.name.clone(),
+                                ty: Self::ir_type(&c.ty),
+                                init: Some(init),
+                                readonly: true,
+                                internal: false,
+                            });
+                        }
+                        Ok(None) => {}
+                        Err(e) => {
+                            ctx.reporter.report_error(ctx.file_id, &e);
+                            return Err(e);
+                        }
                     }
                 }
+                ItemKind::Struct(s) => {
+                    let fields = match &s.kind {
+                        StructKind::Named(fields) => fields
+                            .iter()
+                            .map(|f| (f.name.clone(), f.ty.clone()))
+                            .collect(),
+                        StructKind::Tuple(fields) => fields
+                            .iter()
+                            .enumerate()
+                            .map(|(i, f)| (i.to_string(), f.ty.clone()))
+                            .collect(),
+                        StructKind::Unit => Vec::new(),
+                    };
+                    struct_fields.insert(s.name.clone(), fields);
+                }
                 ItemKind::Static(s) => {
                     static_names.insert(s.name.clone());
 
-                    // Add to IR globals with initial value
-                    let init_value = Self::eval_const_expr(&s.value);
-                    let init_bytes = init_value.map(|v| {
-                        // Convert i64 to 4 bytes (i32)
-                        (v as i32).to_be_bytes().to_vec()
+                    let value = stats::time("consteval", || {
+                        Self::eval_global(&mut evaluator, &s.name, &s.ty, s.span)
                     });
+                    let (ty, init) = match value {
+                        // Scalar statics are held as i32
+                        Ok(Some(ConstValue::Int(value))) => {
+                            (IrType::i32(), Some((value as i32).to_be_bytes().to_vec()))
+                        }
+                        Ok(Some(value)) => match Self::global_bytes(&value, &s.ty, s.span) {
+                            Ok(init) => (Self::ir_type(&s.ty), Some(init)),
+                            Err(e) => {
+                                ctx.reporter.report_error(ctx.file_id, &e);
+                                return Err(e);
+                            }
+                        },
+                        Ok(None) => (IrType::i32(), None),
+                        Err(e) => {
+                            ctx.reporter.report_error(ctx.file_id, &e);
+                            return Err(e);
+                        }
+                    };
+                    if let ast::RustTypeKind::Array { element, .. } = &s.ty.kind {
+                        global_arrays.insert(s.name.clone(), (**element).clone());
+                    }
 
                     ir_module.globals.push(IrGlobal {
                         name: s.name.clone(),
-                        ty: crate::types::IrType::i32(), // Use i32 for now
-                        init: init_bytes,
+                        ty,
+                        init,
+                        readonly: !s.mutable,
+                        internal: false,
                     });
                 }
                 _ => {}
@@ -156,14 +231,17 @@ impl Frontend for RustFrontend {
                     return_type,
                     const_values.clone(),
                     static_names.clone(),
-                );
-                let mir_body = match lowerer.lower_function(func) {
+                )
+                .with_struct_fields(struct_fields.clone())
+                .with_global_arrays(global_arrays.clone());
+                let mut mir_body = match stats::time("mir", || lowerer.lower_function(func)) {
                     Ok(m) => m,
                     Err(e) => {
                         ctx.reporter.report_error(ctx.file_id, &e);
                         return Err(e);
                     }
                 };
+                stats::time("mir-opt", || mir::optimize(&mut mir_body, &struct_fields));
 
                 if config.dump_mir {
                     eprintln!("=== MIR for {} ===", func.name);
@@ -173,7 +251,8 @@ impl Frontend for RustFrontend {
 
                 // Convert MIR to shared IR
                 let mut converter = MirToIr::new();
-                let ir_func = converter.convert(func.name.clone(), &mir_body);
+                let ir_func =
+                    stats::time("lower", || converter.convert(func.name.clone(), &mir_body));
                 ir_module.functions.push(ir_func);
             }
         }
@@ -204,46 +283,56 @@ impl Frontend for RustFrontend {
 }
 
 impl RustFrontend {
-    /// Evaluate a constant expression to an integer value
-    fn eval_const_expr(expr: &ast::Expr) -> Option<i64> {
-        use ast::BinOp;
-        use ast::ExprKind;
-        use ast::UnaryOp;
-
-        match &expr.kind {
-            ExprKind::IntLiteral(v) => Some(*v),
-            ExprKind::BoolLiteral(b) => Some(i64::from(*b)),
-            ExprKind::CharLiteral(c) => Some(*c as i64),
-            ExprKind::Unary { op, operand } => {
-                let val = Self::eval_const_expr(operand)?;
-                match op {
-                    UnaryOp::Neg => Some(-val),
-                    UnaryOp::Not => Some(!val),
-                    _ => None,
-                }
-            }
-            ExprKind::Binary { op, left, right } => {
-                let l = Self::eval_const_expr(left)?;
-                let r = Self::eval_const_expr(right)?;
-                match op {
-                    BinOp::Add => Some(l + r),
-                    BinOp::Sub => Some(l - r),
-                    BinOp::Mul => Some(l * r),
-                    BinOp::Div => Some(l / r),
-                    BinOp::Rem => Some(l % r),
-                    BinOp::BitAnd => Some(l & r),
-                    BinOp::BitOr => Some(l | r),
-                    BinOp::BitXor => Some(l ^ r),
-                    BinOp::Shl => Some(l << r),
-                    BinOp::Shr => Some(l >> r),
-                    _ => None,
-                }
-            }
-            ExprKind::Cast { expr, .. } => {
-                // For casts, just pass through the value (simplification)
-                Self::eval_const_expr(expr)
-            }
-            _ => None,
+    /// Evaluate the const or static `name` of type `ty`. Items of other
+    /// types than integers and arrays of them give `None`, as constants
+    /// cannot hold them yet.
+    fn eval_global(
+        evaluator: &mut ConstEvaluator,
+        name: &str,
+        ty: &ast::RustType,
+        span: Span,
+    ) -> CompileResult<Option<ConstValue>> {
+        match evaluator.eval_item(name, span) {
+            Ok(value) => Ok(Some(value)),
+            Err(_) if !Self::is_plain_data(ty) => Ok(None),
+            Err(e) => Err(e),
+        }
+    }
+
+    /// Whether `ty` is an integer, `bool`, `char` or an array of them
+    fn is_plain_data(ty: &ast::RustType) -> bool {
+        use ast::{PrimitiveType, RustTypeKind};
+
+        match &ty.kind {
+            RustTypeKind::Primitive(PrimitiveType::Bool | PrimitiveType::Char) => true,
+            RustTypeKind::Array { element, .. } => Self::is_plain_data(element),
+            _ => ty.is_integer(),
+        }
+    }
+
+    /// The ROM image of `value` as type `ty`
+    fn global_bytes(value: &ConstValue, ty: &ast::RustType, span: Span) -> CompileResult<Vec<u8>> {
+        let mut bytes = Vec::with_capacity(ty.size());
+        value
+            .to_bytes(ty, &mut bytes)
+            .map_err(|message| CompileError::type_error(message, span))?;
+        Ok(bytes)
+    }
+
+    /// The IR type of a const or static
+    fn ir_type(ty: &ast::RustType) -> IrType {
+        use ast::{PrimitiveType, RustTypeKind};
+
+        match &ty.kind {
+            RustTypeKind::Primitive(PrimitiveType::I8) => IrType::i8(),
+            RustTypeKind::Primitive(PrimitiveType::U8 | PrimitiveType::Bool) => IrType::u8(),
+            RustTypeKind::Primitive(PrimitiveType::I16) => IrType::i16(),
+            RustTypeKind::Primitive(PrimitiveType::U16) => IrType::u16(),
+            RustTypeKind::Primitive(PrimitiveType::U32 | PrimitiveType::Usize) => IrType::u32(),
+            RustTypeKind::Primitive(PrimitiveType::I64) => IrType::i64(),
+            RustTypeKind::Primitive(PrimitiveType::U64) => IrType::u64(),
+            RustTypeKind::Array { element, size } => IrType::array(Self::ir_type(element), *size),
+            _ => IrType::i32(),
         }
     }
 }
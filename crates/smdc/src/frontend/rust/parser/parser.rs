@@ -860,6 +860,35 @@ impl<'a> RustParser<'a> {
             );
         }
 
+        // Range: a..b, a..=b, binding looser than any binary operator
+        if min_prec == 0
+            && (self.check(&RustTokenKind::DotDot)? || self.check(&RustTokenKind::DotDotEq)?)
+        {
+            let inclusive = self.lexer.next_token()?.kind == RustTokenKind::DotDotEq;
+            let end_expr = if inclusive
+                || !(self.check(&RustTokenKind::Semi)?
+                    || self.check(&RustTokenKind::RBrace)?
+                    || self.check(&RustTokenKind::LBrace)?
+                    || self.check(&RustTokenKind::Comma)?
+                    || self.check(&RustTokenKind::RParen)?
+                    || self.check(&RustTokenKind::RBracket)?)
+            {
+                Some(Box::new(self.parse_expr_with_precedence(1)?))
+            } else {
+                None
+            };
+            let end = end_expr.as_ref().map_or(left.span.end, |e| e.span.end);
+            let span = Span::new(left.span.start, end);
+            left = Expr::new(
+                ExprKind::Range {
+                    start: Some(Box::new(left)),
+                    end: end_expr,
+                    inclusive,
+                },
+                span,
+            );
+        }
+
         // Handle assignment
         if let Some(assign_op) = self.peek_assign_op()? {
             self.lexer.next_token()?;
@@ -973,7 +1002,22 @@ impl<'a> RustParser<'a> {
 
         loop {
             if self.match_token(&RustTokenKind::Dot)? {
-                // Field access or method call
+                // Tuple field, field access or method call
+                if let RustTokenKind::IntLiteral(digits) = &self.lexer.peek()?.kind {
+                    let index = digits
+                        .parse()
+                        .map_err(|_| CompileError::parser("invalid tuple index", expr.span))?;
+                    self.lexer.next_token()?;
+                    let span = Span::new(expr.span.start, self.lexer.peek()?.span.start);
+                    expr = Expr::new(
+                        ExprKind::TupleField {
+                            object: Box::new(expr),
+                            index,
+                        },
+                        span,
+                    );
+                    continue;
+                }
                 let field = self.expect_identifier()?;
 
                 if self.match_token(&RustTokenKind::LParen)? {
@@ -1973,4 +2017,45 @@ mod tests {
             panic!("expected function");
         }
     }
+
+    #[test]
+    fn test_parse_range() {
+        let source = "fn main() { for i in 0..n + 1 { } let r = 1..=2; }";
+        let mut parser = RustParser::new(source);
+        let module = parser.parse_module().unwrap();
+
+        let ItemKind::Fn(f) = &module.items[0].kind else {
+            panic!("expected function");
+        };
+        let body = f.body.as_ref().unwrap();
+        let StmtKind::Expr(Expr {
+            kind: ExprKind::For { iter, .. },
+            ..
+        }) = &body.stmts[0].kind
+        else {
+            panic!("expected for loop, got {:?}", body.stmts[0].kind);
+        };
+        let ExprKind::Range {
+            start: Some(_),
+            end: Some(end),
+            inclusive: false,
+        } = &iter.kind
+        else {
+            panic!("expected range, got {:?}", iter.kind);
+        };
+        assert!(matches!(end.kind, ExprKind::Binary { op: BinOp::Add, .. }));
+        let StmtKind::Let {
+            init: Some(init), ..
+        } = &body.stmts[1].kind
+        else {
+            panic!("expected let");
+        };
+        assert!(matches!(
+            init.kind,
+            ExprKind::Range {
+                inclusive: true,
+                ..
+            }
+        ));
+    }
 }
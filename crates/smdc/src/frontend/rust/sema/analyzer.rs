@@ -2,7 +2,7 @@
 
 use super::scope::{RustScope, RustSymbol, RustSymbolKind};
 use super::types::TypeChecker;
-use crate::common::{CompileError, CompileResult};
+use crate::common::{CompileError, CompileResult, Span, fixed};
 use crate::frontend::rust::ast::*;
 
 /// Rust semantic analyzer
@@ -28,6 +28,18 @@ impl RustAnalyzer {
             self.collect_item_types(item)?;
         }
 
+        // SDK builtins, unless the module defines its own
+        for name in fixed::BUILTINS {
+            if self.scope.lookup(name).is_none() {
+                let symbol = RustSymbol::new(
+                    name.to_string(),
+                    RustSymbolKind::Builtin,
+                    RustType::i32(Span::default()),
+                );
+                let _ = self.scope.define(symbol);
+            }
+        }
+
         // Second pass: analyze items
         for item in &mut module.items {
             self.analyze_item(item)?;
@@ -683,11 +695,15 @@ impl RustAnalyzer {
                     ));
                 }
 
-                // We'd need const evaluation to get the actual count
+                // Only a literal count is known before const evaluation
+                let size = match count.kind {
+                    ExprKind::IntLiteral(n) => usize::try_from(n).unwrap_or(0),
+                    _ => 0,
+                };
                 RustType::new(
                     RustTypeKind::Array {
                         element: Box::new(elem_ty),
-                        size: 0, // Unknown at this point
+                        size,
                     },
                     expr.span,
                 )
@@ -56,6 +56,8 @@ pub enum RustSymbolKind {
     Static { mutable: bool },
     /// Module
     Module,
+    /// SDK builtin function
+    Builtin,
 }
 
 /// Scope for Rust symbol resolution
@@ -1,9 +1,9 @@
 //! IR builder - converts AST to IR
 
 use super::inst::*;
-use crate::common::{CompileError, CompileResult};
+use crate::common::{CompileError, CompileResult, Symbol, fixed};
 use crate::frontend::c::ast::*;
-use std::collections::HashMap;
+use std::collections::{HashMap, HashSet};
 
 /// Builds IR from AST
 pub struct IrBuilder {
@@ -17,6 +17,11 @@ pub struct IrBuilder {
     continue_label: Option<Label>,
     /// Current source span — automatically attached to emitted instructions
     current_span: Option<crate::common::Span>,
+    /// Initialized `const` globals, for later initializers to read
+    const_globals: HashMap<String, (CType, Vec<u8>)>,
+    /// Names declared `static` at file scope, so a later definition without
+    /// it keeps internal linkage
+    internal: HashSet<String>,
 }
 
 impl IrBuilder {
@@ -31,6 +36,8 @@ impl IrBuilder {
             break_label: None,
             continue_label: None,
             current_span: None,
+            const_globals: HashMap::new(),
+            internal: HashSet::new(),
         }
     }
 
@@ -49,7 +56,7 @@ impl IrBuilder {
     }
 
     fn new_label(&mut self, prefix: &str) -> Label {
-        let l = Label(format!(".L{}_{}", prefix, self.label_counter));
+        let l = Label(format!(".L{}_{}", prefix, self.label_counter).into());
         self.label_counter += 1;
         l
     }
@@ -70,7 +77,7 @@ impl IrBuilder {
                 func.blocks.push(BasicBlock::new(label));
             } else {
                 if func.blocks.is_empty() {
-                    let entry_label = Label(format!(".L{}_entry", func.name));
+                    let entry_label = Label(format!(".L{}_entry", func.name).into());
                     func.blocks.push(BasicBlock::new(entry_label));
                 }
                 if let Some(block) = func.blocks.last_mut() {
@@ -94,17 +101,40 @@ impl IrBuilder {
         }
     }
 
+    /// Whether `name` has internal linkage, given this declaration's
+    /// storage class
+    fn is_internal(&mut self, name: &str, storage_class: Option<StorageClass>) -> bool {
+        if storage_class == Some(StorageClass::Static) {
+            self.internal.insert(name.to_string());
+        }
+        self.internal.contains(name)
+    }
+
     fn build_global_var(&mut self, var: &VarDecl) -> CompileResult<()> {
+        let internal = self.is_internal(&var.name, var.storage_class);
+        // Defined elsewhere, e.g. an `--asset`
+        if var.storage_class == Some(StorageClass::Extern) && var.init.is_none() {
+            return Ok(());
+        }
         let init_bytes = if let Some(init) = &var.init {
             Some(self.evaluate_initializer(init, &var.ty)?)
         } else {
             None
         };
 
+        if var.ty.is_const()
+            && let Some(bytes) = &init_bytes
+        {
+            self.const_globals
+                .insert(var.name.clone(), (var.ty.clone(), bytes.clone()));
+        }
+
         let global = IrGlobal {
             name: var.name.clone(),
             ty: var.ty.to_ir_type(),
             init: init_bytes,
+            readonly: var.ty.is_const(),
+            internal,
         };
         self.module.globals.push(global);
         Ok(())
@@ -115,10 +145,8 @@ impl IrBuilder {
         match init {
             Initializer::Expr(expr) => self.evaluate_const_expr_to_bytes(expr, ty),
             Initializer::List(items) => self.evaluate_init_list_to_bytes(items, ty),
-            Initializer::Designated { .. } => {
-                // For designated initializers, return zero-initialized for now
-                Ok(vec![0u8; ty.size()])
-            }
+            // The designator places the value within the enclosing list
+            Initializer::Designated { value, .. } => self.evaluate_initializer(value, ty),
         }
     }
 
@@ -207,9 +235,41 @@ impl IrBuilder {
                     self.evaluate_const_expr(else_expr)
                 }
             }
-            ExprKind::Cast { expr: inner, .. } => {
-                // For now, just pass through (proper casts need type info)
-                self.evaluate_const_expr(inner)
+            ExprKind::Cast { ty, expr: inner } => {
+                let value = self.evaluate_const_expr(inner)?;
+                Ok(if ty.is_integer() {
+                    truncate_to(value, ty)
+                } else {
+                    value
+                })
+            }
+            // Fixed-point math builtins evaluate from the SDK's own tables
+            ExprKind::Call { callee, args } => {
+                let ExprKind::Identifier(name) = &callee.kind else {
+                    return Err(CompileError::codegen(
+                        "non-constant expression in global initializer",
+                    ));
+                };
+                let args = args
+                    .iter()
+                    .map(|arg| self.evaluate_const_expr(arg))
+                    .collect::<CompileResult<Vec<_>>>()?;
+                fixed::eval_builtin(name, &args).ok_or_else(|| {
+                    CompileError::codegen(format!(
+                        "call to '{name}' in global initializer is not constant"
+                    ))
+                })
+            }
+            // Earlier `const` globals, whole or one array element
+            ExprKind::Identifier(name) => self.read_const_global(name, None),
+            ExprKind::Index { array, index } => {
+                let ExprKind::Identifier(name) = &array.kind else {
+                    return Err(CompileError::codegen(
+                        "non-constant expression in global initializer",
+                    ));
+                };
+                let index = self.evaluate_const_expr(index)?;
+                self.read_const_global(name, Some(index))
             }
             ExprKind::Sizeof(arg) => {
                 let size = match arg {
@@ -224,7 +284,42 @@ impl IrBuilder {
         }
     }
 
+    /// Read the value of the `const` global `name`, or of its element
+    /// `index`
+    fn read_const_global(&self, name: &str, index: Option<i64>) -> CompileResult<i64> {
+        let (ty, bytes) = self.const_globals.get(name).ok_or_else(|| {
+            CompileError::codegen(format!("'{name}' is not a constant in global initializer"))
+        })?;
+        let (ty, offset) = match (&ty.kind, index) {
+            (TypeKind::Array { element, .. }, Some(i)) => {
+                let offset = usize::try_from(i)
+                    .ok()
+                    .map(|i| i * element.size())
+                    .filter(|&offset| offset + element.size() <= bytes.len())
+                    .ok_or_else(|| {
+                        CompileError::codegen(format!(
+                            "index {i} out of bounds of '{name}' in global initializer"
+                        ))
+                    })?;
+                (element.as_ref(), offset)
+            }
+            (_, None) if ty.is_integer() => (ty, 0),
+            _ => {
+                return Err(CompileError::codegen(
+                    "non-constant expression in global initializer",
+                ));
+            }
+        };
+        let value = bytes[offset..offset + ty.size()]
+            .iter()
+            .fold(0i64, |acc, &b| (acc << 8) | i64::from(b));
+        Ok(truncate_to(value, ty))
+    }
+
     /// Evaluate an initializer list to bytes
+    ///
+    /// Items fill the aggregate in order; a designated item moves the
+    /// position to its element or member first.
     fn evaluate_init_list_to_bytes(
         &self,
         items: &[Initializer],
@@ -233,40 +328,69 @@ impl IrBuilder {
         match &ty.kind {
             TypeKind::Array { element, size } => {
                 let elem_size = element.size();
-                let count = size.unwrap_or(items.len());
-                let mut bytes = Vec::with_capacity(elem_size * count);
-
-                for (i, item) in items.iter().enumerate() {
-                    if i >= count {
+                let mut bytes = vec![0u8; elem_size * size.unwrap_or(0)];
+                let mut position = 0;
+
+                for item in items {
+                    if let Initializer::Designated {
+                        designator: Designator::Index(index),
+                        ..
+                    } = item
+                    {
+                        position = usize::try_from(self.evaluate_const_expr(index)?)
+                            .map_err(|_| CompileError::codegen("negative array designator"))?;
+                    }
+                    if size.is_some_and(|size| position >= size) {
+                        if matches!(item, Initializer::Designated { .. }) {
+                            return Err(CompileError::codegen("array designator out of bounds"));
+                        }
                         break;
                     }
                     let item_bytes = self.evaluate_initializer(item, element)?;
-                    bytes.extend(item_bytes);
-                }
-
-                // Zero-fill remaining elements
-                while bytes.len() < elem_size * count {
-                    bytes.push(0);
+                    let offset = position * elem_size;
+                    if bytes.len() < offset + elem_size {
+                        bytes.resize(offset + elem_size, 0);
+                    }
+                    let len = item_bytes.len().min(elem_size);
+                    bytes[offset..offset + len].copy_from_slice(&item_bytes[..len]);
+                    position += 1;
                 }
 
                 Ok(bytes)
             }
             TypeKind::Struct { name: _, members } => {
                 let mut bytes = vec![0u8; ty.size()];
+                let mut offsets = Vec::with_capacity(members.len());
                 let mut offset = 0;
-
-                for (i, (_name, member_ty)) in members.iter().enumerate() {
-                    // Align offset
+                for (_name, member_ty) in members {
                     let align = member_ty.alignment();
                     offset = (offset + align - 1) & !(align - 1);
+                    offsets.push(offset);
+                    offset += member_ty.size();
+                }
 
-                    if let Some(item) = items.get(i) {
-                        let item_bytes = self.evaluate_initializer(item, member_ty)?;
-                        let end = (offset + item_bytes.len()).min(bytes.len());
-                        bytes[offset..end].copy_from_slice(&item_bytes[..end - offset]);
+                let mut position = 0;
+                for item in items {
+                    if let Initializer::Designated {
+                        designator: Designator::Field(field),
+                        ..
+                    } = item
+                    {
+                        position = members
+                            .iter()
+                            .position(|(name, _)| name == field)
+                            .ok_or_else(|| {
+                                CompileError::codegen(format!("no member named '{field}'"))
+                            })?;
                     }
-
-                    offset += member_ty.size();
+                    let Some((_name, member_ty)) = members.get(position) else {
+                        break;
+                    };
+                    let item_bytes = self.evaluate_initializer(item, member_ty)?;
+                    let offset = offsets[position];
+                    let end = (offset + item_bytes.len()).min(bytes.len());
+                    bytes[offset..end].copy_from_slice(&item_bytes[..end - offset]);
+                    position += 1;
                 }
 
                 Ok(bytes)
@@ -350,6 +474,7 @@ impl IrBuilder {
     }
 
     fn build_function(&mut self, func: &FuncDecl) -> CompileResult<()> {
+        let internal = self.is_internal(&func.name, func.storage_class);
         if func.body.is_none() {
             return Ok(()); // Skip declarations without body
         }
@@ -361,11 +486,13 @@ impl IrBuilder {
             .map(|p| (p.name.clone().unwrap_or_default(), p.ty.to_ir_type()))
             .collect();
 
-        self.current_func = Some(IrFunction::new(
+        let mut ir_func = IrFunction::new(
             func.name.clone(),
             params.clone(),
             func.return_type.to_ir_type(),
-        ));
+        );
+        ir_func.internal = internal;
+        self.current_func = Some(ir_func);
         self.locals.clear();
         self.temp_counter = 0;
 
@@ -447,7 +574,7 @@ impl IrBuilder {
                 addr: Value::Temp(temp),
                 src: value,
                 size,
-                volatile: false,
+                volatile: var.ty.qualifiers.is_volatile,
             });
         }
 
@@ -495,12 +622,12 @@ impl IrBuilder {
             }
             StmtKind::Break => {
                 if let Some(label) = &self.break_label {
-                    self.emit(Inst::Jump(label.clone()));
+                    self.emit(Inst::Jump(*label));
                 }
             }
             StmtKind::Continue => {
                 if let Some(label) = &self.continue_label {
-                    self.emit(Inst::Jump(label.clone()));
+                    self.emit(Inst::Jump(*label));
                 }
             }
             StmtKind::Switch { expr, body } => {
@@ -510,10 +637,10 @@ impl IrBuilder {
                 // Handled inside switch
             }
             StmtKind::Goto(label) => {
-                self.emit(Inst::Jump(Label(label.clone())));
+                self.emit(Inst::Jump(Label(Symbol::from(label.as_str()))));
             }
             StmtKind::Label { name, stmt } => {
-                self.emit(Inst::Label(Label(name.clone())));
+                self.emit(Inst::Label(Label(Symbol::from(name.as_str()))));
                 self.build_stmt(stmt)?;
             }
             StmtKind::Declaration(decl) => match &decl.kind {
@@ -541,13 +668,13 @@ impl IrBuilder {
 
         self.emit(Inst::CondJumpFalse {
             cond,
-            target: else_label.clone(),
+            target: else_label,
         });
 
         self.build_stmt(then_branch)?;
 
         if else_branch.is_some() {
-            self.emit(Inst::Jump(end_label.clone()));
+            self.emit(Inst::Jump(end_label));
         }
 
         self.emit(Inst::Label(else_label));
@@ -564,15 +691,15 @@ impl IrBuilder {
         let start_label = self.new_label("while");
         let end_label = self.new_label("endwhile");
 
-        let old_break = self.break_label.replace(end_label.clone());
-        let old_continue = self.continue_label.replace(start_label.clone());
+        let old_break = self.break_label.replace(end_label);
+        let old_continue = self.continue_label.replace(start_label);
 
-        self.emit(Inst::Label(start_label.clone()));
+        self.emit(Inst::Label(start_label));
 
         let cond = self.build_expr(condition)?;
         self.emit(Inst::CondJumpFalse {
             cond,
-            target: end_label.clone(),
+            target: end_label,
         });
 
         self.build_stmt(body)?;
@@ -590,10 +717,10 @@ impl IrBuilder {
         let cond_label = self.new_label("docond");
         let end_label = self.new_label("enddo");
 
-        let old_break = self.break_label.replace(end_label.clone());
-        let old_continue = self.continue_label.replace(cond_label.clone());
+        let old_break = self.break_label.replace(end_label);
+        let old_continue = self.continue_label.replace(cond_label);
 
-        self.emit(Inst::Label(start_label.clone()));
+        self.emit(Inst::Label(start_label));
         self.build_stmt(body)?;
 
         self.emit(Inst::Label(cond_label));
@@ -640,17 +767,17 @@ impl IrBuilder {
         let update_label = self.new_label("forupdate");
         let end_label = self.new_label("endfor");
 
-        let old_break = self.break_label.replace(end_label.clone());
-        let old_continue = self.continue_label.replace(update_label.clone());
+        let old_break = self.break_label.replace(end_label);
+        let old_continue = self.continue_label.replace(update_label);
 
-        self.emit(Inst::Label(start_label.clone()));
+        self.emit(Inst::Label(start_label));
 
         // Condition
         if let Some(cond_expr) = condition {
             let cond = self.build_expr(cond_expr)?;
             self.emit(Inst::CondJumpFalse {
                 cond,
-                target: end_label.clone(),
+                target: end_label,
             });
         }
 
@@ -679,38 +806,24 @@ impl IrBuilder {
         self.emit(Inst::Copy {
             dst: switch_temp,
             src: switch_val,
+            width: 4,
         });
 
         // Collect case labels and create jump targets
         let end_label = self.new_label("endswitch");
-        let old_break = self.break_label.replace(end_label.clone());
+        let old_break = self.break_label.replace(end_label);
 
         // First pass: collect all case values and create labels
         let mut cases: Vec<(i64, Label)> = Vec::new();
         let mut default_label: Option<Label> = None;
         self.collect_switch_cases(body, &mut cases, &mut default_label);
 
-        // Generate comparison and jumps for each case
-        for (value, label) in &cases {
-            let cmp_temp = self.new_temp();
-            self.emit(Inst::Binary {
-                dst: cmp_temp,
-                op: BinOp::Eq,
-                left: Value::Temp(switch_temp),
-                right: Value::IntConst(*value),
-            });
-            self.emit(Inst::CondJump {
-                cond: Value::Temp(cmp_temp),
-                target: label.clone(),
-            });
-        }
-
-        // Jump to default or end
-        if let Some(def_label) = &default_label {
-            self.emit(Inst::Jump(def_label.clone()));
-        } else {
-            self.emit(Inst::Jump(end_label.clone()));
-        }
+        // The backend picks a compare chain, jump table or binary search
+        self.emit(Inst::Switch {
+            value: Value::Temp(switch_temp),
+            cases: cases.clone(),
+            default: default_label.unwrap_or_else(|| end_label),
+        });
 
         // Second pass: emit the switch body with labels
         self.emit_switch_body(body, &cases, &default_label)?;
@@ -766,13 +879,13 @@ impl IrBuilder {
                 if let Ok(val) = self.evaluate_const_expr(value)
                     && let Some((_, label)) = cases.iter().find(|(v, _)| *v == val)
                 {
-                    self.emit(Inst::Label(label.clone()));
+                    self.emit(Inst::Label(*label));
                 }
                 self.emit_switch_body(inner, cases, default_label)?;
             }
             StmtKind::Default(inner) => {
                 if let Some(def_label) = default_label {
-                    self.emit(Inst::Label(def_label.clone()));
+                    self.emit(Inst::Label(*def_label));
                 }
                 self.emit_switch_body(inner, cases, default_label)?;
             }
@@ -814,9 +927,9 @@ impl IrBuilder {
             ExprKind::CharLiteral(c) => Ok(Value::IntConst(*c as i64)),
 
             ExprKind::StringLiteral(s) => {
-                let label = Label(format!(".Lstr{}", self.string_counter));
+                let label = Label(format!(".Lstr{}", self.string_counter).into());
                 self.string_counter += 1;
-                self.module.strings.push((label.clone(), s.clone()));
+                self.module.strings.push((label, s.clone()));
                 Ok(Value::StringConst(label))
             }
 
@@ -830,8 +943,9 @@ impl IrBuilder {
                         dst,
                         addr: Value::Temp(temp),
                         size,
-                        volatile: false,
+                        volatile: is_volatile(expr),
                         signed,
+                        width: 4,
                     });
                     Ok(Value::Temp(dst))
                 } else {
@@ -842,7 +956,7 @@ impl IrBuilder {
                             let dst = self.new_temp();
                             self.emit(Inst::AddrOf {
                                 dst,
-                                name: name.clone(),
+                                name: Symbol::from(name.as_str()),
                             });
                             return Ok(Value::Temp(dst));
                         }
@@ -852,20 +966,21 @@ impl IrBuilder {
                             let addr_temp = self.new_temp();
                             self.emit(Inst::AddrOf {
                                 dst: addr_temp,
-                                name: name.clone(),
+                                name: Symbol::from(name.as_str()),
                             });
                             let dst = self.new_temp();
                             self.emit(Inst::Load {
                                 dst,
                                 addr: Value::Temp(addr_temp),
                                 size: ty.size(),
-                                volatile: false,
+                                volatile: ty.qualifiers.is_volatile,
                                 signed: ty.is_signed(),
+                                width: 4,
                             });
                             return Ok(Value::Temp(dst));
                         }
                     }
-                    Ok(Value::Name(name.clone()))
+                    Ok(Value::Name(Symbol::from(name.as_str())))
                 }
             }
 
@@ -918,6 +1033,7 @@ impl IrBuilder {
                     op: ir_op,
                     left: l,
                     right: r,
+                    width: 4,
                 });
 
                 Ok(Value::Temp(dst))
@@ -937,6 +1053,7 @@ impl IrBuilder {
                     dst,
                     op: ir_op,
                     src,
+                    width: 4,
                 });
                 Ok(Value::Temp(dst))
             }
@@ -956,8 +1073,9 @@ impl IrBuilder {
                         dst: old_val,
                         addr: addr.clone(),
                         size,
-                        volatile: false,
+                        volatile: is_volatile(target),
                         signed,
+                        width: 4,
                     });
 
                     // Check if unsigned for div/mod operations
@@ -995,6 +1113,7 @@ impl IrBuilder {
                         op: ir_op,
                         left: Value::Temp(old_val),
                         right: val,
+                        width: 4,
                     });
                     Value::Temp(result)
                 } else {
@@ -1006,7 +1125,7 @@ impl IrBuilder {
                     addr,
                     src: final_val.clone(),
                     size,
-                    volatile: false,
+                    volatile: is_volatile(target),
                 });
 
                 Ok(final_val)
@@ -1027,7 +1146,7 @@ impl IrBuilder {
                 let dst = self.new_temp();
                 self.emit(Inst::Call {
                     dst: Some(dst),
-                    func: func_name,
+                    func: func_name.into(),
                     args: ir_args,
                 });
 
@@ -1057,6 +1176,7 @@ impl IrBuilder {
                     op: BinOp::Mul,
                     left: idx,
                     right: Value::IntConst(elem_size as i64),
+                    width: 4,
                 });
 
                 let addr = self.new_temp();
@@ -1065,6 +1185,7 @@ impl IrBuilder {
                     op: BinOp::Add,
                     left: base,
                     right: Value::Temp(offset),
+                    width: 4,
                 });
 
                 let dst = self.new_temp();
@@ -1072,8 +1193,9 @@ impl IrBuilder {
                     dst,
                     addr: Value::Temp(addr),
                     size: elem_size,
-                    volatile: false,
+                    volatile: is_volatile(expr),
                     signed: elem_signed,
+                    width: 4,
                 });
 
                 Ok(Value::Temp(dst))
@@ -1086,17 +1208,13 @@ impl IrBuilder {
                 let dst = self.new_temp();
                 let size = expr.ty.as_ref().map_or(4, |t| t.size());
                 let signed = expr.ty.as_ref().is_some_and(|t| t.is_signed());
-                // Check if pointer type is volatile
-                let is_volatile = operand
-                    .ty
-                    .as_ref()
-                    .is_some_and(|t| t.qualifiers.is_volatile);
                 self.emit(Inst::Load {
                     dst,
                     addr,
                     size,
-                    volatile: is_volatile,
+                    volatile: is_volatile(expr) || is_volatile(operand),
                     signed,
+                    width: 4,
                 });
                 Ok(Value::Temp(dst))
             }
@@ -1105,18 +1223,16 @@ impl IrBuilder {
                 let addr = self.build_lvalue(operand)?;
                 let size = operand.ty.as_ref().map_or(4, |t| t.size());
                 let signed = operand.ty.as_ref().is_some_and(|t| t.is_signed());
-                let is_volatile = operand
-                    .ty
-                    .as_ref()
-                    .is_some_and(|t| t.qualifiers.is_volatile);
+                let volatile = is_volatile(operand);
 
                 let old = self.new_temp();
                 self.emit(Inst::Load {
                     dst: old,
                     addr: addr.clone(),
                     size,
-                    volatile: is_volatile,
+                    volatile,
                     signed,
+                    width: 4,
                 });
 
                 let op = if matches!(expr.kind, ExprKind::PreIncrement(_)) {
@@ -1131,13 +1247,14 @@ impl IrBuilder {
                     op,
                     left: Value::Temp(old),
                     right: Value::IntConst(1),
+                    width: 4,
                 });
 
                 self.emit(Inst::Store {
                     addr,
                     src: Value::Temp(new_val),
                     size,
-                    volatile: is_volatile,
+                    volatile,
                 });
 
                 Ok(Value::Temp(new_val))
@@ -1147,18 +1264,16 @@ impl IrBuilder {
                 let addr = self.build_lvalue(operand)?;
                 let size = operand.ty.as_ref().map_or(4, |t| t.size());
                 let signed = operand.ty.as_ref().is_some_and(|t| t.is_signed());
-                let is_volatile = operand
-                    .ty
-                    .as_ref()
-                    .is_some_and(|t| t.qualifiers.is_volatile);
+                let volatile = is_volatile(operand);
 
                 let old = self.new_temp();
                 self.emit(Inst::Load {
                     dst: old,
                     addr: addr.clone(),
                     size,
-                    volatile: is_volatile,
+                    volatile,
                     signed,
+                    width: 4,
                 });
 
                 let op = if matches!(expr.kind, ExprKind::PostIncrement(_)) {
@@ -1173,13 +1288,14 @@ impl IrBuilder {
                     op,
                     left: Value::Temp(old),
                     right: Value::IntConst(1),
+                    width: 4,
                 });
 
                 self.emit(Inst::Store {
                     addr,
                     src: Value::Temp(new_val),
                     size,
-                    volatile: is_volatile,
+                    volatile,
                 });
 
                 Ok(Value::Temp(old)) // Return old value
@@ -1197,21 +1313,23 @@ impl IrBuilder {
 
                 self.emit(Inst::CondJumpFalse {
                     cond,
-                    target: else_label.clone(),
+                    target: else_label,
                 });
 
                 let then_val = self.build_expr(then_expr)?;
                 self.emit(Inst::Copy {
                     dst: result,
                     src: then_val,
+                    width: 4,
                 });
-                self.emit(Inst::Jump(end_label.clone()));
+                self.emit(Inst::Jump(end_label));
 
                 self.emit(Inst::Label(else_label));
                 let else_val = self.build_expr(else_expr)?;
                 self.emit(Inst::Copy {
                     dst: result,
                     src: else_val,
+                    width: 4,
                 });
 
                 self.emit(Inst::Label(end_label));
@@ -1245,6 +1363,7 @@ impl IrBuilder {
                     op: BinOp::Add,
                     left: base_addr,
                     right: Value::IntConst(offset as i64),
+                    width: 4,
                 });
 
                 // Load the field value
@@ -1253,8 +1372,9 @@ impl IrBuilder {
                     dst,
                     addr: Value::Temp(field_addr),
                     size: field_ty.size(),
-                    volatile: false,
+                    volatile: is_volatile(expr),
                     signed: field_ty.is_signed(),
+                    width: 4,
                 });
                 Ok(Value::Temp(dst))
             }
@@ -1273,6 +1393,7 @@ impl IrBuilder {
                     op: BinOp::Add,
                     left: base_addr,
                     right: Value::IntConst(offset as i64),
+                    width: 4,
                 });
 
                 // Load the field value
@@ -1281,8 +1402,9 @@ impl IrBuilder {
                     dst,
                     addr: Value::Temp(field_addr),
                     size: field_ty.size(),
-                    volatile: false,
+                    volatile: is_volatile(expr),
                     signed: field_ty.is_signed(),
+                    width: 4,
                 });
                 Ok(Value::Temp(dst))
             }
@@ -1311,7 +1433,7 @@ impl IrBuilder {
                     let dst = self.new_temp();
                     self.emit(Inst::AddrOf {
                         dst,
-                        name: name.clone(),
+                        name: Symbol::from(name.as_str()),
                     });
                     Ok(Value::Temp(dst))
                 }
@@ -1337,6 +1459,7 @@ impl IrBuilder {
                     op: BinOp::Mul,
                     left: idx,
                     right: Value::IntConst(elem_size as i64),
+                    width: 4,
                 });
 
                 let addr = self.new_temp();
@@ -1345,6 +1468,7 @@ impl IrBuilder {
                     op: BinOp::Add,
                     left: base,
                     right: Value::Temp(offset),
+                    width: 4,
                 });
 
                 Ok(Value::Temp(addr))
@@ -1363,6 +1487,7 @@ impl IrBuilder {
                     op: BinOp::Add,
                     left: base_addr,
                     right: Value::IntConst(offset as i64),
+                    width: 4,
                 });
 
                 Ok(Value::Temp(field_addr))
@@ -1381,6 +1506,7 @@ impl IrBuilder {
                     op: BinOp::Add,
                     left: base_addr,
                     right: Value::IntConst(offset as i64),
+                    width: 4,
                 });
 
                 Ok(Value::Temp(field_addr))
@@ -1406,7 +1532,7 @@ impl IrBuilder {
                 // If left is false, result is 0
                 self.emit(Inst::CondJumpFalse {
                     cond: l,
-                    target: short_circuit.clone(),
+                    target: short_circuit,
                 });
                 let r = self.build_expr(right)?;
                 // Result is right != 0
@@ -1416,24 +1542,27 @@ impl IrBuilder {
                     op: BinOp::Ne,
                     left: r,
                     right: Value::IntConst(0),
+                    width: 4,
                 });
                 self.emit(Inst::Copy {
                     dst: result,
                     src: Value::Temp(cmp),
+                    width: 4,
                 });
-                self.emit(Inst::Jump(end_label.clone()));
+                self.emit(Inst::Jump(end_label));
 
                 self.emit(Inst::Label(short_circuit));
                 self.emit(Inst::Copy {
                     dst: result,
                     src: Value::IntConst(0),
+                    width: 4,
                 });
             }
             BinaryOp::LogOr => {
                 // If left is true, result is 1
                 self.emit(Inst::CondJump {
                     cond: l,
-                    target: short_circuit.clone(),
+                    target: short_circuit,
                 });
                 let r = self.build_expr(right)?;
                 let cmp = self.new_temp();
@@ -1442,17 +1571,20 @@ impl IrBuilder {
                     op: BinOp::Ne,
                     left: r,
                     right: Value::IntConst(0),
+                    width: 4,
                 });
                 self.emit(Inst::Copy {
                     dst: result,
                     src: Value::Temp(cmp),
+                    width: 4,
                 });
-                self.emit(Inst::Jump(end_label.clone()));
+                self.emit(Inst::Jump(end_label));
 
                 self.emit(Inst::Label(short_circuit));
                 self.emit(Inst::Copy {
                     dst: result,
                     src: Value::IntConst(1),
+                    width: 4,
                 });
             }
             _ => unreachable!(),
@@ -1468,3 +1600,60 @@ impl Default for IrBuilder {
         Self::new()
     }
 }
+
+/// Whether `expr` names a volatile object, whose accesses must all happen
+fn is_volatile(expr: &Expr) -> bool {
+    expr.ty.as_ref().is_some_and(|t| t.qualifiers.is_volatile)
+}
+
+/// Convert `value` to integer type `ty`, wrapping as the target does
+fn truncate_to(value: i64, ty: &CType) -> i64 {
+    let bits = (ty.size() * 8) as u32;
+    if bits == 0 || bits >= 64 {
+        return value;
+    }
+    let shift = 64 - bits;
+    if ty.is_signed() {
+        (value << shift) >> shift
+    } else {
+        ((value as u64) << shift >> shift) as i64
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::frontend::c::{Parser, SemanticAnalyzer};
+
+    fn global_init(source: &str, name: &str) -> Vec<u8> {
+        let mut tu = Parser::new(source).unwrap().parse().unwrap();
+        SemanticAnalyzer::new().analyze(&mut tu).unwrap();
+        let module = IrBuilder::new().build(&tu).unwrap();
+        let global = module.globals.iter().find(|g| g.name == name).unwrap();
+        global.init.clone().unwrap()
+    }
+
+    #[test]
+    fn test_const_table_initializers() {
+        let source = "int sin_fix(int angle);
+            const short sines[6] = { sin_fix(0), sin_fix(32), [4] = sin_fix(192), (char)300 };
+            const short twice = sines[1] * 2;";
+        let sines = global_init(source, "sines");
+        let words: Vec<i16> = sines
+            .chunks(2)
+            .map(|w| i16::from_be_bytes([w[0], w[1]]))
+            .collect();
+        assert_eq!(words, [0, 181, 0, 0, -256, 44]);
+        assert_eq!(global_init(source, "twice"), 362i16.to_be_bytes());
+    }
+
+    #[test]
+    fn test_designated_struct_initializers() {
+        let source = "struct P { short x; short y; };
+            struct P pts[] = { [1] = { .y = -2, .x = 4 }, { 1 } };";
+        assert_eq!(
+            global_init(source, "pts"),
+            [0, 0, 0, 0, 0, 4, 0xFF, 0xFE, 0, 1, 0, 0]
+        );
+    }
+}
@@ -1,5 +1,6 @@
 //! IR instruction definitions
 
+use crate::common::Symbol;
 use crate::types::IrType;
 
 /// A temporary value (virtual register)
@@ -13,8 +14,8 @@ impl std::fmt::Display for Temp {
 }
 
 /// A label in the IR
-#[derive(Debug, Clone, PartialEq, Eq, Hash)]
-pub struct Label(pub String);
+#[derive(Debug, Clone, Copy, PartialEq, Eq, Hash)]
+pub struct Label(pub Symbol);
 
 impl std::fmt::Display for Label {
     fn fmt(&self, f: &mut std::fmt::Formatter<'_>) -> std::fmt::Result {
@@ -32,7 +33,7 @@ pub enum Value {
     /// A string constant (label to string data)
     StringConst(Label),
     /// A named variable/parameter
-    Name(String),
+    Name(Symbol),
     /// Memory location at address
     Mem(Box<Value>),
 }
@@ -49,6 +50,46 @@ impl std::fmt::Display for Value {
     }
 }
 
+impl Value {
+    /// Collect every temp read by this value (including inside `Mem`)
+    pub fn collect_temps(&self, out: &mut Vec<Temp>) {
+        match self {
+            Value::Temp(t) => out.push(*t),
+            Value::Mem(addr) => addr.collect_temps(out),
+            Value::IntConst(_) | Value::StringConst(_) | Value::Name(_) => {}
+        }
+    }
+
+    /// The temp this value refers to, if it is a plain temp
+    pub fn as_temp(&self) -> Option<Temp> {
+        match self {
+            Value::Temp(t) => Some(*t),
+            _ => None,
+        }
+    }
+
+    /// Replace temps (including inside `Mem`) for which `f` returns a value.
+    /// Returns true if anything was replaced.
+    pub fn substitute(&mut self, f: &impl Fn(Temp) -> Option<Value>) -> bool {
+        match self {
+            Value::Temp(t) => match f(*t) {
+                Some(v) => {
+                    *self = v;
+                    true
+                }
+                None => false,
+            },
+            Value::Mem(addr) => addr.substitute(f),
+            Value::IntConst(_) | Value::StringConst(_) | Value::Name(_) => false,
+        }
+    }
+
+    /// Whether evaluating this value dereferences a pointer
+    pub fn reads_memory(&self) -> bool {
+        matches!(self, Value::Mem(_))
+    }
+}
+
 /// Binary operations
 #[derive(Debug, Clone, Copy, PartialEq, Eq)]
 pub enum BinOp {
@@ -122,10 +163,20 @@ pub enum Inst {
     Label(Label),
 
     /// dst = src (copy)
-    Copy { dst: Temp, src: Value },
+    Copy {
+        dst: Temp,
+        src: Value,
+        /// Low bytes of dst that are meaningful; see `Inst::width`
+        width: usize,
+    },
 
     /// dst = op src
-    Unary { dst: Temp, op: UnOp, src: Value },
+    Unary {
+        dst: Temp,
+        op: UnOp,
+        src: Value,
+        width: usize,
+    },
 
     /// dst = left op right
     Binary {
@@ -133,6 +184,7 @@ pub enum Inst {
         op: BinOp,
         left: Value,
         right: Value,
+        width: usize,
     },
 
     /// dst = *src (load from memory)
@@ -144,6 +196,8 @@ pub enum Inst {
         volatile: bool,
         /// If true, sign-extend the value; otherwise zero-extend
         signed: bool,
+        /// The extension is only needed when this is wider than `size`
+        width: usize,
     },
 
     /// *dst = src (store to memory)
@@ -164,10 +218,22 @@ pub enum Inst {
     /// Branch if condition is false
     CondJumpFalse { cond: Value, target: Label },
 
+    /// Counted loop branch: decrement the low word of counter, and goto target
+    /// unless it was zero (it wraps to -1, ending the loop). This is `dbf`.
+    DecJump { counter: Temp, target: Label },
+
+    /// Multiway branch: goto the label of the case equal to value, or to
+    /// default if there is none
+    Switch {
+        value: Value,
+        cases: Vec<(i64, Label)>,
+        default: Label,
+    },
+
     /// Function call: dst = func(args...)
     Call {
         dst: Option<Temp>,
-        func: String,
+        func: Symbol,
         args: Vec<Value>,
     },
 
@@ -182,7 +248,7 @@ pub enum Inst {
     },
 
     /// Get address of named variable
-    AddrOf { dst: Temp, name: String },
+    AddrOf { dst: Temp, name: Symbol },
 
     /// Load function parameter from stack
     LoadParam {
@@ -191,6 +257,15 @@ pub enum Inst {
         size: usize,
     },
 
+    /// Value of a parameter passed in a register, extended from `size`
+    /// bytes. Only the backend introduces these, at function entry.
+    Param {
+        dst: Temp,
+        index: usize,
+        size: usize,
+        signed: bool,
+    },
+
     /// Comment (for debugging)
     Comment(String),
 }
@@ -199,15 +274,18 @@ impl std::fmt::Display for Inst {
     fn fmt(&self, f: &mut std::fmt::Formatter<'_>) -> std::fmt::Result {
         match self {
             Inst::Label(l) => write!(f, "{l}:"),
-            Inst::Copy { dst, src } => write!(f, "  {dst} = {src}"),
-            Inst::Unary { dst, op, src } => write!(f, "  {dst} = {op} {src}"),
+            Inst::Copy { dst, src, .. } => write!(f, "  {dst}{} = {src}", WidthSuffix(self)),
+            Inst::Unary { dst, op, src, .. } => {
+                write!(f, "  {dst}{} = {op} {src}", WidthSuffix(self))
+            }
             Inst::Binary {
                 dst,
                 op,
                 left,
                 right,
+                ..
             } => {
-                write!(f, "  {dst} = {left} {op} {right}")
+                write!(f, "  {dst}{} = {left} {op} {right}", WidthSuffix(self))
             }
             Inst::Load {
                 dst,
@@ -215,8 +293,10 @@ impl std::fmt::Display for Inst {
                 size,
                 volatile,
                 signed,
+                ..
             } => {
                 let sign_str = if *signed { "s" } else { "u" };
+                let dst = format!("{dst}{}", WidthSuffix(self));
                 if *volatile {
                     write!(f, "  {dst} = load.{sign_str}{size}.volatile {addr}")
                 } else {
@@ -238,6 +318,21 @@ impl std::fmt::Display for Inst {
             Inst::Jump(l) => write!(f, "  jump {l}"),
             Inst::CondJump { cond, target } => write!(f, "  if {cond} goto {target}"),
             Inst::CondJumpFalse { cond, target } => write!(f, "  ifnot {cond} goto {target}"),
+            Inst::DecJump { counter, target } => write!(f, "  dec {counter} goto {target}"),
+            Inst::Switch {
+                value,
+                cases,
+                default,
+            } => {
+                write!(f, "  switch {value} [")?;
+                for (i, (case, label)) in cases.iter().enumerate() {
+                    if i > 0 {
+                        write!(f, ", ")?;
+                    }
+                    write!(f, "{case}: {label}")?;
+                }
+                write!(f, "] default {default}")
+            }
             Inst::Call { dst, func, args } => {
                 if let Some(d) = dst {
                     write!(f, "  {d} = call {func}(")?;
@@ -266,11 +361,218 @@ impl std::fmt::Display for Inst {
             Inst::LoadParam { dst, index, size } => {
                 write!(f, "  {dst} = loadparam.{size} #{index}")
             }
+            Inst::Param {
+                dst, index, size, ..
+            } => write!(f, "  {dst} = param.{size} #{index}"),
             Inst::Comment(s) => write!(f, "  ; {s}"),
         }
     }
 }
 
+/// `.b`/`.w` after the destination of a narrowed instruction
+struct WidthSuffix<'a>(&'a Inst);
+
+impl std::fmt::Display for WidthSuffix<'_> {
+    fn fmt(&self, f: &mut std::fmt::Formatter<'_>) -> std::fmt::Result {
+        match self.0.width() {
+            Some(1) => write!(f, ".b"),
+            Some(2) => write!(f, ".w"),
+            _ => Ok(()),
+        }
+    }
+}
+
+impl Inst {
+    /// Number of low bytes of the result that hold the value, for the
+    /// instructions that carry one: 4 by default, 1 or 2 once
+    /// `opt::NarrowWidths` has shown that no reader looks at the upper
+    /// bytes, which are then undefined. `None` for other instructions.
+    pub fn width(&self) -> Option<usize> {
+        match self {
+            Inst::Copy { width, .. }
+            | Inst::Unary { width, .. }
+            | Inst::Binary { width, .. }
+            | Inst::Load { width, .. } => Some(*width),
+            _ => None,
+        }
+    }
+
+    /// Mutable access to the width returned by `width`
+    pub fn width_mut(&mut self) -> Option<&mut usize> {
+        match self {
+            Inst::Copy { width, .. }
+            | Inst::Unary { width, .. }
+            | Inst::Binary { width, .. }
+            | Inst::Load { width, .. } => Some(width),
+            _ => None,
+        }
+    }
+
+    /// The temp written by this instruction, if any
+    pub fn def(&self) -> Option<Temp> {
+        match self {
+            Inst::Copy { dst, .. }
+            | Inst::Unary { dst, .. }
+            | Inst::Binary { dst, .. }
+            | Inst::Load { dst, .. }
+            | Inst::Alloca { dst, .. }
+            | Inst::AddrOf { dst, .. }
+            | Inst::LoadParam { dst, .. }
+            | Inst::Param { dst, .. }
+            | Inst::DecJump { counter: dst, .. } => Some(*dst),
+            Inst::Call { dst, .. } => *dst,
+            Inst::Label(_)
+            | Inst::Store { .. }
+            | Inst::Jump(_)
+            | Inst::CondJump { .. }
+            | Inst::CondJumpFalse { .. }
+            | Inst::Switch { .. }
+            | Inst::Return(_)
+            | Inst::Comment(_) => None,
+        }
+    }
+
+    /// Mutable access to the temp returned by `def`
+    pub fn def_mut(&mut self) -> Option<&mut Temp> {
+        match self {
+            Inst::Copy { dst, .. }
+            | Inst::Unary { dst, .. }
+            | Inst::Binary { dst, .. }
+            | Inst::Load { dst, .. }
+            | Inst::Alloca { dst, .. }
+            | Inst::AddrOf { dst, .. }
+            | Inst::LoadParam { dst, .. }
+            | Inst::Param { dst, .. }
+            | Inst::DecJump { counter: dst, .. } => Some(dst),
+            Inst::Call { dst, .. } => dst.as_mut(),
+            _ => None,
+        }
+    }
+
+    /// The temps read by this instruction, in operand order
+    pub fn uses(&self) -> Vec<Temp> {
+        let mut out = Vec::new();
+        match self {
+            Inst::Copy { src, .. } | Inst::Unary { src, .. } => src.collect_temps(&mut out),
+            Inst::Binary { left, right, .. } => {
+                left.collect_temps(&mut out);
+                right.collect_temps(&mut out);
+            }
+            Inst::Load { addr, .. } => addr.collect_temps(&mut out),
+            Inst::Store { addr, src, .. } => {
+                addr.collect_temps(&mut out);
+                src.collect_temps(&mut out);
+            }
+            Inst::CondJump { cond, .. }
+            | Inst::CondJumpFalse { cond, .. }
+            | Inst::Switch { value: cond, .. } => {
+                cond.collect_temps(&mut out);
+            }
+            Inst::DecJump { counter, .. } => out.push(*counter),
+            Inst::Call { args, .. } => {
+                for arg in args {
+                    arg.collect_temps(&mut out);
+                }
+            }
+            Inst::Return(Some(val)) => val.collect_temps(&mut out),
+            Inst::Label(_)
+            | Inst::Jump(_)
+            | Inst::Return(None)
+            | Inst::Alloca { .. }
+            | Inst::AddrOf { .. }
+            | Inst::LoadParam { .. }
+            | Inst::Param { .. }
+            | Inst::Comment(_) => {}
+        }
+        out
+    }
+
+    /// The values read by this instruction, in operand order
+    pub fn operands(&self) -> Vec<&Value> {
+        match self {
+            Inst::Copy { src, .. } | Inst::Unary { src, .. } => vec![src],
+            Inst::Binary { left, right, .. } => vec![left, right],
+            Inst::Load { addr, .. } => vec![addr],
+            Inst::Store { addr, src, .. } => vec![addr, src],
+            Inst::CondJump { cond, .. }
+            | Inst::CondJumpFalse { cond, .. }
+            | Inst::Switch { value: cond, .. } => vec![cond],
+            Inst::Call { args, .. } => args.iter().collect(),
+            Inst::Return(Some(val)) => vec![val],
+            Inst::Label(_)
+            | Inst::Jump(_)
+            | Inst::DecJump { .. }
+            | Inst::Return(None)
+            | Inst::Alloca { .. }
+            | Inst::AddrOf { .. }
+            | Inst::LoadParam { .. }
+            | Inst::Param { .. }
+            | Inst::Comment(_) => Vec::new(),
+        }
+    }
+
+    /// The values read by this instruction, for in-place rewriting
+    pub fn operands_mut(&mut self) -> Vec<&mut Value> {
+        match self {
+            Inst::Copy { src, .. } | Inst::Unary { src, .. } => vec![src],
+            Inst::Binary { left, right, .. } => vec![left, right],
+            Inst::Load { addr, .. } => vec![addr],
+            Inst::Store { addr, src, .. } => vec![addr, src],
+            Inst::CondJump { cond, .. }
+            | Inst::CondJumpFalse { cond, .. }
+            | Inst::Switch { value: cond, .. } => vec![cond],
+            Inst::Call { args, .. } => args.iter_mut().collect(),
+            Inst::Return(Some(val)) => vec![val],
+            Inst::Label(_)
+            | Inst::Jump(_)
+            | Inst::DecJump { .. }
+            | Inst::Return(None)
+            | Inst::Alloca { .. }
+            | Inst::AddrOf { .. }
+            | Inst::LoadParam { .. }
+            | Inst::Param { .. }
+            | Inst::Comment(_) => Vec::new(),
+        }
+    }
+
+    /// Labels this instruction may transfer control to
+    pub fn branch_targets(&self) -> Vec<&Label> {
+        match self {
+            Inst::Jump(target)
+            | Inst::CondJump { target, .. }
+            | Inst::CondJumpFalse { target, .. }
+            | Inst::DecJump { target, .. } => vec![target],
+            Inst::Switch { cases, default, .. } => cases
+                .iter()
+                .map(|(_, label)| label)
+                .chain(std::iter::once(default))
+                .collect(),
+            _ => Vec::new(),
+        }
+    }
+
+    /// Mutable access to the labels returned by `branch_targets`
+    pub fn branch_targets_mut(&mut self) -> Vec<&mut Label> {
+        match self {
+            Inst::Jump(target)
+            | Inst::CondJump { target, .. }
+            | Inst::CondJumpFalse { target, .. }
+            | Inst::DecJump { target, .. } => vec![target],
+            Inst::Switch { cases, default, .. } => cases
+                .iter_mut()
+                .map(|(_, label)| label)
+                .chain(std::iter::once(default))
+                .collect(),
+            _ => Vec::new(),
+        }
+    }
+
+    /// Whether control never falls through to the next instruction
+    pub fn is_terminator(&self) -> bool {
+        matches!(self, Inst::Jump(_) | Inst::Switch { .. } | Inst::Return(_))
+    }
+}
+
 /// An IR instruction paired with an optional source location
 #[derive(Debug, Clone)]
 pub struct SpannedInst {
@@ -328,6 +630,8 @@ pub struct IrFunction {
     pub return_type: IrType,
     pub blocks: Vec<BasicBlock>,
     pub locals: Vec<(String, IrType, usize)>, // name, type, stack offset
+    /// Only visible in its own translation unit (C `static`)
+    pub internal: bool,
 }
 
 impl IrFunction {
@@ -338,6 +642,7 @@ impl IrFunction {
             return_type,
             blocks: Vec::new(),
             locals: Vec::new(),
+            internal: false,
         }
     }
 }
@@ -358,6 +663,11 @@ pub struct IrGlobal {
     pub name: String,
     pub ty: IrType,
     pub init: Option<Vec<u8>>,
+    /// Never written by the program (C `const`, Rust non-`mut` `static`),
+    /// so it can stay in ROM
+    pub readonly: bool,
+    /// Only visible in its own translation unit (C `static`)
+    pub internal: bool,
 }
 
 /// Source-level debug information attached to an IR module
@@ -399,7 +709,12 @@ impl Default for IrModule {
 impl std::fmt::Display for IrModule {
     fn fmt(&self, f: &mut std::fmt::Formatter<'_>) -> std::fmt::Result {
         for global in &self.globals {
-            writeln!(f, "global {}: {:?}", global.name, global.ty)?;
+            let kind = if global.readonly {
+                "const global"
+            } else {
+                "global"
+            };
+            writeln!(f, "{kind} {}: {:?}", global.name, global.ty)?;
         }
         for (label, s) in &self.strings {
             writeln!(f, "{}: \"{}\"", label, s.escape_default())?;
@@ -419,7 +734,7 @@ mod tests {
 
     #[test]
     fn test_basic_block_display() {
-        let mut bb = BasicBlock::new(Label("L_test".to_string()));
+        let mut bb = BasicBlock::new(Label("L_test".into()));
         bb.insts
             .push(SpannedInst::bare(Inst::Comment("test comment".to_string())));
         bb.insts.push(SpannedInst::bare(Inst::Return(None)));
@@ -438,7 +753,7 @@ mod tests {
             IrType::void(),
         );
 
-        let mut bb = BasicBlock::new(Label("entry".to_string()));
+        let mut bb = BasicBlock::new(Label("entry".into()));
         bb.insts.push(SpannedInst::bare(Inst::Return(None)));
         func.blocks.push(bb);
 
@@ -456,11 +771,13 @@ mod tests {
             name: "g_var".to_string(),
             ty: IrType::i32(),
             init: None,
+            readonly: false,
+            internal: false,
         });
 
         module
             .strings
-            .push((Label("str_1".to_string()), "hello world".to_string()));
+            .push((Label("str_1".into()), "hello world".to_string()));
 
         let output = format!("{module}");
         assert!(output.contains("global g_var:"));
@@ -475,6 +792,7 @@ mod tests {
             Inst::Copy {
                 dst: Temp(0),
                 src: Value::IntConst(42),
+                width: 4,
             },
             Some(span),
         );
@@ -505,6 +823,7 @@ mod tests {
         let inst1 = Inst::Copy {
             dst: Temp(1),
             src: Value::IntConst(42),
+            width: 4,
         };
         assert_eq!(format!("{}", inst1), "  t1 = 42");
 
@@ -513,7 +832,62 @@ mod tests {
             op: BinOp::Add,
             left: Value::Temp(Temp(1)),
             right: Value::IntConst(1),
+            width: 4,
         };
         assert_eq!(format!("{}", inst2), "  t2 = t1 + 1");
     }
+
+    #[test]
+    fn test_inst_def_and_uses() {
+        let store = Inst::Store {
+            addr: Value::Temp(Temp(3)),
+            src: Value::Mem(Box::new(Value::Temp(Temp(4)))),
+            size: 4,
+            volatile: false,
+        };
+        assert!(store.def().is_none());
+        assert_eq!(store.uses(), vec![Temp(3), Temp(4)]);
+
+        let call = Inst::Call {
+            dst: Some(Temp(7)),
+            func: "f".into(),
+            args: vec![Value::IntConst(1), Value::Temp(Temp(5))],
+        };
+        assert_eq!(call.def(), Some(Temp(7)));
+        assert_eq!(call.uses(), vec![Temp(5)]);
+
+        let jump = Inst::CondJumpFalse {
+            cond: Value::Temp(Temp(1)),
+            target: Label("L".into()),
+        };
+        assert_eq!(jump.branch_targets(), vec![&Label("L".into())]);
+        assert!(!jump.is_terminator());
+        assert!(Inst::Return(None).is_terminator());
+
+        let switch = Inst::Switch {
+            value: Value::Temp(Temp(2)),
+            cases: vec![(1, Label("A".into())), (5, Label("B".into()))],
+            default: Label("D".into()),
+        };
+        assert_eq!(switch.uses(), vec![Temp(2)]);
+        assert_eq!(switch.branch_targets().len(), 3);
+        assert!(switch.is_terminator());
+        assert_eq!(format!("{switch}"), "  switch t2 [1: A, 5: B] default D");
+    }
+
+    #[test]
+    fn test_value_substitute() {
+        let mut store = Inst::Store {
+            addr: Value::Mem(Box::new(Value::Temp(Temp(1)))),
+            src: Value::Temp(Temp(2)),
+            size: 4,
+            volatile: false,
+        };
+        let mut changed = false;
+        for operand in store.operands_mut() {
+            changed |= operand.substitute(&|t| (t == Temp(1)).then_some(Value::IntConst(64)));
+        }
+        assert!(changed);
+        assert_eq!(format!("{store}"), "  store.4 [64], t2");
+    }
 }
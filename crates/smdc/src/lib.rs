@@ -8,15 +8,21 @@
 //! The compiler is organized into:
 //! - **Frontends** (`frontend/`): Language-specific parsing and analysis (C, Rust)
 //! - **IR** (`ir/`): Shared intermediate representation
+//! - **Optimizer** (`opt/`): IR-to-IR passes selected by `-O`
 //! - **Backends** (`backend/`): Target-specific code generation (M68k, ROM)
+//! - **Assets** (`asset/`): Build-time compression of tile and map data
+//! - **Cache** (`cache/`): On-disk cache of preprocessed sources and objects
 //! - **Common** (`common/`): Shared infrastructure (errors, spans)
 //! - **Types** (`types/`): Language-agnostic type system
 
+pub mod asset;
 pub mod backend;
+pub mod cache;
 pub mod common;
 pub mod driver;
 pub mod frontend;
 pub mod ir;
+pub mod opt;
 pub mod types;
 
 // Re-exports for convenience
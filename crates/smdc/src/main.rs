@@ -1,15 +1,24 @@
 //! SMD Compiler - C and Rust compiler for Sega Megadrive/Genesis
 //!
-//! Usage: smdc [OPTIONS] <input> -o <output>
+//! Usage: smdc [OPTIONS] <input>... -o <output>
 
 use clap::{Parser as ClapParser, ValueEnum};
+use smd_compiler::asset;
+use smd_compiler::backend::m68k::ObjectFile;
+use smd_compiler::backend::m68k::sdk::VBLANK_CALLBACK;
 use smd_compiler::backend::{
-    Backend, BackendConfig, M68kBackend, OutputFormat, RomBackend, RomConfig,
+    Backend, BackendConfig, M68kBackend, OutputFormat, RomBackend, RomConfig, StartupMode,
 };
+use smd_compiler::cache::{self, BuildCache};
 use smd_compiler::common::DiagnosticReporter;
+use smd_compiler::common::stats::{self, Stats};
+use smd_compiler::driver::{job_count, parallel_map};
 use smd_compiler::frontend::{CFrontend, CompileContext, Frontend, FrontendConfig, RustFrontend};
+use smd_compiler::ir::{IrGlobal, IrModule};
+use smd_compiler::opt::{PassManager, remove_dead_symbols};
+use std::error::Error;
 use std::fs;
-use std::path::PathBuf;
+use std::path::{Path, PathBuf};
 use std::process;
 
 /// Source language
@@ -32,6 +41,28 @@ enum OutputType {
     Asm,
     /// Raw binary ROM (.bin)
     Rom,
+    /// Relocatable object (.o), for linking into a ROM later
+    Obj,
+}
+
+/// How `--time-passes` and `--stats` are printed
+#[derive(Debug, Clone, Copy, ValueEnum, PartialEq, Default)]
+enum StatsFormat {
+    /// Aligned tables
+    #[default]
+    Table,
+    /// One JSON object with phases, counters and functions
+    Json,
+}
+
+/// Startup stub variant
+#[derive(Debug, Clone, Copy, ValueEnum, PartialEq, Default)]
+enum Startup {
+    /// Clear all of work RAM, VRAM, CRAM and VSRAM
+    #[default]
+    Full,
+    /// Clear only the RAM the program uses, plus CRAM and VSRAM
+    Minimal,
 }
 
 #[derive(ClapParser, Debug)]
@@ -40,9 +71,9 @@ enum OutputType {
 #[command(version = "0.2.0")]
 #[command(about = "C and Rust compiler for Sega Megadrive/Genesis (M68000)", long_about = None)]
 struct Args {
-    /// Input source file (.c or .rs)
-    #[arg(required = true)]
-    input: PathBuf,
+    /// Input files: sources (.c or .rs), and objects (.o) to link
+    #[arg(required = true, num_args = 1..)]
+    inputs: Vec<PathBuf>,
 
     /// Output file (assembly or ROM)
     #[arg(short, long)]
@@ -52,12 +83,12 @@ struct Args {
     #[arg(short, long, value_enum, default_value = "auto")]
     lang: Language,
 
-    /// Output type (asm or rom)
+    /// Output type (asm, rom or obj)
     #[arg(short = 't', long, value_enum, default_value = "asm")]
     output_type: OutputType,
 
     /// Optimization level (0-3)
-    #[arg(short = 'O', long, default_value = "0")]
+    #[arg(short = 'O', long, default_value = "0", value_parser = clap::value_parser!(u8).range(0..=3))]
     optimize: u8,
 
     /// Generate debug information
@@ -84,6 +115,44 @@ struct Args {
     #[arg(long)]
     dump_mir: bool,
 
+    /// Print estimated 68000 cycles per basic block (with -g, with source
+    /// lines); single-source builds only
+    #[arg(long)]
+    cycle_report: bool,
+
+    /// Print the time spent in each compiler phase (to stderr)
+    #[arg(long)]
+    time_passes: bool,
+
+    /// Print code size and IR counters, per function (to stderr)
+    #[arg(long)]
+    stats: bool,
+
+    /// Format for --time-passes and --stats (table or json)
+    #[arg(long, value_enum, default_value = "table")]
+    stats_format: StatsFormat,
+
+    /// What the startup code clears before main
+    #[arg(long, value_enum, default_value = "full")]
+    startup: Startup,
+
+    /// Pack the input, a raw binary asset, for `vdp_load_tiles_packed`
+    /// instead of compiling it (default output: .lz)
+    #[arg(long)]
+    pack: bool,
+
+    /// Link a raw binary file in as a packed read-only array (NAME=FILE)
+    #[arg(long = "asset", action = clap::ArgAction::Append)]
+    assets: Vec<String>,
+
+    /// Compile this many files at once (default: one per host core)
+    #[arg(short = 'j', long, default_value = "0")]
+    jobs: usize,
+
+    /// Reuse preprocessed sources and objects from earlier runs kept here
+    #[arg(long, value_name = "DIR")]
+    cache_dir: Option<PathBuf>,
+
     /// Include paths for #include directives
     #[arg(short = 'I', long = "include", action = clap::ArgAction::Append)]
     include_paths: Vec<PathBuf>,
@@ -101,13 +170,38 @@ struct Args {
 fn main() {
     let args = Args::parse();
 
-    if let Err(e) = run(&args) {
+    let result = if args.time_passes || args.stats {
+        let (result, stats) = stats::collect(|| stats::time("total", || run(&args)));
+        print_stats(&args, &stats);
+        result
+    } else {
+        run(&args)
+    };
+    if let Err(e) = result {
         eprintln!("error: {e}");
         process::exit(1);
     }
 }
 
-fn detect_language(path: &PathBuf, explicit: Language) -> Language {
+/// Write what `--time-passes` and `--stats` asked for to stderr
+fn print_stats(args: &Args, stats: &Stats) {
+    match args.stats_format {
+        StatsFormat::Json => eprint!("{}", stats.to_json()),
+        StatsFormat::Table => {
+            if args.time_passes {
+                eprint!("{}", stats.phase_table());
+            }
+            if args.stats {
+                if args.time_passes {
+                    eprintln!();
+                }
+                eprint!("{}", stats.counter_table());
+            }
+        }
+    }
+}
+
+fn detect_language(path: &Path, explicit: Language) -> Language {
     match explicit {
         Language::Auto => match path.extension().and_then(|e| e.to_str()) {
             Some("rs") => Language::Rust,
@@ -121,57 +215,56 @@ fn detect_language(path: &PathBuf, explicit: Language) -> Language {
     }
 }
 
-fn run(args: &Args) -> Result<(), Box<dyn std::error::Error>> {
-    // Read input file
-    let source = fs::read_to_string(&args.input)?;
-    let filename = args.input.display().to_string();
-
-    // Set up diagnostic reporter
-    let mut reporter = DiagnosticReporter::new();
-    let file_id = reporter.add_file(&filename, &source);
-
-    // Detect language
-    let language = detect_language(&args.input, args.lang);
-
-    // Determine output extension based on output type
-    let default_ext = match args.output_type {
-        OutputType::Asm => "s",
-        OutputType::Rom => "bin",
-    };
-
-    // Determine output path
-    let output_path = args.output.clone().unwrap_or_else(|| {
-        let mut path = args.input.clone();
-        path.set_extension(default_ext);
-        path
-    });
-
+/// Write the input file packed, for data embedded by other means
+fn pack(args: &Args, input: &Path) -> Result<(), Box<dyn Error>> {
+    let packed = asset::pack_file(input)?;
+    let output_path = args
+        .output
+        .clone()
+        .unwrap_or_else(|| input.with_extension("lz"));
+    fs::write(&output_path, &packed)?;
     if args.verbose {
-        let lang_str = match language {
-            Language::C => "C",
-            Language::Rust => "Rust",
-            Language::Auto => "auto",
-        };
-        let output_str = match args.output_type {
-            OutputType::Asm => "assembly",
-            OutputType::Rom => "ROM",
-        };
         eprintln!(
-            "Compiling {} ({}) -> {} ({})",
-            args.input.display(),
-            lang_str,
+            "Packed {} ({} bytes) -> {} ({} bytes)",
+            input.display(),
+            fs::metadata(input)?.len(),
             output_path.display(),
-            output_str
+            packed.len()
         );
     }
+    Ok(())
+}
+
+/// Whether an input is an object to link rather than a source to compile
+fn is_object(path: &Path) -> bool {
+    path.extension().is_some_and(|e| e == "o")
+}
+
+fn run(args: &Args) -> Result<(), Box<dyn Error>> {
+    if args.pack {
+        let [input] = args.inputs.as_slice() else {
+            return Err("--pack takes a single input".into());
+        };
+        return pack(args, input);
+    }
 
-    // Select frontend
-    let frontend: Box<dyn Frontend> = match language {
+    match args.inputs.as_slice() {
+        [input] if !is_object(input) && args.output_type != OutputType::Obj => compile(args, input),
+        _ => build_separately(args),
+    }
+}
+
+/// Select the frontend for a language
+fn frontend_for(language: Language) -> Box<dyn Frontend> {
+    match language {
         Language::C => Box::new(CFrontend::new()),
         Language::Rust => Box::new(RustFrontend::new()),
         Language::Auto => unreachable!(),
-    };
+    }
+}
 
+/// Frontend configuration for compiling `input`
+fn frontend_config(args: &Args, input: &Path) -> FrontendConfig {
     // Build include paths
     let mut include_paths = args.include_paths.clone();
 
@@ -182,7 +275,7 @@ fn run(args: &Args) -> Result<(), Box<dyn std::error::Error>> {
     }
 
     // Also check relative to input file
-    if let Some(parent) = args.input.parent() {
+    if let Some(parent) = input.parent() {
         let relative_sdk = parent.join("../include");
         if relative_sdk.exists() && !include_paths.contains(&relative_sdk) {
             include_paths.push(relative_sdk);
@@ -196,20 +289,136 @@ fn run(args: &Args) -> Result<(), Box<dyn std::error::Error>> {
         }
     }
 
-    // Configure frontend
-    let frontend_config = FrontendConfig {
+    FrontendConfig {
         dump_tokens: args.dump_tokens,
         dump_ast: args.dump_ast,
         dump_mir: args.dump_mir,
         verbose: args.verbose,
         include_paths,
+        cache_dir: args.cache_dir.clone(),
+    }
+}
+
+fn backend_config(args: &Args) -> BackendConfig {
+    BackendConfig {
+        output_format: match args.output_type {
+            OutputType::Asm => OutputFormat::Assembly,
+            OutputType::Rom => OutputFormat::Binary,
+            OutputType::Obj => OutputFormat::Object,
+        },
+        optimize_level: args.optimize,
+        debug_info: args.debug,
+        dump_ir: args.dump_ir,
+        verbose: args.verbose,
+        cycle_report: args.cycle_report,
+        startup: match args.startup {
+            Startup::Full => StartupMode::Full,
+            Startup::Minimal => StartupMode::Minimal,
+        },
+    }
+}
+
+fn rom_config(args: &Args) -> RomConfig {
+    RomConfig {
+        domestic_name: args.domestic_name.clone(),
+        overseas_name: args.overseas_name.clone(),
+        ..Default::default()
+    }
+}
+
+/// The `--asset` files, packed into read-only globals
+fn load_assets(args: &Args) -> Result<Vec<IrGlobal>, Box<dyn Error>> {
+    let mut globals = Vec::new();
+    for spec in &args.assets {
+        let global = asset::load(spec)?;
+        if args.verbose {
+            eprintln!("Asset {}: {} bytes packed", global.name, global.ty.size);
+        }
+        globals.push(global);
+    }
+    Ok(globals)
+}
+
+/// Compile a single source file straight to assembly or a ROM
+fn compile(args: &Args, input: &Path) -> Result<(), Box<dyn Error>> {
+    // Read input file
+    let source = stats::time("read", || fs::read_to_string(input))?;
+    let filename = input.display().to_string();
+
+    // Set up diagnostic reporter
+    let mut reporter = DiagnosticReporter::new();
+    let file_id = reporter.add_file(&filename, &source);
+
+    // Detect language
+    let language = detect_language(input, args.lang);
+
+    // Determine output extension based on output type
+    let default_ext = match args.output_type {
+        OutputType::Asm => "s",
+        OutputType::Rom => "bin",
+        OutputType::Obj => "o",
     };
 
+    // Determine output path
+    let output_path = args
+        .output
+        .clone()
+        .unwrap_or_else(|| input.with_extension(default_ext));
+
+    if args.verbose {
+        let lang_str = match language {
+            Language::C => "C",
+            Language::Rust => "Rust",
+            Language::Auto => "auto",
+        };
+        let output_str = match args.output_type {
+            OutputType::Asm => "assembly",
+            OutputType::Rom => "ROM",
+            OutputType::Obj => "object",
+        };
+        eprintln!(
+            "Compiling {} ({}) -> {} ({})",
+            input.display(),
+            lang_str,
+            output_path.display(),
+            output_str
+        );
+    }
+
+    // Select and configure frontend
+    let frontend = frontend_for(language);
+    let frontend_config = frontend_config(args, input);
+
     // Create compile context
     let ctx = CompileContext::new(filename.clone(), file_id, &reporter);
 
     // Compile to IR
-    let ir_module = frontend.compile(&source, &ctx, &frontend_config)?;
+    let mut ir_module = stats::time("frontend", || {
+        frontend.compile(&source, &ctx, &frontend_config)
+    })?;
+    ir_module
+        .globals
+        .extend(stats::time("assets", || load_assets(args))?);
+
+    // Optimize IR
+    let passes = PassManager::for_level(args.optimize);
+    if args.verbose && !passes.is_empty() {
+        eprintln!(
+            "IR passes (-O{}): {}",
+            args.optimize,
+            passes.pass_names().join(", ")
+        );
+    }
+    passes.run(&mut ir_module);
+    if args.optimize > 0 {
+        // Everything the startup code and interrupt vectors call into
+        let removed = stats::time("dead-symbols", || {
+            remove_dead_symbols(&mut ir_module, &["main", VBLANK_CALLBACK])
+        });
+        if args.verbose && !removed.is_empty() {
+            eprintln!("Removed unreachable symbols: {removed}");
+        }
+    }
 
     if args.dump_ir {
         eprintln!("=== IR ===");
@@ -218,29 +427,14 @@ fn run(args: &Args) -> Result<(), Box<dyn std::error::Error>> {
     }
 
     // Select backend and generate output
-    let backend_config = BackendConfig {
-        output_format: match args.output_type {
-            OutputType::Asm => OutputFormat::Assembly,
-            OutputType::Rom => OutputFormat::Binary,
-        },
-        optimize_level: args.optimize,
-        debug_info: args.debug,
-        dump_ir: args.dump_ir,
-        verbose: args.verbose,
-    };
+    let backend_config = backend_config(args);
 
     let mut registry = smd_compiler::backend::BackendRegistry::new();
     registry.register(Box::new(M68kBackend::new()));
-
-    let rom_config = RomConfig {
-        domestic_name: args.domestic_name.clone(),
-        overseas_name: args.overseas_name.clone(),
-        ..Default::default()
-    };
-    registry.register(Box::new(RomBackend::with_config(rom_config)));
+    registry.register(Box::new(RomBackend::with_config(rom_config(args))));
 
     let backend_name = match args.output_type {
-        OutputType::Asm => "m68k",
+        OutputType::Asm | OutputType::Obj => "m68k",
         OutputType::Rom => "rom",
     };
 
@@ -248,10 +442,16 @@ fn run(args: &Args) -> Result<(), Box<dyn std::error::Error>> {
         .find_by_name(backend_name)
         .ok_or_else(|| format!("Backend '{backend_name}' not found"))?;
 
-    let output = backend.generate(&ir_module, &ctx, &backend_config)?;
+    let output = stats::time("backend", || {
+        backend.generate(&ir_module, &ctx, &backend_config)
+    })?;
 
     // Write output
-    output.write_to(&output_path)?;
+    stats::time("write", || output.write_to(&output_path))?;
+
+    if let Some(report) = &output.cycle_report {
+        print!("{report}");
+    }
 
     if args.verbose {
         eprintln!("Successfully compiled to {}", output_path.display());
@@ -259,3 +459,169 @@ fn run(args: &Args) -> Result<(), Box<dyn std::error::Error>> {
 
     Ok(())
 }
+
+/// Compile one source file of a multi-file build to an object
+fn compile_object(args: &Args, input: &Path) -> Result<ObjectFile, Box<dyn Error + Send + Sync>> {
+    let source = stats::time("read", || fs::read_to_string(input))?;
+    let filename = input.display().to_string();
+    let mut reporter = DiagnosticReporter::new();
+    let file_id = reporter.add_file(&filename, &source);
+
+    let frontend = frontend_for(detect_language(input, args.lang));
+    let frontend_config = frontend_config(args, input);
+    let ctx = CompileContext::new(filename.clone(), file_id, &reporter);
+
+    // Dumps are only produced by an actual compile
+    let dumping = args.dump_tokens || args.dump_ast || args.dump_mir || args.dump_ir;
+    let (cached, preprocessed) = match &args.cache_dir {
+        Some(dir) if !dumping => {
+            let text = stats::time("preprocess", || {
+                frontend.preprocess(&source, &ctx, &frontend_config)
+            })?;
+            let key = cache::key_hasher("object")
+                .str(frontend.name())
+                .str(&filename)
+                .str(&text)
+                .str(&format!("-O{} -g{}", args.optimize, args.debug))
+                .finish();
+            let cache = BuildCache::new(dir);
+            if let Some(object) = cache.get(key).and_then(|b| ObjectFile::from_bytes(&b).ok()) {
+                if args.verbose {
+                    eprintln!("{filename}: object cached");
+                }
+                return Ok(object);
+            }
+            (Some((cache, key)), Some(text))
+        }
+        _ => (None, None),
+    };
+
+    // A miss compiles the text the key was made from, rather than
+    // preprocessing the unit and hashing its headers again
+    let mut ir_module = stats::time("frontend", || match &preprocessed {
+        Some(text) => frontend.compile_preprocessed(text, &ctx, &frontend_config),
+        None => frontend.compile(&source, &ctx, &frontend_config),
+    })?;
+
+    // Other objects may call anything here, so nothing counts as dead
+    PassManager::for_level(args.optimize).run(&mut ir_module);
+
+    if args.dump_ir {
+        eprintln!("=== IR: {filename} ===");
+        eprintln!("{ir_module}");
+        eprintln!("=== End IR ===\n");
+    }
+
+    let object = stats::time("backend", || {
+        M68kBackend::compile_object(&ir_module, &backend_config(args))
+    })?;
+    if let Some((cache, key)) = cached {
+        let _ = cache.put(key, &object.to_bytes());
+    }
+    Ok(object)
+}
+
+/// Compile each source to an object, in parallel, then either write the
+/// objects out (`-t obj`) or link them, with any `.o` inputs, into a ROM
+fn build_separately(args: &Args) -> Result<(), Box<dyn Error>> {
+    match args.output_type {
+        OutputType::Asm => {
+            return Err("assembly output takes a single source; use -t obj or -t rom".into());
+        }
+        // Objects keep no instructions to estimate, and cached or `.o`
+        // inputs were never generated here
+        _ if args.cycle_report => {
+            return Err("--cycle-report takes a single source built with -t asm or -t rom".into());
+        }
+        OutputType::Obj if args.inputs.iter().any(|p| is_object(p)) => {
+            return Err(".o inputs can only be linked, with -t rom".into());
+        }
+        OutputType::Obj if args.output.is_some() && args.inputs.len() > 1 => {
+            return Err("-o with -t obj takes a single input".into());
+        }
+        _ => {}
+    }
+
+    let jobs = job_count(args.jobs);
+    if args.verbose {
+        eprintln!(
+            "Compiling {} files on {} threads",
+            args.inputs.len(),
+            jobs.min(args.inputs.len())
+        );
+    }
+
+    // Each worker collects for its own files; they add up here
+    let collecting = stats::enabled();
+    let results = parallel_map(&args.inputs, jobs, |input| {
+        let build = || {
+            if is_object(input) {
+                let bytes = fs::read(input)?;
+                Ok(ObjectFile::from_bytes(&bytes)?)
+            } else {
+                compile_object(args, input)
+            }
+        };
+        if collecting {
+            let (result, stats) = stats::collect(build);
+            (result, Some(stats))
+        } else {
+            (build(), None)
+        }
+    });
+
+    let mut objects = Vec::with_capacity(results.len());
+    let mut failed = 0;
+    for (input, (result, collected)) in args.inputs.iter().zip(results) {
+        if let Some(collected) = collected {
+            stats::absorb(collected);
+        }
+        match result {
+            Ok(object) => objects.push(object),
+            Err(e) => {
+                eprintln!("error: {}: {e}", input.display());
+                failed += 1;
+            }
+        }
+    }
+    if failed > 0 {
+        return Err(format!("{failed} of {} inputs failed", args.inputs.len()).into());
+    }
+
+    if args.output_type == OutputType::Obj {
+        for (input, object) in args.inputs.iter().zip(&objects) {
+            let path = args
+                .output
+                .clone()
+                .unwrap_or_else(|| input.with_extension("o"));
+            fs::write(&path, object.to_bytes())?;
+            if args.verbose {
+                eprintln!("Compiled {} -> {}", input.display(), path.display());
+            }
+        }
+        return Ok(());
+    }
+
+    // Assets link in as one more object
+    let assets = load_assets(args)?;
+    if !assets.is_empty() {
+        let mut module = IrModule::new();
+        module.globals = assets;
+        objects.push(M68kBackend::compile_object(&module, &backend_config(args))?);
+    }
+
+    let output_path = args
+        .output
+        .clone()
+        .unwrap_or_else(|| args.inputs[0].with_extension("bin"));
+    let output = stats::time("backend", || {
+        RomBackend::with_config(rom_config(args)).link(objects, &backend_config(args))
+    })?;
+    stats::time("write", || output.write_to(&output_path))?;
+
+    if args.verbose {
+        eprintln!("Successfully linked {}", output_path.display());
+    }
+
+    Ok(())
+}
@@ -0,0 +1,289 @@
+//! Constant folding
+//!
+//! Evaluates operations on constants at compile time and turns conditional
+//! jumps on a constant into plain jumps (or removes them). The arithmetic
+//! mirrors what the 68000 lowering in `backend::m68k` computes, so folding
+//! never changes a program's result:
+//!
+//! - values are 32 bits wide
+//! - `Mul` is MULS, which multiplies the low words of its operands
+//! - division is DIVS/DIVU (32 by 16 bits). It isn't folded when the divisor
+//!   is zero or the quotient overflows a word, because the hardware traps or
+//!   leaves its operand unchanged in those cases
+//! - shifts are logical and use the count modulo 64
+
+use super::Pass;
+use crate::ir::{BinOp, Inst, IrFunction, UnOp, Value};
+
+pub struct ConstFold;
+
+impl Pass for ConstFold {
+    fn name(&self) -> &'static str {
+        "const-fold"
+    }
+
+    fn run(&self, func: &mut IrFunction) -> bool {
+        let mut changed = false;
+        for block in &mut func.blocks {
+            let mut i = 0;
+            while i < block.insts.len() {
+                match fold(&block.insts[i].inst) {
+                    Folded::Keep => i += 1,
+                    Folded::Replace(inst) => {
+                        block.insts[i].inst = inst;
+                        changed = true;
+                        i += 1;
+                    }
+                    Folded::Remove => {
+                        block.insts.remove(i);
+                        changed = true;
+                    }
+                }
+            }
+        }
+        changed
+    }
+}
+
+enum Folded {
+    Keep,
+    Replace(Inst),
+    Remove,
+}
+
+fn fold(inst: &Inst) -> Folded {
+    match inst {
+        Inst::Binary {
+            dst,
+            op,
+            left,
+            right,
+            width,
+        } => {
+            let folded = match (left, right) {
+                (Value::IntConst(l), Value::IntConst(r)) => {
+                    eval_binary(*op, *l, *r).map(Value::IntConst)
+                }
+                _ => simplify(*op, left, right),
+            };
+            match folded {
+                Some(src) => Folded::Replace(Inst::Copy {
+                    dst: *dst,
+                    src,
+                    width: *width,
+                }),
+                None => Folded::Keep,
+            }
+        }
+        Inst::Unary {
+            dst,
+            op,
+            src: Value::IntConst(n),
+            width,
+        } => Folded::Replace(Inst::Copy {
+            dst: *dst,
+            src: Value::IntConst(eval_unary(*op, *n)),
+            width: *width,
+        }),
+        Inst::CondJump {
+            cond: Value::IntConst(n),
+            target,
+        } => {
+            if truth(*n) {
+                Folded::Replace(Inst::Jump(*target))
+            } else {
+                Folded::Remove
+            }
+        }
+        Inst::CondJumpFalse {
+            cond: Value::IntConst(n),
+            target,
+        } => {
+            if truth(*n) {
+                Folded::Remove
+            } else {
+                Folded::Replace(Inst::Jump(*target))
+            }
+        }
+        Inst::Switch {
+            value: Value::IntConst(n),
+            cases,
+            default,
+        } => {
+            let target = cases
+                .iter()
+                .find(|(case, _)| *case as i32 == *n as i32)
+                .map_or(default, |(_, label)| label);
+            Folded::Replace(Inst::Jump(*target))
+        }
+        _ => Folded::Keep,
+    }
+}
+
+/// Branch conditions test all 32 bits
+pub(super) fn truth(n: i64) -> bool {
+    n as i32 != 0
+}
+
+/// Evaluate `l op r` as the generated 68000 code would
+pub(super) fn eval_binary(op: BinOp, l: i64, r: i64) -> Option<i64> {
+    let (l, r) = (l as i32, r as i32);
+    let v = match op {
+        BinOp::Add => l.wrapping_add(r),
+        BinOp::Sub => l.wrapping_sub(r),
+        BinOp::Mul => i32::from(l as i16) * i32::from(r as i16),
+        BinOp::Div | BinOp::Mod => {
+            let d = i32::from(r as i16);
+            let q = l.checked_div(d)?;
+            i16::try_from(q).ok()?;
+            if op == BinOp::Div { q } else { l % d }
+        }
+        BinOp::UDiv | BinOp::UMod => {
+            let (l, d) = (l as u32, u32::from(r as u16));
+            let q = l.checked_div(d)?;
+            if q > 0xFFFF {
+                return None;
+            }
+            (if op == BinOp::UDiv { q } else { l % d }) as i32
+        }
+        BinOp::And => l & r,
+        BinOp::Or => l | r,
+        BinOp::Xor => l ^ r,
+        BinOp::Shl | BinOp::Shr => {
+            let count = r & 63;
+            if count >= 32 {
+                0
+            } else if op == BinOp::Shl {
+                ((l as u32) << count) as i32
+            } else {
+                ((l as u32) >> count) as i32
+            }
+        }
+        BinOp::Eq => i32::from(l == r),
+        BinOp::Ne => i32::from(l != r),
+        BinOp::Lt => i32::from(l < r),
+        BinOp::Le => i32::from(l <= r),
+        BinOp::Gt => i32::from(l > r),
+        BinOp::Ge => i32::from(l >= r),
+    };
+    Some(i64::from(v))
+}
+
+fn eval_unary(op: UnOp, n: i64) -> i64 {
+    let n = n as i32;
+    i64::from(match op {
+        UnOp::Neg => n.wrapping_neg(),
+        UnOp::Not => i32::from(n == 0),
+        UnOp::BitNot => !n,
+    })
+}
+
+/// Algebraic identities with one constant operand
+fn simplify(op: BinOp, left: &Value, right: &Value) -> Option<Value> {
+    let is = |v: &Value, n: i32| matches!(v, Value::IntConst(c) if *c as i32 == n);
+    match op {
+        BinOp::Add | BinOp::Or | BinOp::Xor if is(left, 0) => Some(right.clone()),
+        BinOp::Add | BinOp::Sub | BinOp::Or | BinOp::Xor | BinOp::Shl | BinOp::Shr
+            if is(right, 0) =>
+        {
+            Some(left.clone())
+        }
+        BinOp::And if is(left, -1) => Some(right.clone()),
+        BinOp::And if is(right, -1) => Some(left.clone()),
+        // Dropping the other operand must not drop a memory read
+        BinOp::And | BinOp::Mul
+            if (is(left, 0) && !right.reads_memory()) || (is(right, 0) && !left.reads_memory()) =>
+        {
+            Some(Value::IntConst(0))
+        }
+        _ => None,
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::ir::{Label, Temp};
+    use crate::opt::test_util::{body, function};
+    use pretty_assertions::assert_eq;
+
+    #[test]
+    fn test_eval_matches_hardware() {
+        assert_eq!(eval_binary(BinOp::Add, 0x7FFF_FFFF, 1), Some(-0x8000_0000));
+        assert_eq!(eval_binary(BinOp::Mul, 300, 300), Some(90000));
+        // MULS only sees the low word of 0x10002
+        assert_eq!(eval_binary(BinOp::Mul, 0x10002, 3), Some(6));
+        assert_eq!(eval_binary(BinOp::Div, -7, 2), Some(-3));
+        assert_eq!(eval_binary(BinOp::Mod, -7, 2), Some(-1));
+        assert_eq!(eval_binary(BinOp::UMod, 70000, 16), Some(70000 % 16));
+        assert_eq!(eval_binary(BinOp::Shr, -1, 28), Some(0xF));
+        assert_eq!(eval_binary(BinOp::Shl, 1, 40), Some(0));
+        assert_eq!(eval_binary(BinOp::Lt, -1, 0), Some(1));
+        assert_eq!(eval_unary(UnOp::Not, 0x1_0000_0000), 1);
+    }
+
+    #[test]
+    fn test_unfoldable_division_kept() {
+        assert_eq!(eval_binary(BinOp::Div, 1, 0), None);
+        // Quotient does not fit in a word: DIVS sets V and leaves Dn alone
+        assert_eq!(eval_binary(BinOp::Div, 100_000, 1), None);
+        assert_eq!(eval_binary(BinOp::UDiv, 0x20000, 1), None);
+    }
+
+    #[test]
+    fn test_fold_instructions() {
+        let mut func = function(vec![(
+            "entry",
+            vec![
+                Inst::Binary {
+                    dst: Temp(0),
+                    op: BinOp::Shl,
+                    left: Value::IntConst(3),
+                    right: Value::IntConst(4),
+                    width: 4,
+                },
+                Inst::Binary {
+                    dst: Temp(1),
+                    op: BinOp::Add,
+                    left: Value::Temp(Temp(0)),
+                    right: Value::IntConst(0),
+                    width: 4,
+                },
+                Inst::CondJumpFalse {
+                    cond: Value::IntConst(1),
+                    target: Label("never".into()),
+                },
+                Inst::CondJump {
+                    cond: Value::IntConst(2),
+                    target: Label("always".into()),
+                },
+            ],
+        )]);
+        assert!(ConstFold.run(&mut func));
+        assert_eq!(body(&func), "entry:\nt0 = 48\nt1 = t0\njump always");
+    }
+
+    #[test]
+    fn test_fold_switch_on_constant() {
+        let switch = |n| {
+            function(vec![(
+                "entry",
+                vec![Inst::Switch {
+                    value: Value::IntConst(n),
+                    cases: vec![(-1, Label("neg".into())), (3, Label("three".into()))],
+                    default: Label("other".into()),
+                }],
+            )])
+        };
+        for (n, target) in [
+            (3, "three"),
+            (-1, "neg"),
+            (0xFFFF_FFFF, "neg"),
+            (4, "other"),
+        ] {
+            let mut func = switch(n);
+            assert!(ConstFold.run(&mut func));
+            assert_eq!(body(&func), format!("entry:\njump {target}"));
+        }
+    }
+}
@@ -0,0 +1,237 @@
+//! Copy and constant propagation
+//!
+//! Replaces reads of a temp with the value it was copied from. IR temps may
+//! be assigned more than once, so a copy `d = s` is only forwarded where `s`
+//! is known to still hold the copied value:
+//!
+//! - inside the copy's block, until `d` or `s` is redefined
+//! - everywhere, if the copy is `d`'s only definition and `s` is a constant,
+//!   a temp whose single definition always yields the same value (a frame or
+//!   global address), or a temp defined just before the copy
+
+use super::{Pass, def_counts, insts};
+use crate::ir::{Inst, IrFunction, SpannedInst, Temp, Value};
+use std::collections::{HashMap, HashSet};
+
+pub struct CopyProp;
+
+impl Pass for CopyProp {
+    fn name(&self) -> &'static str {
+        "copy-prop"
+    }
+
+    fn run(&self, func: &mut IrFunction) -> bool {
+        let global = global_copies(func);
+        let mut changed = false;
+
+        for block in &mut func.blocks {
+            let mut avail: HashMap<Temp, Value> = HashMap::new();
+            for sinst in &mut block.insts {
+                let inst = &mut sinst.inst;
+                let lookup = |t| avail.get(&t).or_else(|| global.get(&t)).cloned();
+                for operand in inst.operands_mut() {
+                    changed |= operand.substitute(&lookup);
+                }
+
+                if let Some(dst) = inst.def() {
+                    avail.retain(|&k, v| k != dst && v.as_temp() != Some(dst));
+                    if let Inst::Copy { src, .. } = inst
+                        && is_forwardable(src)
+                        && src.as_temp() != Some(dst)
+                    {
+                        avail.insert(dst, src.clone());
+                    }
+                }
+            }
+        }
+        changed
+    }
+}
+
+/// Values that can be re-read at another point without changing meaning
+fn is_forwardable(value: &Value) -> bool {
+    matches!(
+        value,
+        Value::Temp(_) | Value::IntConst(_) | Value::StringConst(_)
+    )
+}
+
+/// Copies that can be forwarded to every read of their destination
+fn global_copies(func: &IrFunction) -> HashMap<Temp, Value> {
+    let defs = def_counts(func);
+    let single = |t: &Temp| defs.get(t) == Some(&1);
+
+    // Single-definition temps whose value never changes once computed
+    let mut constants: HashMap<Temp, Value> = HashMap::new();
+    let mut invariant: HashSet<Temp> = HashSet::new();
+    for inst in insts(func) {
+        match inst {
+            Inst::Copy {
+                dst,
+                src: src @ (Value::IntConst(_) | Value::StringConst(_)),
+                ..
+            } if single(dst) => {
+                constants.insert(*dst, src.clone());
+            }
+            Inst::Alloca { dst, .. } | Inst::AddrOf { dst, .. } | Inst::LoadParam { dst, .. }
+                if single(dst) =>
+            {
+                invariant.insert(*dst);
+            }
+            _ => {}
+        }
+    }
+
+    let mut map = constants.clone();
+    for block in &func.blocks {
+        for (i, sinst) in block.insts.iter().enumerate() {
+            let Inst::Copy {
+                dst,
+                src: Value::Temp(src),
+                ..
+            } = &sinst.inst
+            else {
+                continue;
+            };
+            if !single(dst) || !single(src) || dst == src {
+                continue;
+            }
+            if let Some(value) = constants.get(src) {
+                map.insert(*dst, value.clone());
+            } else if invariant.contains(src) || defined_just_before(&block.insts, i, *src, *dst) {
+                map.insert(*dst, Value::Temp(*src));
+            }
+        }
+    }
+    map
+}
+
+/// Whether `src` is defined earlier in `insts` than the copy at `copy`, with
+/// no branch and no read of `dst` in between.
+///
+/// Blocks are only entered at the top, so whenever `src` is recomputed the
+/// copy runs again before `dst` can be read.
+fn defined_just_before(insts: &[SpannedInst], copy: usize, src: Temp, dst: Temp) -> bool {
+    for sinst in insts[..copy].iter().rev() {
+        let inst = &sinst.inst;
+        if inst.def() == Some(src) {
+            return true;
+        }
+        if !inst.branch_targets().is_empty() || inst.uses().contains(&dst) {
+            return false;
+        }
+    }
+    false
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::ir::{BinOp, Label};
+    use crate::opt::test_util::{body, function};
+    use pretty_assertions::assert_eq;
+
+    fn copy(dst: u32, src: Value) -> Inst {
+        Inst::Copy {
+            dst: Temp(dst),
+            src,
+            width: 4,
+        }
+    }
+
+    fn add(dst: u32, left: Value, right: Value) -> Inst {
+        Inst::Binary {
+            dst: Temp(dst),
+            op: BinOp::Add,
+            left,
+            right,
+            width: 4,
+        }
+    }
+
+    #[test]
+    fn test_local_copy_forwarded() {
+        let mut func = function(vec![(
+            "entry",
+            vec![
+                add(0, Value::Name("g".into()), Value::IntConst(1)),
+                copy(1, Value::Temp(Temp(0))),
+                add(2, Value::Temp(Temp(1)), Value::Temp(Temp(1))),
+                Inst::Return(Some(Value::Temp(Temp(2)))),
+            ],
+        )]);
+        assert!(CopyProp.run(&mut func));
+        assert!(body(&func).contains("t2 = t0 + t0"));
+    }
+
+    #[test]
+    fn test_redefined_source_stops_forwarding() {
+        // t1 = t0; t0 = t0 + 1; return t1  -- t1 must keep the old value
+        let mut func = function(vec![(
+            "entry",
+            vec![
+                copy(0, Value::Name("g".into())),
+                copy(1, Value::Temp(Temp(0))),
+                add(0, Value::Temp(Temp(0)), Value::IntConst(1)),
+                Inst::Return(Some(Value::Temp(Temp(1)))),
+            ],
+        )]);
+        CopyProp.run(&mut func);
+        assert!(body(&func).ends_with("return t1"));
+    }
+
+    #[test]
+    fn test_constant_forwarded_across_blocks() {
+        let mut func = function(vec![
+            ("entry", vec![copy(0, Value::IntConst(5))]),
+            (
+                "next",
+                vec![
+                    add(1, Value::Temp(Temp(0)), Value::IntConst(1)),
+                    Inst::Return(Some(Value::Temp(Temp(1)))),
+                ],
+            ),
+        ]);
+        assert!(CopyProp.run(&mut func));
+        assert!(body(&func).contains("t1 = 5 + 1"));
+    }
+
+    #[test]
+    fn test_copy_in_loop_not_forwarded_past_branch() {
+        // loop: t0 = g; if t0 goto out; t1 = t0; jump loop; out: return t1
+        // t1's read at `out` must see the previous iteration's copy.
+        let mut func = function(vec![
+            (
+                "loop",
+                vec![
+                    copy(0, Value::Name("g".into())),
+                    Inst::CondJump {
+                        cond: Value::Temp(Temp(0)),
+                        target: Label("out".into()),
+                    },
+                    copy(1, Value::Temp(Temp(0))),
+                    Inst::Jump(Label("loop".into())),
+                ],
+            ),
+            ("out", vec![Inst::Return(Some(Value::Temp(Temp(1))))]),
+        ]);
+        CopyProp.run(&mut func);
+        assert!(body(&func).ends_with("return t1"));
+    }
+
+    #[test]
+    fn test_copy_of_adjacent_definition_forwarded() {
+        let mut func = function(vec![
+            (
+                "entry",
+                vec![
+                    add(0, Value::Name("g".into()), Value::IntConst(2)),
+                    copy(1, Value::Temp(Temp(0))),
+                ],
+            ),
+            ("next", vec![Inst::Return(Some(Value::Temp(Temp(1))))]),
+        ]);
+        assert!(CopyProp.run(&mut func));
+        assert_eq!(body(&func), "entry:\nt0 = g + 2\nt1 = t0\nnext:\nreturn t0");
+    }
+}
@@ -0,0 +1,253 @@
+//! Whole-program dead function and data elimination
+//!
+//! The backend emits every function, global and string literal of the
+//! module, so helpers and tables pulled in from shared headers cost ROM and
+//! RAM even when nothing calls or reads them. This walks the references from
+//! the program's entry points (`main` and the interrupt callbacks the
+//! backend wires up) and drops everything it can't reach. Functions whose
+//! address is taken are reached through that reference like any other.
+//!
+//! A module without `main` is not a whole program, and is left alone.
+
+use crate::common::Symbol;
+use crate::ir::{Inst, IrModule, Value};
+use std::collections::HashSet;
+
+/// What `remove_dead_symbols` dropped
+#[derive(Debug, Clone, Default, PartialEq, Eq)]
+pub struct RemovedSymbols {
+    pub functions: usize,
+    /// IR instructions of the removed functions
+    pub insts: usize,
+    pub globals: usize,
+    pub strings: usize,
+    /// Bytes of writable globals
+    pub ram_bytes: usize,
+    /// Bytes of read-only globals and string literals
+    pub rom_bytes: usize,
+}
+
+impl RemovedSymbols {
+    pub fn is_empty(&self) -> bool {
+        self.functions == 0 && self.globals == 0 && self.strings == 0
+    }
+}
+
+impl std::fmt::Display for RemovedSymbols {
+    fn fmt(&self, f: &mut std::fmt::Formatter<'_>) -> std::fmt::Result {
+        write!(
+            f,
+            "{} functions ({} IR instructions), {} globals, {} strings; \
+             {} bytes of RAM, {} bytes of ROM data",
+            self.functions, self.insts, self.globals, self.strings, self.ram_bytes, self.rom_bytes
+        )
+    }
+}
+
+/// Remove the functions, globals and strings of `module` that no chain of
+/// references from `roots` reaches. Roots the module doesn't define are
+/// ignored.
+pub fn remove_dead_symbols(module: &mut IrModule, roots: &[&str]) -> RemovedSymbols {
+    let mut removed = RemovedSymbols::default();
+    if !module.functions.iter().any(|f| f.name == "main") {
+        return removed;
+    }
+    let live = reachable(module, roots);
+
+    module.functions.retain(|func| {
+        let keep = live.contains(&Symbol::from(&func.name));
+        if !keep {
+            removed.functions += 1;
+            removed.insts += func.blocks.iter().map(|b| b.insts.len()).sum::<usize>();
+        }
+        keep
+    });
+    module.globals.retain(|global| {
+        let keep = live.contains(&Symbol::from(&global.name));
+        if !keep {
+            removed.globals += 1;
+            if global.readonly {
+                removed.rom_bytes += global.ty.size;
+            } else {
+                removed.ram_bytes += global.ty.size;
+            }
+        }
+        keep
+    });
+    module.strings.retain(|(label, text)| {
+        let keep = live.contains(&label.0);
+        if !keep {
+            removed.strings += 1;
+            // Strings are emitted NUL-terminated
+            removed.rom_bytes += text.len() + 1;
+        }
+        keep
+    });
+    removed
+}
+
+/// Names of the functions, globals and strings reachable from `roots`
+fn reachable(module: &IrModule, roots: &[&str]) -> HashSet<Symbol> {
+    let mut live = HashSet::new();
+    let mut work: Vec<Symbol> = roots.iter().map(|&root| root.into()).collect();
+    while let Some(name) = work.pop() {
+        if !live.insert(name) {
+            continue;
+        }
+        // Only functions refer to anything: global initializers are plain bytes
+        let Some(func) = module.functions.iter().find(|f| name == f.name) else {
+            continue;
+        };
+        for sinst in func.blocks.iter().flat_map(|b| &b.insts) {
+            match &sinst.inst {
+                Inst::Call { func, .. } => work.push(*func),
+                Inst::AddrOf { name, .. } => work.push(*name),
+                _ => {}
+            }
+            for value in sinst.inst.operands() {
+                collect_names(value, &mut work);
+            }
+        }
+    }
+    live
+}
+
+/// Push every symbol `value` mentions onto `out`
+fn collect_names(value: &Value, out: &mut Vec<Symbol>) {
+    match value {
+        Value::Name(name) => out.push(*name),
+        Value::StringConst(label) => out.push(label.0),
+        Value::Mem(addr) => collect_names(addr, out),
+        Value::Temp(_) | Value::IntConst(_) => {}
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::ir::{BasicBlock, IrFunction, IrGlobal, Label, SpannedInst, Temp};
+    use crate::types::IrType;
+    use pretty_assertions::assert_eq;
+
+    fn function(name: &str, insts: Vec<Inst>) -> IrFunction {
+        let mut func = IrFunction::new(name.to_string(), Vec::new(), IrType::void());
+        let mut block = BasicBlock::new(Label(name.into()));
+        block.insts = insts.into_iter().map(SpannedInst::bare).collect();
+        func.blocks.push(block);
+        func
+    }
+
+    fn call(func: &str) -> Inst {
+        Inst::Call {
+            dst: None,
+            func: func.into(),
+            args: Vec::new(),
+        }
+    }
+
+    fn global(name: &str, readonly: bool) -> IrGlobal {
+        IrGlobal {
+            name: name.to_string(),
+            ty: IrType::i32(),
+            init: None,
+            readonly,
+            internal: false,
+        }
+    }
+
+    fn names(module: &IrModule) -> Vec<&str> {
+        module
+            .functions
+            .iter()
+            .map(|f| f.name.as_str())
+            .chain(module.globals.iter().map(|g| g.name.as_str()))
+            .chain(module.strings.iter().map(|(l, _)| l.0.as_str()))
+            .collect()
+    }
+
+    #[test]
+    fn test_removes_unreferenced_symbols() {
+        let mut module = IrModule::new();
+        module.functions = vec![
+            function("main", vec![call("helper"), Inst::Return(None)]),
+            function(
+                "helper",
+                vec![
+                    Inst::Store {
+                        addr: Value::Name("counter".into()),
+                        src: Value::StringConst(Label(".Lstr0".into())),
+                        size: 4,
+                        volatile: false,
+                    },
+                    Inst::Return(None),
+                ],
+            ),
+            function(
+                "unused",
+                vec![
+                    call("helper"),
+                    Inst::Load {
+                        dst: Temp(0),
+                        addr: Value::Name("table".into()),
+                        size: 4,
+                        volatile: false,
+                        signed: false,
+                        width: 4,
+                    },
+                ],
+            ),
+        ];
+        module.globals = vec![
+            global("counter", false),
+            global("table", true),
+            global("spare", false),
+        ];
+        module.strings = vec![
+            (Label(".Lstr0".into()), "hi".to_string()),
+            (Label(".Lstr1".into()), "unused".to_string()),
+        ];
+
+        let removed = remove_dead_symbols(&mut module, &["main"]);
+        assert_eq!(names(&module), vec!["main", "helper", "counter", ".Lstr0"]);
+        assert_eq!(
+            removed,
+            RemovedSymbols {
+                functions: 1,
+                insts: 2,
+                globals: 2,
+                strings: 1,
+                ram_bytes: 4,
+                rom_bytes: 4 + 7,
+            }
+        );
+    }
+
+    #[test]
+    fn test_keeps_handlers_and_address_taken_functions() {
+        let mut module = IrModule::new();
+        module.functions = vec![
+            function(
+                "main",
+                vec![Inst::AddrOf {
+                    dst: Temp(0),
+                    name: "callback".into(),
+                }],
+            ),
+            function("callback", vec![Inst::Return(None)]),
+            function("vblank_handler", vec![call("tick")]),
+            function("tick", vec![Inst::Return(None)]),
+        ];
+        let removed = remove_dead_symbols(&mut module, &["main", "vblank_handler"]);
+        assert!(removed.is_empty());
+        assert_eq!(module.functions.len(), 4);
+    }
+
+    #[test]
+    fn test_module_without_main_is_kept() {
+        let mut module = IrModule::new();
+        module.functions = vec![function("lib", Vec::new())];
+        module.globals = vec![global("state", false)];
+        assert!(remove_dead_symbols(&mut module, &["main"]).is_empty());
+        assert_eq!(names(&module), vec!["lib", "state"]);
+    }
+}
@@ -0,0 +1,202 @@
+//! Dead temp elimination
+//!
+//! Removes side-effect-free instructions whose result is never read, and
+//! drops unused call results. A value only counts as read if something with
+//! an effect depends on it, so a counter that only feeds its own next value
+//! goes too. Loads are only removed when they read memory the compiler owns
+//! (stack slots and named globals). Frontends don't mark every hardware
+//! register access volatile, so loads through arbitrary pointers are kept.
+
+use super::{Pass, def_counts, insts};
+use crate::ir::{Inst, IrFunction, Temp, Value};
+use std::collections::HashSet;
+
+pub struct DeadTemps;
+
+impl Pass for DeadTemps {
+    fn name(&self) -> &'static str {
+        "dead-temps"
+    }
+
+    fn run(&self, func: &mut IrFunction) -> bool {
+        let owned = owned_addresses(func);
+        let needed = needed_temps(func, &owned);
+        let mut changed = false;
+        for block in &mut func.blocks {
+            block.insts.retain_mut(|sinst| {
+                let keep = !is_dead(&sinst.inst, &needed, &owned);
+                if let Inst::Call { dst, .. } = &mut sinst.inst
+                    && dst.is_some_and(|t| !needed.contains(&t))
+                {
+                    *dst = None;
+                    changed = true;
+                }
+                changed |= !keep;
+                keep
+            });
+        }
+        changed
+    }
+}
+
+/// Temps read by an instruction that can't be removed, directly or through
+/// the instructions computing them
+fn needed_temps(func: &IrFunction, owned: &HashSet<Temp>) -> HashSet<Temp> {
+    let mut needed: HashSet<Temp> = insts(func)
+        .filter(|inst| !is_removable(inst, owned))
+        .flat_map(Inst::uses)
+        .collect();
+    loop {
+        let before = needed.len();
+        for inst in insts(func) {
+            if inst.def().is_some_and(|d| needed.contains(&d)) && is_removable(inst, owned) {
+                needed.extend(inst.uses());
+            }
+        }
+        if needed.len() == before {
+            return needed;
+        }
+    }
+}
+
+/// Temps holding the address of a stack slot or global
+fn owned_addresses(func: &IrFunction) -> HashSet<Temp> {
+    let defs = def_counts(func);
+    insts(func)
+        .filter_map(|inst| match inst {
+            Inst::Alloca { dst, .. } | Inst::LoadParam { dst, .. } | Inst::AddrOf { dst, .. }
+                if defs.get(dst) == Some(&1) =>
+            {
+                Some(*dst)
+            }
+            _ => None,
+        })
+        .collect()
+}
+
+fn is_dead(inst: &Inst, needed: &HashSet<Temp>, owned: &HashSet<Temp>) -> bool {
+    if let Inst::Copy {
+        dst,
+        src: Value::Temp(src),
+        ..
+    } = inst
+        && dst == src
+    {
+        return true;
+    }
+    inst.def().is_some_and(|dst| !needed.contains(&dst)) && is_removable(inst, owned)
+}
+
+/// Whether `inst` only computes its result, so it can go if that is unused
+fn is_removable(inst: &Inst, owned: &HashSet<Temp>) -> bool {
+    match inst {
+        Inst::Copy { src, .. } | Inst::Unary { src, .. } => !src.reads_memory(),
+        Inst::Binary { left, right, .. } => !left.reads_memory() && !right.reads_memory(),
+        Inst::Load { addr, volatile, .. } => {
+            !volatile
+                && match addr {
+                    Value::Temp(t) => owned.contains(t),
+                    Value::Name(_) => true,
+                    _ => false,
+                }
+        }
+        Inst::Alloca { .. } | Inst::AddrOf { .. } | Inst::LoadParam { .. } => true,
+        _ => false,
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::ir::{BinOp, Label};
+    use crate::opt::test_util::{body, function};
+    use pretty_assertions::assert_eq;
+
+    #[test]
+    fn test_removes_dead_chain_keeps_device_load() {
+        let mut func = function(vec![(
+            "entry",
+            vec![
+                Inst::Alloca {
+                    dst: Temp(0),
+                    size: 4,
+                    align: 2,
+                },
+                Inst::Load {
+                    dst: Temp(1),
+                    addr: Value::Temp(Temp(0)),
+                    size: 4,
+                    volatile: false,
+                    signed: true,
+                    width: 4,
+                },
+                Inst::Binary {
+                    dst: Temp(2),
+                    op: BinOp::Add,
+                    left: Value::Temp(Temp(1)),
+                    right: Value::IntConst(1),
+                    width: 4,
+                },
+                // Reading a status port has side effects even if unused
+                Inst::Load {
+                    dst: Temp(3),
+                    addr: Value::IntConst(0xC0_0004),
+                    size: 2,
+                    volatile: false,
+                    signed: false,
+                    width: 4,
+                },
+                Inst::Call {
+                    dst: Some(Temp(4)),
+                    func: "f".into(),
+                    args: Vec::new(),
+                },
+                Inst::Return(None),
+            ],
+        )]);
+        assert!(DeadTemps.run(&mut func));
+        assert_eq!(
+            body(&func),
+            "entry:\nt3 = load.u2 12582916\ncall f()\nreturn"
+        );
+    }
+
+    #[test]
+    fn test_removes_value_only_feeding_itself() {
+        let step = |dst, src| Inst::Binary {
+            dst: Temp(dst),
+            op: BinOp::Sub,
+            left: Value::Temp(Temp(src)),
+            right: Value::IntConst(1),
+            width: 4,
+        };
+        let mut func = function(vec![
+            (
+                "entry",
+                vec![Inst::Copy {
+                    dst: Temp(0),
+                    src: Value::IntConst(10),
+                    width: 4,
+                }],
+            ),
+            (
+                "loop",
+                vec![
+                    step(1, 0),
+                    Inst::Copy {
+                        dst: Temp(0),
+                        src: Value::Temp(Temp(1)),
+                        width: 4,
+                    },
+                    step(2, 2),
+                    Inst::DecJump {
+                        counter: Temp(2),
+                        target: Label("loop".into()),
+                    },
+                ],
+            ),
+        ]);
+        assert!(DeadTemps.run(&mut func));
+        assert_eq!(body(&func), "entry:\nloop:\nt2 = t2 - 1\ndec t2 goto loop");
+    }
+}
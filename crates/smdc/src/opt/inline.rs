@@ -0,0 +1,242 @@
+//! Function inlining
+//!
+//! Replaces calls to small functions of the module with a copy of their
+//! body. That saves the argument pushes, JSR, frame setup and register saves
+//! of a standard call, and lets the caller's passes fold constant arguments
+//! into the copy. Each parameter becomes a local slot holding its argument
+//! (which `-O2` promotes to a temp), and each return becomes a copy to the
+//! call's result followed by a jump past the inlined body.
+//!
+//! Callees are handled before their callers, so a helper is measured after
+//! its own calls were inlined and the result optimized. Recursive functions
+//! are never inlined. The original function is kept for other callers and
+//! taken addresses.
+
+use super::next_temp;
+use crate::common::Symbol;
+use crate::ir::{BasicBlock, Inst, IrFunction, IrModule, Label, SpannedInst, Temp, Value};
+use std::collections::HashMap;
+
+/// Largest callee inlined at each `-O` level, in IR instructions. A standard
+/// call costs about as much as a dozen simple instructions.
+const MAX_COST: [usize; 4] = [0, 4, 12, 32];
+
+pub struct Inliner {
+    max_cost: usize,
+}
+
+impl Inliner {
+    /// Inline callees of at most `max_cost` instructions
+    pub fn new(max_cost: usize) -> Self {
+        Self { max_cost }
+    }
+
+    /// The inliner behind `-O<level>`
+    pub fn for_level(level: u8) -> Self {
+        Self::new(MAX_COST[usize::from(level.min(3))])
+    }
+
+    /// Short name for diagnostics
+    pub fn name(&self) -> &'static str {
+        "inline"
+    }
+
+    /// Inline eligible calls in every function of `module`, returning true
+    /// if any were. Each function that took in a copy is passed to
+    /// `optimize` before its own callers look at its size.
+    pub fn run(&self, module: &mut IrModule, optimize: &mut dyn FnMut(&mut IrFunction)) -> bool {
+        let index: HashMap<Symbol, usize> = module
+            .functions
+            .iter()
+            .enumerate()
+            .map(|(i, func)| (Symbol::from(&func.name), i))
+            .collect();
+        let calls: Vec<Vec<usize>> = module
+            .functions
+            .iter()
+            .map(|func| callees(func, &index))
+            .collect();
+        let recursive: Vec<bool> = (0..calls.len()).map(|f| reaches(&calls, f, f)).collect();
+
+        let mut changed = false;
+        for caller in post_order(&calls) {
+            let mut inlined = 0;
+            let mut block = 0;
+            while let Some((b, i, callee)) =
+                self.find_call(&module.functions, caller, block, &index, &recursive)
+            {
+                let body = module.functions[callee].clone();
+                inline_call(&mut module.functions[caller], b, i, &body, inlined);
+                inlined += 1;
+                // Carry on after the copy: its calls were already considered
+                // when the callee itself was processed
+                block = b + body.blocks.len() + 1;
+            }
+            if inlined > 0 {
+                optimize(&mut module.functions[caller]);
+                changed = true;
+            }
+        }
+        changed
+    }
+
+    /// The first call from block `from` of `functions[caller]` on that
+    /// should be inlined, as (block, instruction, callee)
+    fn find_call(
+        &self,
+        functions: &[IrFunction],
+        caller: usize,
+        from: usize,
+        index: &HashMap<Symbol, usize>,
+        recursive: &[bool],
+    ) -> Option<(usize, usize, usize)> {
+        let blocks = &functions[caller].blocks;
+        for (b, block) in blocks.iter().enumerate().skip(from) {
+            for (i, sinst) in block.insts.iter().enumerate() {
+                let Inst::Call { func, args, .. } = &sinst.inst else {
+                    continue;
+                };
+                let Some(&callee) = index.get(func) else {
+                    continue;
+                };
+                let body = &functions[callee];
+                if callee != caller
+                    && !recursive[callee]
+                    && body.params.len() == args.len()
+                    && cost(body) <= self.max_cost
+                {
+                    return Some((b, i, callee));
+                }
+            }
+        }
+        None
+    }
+}
+
+/// Size of `func` once inlined: parameters turn into the caller's
+/// arguments, so they are free
+fn cost(func: &IrFunction) -> usize {
+    func.blocks
+        .iter()
+        .flat_map(|b| &b.insts)
+        .filter(|s| !matches!(s.inst, Inst::Comment(_) | Inst::LoadParam { .. }))
+        .count()
+}
+
+/// Module functions called by `func`, by index
+fn callees(func: &IrFunction, index: &HashMap<Symbol, usize>) -> Vec<usize> {
+    let mut out: Vec<usize> = func
+        .blocks
+        .iter()
+        .flat_map(|b| &b.insts)
+        .filter_map(|s| match &s.inst {
+            Inst::Call { func, .. } => index.get(func).copied(),
+            _ => None,
+        })
+        .collect();
+    out.sort_unstable();
+    out.dedup();
+    out
+}
+
+/// Whether a chain of calls leads from `from` to `to`
+fn reaches(calls: &[Vec<usize>], from: usize, to: usize) -> bool {
+    let mut seen = vec![false; calls.len()];
+    let mut stack = calls[from].clone();
+    while let Some(f) = stack.pop() {
+        if f == to {
+            return true;
+        }
+        if !std::mem::replace(&mut seen[f], true) {
+            stack.extend(&calls[f]);
+        }
+    }
+    false
+}
+
+/// Function indices with every callee before its callers (outside cycles)
+fn post_order(calls: &[Vec<usize>]) -> Vec<usize> {
+    fn visit(f: usize, calls: &[Vec<usize>], seen: &mut [bool], out: &mut Vec<usize>) {
+        if std::mem::replace(&mut seen[f], true) {
+            return;
+        }
+        for &callee in &calls[f] {
+            visit(callee, calls, seen, out);
+        }
+        out.push(f);
+    }
+    let mut seen = vec![false; calls.len()];
+    let mut out = Vec::new();
+    for f in 0..calls.len() {
+        visit(f, calls, &mut seen, &mut out);
+    }
+    out
+}
+
+/// Replace the call at `func.blocks[b].insts[i]` with a copy of `callee`.
+/// `n` numbers the copies made in `func`, keeping their labels apart.
+fn inline_call(func: &mut IrFunction, b: usize, i: usize, callee: &IrFunction, n: usize) {
+    // Labels are global to the module, so copies name their caller
+    let suffix = format!("_{}_{n}", func.name);
+    let offset = next_temp(func).0;
+    let rename = |t: Temp| Temp(t.0 + offset);
+    let relabel = |l: &Label| Label(format!("{}{suffix}", l.0).into());
+
+    let tail = func.blocks[b].insts.split_off(i + 1);
+    let call = func.blocks[b].insts.pop().unwrap();
+    let Inst::Call { dst, args, .. } = call.inst else {
+        unreachable!("inlining a non-call");
+    };
+    let end = Label(format!(".L{}_ret{suffix}", callee.name).into());
+
+    let mut blocks = Vec::new();
+    for block in &callee.blocks {
+        let mut copy = BasicBlock::new(relabel(&block.label));
+        for sinst in &block.insts {
+            let mut inst = sinst.inst.clone();
+            for value in inst.operands_mut() {
+                value.substitute(&|t| Some(Value::Temp(rename(t))));
+            }
+            if let Some(d) = inst.def_mut() {
+                *d = rename(*d);
+            }
+            for target in inst.branch_targets_mut() {
+                *target = relabel(target);
+            }
+            let mut push = |inst| copy.insts.push(SpannedInst::new(inst, sinst.span));
+            match inst {
+                // A parameter's slot holds its argument, truncated to the
+                // parameter's size like the caller's push would be
+                Inst::LoadParam {
+                    dst: slot,
+                    index,
+                    size,
+                } => {
+                    push(Inst::Alloca {
+                        dst: slot,
+                        size,
+                        align: size,
+                    });
+                    push(Inst::Store {
+                        addr: Value::Temp(slot),
+                        src: args[index].clone(),
+                        size,
+                        volatile: false,
+                    });
+                }
+                Inst::Return(value) => {
+                    if let (Some(dst), Some(src)) = (dst, value) {
+                        push(Inst::Copy { dst, src, width: 4 });
+                    }
+                    push(Inst::Jump(end));
+                }
+                inst => push(inst),
+            }
+        }
+        blocks.push(copy);
+    }
+    let mut rest = BasicBlock::new(end);
+    rest.insts = tail;
+    blocks.push(rest);
+    func.blocks.splice(b + 1..b + 1, blocks);
+}
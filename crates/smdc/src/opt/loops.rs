@@ -0,0 +1,651 @@
+//! Loop optimizations
+//!
+//! Frontends lay a loop out as a contiguous run of blocks: a header entered
+//! by falling through from the block before it (the preheader), and a latch
+//! at the end that jumps back to the header. `find_loops` recognizes these
+//! when nothing outside the run branches into it.
+//!
+//! - `HoistInvariants` moves pure computations whose operands don't change
+//!   inside the loop, such as global addresses and field offsets from them,
+//!   into the preheader.
+//! - `CountedLoops` works out the trip count of a loop whose exit test
+//!   compares a counter stepped by a constant against a constant, and turns
+//!   the test into a `DecJump` on a fresh counter at the latch, which the
+//!   backend emits as `dbf`.
+
+use super::const_fold::{eval_binary, truth};
+use super::{Pass, def_counts, next_temp};
+use crate::ir::{BinOp, Inst, IrFunction, Label, SpannedInst, Temp, Value};
+use std::collections::{HashMap, HashSet};
+
+/// Most iterations a `dbf` counter can count
+const MAX_TRIPS: u32 = 0x1_0000;
+
+/// A loop laid out as blocks `header..=latch`
+#[derive(Debug, Clone, Copy)]
+struct Loop {
+    header: usize,
+    latch: usize,
+}
+
+impl Loop {
+    fn blocks(self) -> std::ops::RangeInclusive<usize> {
+        self.header..=self.latch
+    }
+
+    fn preheader(self) -> usize {
+        self.header - 1
+    }
+}
+
+/// Loops of `func`, inner loops before the loops containing them
+fn find_loops(func: &IrFunction) -> Vec<Loop> {
+    let index: HashMap<&Label, usize> = func
+        .blocks
+        .iter()
+        .enumerate()
+        .map(|(i, b)| (&b.label, i))
+        .collect();
+    // Blocks each block branches to
+    let targets: Vec<Vec<usize>> = func
+        .blocks
+        .iter()
+        .map(|b| {
+            b.insts
+                .iter()
+                .flat_map(|s| s.inst.branch_targets())
+                .filter_map(|l| index.get(l).copied())
+                .collect()
+        })
+        .collect();
+
+    let mut loops = Vec::new();
+    for (latch, block) in func.blocks.iter().enumerate() {
+        let Some(Inst::Jump(label)) = block.insts.last().map(|s| &s.inst) else {
+            continue;
+        };
+        let Some(&header) = index.get(label) else {
+            continue;
+        };
+        let lp = Loop { header, latch };
+        let entered_from_outside = targets.iter().enumerate().any(|(from, to)| {
+            !lp.blocks().contains(&from) && to.iter().any(|t| lp.blocks().contains(t))
+        });
+        if header == 0
+            || header > latch
+            || entered_from_outside
+            || func.blocks[lp.preheader()]
+                .insts
+                .last()
+                .is_some_and(|s| s.inst.is_terminator())
+            || lp.blocks().any(|b| {
+                func.blocks[b]
+                    .insts
+                    .iter()
+                    .any(|s| matches!(s.inst, Inst::Label(_)))
+            })
+        {
+            continue;
+        }
+        loops.push(lp);
+    }
+    loops.sort_by_key(|lp| lp.latch - lp.header);
+    loops
+}
+
+/// Whether `temp` may be read, before being redefined, on some path
+/// starting at block `start`
+fn live_at(func: &IrFunction, start: usize, temp: Temp) -> bool {
+    let index: HashMap<&Label, usize> = func
+        .blocks
+        .iter()
+        .enumerate()
+        .map(|(i, b)| (&b.label, i))
+        .collect();
+    let mut seen = vec![false; func.blocks.len()];
+    let mut worklist = vec![start];
+    while let Some(b) = worklist.pop() {
+        if b >= seen.len() || seen[b] {
+            continue;
+        }
+        seen[b] = true;
+        let mut falls_through = true;
+        for sinst in &func.blocks[b].insts {
+            let inst = &sinst.inst;
+            if inst.uses().contains(&temp) {
+                return true;
+            }
+            worklist.extend(
+                inst.branch_targets()
+                    .into_iter()
+                    .filter_map(|l| index.get(l)),
+            );
+            if inst.def() == Some(temp) || inst.is_terminator() {
+                falls_through = false;
+                break;
+            }
+        }
+        if falls_through {
+            worklist.push(b + 1);
+        }
+    }
+    false
+}
+
+/// Pure operations that can't fault, whatever their operands
+fn is_pure(inst: &Inst) -> bool {
+    match inst {
+        Inst::AddrOf { .. } => true,
+        Inst::Unary { src, .. } => !src.reads_memory(),
+        Inst::Binary {
+            op, left, right, ..
+        } => {
+            !matches!(op, BinOp::Div | BinOp::Mod | BinOp::UDiv | BinOp::UMod)
+                && !left.reads_memory()
+                && !right.reads_memory()
+        }
+        _ => false,
+    }
+}
+
+pub struct HoistInvariants;
+
+impl Pass for HoistInvariants {
+    fn name(&self) -> &'static str {
+        "hoist-invariants"
+    }
+
+    fn run(&self, func: &mut IrFunction) -> bool {
+        let defs = def_counts(func);
+        let mut changed = false;
+        for lp in find_loops(func) {
+            let mut varying: HashSet<Temp> = lp
+                .blocks()
+                .flat_map(|b| &func.blocks[b].insts)
+                .filter_map(|s| s.inst.def())
+                .collect();
+            let invariant = |inst: &Inst, varying: &HashSet<Temp>| {
+                is_pure(inst)
+                    && inst.def().is_some_and(|d| defs.get(&d) == Some(&1))
+                    && inst.uses().iter().all(|t| !varying.contains(t))
+                    && !matches!(
+                        inst,
+                        Inst::Binary {
+                            left: Value::IntConst(_),
+                            right: Value::IntConst(_),
+                            ..
+                        }
+                    )
+            };
+
+            let mut hoisted: Vec<SpannedInst> = Vec::new();
+            for b in lp.blocks() {
+                let mut i = 0;
+                while i < func.blocks[b].insts.len() {
+                    if invariant(&func.blocks[b].insts[i].inst, &varying) {
+                        let sinst = func.blocks[b].insts.remove(i);
+                        varying.remove(&sinst.inst.def().unwrap());
+                        hoisted.push(sinst);
+                    } else {
+                        i += 1;
+                    }
+                }
+            }
+            changed |= !hoisted.is_empty();
+            func.blocks[lp.preheader()].insts.extend(hoisted);
+        }
+        changed
+    }
+}
+
+/// How a loop steps its counter: `var = var op step`, once per iteration
+struct Induction {
+    var: Temp,
+    op: BinOp,
+    step: i64,
+    /// The temp the step is computed into before it is copied to `var`
+    next: Option<Temp>,
+    /// Block and position of the instruction assigning `var`
+    block: usize,
+    at: usize,
+}
+
+impl Induction {
+    fn advance(&self, value: i64) -> Option<i64> {
+        eval_binary(self.op, value, self.step)
+    }
+}
+
+/// The single definition of `var` inside `lp`, if it adds or subtracts a
+/// constant and runs exactly once per iteration (in the header or latch)
+fn induction(func: &IrFunction, lp: Loop, var: Temp) -> Option<Induction> {
+    let defs = def_counts(func);
+    let mut found = None;
+    for b in lp.blocks() {
+        for (at, sinst) in func.blocks[b].insts.iter().enumerate() {
+            if sinst.inst.def() == Some(var) {
+                if found.is_some() {
+                    return None;
+                }
+                found = Some((b, at));
+            }
+        }
+    }
+    let (block, at) = found?;
+    if block != lp.header && block != lp.latch {
+        return None;
+    }
+    let insts = &func.blocks[block].insts;
+    let step = |inst: &Inst| match inst {
+        Inst::Binary {
+            op: op @ (BinOp::Add | BinOp::Sub),
+            left: Value::Temp(t),
+            right: Value::IntConst(step),
+            ..
+        } if *t == var => Some((*op, *step)),
+        _ => None,
+    };
+    if let Some((op, step)) = step(&insts[at].inst) {
+        return Some(Induction {
+            var,
+            op,
+            step,
+            next: None,
+            block,
+            at,
+        });
+    }
+    let Inst::Copy {
+        src: Value::Temp(next),
+        ..
+    } = &insts[at].inst
+    else {
+        return None;
+    };
+    if defs.get(next) != Some(&1) {
+        return None;
+    }
+    let (op, step) = insts[..at]
+        .iter()
+        .find(|s| s.inst.def() == Some(*next))
+        .and_then(|s| step(&s.inst))?;
+    Some(Induction {
+        var,
+        op,
+        step,
+        next: Some(*next),
+        block,
+        at,
+    })
+}
+
+/// The exit test of a loop header: `lhs op rhs`, one side being the loop
+/// counter read at header position `at`
+struct ExitTest {
+    op: BinOp,
+    counter: Temp,
+    bound: i64,
+    counter_on_left: bool,
+    at: usize,
+}
+
+impl ExitTest {
+    fn stays(&self, counter: i64) -> Option<bool> {
+        let (l, r) = if self.counter_on_left {
+            (counter, self.bound)
+        } else {
+            (self.bound, counter)
+        };
+        eval_binary(self.op, l, r).map(truth)
+    }
+}
+
+/// Decode the condition a header exit branch tests, following copies made
+/// in the header back to the temp they read
+fn exit_test(header: &[SpannedInst], cond: Temp) -> ExitTest {
+    let def_in_header = |t: Temp, before: usize| {
+        header[..before]
+            .iter()
+            .rposition(|s| s.inst.def() == Some(t))
+    };
+    let end = header.len() - 1;
+    let mut test = match def_in_header(cond, end).map(|i| (i, &header[i].inst)) {
+        Some((
+            at,
+            Inst::Binary {
+                op,
+                left: Value::Temp(t),
+                right: Value::IntConst(n),
+                ..
+            },
+        )) => ExitTest {
+            op: *op,
+            counter: *t,
+            bound: *n,
+            counter_on_left: true,
+            at,
+        },
+        Some((
+            at,
+            Inst::Binary {
+                op,
+                left: Value::IntConst(n),
+                right: Value::Temp(t),
+                ..
+            },
+        )) => ExitTest {
+            op: *op,
+            counter: *t,
+            bound: *n,
+            counter_on_left: false,
+            at,
+        },
+        _ => ExitTest {
+            op: BinOp::Ne,
+            counter: cond,
+            bound: 0,
+            counter_on_left: true,
+            at: end,
+        },
+    };
+    while let Some(at) = def_in_header(test.counter, test.at) {
+        let Inst::Copy {
+            src: Value::Temp(src),
+            ..
+        } = &header[at].inst
+        else {
+            break;
+        };
+        test.counter = *src;
+        test.at = at;
+    }
+    test
+}
+
+pub struct CountedLoops;
+
+impl Pass for CountedLoops {
+    fn name(&self) -> &'static str {
+        "counted-loops"
+    }
+
+    fn run(&self, func: &mut IrFunction) -> bool {
+        let mut changed = false;
+        // Rewriting one loop leaves the others' block indices alone
+        for lp in find_loops(func) {
+            changed |= lower_counted(func, lp);
+        }
+        changed
+    }
+}
+
+/// Replace the exit test of `lp` with a `DecJump` at the latch if its trip
+/// count is a constant `dbf` can count
+fn lower_counted(func: &mut IrFunction, lp: Loop) -> bool {
+    let Some(exit) = func.blocks.get(lp.latch + 1).map(|b| b.label) else {
+        return false;
+    };
+    let header = &func.blocks[lp.header];
+    // The loop body may continue in the header block after the test
+    let Some(branch) = header
+        .insts
+        .iter()
+        .position(|s| !s.inst.branch_targets().is_empty())
+    else {
+        return false;
+    };
+    let Inst::CondJumpFalse {
+        cond: Value::Temp(cond),
+        target,
+    } = &header.insts[branch].inst
+    else {
+        return false;
+    };
+    if *target != exit {
+        return false;
+    }
+    // The back edge must be the only other way into the header
+    let entries = func
+        .blocks
+        .iter()
+        .flat_map(|b| &b.insts)
+        .flat_map(|s| s.inst.branch_targets())
+        .filter(|&l| *l == header.label)
+        .count();
+    if entries != 1 {
+        return false;
+    }
+    // The code before the test now runs once less, so it may only compute
+    // values that nothing reads once the loop has exited
+    let before_test = &header.insts[..branch];
+    let pure_header = before_test.iter().all(|s| match &s.inst {
+        Inst::Copy { src, .. } => !src.reads_memory(),
+        inst => is_pure(inst),
+    });
+    if !pure_header
+        || before_test
+            .iter()
+            .filter_map(|s| s.inst.def())
+            .any(|d| live_at(func, lp.latch + 1, d))
+    {
+        return false;
+    }
+
+    let mut test = exit_test(&header.insts[..=branch], *cond);
+    // The test may read the stepped value before it is copied to the variable
+    let read = test.counter;
+    let stepped_at = before_test.iter().position(|s| s.inst.def() == Some(read));
+    if let Some(at) = stepped_at
+        && let Inst::Binary {
+            left: Value::Temp(var),
+            ..
+        } = &before_test[at].inst
+    {
+        test.counter = *var;
+    }
+    let Some(iv) = induction(func, lp, test.counter) else {
+        return false;
+    };
+    let stepped = if iv.next.is_some() && iv.next == Some(read) {
+        if iv.block != lp.header || stepped_at > Some(test.at) {
+            return false;
+        }
+        true
+    } else if test.counter == read {
+        iv.block == lp.header && iv.at < test.at
+    } else {
+        return false;
+    };
+
+    // The counter's value on entry, set just before the loop
+    let Some(Inst::Copy {
+        src: Value::IntConst(init),
+        ..
+    }) = func.blocks[lp.preheader()]
+        .insts
+        .iter()
+        .rev()
+        .find(|s| s.inst.def() == Some(iv.var))
+        .map(|s| &s.inst)
+    else {
+        return false;
+    };
+
+    let mut value = *init;
+    let mut trips = 0;
+    loop {
+        let tested = if stepped {
+            iv.advance(value)
+        } else {
+            Some(value)
+        };
+        match tested.and_then(|v| test.stays(v)) {
+            Some(true) => {}
+            Some(false) => break,
+            None => return false,
+        }
+        trips += 1;
+        if trips > MAX_TRIPS {
+            return false;
+        }
+        let Some(next) = iv.advance(value) else {
+            return false;
+        };
+        value = next;
+    }
+    if trips == 0 {
+        return false;
+    }
+
+    let counter = next_temp(func);
+    let preheader = &mut func.blocks[lp.preheader()].insts;
+    let span = preheader.last().and_then(|s| s.span);
+    preheader.push(SpannedInst::new(
+        Inst::Copy {
+            dst: counter,
+            src: Value::IntConst(i64::from(trips - 1)),
+            width: 4,
+        },
+        span,
+    ));
+    func.blocks[lp.header].insts.remove(branch);
+    let header = func.blocks[lp.header].label;
+    let latch = func.blocks[lp.latch].insts.last_mut().unwrap();
+    latch.inst = Inst::DecJump {
+        counter,
+        target: header,
+    };
+    true
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::opt::test_util::{body, function};
+
+    fn t(n: u32) -> Temp {
+        Temp(n)
+    }
+
+    fn binary(dst: u32, op: BinOp, left: Value, right: Value) -> Inst {
+        Inst::Binary {
+            dst: t(dst),
+            op,
+            left,
+            right,
+            width: 4,
+        }
+    }
+
+    fn copy(dst: u32, src: Value) -> Inst {
+        Inst::Copy {
+            dst: t(dst),
+            src,
+            width: 4,
+        }
+    }
+
+    /// for (i = 0; i < trips; i++) buf[i] = i;
+    fn for_loop(trips: i64) -> IrFunction {
+        function(vec![
+            ("entry", vec![copy(0, Value::IntConst(0))]),
+            (
+                "for",
+                vec![
+                    binary(1, BinOp::Lt, Value::Temp(t(0)), Value::IntConst(trips)),
+                    Inst::CondJumpFalse {
+                        cond: Value::Temp(t(1)),
+                        target: Label("end".into()),
+                    },
+                    Inst::AddrOf {
+                        dst: t(2),
+                        name: "buf".into(),
+                    },
+                    binary(3, BinOp::Shl, Value::Temp(t(0)), Value::IntConst(2)),
+                    binary(4, BinOp::Add, Value::Temp(t(2)), Value::Temp(t(3))),
+                    Inst::Store {
+                        addr: Value::Temp(t(4)),
+                        src: Value::Temp(t(0)),
+                        size: 4,
+                        volatile: false,
+                    },
+                ],
+            ),
+            (
+                "update",
+                vec![
+                    binary(5, BinOp::Add, Value::Temp(t(0)), Value::IntConst(1)),
+                    copy(0, Value::Temp(t(5))),
+                    Inst::Jump(Label("for".into())),
+                ],
+            ),
+            ("end", vec![Inst::Return(None)]),
+        ])
+    }
+
+    #[test]
+    fn test_hoists_global_address() {
+        let mut func = for_loop(40);
+        assert!(HoistInvariants.run(&mut func));
+        assert!(body(&func).starts_with("entry:\nt0 = 0\nt2 = &buf\nfor:\n"));
+        assert!(!HoistInvariants.run(&mut func));
+    }
+
+    #[test]
+    fn test_fixed_trip_count_becomes_dec_jump() {
+        let mut func = for_loop(40);
+        assert!(CountedLoops.run(&mut func));
+        let text = body(&func);
+        assert!(text.starts_with("entry:\nt0 = 0\nt6 = 39\nfor:\nt1 = t0 < 40\nt2 = &buf"));
+        assert!(text.ends_with("t0 = t5\ndec t6 goto for\nend:\nreturn"));
+        // Already lowered
+        assert!(!CountedLoops.run(&mut func));
+    }
+
+    #[test]
+    fn test_trip_counts_dbf_cannot_hold_are_kept() {
+        for trips in [0, 0x1_0001] {
+            let mut func = for_loop(trips);
+            assert!(!CountedLoops.run(&mut func));
+        }
+        let mut func = for_loop(0x1_0000);
+        assert!(CountedLoops.run(&mut func));
+        assert!(body(&func).contains("= 65535\n"));
+    }
+
+    #[test]
+    fn test_post_decrement_while_loop() {
+        // n = 10; while (n--) g();
+        let while_loop = |tail: Vec<Inst>| {
+            function(vec![
+                ("entry", vec![copy(0, Value::IntConst(10))]),
+                (
+                    "while",
+                    vec![
+                        copy(1, Value::Temp(t(0))),
+                        binary(2, BinOp::Sub, Value::Temp(t(0)), Value::IntConst(1)),
+                        copy(0, Value::Temp(t(2))),
+                        Inst::CondJumpFalse {
+                            cond: Value::Temp(t(1)),
+                            target: Label("end".into()),
+                        },
+                        Inst::Call {
+                            dst: None,
+                            func: "g".into(),
+                            args: Vec::new(),
+                        },
+                        Inst::Jump(Label("while".into())),
+                    ],
+                ),
+                ("end", tail),
+            ])
+        };
+        let mut func = while_loop(vec![Inst::Return(None)]);
+        assert!(CountedLoops.run(&mut func));
+        assert!(body(&func).contains("t3 = 9\n"));
+
+        // n is -1 after the loop, which the lowered header would not match
+        let mut func = while_loop(vec![Inst::Return(Some(Value::Temp(t(0))))]);
+        assert!(!CountedLoops.run(&mut func));
+    }
+}
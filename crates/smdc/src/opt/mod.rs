@@ -0,0 +1,322 @@
+//! IR optimization passes
+//!
+//! Each pass rewrites one `IrFunction` in place and reports whether it changed
+//! anything. `PassManager::for_level` builds the pipeline behind `-O`:
+//!
+//! - `-O0`: no passes
+//! - `-O1`: copy propagation, constant folding, unreachable code removal,
+//!   dead-temp elimination and operation width narrowing, run once
+//! - `-O2`/`-O3`: stack slot promotion first, then the `-O1` passes,
+//!   loop-invariant hoisting and counted loop lowering before the
+//!   narrowing, repeated until nothing changes
+//!
+//! After that, every level inlines small functions into their callers
+//! (`Inliner`, with a size limit growing with the level) and runs the
+//! pipeline again on the callers that changed.
+//!
+//! `remove_dead_symbols` then drops the functions, globals and strings no
+//! entry point reaches; the driver runs it at `-O1` and above.
+//!
+//! Passes only rely on the IR itself, so both the C `IrBuilder` and the Rust
+//! MIR lowering benefit from them.
+
+mod const_fold;
+mod copy_prop;
+mod dead_symbols;
+mod dead_temps;
+mod inline;
+mod loops;
+mod promote;
+mod unreachable;
+mod widths;
+
+pub use const_fold::ConstFold;
+pub use copy_prop::CopyProp;
+pub use dead_symbols::{RemovedSymbols, remove_dead_symbols};
+pub use dead_temps::DeadTemps;
+pub use inline::Inliner;
+pub use loops::{CountedLoops, HoistInvariants};
+pub use promote::PromoteSlots;
+pub use unreachable::RemoveUnreachable;
+pub use widths::NarrowWidths;
+
+use crate::common::stats;
+use crate::ir::{Inst, IrFunction, IrModule, Temp};
+use std::collections::HashMap;
+
+/// Upper bound on pipeline rounds when iterating to a fixed point
+const MAX_ROUNDS: usize = 8;
+
+/// A transformation over a single IR function
+pub trait Pass {
+    /// Short name for diagnostics
+    fn name(&self) -> &'static str;
+
+    /// Rewrite `func` in place, returning true if anything changed
+    fn run(&self, func: &mut IrFunction) -> bool;
+}
+
+/// Ordered list of passes applied to every function of a module
+pub struct PassManager {
+    passes: Vec<Box<dyn Pass>>,
+    /// Repeat the pipeline until no pass reports a change
+    iterate: bool,
+    /// Inline small functions once every function has been optimized, then
+    /// optimize the callers again
+    inliner: Option<Inliner>,
+}
+
+impl PassManager {
+    pub fn new() -> Self {
+        Self {
+            passes: Vec::new(),
+            iterate: false,
+            inliner: None,
+        }
+    }
+
+    /// The standard pipeline for `-O<level>`
+    pub fn for_level(level: u8) -> Self {
+        let mut pm = Self::new();
+        if level == 0 {
+            return pm;
+        }
+        if level >= 2 {
+            pm.add(Box::new(PromoteSlots));
+            pm.iterate = true;
+        }
+        pm.add(Box::new(CopyProp));
+        pm.add(Box::new(ConstFold));
+        pm.add(Box::new(RemoveUnreachable));
+        pm.add(Box::new(DeadTemps));
+        if level >= 2 {
+            pm.add(Box::new(HoistInvariants));
+            pm.add(Box::new(CountedLoops));
+        }
+        // Last, as it has to see every reader of a temp
+        pm.add(Box::new(NarrowWidths));
+        pm.inliner = Some(Inliner::for_level(level));
+        pm
+    }
+
+    pub fn add(&mut self, pass: Box<dyn Pass>) {
+        self.passes.push(pass);
+    }
+
+    pub fn is_empty(&self) -> bool {
+        self.passes.is_empty()
+    }
+
+    /// Names of the scheduled passes, in order
+    pub fn pass_names(&self) -> Vec<&'static str> {
+        self.passes
+            .iter()
+            .map(|p| p.name())
+            .chain(self.inliner.as_ref().map(Inliner::name))
+            .collect()
+    }
+
+    /// Optimize every function in `module`, returning true if anything changed
+    pub fn run(&self, module: &mut IrModule) -> bool {
+        stats::time("opt", || {
+            let mut changed = false;
+            for func in &mut module.functions {
+                changed |= self.run_function(func);
+            }
+            if let Some(inliner) = &self.inliner {
+                changed |= stats::time(inliner.name(), || {
+                    inliner.run(module, &mut |func| {
+                        self.run_function(func);
+                    })
+                });
+            }
+            changed
+        })
+    }
+
+    pub fn run_function(&self, func: &mut IrFunction) -> bool {
+        let mut changed = false;
+        for _ in 0..MAX_ROUNDS {
+            let mut round = false;
+            for pass in &self.passes {
+                round |= stats::time(pass.name(), || pass.run(func));
+            }
+            changed |= round;
+            if !round || !self.iterate {
+                break;
+            }
+        }
+        changed
+    }
+}
+
+impl Default for PassManager {
+    fn default() -> Self {
+        Self::new()
+    }
+}
+
+/// All instructions of `func` in layout order
+fn insts(func: &IrFunction) -> impl Iterator<Item = &Inst> {
+    func.blocks
+        .iter()
+        .flat_map(|b| b.insts.iter().map(|s| &s.inst))
+}
+
+/// Number of instructions defining each temp
+fn def_counts(func: &IrFunction) -> HashMap<Temp, usize> {
+    let mut counts = HashMap::new();
+    for inst in insts(func) {
+        if let Some(t) = inst.def() {
+            *counts.entry(t).or_insert(0) += 1;
+        }
+    }
+    counts
+}
+
+/// A temp number no instruction of `func` uses yet
+fn next_temp(func: &IrFunction) -> Temp {
+    insts(func)
+        .flat_map(|inst| inst.def().into_iter().chain(inst.uses()))
+        .map(|t| t.0 + 1)
+        .max()
+        .map_or(Temp(0), Temp)
+}
+
+#[cfg(test)]
+pub(crate) mod test_util {
+    use crate::ir::{BasicBlock, Inst, IrFunction, Label, SpannedInst};
+    use crate::types::IrType;
+
+    /// Build a function from `(label, instructions)` blocks
+    pub fn function(blocks: Vec<(&str, Vec<Inst>)>) -> IrFunction {
+        let mut func = IrFunction::new("f".to_string(), Vec::new(), IrType::i32());
+        for (label, insts) in blocks {
+            let mut block = BasicBlock::new(Label(label.into()));
+            block.insts = insts.into_iter().map(SpannedInst::bare).collect();
+            func.blocks.push(block);
+        }
+        func
+    }
+
+    /// The function body as text, one instruction per line
+    pub fn body(func: &IrFunction) -> String {
+        format!("{func}")
+            .lines()
+            .skip(1)
+            .map(str::trim)
+            .collect::<Vec<_>>()
+            .join("\n")
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::test_util::{body, function};
+    use super::*;
+    use crate::ir::{BinOp, Label, Value};
+    use pretty_assertions::assert_eq;
+
+    #[test]
+    fn test_level_zero_is_empty() {
+        assert!(PassManager::for_level(0).is_empty());
+        assert_eq!(
+            PassManager::for_level(1).pass_names(),
+            vec![
+                "copy-prop",
+                "const-fold",
+                "remove-unreachable",
+                "dead-temps",
+                "narrow-widths",
+                "inline"
+            ]
+        );
+        assert_eq!(PassManager::for_level(3).pass_names()[0], "promote-slots");
+    }
+
+    #[test]
+    fn test_pipeline_folds_promoted_local() {
+        // int x = 6; if (x * 7 == 42) return x; return 0;
+        let mut func = function(vec![
+            (
+                "entry",
+                vec![
+                    Inst::Alloca {
+                        dst: Temp(0),
+                        size: 4,
+                        align: 2,
+                    },
+                    Inst::Store {
+                        addr: Value::Temp(Temp(0)),
+                        src: Value::IntConst(6),
+                        size: 4,
+                        volatile: false,
+                    },
+                    Inst::Load {
+                        dst: Temp(1),
+                        addr: Value::Temp(Temp(0)),
+                        size: 4,
+                        volatile: false,
+                        signed: true,
+                        width: 4,
+                    },
+                    Inst::Binary {
+                        dst: Temp(2),
+                        op: BinOp::Mul,
+                        left: Value::Temp(Temp(1)),
+                        right: Value::IntConst(7),
+                        width: 4,
+                    },
+                    Inst::Binary {
+                        dst: Temp(3),
+                        op: BinOp::Eq,
+                        left: Value::Temp(Temp(2)),
+                        right: Value::IntConst(42),
+                        width: 4,
+                    },
+                    Inst::CondJumpFalse {
+                        cond: Value::Temp(Temp(3)),
+                        target: Label("else".into()),
+                    },
+                    Inst::Return(Some(Value::Temp(Temp(1)))),
+                ],
+            ),
+            ("else", vec![Inst::Return(Some(Value::IntConst(0)))]),
+        ]);
+
+        assert!(PassManager::for_level(2).run_function(&mut func));
+        assert_eq!(body(&func), "entry:\nreturn 6");
+    }
+
+    #[test]
+    fn test_level_one_keeps_memory_locals() {
+        let mut func = function(vec![(
+            "entry",
+            vec![
+                Inst::Alloca {
+                    dst: Temp(0),
+                    size: 4,
+                    align: 2,
+                },
+                Inst::Store {
+                    addr: Value::Temp(Temp(0)),
+                    src: Value::IntConst(1),
+                    size: 4,
+                    volatile: false,
+                },
+                Inst::Load {
+                    dst: Temp(1),
+                    addr: Value::Temp(Temp(0)),
+                    size: 4,
+                    volatile: false,
+                    signed: true,
+                    width: 4,
+                },
+                Inst::Return(Some(Value::Temp(Temp(1)))),
+            ],
+        )]);
+
+        PassManager::for_level(1).run_function(&mut func);
+        assert!(body(&func).contains("store.4 t0, 1"));
+    }
+}
@@ -0,0 +1,244 @@
+//! Stack slot promotion
+//!
+//! Frontends keep locals in `Alloca` slots and access them with `Load` and
+//! `Store`, so on their own the temp-level passes find little to do. A
+//! 4-byte slot whose address is used only for whole-word accesses can't be
+//! reached any other way. Each store becomes a copy into a fresh temp and
+//! each load a copy out of it, so the allocator can keep the local in a
+//! register.
+//!
+//! Parameter slots are promoted the same way after a single load at entry,
+//! when the function reassigns the parameter or reads it more than once.
+
+use super::{Pass, def_counts, insts};
+use crate::ir::{Inst, IrFunction, SpannedInst, Temp, Value};
+use std::collections::HashMap;
+
+pub struct PromoteSlots;
+
+impl Pass for PromoteSlots {
+    fn name(&self) -> &'static str {
+        "promote-slots"
+    }
+
+    fn run(&self, func: &mut IrFunction) -> bool {
+        let slots = promotable_slots(func);
+        if slots.is_empty() {
+            return false;
+        }
+
+        let mut next = insts(func)
+            .flat_map(|inst| inst.def().into_iter().chain(inst.uses()))
+            .map(|t| t.0 + 1)
+            .max()
+            .unwrap_or(0);
+        let mut vars: HashMap<Temp, Temp> = HashMap::new();
+        for slot in slots {
+            vars.insert(slot, Temp(next));
+            next += 1;
+        }
+
+        for block in &mut func.blocks {
+            let old = std::mem::take(&mut block.insts);
+            for SpannedInst { inst, span } in old {
+                let push = |insts: &mut Vec<SpannedInst>, inst| {
+                    insts.push(SpannedInst::new(inst, span));
+                };
+                match inst {
+                    Inst::Load {
+                        dst,
+                        addr: Value::Temp(slot),
+                        ..
+                    } if vars.contains_key(&slot) => push(
+                        &mut block.insts,
+                        Inst::Copy {
+                            dst,
+                            src: Value::Temp(vars[&slot]),
+                            width: 4,
+                        },
+                    ),
+                    Inst::Store {
+                        addr: Value::Temp(slot),
+                        src,
+                        ..
+                    } if vars.contains_key(&slot) => push(
+                        &mut block.insts,
+                        Inst::Copy {
+                            dst: vars[&slot],
+                            src,
+                            width: 4,
+                        },
+                    ),
+                    Inst::Alloca { dst, .. } if vars.contains_key(&dst) => {}
+                    Inst::LoadParam { dst, index, size } if vars.contains_key(&dst) => {
+                        push(&mut block.insts, Inst::LoadParam { dst, index, size });
+                        push(
+                            &mut block.insts,
+                            Inst::Load {
+                                dst: vars[&dst],
+                                addr: Value::Temp(dst),
+                                size,
+                                volatile: false,
+                                signed: true,
+                                width: 4,
+                            },
+                        );
+                    }
+                    inst => push(&mut block.insts, inst),
+                }
+            }
+        }
+        true
+    }
+}
+
+/// Slots only ever accessed as a whole word through their own address temp
+fn promotable_slots(func: &IrFunction) -> Vec<Temp> {
+    let defs = def_counts(func);
+    let mut candidates: HashMap<Temp, bool> = HashMap::new();
+    for inst in insts(func) {
+        match inst {
+            Inst::Alloca { dst, size: 4, .. } if defs[dst] == 1 => {
+                candidates.insert(*dst, false);
+            }
+            Inst::LoadParam { dst, size: 4, .. } if defs[dst] == 1 => {
+                candidates.insert(*dst, true);
+            }
+            _ => {}
+        }
+    }
+
+    let mut accesses: HashMap<Temp, (usize, usize)> = HashMap::new();
+    for inst in insts(func) {
+        match inst {
+            Inst::Load {
+                addr: Value::Temp(slot),
+                size: 4,
+                volatile: false,
+                ..
+            } => accesses.entry(*slot).or_default().0 += 1,
+            Inst::Store {
+                addr: Value::Temp(slot),
+                src,
+                size: 4,
+                volatile: false,
+            } => {
+                accesses.entry(*slot).or_default().1 += 1;
+                let mut stored = Vec::new();
+                src.collect_temps(&mut stored);
+                for t in stored {
+                    candidates.remove(&t);
+                }
+            }
+            other => {
+                for t in other.uses() {
+                    candidates.remove(&t);
+                }
+            }
+        }
+    }
+
+    // A parameter read once and never written gains nothing, and promoting
+    // it would leave exactly that shape behind again.
+    let mut slots: Vec<Temp> = candidates
+        .into_iter()
+        .filter(|&(slot, is_param)| {
+            let (loads, stores) = accesses.get(&slot).copied().unwrap_or_default();
+            !is_param || stores > 0 || loads > 1
+        })
+        .map(|(slot, _)| slot)
+        .collect();
+    slots.sort_by_key(|t| t.0);
+    slots
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::opt::test_util::{body, function};
+    use pretty_assertions::assert_eq;
+
+    fn store(slot: u32, src: Value) -> Inst {
+        Inst::Store {
+            addr: Value::Temp(Temp(slot)),
+            src,
+            size: 4,
+            volatile: false,
+        }
+    }
+
+    fn load(dst: u32, slot: u32) -> Inst {
+        Inst::Load {
+            dst: Temp(dst),
+            addr: Value::Temp(Temp(slot)),
+            size: 4,
+            volatile: false,
+            signed: true,
+            width: 4,
+        }
+    }
+
+    #[test]
+    fn test_promotes_local_and_param() {
+        let mut func = function(vec![(
+            "entry",
+            vec![
+                Inst::LoadParam {
+                    dst: Temp(0),
+                    index: 0,
+                    size: 4,
+                },
+                Inst::Alloca {
+                    dst: Temp(1),
+                    size: 4,
+                    align: 2,
+                },
+                load(2, 0),
+                store(1, Value::Temp(Temp(2))),
+                store(0, Value::IntConst(0)),
+                load(3, 1),
+                Inst::Return(Some(Value::Temp(Temp(3)))),
+            ],
+        )]);
+        assert!(PromoteSlots.run(&mut func));
+        assert_eq!(
+            body(&func),
+            "entry:\nt0 = loadparam.4 #0\nt4 = load.s4 t0\nt2 = t4\nt5 = t2\nt4 = 0\nt3 = t5\nreturn t3"
+        );
+        assert!(!PromoteSlots.run(&mut func));
+    }
+
+    #[test]
+    fn test_escaping_and_partial_slots_stay() {
+        let mut func = function(vec![(
+            "entry",
+            vec![
+                Inst::Alloca {
+                    dst: Temp(0),
+                    size: 4,
+                    align: 2,
+                },
+                Inst::Alloca {
+                    dst: Temp(1),
+                    size: 4,
+                    align: 2,
+                },
+                // &local passed to a call
+                Inst::Call {
+                    dst: None,
+                    func: "f".into(),
+                    args: vec![Value::Temp(Temp(0))],
+                },
+                // half-word access into the second slot
+                Inst::Store {
+                    addr: Value::Temp(Temp(1)),
+                    src: Value::IntConst(1),
+                    size: 2,
+                    volatile: false,
+                },
+                Inst::Return(None),
+            ],
+        )]);
+        assert!(!PromoteSlots.run(&mut func));
+    }
+}
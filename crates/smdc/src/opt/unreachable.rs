@@ -0,0 +1,127 @@
+//! Unreachable code removal
+//!
+//! Drops instructions after a block's first `jump`/`return`, blocks that no
+//! path from the entry reaches, and branches to the block that follows
+//! anyway. Blocks fall through to the next one in layout order, so the
+//! relative order of the remaining blocks is preserved.
+
+use super::Pass;
+use crate::ir::{IrFunction, Label};
+use std::collections::HashMap;
+
+pub struct RemoveUnreachable;
+
+impl Pass for RemoveUnreachable {
+    fn name(&self) -> &'static str {
+        "remove-unreachable"
+    }
+
+    fn run(&self, func: &mut IrFunction) -> bool {
+        let mut changed = false;
+
+        for block in &mut func.blocks {
+            if let Some(end) = block.insts.iter().position(|s| s.inst.is_terminator())
+                && end + 1 < block.insts.len()
+            {
+                block.insts.truncate(end + 1);
+                changed = true;
+            }
+        }
+
+        let reachable = reachable_blocks(func);
+        if reachable.iter().any(|r| !r) {
+            let mut keep = reachable.into_iter();
+            func.blocks.retain(|_| keep.next().unwrap_or(true));
+            changed = true;
+        }
+
+        for i in 1..func.blocks.len() {
+            let next = func.blocks[i].label;
+            let insts = &mut func.blocks[i - 1].insts;
+            while insts
+                .last()
+                .is_some_and(|s| s.inst.branch_targets() == [&next])
+            {
+                insts.pop();
+                changed = true;
+            }
+        }
+
+        changed
+    }
+}
+
+/// Which blocks can be reached from the entry block
+fn reachable_blocks(func: &IrFunction) -> Vec<bool> {
+    let index: HashMap<&Label, usize> = func
+        .blocks
+        .iter()
+        .enumerate()
+        .map(|(i, b)| (&b.label, i))
+        .collect();
+
+    let mut reachable = vec![false; func.blocks.len()];
+    let mut worklist = vec![0];
+    while let Some(b) = worklist.pop() {
+        if b >= reachable.len() || reachable[b] {
+            continue;
+        }
+        reachable[b] = true;
+        let insts = &func.blocks[b].insts;
+        for sinst in insts {
+            for target in sinst.inst.branch_targets() {
+                if let Some(&t) = index.get(target) {
+                    worklist.push(t);
+                }
+            }
+        }
+        if !insts.last().is_some_and(|s| s.inst.is_terminator()) {
+            worklist.push(b + 1);
+        }
+    }
+    reachable
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::ir::{Inst, Temp, Value};
+    use crate::opt::test_util::{body, function};
+    use pretty_assertions::assert_eq;
+
+    #[test]
+    fn test_removes_dead_blocks_and_tails() {
+        let mut func = function(vec![
+            (
+                "entry",
+                vec![
+                    Inst::CondJump {
+                        cond: Value::Name("g".into()),
+                        target: Label("taken".into()),
+                    },
+                    Inst::Jump(Label("join".into())),
+                    Inst::Return(None),
+                ],
+            ),
+            ("dead", vec![Inst::Return(Some(Value::IntConst(1)))]),
+            ("taken", vec![Inst::Jump(Label("join".into()))]),
+            ("join", vec![Inst::Return(Some(Value::Temp(Temp(0))))]),
+        ]);
+        assert!(RemoveUnreachable.run(&mut func));
+        assert_eq!(
+            body(&func),
+            "entry:\nif g goto taken\njump join\ntaken:\njoin:\nreturn t0"
+        );
+        assert!(!RemoveUnreachable.run(&mut func));
+    }
+
+    #[test]
+    fn test_fallthrough_keeps_next_block() {
+        let mut func = function(vec![
+            ("entry", vec![Inst::Comment("falls through".to_string())]),
+            ("next", vec![Inst::Return(None)]),
+        ]);
+        assert!(!RemoveUnreachable.run(&mut func));
+        assert_eq!(func.blocks.len(), 2);
+    }
+}
@@ -0,0 +1,256 @@
+//! Operation width narrowing
+//!
+//! Frontends compute everything in 32 bits, as C's integer promotions ask.
+//! Most `u8`/`u16` arithmetic only ends up in a byte or word store though,
+//! and the 68000 does `.b`/`.w` operations faster than `.l` ones. This pass
+//! works out how many low bytes of each temp some reader actually looks at,
+//! and records it as the `width` of the instructions defining it. The
+//! emitter then uses the narrow forms and skips the extension of loads
+//! nobody reads past.
+//!
+//! A reader's demand depends only on the operation: a store of `n` bytes
+//! needs `n`, carry-free operations (add, sub, and, or, xor, shl, neg, not)
+//! need what their own result needs, MULS reads low words, and everything
+//! else (comparisons, right shifts, dividends, addresses, conditions, call
+//! arguments, return values) needs all 4. The demands are recomputed from
+//! scratch on every run, so this pass should come last: a temp that a later
+//! pass gives a wider reader is widened again.
+
+use super::{Pass, insts};
+use crate::ir::{BinOp, Inst, IrFunction, Temp, UnOp, Value};
+use std::collections::HashMap;
+
+pub struct NarrowWidths;
+
+impl Pass for NarrowWidths {
+    fn name(&self) -> &'static str {
+        "narrow-widths"
+    }
+
+    fn run(&self, func: &mut IrFunction) -> bool {
+        let demand = demanded_bytes(func);
+        let mut changed = false;
+        for block in &mut func.blocks {
+            for sinst in &mut block.insts {
+                let Some(dst) = sinst.inst.def() else {
+                    continue;
+                };
+                let Some(width) = sinst.inst.width_mut() else {
+                    continue;
+                };
+                let narrow = match demand.get(&dst).copied().unwrap_or(0) {
+                    0 | 1 => 1,
+                    2 => 2,
+                    _ => 4,
+                };
+                changed |= *width != narrow;
+                *width = narrow;
+            }
+        }
+        changed
+    }
+}
+
+/// The most low bytes of each temp that any reader depends on
+fn demanded_bytes(func: &IrFunction) -> HashMap<Temp, usize> {
+    let mut demand: HashMap<Temp, usize> = HashMap::new();
+    loop {
+        let mut changed = false;
+        for inst in insts(func) {
+            let result = inst
+                .def()
+                .map_or(0, |dst| demand.get(&dst).copied().unwrap_or(0));
+            for (t, bytes) in reads(inst, result) {
+                let entry = demand.entry(t).or_insert(0);
+                if *entry < bytes {
+                    *entry = bytes;
+                    changed = true;
+                }
+            }
+        }
+        if !changed {
+            return demand;
+        }
+    }
+}
+
+/// The temps `inst` reads, with how many of their low bytes it depends on
+fn reads(inst: &Inst, result: usize) -> Vec<(Temp, usize)> {
+    if let Inst::DecJump { counter, .. } = inst {
+        // dbf only looks at the low word
+        return vec![(*counter, 2)];
+    }
+    let Some(operands) = operand_demands(inst, result) else {
+        return inst.uses().into_iter().map(|t| (t, 4)).collect();
+    };
+    let mut out = Vec::new();
+    for (value, bytes) in operands {
+        match value {
+            Value::Temp(t) => out.push((*t, bytes)),
+            // Temps inside an address are read whole
+            other => {
+                let mut temps = Vec::new();
+                other.collect_temps(&mut temps);
+                out.extend(temps.into_iter().map(|t| (t, 4)));
+            }
+        }
+    }
+    out
+}
+
+/// Each operand of `inst` with the number of its low bytes that matter,
+/// given that `result` bytes of the instruction's own result do. `None` for
+/// instructions that read all their operands whole.
+fn operand_demands(inst: &Inst, result: usize) -> Option<Vec<(&Value, usize)>> {
+    let demands = match inst {
+        Inst::Copy { src, .. } => vec![(src, result)],
+        Inst::Unary { op, src, .. } => match op {
+            UnOp::Neg | UnOp::BitNot => vec![(src, result)],
+            UnOp::Not => vec![(src, 4)],
+        },
+        Inst::Binary {
+            op, left, right, ..
+        } => {
+            let (l, r) = match op {
+                BinOp::Add | BinOp::Sub | BinOp::And | BinOp::Or | BinOp::Xor => (result, result),
+                // Shift counts are taken modulo 64
+                BinOp::Shl => (result, 1),
+                BinOp::Shr => (4, 1),
+                // MULS reads low words, but a reduced multiplication by a
+                // constant keeps the upper bits of its operand around
+                BinOp::Mul if result <= 2 => (2, 2),
+                // DIVS/DIVU take a 32-bit dividend and a 16-bit divisor
+                BinOp::Div | BinOp::Mod | BinOp::UDiv | BinOp::UMod => (4, 2),
+                _ => (4, 4),
+            };
+            vec![(left, l), (right, r)]
+        }
+        Inst::Store {
+            addr, src, size, ..
+        } => vec![(addr, 4), (src, *size)],
+        _ => return None,
+    };
+    Some(demands)
+}
+
+#[cfg(test)]
+mod tests {
+    use super::super::test_util::{body, function};
+    use super::*;
+    use pretty_assertions::assert_eq;
+
+    fn load(dst: u32, addr: u32, size: usize) -> Inst {
+        Inst::Load {
+            dst: Temp(dst),
+            addr: Value::Temp(Temp(addr)),
+            size,
+            volatile: false,
+            signed: false,
+            width: 4,
+        }
+    }
+
+    fn binary(dst: u32, op: BinOp, left: Value, right: Value) -> Inst {
+        Inst::Binary {
+            dst: Temp(dst),
+            op,
+            left,
+            right,
+            width: 4,
+        }
+    }
+
+    fn store(addr: u32, src: u32, size: usize) -> Inst {
+        Inst::Store {
+            addr: Value::Temp(Temp(addr)),
+            src: Value::Temp(Temp(src)),
+            size,
+            volatile: false,
+        }
+    }
+
+    #[test]
+    fn test_byte_arithmetic_into_byte_store() {
+        let mut func = function(vec![(
+            "entry",
+            vec![
+                load(1, 0, 1),
+                binary(2, BinOp::Add, Value::Temp(Temp(1)), Value::IntConst(3)),
+                binary(3, BinOp::Shl, Value::Temp(Temp(2)), Value::IntConst(1)),
+                store(0, 3, 1),
+            ],
+        )]);
+        assert!(NarrowWidths.run(&mut func));
+        assert_eq!(
+            body(&func),
+            "entry:\nt1.b = load.u1 t0\nt2.b = t1 + 3\nt3.b = t2 << 1\nstore.1 t0, t3"
+        );
+        assert!(!NarrowWidths.run(&mut func));
+    }
+
+    #[test]
+    fn test_wide_readers_keep_full_width() {
+        let mut func = function(vec![(
+            "entry",
+            vec![
+                load(1, 0, 2),
+                // The comparison reads all of t2, so t1 must be extended
+                binary(2, BinOp::Add, Value::Temp(Temp(1)), Value::IntConst(1)),
+                binary(3, BinOp::Lt, Value::Temp(Temp(2)), Value::IntConst(9)),
+                store(0, 2, 2),
+                // A right shift moves upper bytes down
+                binary(4, BinOp::Shr, Value::Temp(Temp(1)), Value::IntConst(4)),
+                store(0, 4, 1),
+                Inst::Return(Some(Value::Temp(Temp(3)))),
+            ],
+        )]);
+        NarrowWidths.run(&mut func);
+        let widths: Vec<_> = func.blocks[0]
+            .insts
+            .iter()
+            .map(|s| s.inst.width())
+            .collect();
+        assert_eq!(
+            widths,
+            vec![Some(4), Some(4), Some(4), None, Some(1), None, None]
+        );
+    }
+
+    #[test]
+    fn test_multiply_reads_low_words() {
+        let mut func = function(vec![(
+            "entry",
+            vec![
+                load(1, 0, 4),
+                binary(2, BinOp::Mul, Value::Temp(Temp(1)), Value::Temp(Temp(1))),
+                store(0, 2, 2),
+                load(3, 0, 4),
+                binary(4, BinOp::Mul, Value::Temp(Temp(3)), Value::IntConst(10)),
+                store(0, 4, 4),
+            ],
+        )]);
+        NarrowWidths.run(&mut func);
+        assert_eq!(
+            body(&func),
+            "entry:\nt1.w = load.u4 t0\nt2.w = t1 * t1\nstore.2 t0, t2\n\
+             t3 = load.u4 t0\nt4 = t3 * 10\nstore.4 t0, t4"
+        );
+    }
+
+    #[test]
+    fn test_widens_again_for_new_reader() {
+        let mut func = function(vec![(
+            "entry",
+            vec![
+                load(1, 0, 1),
+                store(0, 1, 1),
+                Inst::Return(Some(Value::Temp(Temp(1)))),
+            ],
+        )]);
+        NarrowWidths.run(&mut func);
+        assert_eq!(func.blocks[0].insts[0].inst.width(), Some(4));
+        func.blocks[0].insts.pop();
+        assert!(NarrowWidths.run(&mut func));
+        assert_eq!(func.blocks[0].insts[0].inst.width(), Some(1));
+    }
+}
@@ -0,0 +1,148 @@
+//! Cycles per frame and per function for the example programs
+//!
+//! ```text
+//! cargo bench -p smdsim -- [FILTER] [--frames N] [-O N]
+//!                          [--save FILE] [--baseline FILE] [--threshold PCT]
+//! ```
+//!
+//! Every example under `sdk/c/examples` and `crates/smd/examples` is built
+//! and run headless for a number of frames, with Start pressed once early on
+//! for the ones that wait for it. Runs are deterministic, so any change in
+//! the numbers comes from the code. Startup cycles and mean busy cycles per
+//! frame are what `--save` and `--baseline` record and compare; see
+//! `bench_support` for those.
+
+use bench_support::{Format, Options, Results};
+use smdsim::bus::CYCLES_PER_FRAME;
+use smdsim::{Machine, compile};
+use std::error::Error;
+use std::fmt::Write as _;
+use std::path::Path;
+use std::process::ExitCode;
+
+/// Functions listed per example
+const TOP_FUNCTIONS: usize = 10;
+/// Frames Start is held for
+const START_PRESS: std::ops::Range<usize> = 60..63;
+const BTN_START: u8 = 0x80;
+
+/// Options of this benchmark, besides the shared ones
+struct Run {
+    frames: usize,
+    opt: u8,
+}
+
+/// Run one example and print its report; returns its measurements
+fn bench(path: &Path, name: &str, run: &Run) -> Result<Results, Box<dyn Error>> {
+    let image = compile(path, run.opt)?;
+    let mut machine = Machine::new(image.rom, image.symbols)?;
+    let mut busy = Vec::with_capacity(run.frames);
+    let mut writes = smdsim::bus::PortWrites::default();
+    for frame in 0..run.frames {
+        let buttons = if START_PRESS.contains(&frame) {
+            BTN_START
+        } else {
+            0
+        };
+        machine.set_pad(0, buttons);
+        // Frames still running the startup code aren't the program's
+        let started = machine.startup_cycles().is_some();
+        let result = machine.run_frame().map_err(|fault| {
+            format!("frame {frame}: {fault} in {}", machine.describe(fault.pc()))
+        })?;
+        if started {
+            busy.push(f64::from(result.busy()));
+            let w = result.writes;
+            writes.vdp_data += w.vdp_data;
+            writes.vdp_ctrl += w.vdp_ctrl;
+            writes.psg += w.psg;
+            writes.ym += w.ym;
+        }
+    }
+
+    if busy.is_empty() {
+        return Err(format!("main not reached in {} frames", run.frames).into());
+    }
+    let frames = busy.len() as f64;
+    let mean = busy.iter().sum::<f64>() / frames;
+    let min = busy.iter().copied().fold(f64::INFINITY, f64::min);
+    let max = busy.iter().copied().fold(0.0, f64::max);
+    let startup = machine.startup_cycles().unwrap_or(0);
+
+    let mut out = String::new();
+    let _ = writeln!(out, "{name} (-O{})", run.opt);
+    let _ = writeln!(out, "  startup      {startup:>9} cycles");
+    let _ = writeln!(
+        out,
+        "  busy/frame   {mean:>9.0} mean  {min:.0} min  {max:.0} max  ({:.1}% of {CYCLES_PER_FRAME})",
+        mean * 100.0 / f64::from(CYCLES_PER_FRAME)
+    );
+    let _ = writeln!(
+        out,
+        "  ports/frame  vdp {:.1} data  {:.1} ctrl  psg {:.1}  ym {:.1}",
+        writes.vdp_data as f64 / frames,
+        writes.vdp_ctrl as f64 / frames,
+        writes.psg as f64 / frames,
+        writes.ym as f64 / frames
+    );
+    let _ = writeln!(
+        out,
+        "  {:<28} {:>8} {:>12} {:>12} {:>10}",
+        "function", "calls", "self", "total", "self/frame"
+    );
+    let all_frames = run.frames as f64;
+    for (function, stats) in machine.profile.functions().iter().take(TOP_FUNCTIONS) {
+        let _ = writeln!(
+            out,
+            "  {function:<28} {:>8} {:>12} {:>12} {:>10.0}",
+            stats.calls,
+            stats.self_cycles,
+            stats.total_cycles,
+            stats.self_cycles as f64 / all_frames
+        );
+    }
+    println!("{out}");
+
+    let mut results = Results::new();
+    results.insert(format!("{name}\tstartup"), startup as f64);
+    results.insert(format!("{name}\tframe"), mean.round());
+    Ok(results)
+}
+
+fn main() -> ExitCode {
+    let mut run = Run {
+        frames: 300,
+        opt: 2,
+    };
+    let parsed = Options::parse(2.0, |arg, value| {
+        match arg {
+            "--frames" => run.frames = bench_support::number(&value()?)?,
+            "-O" => run.opt = bench_support::number(&value()?)?,
+            _ => return Ok(false),
+        }
+        Ok(true)
+    });
+    let options = match parsed {
+        Ok(options) => options,
+        Err(message) => {
+            eprintln!("error: {message}");
+            return ExitCode::FAILURE;
+        }
+    };
+    let cases: Vec<_> = bench_support::examples()
+        .into_iter()
+        .map(|path| (bench_support::file_name(&path), path))
+        .collect();
+    let format = Format {
+        decimals: 0,
+        unit: "",
+    };
+    bench_support::run(
+        &options,
+        format,
+        &cases,
+        |name, path| bench(path, name, &run),
+        // Examples the frontends can't build yet aren't failures here
+        |e| e.downcast_ref::<smd_compiler::CompileError>().is_some(),
+    )
+}
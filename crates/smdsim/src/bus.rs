@@ -0,0 +1,393 @@
+//! Mega Drive memory map as the 68000 sees it
+//!
+//! Only what the SDK touches is modelled, and only as far as timing and the
+//! SDK's polling loops need. The VDP keeps its registers and reports blanking
+//! and interrupts but draws nothing and keeps no VRAM; FM and PSG writes are
+//! counted and dropped; the YM2612 is never busy. The Z80 isn't run: the bus
+//! is granted as soon as it's requested, and releasing it empties the sound
+//! driver's mailbox as if the driver had taken the command.
+
+use crate::cpu::Bus;
+use smd_compiler::backend::m68k::sdk::{Z80_BUS_REQ, Z80_RESET};
+
+/// 68000 clock periods per scanline (NTSC)
+pub const CYCLES_PER_LINE: u32 = 488;
+/// Scanlines per frame (NTSC)
+pub const LINES_PER_FRAME: u32 = 262;
+/// 68000 clock periods per frame, about 7.67 MHz / 59.92 Hz
+pub const CYCLES_PER_FRAME: u32 = CYCLES_PER_LINE * LINES_PER_FRAME;
+/// First line of vertical blanking, where the VBlank interrupt fires (V28)
+pub const VBLANK_LINE: u32 = 224;
+
+/// Sound driver mailbox in Z80 RAM
+const MAILBOX: usize = 0x1F00;
+/// Version register: overseas, NTSC, no expansion unit, TMSS present
+const VERSION: u8 = 0xA1;
+const IO_BASE: u32 = 0xA10000;
+const TMSS: u32 = 0xA14000;
+const RAM_BASE: u32 = 0xE00000;
+const RAM_SIZE: usize = 0x10000;
+const Z80_RAM_SIZE: usize = 0x2000;
+
+/// Bytes a 68000-to-VRAM DMA moves per line, in H40 and H32 modes, while
+/// the display is blanked and while it is drawing
+const DMA_RATE_BLANK: (u32, u32) = (205, 167);
+const DMA_RATE_ACTIVE: (u32, u32) = (18, 16);
+
+/// Writes to the sound and video ports, for spotting changes in how much
+/// traffic generated code puts on them
+#[derive(Debug, Clone, Copy, Default, PartialEq, Eq)]
+pub struct PortWrites {
+    pub vdp_data: u64,
+    pub vdp_ctrl: u64,
+    pub psg: u64,
+    pub ym: u64,
+}
+
+impl std::ops::Sub for PortWrites {
+    type Output = PortWrites;
+
+    fn sub(self, rhs: PortWrites) -> PortWrites {
+        PortWrites {
+            vdp_data: self.vdp_data - rhs.vdp_data,
+            vdp_ctrl: self.vdp_ctrl - rhs.vdp_ctrl,
+            psg: self.psg - rhs.psg,
+            ym: self.ym - rhs.ym,
+        }
+    }
+}
+
+/// VDP register file and the state of its control port
+#[derive(Debug, Clone, Default)]
+pub struct Vdp {
+    pub registers: [u8; 24],
+    /// First half of a two-word command
+    pending: Option<u16>,
+    /// Vertical interrupt raised and not yet acknowledged
+    pub vint_pending: bool,
+    /// Clock periods the 68000 is held off the bus by DMA, not yet charged
+    pub dma_stall: u32,
+}
+
+impl Vdp {
+    /// Display enabled (register 1, bit 6)
+    pub fn display_enabled(&self) -> bool {
+        self.registers[1] & 0x40 != 0
+    }
+
+    /// VBlank interrupt enabled (register 1, bit 5)
+    pub fn vint_enabled(&self) -> bool {
+        self.registers[1] & 0x20 != 0
+    }
+
+    fn h40(&self) -> bool {
+        self.registers[12] & 0x81 != 0
+    }
+
+    fn write_control(&mut self, value: u16, line: u32) {
+        if self.pending.take().is_some() {
+            // Second word: CD5 starts a DMA
+            if value & 0x80 != 0 && self.registers[1] & 0x10 != 0 {
+                self.start_dma(line);
+            }
+        } else if value & 0xC000 == 0x8000 {
+            let reg = usize::from(value >> 8 & 0x1F);
+            if let Some(r) = self.registers.get_mut(reg) {
+                *r = value as u8;
+            }
+        } else {
+            self.pending = Some(value);
+        }
+    }
+
+    /// Charge a 68000-to-VDP transfer; fills and copies run inside the VDP
+    /// and leave the 68000 alone
+    fn start_dma(&mut self, line: u32) {
+        if self.registers[23] & 0x80 != 0 {
+            return;
+        }
+        let words = u32::from(self.registers[19]) | u32::from(self.registers[20]) << 8;
+        let bytes = if words == 0 { 0x20000 } else { words * 2 };
+        let blank = !self.display_enabled() || line >= VBLANK_LINE;
+        let (h40, h32) = if blank {
+            DMA_RATE_BLANK
+        } else {
+            DMA_RATE_ACTIVE
+        };
+        let rate = if self.h40() { h40 } else { h32 };
+        self.dma_stall += bytes.div_ceil(rate) * CYCLES_PER_LINE;
+    }
+
+    /// Status register: FIFO empty, VBlank, VInt pending, DMA never busy
+    fn status(&self, line: u32) -> u16 {
+        let mut status = 0x3600;
+        if line >= VBLANK_LINE || !self.display_enabled() {
+            status |= 0x0008;
+        }
+        if self.vint_pending {
+            status |= 0x0080;
+        }
+        status
+    }
+}
+
+/// The 68000's address space
+pub struct MegaDrive {
+    rom: Vec<u8>,
+    ram: Vec<u8>,
+    z80_ram: Vec<u8>,
+    pub vdp: Vdp,
+    /// Controller buttons for ports 1 and 2, in the SDK's `BTN_*` layout
+    pub pads: [u8; 2],
+    /// TH output level last written to each port
+    th: [bool; 2],
+    z80_bus_requested: bool,
+    z80_reset_released: bool,
+    /// Clock periods since power-on, kept up to date by the machine
+    pub now: u64,
+    pub writes: PortWrites,
+    /// Writes that changed memory or reached a port
+    pub changes: u64,
+}
+
+impl MegaDrive {
+    pub fn new(rom: Vec<u8>) -> Self {
+        Self {
+            rom,
+            ram: vec![0; RAM_SIZE],
+            z80_ram: vec![0; Z80_RAM_SIZE],
+            vdp: Vdp::default(),
+            pads: [0; 2],
+            th: [true; 2],
+            z80_bus_requested: false,
+            z80_reset_released: false,
+            now: 0,
+            writes: PortWrites::default(),
+            changes: 0,
+        }
+    }
+
+    /// Work RAM, from $FF0000
+    pub fn ram(&self) -> &[u8] {
+        &self.ram
+    }
+
+    /// Z80 RAM, as the 68000 last left it
+    pub fn z80_ram(&self) -> &[u8] {
+        &self.z80_ram
+    }
+
+    /// Current scanline, counting from the top of the active display
+    pub fn line(&self) -> u32 {
+        ((self.now % u64::from(CYCLES_PER_FRAME)) / u64::from(CYCLES_PER_LINE)) as u32
+    }
+
+    fn pad_read(&self, port: usize) -> u8 {
+        let pressed = self.pads[port];
+        if self.th[port] {
+            // TH high: C B R L D U
+            0x40 | (!pressed & 0x3F)
+        } else {
+            // TH low: Start A 0 0 D U
+            !((pressed & 0x03) | (pressed >> 2 & 0x30)) & 0x33
+        }
+    }
+
+    fn io_read(&self, addr: u32) -> u8 {
+        match addr & 0x1F {
+            0x01 => VERSION,
+            0x03 => self.pad_read(0),
+            0x05 => self.pad_read(1),
+            _ => 0,
+        }
+    }
+
+    fn io_write(&mut self, addr: u32, value: u8) {
+        match addr & 0x1F {
+            0x03 => self.th[0] = value & 0x40 != 0,
+            0x05 => self.th[1] = value & 0x40 != 0,
+            _ => {}
+        }
+    }
+
+    fn z80_bus_write(&mut self, requested: bool) {
+        if self.z80_bus_requested && !requested && self.z80_reset_released {
+            self.z80_ram[MAILBOX] = 0;
+        }
+        self.z80_bus_requested = requested;
+    }
+
+    fn vdp_read(&self, addr: u32) -> u16 {
+        match addr & 0x1C {
+            0x04 => self.vdp.status(self.line()),
+            0x08 | 0x0C => {
+                // V counter in the high byte, H counter in the low byte
+                let line = self.line();
+                let v = if line > 0xEA { line - 6 } else { line };
+                let h = (self.now % u64::from(CYCLES_PER_LINE)) * 0xD2 / u64::from(CYCLES_PER_LINE);
+                ((v & 0xFF) << 8) as u16 | h as u16
+            }
+            _ => 0,
+        }
+    }
+
+    fn vdp_write(&mut self, addr: u32, value: u16) {
+        match addr & 0x1F {
+            0x00..=0x03 => self.writes.vdp_data += 1,
+            0x04..=0x07 => {
+                self.writes.vdp_ctrl += 1;
+                let line = self.line();
+                self.vdp.write_control(value, line);
+            }
+            0x11 | 0x13 | 0x15 | 0x17 => self.writes.psg += 1,
+            _ => {}
+        }
+    }
+}
+
+impl Bus for MegaDrive {
+    fn read_byte(&mut self, addr: u32) -> u8 {
+        match addr {
+            0..=0x3F_FFFF => self.rom.get(addr as usize).copied().unwrap_or(0xFF),
+            // Z80 RAM, mirrored once; the YM2612 status is never busy
+            0xA0_0000..=0xA0_3FFF => self.z80_ram[addr as usize & (Z80_RAM_SIZE - 1)],
+            0xA0_4000..=0xA0_FFFF => 0,
+            IO_BASE..=0xA1_001F => self.io_read(addr),
+            _ if addr & !1 == Z80_BUS_REQ => {
+                // Bit 0 clear: bus granted
+                u8::from(!(self.z80_bus_requested && addr & 1 == 0))
+            }
+            0xC0_0000..=0xDF_FFFF => {
+                let word = self.vdp_read(addr);
+                if addr & 1 == 0 {
+                    (word >> 8) as u8
+                } else {
+                    word as u8
+                }
+            }
+            RAM_BASE.. => self.ram[addr as usize & (RAM_SIZE - 1)],
+            _ => 0,
+        }
+    }
+
+    fn read_word(&mut self, addr: u32) -> u16 {
+        match addr {
+            0xC0_0000..=0xDF_FFFF => self.vdp_read(addr),
+            // Z80 space repeats the byte on both halves
+            0xA0_0000..=0xA0_FFFF => u16::from_be_bytes([self.read_byte(addr); 2]),
+            _ => u16::from_be_bytes([self.read_byte(addr), self.read_byte(addr | 1)]),
+        }
+    }
+
+    fn write_byte(&mut self, addr: u32, value: u8) {
+        let cell = match addr {
+            0xA0_0000..=0xA0_3FFF => &mut self.z80_ram[addr as usize & (Z80_RAM_SIZE - 1)],
+            RAM_BASE.. => &mut self.ram[addr as usize & (RAM_SIZE - 1)],
+            _ => {
+                self.changes += 1;
+                match addr {
+                    // YM2612: count the data writes, not the register selects
+                    0xA0_4000..=0xA0_5FFF => self.writes.ym += u64::from(addr & 1),
+                    IO_BASE..=0xA1_001F => self.io_write(addr, value),
+                    _ if addr == Z80_BUS_REQ => self.z80_bus_write(value & 1 != 0),
+                    _ if addr == Z80_RESET => self.z80_reset_released = value & 1 != 0,
+                    // Byte writes reach the VDP doubled up
+                    0xC0_0000..=0xDF_FFFF => self.vdp_write(addr, u16::from_be_bytes([value; 2])),
+                    _ => {}
+                }
+                return;
+            }
+        };
+        if *cell != value {
+            *cell = value;
+            self.changes += 1;
+        }
+    }
+
+    fn write_word(&mut self, addr: u32, value: u16) {
+        match addr {
+            0xC0_0000..=0xDF_FFFF => {
+                self.changes += 1;
+                self.vdp_write(addr, value);
+            }
+            // The Z80 bus and the control registers take the high byte
+            0xA0_0000..=0xA0_FFFF => self.write_byte(addr, (value >> 8) as u8),
+            _ if addr == Z80_BUS_REQ || addr == Z80_RESET => {
+                self.write_byte(addr, (value >> 8) as u8);
+            }
+            _ if addr & !3 == TMSS => self.changes += 1,
+            _ => {
+                let [high, low] = value.to_be_bytes();
+                self.write_byte(addr, high);
+                self.write_byte(addr | 1, low);
+            }
+        }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use smd_compiler::backend::m68k::sdk::{PSG_PORT, VDP_CTRL, VDP_DATA, YM_ADDR0, Z80_RAM};
+
+    #[test]
+    fn test_pad_protocol() {
+        let mut md = MegaDrive::new(Vec::new());
+        md.pads[0] = 0x80 | 0x40 | 0x01; // Start, A, Up
+        md.write_byte(IO_BASE + 3, 0x40);
+        assert_eq!(md.read_byte(IO_BASE + 3), 0x40 | 0x3E);
+        md.write_byte(IO_BASE + 3, 0x00);
+        assert_eq!(md.read_byte(IO_BASE + 3), 0x02);
+    }
+
+    #[test]
+    fn test_status_follows_the_beam() {
+        let mut md = MegaDrive::new(Vec::new());
+        md.write_word(VDP_CTRL, 0x8144);
+        assert!(md.vdp.display_enabled());
+        assert_eq!(md.read_word(VDP_CTRL) & 8, 0);
+        md.now = u64::from(VBLANK_LINE * CYCLES_PER_LINE);
+        assert_eq!(md.read_word(VDP_CTRL) & 8, 8);
+        md.now += u64::from(CYCLES_PER_LINE * (LINES_PER_FRAME - VBLANK_LINE));
+        assert_eq!(md.read_word(VDP_CTRL) & 8, 0);
+    }
+
+    #[test]
+    fn test_dma_stall() {
+        let mut md = MegaDrive::new(Vec::new());
+        // Display off, DMA on, H40, 410 words from 68000 memory
+        for value in [0x8114, 0x8C81, 0x939A, 0x9401, 0x977F] {
+            md.write_word(VDP_CTRL, value);
+        }
+        md.write_word(VDP_CTRL, 0x4000);
+        md.write_word(VDP_CTRL, 0x0080);
+        assert_eq!(md.vdp.dma_stall, 4 * CYCLES_PER_LINE);
+        assert_eq!(md.writes.vdp_ctrl, 7);
+        md.write_word(VDP_DATA, 0);
+        assert_eq!(md.writes.vdp_data, 1);
+    }
+
+    #[test]
+    fn test_z80_mailbox_ack() {
+        let mut md = MegaDrive::new(Vec::new());
+        md.write_word(Z80_RESET, 0x100);
+        md.write_word(Z80_BUS_REQ, 0x100);
+        assert_eq!(md.read_byte(Z80_BUS_REQ) & 1, 0);
+        md.write_byte(Z80_RAM + MAILBOX as u32, 0x20);
+        assert_eq!(md.read_byte(Z80_RAM + MAILBOX as u32), 0x20);
+        md.write_word(Z80_BUS_REQ, 0);
+        assert_eq!(md.read_byte(Z80_BUS_REQ) & 1, 1);
+        assert_eq!(md.z80_ram()[MAILBOX], 0);
+    }
+
+    #[test]
+    fn test_sound_ports_counted() {
+        let mut md = MegaDrive::new(Vec::new());
+        md.write_byte(PSG_PORT, 0x9F);
+        md.write_byte(YM_ADDR0, 0x28);
+        md.write_byte(YM_ADDR0 + 1, 0xF0);
+        assert_eq!(md.writes.psg, 1);
+        assert_eq!(md.writes.ym, 1);
+        assert_eq!(md.read_byte(YM_ADDR0), 0);
+    }
+}
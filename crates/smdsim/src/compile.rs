@@ -0,0 +1,77 @@
+//! Building example ROMs in-process
+//!
+//! Runs the same passes `smdc` does for a single-file ROM build, with debug
+//! info on so the symbol map comes back alongside the image.
+
+use crate::sym::SymbolMap;
+use smd_compiler::backend::m68k::sdk::VBLANK_CALLBACK;
+use smd_compiler::backend::{Backend, BackendConfig, OutputFormat, OutputKind, RomBackend};
+use smd_compiler::common::DiagnosticReporter;
+use smd_compiler::frontend::{CFrontend, CompileContext, Frontend, FrontendConfig, RustFrontend};
+use smd_compiler::opt::{PassManager, remove_dead_symbols};
+use std::error::Error;
+use std::fs;
+use std::path::{Path, PathBuf};
+
+/// A ROM and its symbols
+pub struct Image {
+    pub rom: Vec<u8>,
+    pub symbols: SymbolMap,
+}
+
+/// The SDK's C headers in this checkout
+pub fn sdk_include_dir() -> PathBuf {
+    Path::new(env!("CARGO_MANIFEST_DIR")).join("../../sdk/c/include")
+}
+
+/// Compile the C or Rust file at `path` to a ROM at `-O<opt>`
+pub fn compile(path: &Path, opt: u8) -> Result<Image, Box<dyn Error>> {
+    let source = fs::read_to_string(path)?;
+    let filename = path.display().to_string();
+    compile_source(&source, &filename, opt)
+}
+
+/// Compile `source`, picking the frontend by `filename`'s extension
+pub fn compile_source(source: &str, filename: &str, opt: u8) -> Result<Image, Box<dyn Error>> {
+    let mut reporter = DiagnosticReporter::new();
+    let file_id = reporter.add_file(filename, source);
+    let frontend: Box<dyn Frontend> = if Path::new(filename)
+        .extension()
+        .is_some_and(|e| e.eq_ignore_ascii_case("rs"))
+    {
+        Box::new(RustFrontend::new())
+    } else {
+        Box::new(CFrontend::new())
+    };
+    let frontend_config = FrontendConfig {
+        include_paths: vec![sdk_include_dir()],
+        ..Default::default()
+    };
+    let ctx = CompileContext::new(filename.to_string(), file_id, &reporter);
+
+    let mut module = frontend.compile(source, &ctx, &frontend_config)?;
+    PassManager::for_level(opt).run(&mut module);
+    if opt > 0 {
+        remove_dead_symbols(&mut module, &["main", VBLANK_CALLBACK]);
+    }
+
+    let config = BackendConfig {
+        output_format: OutputFormat::Binary,
+        optimize_level: opt,
+        debug_info: true,
+        ..Default::default()
+    };
+    let output = RomBackend::new().generate(&module, &ctx, &config)?;
+    let OutputKind::Binary(rom) = output.data else {
+        return Err("ROM backend produced text".into());
+    };
+    let sym = output
+        .side_artifacts
+        .iter()
+        .find(|(ext, _)| ext == "sym")
+        .map_or("", |(_, text)| text.as_str());
+    Ok(Image {
+        rom,
+        symbols: SymbolMap::parse(sym)?,
+    })
+}
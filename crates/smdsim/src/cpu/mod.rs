@@ -0,0 +1,1396 @@
+//! MC68000 interpreter with cycle counting
+//!
+//! Runs the integer instruction set, without the BCD instructions, `MOVEP`
+//! and `CHK`. Each instruction is charged its clock periods from the
+//! MC68000 user's manual, the same tables `instruction_cycles` estimates
+//! from, with the data-dependent cases resolved as they happen: branches
+//! taken or not, the multiplier's bits, the division steps and the shift
+//! count. Memory is zero wait state.
+//!
+//! Exceptions other than interrupts stop the run with a [`Fault`] instead of
+//! being taken. The SDK installs no handlers for them, so reaching one means
+//! the program, or the compiler, is broken.
+
+#[cfg(test)]
+mod tests;
+
+use std::fmt;
+
+/// The CPU's view of memory. Addresses are 24-bit; word accesses are even.
+pub trait Bus {
+    fn read_byte(&mut self, addr: u32) -> u8;
+    fn read_word(&mut self, addr: u32) -> u16;
+    fn write_byte(&mut self, addr: u32, value: u8);
+    fn write_word(&mut self, addr: u32, value: u16);
+}
+
+/// Why execution stopped
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum Fault {
+    /// An opcode the 68000 doesn't have, or one not implemented here
+    Illegal { pc: u32, opcode: u16 },
+    /// Word or long access at an odd address
+    AddressError { pc: u32, addr: u32 },
+    /// `DIVU` or `DIVS` by zero
+    DivideByZero { pc: u32 },
+    /// `TRAP #n` (vector 32 + n) or a `TRAPV` that overflowed (vector 7)
+    Trap { pc: u32, vector: u8 },
+    /// Supervisor instruction in user mode
+    Privilege { pc: u32 },
+}
+
+impl Fault {
+    /// Address of the faulting instruction
+    pub fn pc(&self) -> u32 {
+        match *self {
+            Fault::Illegal { pc, .. }
+            | Fault::AddressError { pc, .. }
+            | Fault::DivideByZero { pc }
+            | Fault::Trap { pc, .. }
+            | Fault::Privilege { pc } => pc,
+        }
+    }
+}
+
+impl fmt::Display for Fault {
+    fn fmt(&self, f: &mut fmt::Formatter<'_>) -> fmt::Result {
+        match self {
+            Fault::Illegal { pc, opcode } => {
+                write!(f, "illegal instruction {opcode:04X} at ${pc:06X}")
+            }
+            Fault::AddressError { pc, addr } => {
+                write!(f, "odd address ${addr:06X} accessed at ${pc:06X}")
+            }
+            Fault::DivideByZero { pc } => write!(f, "division by zero at ${pc:06X}"),
+            Fault::Trap { pc, vector } => write!(f, "trap to vector {vector} at ${pc:06X}"),
+            Fault::Privilege { pc } => write!(f, "privilege violation at ${pc:06X}"),
+        }
+    }
+}
+
+impl std::error::Error for Fault {}
+
+/// Control transfer made by the last instruction, for call-graph profiling
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum Flow {
+    Sequential,
+    /// `JSR` or `BSR` to this address
+    Call(u32),
+    /// Interrupt taken, to this handler
+    Interrupt(u32),
+    /// `RTS`, `RTR` or `RTE`
+    Return,
+}
+
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+enum Size {
+    Byte,
+    Word,
+    Long,
+}
+
+impl Size {
+    /// Size field in bits 1-0 of `bits`; 3 isn't a size
+    fn from_bits(bits: u16) -> Option<Size> {
+        match bits & 3 {
+            0 => Some(Size::Byte),
+            1 => Some(Size::Word),
+            2 => Some(Size::Long),
+            _ => None,
+        }
+    }
+
+    fn bytes(self) -> u32 {
+        match self {
+            Size::Byte => 1,
+            Size::Word => 2,
+            Size::Long => 4,
+        }
+    }
+
+    fn mask(self) -> u32 {
+        match self {
+            Size::Byte => 0xFF,
+            Size::Word => 0xFFFF,
+            Size::Long => 0xFFFF_FFFF,
+        }
+    }
+
+    fn msb(self) -> u32 {
+        match self {
+            Size::Byte => 0x80,
+            Size::Word => 0x8000,
+            Size::Long => 0x8000_0000,
+        }
+    }
+
+    fn sign_extend(self, value: u32) -> u32 {
+        match self {
+            Size::Byte => value as u8 as i8 as u32,
+            Size::Word => value as u16 as i16 as u32,
+            Size::Long => value,
+        }
+    }
+}
+
+/// Resolved effective address
+#[derive(Debug, Clone, Copy)]
+enum Ea {
+    Data(usize),
+    Addr(usize),
+    Mem(u32),
+    Imm(u32),
+}
+
+// Status register bits
+const C: u16 = 0x0001;
+const V: u16 = 0x0002;
+const Z: u16 = 0x0004;
+const N: u16 = 0x0008;
+const X: u16 = 0x0010;
+const S: u16 = 0x2000;
+const SR_BITS: u16 = 0xA71F;
+
+/// Address bus width
+const ADDRESS_MASK: u32 = 0x00FF_FFFF;
+
+/// Effective address calculation time, as in `instruction_cycles`
+fn ea_cycles(mode: u16, reg: u16, size: Size) -> u32 {
+    let (short, long) = match (mode, reg) {
+        (2 | 3, _) | (7, 4) => (4, 8),
+        (4, _) => (6, 10),
+        (5, _) | (7, 0 | 2) => (8, 12),
+        (6, _) | (7, 3) => (10, 14),
+        (7, 1) => (12, 16),
+        _ => (0, 0),
+    };
+    if size == Size::Long { long } else { short }
+}
+
+/// Extra time `LEA`, `PEA`, `JMP`, `JSR` and `MOVEM` take to form an address
+/// beyond the `(An)` form: `(displacement, indexed, absolute long)`
+fn control_cycles(mode: u16, reg: u16, (disp, indexed, long): (u32, u32, u32)) -> u32 {
+    match (mode, reg) {
+        (5, _) | (7, 0 | 2) => disp,
+        (6, _) | (7, 3) => indexed,
+        (7, 1) => long,
+        _ => 0,
+    }
+}
+
+/// Register-to-register time, or read-modify-write time for a memory operand
+fn read_modify_write(size: Size, mode: u16, reg: u16, register: (u32, u32)) -> u32 {
+    let long = size == Size::Long;
+    if mode <= 1 {
+        if long { register.1 } else { register.0 }
+    } else {
+        (if long { 12 } else { 8 }) + ea_cycles(mode, reg, size)
+    }
+}
+
+/// Register or immediate source, which makes long `ADD`-type operations
+/// slower than memory ones
+fn register_or_immediate(mode: u16, reg: u16) -> bool {
+    mode <= 1 || (mode == 7 && reg == 4)
+}
+
+/// `DIVU` time: 38 steps plus one or two per quotient bit, or 10 clock
+/// periods on overflow
+fn divu_cycles(dividend: u32, divisor: u16) -> u32 {
+    let divisor = u32::from(divisor) << 16;
+    if dividend >= divisor {
+        return 10;
+    }
+    let mut dividend = dividend;
+    let mut steps = 38;
+    for _ in 0..15 {
+        let carry = dividend & 0x8000_0000 != 0;
+        dividend <<= 1;
+        if carry {
+            dividend = dividend.wrapping_sub(divisor);
+        } else if dividend >= divisor {
+            dividend -= divisor;
+            steps += 1;
+        } else {
+            steps += 2;
+        }
+    }
+    steps * 2
+}
+
+/// `DIVS` time, from the signs and the magnitude of the quotient
+fn divs_cycles(dividend: i32, divisor: i16) -> u32 {
+    let mut steps = 6;
+    if dividend < 0 {
+        steps += 1;
+    }
+    let magnitude = dividend.unsigned_abs();
+    let divisor_magnitude = u32::from(divisor.unsigned_abs());
+    if magnitude >> 16 >= divisor_magnitude {
+        return (steps + 2) * 2;
+    }
+    steps += 55;
+    if divisor >= 0 {
+        if dividend >= 0 {
+            steps -= 1;
+        } else {
+            steps += 1;
+        }
+    }
+    let mut quotient = magnitude / divisor_magnitude;
+    for _ in 0..15 {
+        if quotient & 0x8000 == 0 {
+            steps += 1;
+        }
+        quotient <<= 1;
+    }
+    steps * 2
+}
+
+/// Processor state
+#[derive(Debug, Clone)]
+pub struct Cpu {
+    /// Data registers
+    pub d: [u32; 8],
+    /// Address registers; `a[7]` is the stack pointer of the current mode
+    pub a: [u32; 8],
+    pub pc: u32,
+    sr: u16,
+    /// Stack pointer of the other mode
+    inactive_sp: u32,
+    /// Clock periods since reset
+    pub cycles: u64,
+    stopped: bool,
+    /// Control transfer made by the last instruction
+    pub flow: Flow,
+    /// Address and opcode of the instruction being executed
+    inst_pc: u32,
+    opcode: u16,
+}
+
+impl Cpu {
+    /// Reset: load the stack pointer and entry point from the vector table
+    pub fn new(bus: &mut impl Bus) -> Result<Self, Fault> {
+        let mut cpu = Self {
+            d: [0; 8],
+            a: [0; 8],
+            pc: 0,
+            sr: 0x2700,
+            inactive_sp: 0,
+            cycles: 40,
+            stopped: false,
+            flow: Flow::Sequential,
+            inst_pc: 0,
+            opcode: 0,
+        };
+        cpu.a[7] = cpu.read(bus, 0, Size::Long)?;
+        cpu.pc = cpu.read(bus, 4, Size::Long)?;
+        Ok(cpu)
+    }
+
+    pub fn sr(&self) -> u16 {
+        self.sr
+    }
+
+    /// Whether a `STOP` is waiting for an interrupt
+    pub fn is_stopped(&self) -> bool {
+        self.stopped
+    }
+
+    /// Execute one instruction; returns the clock periods it took
+    pub fn step(&mut self, bus: &mut impl Bus) -> Result<u32, Fault> {
+        self.flow = Flow::Sequential;
+        let cycles = if self.stopped {
+            4
+        } else {
+            self.inst_pc = self.pc;
+            self.opcode = self.fetch(bus)?;
+            self.execute(bus, self.opcode)?
+        };
+        self.cycles += u64::from(cycles);
+        Ok(cycles)
+    }
+
+    /// Take an autovectored interrupt at `level` unless the mask blocks it;
+    /// returns the clock periods taken
+    pub fn interrupt(&mut self, bus: &mut impl Bus, level: u8) -> Result<Option<u32>, Fault> {
+        let level = u16::from(level);
+        if level < 7 && level <= self.sr >> 8 & 7 {
+            return Ok(None);
+        }
+        self.stopped = false;
+        self.inst_pc = self.pc;
+        let old = self.sr;
+        self.set_sr((old & !0x8700) | S | level << 8);
+        self.push(bus, Size::Long, self.pc)?;
+        self.push(bus, Size::Word, u32::from(old))?;
+        self.pc = self.read(bus, (24 + u32::from(level)) * 4, Size::Long)?;
+        self.flow = Flow::Interrupt(self.pc);
+        self.cycles += 44;
+        Ok(Some(44))
+    }
+
+    // ---------------------------------------------------------------------
+    // Memory
+    // ---------------------------------------------------------------------
+
+    fn read(&self, bus: &mut impl Bus, addr: u32, size: Size) -> Result<u32, Fault> {
+        let addr = addr & ADDRESS_MASK;
+        if size != Size::Byte && addr & 1 != 0 {
+            return Err(Fault::AddressError {
+                pc: self.inst_pc,
+                addr,
+            });
+        }
+        Ok(match size {
+            Size::Byte => u32::from(bus.read_byte(addr)),
+            Size::Word => u32::from(bus.read_word(addr)),
+            Size::Long => {
+                let high = u32::from(bus.read_word(addr));
+                high << 16 | u32::from(bus.read_word((addr + 2) & ADDRESS_MASK))
+            }
+        })
+    }
+
+    fn write(&self, bus: &mut impl Bus, addr: u32, size: Size, value: u32) -> Result<(), Fault> {
+        let addr = addr & ADDRESS_MASK;
+        if size != Size::Byte && addr & 1 != 0 {
+            return Err(Fault::AddressError {
+                pc: self.inst_pc,
+                addr,
+            });
+        }
+        match size {
+            Size::Byte => bus.write_byte(addr, value as u8),
+            Size::Word => bus.write_word(addr, value as u16),
+            Size::Long => {
+                bus.write_word(addr, (value >> 16) as u16);
+                bus.write_word((addr + 2) & ADDRESS_MASK, value as u16);
+            }
+        }
+        Ok(())
+    }
+
+    fn fetch(&mut self, bus: &mut impl Bus) -> Result<u16, Fault> {
+        let word = self.read(bus, self.pc, Size::Word)? as u16;
+        self.pc = self.pc.wrapping_add(2);
+        Ok(word)
+    }
+
+    fn fetch_long(&mut self, bus: &mut impl Bus) -> Result<u32, Fault> {
+        let high = u32::from(self.fetch(bus)?);
+        Ok(high << 16 | u32::from(self.fetch(bus)?))
+    }
+
+    /// Immediate operand of `size`; bytes take the low half of a word
+    fn immediate(&mut self, bus: &mut impl Bus, size: Size) -> Result<u32, Fault> {
+        match size {
+            Size::Byte => Ok(u32::from(self.fetch(bus)? & 0xFF)),
+            Size::Word => Ok(u32::from(self.fetch(bus)?)),
+            Size::Long => self.fetch_long(bus),
+        }
+    }
+
+    fn push(&mut self, bus: &mut impl Bus, size: Size, value: u32) -> Result<(), Fault> {
+        self.a[7] = self.a[7].wrapping_sub(size.bytes());
+        self.write(bus, self.a[7], size, value)
+    }
+
+    fn pop(&mut self, bus: &mut impl Bus, size: Size) -> Result<u32, Fault> {
+        let value = self.read(bus, self.a[7], size)?;
+        self.a[7] = self.a[7].wrapping_add(size.bytes());
+        Ok(value)
+    }
+
+    // ---------------------------------------------------------------------
+    // Effective addresses
+    // ---------------------------------------------------------------------
+
+    /// Resolve mode/register fields, applying any increment or decrement
+    fn ea(&mut self, bus: &mut impl Bus, mode: u16, reg: u16, size: Size) -> Result<Ea, Fault> {
+        let r = usize::from(reg);
+        // The stack pointer stays even
+        let step = if r == 7 && size == Size::Byte {
+            2
+        } else {
+            size.bytes()
+        };
+        Ok(match mode {
+            0 => Ea::Data(r),
+            1 => Ea::Addr(r),
+            2 => Ea::Mem(self.a[r]),
+            3 => {
+                let addr = self.a[r];
+                self.a[r] = addr.wrapping_add(step);
+                Ea::Mem(addr)
+            }
+            4 => {
+                self.a[r] = self.a[r].wrapping_sub(step);
+                Ea::Mem(self.a[r])
+            }
+            5 => {
+                let disp = self.fetch(bus)? as i16 as u32;
+                Ea::Mem(self.a[r].wrapping_add(disp))
+            }
+            6 => {
+                let base = self.a[r];
+                Ea::Mem(self.indexed(bus, base)?)
+            }
+            _ => match reg {
+                0 => Ea::Mem(self.fetch(bus)? as i16 as u32),
+                1 => Ea::Mem(self.fetch_long(bus)?),
+                2 => {
+                    let base = self.pc;
+                    Ea::Mem(base.wrapping_add(self.fetch(bus)? as i16 as u32))
+                }
+                3 => {
+                    let base = self.pc;
+                    Ea::Mem(self.indexed(bus, base)?)
+                }
+                4 => Ea::Imm(self.immediate(bus, size)?),
+                _ => return Err(self.illegal()),
+            },
+        })
+    }
+
+    /// `d8(base,Xn)` from its extension word
+    fn indexed(&mut self, bus: &mut impl Bus, base: u32) -> Result<u32, Fault> {
+        let ext = self.fetch(bus)?;
+        let r = usize::from(ext >> 12 & 7);
+        let index = if ext & 0x8000 != 0 {
+            self.a[r]
+        } else {
+            self.d[r]
+        };
+        let index = if ext & 0x0800 != 0 {
+            index
+        } else {
+            Size::Word.sign_extend(index)
+        };
+        Ok(base
+            .wrapping_add(Size::Byte.sign_extend(u32::from(ext)))
+            .wrapping_add(index))
+    }
+
+    /// Address of a control-mode operand (`LEA`, `PEA`, `JMP`, `JSR`,
+    /// `MOVEM`)
+    fn control_address(&mut self, bus: &mut impl Bus, mode: u16, reg: u16) -> Result<u32, Fault> {
+        if matches!(mode, 0 | 1 | 3 | 4) {
+            return Err(self.illegal());
+        }
+        match self.ea(bus, mode, reg, Size::Long)? {
+            Ea::Mem(addr) => Ok(addr),
+            _ => Err(self.illegal()),
+        }
+    }
+
+    fn read_ea(&self, bus: &mut impl Bus, ea: Ea, size: Size) -> Result<u32, Fault> {
+        Ok(match ea {
+            Ea::Data(r) => self.d[r] & size.mask(),
+            Ea::Addr(r) => self.a[r] & size.mask(),
+            Ea::Mem(addr) => self.read(bus, addr, size)?,
+            Ea::Imm(value) => value & size.mask(),
+        })
+    }
+
+    fn write_ea(
+        &mut self,
+        bus: &mut impl Bus,
+        ea: Ea,
+        size: Size,
+        value: u32,
+    ) -> Result<(), Fault> {
+        match ea {
+            Ea::Data(r) => self.d[r] = (self.d[r] & !size.mask()) | (value & size.mask()),
+            Ea::Addr(r) => self.a[r] = size.sign_extend(value),
+            Ea::Mem(addr) => self.write(bus, addr, size, value)?,
+            Ea::Imm(_) => return Err(self.illegal()),
+        }
+        Ok(())
+    }
+
+    // ---------------------------------------------------------------------
+    // Flags
+    // ---------------------------------------------------------------------
+
+    fn flag(&self, bit: u16) -> bool {
+        self.sr & bit != 0
+    }
+
+    fn set_flags(&mut self, mask: u16, bits: u16) {
+        self.sr = (self.sr & !mask) | (bits & mask);
+    }
+
+    fn set_sr(&mut self, value: u16) {
+        let value = value & SR_BITS;
+        if (value ^ self.sr) & S != 0 {
+            std::mem::swap(&mut self.a[7], &mut self.inactive_sp);
+        }
+        self.sr = value;
+    }
+
+    fn supervisor(&self) -> Result<(), Fault> {
+        if self.flag(S) {
+            Ok(())
+        } else {
+            Err(Fault::Privilege { pc: self.inst_pc })
+        }
+    }
+
+    fn illegal(&self) -> Fault {
+        Fault::Illegal {
+            pc: self.inst_pc,
+            opcode: self.opcode,
+        }
+    }
+
+    fn nz(value: u32, size: Size) -> u16 {
+        let mut flags = 0;
+        if value & size.mask() == 0 {
+            flags |= Z;
+        }
+        if value & size.msb() != 0 {
+            flags |= N;
+        }
+        flags
+    }
+
+    /// N and Z from `value`, V and C cleared
+    fn logic_flags(&mut self, value: u32, size: Size) {
+        self.set_flags(N | Z | V | C, Self::nz(value, size));
+    }
+
+    /// `dst + src + carry`, setting all five flags; with `extend`, Z is only
+    /// ever cleared, as `ADDX` does
+    fn add(&mut self, src: u32, dst: u32, carry: bool, extend: bool, size: Size) -> u32 {
+        let result = dst.wrapping_add(src).wrapping_add(u32::from(carry)) & size.mask();
+        let msb = size.msb();
+        let mut flags = Self::nz(result, size);
+        if ((src & dst) | (!result & (src | dst))) & msb != 0 {
+            flags |= C | X;
+        }
+        if (src ^ result) & (dst ^ result) & msb != 0 {
+            flags |= V;
+        }
+        if extend && result != 0 {
+            flags &= !Z;
+        } else if extend {
+            flags = (flags & !Z) | (self.sr & Z);
+        }
+        self.set_flags(N | Z | V | C | X, flags);
+        result
+    }
+
+    /// `dst - src - borrow`, setting all five flags; with `extend`, Z is only
+    /// ever cleared, as `SUBX` and `NEGX` do
+    fn sub(&mut self, src: u32, dst: u32, borrow: bool, extend: bool, size: Size) -> u32 {
+        let result = dst.wrapping_sub(src).wrapping_sub(u32::from(borrow)) & size.mask();
+        let msb = size.msb();
+        let mut flags = Self::nz(result, size);
+        if ((src & !dst) | (result & !dst) | (src & result)) & msb != 0 {
+            flags |= C | X;
+        }
+        if (src ^ dst) & (result ^ dst) & msb != 0 {
+            flags |= V;
+        }
+        if extend && result == 0 {
+            flags = (flags & !Z) | (self.sr & Z);
+        }
+        self.set_flags(N | Z | V | C | X, flags);
+        result
+    }
+
+    /// Flags of `dst - src`, leaving X alone
+    fn compare(&mut self, src: u32, dst: u32, size: Size) {
+        let x = self.sr & X;
+        self.sub(src, dst, false, false, size);
+        self.sr = (self.sr & !X) | x;
+    }
+
+    fn condition(&self, cc: u16) -> bool {
+        let (c, v, z, n) = (self.flag(C), self.flag(V), self.flag(Z), self.flag(N));
+        match cc & 0xF {
+            0 => true,
+            1 => false,
+            2 => !c && !z,
+            3 => c || z,
+            4 => !c,
+            5 => c,
+            6 => !z,
+            7 => z,
+            8 => !v,
+            9 => v,
+            10 => !n,
+            11 => n,
+            12 => n == v,
+            13 => n != v,
+            14 => !z && n == v,
+            _ => z || n != v,
+        }
+    }
+
+    // ---------------------------------------------------------------------
+    // Instructions
+    // ---------------------------------------------------------------------
+
+    fn execute(&mut self, bus: &mut impl Bus, op: u16) -> Result<u32, Fault> {
+        match op >> 12 {
+            0x0 => self.group_immediate(bus, op),
+            0x1..=0x3 => self.op_move(bus, op),
+            0x4 => self.group_misc(bus, op),
+            0x5 => self.group_quick(bus, op),
+            0x6 => self.op_branch(bus, op),
+            0x7 if op & 0x0100 == 0 => {
+                let r = usize::from(op >> 9 & 7);
+                self.d[r] = Size::Byte.sign_extend(u32::from(op));
+                self.logic_flags(self.d[r], Size::Long);
+                Ok(4)
+            }
+            0x8 | 0x9 | 0xB | 0xC | 0xD => self.group_arithmetic(bus, op),
+            0xE => self.group_shift(bus, op),
+            _ => Err(self.illegal()),
+        }
+    }
+
+    /// Immediate operations and bit operations
+    fn group_immediate(&mut self, bus: &mut impl Bus, op: u16) -> Result<u32, Fault> {
+        let (mode, reg) = (op >> 3 & 7, op & 7);
+        if op & 0x0100 != 0 {
+            if mode == 1 {
+                return Err(self.illegal());
+            }
+            let bit = self.d[usize::from(op >> 9 & 7)];
+            return self.bit_operation(bus, op, bit, false);
+        }
+        let kind = op >> 9 & 7;
+        match op & 0xF1FF {
+            // ORI, ANDI, EORI to CCR and SR
+            0x003C | 0x007C => {
+                let imm = self.fetch(bus)?;
+                let word = op & 0x40 != 0;
+                if word {
+                    self.supervisor()?;
+                }
+                let mask = if word { 0xFFFF } else { 0x00FF };
+                let value = match kind {
+                    0 => self.sr | imm,
+                    1 => self.sr & (imm | !mask),
+                    5 => self.sr ^ imm,
+                    _ => return Err(self.illegal()),
+                };
+                self.set_sr((self.sr & !mask) | (value & mask));
+                return Ok(20);
+            }
+            _ => {}
+        }
+        if kind == 4 {
+            let bit = u32::from(self.fetch(bus)? & 0xFF);
+            return self.bit_operation(bus, op, bit, true);
+        }
+        let size = Size::from_bits(op >> 6).ok_or_else(|| self.illegal())?;
+        let imm = self.immediate(bus, size)?;
+        let ea = self.ea(bus, mode, reg, size)?;
+        let dst = self.read_ea(bus, ea, size)?;
+        let long = size == Size::Long;
+        let result = match kind {
+            0 => dst | imm,
+            1 => dst & imm,
+            2 => self.sub(imm, dst, false, false, size),
+            3 => self.add(imm, dst, false, false, size),
+            5 => dst ^ imm,
+            6 => {
+                self.compare(imm, dst, size);
+                return Ok(if mode == 0 {
+                    if long { 14 } else { 8 }
+                } else {
+                    ea_cycles(mode, reg, size) + if long { 12 } else { 8 }
+                });
+            }
+            _ => return Err(self.illegal()),
+        };
+        if matches!(kind, 0 | 1 | 5) {
+            self.logic_flags(result, size);
+        }
+        self.write_ea(bus, ea, size, result)?;
+        Ok(if mode == 0 {
+            match (long, kind) {
+                (false, _) => 8,
+                (true, 1) => 14,
+                (true, _) => 16,
+            }
+        } else {
+            ea_cycles(mode, reg, size) + if long { 20 } else { 12 }
+        })
+    }
+
+    /// `BTST`, `BCHG`, `BCLR`, `BSET` of `bit`, which came from an extension
+    /// word when `immediate`
+    fn bit_operation(
+        &mut self,
+        bus: &mut impl Bus,
+        op: u16,
+        bit: u32,
+        immediate: bool,
+    ) -> Result<u32, Fault> {
+        let (mode, reg) = (op >> 3 & 7, op & 7);
+        let kind = op >> 6 & 3;
+        let extra = if immediate { 4 } else { 0 };
+        let (ea, size) = if mode == 0 {
+            (Ea::Data(usize::from(reg)), Size::Long)
+        } else {
+            (self.ea(bus, mode, reg, Size::Byte)?, Size::Byte)
+        };
+        let mask = 1 << (bit & (size.bytes() * 8 - 1));
+        let value = self.read_ea(bus, ea, size)?;
+        self.set_flags(Z, if value & mask == 0 { Z } else { 0 });
+        let result = match kind {
+            0 => {
+                return Ok(if mode == 0 {
+                    6 + extra
+                } else {
+                    4 + extra + ea_cycles(mode, reg, size)
+                });
+            }
+            1 => value ^ mask,
+            2 => value & !mask,
+            _ => value | mask,
+        };
+        self.write_ea(bus, ea, size, result)?;
+        Ok(if mode == 0 {
+            let high = u32::from(bit & 31 >= 16) * 2;
+            extra + high + if kind == 2 { 8 } else { 6 }
+        } else {
+            8 + extra + ea_cycles(mode, reg, size)
+        })
+    }
+
+    fn op_move(&mut self, bus: &mut impl Bus, op: u16) -> Result<u32, Fault> {
+        let size = match op >> 12 {
+            1 => Size::Byte,
+            3 => Size::Word,
+            _ => Size::Long,
+        };
+        let (src_mode, src_reg) = (op >> 3 & 7, op & 7);
+        let (dst_mode, dst_reg) = (op >> 6 & 7, op >> 9 & 7);
+        let src = self.ea(bus, src_mode, src_reg, size)?;
+        let value = self.read_ea(bus, src, size)?;
+        let cycles = 4 + ea_cycles(src_mode, src_reg, size);
+        if dst_mode == 1 {
+            self.a[usize::from(dst_reg)] = size.sign_extend(value);
+            return Ok(cycles);
+        }
+        let dst = self.ea(bus, dst_mode, dst_reg, size)?;
+        self.write_ea(bus, dst, size, value)?;
+        self.logic_flags(value, size);
+        // Predecrement costs no extra as a destination
+        let dst_mode = if dst_mode == 4 { 2 } else { dst_mode };
+        Ok(cycles + ea_cycles(dst_mode, dst_reg, size))
+    }
+
+    /// Line 4: everything else
+    fn group_misc(&mut self, bus: &mut impl Bus, op: u16) -> Result<u32, Fault> {
+        let (mode, reg) = (op >> 3 & 7, op & 7);
+        let r = usize::from(reg);
+        match op {
+            0x4E70 => {
+                self.supervisor()?;
+                return Ok(132);
+            }
+            0x4E71 => return Ok(4),
+            0x4E72 => {
+                self.supervisor()?;
+                let sr = self.fetch(bus)?;
+                self.set_sr(sr);
+                self.stopped = true;
+                return Ok(4);
+            }
+            0x4E73 => {
+                self.supervisor()?;
+                let sr = self.pop(bus, Size::Word)? as u16;
+                self.pc = self.pop(bus, Size::Long)?;
+                self.set_sr(sr);
+                self.flow = Flow::Return;
+                return Ok(20);
+            }
+            0x4E75 => {
+                self.pc = self.pop(bus, Size::Long)?;
+                self.flow = Flow::Return;
+                return Ok(16);
+            }
+            0x4E76 => {
+                if self.flag(V) {
+                    return Err(Fault::Trap {
+                        pc: self.inst_pc,
+                        vector: 7,
+                    });
+                }
+                return Ok(4);
+            }
+            0x4E77 => {
+                let ccr = self.pop(bus, Size::Word)? as u16;
+                self.pc = self.pop(bus, Size::Long)?;
+                self.set_flags(0x1F, ccr);
+                self.flow = Flow::Return;
+                return Ok(20);
+            }
+            _ => {}
+        }
+        match op & 0xFFF8 {
+            0x4E40 | 0x4E48 => {
+                return Err(Fault::Trap {
+                    pc: self.inst_pc,
+                    vector: 32 + (op & 0xF) as u8,
+                });
+            }
+            0x4E50 => {
+                let disp = self.fetch(bus)? as i16 as u32;
+                self.push(bus, Size::Long, self.a[r])?;
+                self.a[r] = self.a[7];
+                self.a[7] = self.a[7].wrapping_add(disp);
+                return Ok(16);
+            }
+            0x4E58 => {
+                self.a[7] = self.a[r];
+                self.a[r] = self.pop(bus, Size::Long)?;
+                return Ok(12);
+            }
+            0x4E60 => {
+                self.supervisor()?;
+                self.inactive_sp = self.a[r];
+                return Ok(4);
+            }
+            0x4E68 => {
+                self.supervisor()?;
+                self.a[r] = self.inactive_sp;
+                return Ok(4);
+            }
+            0x4840 => {
+                self.d[r] = self.d[r].rotate_left(16);
+                self.logic_flags(self.d[r], Size::Long);
+                return Ok(4);
+            }
+            0x4880 => {
+                let value = Size::Byte.sign_extend(self.d[r]);
+                self.d[r] = (self.d[r] & 0xFFFF_0000) | (value & 0xFFFF);
+                self.logic_flags(value, Size::Word);
+                return Ok(4);
+            }
+            0x48C0 => {
+                self.d[r] = Size::Word.sign_extend(self.d[r]);
+                self.logic_flags(self.d[r], Size::Long);
+                return Ok(4);
+            }
+            _ => {}
+        }
+        match op & 0xFFC0 {
+            0x4E80 => {
+                let target = self.control_address(bus, mode, reg)?;
+                self.push(bus, Size::Long, self.pc)?;
+                self.pc = target;
+                self.flow = Flow::Call(target);
+                return Ok(16 + control_cycles(mode, reg, (2, 6, 4)));
+            }
+            0x4EC0 => {
+                self.pc = self.control_address(bus, mode, reg)?;
+                return Ok(8 + control_cycles(mode, reg, (2, 6, 4)));
+            }
+            0x4840 => {
+                let addr = self.control_address(bus, mode, reg)?;
+                self.push(bus, Size::Long, addr)?;
+                return Ok(12 + control_cycles(mode, reg, (4, 8, 8)));
+            }
+            0x4880 | 0x48C0 | 0x4C80 | 0x4CC0 => return self.movem(bus, op),
+            0x40C0 => {
+                let ea = self.ea(bus, mode, reg, Size::Word)?;
+                self.write_ea(bus, ea, Size::Word, u32::from(self.sr))?;
+                return Ok(if mode == 0 {
+                    6
+                } else {
+                    8 + ea_cycles(mode, reg, Size::Word)
+                });
+            }
+            0x44C0 | 0x46C0 => {
+                let to_sr = op & 0x0200 != 0;
+                if to_sr {
+                    self.supervisor()?;
+                }
+                let ea = self.ea(bus, mode, reg, Size::Word)?;
+                let value = self.read_ea(bus, ea, Size::Word)? as u16;
+                if to_sr {
+                    self.set_sr(value);
+                } else {
+                    self.set_flags(0x1F, value);
+                }
+                return Ok(12 + ea_cycles(mode, reg, Size::Word));
+            }
+            0x4AC0 if op != 0x4AFC => {
+                let ea = self.ea(bus, mode, reg, Size::Byte)?;
+                let value = self.read_ea(bus, ea, Size::Byte)?;
+                self.logic_flags(value, Size::Byte);
+                self.write_ea(bus, ea, Size::Byte, value | 0x80)?;
+                return Ok(if mode == 0 {
+                    4
+                } else {
+                    14 + ea_cycles(mode, reg, Size::Byte)
+                });
+            }
+            _ => {}
+        }
+        if op & 0xF1C0 == 0x41C0 {
+            let addr = self.control_address(bus, mode, reg)?;
+            self.a[usize::from(op >> 9 & 7)] = addr;
+            return Ok(4 + control_cycles(mode, reg, (4, 8, 8)));
+        }
+        // Single-operand NEGX, CLR, NEG, NOT, TST
+        let kind = op >> 8 & 0xF;
+        let Some(size) = Size::from_bits(op >> 6) else {
+            return Err(self.illegal());
+        };
+        if !matches!(kind, 0x0 | 0x2 | 0x4 | 0x6 | 0xA) {
+            return Err(self.illegal());
+        }
+        let ea = self.ea(bus, mode, reg, size)?;
+        let value = self.read_ea(bus, ea, size)?;
+        let result = match kind {
+            0x0 => {
+                let extend = self.flag(X);
+                self.sub(value, 0, extend, true, size)
+            }
+            0x2 => {
+                self.logic_flags(0, size);
+                0
+            }
+            0x4 => self.sub(value, 0, false, false, size),
+            0x6 => {
+                self.logic_flags(!value, size);
+                !value
+            }
+            _ => {
+                self.logic_flags(value, size);
+                return Ok(4 + ea_cycles(mode, reg, size));
+            }
+        };
+        self.write_ea(bus, ea, size, result)?;
+        Ok(read_modify_write(size, mode, reg, (4, 6)))
+    }
+
+    fn movem(&mut self, bus: &mut impl Bus, op: u16) -> Result<u32, Fault> {
+        let (mode, reg) = (op >> 3 & 7, op & 7);
+        let r = usize::from(reg);
+        let size = if op & 0x40 != 0 {
+            Size::Long
+        } else {
+            Size::Word
+        };
+        let mask = self.fetch(bus)?;
+        let per_register = if size == Size::Long { 8 } else { 4 };
+        let count = mask.count_ones();
+        if op & 0x0400 == 0 {
+            // Registers to memory; for -(An) the mask runs from A7 down to D0
+            if mode == 4 {
+                let mut addr = self.a[r];
+                for i in (0..16).filter(|i| mask & 1 << i != 0) {
+                    addr = addr.wrapping_sub(size.bytes());
+                    let value = if i < 8 { self.a[7 - i] } else { self.d[15 - i] };
+                    self.write(bus, addr, size, value)?;
+                }
+                self.a[r] = addr;
+            } else {
+                let mut addr = self.control_address(bus, mode, reg)?;
+                for i in (0..16).filter(|i| mask & 1 << i != 0) {
+                    let value = if i < 8 { self.d[i] } else { self.a[i - 8] };
+                    self.write(bus, addr, size, value)?;
+                    addr = addr.wrapping_add(size.bytes());
+                }
+            }
+            Ok(8 + control_cycles(mode, reg, (4, 6, 8)) + per_register * count)
+        } else {
+            // Memory to registers, sign-extending words
+            let mut addr = if mode == 3 {
+                self.a[r]
+            } else {
+                self.control_address(bus, mode, reg)?
+            };
+            for i in (0..16).filter(|i| mask & 1 << i != 0) {
+                let value = size.sign_extend(self.read(bus, addr, size)?);
+                if i < 8 {
+                    self.d[i] = value;
+                } else {
+                    self.a[i - 8] = value;
+                }
+                addr = addr.wrapping_add(size.bytes());
+            }
+            if mode == 3 {
+                self.a[r] = addr;
+            }
+            Ok(12 + control_cycles(mode, reg, (4, 6, 8)) + per_register * count)
+        }
+    }
+
+    /// Line 5: `ADDQ`, `SUBQ`, `Scc`, `DBcc`
+    fn group_quick(&mut self, bus: &mut impl Bus, op: u16) -> Result<u32, Fault> {
+        let (mode, reg) = (op >> 3 & 7, op & 7);
+        let r = usize::from(reg);
+        let Some(size) = Size::from_bits(op >> 6) else {
+            let cc = op >> 8 & 0xF;
+            if mode == 1 {
+                let disp = self.fetch(bus)? as i16 as u32;
+                if self.condition(cc) {
+                    return Ok(12);
+                }
+                let counter = (self.d[r] as u16).wrapping_sub(1);
+                self.d[r] = (self.d[r] & 0xFFFF_0000) | u32::from(counter);
+                if counter == 0xFFFF {
+                    return Ok(14);
+                }
+                self.pc = self.inst_pc.wrapping_add(2).wrapping_add(disp);
+                return Ok(10);
+            }
+            let set = self.condition(cc);
+            let ea = self.ea(bus, mode, reg, Size::Byte)?;
+            self.write_ea(bus, ea, Size::Byte, if set { 0xFF } else { 0 })?;
+            return Ok(if mode == 0 {
+                if set { 6 } else { 4 }
+            } else {
+                8 + ea_cycles(mode, reg, Size::Byte)
+            });
+        };
+        let data = match op >> 9 & 7 {
+            0 => 8,
+            n => u32::from(n),
+        };
+        let subtract = op & 0x0100 != 0;
+        if mode == 1 {
+            self.a[r] = if subtract {
+                self.a[r].wrapping_sub(data)
+            } else {
+                self.a[r].wrapping_add(data)
+            };
+            return Ok(8);
+        }
+        let ea = self.ea(bus, mode, reg, size)?;
+        let dst = self.read_ea(bus, ea, size)?;
+        let result = if subtract {
+            self.sub(data, dst, false, false, size)
+        } else {
+            self.add(data, dst, false, false, size)
+        };
+        self.write_ea(bus, ea, size, result)?;
+        Ok(read_modify_write(size, mode, reg, (4, 8)))
+    }
+
+    /// Line 6: `BRA`, `BSR`, `Bcc`
+    fn op_branch(&mut self, bus: &mut impl Bus, op: u16) -> Result<u32, Fault> {
+        let base = self.pc;
+        let (disp, short) = match op as u8 {
+            0 => (self.fetch(bus)? as i16 as u32, false),
+            disp => (disp as i8 as u32, true),
+        };
+        let target = base.wrapping_add(disp);
+        match op >> 8 & 0xF {
+            0 => {
+                self.pc = target;
+                Ok(10)
+            }
+            1 => {
+                self.push(bus, Size::Long, self.pc)?;
+                self.pc = target;
+                self.flow = Flow::Call(target);
+                Ok(18)
+            }
+            cc if self.condition(cc) => {
+                self.pc = target;
+                Ok(10)
+            }
+            _ => Ok(if short { 8 } else { 12 }),
+        }
+    }
+
+    /// Lines 8, 9, B, C and D: the two-operand arithmetic and logic
+    fn group_arithmetic(&mut self, bus: &mut impl Bus, op: u16) -> Result<u32, Fault> {
+        let line = op >> 12;
+        let (mode, reg) = (op >> 3 & 7, op & 7);
+        let rx = usize::from(op >> 9 & 7);
+        let opmode = op >> 6 & 7;
+        match (line, opmode) {
+            (0x8, 3 | 7) => return self.divide(bus, op, opmode == 7),
+            (0xC, 3 | 7) => return self.multiply(bus, op, opmode == 7),
+            (0x9 | 0xB | 0xD, 3 | 7) => return self.address_arithmetic(bus, op),
+            _ => {}
+        }
+        let size = Size::from_bits(opmode).ok_or_else(|| self.illegal())?;
+        let long = size == Size::Long;
+        let to_ea = opmode & 4 != 0;
+        if line == 0xB {
+            if !to_ea {
+                let ea = self.ea(bus, mode, reg, size)?;
+                let src = self.read_ea(bus, ea, size)?;
+                self.compare(src, self.d[rx], size);
+                return Ok(ea_cycles(mode, reg, size) + if long { 6 } else { 4 });
+            }
+            if mode == 1 {
+                let src = self.ea(bus, 3, reg, size)?;
+                let src = self.read_ea(bus, src, size)?;
+                let dst = self.ea(bus, 3, rx as u16, size)?;
+                let dst = self.read_ea(bus, dst, size)?;
+                self.compare(src, dst, size);
+                return Ok(if long { 20 } else { 12 });
+            }
+            let ea = self.ea(bus, mode, reg, size)?;
+            let result = self.read_ea(bus, ea, size)? ^ self.d[rx];
+            self.logic_flags(result, size);
+            self.write_ea(bus, ea, size, result)?;
+            return Ok(read_modify_write(size, mode, reg, (4, 8)));
+        }
+        if to_ea && mode <= 1 {
+            return self.register_forms(bus, op, size);
+        }
+        let ea = self.ea(bus, mode, reg, size)?;
+        let (src, dst) = if to_ea {
+            (self.d[rx], self.read_ea(bus, ea, size)?)
+        } else {
+            (self.read_ea(bus, ea, size)?, self.d[rx])
+        };
+        let result = match line {
+            0x8 | 0xC => {
+                let result = if line == 0x8 { src | dst } else { src & dst };
+                self.logic_flags(result, size);
+                result
+            }
+            0x9 => self.sub(src, dst, false, false, size),
+            _ => self.add(src, dst, false, false, size),
+        };
+        if to_ea {
+            self.write_ea(bus, ea, size, result)?;
+            Ok(read_modify_write(size, mode, reg, (4, 8)))
+        } else {
+            self.write_ea(bus, Ea::Data(rx), size, result)?;
+            let long_time = if register_or_immediate(mode, reg) {
+                8
+            } else {
+                6
+            };
+            Ok(ea_cycles(mode, reg, size) + if long { long_time } else { 4 })
+        }
+    }
+
+    /// `ADDX`, `SUBX` and `EXG`, which sit where a register destination of
+    /// `ADD`, `SUB` and `AND` would
+    fn register_forms(&mut self, bus: &mut impl Bus, op: u16, size: Size) -> Result<u32, Fault> {
+        let line = op >> 12;
+        let (mode, reg) = (op >> 3 & 7, op & 7);
+        let (rx, ry) = (usize::from(op >> 9 & 7), usize::from(reg));
+        match (line, op & 0x01F8) {
+            (0xC, 0x0140) => {
+                self.d.swap(rx, ry);
+                Ok(6)
+            }
+            (0xC, 0x0148) => {
+                self.a.swap(rx, ry);
+                Ok(6)
+            }
+            (0xC, 0x0188) => {
+                std::mem::swap(&mut self.d[rx], &mut self.a[ry]);
+                Ok(6)
+            }
+            (0x9 | 0xD, _) => {
+                let (src, dst) = if mode == 0 {
+                    (Ea::Data(ry), Ea::Data(rx))
+                } else {
+                    (
+                        self.ea(bus, 4, reg, size)?,
+                        self.ea(bus, 4, rx as u16, size)?,
+                    )
+                };
+                let src = self.read_ea(bus, src, size)?;
+                let value = self.read_ea(bus, dst, size)?;
+                let extend = self.flag(X);
+                let result = if line == 0x9 {
+                    self.sub(src, value, extend, true, size)
+                } else {
+                    self.add(src, value, extend, true, size)
+                };
+                self.write_ea(bus, dst, size, result)?;
+                let long = size == Size::Long;
+                Ok(match (mode, long) {
+                    (0, false) => 4,
+                    (0, true) => 8,
+                    (_, false) => 18,
+                    (_, true) => 30,
+                })
+            }
+            _ => Err(self.illegal()),
+        }
+    }
+
+    /// `ADDA`, `SUBA`, `CMPA`
+    fn address_arithmetic(&mut self, bus: &mut impl Bus, op: u16) -> Result<u32, Fault> {
+        let (mode, reg) = (op >> 3 & 7, op & 7);
+        let rx = usize::from(op >> 9 & 7);
+        let size = if op & 0x0100 != 0 {
+            Size::Long
+        } else {
+            Size::Word
+        };
+        let ea = self.ea(bus, mode, reg, size)?;
+        let src = size.sign_extend(self.read_ea(bus, ea, size)?);
+        let ea_time = ea_cycles(mode, reg, size);
+        match op >> 12 {
+            0xB => {
+                self.compare(src, self.a[rx], Size::Long);
+                return Ok(6 + ea_time);
+            }
+            0x9 => self.a[rx] = self.a[rx].wrapping_sub(src),
+            _ => self.a[rx] = self.a[rx].wrapping_add(src),
+        }
+        let long_from_memory = size == Size::Long && !register_or_immediate(mode, reg);
+        Ok(ea_time + if long_from_memory { 6 } else { 8 })
+    }
+
+    fn multiply(&mut self, bus: &mut impl Bus, op: u16, signed: bool) -> Result<u32, Fault> {
+        let (mode, reg) = (op >> 3 & 7, op & 7);
+        let rx = usize::from(op >> 9 & 7);
+        let ea = self.ea(bus, mode, reg, Size::Word)?;
+        let src = self.read_ea(bus, ea, Size::Word)?;
+        let dst = self.d[rx] & 0xFFFF;
+        // One step per set bit of an unsigned multiplier, per 01/10 pair of
+        // a signed one
+        let (result, steps) = if signed {
+            let product = Size::Word
+                .sign_extend(src)
+                .wrapping_mul(Size::Word.sign_extend(dst));
+            let bits = src << 1;
+            (product, ((bits ^ (bits >> 1)) & 0xFFFF).count_ones())
+        } else {
+            (src * dst, src.count_ones())
+        };
+        self.d[rx] = result;
+        self.logic_flags(result, Size::Long);
+        Ok(38 + 2 * steps + ea_cycles(mode, reg, Size::Word))
+    }
+
+    fn divide(&mut self, bus: &mut impl Bus, op: u16, signed: bool) -> Result<u32, Fault> {
+        let (mode, reg) = (op >> 3 & 7, op & 7);
+        let rx = usize::from(op >> 9 & 7);
+        let ea = self.ea(bus, mode, reg, Size::Word)?;
+        let divisor = self.read_ea(bus, ea, Size::Word)?;
+        if divisor == 0 {
+            return Err(Fault::DivideByZero { pc: self.inst_pc });
+        }
+        let dividend = self.d[rx];
+        let (quotient, remainder, cycles) = if signed {
+            let divisor = divisor as u16 as i16;
+            let dividend = dividend as i32;
+            let quotient = i64::from(dividend) / i64::from(divisor);
+            let remainder = i64::from(dividend) % i64::from(divisor);
+            let cycles = divs_cycles(dividend, divisor);
+            let fits = i16::try_from(quotient).is_ok();
+            (fits.then_some(quotient as u32), remainder as u32, cycles)
+        } else {
+            let quotient = dividend / divisor;
+            let cycles = divu_cycles(dividend, divisor as u16);
+            (
+                (quotient <= 0xFFFF).then_some(quotient),
+                dividend % divisor,
+                cycles,
+            )
+        };
+        match quotient {
+            Some(quotient) => {
+                self.d[rx] = (remainder & 0xFFFF) << 16 | (quotient & 0xFFFF);
+                self.logic_flags(quotient, Size::Word);
+            }
+            // Overflow leaves the register alone
+            None => self.set_flags(V | C, V),
+        }
+        Ok(cycles + ea_cycles(mode, reg, Size::Word))
+    }
+
+    /// Line E: shifts and rotates
+    fn group_shift(&mut self, bus: &mut impl Bus, op: u16) -> Result<u32, Fault> {
+        let (mode, reg) = (op >> 3 & 7, op & 7);
+        let left = op & 0x0100 != 0;
+        let Some(size) = Size::from_bits(op >> 6) else {
+            // One bit of a word in memory
+            if op & 0x0800 != 0 {
+                return Err(self.illegal());
+            }
+            let ea = self.ea(bus, mode, reg, Size::Word)?;
+            let value = self.read_ea(bus, ea, Size::Word)?;
+            let result = self.shift(op >> 9 & 3, left, value, 1, Size::Word);
+            self.write_ea(bus, ea, Size::Word, result)?;
+            return Ok(8 + ea_cycles(mode, reg, Size::Word));
+        };
+        let count = if op & 0x20 != 0 {
+            self.d[usize::from(op >> 9 & 7)] & 63
+        } else {
+            match op >> 9 & 7 {
+                0 => 8,
+                n => u32::from(n),
+            }
+        };
+        let r = usize::from(reg);
+        let result = self.shift(op >> 3 & 3, left, self.d[r], count, size);
+        self.write_ea(bus, Ea::Data(r), size, result)?;
+        Ok(2 * count + if size == Size::Long { 8 } else { 6 })
+    }
+
+    /// Shift `value` `count` times. `kind` is 0 for arithmetic, 1 logical,
+    /// 2 rotate through X and 3 rotate.
+    fn shift(&mut self, kind: u16, left: bool, value: u32, count: u32, size: Size) -> u32 {
+        let msb = size.msb();
+        let mut value = value & size.mask();
+        let mut x = self.flag(X);
+        let mut carry = false;
+        let mut overflow = false;
+        for _ in 0..count {
+            if left {
+                carry = value & msb != 0;
+                let fill = match kind {
+                    2 => x,
+                    3 => carry,
+                    _ => false,
+                };
+                value = ((value << 1) | u32::from(fill)) & size.mask();
+                // ASL sets V if the sign bit changes along the way
+                overflow |= kind == 0 && (value & msb != 0) != carry;
+            } else {
+                carry = value & 1 != 0;
+                let fill = match kind {
+                    0 => value & msb != 0,
+                    2 => x,
+                    3 => carry,
+                    _ => false,
+                };
+                value = (value >> 1) | if fill { msb } else { 0 };
+            }
+            if kind != 3 {
+                x = carry;
+            }
+        }
+        let mut flags = Self::nz(value, size);
+        if overflow {
+            flags |= V;
+        }
+        if count == 0 {
+            // Only ROXd copies X to C with no shift
+            if kind == 2 && x {
+                flags |= C;
+            }
+            self.set_flags(N | Z | V | C, flags);
+        } else {
+            if carry {
+                flags |= C;
+            }
+            if kind == 3 {
+                self.set_flags(N | Z | V | C, flags);
+            } else {
+                if x {
+                    flags |= X;
+                }
+                self.set_flags(N | Z | V | C | X, flags);
+            }
+        }
+        value
+    }
+}
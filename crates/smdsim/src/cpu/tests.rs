@@ -0,0 +1,422 @@
+use super::*;
+use smd_compiler::backend::m68k::{
+    self as asm, AddrReg, Assembler, Cond, DataReg, M68kInst, Operand, Reg, instruction_cycles,
+};
+
+const ORIGIN: u32 = 0x100;
+const STACK: u32 = 0x8000;
+const DATA: u32 = 0x4000;
+
+/// 64 KB of RAM at address 0, mirrored
+struct Ram(Vec<u8>);
+
+impl Bus for Ram {
+    fn read_byte(&mut self, addr: u32) -> u8 {
+        self.0[addr as usize & 0xFFFF]
+    }
+
+    fn read_word(&mut self, addr: u32) -> u16 {
+        u16::from_be_bytes([self.read_byte(addr), self.read_byte(addr + 1)])
+    }
+
+    fn write_byte(&mut self, addr: u32, value: u8) {
+        self.0[addr as usize & 0xFFFF] = value;
+    }
+
+    fn write_word(&mut self, addr: u32, value: u16) {
+        let [high, low] = value.to_be_bytes();
+        self.write_byte(addr, high);
+        self.write_byte(addr + 1, low);
+    }
+}
+
+/// Assemble `insts` at `ORIGIN` and run them to the end; returns the CPU,
+/// memory, and each instruction's clock periods
+fn run(insts: &[M68kInst]) -> Result<(Cpu, Ram, Vec<u32>), Fault> {
+    let code = Assembler::new(ORIGIN).assemble(insts).unwrap();
+    let mut ram = Ram(vec![0; 0x10000]);
+    ram.0[..4].copy_from_slice(&STACK.to_be_bytes());
+    ram.0[4..8].copy_from_slice(&ORIGIN.to_be_bytes());
+    let start = ORIGIN as usize;
+    ram.0[start..start + code.len()].copy_from_slice(&code);
+    let end = ORIGIN + code.len() as u32;
+    let mut cpu = Cpu::new(&mut ram)?;
+    let mut cycles = Vec::new();
+    while cpu.pc != end {
+        cycles.push(cpu.step(&mut ram)?);
+        assert!(cycles.len() < 10_000, "runaway program");
+    }
+    Ok((cpu, ram, cycles))
+}
+
+fn d(n: u8) -> Operand {
+    Operand::DataReg(data_reg(n))
+}
+
+fn data_reg(n: u8) -> DataReg {
+    [
+        DataReg::D0,
+        DataReg::D1,
+        DataReg::D2,
+        DataReg::D3,
+        DataReg::D4,
+        DataReg::D5,
+        DataReg::D6,
+        DataReg::D7,
+    ][usize::from(n)]
+}
+
+fn imm(value: i32) -> Operand {
+    Operand::Imm(value)
+}
+
+#[test]
+fn test_move_and_add_flags() {
+    let (cpu, _, _) = run(&[
+        M68kInst::Move(asm::Size::Long, imm(0x7FFF_FFFF), d(0)),
+        M68kInst::Addq(asm::Size::Long, 1, d(0)),
+    ])
+    .unwrap();
+    assert_eq!(cpu.d[0], 0x8000_0000);
+    assert_eq!(cpu.sr() & 0x1F, N | V);
+
+    let (cpu, _, _) = run(&[
+        M68kInst::Moveq(1, data_reg(0)),
+        M68kInst::Sub(asm::Size::Byte, imm(2), d(0)),
+    ])
+    .unwrap();
+    assert_eq!(cpu.d[0], 0xFF);
+    assert_eq!(cpu.sr() & 0x1F, X | N | C);
+
+    // Word operations leave the high half alone
+    let (cpu, _, _) = run(&[
+        M68kInst::Move(asm::Size::Long, imm(0x1234_FFFF), d(1)),
+        M68kInst::Addq(asm::Size::Word, 1, d(1)),
+    ])
+    .unwrap();
+    assert_eq!(cpu.d[1], 0x1234_0000);
+    assert_eq!(cpu.sr() & 0x1F, X | Z | C);
+}
+
+#[test]
+fn test_compare_and_branch() {
+    let (cpu, _, _) = run(&[
+        M68kInst::Moveq(-5, data_reg(0)),
+        M68kInst::Moveq(0, data_reg(1)),
+        M68kInst::Cmp(asm::Size::Long, imm(3), d(0)),
+        M68kInst::Bcc(Cond::Lt, "less".into()),
+        M68kInst::Moveq(1, data_reg(1)),
+        M68kInst::Label("less".into()),
+        M68kInst::Cmp(asm::Size::Long, imm(3), d(0)),
+        M68kInst::Bcc(Cond::Cs, "end".into()),
+        M68kInst::Moveq(2, data_reg(1)),
+        M68kInst::Label("end".into()),
+    ])
+    .unwrap();
+    // Signed less, but not unsigned
+    assert_eq!(cpu.d[1], 2);
+}
+
+#[test]
+fn test_dbf_loop_timing() {
+    let (cpu, _, cycles) = run(&[
+        M68kInst::Moveq(3, data_reg(0)),
+        M68kInst::Label("loop".into()),
+        M68kInst::Dbf(data_reg(0), "loop".into()),
+    ])
+    .unwrap();
+    assert_eq!(cpu.d[0], 0xFFFF);
+    assert_eq!(cycles, [4, 10, 10, 10, 14]);
+}
+
+#[test]
+fn test_calls_and_stack() {
+    let (cpu, _, _) = run(&[
+        M68kInst::Bsr("function".into()),
+        M68kInst::Bra("end".into()),
+        M68kInst::Label("function".into()),
+        M68kInst::Link(AddrReg::A6, -8),
+        M68kInst::Move(asm::Size::Long, imm(42), Operand::Disp(-4, AddrReg::A6)),
+        M68kInst::Move(asm::Size::Long, Operand::Disp(-4, AddrReg::A6), d(0)),
+        M68kInst::Unlk(AddrReg::A6),
+        M68kInst::Rts,
+        M68kInst::Label("end".into()),
+    ])
+    .unwrap();
+    assert_eq!(cpu.d[0], 42);
+    assert_eq!(cpu.a[7], STACK);
+}
+
+#[test]
+fn test_flow() {
+    let code = Assembler::new(ORIGIN)
+        .assemble(&[
+            M68kInst::Bsr("function".into()),
+            M68kInst::Nop,
+            M68kInst::Label("function".into()),
+            M68kInst::Rts,
+        ])
+        .unwrap();
+    let mut ram = Ram(vec![0; 0x10000]);
+    ram.0[..4].copy_from_slice(&STACK.to_be_bytes());
+    ram.0[4..8].copy_from_slice(&ORIGIN.to_be_bytes());
+    ram.0[ORIGIN as usize..ORIGIN as usize + code.len()].copy_from_slice(&code);
+    let mut cpu = Cpu::new(&mut ram).unwrap();
+    cpu.step(&mut ram).unwrap();
+    assert_eq!(cpu.flow, Flow::Call(cpu.pc));
+    cpu.step(&mut ram).unwrap();
+    assert_eq!(cpu.flow, Flow::Return);
+    cpu.step(&mut ram).unwrap();
+    assert_eq!(cpu.flow, Flow::Sequential);
+}
+
+#[test]
+fn test_movem_round_trip() {
+    let regs = vec![
+        Reg::Data(DataReg::D2),
+        Reg::Data(DataReg::D3),
+        Reg::Addr(AddrReg::A2),
+    ];
+    let (cpu, ram, cycles) = run(&[
+        M68kInst::Moveq(2, data_reg(2)),
+        M68kInst::Moveq(3, data_reg(3)),
+        M68kInst::Lea(Operand::AbsShort(0x1234), AddrReg::A2),
+        M68kInst::Movem(
+            asm::Size::Long,
+            regs.clone(),
+            Operand::PreDec(AddrReg::A7),
+            true,
+        ),
+        M68kInst::Moveq(0, data_reg(2)),
+        M68kInst::Moveq(0, data_reg(3)),
+        M68kInst::Movem(asm::Size::Long, regs, Operand::PostInc(AddrReg::A7), false),
+    ])
+    .unwrap();
+    assert_eq!((cpu.d[2], cpu.d[3], cpu.a[2]), (2, 3, 0x1234));
+    assert_eq!(cpu.a[7], STACK);
+    // Lowest register at the lowest address
+    assert_eq!(
+        &ram.0[STACK as usize - 12..STACK as usize - 8],
+        &[0, 0, 0, 2]
+    );
+    assert_eq!(cycles[3], 8 + 3 * 8);
+    assert_eq!(cycles[6], 12 + 3 * 8);
+}
+
+#[test]
+fn test_multiply_and_divide() {
+    let (cpu, _, cycles) = run(&[
+        M68kInst::Move(asm::Size::Long, imm(1000), d(0)),
+        M68kInst::Mulu(imm(0x0F0F), data_reg(0)),
+        M68kInst::Moveq(-3, data_reg(1)),
+        M68kInst::Muls(imm(7), data_reg(1)),
+        M68kInst::Move(asm::Size::Long, imm(100_001), d(2)),
+        M68kInst::Divu(imm(10), data_reg(2)),
+        M68kInst::Moveq(-7, data_reg(3)),
+        M68kInst::Divs(imm(2), data_reg(3)),
+    ])
+    .unwrap();
+    assert_eq!(cpu.d[0], 1000 * 0x0F0F);
+    assert_eq!(cycles[1], 38 + 2 * 8 + 4);
+    assert_eq!(cpu.d[1], (-21_i32) as u32);
+    // 7 is 0111: the 0-1 and 1-0 boundaries, counting a 0 below bit 0
+    assert_eq!(cycles[3], 38 + 2 * 2 + 4);
+    // 100001 / 10 = 10000 remainder 1
+    assert_eq!(cpu.d[2], 1 << 16 | 10_000);
+    // -7 / 2 = -3 remainder -1
+    assert_eq!(cpu.d[3], 0xFFFF_FFFD);
+    assert!(cycles[5] <= 140 + 4 && cycles[5] >= 76 + 4);
+    assert!(cycles[7] <= 158 + 4 && cycles[7] >= 120 + 4);
+
+    // Overflow sets V and keeps the dividend
+    let (cpu, _, _) = run(&[
+        M68kInst::Move(asm::Size::Long, imm(0x0010_0000), d(0)),
+        M68kInst::Divu(imm(1), data_reg(0)),
+    ])
+    .unwrap();
+    assert_eq!(cpu.d[0], 0x0010_0000);
+    assert_eq!(cpu.sr() & V, V);
+
+    let fault = run(&[
+        M68kInst::Moveq(0, data_reg(1)),
+        M68kInst::Divu(d(1), data_reg(0)),
+    ])
+    .err()
+    .unwrap();
+    assert_eq!(fault, Fault::DivideByZero { pc: ORIGIN + 2 });
+}
+
+#[test]
+fn test_shifts() {
+    let (cpu, _, cycles) = run(&[
+        M68kInst::Move(asm::Size::Long, imm(0x4000_0001), d(0)),
+        M68kInst::Asl(asm::Size::Long, imm(1), data_reg(0)),
+    ])
+    .unwrap();
+    assert_eq!(cpu.d[0], 0x8000_0002);
+    assert_eq!(cpu.sr() & 0x1F, N | V);
+    assert_eq!(cycles[1], 8 + 2);
+
+    let (cpu, _, _) = run(&[
+        M68kInst::Moveq(-127, data_reg(0)),
+        M68kInst::Asr(asm::Size::Byte, imm(1), data_reg(0)),
+    ])
+    .unwrap();
+    assert_eq!(cpu.d[0] & 0xFF, 0xC0);
+    assert_eq!(cpu.sr() & 0x1F, X | N | C);
+
+    let (cpu, _, cycles) = run(&[
+        M68kInst::Moveq(1, data_reg(0)),
+        M68kInst::Moveq(12, data_reg(1)),
+        M68kInst::Ror(asm::Size::Word, d(1), data_reg(0)),
+        M68kInst::Lsr(asm::Size::Long, imm(8), data_reg(0)),
+    ])
+    .unwrap();
+    assert_eq!(cycles[2], 6 + 2 * 12);
+    assert_eq!(cpu.d[0], 0x10 >> 8);
+    assert_eq!(cpu.sr() & Z, Z);
+}
+
+#[test]
+fn test_bit_operations() {
+    let a0 = Operand::AddrInd(AddrReg::A0);
+    let (cpu, ram, _) = run(&[
+        M68kInst::Lea(Operand::AbsShort(DATA as i16), AddrReg::A0),
+        M68kInst::Bset(imm(3), a0.clone()),
+        M68kInst::Btst(imm(3), a0.clone()),
+        M68kInst::Scc(Cond::Ne, d(1)),
+        M68kInst::Bchg(imm(7), a0.clone()),
+        M68kInst::Bclr(imm(11), a0.clone()),
+        M68kInst::Btst(imm(3), a0),
+        M68kInst::Scc(Cond::Ne, d(2)),
+    ])
+    .unwrap();
+    assert_eq!(cpu.d[1] & 0xFF, 0xFF);
+    // Memory bit numbers wrap at 8
+    assert_eq!(ram.0[DATA as usize], 0x80);
+    assert_eq!(cpu.d[2] & 0xFF, 0);
+}
+
+#[test]
+fn test_address_error() {
+    let fault = run(&[
+        M68kInst::Lea(Operand::AbsShort(0x4001), AddrReg::A0),
+        M68kInst::Move(asm::Size::Word, Operand::AddrInd(AddrReg::A0), d(0)),
+    ])
+    .err()
+    .unwrap();
+    assert_eq!(
+        fault,
+        Fault::AddressError {
+            pc: ORIGIN + 4,
+            addr: 0x4001
+        }
+    );
+}
+
+#[test]
+fn test_interrupt() {
+    let mut ram = Ram(vec![0; 0x10000]);
+    ram.0[..4].copy_from_slice(&STACK.to_be_bytes());
+    ram.0[4..8].copy_from_slice(&ORIGIN.to_be_bytes());
+    ram.0[0x78..0x7C].copy_from_slice(&0x200_u32.to_be_bytes());
+    let mut cpu = Cpu::new(&mut ram).unwrap();
+    // Masked at level 7 out of reset
+    assert_eq!(cpu.interrupt(&mut ram, 6).unwrap(), None);
+    cpu.set_sr(0x2000);
+    assert_eq!(cpu.interrupt(&mut ram, 6).unwrap(), Some(44));
+    assert_eq!(cpu.pc, 0x200);
+    assert_eq!(cpu.flow, Flow::Interrupt(0x200));
+    assert_eq!(cpu.sr() & 0x0700, 0x0600);
+    // RTE restores the mask and the return address
+    ram.write_word(0x200, 0x4E73);
+    assert_eq!(cpu.step(&mut ram).unwrap(), 20);
+    assert_eq!((cpu.pc, cpu.sr()), (ORIGIN, 0x2000));
+}
+
+/// Instructions whose timing doesn't depend on their data run in exactly
+/// the clock periods the static model gives them
+#[test]
+fn test_cycles_match_static_model() {
+    use asm::Size::{Byte, Long, Word};
+    let a0 = Operand::AddrInd(AddrReg::A0);
+    let insts = vec![
+        M68kInst::Lea(Operand::AbsLong(DATA), AddrReg::A0),
+        M68kInst::Lea(Operand::Disp(16, AddrReg::A0), AddrReg::A1),
+        M68kInst::Lea(Operand::Indexed(2, AddrReg::A0, DataReg::D7), AddrReg::A2),
+        M68kInst::Moveq(5, data_reg(0)),
+        M68kInst::Move(Word, d(0), d(1)),
+        M68kInst::Move(Long, imm(0x1234_5678), a0.clone()),
+        M68kInst::Move(Long, a0.clone(), Operand::Disp(4, AddrReg::A0)),
+        M68kInst::Move(
+            Word,
+            Operand::PostInc(AddrReg::A0),
+            Operand::PreDec(AddrReg::A1),
+        ),
+        M68kInst::Move(Byte, Operand::AbsLong(DATA), Operand::AbsShort(DATA as i16)),
+        M68kInst::Move(
+            Long,
+            Operand::AbsShort(DATA as i16),
+            Operand::AddrReg(AddrReg::A3),
+        ),
+        M68kInst::Move(Word, Operand::Indexed(0, AddrReg::A0, DataReg::D7), d(2)),
+        M68kInst::Add(Long, d(0), d(1)),
+        M68kInst::Add(Long, a0.clone(), d(1)),
+        M68kInst::Add(Word, d(0), a0.clone()),
+        M68kInst::Sub(Long, d(0), Operand::Disp(2, AddrReg::A0)),
+        M68kInst::And(Word, imm(0xFF), d(1)),
+        M68kInst::Or(Long, a0.clone(), d(1)),
+        M68kInst::Eor(Long, data_reg(0), d(1)),
+        M68kInst::Adda(Long, d(0), AddrReg::A3),
+        M68kInst::Suba(Word, a0.clone(), AddrReg::A3),
+        M68kInst::Adda(Long, a0.clone(), AddrReg::A3),
+        M68kInst::Addq(Long, 4, Operand::AddrReg(AddrReg::A0)),
+        M68kInst::Addq(Word, 1, a0.clone()),
+        M68kInst::Subq(Long, 8, d(3)),
+        M68kInst::Addi(Long, 1000, d(3)),
+        M68kInst::Addi(Word, 1000, a0.clone()),
+        M68kInst::Andi(Long, 0xFFFF, d(3)),
+        M68kInst::Ori(Byte, 1, Operand::Disp(1, AddrReg::A0)),
+        M68kInst::Cmp(Long, imm(4), d(0)),
+        M68kInst::Cmpa(Long, d(0), AddrReg::A0),
+        M68kInst::Cmpi(Word, 3, a0.clone()),
+        M68kInst::Cmpi(Long, 3, d(0)),
+        M68kInst::Tst(Long, a0.clone()),
+        M68kInst::Tst(Byte, d(0)),
+        M68kInst::Clr(Long, d(4)),
+        M68kInst::Clr(Word, a0.clone()),
+        M68kInst::Neg(Long, d(4)),
+        M68kInst::Not(Byte, a0.clone()),
+        M68kInst::Ext(Long, data_reg(0)),
+        M68kInst::Swap(data_reg(0)),
+        M68kInst::Exg(Reg::Data(DataReg::D0), Reg::Addr(AddrReg::A4)),
+        M68kInst::Lsl(Word, imm(3), data_reg(0)),
+        M68kInst::Lsr(Long, imm(8), data_reg(0)),
+        M68kInst::Btst(imm(2), d(0)),
+        M68kInst::Btst(d(0), a0.clone()),
+        M68kInst::Bset(d(1), a0.clone()),
+        M68kInst::Pea(Operand::Disp(8, AddrReg::A0)),
+        M68kInst::Move(Long, Operand::PostInc(AddrReg::A7), d(5)),
+        M68kInst::Link(AddrReg::A6, -4),
+        M68kInst::Unlk(AddrReg::A6),
+        M68kInst::Movem(
+            Long,
+            vec![Reg::Data(DataReg::D2), Reg::Addr(AddrReg::A2)],
+            Operand::PreDec(AddrReg::A7),
+            true,
+        ),
+        M68kInst::Movem(
+            Long,
+            vec![Reg::Data(DataReg::D2), Reg::Addr(AddrReg::A2)],
+            Operand::PostInc(AddrReg::A7),
+            false,
+        ),
+        M68kInst::Mulu(imm(0x8421), data_reg(1)),
+        M68kInst::Nop,
+    ];
+    let (_, _, cycles) = run(&insts).unwrap();
+    let expected: Vec<u32> = insts.iter().map(instruction_cycles).collect();
+    for (inst, (got, want)) in insts.iter().zip(cycles.iter().zip(&expected)) {
+        assert_eq!(got, want, "{inst:?}");
+    }
+}
@@ -0,0 +1,21 @@
+//! Headless cycle-counting harness for ROMs built by smdc
+//!
+//! Runs a ROM on an interpreted 68000 against a stubbed Mega Drive memory
+//! map, a frame at a time, and profiles where the clock periods go using the
+//! ROM's `.sym` file. Nothing is drawn or played: the point is measuring what
+//! the generated code costs, so codegen changes can be checked against real
+//! cycle counts rather than static estimates.
+//!
+//! `cargo bench -p smdsim` runs the SDK and crate examples through it.
+
+pub mod bus;
+pub mod compile;
+pub mod cpu;
+pub mod machine;
+pub mod sym;
+
+pub use bus::MegaDrive;
+pub use compile::{Image, compile, compile_source};
+pub use cpu::{Bus, Cpu, Fault};
+pub use machine::{Frame, FunctionStats, Machine, Profile};
+pub use sym::SymbolMap;
@@ -0,0 +1,260 @@
+//! Frame-stepped runs with per-function profiling
+//!
+//! Frames run from one VBlank interrupt to the next, so each [`Frame`] holds
+//! one pass of a typical game loop: the VBlank handler, then the main loop's
+//! update up to where it waits for the next frame.
+//!
+//! Waiting is recognised by what it does rather than by name, since games
+//! often inline their own: a loop iteration that ends with every register as
+//! it started, having changed no memory and written no port, is polling, and
+//! its time is idle. So are a `STOP` and a branch to itself.
+
+use crate::bus::{CYCLES_PER_FRAME, CYCLES_PER_LINE, MegaDrive, PortWrites, VBLANK_LINE};
+use crate::cpu::{Bus, Cpu, Fault, Flow};
+use crate::sym::SymbolMap;
+
+/// Level the VDP interrupts the 68000 at for VBlank
+const VBLANK_LEVEL: u8 = 6;
+
+/// One frame's worth of execution
+#[derive(Debug, Clone, Copy, Default, PartialEq, Eq)]
+pub struct Frame {
+    /// Clock periods, including any DMA stall
+    pub cycles: u32,
+    /// Clock periods spent waiting
+    pub idle: u32,
+    pub writes: PortWrites,
+}
+
+impl Frame {
+    /// Clock periods spent on actual work
+    pub fn busy(&self) -> u32 {
+        self.cycles - self.idle
+    }
+}
+
+/// Totals for one function
+#[derive(Debug, Clone, Copy, Default, PartialEq, Eq)]
+pub struct FunctionStats {
+    pub calls: u64,
+    /// Clock periods in the function's own code
+    pub self_cycles: u64,
+    /// Clock periods from entry to return, callees included
+    pub total_cycles: u64,
+}
+
+/// Call-graph profile, attributing time by the symbol each instruction
+/// falls under
+#[derive(Debug, Clone)]
+pub struct Profile {
+    symbols: SymbolMap,
+    /// One slot per symbol, then one for code below the first symbol
+    stats: Vec<FunctionStats>,
+    /// Shadow call stack: callee slot and entry time
+    stack: Vec<(usize, u64)>,
+}
+
+impl Profile {
+    fn new(symbols: SymbolMap) -> Self {
+        Self {
+            stats: vec![FunctionStats::default(); symbols.len() + 1],
+            symbols,
+            stack: Vec::new(),
+        }
+    }
+
+    fn slot(&self, pc: u32) -> usize {
+        self.symbols.index_at(pc).unwrap_or(self.symbols.len())
+    }
+
+    /// Charge `cycles` spent at `pc`, which ended at `now`
+    fn record(&mut self, pc: u32, cycles: u32, flow: Flow, now: u64) {
+        let slot = self.slot(pc);
+        self.stats[slot].self_cycles += u64::from(cycles);
+        match flow {
+            Flow::Sequential => {}
+            Flow::Call(target) | Flow::Interrupt(target) => {
+                let callee = self.slot(target);
+                self.stats[callee].calls += 1;
+                self.stack.push((callee, now - u64::from(cycles)));
+            }
+            Flow::Return => {
+                if let Some((callee, entered)) = self.stack.pop() {
+                    // Recursion is only counted at the outermost call
+                    if self.stack.iter().all(|&(slot, _)| slot != callee) {
+                        self.stats[callee].total_cycles += now - entered;
+                    }
+                }
+            }
+        }
+    }
+
+    pub fn symbols(&self) -> &SymbolMap {
+        &self.symbols
+    }
+
+    /// Functions with their totals, busiest first; code outside any symbol
+    /// is `?`
+    pub fn functions(&self) -> Vec<(&str, FunctionStats)> {
+        let mut functions: Vec<_> = self
+            .stats
+            .iter()
+            .enumerate()
+            .filter(|(_, stats)| stats.self_cycles > 0 || stats.calls > 0)
+            .map(|(slot, stats)| {
+                let name = if slot < self.symbols.len() {
+                    self.symbols.name(slot)
+                } else {
+                    "?"
+                };
+                (name, *stats)
+            })
+            .collect();
+        functions.sort_by(|a, b| b.1.self_cycles.cmp(&a.1.self_cycles).then(a.0.cmp(b.0)));
+        functions
+    }
+
+    /// Totals for `name`
+    pub fn function(&self, name: &str) -> Option<FunctionStats> {
+        self.symbols.index_of(name).map(|slot| self.stats[slot])
+    }
+}
+
+/// Machine state at the top of a loop iteration
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+struct LoopHead {
+    pc: u32,
+    d: [u32; 8],
+    a: [u32; 8],
+    sr: u16,
+    changes: u64,
+}
+
+/// 68000 and memory map, run a frame at a time
+pub struct Machine {
+    pub cpu: Cpu,
+    pub md: MegaDrive,
+    pub profile: Profile,
+    /// When the next VBlank starts
+    next_vblank: u64,
+    main: Option<u32>,
+    /// When `main` was first called
+    main_entered: Option<u64>,
+    /// Target of the last backward branch, and when it was taken
+    loop_head: Option<(LoopHead, u64)>,
+}
+
+impl Machine {
+    /// Power on with `rom` inserted. The reset and VBlank vectors get
+    /// `<reset>` and `<vblank>` symbols when nothing else names them.
+    pub fn new(rom: Vec<u8>, mut symbols: SymbolMap) -> Result<Self, Fault> {
+        let mut md = MegaDrive::new(rom);
+        let cpu = Cpu::new(&mut md)?;
+        let vblank = u32::from(md.read_word(0x78)) << 16 | u32::from(md.read_word(0x7A));
+        for (name, addr) in [("<reset>", cpu.pc), ("<vblank>", vblank)] {
+            if symbols
+                .index_at(addr)
+                .is_none_or(|i| symbols.address_at(i) != addr)
+            {
+                symbols.insert(name, addr);
+            }
+        }
+        md.now = cpu.cycles;
+        Ok(Self {
+            cpu,
+            main: symbols.address("main"),
+            profile: Profile::new(symbols),
+            md,
+            next_vblank: u64::from(VBLANK_LINE * CYCLES_PER_LINE),
+            main_entered: None,
+            loop_head: None,
+        })
+    }
+
+    /// Clock periods from power-on to the call to `main`, once it's happened
+    pub fn startup_cycles(&self) -> Option<u64> {
+        self.main_entered
+    }
+
+    /// Hold down `buttons` (`BTN_*` bits) on controller `port`
+    pub fn set_pad(&mut self, port: usize, buttons: u8) {
+        self.md.pads[port] = buttons;
+    }
+
+    /// Big-endian value of `size` bytes at `addr` in work RAM
+    pub fn read_ram(&self, addr: u32, size: usize) -> u32 {
+        let ram = self.md.ram();
+        (0..size).fold(0, |value, i| {
+            value << 8 | u32::from(ram[(addr as usize + i) & (ram.len() - 1)])
+        })
+    }
+
+    /// `symbol+offset` for `addr`
+    pub fn describe(&self, addr: u32) -> String {
+        let symbols = self.profile.symbols();
+        match symbols.index_at(addr) {
+            Some(i) => format!("{}+${:X}", symbols.name(i), addr - symbols.address_at(i)),
+            None => format!("${addr:06X}"),
+        }
+    }
+
+    /// After a backward branch: the clock periods since the previous one
+    /// when the loop just went round without doing anything
+    fn spin(&mut self) -> u64 {
+        let head = LoopHead {
+            pc: self.cpu.pc,
+            d: self.cpu.d,
+            a: self.cpu.a,
+            sr: self.cpu.sr(),
+            changes: self.md.changes,
+        };
+        match self.loop_head.replace((head, self.md.now)) {
+            Some((last, since)) if last == head => self.md.now - since,
+            _ => 0,
+        }
+    }
+
+    /// Run up to the start of the next VBlank
+    pub fn run_frame(&mut self) -> Result<Frame, Fault> {
+        let start = self.md.now;
+        let writes = self.md.writes;
+        let mut idle = 0;
+        while self.md.now < self.next_vblank {
+            let mut pc = self.cpu.pc;
+            let interrupt = if self.md.vdp.vint_pending && self.md.vdp.vint_enabled() {
+                self.cpu.interrupt(&mut self.md, VBLANK_LEVEL)?
+            } else {
+                None
+            };
+            let cycles = match interrupt {
+                Some(cycles) => {
+                    // Acknowledged; the exception's time is the handler's
+                    self.md.vdp.vint_pending = false;
+                    pc = self.cpu.pc;
+                    cycles
+                }
+                None => self.cpu.step(&mut self.md)?,
+            };
+            let cycles = cycles + std::mem::take(&mut self.md.vdp.dma_stall);
+            self.md.now += u64::from(cycles);
+            self.profile.record(pc, cycles, self.cpu.flow, self.md.now);
+            if self.cpu.is_stopped() {
+                idle += u64::from(cycles);
+            } else if interrupt.is_none() && self.cpu.flow == Flow::Sequential && self.cpu.pc <= pc
+            {
+                // Only this frame's share of an iteration begun in the last
+                idle += self.spin().min(self.md.now - start);
+            }
+            if self.main_entered.is_none() && self.main.map(Flow::Call) == Some(self.cpu.flow) {
+                self.main_entered = Some(self.md.now);
+            }
+        }
+        self.md.vdp.vint_pending = true;
+        self.next_vblank += u64::from(CYCLES_PER_FRAME);
+        Ok(Frame {
+            cycles: (self.md.now - start) as u32,
+            idle: idle as u32,
+            writes: self.md.writes - writes,
+        })
+    }
+}
@@ -0,0 +1,137 @@
+//! Symbol lookup from `.sym` files
+//!
+//! Reads the WLA DX symbol maps `generate_sym_file` writes, so the harness
+//! names code the same way an emulator's debugger would.
+
+use std::fmt;
+
+/// A `.sym` line that isn't `bank:address name`
+#[derive(Debug, Clone, PartialEq, Eq)]
+pub struct SymParseError {
+    /// 1-based line number
+    pub line: usize,
+}
+
+impl fmt::Display for SymParseError {
+    fn fmt(&self, f: &mut fmt::Formatter<'_>) -> fmt::Result {
+        write!(f, "malformed symbol on line {}", self.line)
+    }
+}
+
+impl std::error::Error for SymParseError {}
+
+/// Labels sorted by address
+#[derive(Debug, Clone, Default)]
+pub struct SymbolMap {
+    symbols: Vec<(u32, String)>,
+}
+
+impl SymbolMap {
+    /// Parse the `[labels]` section of a symbol file; comments and other
+    /// sections are skipped
+    pub fn parse(text: &str) -> Result<Self, SymParseError> {
+        let mut symbols = Vec::new();
+        let mut in_labels = false;
+        for (i, line) in text.lines().enumerate() {
+            let line = line.split(';').next().unwrap_or("").trim();
+            if line.is_empty() {
+                continue;
+            }
+            if line.starts_with('[') {
+                in_labels = line == "[labels]";
+                continue;
+            }
+            if !in_labels {
+                continue;
+            }
+            let error = SymParseError { line: i + 1 };
+            let (location, name) = line.split_once(' ').ok_or_else(|| error.clone())?;
+            let (_bank, address) = location.split_once(':').ok_or_else(|| error.clone())?;
+            let address = u32::from_str_radix(address, 16).map_err(|_| error)?;
+            symbols.push((address, name.trim().to_string()));
+        }
+        symbols.sort_by_key(|(address, _)| *address);
+        Ok(Self { symbols })
+    }
+
+    /// Number of symbols
+    pub fn len(&self) -> usize {
+        self.symbols.len()
+    }
+
+    pub fn is_empty(&self) -> bool {
+        self.symbols.is_empty()
+    }
+
+    /// Address of `name`
+    pub fn address(&self, name: &str) -> Option<u32> {
+        self.symbols
+            .iter()
+            .find(|(_, n)| n == name)
+            .map(|(address, _)| *address)
+    }
+
+    /// Index of the symbol `address` falls under: the last one at or below it
+    pub fn index_at(&self, address: u32) -> Option<usize> {
+        self.symbols
+            .partition_point(|(a, _)| *a <= address)
+            .checked_sub(1)
+    }
+
+    /// Name of the symbol at `index`
+    pub fn name(&self, index: usize) -> &str {
+        &self.symbols[index].1
+    }
+
+    /// Address of the symbol at `index`
+    pub fn address_at(&self, index: usize) -> u32 {
+        self.symbols[index].0
+    }
+
+    /// Add `name` at `address`, ahead of any symbol already there
+    pub fn insert(&mut self, name: &str, address: u32) {
+        let index = self.symbols.partition_point(|(a, _)| *a < address);
+        self.symbols.insert(index, (address, name.to_string()));
+    }
+
+    /// Index of `name`
+    pub fn index_of(&self, name: &str) -> Option<usize> {
+        self.symbols.iter().position(|(_, n)| n == name)
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use smd_compiler::backend::m68k::generate_sym_file;
+    use std::collections::HashMap;
+
+    #[test]
+    fn test_round_trip() {
+        let table = HashMap::from([
+            ("main".to_string(), 0x200),
+            ("update".to_string(), 0x240),
+            (".Lmain_entry".to_string(), 0x204),
+            ("player_x".to_string(), 0xFF8000),
+        ]);
+        let map = SymbolMap::parse(&generate_sym_file(&table)).unwrap();
+        assert_eq!(map.len(), 3);
+        assert_eq!(map.address("update"), Some(0x240));
+        assert_eq!(map.address(".Lmain_entry"), None);
+        assert_eq!(map.index_at(0x1FE), None);
+        assert_eq!(map.index_at(0x200).map(|i| map.name(i)), Some("main"));
+        assert_eq!(map.index_at(0x23E).map(|i| map.name(i)), Some("main"));
+        assert_eq!(map.index_at(0x300).map(|i| map.name(i)), Some("update"));
+    }
+
+    #[test]
+    fn test_malformed() {
+        assert_eq!(
+            SymbolMap::parse("[labels]\n00:000200 main\nbogus\n").unwrap_err(),
+            SymParseError { line: 3 }
+        );
+        // Only the labels section is read
+        let map = SymbolMap::parse("[information]\nbogus\n[labels]\n00:0200 a\n").unwrap();
+        assert_eq!(map.len(), 1);
+    }
+}
@@ -0,0 +1,106 @@
+//! Examples run headless without faulting
+
+use smdsim::{Machine, compile, compile_source};
+use std::path::{Path, PathBuf};
+
+fn examples() -> Vec<PathBuf> {
+    let root = Path::new(env!("CARGO_MANIFEST_DIR")).join("../..");
+    let mut paths = Vec::new();
+    for (dir, ext) in [("sdk/c/examples", "c"), ("crates/smd/examples", "rs")] {
+        for entry in std::fs::read_dir(root.join(dir)).unwrap() {
+            let path = entry.unwrap().path();
+            if path.extension().is_some_and(|e| e == ext) {
+                paths.push(path);
+            }
+        }
+    }
+    paths.sort();
+    paths
+}
+
+#[test]
+fn examples_run_without_faults() {
+    let mut ran = 0;
+    for path in examples() {
+        // Some examples use C the frontend doesn't take yet
+        let Ok(image) = compile(&path, 2) else {
+            continue;
+        };
+        let mut machine = Machine::new(image.rom, image.symbols).unwrap();
+        for frame in 0..90 {
+            // Press Start for the examples waiting on it
+            machine.set_pad(0, if (30..33).contains(&frame) { 0x80 } else { 0 });
+            if let Err(fault) = machine.run_frame() {
+                panic!(
+                    "{}: {fault} in {}",
+                    path.display(),
+                    machine.describe(fault.pc())
+                );
+            }
+        }
+        assert!(
+            machine.startup_cycles().is_some(),
+            "{}: main never called",
+            path.display()
+        );
+        ran += 1;
+    }
+    assert!(ran >= 6, "only {ran} examples compiled");
+}
+
+#[test]
+fn globals_hold_computed_values() {
+    let source = r"
+        int fib[12];
+        unsigned short checksum;
+        int main(void) {
+            fib[0] = 0;
+            fib[1] = 1;
+            for (int i = 2; i < 12; i++) {
+                fib[i] = fib[i - 1] + fib[i - 2];
+            }
+            checksum = (unsigned short)(fib[11] * 3 / 7);
+            while (1) {}
+        }
+    ";
+    for opt in [0, 2] {
+        let image = compile_source(source, "fib.c", opt).unwrap();
+        let mut machine = Machine::new(image.rom, image.symbols).unwrap();
+        for _ in 0..10 {
+            machine.run_frame().unwrap();
+        }
+        let symbols = &machine.profile.symbols();
+        let fib = symbols.address("fib").unwrap();
+        let checksum = symbols.address("checksum").unwrap();
+        assert_eq!(machine.read_ram(fib + 11 * 4, 4), 89, "-O{opt}");
+        assert_eq!(machine.read_ram(checksum, 2), 89 * 3 / 7, "-O{opt}");
+        let main = machine.profile.function("main").unwrap();
+        assert_eq!(main.calls, 1);
+        assert!(main.self_cycles > 0);
+    }
+}
+
+#[test]
+fn sprite_dirty_range_starts_clean() {
+    // No sprite_init, so the range is whatever .bss starts as: moving one
+    // sprite should send that entry alone, not every entry before it too
+    let source = r"
+        #include <smd/sprite.h>
+        #include <smd/vdp.h>
+        int main(void) {
+            sprite_set(5, 10, 20, SPRITE_SIZE_1x1, 0);
+            vdp_vsync();
+            while (1) {}
+        }
+    ";
+    for opt in [0, 2] {
+        let image = compile_source(source, "sprite.c", opt).unwrap();
+        let mut machine = Machine::new(image.rom, image.symbols).unwrap();
+        for _ in 0..3 {
+            machine.run_frame().unwrap();
+        }
+        // DMA length in words, from registers 19 and 20: one 8-byte entry
+        let registers = &machine.md.vdp.registers;
+        assert_eq!((registers[19], registers[20]), (4, 0), "-O{opt}");
+    }
+}
@@ -91,6 +91,8 @@
  * - smd/psg.h - PSG sound generation
  * - smd/ym2612.h - YM2612 FM synth
  * - smd/z80.h - Z80 sound driver interface
+ * - smd/sound.h - Built-in Z80 driver: DAC samples and FM songs
+ * - smd/math.h - Fixed-point sine, cosine and square root
  */
 
 #ifndef SMD_H
@@ -104,6 +106,8 @@
 #include "smd/psg.h"
 #include "smd/ym2612.h"
 #include "smd/z80.h"
+#include "smd/sound.h"
+#include "smd/math.h"
 
 /* ============================================================================
  * SDK Version
@@ -0,0 +1,27 @@
+/*
+ * smd/math.h - Fixed-point math for Sega Mega Drive
+ *
+ * Values are 8.8 fixed point: 256 is 1.0. Angles are in 1/256ths of a
+ * turn, so 64 is a right angle, and wrap around.
+ *
+ * The functions read tables the SDK places in ROM. With constant arguments,
+ * including in global initializers, smdc works the result out at compile
+ * time from the same tables.
+ *
+ * Note: smdc uses int for all parameters.
+ */
+
+#ifndef SMD_MATH_H
+#define SMD_MATH_H
+
+/* Fixed-point Format */
+#define FIX_ONE         256
+#define ANGLE_STEPS     256
+#define ANGLE_RIGHT     64
+
+/* Functions */
+int sin_fix(int angle);     /* -256..256 */
+int cos_fix(int angle);     /* -256..256 */
+int sqrt_fix(int x);        /* x taken as unsigned 16-bit */
+
+#endif /* SMD_MATH_H */
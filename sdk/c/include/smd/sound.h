@@ -0,0 +1,60 @@
+/*
+ * smd/sound.h - Built-in Z80 sound driver
+ *
+ * snd_init() loads a driver onto the Z80 that streams PCM samples to the
+ * YM2612 DAC and plays FM songs, so the 68000 only posts commands:
+ * - 2 PCM channels (0-1), mixed at about 13.3 kHz
+ * - 8-bit unsigned samples, centred at 128, like smd/samples.h
+ * - Songs of YM register writes and waits, ticking about 52 times a second
+ *
+ * Samples and songs must be in ROM (const data). Once the driver runs it
+ * owns the YM2612 and the Z80 bus: use these calls instead of ym_* and
+ * z80_*. Each call briefly stops the Z80 to post its command.
+ */
+
+#ifndef SMD_SOUND_H
+#define SMD_SOUND_H
+
+/* ========================================================================== */
+/* Song Events                                                                */
+/* ========================================================================== */
+
+/*
+ * A song is a byte array of events:
+ *
+ *   static const unsigned char song[] = {
+ *       SND_YM0, 0x28, 0xF0,    key on channel 1
+ *       SND_WAIT, 26,           half a second
+ *       SND_YM0, 0x28, 0x00,    key off
+ *       SND_WAIT, 26,
+ *       SND_LOOP
+ *   };
+ */
+#define SND_END         0x00    /* Stop */
+#define SND_YM0         0x01    /* reg, value: write YM port 0 */
+#define SND_YM1         0x02    /* reg, value: write YM port 1 */
+#define SND_WAIT        0x03    /* ticks: wait 1-255 ticks */
+#define SND_LOOP        0x04    /* Continue from the start */
+
+#define SND_TICK_RATE   52      /* Ticks per second, roughly */
+
+/* ========================================================================== */
+/* Functions                                                                  */
+/* ========================================================================== */
+
+/* Load and start the driver */
+void snd_init(void);
+
+/* Play len bytes of sample on channel, replacing what it was playing */
+void snd_play_sample(int channel, const unsigned char *sample, int len);
+
+/* Silence channel */
+void snd_stop_sample(int channel);
+
+/* Play song from the start */
+void snd_play_song(const unsigned char *song);
+
+/* Stop the song and key off all FM channels */
+void snd_stop_song(void);
+
+#endif /* SMD_SOUND_H */
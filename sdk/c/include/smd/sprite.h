@@ -4,6 +4,11 @@
  * The Genesis VDP supports up to 80 hardware sprites.
  * Each sprite can be 1-4 tiles wide and 1-4 tiles tall.
  *
+ * The sprite functions edit a copy of the sprite table in work RAM.
+ * Changed entries go to VRAM as one DMA during vblank:
+ * vdp_wait_vblank_start() sends them by itself, or call sprite_flush()
+ * once the frame's updates are done to queue them at that point.
+ *
  * Note: smdc uses int for all parameters.
  */
 
@@ -45,6 +50,7 @@ void sprite_hide(int index);
 void sprite_clear(int index);
 void sprite_clear_all(void);
 void sprite_set_link(int index, int next);
+void sprite_flush(void);
 int sprite_get_width(int size);
 int sprite_get_height(int size);
 int sprite_attr(int tile, int pal, int priority, int hflip, int vflip);
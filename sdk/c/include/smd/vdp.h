@@ -75,6 +75,7 @@ void vdp_set_vscroll_b(int scroll);
 /*
  * Wait for VBlank start - blocks until VBlank begins
  * Use this for consistent 60Hz (NTSC) or 50Hz (PAL) timing
+ * Then sends the changed sprites and starts queued DMAs.
  */
 void vdp_wait_vblank_start(void);
 
@@ -106,4 +107,57 @@ unsigned int vdp_get_frame_count(void);
  */
 void vdp_reset_frame_count(void);
 
+/*
+ * Optional hook - if the program defines it, the VBlank interrupt
+ * calls it once per frame, after counting the frame
+ * It can land between any two instructions of the main program, so
+ * leave the VDP ports to the main program.
+ */
+void vblank_handler(void);
+
+/* ========================================================================== */
+/* DMA Queue - VRAM updates deferred to VBlank                                */
+/* ========================================================================== */
+
+/*
+ * Queue a DMA from 68000 memory to VRAM (len in words)
+ * Returns: 1 if queued, 0 if the queue is full
+ * A transfer continuing the previous one is merged into it.
+ */
+int dma_queue_transfer(void *src, int dst, int len);
+
+/*
+ * Queue a VRAM fill of len bytes with value
+ * Returns: 1 if queued, 0 if the queue is full
+ */
+int dma_queue_fill(int dst, int value, int len);
+
+/*
+ * Queue a VRAM to VRAM copy of len bytes
+ * Returns: 1 if queued, 0 if the queue is full
+ */
+int dma_queue_copy(int src, int dst, int len);
+
+/*
+ * Start queued DMAs, oldest first, up to about one vblank's worth
+ * vdp_wait_vblank_start() calls this every frame; call it yourself only
+ * with the display off, e.g. while loading a level.
+ */
+void dma_queue_flush(void);
+
+/*
+ * Drop every queued DMA
+ */
+void dma_queue_clear(void);
+
+/*
+ * Load tiles packed at build time, starting at tile index
+ * The data comes from `smdc --asset NAME=FILE`, declared as
+ *     extern const unsigned char NAME[];
+ * It is unpacked into a RAM window and queued for DMA, so the tiles
+ * reach VRAM over the next vblanks. Waits for the queue to drain when
+ * the window is full, so don't call it from vblank_handler.
+ */
+void vdp_load_tiles_packed(const void *data, int index);
+
 #endif